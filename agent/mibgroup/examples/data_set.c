@@ -8,9 +8,6 @@
  *  containing the names of IETF working group chairs.  Obviously,
  *  this data isn't all that useful from a network management point of
  *  view but this example only demonstrates how to use and store data.
- *  For more useful examples (but more complex), check out the
- *  apps/notification_log.c file which implements parts of the
- *  NOTIFICATION-LOG-MIB for logging incoming SNMP notifications.
  *
  *  Much of this code could be automatically generated by running
  *  mib2c as follows:
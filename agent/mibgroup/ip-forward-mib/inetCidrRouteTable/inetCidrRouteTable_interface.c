@@ -2309,6 +2309,8 @@ void
 _inetCidrRouteTable_container_init(inetCidrRouteTable_interface_ctx *
                                    if_ctx)
 {
+    int             rc;
+
     DEBUGMSGTL(("internal:inetCidrRouteTable:_inetCidrRouteTable_container_init", "called\n"));
 
     /*
@@ -2329,7 +2331,7 @@ _inetCidrRouteTable_container_init(inetCidrRouteTable_interface_ctx *
     inetCidrRouteTable_container_init(&if_ctx->container, if_ctx->cache);
     if (NULL == if_ctx->container) {
         if_ctx->container =
-            netsnmp_container_find("inetCidrRouteTable:table_container");
+            netsnmp_container_find("inetCidrRouteTable:btree:table_container");
         if (NULL == if_ctx->container) {
             snmp_log(LOG_ERR, "error creating container in "
                      "inetCidrRouteTable_container_init\n");
@@ -2339,9 +2341,12 @@ _inetCidrRouteTable_container_init(inetCidrRouteTable_interface_ctx *
 
     if_ctx->container->container_name = strdup("inetCidrRouteTable");
 
-   /* set allow duplicates this makes insert O(1) */
-   netsnmp_binary_array_options_set(if_ctx->container, 1,
-                                    CONTAINER_KEY_ALLOW_DUPLICATES);
+    /* set allow duplicates this makes insert O(1) */
+    CONTAINER_SET_OPTIONS(if_ctx->container, CONTAINER_KEY_ALLOW_DUPLICATES,
+                          rc);
+    if (rc == -1)
+        snmp_log(LOG_WARNING, "inetCidrRouteTable container does not "
+                 "allow duplicates\n");
 
     if (NULL != if_ctx->cache)
         if_ctx->cache->magic = (void *) if_ctx->container;
@@ -15,15 +15,11 @@
 #include <net-snmp/agent/ds_agent.h>
 #include <net-snmp/agent/instance.h>
 #include <net-snmp/agent/table.h>
-#include <net-snmp/agent/table_data.h>
-#include <net-snmp/agent/table_dataset.h>
 #include "net-snmp/agent/sysORTable.h"
 #include "notification_log.h"
 
 netsnmp_feature_require(register_ulong_instance_context);
 netsnmp_feature_require(register_read_only_counter32_instance_context);
-netsnmp_feature_require(delete_table_data_set);
-netsnmp_feature_require(table_dataset);
 netsnmp_feature_require(date_n_time);
 
 /*
@@ -62,120 +58,183 @@ static u_long   num_deleted = 0;
 static u_long   max_logged = 1000;      /* goes against the mib default of infinite */
 static u_long   max_age = 1440; /* 1440 = 24 hours, which is the mib default */
 
-static netsnmp_table_data_set *nlmLogTable;
-static netsnmp_table_data_set *nlmLogVarTable;
+/*
+ * The log is a ring of entries, oldest first.  Notifications are only
+ * ever removed at the oldest end, so the nlmLogIndex values in the ring
+ * are consecutive: the entry for an index, or the one after it for a
+ * GETNEXT, is found by subtracting the index of the oldest entry.  The
+ * ring has room for max_logged entries, and is reallocated when that
+ * changes.
+ */
+typedef struct nlm_log_entry_s {
+    u_long          index;                  /* nlmLogIndex */
+    u_long          time;                   /* nlmLogTime */
+    u_char          dateandtime[11];
+    size_t          dateandtime_len;
+    u_char         *engineid;
+    size_t          engineid_len;
+    u_char          taddress[6];
+    size_t          taddress_len;           /* 0 if not received over UDP */
+    oid            *tdomain;
+    size_t          tdomain_len;            /* 0 without a transport */
+    u_char         *contextengineid;
+    size_t          contextengineid_len;
+    u_char         *contextname;
+    size_t          contextname_len;
+    oid            *notificationid;
+    size_t          notificationid_len;     /* 0 without snmpTrapOID.0 */
+    netsnmp_variable_list *vars;            /* nlmLogVariableIndex - 1 */
+    size_t          nvars;
+} nlm_log_entry;
+
+static nlm_log_entry **nlm_ring;
+static size_t   nlm_ring_size;
+static size_t   nlm_ring_head;          /* position of the oldest entry */
+static size_t   nlm_ring_count;
+static int      nlm_initialized;
+static unsigned int nlm_alarm;
+
+static netsnmp_handler_registration *nlm_log_reg;
+static netsnmp_handler_registration *nlm_var_reg;
+
+/* the nlmLogName index of the only log */
+static const oid nlm_default_name[] = { 7, 'd', 'e', 'f', 'a', 'u', 'l', 't' };
 
 static oid nlm_module_oid[] = { SNMP_OID_MIB2, 92 }; /* NOTIFICATION-LOG-MIB::notificationLogMIB */
 
+static nlm_log_entry *
+_nlm_entry_at(size_t pos)
+{
+    return nlm_ring[(nlm_ring_head + pos) % nlm_ring_size];
+}
+
+/*
+ * the position of the first entry with an nlmLogIndex of at least
+ * index, or nlm_ring_count if there is none
+ */
+static size_t
+_nlm_position(oid index)
+{
+    u_long          first;
+
+    if (nlm_ring_count == 0)
+        return 0;
+    first = _nlm_entry_at(0)->index;
+    if (index <= first)
+        return 0;
+    if (index - first >= nlm_ring_count)
+        return nlm_ring_count;
+    return index - first;
+}
+
 static void
-netsnmp_notif_log_remove_oldest(int count)
+_nlm_entry_free(nlm_log_entry *e)
 {
-    netsnmp_table_row *deleterow, *tmprow, *deletevarrow;
-    
-    DEBUGMSGTL(("notification_log", "deleting %d log entry(s)\n", count));
+    size_t          i;
+
+    for (i = 0; i < e->nvars; i++)
+        snmp_free_var_internals(&e->vars[i]);
+    SNMP_FREE(e->vars);
+    SNMP_FREE(e->engineid);
+    SNMP_FREE(e->tdomain);
+    SNMP_FREE(e->contextengineid);
+    SNMP_FREE(e->contextname);
+    SNMP_FREE(e->notificationid);
+    free(e);
+}
 
-    deleterow = netsnmp_table_data_set_get_first_row(nlmLogTable);
-    for (; count && deleterow; deleterow = tmprow, --count) {
-        /*
-         * delete contained varbinds
-         * xxx-rks: note that this assumes that only the default
-         * log is used (ie for the first nlmLogTable row, the
-         * first nlmLogVarTable rows will be the right ones).
-         * the right thing to do would be to do a find based on
-         * the nlmLogTable oid.
-         */
-        DEBUGMSGTL(("9:notification_log", "  deleting notification\n"));
-        DEBUGIF("9:notification_log") {
-            DEBUGMSGTL(("9:notification_log",
-                        " base oid:"));
-            DEBUGMSGOID(("9:notification_log", deleterow->index_oid,
-                         deleterow->index_oid_len));
-            DEBUGMSG(("9:notification_log", "\n"));
-        }
-        deletevarrow = netsnmp_table_data_set_get_first_row(nlmLogVarTable);
-        for (; deletevarrow; deletevarrow = tmprow) {
-
-            tmprow = netsnmp_table_data_set_get_next_row(nlmLogVarTable,
-                                                          deletevarrow);
-            
-            DEBUGIF("9:notification_log") {
-                DEBUGMSGTL(("9:notification_log",
-                            "         :"));
-                DEBUGMSGOID(("9:notification_log", deletevarrow->index_oid,
-                             deletevarrow->index_oid_len));
-                DEBUGMSG(("9:notification_log", "\n"));
-            }
-            if ((deleterow->index_oid_len == deletevarrow->index_oid_len - 1) &&
-                snmp_oid_compare(deleterow->index_oid,
-                                 deleterow->index_oid_len,
-                                 deletevarrow->index_oid,
-                                 deleterow->index_oid_len) == 0) {
-                DEBUGMSGTL(("9:notification_log", "    deleting varbind\n"));
-                netsnmp_table_dataset_remove_and_delete_row(nlmLogVarTable,
-                                                             deletevarrow);
-            }
-            else
-                break;
-        }
-        
-        /*
-         * delete the master row 
-         */
-        tmprow = netsnmp_table_data_set_get_next_row(nlmLogTable, deleterow);
-        netsnmp_table_dataset_remove_and_delete_row(nlmLogTable,
-                                                     deleterow);
+static int
+_nlm_dup(void *to, size_t *to_len, const void *from, size_t len)
+{
+    *(void **) to = NULL;
+    *to_len = 0;
+    if (from == NULL || len == 0)
+        return 0;
+    *(void **) to = netsnmp_memdup(from, len);
+    if (*(void **) to == NULL)
+        return -1;
+    *to_len = len;
+    return 0;
+}
+
+static void
+netsnmp_notif_log_remove_oldest(u_long count)
+{
+    nlm_log_entry  *e;
+
+    DEBUGMSGTL(("notification_log", "deleting %lu log entry(s)\n", count));
+
+    for (; count && nlm_ring_count; --count) {
+        e = nlm_ring[nlm_ring_head];
+        DEBUGMSGTL(("9:notification_log", "  deleting notification %lu\n",
+                    e->index));
+        _nlm_entry_free(e);
+        nlm_ring[nlm_ring_head] = NULL;
+        nlm_ring_head = (nlm_ring_head + 1) % nlm_ring_size;
+        nlm_ring_count--;
         num_deleted++;
     }
     /** should have deleted all of them */
     netsnmp_assert(0 == count);
 }
 
+/*
+ * give the ring room for max_logged entries, keeping the newest ones
+ */
 static void
-check_log_size(unsigned int clientreg, void *clientarg)
+netsnmp_notif_log_resize(void)
 {
-    netsnmp_table_row *row;
-    netsnmp_table_data_set_storage *data;
-    u_long          count = 0;
-    u_long          uptime;
+    nlm_log_entry **ring = NULL;
+    size_t          size = max_logged;
+    size_t          i;
 
-    uptime = netsnmp_get_agent_uptime();
-
-    if (!nlmLogTable || !nlmLogTable->table )  {
-        DEBUGMSGTL(("notification_log", "missing log table\n"));
+    if (size == nlm_ring_size)
         return;
+    if (size) {
+        ring = (nlm_log_entry **) calloc(size, sizeof(*ring));
+        if (ring == NULL) {
+            snmp_log(LOG_ERR, "notification log: cannot hold %lu "
+                     "notifications, keeping the limit at %lu\n",
+                     max_logged, (u_long) nlm_ring_size);
+            max_logged = nlm_ring_size;
+            return;
+        }
     }
+    DEBUGMSGTL(("notification_log", "room for %lu notifications\n",
+                max_logged));
+    if (nlm_ring_count > size)
+        netsnmp_notif_log_remove_oldest(nlm_ring_count - size);
+    for (i = 0; i < nlm_ring_count; i++)
+        ring[i] = _nlm_entry_at(i);
+    free(nlm_ring);
+    nlm_ring = ring;
+    nlm_ring_size = size;
+    nlm_ring_head = 0;
+}
+
+static void
+check_log_size(unsigned int clientreg, void *clientarg)
+{
+    u_long          count = 0;
+    u_long          uptime;
 
     /*
      * check max allowed count
      */
-    count = netsnmp_table_set_num_rows(nlmLogTable);
     DEBUGMSGTL(("notification_log",
                 "logged notifications %lu; max %lu\n",
-                    count, max_logged));
-    if (count > max_logged) {
-        count = count - max_logged;
-        DEBUGMSGTL(("notification_log", "removing %lu extra notifications\n",
-                    count));
-        netsnmp_notif_log_remove_oldest(count);
-    }
+                    (u_long) nlm_ring_count, max_logged));
+    netsnmp_notif_log_resize();
 
     /*
-     * check max age 
+     * check max age: the oldest ones expire first
      */
     if (0 == max_age)
         return;
-    count = 0;
-    for (row = netsnmp_table_data_set_get_first_row(nlmLogTable);
-         row;
-         row = netsnmp_table_data_set_get_next_row(nlmLogTable, row)) {
-
-        data = (netsnmp_table_data_set_storage *) row->data;
-        data = netsnmp_table_data_set_find_column(data, COLUMN_NLMLOGTIME);
-
-        if (uptime < ((u_long)(*(data->data.integer) + max_age * 100 * 60)))
-            break;
+    uptime = netsnmp_get_agent_uptime();
+    while (count < nlm_ring_count &&
+           uptime >= _nlm_entry_at(count)->time + max_age * 100 * 60)
         ++count;
-    }
 
     if (count) {
         DEBUGMSGTL(("notification_log", "removing %lu expired notifications\n",
@@ -184,8 +243,349 @@ check_log_size(unsigned int clientreg, void *clientarg)
     }
 }
 
+/*
+ * compares a request index with the name of the log: returns -1 if it
+ * sorts after all the rows, 0 if before all of them, and 1 if among
+ * them, with what follows the name in *rest
+ */
+static int
+_nlm_locate(const oid *index, size_t index_len,
+            const oid **rest, size_t *rest_len)
+{
+    size_t          i;
 
-/** Initialize the nlmLogVariableTable table by defining its contents and how it's structured */
+    for (i = 0; i < index_len && i < OID_LENGTH(nlm_default_name); i++) {
+        if (index[i] < nlm_default_name[i])
+            return 0;
+        if (index[i] > nlm_default_name[i])
+            return -1;
+    }
+    if (index_len <= OID_LENGTH(nlm_default_name))
+        return 0;
+    *rest = index + OID_LENGTH(nlm_default_name);
+    *rest_len = index_len - OID_LENGTH(nlm_default_name);
+    return 1;
+}
+
+/*
+ * set the varbind of a GETNEXT to a row of the log, given its
+ * nlmLogIndex and, in the variable table, nlmLogVariableIndex
+ */
+static void
+_nlm_set_row_oid(netsnmp_variable_list *vb,
+                 netsnmp_handler_registration *reginfo, int column,
+                 u_long index, u_long varindex)
+{
+    oid             name[MAX_OID_LEN];
+    size_t          len = reginfo->rootoid_len;
+
+    memcpy(name, reginfo->rootoid, len * sizeof(oid));
+    name[len++] = 1;                                 /* entry */
+    name[len++] = column;
+    memcpy(name + len, nlm_default_name, sizeof(nlm_default_name));
+    len += OID_LENGTH(nlm_default_name);
+    name[len++] = index;
+    if (varindex)
+        name[len++] = varindex;
+    snmp_set_var_objid(vb, name, len);
+}
+
+/*
+ * the nlmLogVariableTable column holding a value of the given type, and
+ * the nlmLogVariableValueType for it; 0 if the type is not supported
+ */
+static int
+_nlm_var_column(u_char type, long *valuetype)
+{
+    switch (type) {
+    case ASN_OBJECT_ID:
+        *valuetype = 7;
+        return COLUMN_NLMLOGVARIABLEOIDVAL;
+    case ASN_INTEGER:
+        *valuetype = 4;
+        return COLUMN_NLMLOGVARIABLEINTEGER32VAL;
+    case ASN_UNSIGNED:
+        *valuetype = 2;
+        return COLUMN_NLMLOGVARIABLEUNSIGNED32VAL;
+    case ASN_COUNTER:
+        *valuetype = 1;
+        return COLUMN_NLMLOGVARIABLECOUNTER32VAL;
+    case ASN_TIMETICKS:
+        *valuetype = 3;
+        return COLUMN_NLMLOGVARIABLETIMETICKSVAL;
+    case ASN_OCTET_STR:
+        *valuetype = 6;
+        return COLUMN_NLMLOGVARIABLEOCTETSTRINGVAL;
+    case ASN_IPADDRESS:
+        *valuetype = 5;
+        return COLUMN_NLMLOGVARIABLEIPADDRESSVAL;
+    case ASN_COUNTER64:
+        *valuetype = 8;
+        return COLUMN_NLMLOGVARIABLECOUNTER64VAL;
+    case ASN_OPAQUE:
+        *valuetype = 9;
+        return COLUMN_NLMLOGVARIABLEOPAQUEVAL;
+    default:
+        return 0;
+    }
+}
+
+/*
+ * set vb to a column of an nlmLogTable row; returns 0 if the row has no
+ * such column
+ */
+static int
+_nlm_log_value(netsnmp_variable_list *vb, nlm_log_entry *e, int column)
+{
+    switch (column) {
+    case COLUMN_NLMLOGTIME:
+        snmp_set_var_typed_value(vb, ASN_TIMETICKS, &e->time,
+                                 sizeof(e->time));
+        break;
+    case COLUMN_NLMLOGDATEANDTIME:
+        snmp_set_var_typed_value(vb, ASN_OCTET_STR, e->dateandtime,
+                                 e->dateandtime_len);
+        break;
+    case COLUMN_NLMLOGENGINEID:
+        snmp_set_var_typed_value(vb, ASN_OCTET_STR, e->engineid,
+                                 e->engineid_len);
+        break;
+    case COLUMN_NLMLOGENGINETADDRESS:
+        if (!e->taddress_len)
+            return 0;
+        snmp_set_var_typed_value(vb, ASN_OCTET_STR, e->taddress,
+                                 e->taddress_len);
+        break;
+    case COLUMN_NLMLOGENGINETDOMAIN:
+        if (!e->tdomain_len)
+            return 0;
+        snmp_set_var_typed_value(vb, ASN_OBJECT_ID, e->tdomain,
+                                 e->tdomain_len * sizeof(oid));
+        break;
+    case COLUMN_NLMLOGCONTEXTENGINEID:
+        snmp_set_var_typed_value(vb, ASN_OCTET_STR, e->contextengineid,
+                                 e->contextengineid_len);
+        break;
+    case COLUMN_NLMLOGCONTEXTNAME:
+        snmp_set_var_typed_value(vb, ASN_OCTET_STR, e->contextname,
+                                 e->contextname_len);
+        break;
+    case COLUMN_NLMLOGNOTIFICATIONID:
+        if (!e->notificationid_len)
+            return 0;
+        snmp_set_var_typed_value(vb, ASN_OBJECT_ID, e->notificationid,
+                                 e->notificationid_len * sizeof(oid));
+        break;
+    default:
+        return 0;
+    }
+    return 1;
+}
+
+/*
+ * set vb to a column of an nlmLogVariableTable row; returns 0 if the
+ * row has no such column
+ */
+static int
+_nlm_var_value(netsnmp_variable_list *vb, netsnmp_variable_list *var,
+               int column)
+{
+    long            valuetype;
+    int             valuecolumn = _nlm_var_column(var->type, &valuetype);
+
+    if (!valuecolumn)
+        return 0;
+    if (column == COLUMN_NLMLOGVARIABLEID)
+        snmp_set_var_typed_value(vb, ASN_OBJECT_ID, var->name,
+                                 var->name_length * sizeof(oid));
+    else if (column == COLUMN_NLMLOGVARIABLEVALUETYPE)
+        snmp_set_var_typed_value(vb, ASN_INTEGER, &valuetype,
+                                 sizeof(valuetype));
+    else if (column == valuecolumn)
+        snmp_set_var_typed_value(vb, var->type, var->val.string,
+                                 var->val_len);
+    else
+        return 0;
+    return 1;
+}
+
+static int
+nlmLogTable_handler(netsnmp_mib_handler *handler,
+                    netsnmp_handler_registration *reginfo,
+                    netsnmp_agent_request_info *reqinfo,
+                    netsnmp_request_info *requests)
+{
+    netsnmp_request_info *request;
+    netsnmp_table_request_info *table_info;
+    nlm_log_entry  *e;
+    const oid      *rest = NULL;
+    size_t          rest_len = 0;
+    size_t          pos;
+    int             column;
+
+    for (request = requests; request; request = request->next) {
+        if (request->processed)
+            continue;
+        table_info = netsnmp_extract_table_info(request);
+
+        switch (reqinfo->mode) {
+        case MODE_GET:
+            e = NULL;
+            if (_nlm_locate(table_info->index_oid, table_info->index_oid_len,
+                            &rest, &rest_len) == 1 && rest_len == 1) {
+                pos = _nlm_position(rest[0]);
+                if (pos < nlm_ring_count &&
+                    _nlm_entry_at(pos)->index == rest[0])
+                    e = _nlm_entry_at(pos);
+            }
+            if (!e || !_nlm_log_value(request->requestvb, e,
+                                      table_info->colnum))
+                netsnmp_set_request_error(reqinfo, request,
+                                          SNMP_NOSUCHINSTANCE);
+            break;
+
+        case MODE_GETNEXT:
+            switch (_nlm_locate(table_info->index_oid,
+                                table_info->index_oid_len,
+                                &rest, &rest_len)) {
+            case 0:
+                pos = 0;
+                break;
+            case 1:
+                /* the rows after LOGINDEX and anything below it */
+                pos = _nlm_position(rest[0]);
+                if (pos < nlm_ring_count &&
+                    _nlm_entry_at(pos)->index == rest[0])
+                    pos++;
+                break;
+            default:
+                pos = nlm_ring_count;
+                break;
+            }
+            /*
+             * the rest of this column, then the next columns from their
+             * first row: a row need not have every column
+             */
+            for (column = table_info->colnum;
+                 column <= COLUMN_NLMLOGNOTIFICATIONID; column++, pos = 0) {
+                for (; pos < nlm_ring_count; pos++)
+                    if (_nlm_log_value(request->requestvb, _nlm_entry_at(pos),
+                                       column))
+                        break;
+                if (pos < nlm_ring_count)
+                    break;
+            }
+            if (column > COLUMN_NLMLOGNOTIFICATIONID) {
+                netsnmp_set_request_error(reqinfo, request,
+                                          SNMP_ENDOFMIBVIEW);
+                continue;
+            }
+            _nlm_set_row_oid(request->requestvb, reginfo, column,
+                             _nlm_entry_at(pos)->index, 0);
+            break;
+
+        default:
+            netsnmp_set_request_error(reqinfo, request, SNMP_ERR_GENERR);
+            return SNMP_ERR_GENERR;
+        }
+    }
+    return SNMP_ERR_NOERROR;
+}
+
+static int
+nlmLogVariableTable_handler(netsnmp_mib_handler *handler,
+                            netsnmp_handler_registration *reginfo,
+                            netsnmp_agent_request_info *reqinfo,
+                            netsnmp_request_info *requests)
+{
+    netsnmp_request_info *request;
+    netsnmp_table_request_info *table_info;
+    nlm_log_entry  *e;
+    const oid      *rest = NULL;
+    size_t          rest_len = 0;
+    size_t          pos, vpos;
+    int             column, found;
+
+    for (request = requests; request; request = request->next) {
+        if (request->processed)
+            continue;
+        table_info = netsnmp_extract_table_info(request);
+
+        switch (reqinfo->mode) {
+        case MODE_GET:
+            e = NULL;
+            if (_nlm_locate(table_info->index_oid, table_info->index_oid_len,
+                            &rest, &rest_len) == 1 && rest_len == 2) {
+                pos = _nlm_position(rest[0]);
+                if (pos < nlm_ring_count &&
+                    _nlm_entry_at(pos)->index == rest[0])
+                    e = _nlm_entry_at(pos);
+            }
+            if (!e || rest[1] < 1 || rest[1] > e->nvars ||
+                !_nlm_var_value(request->requestvb, &e->vars[rest[1] - 1],
+                                table_info->colnum))
+                netsnmp_set_request_error(reqinfo, request,
+                                          SNMP_NOSUCHINSTANCE);
+            break;
+
+        case MODE_GETNEXT:
+            vpos = 0;
+            switch (_nlm_locate(table_info->index_oid,
+                                table_info->index_oid_len,
+                                &rest, &rest_len)) {
+            case 0:
+                pos = 0;
+                break;
+            case 1:
+                /*
+                 * the rows below LOGINDEX, after LOGINDEX.VARINDEX if
+                 * given, whose position is VARINDEX
+                 */
+                pos = _nlm_position(rest[0]);
+                if (rest_len > 1 && pos < nlm_ring_count &&
+                    _nlm_entry_at(pos)->index == rest[0]) {
+                    e = _nlm_entry_at(pos);
+                    vpos = rest[1] < e->nvars ? rest[1] : e->nvars;
+                }
+                break;
+            default:
+                pos = nlm_ring_count;
+                break;
+            }
+            /*
+             * the rest of this column, then the next columns from their
+             * first row: only one of the value columns is set in a row
+             */
+            found = 0;
+            for (column = table_info->colnum;
+                 !found && column <= COLUMN_NLMLOGVARIABLEOPAQUEVAL;
+                 column++, pos = 0, vpos = 0) {
+                for (; !found && pos < nlm_ring_count; pos++, vpos = 0) {
+                    e = _nlm_entry_at(pos);
+                    for (; vpos < e->nvars; vpos++)
+                        if (_nlm_var_value(request->requestvb,
+                                           &e->vars[vpos], column)) {
+                            _nlm_set_row_oid(request->requestvb, reginfo,
+                                             column, e->index, vpos + 1);
+                            found = 1;
+                            break;
+                        }
+                }
+            }
+            if (!found)
+                netsnmp_set_request_error(reqinfo, request,
+                                          SNMP_ENDOFMIBVIEW);
+            break;
+
+        default:
+            netsnmp_set_request_error(reqinfo, request, SNMP_ERR_GENERR);
+            return SNMP_ERR_GENERR;
+        }
+    }
+    return SNMP_ERR_NOERROR;
+}
+
+/** Initialize the nlmLogVariableTable table by defining how it's structured */
 static void
 initialize_table_nlmLogVariableTable(const char * context)
 {
@@ -193,274 +593,78 @@ initialize_table_nlmLogVariableTable(const char * context)
         { 1, 3, 6, 1, 2, 1, 92, 1, 3, 2 };
     size_t          nlmLogVariableTable_oid_len =
         OID_LENGTH(nlmLogVariableTable_oid);
-    netsnmp_table_data_set *table_set;
+    netsnmp_table_registration_info *table_info;
     netsnmp_handler_registration *reginfo;
 
     /*
-     * create the table structure itself 
-     */
-    table_set = netsnmp_create_table_data_set("nlmLogVariableTable");
-    nlmLogVarTable = table_set;
-    nlmLogVarTable->table->store_indexes = 1;
-
-    /***************************************************
-     * Adding indexes
-     */
-    /*
-     * declaring the nlmLogName index
-     */
-    DEBUGMSGTL(("initialize_table_nlmLogVariableTable",
-                "adding index nlmLogName of type ASN_OCTET_STR to table nlmLogVariableTable\n"));
-    netsnmp_table_dataset_add_index(table_set, ASN_OCTET_STR);
-    /*
-     * declaring the nlmLogIndex index
-     */
-    DEBUGMSGTL(("initialize_table_nlmLogVariableTable",
-                "adding index nlmLogIndex of type ASN_UNSIGNED to table nlmLogVariableTable\n"));
-    netsnmp_table_dataset_add_index(table_set, ASN_UNSIGNED);
-    /*
-     * declaring the nlmLogVariableIndex index
-     */
-    DEBUGMSGTL(("initialize_table_nlmLogVariableTable",
-                "adding index nlmLogVariableIndex of type ASN_UNSIGNED to table nlmLogVariableTable\n"));
-    netsnmp_table_dataset_add_index(table_set, ASN_UNSIGNED);
-
-    /*
-     * adding column nlmLogVariableID of type ASN_OBJECT_ID and access of
-     * ReadOnly 
-     */
-    DEBUGMSGTL(("initialize_table_nlmLogVariableTable",
-                "adding column nlmLogVariableID (#2) of type ASN_OBJECT_ID to table nlmLogVariableTable\n"));
-    netsnmp_table_set_add_default_row(table_set, COLUMN_NLMLOGVARIABLEID,
-                                      ASN_OBJECT_ID, 0, NULL, 0);
-    /*
-     * adding column nlmLogVariableValueType of type ASN_INTEGER and
-     * access of ReadOnly 
-     */
-    DEBUGMSGTL(("initialize_table_nlmLogVariableTable",
-                "adding column nlmLogVariableValueType (#3) of type ASN_INTEGER to table nlmLogVariableTable\n"));
-    netsnmp_table_set_add_default_row(table_set,
-                                      COLUMN_NLMLOGVARIABLEVALUETYPE,
-                                      ASN_INTEGER, 0, NULL, 0);
-    /*
-     * adding column nlmLogVariableCounter32Val of type ASN_COUNTER and
-     * access of ReadOnly 
-     */
-    DEBUGMSGTL(("initialize_table_nlmLogVariableTable",
-                "adding column nlmLogVariableCounter32Val (#4) of type ASN_COUNTER to table nlmLogVariableTable\n"));
-    netsnmp_table_set_add_default_row(table_set,
-                                      COLUMN_NLMLOGVARIABLECOUNTER32VAL,
-                                      ASN_COUNTER, 0, NULL, 0);
-    /*
-     * adding column nlmLogVariableUnsigned32Val of type ASN_UNSIGNED and
-     * access of ReadOnly 
-     */
-    DEBUGMSGTL(("initialize_table_nlmLogVariableTable",
-                "adding column nlmLogVariableUnsigned32Val (#5) of type ASN_UNSIGNED to table nlmLogVariableTable\n"));
-    netsnmp_table_set_add_default_row(table_set,
-                                      COLUMN_NLMLOGVARIABLEUNSIGNED32VAL,
-                                      ASN_UNSIGNED, 0, NULL, 0);
-    /*
-     * adding column nlmLogVariableTimeTicksVal of type ASN_TIMETICKS and
-     * access of ReadOnly 
-     */
-    DEBUGMSGTL(("initialize_table_nlmLogVariableTable",
-                "adding column nlmLogVariableTimeTicksVal (#6) of type ASN_TIMETICKS to table nlmLogVariableTable\n"));
-    netsnmp_table_set_add_default_row(table_set,
-                                      COLUMN_NLMLOGVARIABLETIMETICKSVAL,
-                                      ASN_TIMETICKS, 0, NULL, 0);
-    /*
-     * adding column nlmLogVariableInteger32Val of type ASN_INTEGER and
-     * access of ReadOnly 
-     */
-    DEBUGMSGTL(("initialize_table_nlmLogVariableTable",
-                "adding column nlmLogVariableInteger32Val (#7) of type ASN_INTEGER to table nlmLogVariableTable\n"));
-    netsnmp_table_set_add_default_row(table_set,
-                                      COLUMN_NLMLOGVARIABLEINTEGER32VAL,
-                                      ASN_INTEGER, 0, NULL, 0);
-    /*
-     * adding column nlmLogVariableOctetStringVal of type ASN_OCTET_STR
-     * and access of ReadOnly 
-     */
-    DEBUGMSGTL(("initialize_table_nlmLogVariableTable",
-                "adding column nlmLogVariableOctetStringVal (#8) of type ASN_OCTET_STR to table nlmLogVariableTable\n"));
-    netsnmp_table_set_add_default_row(table_set,
-                                      COLUMN_NLMLOGVARIABLEOCTETSTRINGVAL,
-                                      ASN_OCTET_STR, 0, NULL, 0);
-    /*
-     * adding column nlmLogVariableIpAddressVal of type ASN_IPADDRESS and
-     * access of ReadOnly 
-     */
-    DEBUGMSGTL(("initialize_table_nlmLogVariableTable",
-                "adding column nlmLogVariableIpAddressVal (#9) of type ASN_IPADDRESS to table nlmLogVariableTable\n"));
-    netsnmp_table_set_add_default_row(table_set,
-                                      COLUMN_NLMLOGVARIABLEIPADDRESSVAL,
-                                      ASN_IPADDRESS, 0, NULL, 0);
-    /*
-     * adding column nlmLogVariableOidVal of type ASN_OBJECT_ID and access 
-     * of ReadOnly 
-     */
-    DEBUGMSGTL(("initialize_table_nlmLogVariableTable",
-                "adding column nlmLogVariableOidVal (#10) of type ASN_OBJECT_ID to table nlmLogVariableTable\n"));
-    netsnmp_table_set_add_default_row(table_set,
-                                      COLUMN_NLMLOGVARIABLEOIDVAL,
-                                      ASN_OBJECT_ID, 0, NULL, 0);
-    /*
-     * adding column nlmLogVariableCounter64Val of type ASN_COUNTER64 and
-     * access of ReadOnly 
-     */
-    DEBUGMSGTL(("initialize_table_nlmLogVariableTable",
-                "adding column nlmLogVariableCounter64Val (#11) of type ASN_COUNTER64 to table nlmLogVariableTable\n"));
-    netsnmp_table_set_add_default_row(table_set,
-                                      COLUMN_NLMLOGVARIABLECOUNTER64VAL,
-                                      ASN_COUNTER64, 0, NULL, 0);
-    /*
-     * adding column nlmLogVariableOpaqueVal of type ASN_OPAQUE and access 
-     * of ReadOnly 
+     * indexes: nlmLogName, nlmLogIndex and nlmLogVariableIndex
      */
-    DEBUGMSGTL(("initialize_table_nlmLogVariableTable",
-                "adding column nlmLogVariableOpaqueVal (#12) of type ASN_OPAQUE to table nlmLogVariableTable\n"));
-    netsnmp_table_set_add_default_row(table_set,
-                                      COLUMN_NLMLOGVARIABLEOPAQUEVAL,
-                                      ASN_OPAQUE, 0, NULL, 0);
+    table_info = SNMP_MALLOC_TYPEDEF(netsnmp_table_registration_info);
+    if (!table_info)
+        return;
+    netsnmp_table_helper_add_indexes(table_info, ASN_OCTET_STR,
+                                     ASN_UNSIGNED, ASN_UNSIGNED, 0);
+    table_info->min_column = COLUMN_NLMLOGVARIABLEID;
+    table_info->max_column = COLUMN_NLMLOGVARIABLEOPAQUEVAL;
 
     /*
      * registering the table with the master agent 
      */
-    /*
-     * note: if you don't need a subhandler to deal with any aspects of
-     * the request, change nlmLogVariableTable_handler to "NULL" 
-     */
     reginfo =
         netsnmp_create_handler_registration ("nlmLogVariableTable",
-                                             NULL,
+                                             nlmLogVariableTable_handler,
                                              nlmLogVariableTable_oid,
                                              nlmLogVariableTable_oid_len,
-                                             HANDLER_CAN_RWRITE);
+                                             HANDLER_CAN_RONLY);
     if (NULL != context)
         reginfo->contextName = strdup(context);
-    netsnmp_register_table_data_set(reginfo, table_set, NULL);
+    if (netsnmp_register_table(reginfo, table_info) != MIB_REGISTERED_OK)
+        return;
+    netsnmp_handler_owns_table_info(reginfo->handler->next);
+    nlm_var_reg = reginfo;
 }
 
-/** Initialize the nlmLogTable table by defining its contents and how it's structured */
+/** Initialize the nlmLogTable table by defining how it's structured */
 static void
 initialize_table_nlmLogTable(const char * context)
 {
     static oid      nlmLogTable_oid[] = { 1, 3, 6, 1, 2, 1, 92, 1, 3, 1 };
     size_t          nlmLogTable_oid_len = OID_LENGTH(nlmLogTable_oid);
+    netsnmp_table_registration_info *table_info;
     netsnmp_handler_registration *reginfo;
 
     /*
-     * create the table structure itself 
-     */
-    nlmLogTable = netsnmp_create_table_data_set("nlmLogTable");
-
-    /***************************************************
-     * Adding indexes
-     */
-    /*
-     * declaring the nlmLogIndex index
-     */
-    DEBUGMSGTL(("initialize_table_nlmLogTable",
-                "adding index nlmLogName of type ASN_OCTET_STR to table nlmLogTable\n"));
-    netsnmp_table_dataset_add_index(nlmLogTable, ASN_OCTET_STR);
-
-    DEBUGMSGTL(("initialize_table_nlmLogTable",
-                "adding index nlmLogIndex of type ASN_UNSIGNED to table nlmLogTable\n"));
-    netsnmp_table_dataset_add_index(nlmLogTable, ASN_UNSIGNED);
-
-    /*
-     * adding column nlmLogTime of type ASN_TIMETICKS and access of
-     * ReadOnly 
+     * indexes: nlmLogName and nlmLogIndex
      */
-    DEBUGMSGTL(("initialize_table_nlmLogTable",
-                "adding column nlmLogTime (#2) of type ASN_TIMETICKS to table nlmLogTable\n"));
-    netsnmp_table_set_add_default_row(nlmLogTable, COLUMN_NLMLOGTIME,
-                                      ASN_TIMETICKS, 0, NULL, 0);
-    /*
-     * adding column nlmLogDateAndTime of type ASN_OCTET_STR and access of 
-     * ReadOnly 
-     */
-    DEBUGMSGTL(("initialize_table_nlmLogTable",
-                "adding column nlmLogDateAndTime (#3) of type ASN_OCTET_STR to table nlmLogTable\n"));
-    netsnmp_table_set_add_default_row(nlmLogTable,
-                                      COLUMN_NLMLOGDATEANDTIME,
-                                      ASN_OCTET_STR, 0, NULL, 0);
-    /*
-     * adding column nlmLogEngineID of type ASN_OCTET_STR and access of
-     * ReadOnly 
-     */
-    DEBUGMSGTL(("initialize_table_nlmLogTable",
-                "adding column nlmLogEngineID (#4) of type ASN_OCTET_STR to table nlmLogTable\n"));
-    netsnmp_table_set_add_default_row(nlmLogTable, COLUMN_NLMLOGENGINEID,
-                                      ASN_OCTET_STR, 0, NULL, 0);
-    /*
-     * adding column nlmLogEngineTAddress of type ASN_OCTET_STR and access 
-     * of ReadOnly 
-     */
-    DEBUGMSGTL(("initialize_table_nlmLogTable",
-                "adding column nlmLogEngineTAddress (#5) of type ASN_OCTET_STR to table nlmLogTable\n"));
-    netsnmp_table_set_add_default_row(nlmLogTable,
-                                      COLUMN_NLMLOGENGINETADDRESS,
-                                      ASN_OCTET_STR, 0, NULL, 0);
-    /*
-     * adding column nlmLogEngineTDomain of type ASN_OBJECT_ID and access
-     * of ReadOnly 
-     */
-    DEBUGMSGTL(("initialize_table_nlmLogTable",
-                "adding column nlmLogEngineTDomain (#6) of type ASN_OBJECT_ID to table nlmLogTable\n"));
-    netsnmp_table_set_add_default_row(nlmLogTable,
-                                      COLUMN_NLMLOGENGINETDOMAIN,
-                                      ASN_OBJECT_ID, 0, NULL, 0);
-    /*
-     * adding column nlmLogContextEngineID of type ASN_OCTET_STR and
-     * access of ReadOnly 
-     */
-    DEBUGMSGTL(("initialize_table_nlmLogTable",
-                "adding column nlmLogContextEngineID (#7) of type ASN_OCTET_STR to table nlmLogTable\n"));
-    netsnmp_table_set_add_default_row(nlmLogTable,
-                                      COLUMN_NLMLOGCONTEXTENGINEID,
-                                      ASN_OCTET_STR, 0, NULL, 0);
-    /*
-     * adding column nlmLogContextName of type ASN_OCTET_STR and access of 
-     * ReadOnly 
-     */
-    DEBUGMSGTL(("initialize_table_nlmLogTable",
-                "adding column nlmLogContextName (#8) of type ASN_OCTET_STR to table nlmLogTable\n"));
-    netsnmp_table_set_add_default_row(nlmLogTable,
-                                      COLUMN_NLMLOGCONTEXTNAME,
-                                      ASN_OCTET_STR, 0, NULL, 0);
-    /*
-     * adding column nlmLogNotificationID of type ASN_OBJECT_ID and access 
-     * of ReadOnly 
-     */
-    DEBUGMSGTL(("initialize_table_nlmLogTable",
-                "adding column nlmLogNotificationID (#9) of type ASN_OBJECT_ID to table nlmLogTable\n"));
-    netsnmp_table_set_add_default_row(nlmLogTable,
-                                      COLUMN_NLMLOGNOTIFICATIONID,
-                                      ASN_OBJECT_ID, 0, NULL, 0);
+    table_info = SNMP_MALLOC_TYPEDEF(netsnmp_table_registration_info);
+    if (!table_info)
+        return;
+    netsnmp_table_helper_add_indexes(table_info, ASN_OCTET_STR,
+                                     ASN_UNSIGNED, 0);
+    table_info->min_column = COLUMN_NLMLOGTIME;
+    table_info->max_column = COLUMN_NLMLOGNOTIFICATIONID;
 
     /*
      * registering the table with the master agent 
      */
-    /*
-     * note: if you don't need a subhandler to deal with any aspects of
-     * the request, change nlmLogTable_handler to "NULL" 
-     */
     reginfo =
-        netsnmp_create_handler_registration("nlmLogTable", NULL,
+        netsnmp_create_handler_registration("nlmLogTable",
+                                            nlmLogTable_handler,
                                             nlmLogTable_oid,
                                             nlmLogTable_oid_len,
-                                            HANDLER_CAN_RWRITE);
+                                            HANDLER_CAN_RONLY);
     if (NULL != context)
         reginfo->contextName = strdup(context);
-    netsnmp_register_table_data_set(reginfo, nlmLogTable, NULL);
+    if (netsnmp_register_table(reginfo, table_info) == MIB_REGISTERED_OK) {
+        netsnmp_handler_owns_table_info(reginfo->handler->next);
+        nlm_log_reg = reginfo;
+    }
 
     /*
      * hmm...  5 minutes seems like a reasonable time to check for out
      * dated notification logs right? 
      */
-    snmp_alarm_register(300, SA_REPEAT, check_log_size, NULL);
+    nlm_alarm = snmp_alarm_register(300, SA_REPEAT, check_log_size, NULL);
 }
 
 static int
@@ -481,6 +685,18 @@ notification_log_config_handler(netsnmp_mib_handler *handler,
     return SNMP_ERR_NOERROR;
 }
 
+static void
+notification_log_parse_max(const char *token, char *cptr)
+{
+    int             max = atoi(cptr);
+
+    if (max < 0) {
+        config_perror("notificationLogMax must not be negative");
+        return;
+    }
+    max_logged = max;
+}
+
 void
 init_notification_log(void)
 {
@@ -549,15 +765,9 @@ init_notification_log(void)
     netsnmp_ds_register_config(ASN_BOOLEAN, apptype, "doNotRetainNotificationLogs",
                                NETSNMP_DS_APPLICATION_ID,
                                NETSNMP_DS_AGENT_DONT_RETAIN_NOTIFICATIONS);
-#if 0
-    /* xxx-rks: config for max size; should be peristent too, & tied to mib */
-    netsnmp_ds_register_config(ASN_INTEGER,
-                               netsnmp_ds_get_string(NETSNMP_DS_LIBRARY_ID, 
-                                                     NETSNMP_DS_LIB_APPTYPE),
-                               "notificationLogMax",
-                               NETSNMP_DS_APPLICATION_ID,
-                               NETSNMP_DS_AGENT_NOTIF_LOG_MAX);
-#endif
+    register_config_handler(apptype, "notificationLogMax",
+                            notification_log_parse_max, NULL, "integer");
+    nlm_initialized = 1;
 
     REGISTER_SYSOR_ENTRY(nlm_module_oid, 
         "The MIB module for logging SNMP Notifications.");
@@ -568,8 +778,19 @@ shutdown_notification_log(void)
 {
     max_logged = 0;
     check_log_size(0, NULL);
-    netsnmp_delete_table_data_set(nlmLogTable);
-    nlmLogTable = NULL;
+    nlm_initialized = 0;
+    if (nlm_alarm) {
+        snmp_alarm_unregister(nlm_alarm);
+        nlm_alarm = 0;
+    }
+    if (nlm_log_reg) {
+        netsnmp_unregister_handler(nlm_log_reg);
+        nlm_log_reg = NULL;
+    }
+    if (nlm_var_reg) {
+        netsnmp_unregister_handler(nlm_var_reg);
+        nlm_var_reg = NULL;
+    }
 
     UNREGISTER_SYSOR_ENTRY(nlm_module_oid);
 }
@@ -577,56 +798,54 @@ shutdown_notification_log(void)
 void
 log_notification(netsnmp_pdu *pdu, netsnmp_transport *transport)
 {
-    long            tmpl;
-    netsnmp_table_row *row;
-
     static u_long   default_num = 0;
 
     static oid      snmptrapoid[] = { 1, 3, 6, 1, 6, 3, 1, 1, 4, 1, 0 };
     size_t          snmptrapoid_len = OID_LENGTH(snmptrapoid);
     netsnmp_variable_list *vptr;
+    nlm_log_entry  *e;
     u_char         *logdate;
     size_t          logdate_size;
     time_t          timetnow;
-
-    u_long          vbcount = 0;
-    u_long          tmpul;
-    int             col;
+    size_t          count;
     netsnmp_pdu    *orig_pdu = pdu;
 
-    if (!nlmLogVarTable
+    if (!nlm_initialized
         || netsnmp_ds_get_boolean(NETSNMP_DS_APPLICATION_ID,
                                   NETSNMP_DS_APP_DONT_LOG)) {
         return;
     }
 
     DEBUGMSGTL(("notification_log", "logging something\n"));
-    row = netsnmp_create_table_data_row();
 
     ++num_received;
     default_num++;
 
-    /*
-     * indexes to the table 
-     */
-    netsnmp_table_row_add_index(row, ASN_OCTET_STR, "default",
-                                strlen("default"));
-    netsnmp_table_row_add_index(row, ASN_UNSIGNED, &default_num,
-                                sizeof(default_num));
+    netsnmp_notif_log_resize();
+    if (0 == nlm_ring_size) {
+        /** nowhere to keep it: bumped straight away */
+        num_deleted++;
+        return;
+    }
+
+    e = SNMP_MALLOC_TYPEDEF(nlm_log_entry);
+    if (!e)
+        goto nomem;
+    e->index = default_num;
 
     /*
      * add the data 
      */
-    tmpl = netsnmp_get_agent_uptime();
-    netsnmp_set_row_column(row, COLUMN_NLMLOGTIME, ASN_TIMETICKS,
-                           &tmpl, sizeof(tmpl));
+    e->time = netsnmp_get_agent_uptime();
     time(&timetnow);
     logdate = date_n_time(&timetnow, &logdate_size);
-    netsnmp_set_row_column(row, COLUMN_NLMLOGDATEANDTIME, ASN_OCTET_STR,
-                           logdate, logdate_size);
-    netsnmp_set_row_column(row, COLUMN_NLMLOGENGINEID, ASN_OCTET_STR,
-                           pdu->securityEngineID,
-                           pdu->securityEngineIDLen);
+    if (logdate_size > sizeof(e->dateandtime))
+        logdate_size = sizeof(e->dateandtime);
+    memcpy(e->dateandtime, logdate, logdate_size);
+    e->dateandtime_len = logdate_size;
+    if (_nlm_dup(&e->engineid, &e->engineid_len,
+                 pdu->securityEngineID, pdu->securityEngineIDLen) < 0)
+        goto nomem;
     if (transport && transport->domain == netsnmpUDPDomain) {
         /*
          * check for the udp domain 
@@ -634,137 +853,82 @@ log_notification(netsnmp_pdu *pdu, netsnmp_transport *transport)
         struct sockaddr_in *addr =
             (struct sockaddr_in *) pdu->transport_data;
         if (addr) {
-            char            buf[sizeof(in_addr_t) +
-                                sizeof(addr->sin_port)];
             in_addr_t       locaddr = htonl(addr->sin_addr.s_addr);
             u_short         portnum = htons(addr->sin_port);
-            memcpy(buf, &locaddr, sizeof(in_addr_t));
-            memcpy(buf + sizeof(in_addr_t), &portnum,
+            memcpy(e->taddress, &locaddr, sizeof(in_addr_t));
+            memcpy(e->taddress + sizeof(in_addr_t), &portnum,
                    sizeof(addr->sin_port));
-            netsnmp_set_row_column(row, COLUMN_NLMLOGENGINETADDRESS,
-                                   ASN_OCTET_STR, buf,
-                                   sizeof(in_addr_t) +
-                                   sizeof(addr->sin_port));
+            e->taddress_len = sizeof(in_addr_t) + sizeof(addr->sin_port);
         }
     }
-    if (transport)
-        netsnmp_set_row_column(row, COLUMN_NLMLOGENGINETDOMAIN,
-                               ASN_OBJECT_ID,
-                               transport->domain,
-                               sizeof(oid) * transport->domain_length);
-    netsnmp_set_row_column(row, COLUMN_NLMLOGCONTEXTENGINEID,
-                           ASN_OCTET_STR, pdu->contextEngineID,
-                           pdu->contextEngineIDLen);
-    netsnmp_set_row_column(row, COLUMN_NLMLOGCONTEXTNAME, ASN_OCTET_STR,
-                           pdu->contextName, pdu->contextNameLen);
+    if (transport) {
+        if (_nlm_dup(&e->tdomain, &e->tdomain_len, transport->domain,
+                     sizeof(oid) * transport->domain_length) < 0)
+            goto nomem;
+        e->tdomain_len = transport->domain_length;
+    }
+    if (_nlm_dup(&e->contextengineid, &e->contextengineid_len,
+                 pdu->contextEngineID, pdu->contextEngineIDLen) < 0 ||
+        _nlm_dup(&e->contextname, &e->contextname_len,
+                 pdu->contextName, pdu->contextNameLen) < 0)
+        goto nomem;
 
     if (pdu->command == SNMP_MSG_TRAP)
 	pdu = convert_v1pdu_to_v2(orig_pdu);
+    if (!pdu)
+        goto nomem;
+    count = 0;
+    for (vptr = pdu->variables; vptr; vptr = vptr->next_variable)
+        count++;
+    if (count) {
+        e->vars = (netsnmp_variable_list *) calloc(count, sizeof(*e->vars));
+        if (!e->vars)
+            goto nomem;
+    }
     for (vptr = pdu->variables; vptr; vptr = vptr->next_variable) {
         if (snmp_oid_compare(snmptrapoid, snmptrapoid_len,
                              vptr->name, vptr->name_length) == 0) {
-            netsnmp_set_row_column(row, COLUMN_NLMLOGNOTIFICATIONID,
-                                   ASN_OBJECT_ID, vptr->val.string,
-                                   vptr->val_len);
-        } else {
-            netsnmp_table_row *myrow;
-            myrow = netsnmp_create_table_data_row();
-
-            /*
-             * indexes to the table 
-             */
-            netsnmp_table_row_add_index(myrow, ASN_OCTET_STR, "default",
-                                        strlen("default"));
-            netsnmp_table_row_add_index(myrow, ASN_UNSIGNED, &default_num,
-                                        sizeof(default_num));
-            vbcount++;
-            netsnmp_table_row_add_index(myrow, ASN_UNSIGNED, &vbcount,
-                                        sizeof(vbcount));
-
-            /*
-             * OID 
-             */
-            netsnmp_set_row_column(myrow, COLUMN_NLMLOGVARIABLEID,
-                                   ASN_OBJECT_ID, vptr->name,
-                                   vptr->name_length * sizeof(oid));
-
-            /*
-             * value 
-             */
-            switch (vptr->type) {
-            case ASN_OBJECT_ID:
-                tmpul = 7;
-                col = COLUMN_NLMLOGVARIABLEOIDVAL;
-                break;
-
-            case ASN_INTEGER:
-                tmpul = 4;
-                col = COLUMN_NLMLOGVARIABLEINTEGER32VAL;
-                break;
-
-            case ASN_UNSIGNED:
-                tmpul = 2;
-                col = COLUMN_NLMLOGVARIABLEUNSIGNED32VAL;
-                break;
-
-            case ASN_COUNTER:
-                tmpul = 1;
-                col = COLUMN_NLMLOGVARIABLECOUNTER32VAL;
-                break;
-
-            case ASN_TIMETICKS:
-                tmpul = 3;
-                col = COLUMN_NLMLOGVARIABLETIMETICKSVAL;
-                break;
-
-            case ASN_OCTET_STR:
-                tmpul = 6;
-                col = COLUMN_NLMLOGVARIABLEOCTETSTRINGVAL;
-                break;
-
-            case ASN_IPADDRESS:
-                tmpul = 5;
-                col = COLUMN_NLMLOGVARIABLEIPADDRESSVAL;
-                break;
-
-            case ASN_COUNTER64:
-                tmpul = 8;
-                col = COLUMN_NLMLOGVARIABLECOUNTER64VAL;
-                break;
-
-            case ASN_OPAQUE:
-                tmpul = 9;
-                col = COLUMN_NLMLOGVARIABLEOPAQUEVAL;
-                break;
-
-            default:
-                /*
-                 * unsupported 
-                 */
-                DEBUGMSGTL(("notification_log",
-                            "skipping type %d\n", vptr->type));
-                (void)netsnmp_table_dataset_delete_row(myrow);
-                continue;
-            }
-            netsnmp_set_row_column(myrow, COLUMN_NLMLOGVARIABLEVALUETYPE,
-                                   ASN_INTEGER, & tmpul,
-                                   sizeof(tmpul));
-            netsnmp_set_row_column(myrow, col, vptr->type,
-                                   vptr->val.string, vptr->val_len);
-            DEBUGMSGTL(("notification_log",
-                        "adding a row to the variables table\n"));
-            netsnmp_table_dataset_add_row(nlmLogVarTable, myrow);
+            if (_nlm_dup(&e->notificationid, &e->notificationid_len,
+                         vptr->val.string, vptr->val_len) < 0)
+                goto nomem;
+            e->notificationid_len = vptr->val_len / sizeof(oid);
+            continue;
+        }
+        /*
+         * unsupported types are kept too, with no columns, so that
+         * nlmLogVariableIndex numbers every varbind
+         */
+        if (snmp_set_var_objid(&e->vars[e->nvars], vptr->name,
+                               vptr->name_length) ||
+            snmp_set_var_typed_value(&e->vars[e->nvars], vptr->type,
+                                     vptr->val.string, vptr->val_len)) {
+            snmp_free_var_internals(&e->vars[e->nvars]);
+            goto nomem;
         }
+        e->nvars++;
     }
 
     if (pdu != orig_pdu)
         snmp_free_pdu( pdu );
 
     /*
-     * store the row 
+     * store the entry: the ring is full, the oldest one goes
      */
-    netsnmp_table_dataset_add_row(nlmLogTable, row);
+    if (nlm_ring_count == nlm_ring_size)
+        netsnmp_notif_log_remove_oldest(1);
+    nlm_ring[(nlm_ring_head + nlm_ring_count) % nlm_ring_size] = e;
+    nlm_ring_count++;
 
     check_log_size(0, NULL);
     DEBUGMSGTL(("notification_log", "done logging something\n"));
+    return;
+
+  nomem:
+    snmp_log(LOG_ERR, "notification log: out of memory, "
+             "notification %lu not logged\n", default_num);
+    if (pdu && pdu != orig_pdu)
+        snmp_free_pdu(pdu);
+    if (e)
+        _nlm_entry_free(e);
+    num_deleted++;
 }
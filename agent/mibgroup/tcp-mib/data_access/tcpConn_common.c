@@ -34,7 +34,7 @@ netsnmp_access_tcpconn_container_init(u_int flags)
     /*
      * create the container
      */
-    container1 = netsnmp_container_find("access:tcpconn:table_container");
+    container1 = netsnmp_container_find("access:tcpconn:btree:table_container");
     if (NULL == container1) {
         snmp_log(LOG_ERR, "tcpconn primary container not found\n");
         return NULL;
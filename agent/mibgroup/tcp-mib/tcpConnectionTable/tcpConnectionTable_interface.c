@@ -1762,7 +1762,7 @@ _tcpConnectionTable_container_init(tcpConnectionTable_interface_ctx *
     tcpConnectionTable_container_init(&if_ctx->container, if_ctx->cache);
     if (NULL == if_ctx->container) {
         if_ctx->container =
-            netsnmp_container_find("tcpConnectionTable:table_container");
+            netsnmp_container_find("tcpConnectionTable:btree:table_container");
         if (if_ctx->container)
         if_ctx->container->container_name = strdup("tcpConnectionTable");
     }
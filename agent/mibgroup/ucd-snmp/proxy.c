@@ -166,6 +166,8 @@ proxy_parse_config(const char *token, char *line)
      * snmplib/snmpusm.c to pass in the pdu type to usm_process_incoming
      * so this isn't needed. 
      */
+    /* responses are copied into the original requests as they arrive */
+    session.flags |= SNMP_FLAGS_BORROW_VARBINDS;
     ss = snmp_open(&session);
     SNMP_FREE(session.community);
     /*
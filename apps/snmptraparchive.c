@@ -0,0 +1,291 @@
+/*
+ * snmptraparchive.c - query the notifications archived by snmptrapd
+ *
+ * Scans the segments written by snmptrapd's "archiveDir" and prints the
+ * notifications matching the options given, in the order received.
+ */
+/************************************************************************
+	Copyright 1988, 1989, 1991, 1992 by Carnegie Mellon University
+
+                      All Rights Reserved
+
+Permission to use, copy, modify, and distribute this software and its
+documentation for any purpose and without fee is hereby granted,
+provided that the above copyright notice appear in all copies and that
+both that copyright notice and this permission notice appear in
+supporting documentation, and that the name of CMU not be
+used in advertising or publicity pertaining to distribution of the
+software without specific, written prior permission.
+
+CMU DISCLAIMS ALL WARRANTIES WITH REGARD TO THIS SOFTWARE, INCLUDING
+ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS, IN NO EVENT SHALL
+CMU BE LIABLE FOR ANY SPECIAL, INDIRECT OR CONSEQUENTIAL DAMAGES OR
+ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS,
+WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION,
+ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS
+SOFTWARE.
+******************************************************************/
+
+#include <net-snmp/net-snmp-config.h>
+
+#ifdef HAVE_STDLIB_H
+#include <stdlib.h>
+#endif
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+#ifdef HAVE_STRING_H
+#include <string.h>
+#else
+#include <strings.h>
+#endif
+#include <sys/types.h>
+#ifdef HAVE_NETINET_IN_H
+#include <netinet/in.h>
+#endif
+#ifdef TIME_WITH_SYS_TIME
+# include <sys/time.h>
+# include <time.h>
+#else
+# ifdef HAVE_SYS_TIME_H
+#  include <sys/time.h>
+# else
+#  include <time.h>
+# endif
+#endif
+#include <stdio.h>
+#include <net-snmp/net-snmp-includes.h>
+#include "snmptrapd_archive.h"
+
+static int      count_only = 0;
+
+static void
+usage(void)
+{
+    fprintf(stderr, "USAGE: snmptraparchive [OPTIONS] DIRECTORY|SEGMENT\n\n");
+    fprintf(stderr, "  Version:  %s\n", netsnmp_get_version());
+    fprintf(stderr, "  Web:      http://www.net-snmp.org/\n");
+    fprintf(stderr,
+            "  Email:    net-snmp-coders@lists.sourceforge.net\n\nOPTIONS:\n");
+
+    fprintf(stderr, "  -h\t\t\tdisplay this help message\n");
+    fprintf(stderr, "  -V\t\t\tdisplay package version number\n");
+    fprintf(stderr,
+            "  -m MIB[" ENV_SEPARATOR "...]\t\tload given list of MIBs (ALL loads everything)\n");
+    fprintf(stderr,
+            "  -M DIR[" ENV_SEPARATOR "...]\t\tlook in given list of directories for MIBs\n");
+    fprintf(stderr,
+            "  -D[TOKEN[,...]]\tturn on debugging output for the specified TOKENs\n\t\t\t   (ALL gives extremely verbose debugging output)\n");
+    fprintf(stderr,
+            "  -b TIME\t\tonly notifications received at or after TIME\n");
+    fprintf(stderr,
+            "  -e TIME\t\tonly notifications received at or before TIME\n");
+    fprintf(stderr,
+            "\t\t\t  (\"YYYY-MM-DD [HH:MM[:SS]]\" local time, or seconds\n\t\t\t   since the epoch)\n");
+    fprintf(stderr,
+            "  -a ADDRESS\t\tonly notifications received from ADDRESS\n");
+    fprintf(stderr,
+            "  -t OID\t\tonly notifications with the trap OID OID, or\n\t\t\t  within it if OID ends with \".*\"\n");
+    fprintf(stderr, "  -c\t\t\tonly print the number of notifications found\n");
+    fprintf(stderr, "  -s\t\t\tprint what the scan read and skipped\n");
+    fprintf(stderr,
+            "  -O OUTOPTS\t\tToggle various defaults controlling output display:\n");
+    snmp_out_toggle_options_usage("\t\t\t  ", stderr);
+    fprintf(stderr,
+            "  -L LOGOPTS\t\tToggle various defaults controlling logging:\n");
+    snmp_log_options_usage("\t\t\t  ", stderr);
+}
+
+/*
+ * parse a time given as seconds since the epoch or as a local date
+ */
+static int
+parse_time(const char *str, time_t *t)
+{
+    struct tm       tm;
+    char            extra;
+    long            secs;
+    int             n;
+
+    if (sscanf(str, "%ld%c", &secs, &extra) == 1) {
+        *t = secs;
+        return 0;
+    }
+    memset(&tm, 0, sizeof(tm));
+    n = sscanf(str, "%d-%d-%d %d:%d:%d%c", &tm.tm_year, &tm.tm_mon,
+               &tm.tm_mday, &tm.tm_hour, &tm.tm_min, &tm.tm_sec, &extra);
+    if (n != 3 && n != 5 && n != 6)
+        return -1;
+    tm.tm_year -= 1900;
+    tm.tm_mon -= 1;
+    tm.tm_isdst = -1;
+    *t = mktime(&tm);
+    return *t == (time_t) -1 ? -1 : 0;
+}
+
+static const char *
+version_string(long version)
+{
+    switch (version) {
+    case SNMP_VERSION_1:
+        return "v1";
+    case SNMP_VERSION_2c:
+        return "v2c";
+    case SNMP_VERSION_3:
+        return "v3";
+    default:
+        return "?";
+    }
+}
+
+static int
+print_notification(time_t when, const char *source, const oid *trapoid,
+                   size_t trapoid_len, netsnmp_pdu *pdu, void *ctx)
+{
+    netsnmp_variable_list *var;
+    struct tm      *tm;
+    char            date[32];
+
+    if (count_only)
+        return 0;
+    tm = localtime(&when);
+    if (tm == NULL || !strftime(date, sizeof(date), "%Y-%m-%d %H:%M:%S", tm))
+        snprintf(date, sizeof(date), "%ld", (long) when);
+    printf("%s %s %s ", date, source, version_string(pdu->version));
+    if (pdu->version == SNMP_VERSION_3)
+        printf("%s ", pdu->securityName ? pdu->securityName : "");
+    else
+        printf("%.*s ", (int) pdu->community_len,
+               pdu->community ? (char *) pdu->community : "");
+    fprint_objid(stdout, trapoid, trapoid_len);
+    for (var = pdu->variables; var; var = var->next_variable) {
+        putchar('\t');
+        fprint_variable(stdout, var->name, var->name_length, var);
+    }
+    return 0;
+}
+
+int
+main(int argc, char *argv[])
+{
+    int             arg;
+    const char     *cp = NULL;
+    char           *trapoid_str;
+    oid             trapoid[MAX_OID_LEN];
+    size_t          len;
+    int             print_stats = 0;
+    int             exit_code = 1;
+    netsnmp_trapd_archive_query query;
+    netsnmp_trapd_archive_scan_stats stats;
+
+    SOCK_STARTUP;
+
+    memset(&query, 0, sizeof(query));
+    trapoid_str = NULL;
+    while ((arg = getopt(argc, argv, "Vhm:M:D:O:L:b:e:a:t:cs")) != EOF) {
+        switch (arg) {
+        case 'h':
+            usage();
+            goto out;
+
+        case 'm':
+            setenv("MIBS", optarg, 1);
+            break;
+        case 'M':
+            setenv("MIBDIRS", optarg, 1);
+            break;
+        case 'D':
+            debug_register_tokens(optarg);
+            snmp_set_do_debugging(1);
+            break;
+        case 'V':
+            fprintf(stderr, "NET-SNMP version: %s\n",
+                    netsnmp_get_version());
+            exit_code = 0;
+            goto out;
+        case 'O':
+            cp = snmp_out_toggle_options(optarg);
+            if (cp != NULL) {
+                fprintf(stderr, "Unknown OID option to -O: %c.\n", *cp);
+                usage();
+                goto out;
+            }
+            break;
+        case 'L':
+            if (snmp_log_options(optarg, argc, argv) < 0)
+                goto out;
+            break;
+        case 'b':
+            if (parse_time(optarg, &query.begin) < 0) {
+                fprintf(stderr, "Invalid time: %s\n", optarg);
+                goto out;
+            }
+            break;
+        case 'e':
+            if (parse_time(optarg, &query.end) < 0) {
+                fprintf(stderr, "Invalid time: %s\n", optarg);
+                goto out;
+            }
+            break;
+        case 'a':
+            query.source = optarg;
+            break;
+        case 't':
+            trapoid_str = optarg;
+            break;
+        case 'c':
+            count_only = 1;
+            break;
+        case 's':
+            print_stats = 1;
+            break;
+        default:
+            fprintf(stderr, "invalid option: -%c\n", arg);
+            usage();
+            goto out;
+        }
+    }
+
+    if (optind != argc - 1) {
+        usage();
+        goto out;
+    }
+
+    netsnmp_ds_set_boolean(NETSNMP_DS_LIBRARY_ID,
+                           NETSNMP_DS_LIB_DONT_PERSIST_STATE, 1);
+    init_snmp(NETSNMP_APPLICATION_CONFIG_TYPE);
+
+    if (trapoid_str) {
+        len = strlen(trapoid_str);
+        if (len >= 2 && !strcmp(trapoid_str + len - 2, ".*")) {
+            trapoid_str[len - 2] = '\0';
+            query.subtree = 1;
+        }
+        len = MAX_OID_LEN;
+        if (!snmp_parse_oid(trapoid_str, trapoid, &len)) {
+            snmp_perror(trapoid_str);
+            goto out;
+        }
+        query.trapoid = trapoid;
+        query.trapoid_len = len;
+    }
+
+    if (netsnmp_trapd_archive_scan(argv[optind], &query, print_notification,
+                                   NULL, &stats) < 0) {
+        fprintf(stderr, "Cannot read %s\n", argv[optind]);
+        goto out;
+    }
+    if (count_only)
+        printf("%lu\n", stats.matched);
+    if (print_stats)
+        fprintf(stderr, "%lu segments (%lu skipped), %lu blocks (%lu skipped), "
+                "%lu notifications read, %lu matched, %lu errors\n",
+                stats.segments, stats.segments_skipped, stats.blocks,
+                stats.blocks_skipped, stats.records, stats.matched,
+                stats.errors);
+    exit_code = stats.errors ? 2 : 0;
+
+out:
+    SOCK_CLEANUP;
+    return exit_code;
+}
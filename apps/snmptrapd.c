@@ -97,6 +97,7 @@ SOFTWARE.
 #include <net-snmp/net-snmp-includes.h>
 #include <net-snmp/agent/net-snmp-agent-includes.h>
 #include <net-snmp/library/fd_event_manager.h>
+#include <net-snmp/library/large_fd_set.h>
 #include <net-snmp/agent/netsnmp_close_fds.h>
 #include <net-snmp/agent/mib_modules.h>
 #include "../snmplib/snmp_syslog.h"
@@ -109,6 +110,11 @@ SOFTWARE.
 #include "snmptrapd_log.h"
 #include "snmptrapd_auth.h"
 #include "snmptrapd_sql.h"
+#include "snmptrapd_queue.h"
+#include "snmptrapd_forward.h"
+#include "snmptrapd_archive.h"
+#include "snmptrapd_dedup.h"
+#include "snmptrapd_persist.h"
 #include "notification-log-mib/notification_log.h"
 #include "tlstm-mib/snmpTlstmCertToTSNTable/snmpTlstmCertToTSNTable.h"
 #include "mibII/vacm_conf.h"
@@ -170,6 +176,15 @@ int             trapd_status = SNMPTRAPD_STOPPED;
 LPCTSTR         app_name_long = _T("Net-SNMP Trap Handler");     /* Application Name */
 #endif
 
+/*
+ * The listen() backlog of the stream transports snmptrapd listens on.
+ * A trap receiver may see hundreds of devices (re)connect at once, more
+ * than the library's NETSNMP_STREAM_QUEUE_LEN; the kernel caps it anyway.
+ */
+#ifndef SNMPTRAPD_STREAM_QUEUE_LEN
+#define SNMPTRAPD_STREAM_QUEUE_LEN 128
+#endif
+
 const char     *app_name = "snmptrapd";
 
 void            trapd_update_config(void);
@@ -341,6 +356,11 @@ snmptrapd_add_session(netsnmp_transport *t)
     session->callback = snmp_input;
     session->callback_magic = (void *) t;
     session->authenticator = NULL;
+    /*
+     * handlers only look at a trap while it is being received, and a trap
+     * that isn't authorized never has its values decoded
+     */
+    session->flags |= SNMP_FLAGS_BORROW_VARBINDS | SNMP_FLAGS_LAZY_VARBINDS;
     sess.isAuthoritative = SNMP_SESS_UNKNOWNAUTH;
 
     rc = snmp_add(session, t, pre_parse, NULL);
@@ -508,9 +528,12 @@ static void
 snmptrapd_main_loop(void)
 {
     int             count, numfds, block;
-    fd_set          readfds,writefds,exceptfds;
+    netsnmp_large_fd_set readfds, writefds, exceptfds;
     struct timeval  timeout;
-    NETSNMP_SELECT_TIMEVAL timeout2;
+
+    netsnmp_large_fd_set_init(&readfds, FD_SETSIZE);
+    netsnmp_large_fd_set_init(&writefds, FD_SETSIZE);
+    netsnmp_large_fd_set_init(&exceptfds, FD_SETSIZE);
 
     while (netsnmp_running) {
         if (reconfig) {
@@ -527,32 +550,37 @@ snmptrapd_main_loop(void)
             if (trap1_fmt_str_remember) {
                 parse_format( NULL, trap1_fmt_str_remember );
             }
+            snmptrapd_queue_reconfig();
+            snmptrapd_forward_log_stats();
+            snmptrapd_archive_log_stats();
+            snmptrapd_dedup_log_stats();
+            snmptrapd_auth_log_stats();
             reconfig = 0;
         }
         numfds = 0;
-        FD_ZERO(&readfds);
-        FD_ZERO(&writefds);
-        FD_ZERO(&exceptfds);
+        NETSNMP_LARGE_FD_ZERO(&readfds);
+        NETSNMP_LARGE_FD_ZERO(&writefds);
+        NETSNMP_LARGE_FD_ZERO(&exceptfds);
         block = 0;
         timerclear(&timeout);
         timeout.tv_sec = 5;
-        snmp_select_info(&numfds, &readfds, &timeout, &block);
+        snmp_select_info2(&numfds, &readfds, &timeout, &block);
+        snmptrapd_queue_select_info(&readfds);
 #ifndef NETSNMP_FEATURE_REMOVE_FD_EVENT_MANAGER
-        netsnmp_external_event_info(&numfds, &readfds, &writefds, &exceptfds);
+        netsnmp_external_event_info2(&numfds, &readfds, &writefds, &exceptfds);
 #endif /* NETSNMP_FEATURE_REMOVE_FD_EVENT_MANAGER */
-        timeout2.tv_sec = timeout.tv_sec;
-        timeout2.tv_usec = timeout.tv_usec;
-        count = select(numfds, &readfds, &writefds, &exceptfds,
-                       !block ? &timeout2 : NULL);
+        count = netsnmp_large_fd_set_select(numfds, &readfds, &writefds,
+                                            &exceptfds,
+                                            !block ? &timeout : NULL);
         if (count > 0) {
 #ifndef NETSNMP_FEATURE_REMOVE_FD_EVENT_MANAGER
-            netsnmp_dispatch_external_events(&count, &readfds, &writefds,
-                                             &exceptfds);
+            netsnmp_dispatch_external_events2(&count, &readfds, &writefds,
+                                              &exceptfds);
 #endif /* NETSNMP_FEATURE_REMOVE_FD_EVENT_MANAGER */
             /* If there are any more events after external events, then
              * try SNMP events. */
             if (count > 0) {
-                snmp_read(&readfds);
+                snmp_read2(&readfds);
             }
         } else {
             switch (count) {
@@ -570,8 +598,14 @@ snmptrapd_main_loop(void)
                 netsnmp_running = 0;
             }
 	}
+        snmptrapd_forward_flush();
+        snmptrapd_persist_flush();
 	run_alarms();
     }
+
+    netsnmp_large_fd_set_cleanup(&readfds);
+    netsnmp_large_fd_set_cleanup(&writefds);
+    netsnmp_large_fd_set_cleanup(&exceptfds);
 }
 
 /*******************************************************************-o-******
@@ -647,6 +681,11 @@ main(int argc, char *argv[])
      * register our configuration handlers now so -H properly displays them 
      */
     snmptrapd_register_configs( );
+    snmptrapd_register_queue_configs( );
+    snmptrapd_register_forward_configs( );
+    snmptrapd_register_archive_configs( );
+    snmptrapd_register_dedup_configs( );
+    snmptrapd_register_persist_configs( );
 #ifdef NETSNMP_USE_MYSQL
     snmptrapd_register_sql_configs( );
 #endif
@@ -1073,7 +1112,11 @@ main(int argc, char *argv[])
     }
 #endif /* USING_AGENTX_SUBAGENT_MODULE && !NETSNMP_SNMPTRAPD_DISABLE_AGENTX */
 
-    /* register our authorization handler */
+    /*
+     * register our authorization handler, and the dedup one which
+     * runs right after it (handlers are prepended to their list)
+     */
+    init_netsnmp_trapd_dedup();
     init_netsnmp_trapd_auth();
 
 #if defined(USING_AGENTX_SUBAGENT_MODULE) && !defined(NETSNMP_SNMPTRAPD_DISABLE_AGENTX)
@@ -1162,6 +1205,12 @@ main(int argc, char *argv[])
             snmptrapd_close_sessions(sess_list);
             goto sock_cleanup;
         } else {
+            if ((transport->flags & NETSNMP_TRANSPORT_FLAG_STREAM) &&
+                (transport->flags & NETSNMP_TRANSPORT_FLAG_LISTEN) &&
+                listen(transport->sock, SNMPTRAPD_STREAM_QUEUE_LEN) < 0)
+                snmp_log(LOG_WARNING, "couldn't raise the backlog of %s "
+                         "-- errno %d (\"%s\")\n", cp, errno,
+                         strerror(errno));
             ss = snmptrapd_add_session(transport);
             if (ss == NULL) {
                 /*
@@ -1316,8 +1365,21 @@ main(int argc, char *argv[])
     trapd_status = SNMPTRAPD_RUNNING;
 #endif
 
+    /*
+     * the receiver thread is started late, as it would not survive the fork
+     */
+    if (snmptrapd_queue_start(sess_list) < 0)
+        snmp_log(LOG_WARNING, "receiving without a receive queue\n");
+
     snmptrapd_main_loop();
 
+    snmptrapd_queue_stop();
+    snmptrapd_forward_shutdown();
+    snmptrapd_archive_shutdown();
+    snmptrapd_dedup_shutdown();
+    snmptrapd_auth_shutdown();
+    snmptrapd_persist_free_all();
+
     if (snmp_get_do_logging()) {
         struct tm      *tm;
         time_t          timer;
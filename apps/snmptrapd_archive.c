@@ -0,0 +1,1634 @@
+/*
+ * snmptrapd_archive.c - keep received notifications in a local archive
+ *
+ * With "archiveDir", every notification that may be logged is appended to
+ * segment files in that directory.  Notifications are gathered in memory
+ * into blocks of "archiveBlockRecords", and a block is written once it is
+ * full or "archiveFlushInterval" seconds after its first notification.  A
+ * segment is closed and the next one started once it is larger than
+ * "archiveSegmentSize" megabytes or older than "archiveSegmentAge"
+ * seconds; segments last written more than "archiveRetention" days ago are
+ * removed then.
+ *
+ * Segments are named snmptrapd-YYYYMMDD-HHMMSS.archive after the (UTC)
+ * time of their first notification, and hold a header and blocks:
+ *
+ *   header:  "NSTA", version, 3 bytes 0, start time (8 bytes)
+ *   block:   "NSTB", notifications, index length, data length and data
+ *            length before compression (4 bytes each), compression,
+ *            3 bytes 0, first and last time (8 bytes each), the index
+ *            and the data
+ *
+ * All numbers in the headers are little endian.  The index holds the
+ * dictionaries of the source addresses, trap OIDs and communities seen in
+ * the block, so that a query skips the blocks that cannot match it without
+ * reading their data.  The data is stored column by column: times,
+ * sources, trap OIDs, versions, commands, uptimes, communities, the fields
+ * of v1 traps and the varbinds.  Numbers are stored as varints, dictionary
+ * entries by their index, and the name of a varbind as the number of
+ * subidentifiers it shares with the previous one and the rest of them.
+ * With zlib, the data is compressed.
+ *
+ * Each block goes out with a single write; a reader stops at a block that
+ * was cut short, say by a crash.  Skipping whole segments by their start
+ * times assumes that the clock does not step backwards.
+ */
+#include <net-snmp/net-snmp-config.h>
+
+#ifdef HAVE_STDLIB_H
+#include <stdlib.h>
+#endif
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+#ifdef HAVE_STRING_H
+#include <string.h>
+#else
+#include <strings.h>
+#endif
+#include <stdio.h>
+#include <errno.h>
+#include <sys/types.h>
+#ifdef HAVE_SYS_STAT_H
+#include <sys/stat.h>
+#endif
+#ifdef HAVE_FCNTL_H
+#include <fcntl.h>
+#endif
+#ifdef HAVE_IO_H
+#include <io.h>
+#endif
+#ifdef TIME_WITH_SYS_TIME
+# include <sys/time.h>
+# include <time.h>
+#else
+# ifdef HAVE_SYS_TIME_H
+#  include <sys/time.h>
+# else
+#  include <time.h>
+# endif
+#endif
+#ifdef NETSNMP_USE_ZLIB
+#include <zlib.h>
+#endif
+
+#include <net-snmp/net-snmp-includes.h>
+#include <net-snmp/library/dir_utils.h>
+#include "snmptrapd_handlers.h"
+#include "snmptrapd_auth.h"
+#include "snmptrapd_archive.h"
+
+netsnmp_feature_require(container_directory);
+
+#ifndef O_BINARY
+#define O_BINARY 0
+#endif
+#ifndef S_ISDIR
+#define S_ISDIR(m) (((m) & S_IFMT) == S_IFDIR)
+#endif
+
+/* defaults of the archive configuration tokens */
+#define TRAPD_ARCHIVE_BLOCK_RECORDS   1000
+#define TRAPD_ARCHIVE_FLUSH_INTERVAL  10
+#define TRAPD_ARCHIVE_SEGMENT_SIZE    64            /* megabytes */
+#define TRAPD_ARCHIVE_SEGMENT_AGE     86400         /* seconds */
+
+#define TRAPD_ARCHIVE_VERSION         1
+#define TRAPD_ARCHIVE_HEADER_LEN      16
+#define TRAPD_ARCHIVE_BLOCK_LEN       40
+/* snmptrapd-YYYYMMDD-HHMMSS.archive */
+#define TRAPD_ARCHIVE_NAME_LEN        33
+#define TRAPD_ARCHIVE_NONE            0
+#define TRAPD_ARCHIVE_ZLIB            1
+
+/* the columns of the data of a block, in the order they are stored */
+#define COL_TIME         0
+#define COL_SOURCE       1
+#define COL_TRAPOID      2
+#define COL_VERSION      3
+#define COL_COMMAND      4
+#define COL_UPTIME       5
+#define COL_COMMUNITY    6
+#define COL_V1           7
+#define COL_VARBINDS     8
+#define COL_COUNT        9
+
+typedef struct trapd_archive_buf_s {
+    u_char         *data;
+    size_t          len;
+    size_t          size;
+    int             failed;         /* an allocation failed */
+} trapd_archive_buf;
+
+typedef struct trapd_archive_dict_s {
+    u_char        **keys;
+    size_t         *lens;
+    u_int           count;
+    u_int           max;
+    u_int          *slots;          /* index of the key + 1, or 0 */
+    u_int           nslots;
+} trapd_archive_dict;
+
+/*
+ * define a structure to hold all the file globals
+ */
+typedef struct netsnmp_trapd_archive_globals_t {
+    char           *dir;            /* from archiveDir */
+    int             block_records;  /* from archiveBlockRecords */
+    int             flush_interval; /* from archiveFlushInterval */
+    u_long          segment_size;   /* from archiveSegmentSize, in bytes */
+    int             segment_age;    /* from archiveSegmentAge */
+    int             retention;      /* from archiveRetention, in days */
+    int             registered;     /* the handler has been added */
+    u_int           alarm;          /* pending flush of the block */
+
+    int             fd;             /* the current segment, or -1 */
+    time_t          segment_start;
+    u_long          segment_bytes;
+
+    u_int           count;          /* notifications in the block */
+    time_t          first;
+    time_t          last;
+    time_t          prev;
+    oid             prev_name[MAX_OID_LEN];
+    size_t          prev_name_len;
+    trapd_archive_dict sources;
+    trapd_archive_dict trapoids;
+    trapd_archive_dict communities;
+    trapd_archive_buf cols[COL_COUNT];
+    trapd_archive_buf out;          /* the block being written */
+
+    netsnmp_trapd_archive_stats stats;
+} netsnmp_trapd_archive_globals;
+
+static netsnmp_trapd_archive_globals _arc = {
+    NULL,                               /* dir */
+    TRAPD_ARCHIVE_BLOCK_RECORDS,        /* block_records */
+    TRAPD_ARCHIVE_FLUSH_INTERVAL,       /* flush_interval */
+    TRAPD_ARCHIVE_SEGMENT_SIZE * 1024 * 1024, /* segment_size */
+    TRAPD_ARCHIVE_SEGMENT_AGE,          /* segment_age */
+    0,                                  /* retention */
+    0,                                  /* registered */
+    0,                                  /* alarm */
+    -1                                  /* fd */
+};
+
+static void _archive_flush(void);
+static void _archive_close(void);
+
+/*
+ * growable buffers; a failed allocation is remembered in the buffer so
+ * that a whole notification can be checked at once
+ */
+static int
+_buf_reserve(trapd_archive_buf *b, size_t n)
+{
+    u_char         *data;
+    size_t          size;
+
+    if (b->failed)
+        return -1;
+    if (b->len + n <= b->size)
+        return 0;
+    size = b->size ? b->size : 256;
+    while (size < b->len + n)
+        size *= 2;
+    data = (u_char *) realloc(b->data, size);
+    if (data == NULL) {
+        b->failed = 1;
+        return -1;
+    }
+    b->data = data;
+    b->size = size;
+    return 0;
+}
+
+static void
+_buf_put(trapd_archive_buf *b, const void *p, size_t n)
+{
+    if (n == 0 || _buf_reserve(b, n) < 0)
+        return;
+    memcpy(b->data + b->len, p, n);
+    b->len += n;
+}
+
+static void
+_buf_put_varint(trapd_archive_buf *b, u_long v)
+{
+    if (_buf_reserve(b, sizeof(v) * 8 / 7 + 1) < 0)
+        return;
+    while (v >= 0x80) {
+        b->data[b->len++] = (u_char) (v | 0x80);
+        v >>= 7;
+    }
+    b->data[b->len++] = (u_char) v;
+}
+
+static void
+_buf_put_oid(trapd_archive_buf *b, const oid *name, size_t len)
+{
+    size_t          i;
+
+    _buf_put_varint(b, len);
+    for (i = 0; i < len; i++)
+        _buf_put_varint(b, name[i]);
+}
+
+static void
+_buf_free(trapd_archive_buf *b)
+{
+    SNMP_FREE(b->data);
+    b->len = b->size = 0;
+    b->failed = 0;
+}
+
+static u_long
+_zigzag(long v)
+{
+    return ((u_long) v << 1) ^ (u_long) (v < 0 ? -1L : 0L);
+}
+
+static long
+_unzigzag(u_long v)
+{
+    return (long) ((v >> 1) ^ (0 - (v & 1)));
+}
+
+static void
+_put_le32(u_char *p, u_long v)
+{
+    p[0] = (u_char) v;
+    p[1] = (u_char) (v >> 8);
+    p[2] = (u_char) (v >> 16);
+    p[3] = (u_char) (v >> 24);
+}
+
+static u_long
+_get_le32(const u_char *p)
+{
+    return (u_long) p[0] | ((u_long) p[1] << 8) | ((u_long) p[2] << 16) |
+        ((u_long) p[3] << 24);
+}
+
+static void
+_put_time(u_char *p, time_t t)
+{
+    uint64_t        v = (uint64_t) t;
+
+    _put_le32(p, (u_long) (v & 0xffffffffUL));
+    _put_le32(p + 4, (u_long) (v >> 32));
+}
+
+static time_t
+_get_time(const u_char *p)
+{
+    return (time_t) (_get_le32(p) | ((uint64_t) _get_le32(p + 4) << 32));
+}
+
+/*
+ * dictionaries of the keys seen in a block, by open addressing
+ */
+static u_int
+_dict_hash(const u_char *key, size_t len)
+{
+    u_int           h = 2166136261U;
+
+    while (len--)
+        h = (h ^ *key++) * 16777619U;
+    return h;
+}
+
+static int
+_dict_grow(trapd_archive_dict *d)
+{
+    u_int           nslots = d->nslots ? d->nslots * 2 : 64;
+    u_int          *slots, i, j;
+
+    slots = (u_int *) calloc(nslots, sizeof(u_int));
+    if (slots == NULL)
+        return -1;
+    for (i = 0; i < d->count; i++) {
+        j = _dict_hash(d->keys[i], d->lens[i]) & (nslots - 1);
+        while (slots[j])
+            j = (j + 1) & (nslots - 1);
+        slots[j] = i + 1;
+    }
+    free(d->slots);
+    d->slots = slots;
+    d->nslots = nslots;
+    return 0;
+}
+
+/*
+ * returns the index of key in the dictionary, adding it if needed
+ */
+static int
+_dict_index(trapd_archive_dict *d, const void *key, size_t len)
+{
+    u_int           i, e;
+    u_char         *copy;
+
+    if (d->count * 2 >= d->nslots && _dict_grow(d) < 0)
+        return -1;
+    for (i = _dict_hash((const u_char *) key, len) & (d->nslots - 1);
+         d->slots[i]; i = (i + 1) & (d->nslots - 1)) {
+        e = d->slots[i] - 1;
+        if (d->lens[e] == len && !memcmp(d->keys[e], key, len))
+            return e;
+    }
+    if (d->count == d->max) {
+        u_int           max = d->max ? d->max * 2 : 16;
+        u_char        **keys;
+        size_t         *lens;
+
+        keys = (u_char **) realloc(d->keys, max * sizeof(*keys));
+        if (keys == NULL)
+            return -1;
+        d->keys = keys;
+        lens = (size_t *) realloc(d->lens, max * sizeof(*lens));
+        if (lens == NULL)
+            return -1;
+        d->lens = lens;
+        d->max = max;
+    }
+    copy = (u_char *) malloc(len + 1);
+    if (copy == NULL)
+        return -1;
+    memcpy(copy, key, len);
+    d->keys[d->count] = copy;
+    d->lens[d->count] = len;
+    d->slots[i] = d->count + 1;
+    return d->count++;
+}
+
+static void
+_dict_reset(trapd_archive_dict *d)
+{
+    u_int           i;
+
+    for (i = 0; i < d->count; i++)
+        free(d->keys[i]);
+    d->count = 0;
+    if (d->slots)
+        memset(d->slots, 0, d->nslots * sizeof(u_int));
+}
+
+static void
+_dict_free(trapd_archive_dict *d)
+{
+    _dict_reset(d);
+    SNMP_FREE(d->keys);
+    SNMP_FREE(d->lens);
+    SNMP_FREE(d->slots);
+    d->max = d->nslots = 0;
+}
+
+static void
+_archive_put_value(trapd_archive_buf *b, netsnmp_variable_list *var)
+{
+    switch (var->type) {
+    case ASN_INTEGER:
+        _buf_put_varint(b, _zigzag(*var->val.integer));
+        break;
+    case ASN_COUNTER:
+    case ASN_GAUGE:
+    case ASN_TIMETICKS:
+    case ASN_UINTEGER:
+        _buf_put_varint(b, (u_long) *var->val.integer);
+        break;
+    case ASN_COUNTER64:
+        _buf_put_varint(b, var->val.counter64->high);
+        _buf_put_varint(b, var->val.counter64->low);
+        break;
+    case ASN_OBJECT_ID:
+        _buf_put_oid(b, var->val.objid, var->val_len / sizeof(oid));
+        break;
+    case ASN_NULL:
+    case SNMP_NOSUCHOBJECT:
+    case SNMP_NOSUCHINSTANCE:
+    case SNMP_ENDOFMIBVIEW:
+        break;
+    default:
+        /* strings, addresses and anything else, as they are */
+        _buf_put_varint(b, var->val_len);
+        _buf_put(b, var->val.string, var->val_len);
+        break;
+    }
+}
+
+/*
+ * add a notification to the block
+ */
+static int
+_archive_add(netsnmp_pdu *pdu, netsnmp_transport *transport, time_t now)
+{
+    size_t          saved[COL_COUNT];
+    char            source[128];
+    oid             trapoid[MAX_OID_LEN + 2];
+    size_t          trapoid_len, shared;
+    int             source_idx, trapoid_idx, community_idx, i;
+    u_long          nvars;
+    netsnmp_variable_list *var;
+    trapd_archive_buf *b;
+
+    netsnmp_trapd_source(pdu, transport, source, sizeof(source));
+    trapoid_len = OID_LENGTH(trapoid);
+    if (netsnmp_trapd_trapoid(pdu, trapoid, &trapoid_len) < 0)
+        trapoid_len = 0;
+    source_idx = _dict_index(&_arc.sources, source, strlen(source));
+    trapoid_idx = _dict_index(&_arc.trapoids, trapoid,
+                              trapoid_len * sizeof(oid));
+    if (pdu->version == SNMP_VERSION_3)
+        community_idx = _dict_index(&_arc.communities, pdu->securityName,
+                                    pdu->securityNameLen);
+    else
+        community_idx = _dict_index(&_arc.communities, pdu->community,
+                                    pdu->community_len);
+    if (source_idx < 0 || trapoid_idx < 0 || community_idx < 0)
+        return -1;
+
+    for (i = 0; i < COL_COUNT; i++)
+        saved[i] = _arc.cols[i].len;
+    if (_arc.count == 0) {
+        _arc.first = _arc.last = now;
+        _arc.prev = 0;
+        _arc.prev_name_len = 0;
+    }
+
+    _buf_put_varint(&_arc.cols[COL_TIME], _zigzag((long) (now - _arc.prev)));
+    _buf_put_varint(&_arc.cols[COL_SOURCE], source_idx);
+    _buf_put_varint(&_arc.cols[COL_TRAPOID], trapoid_idx);
+    _buf_put_varint(&_arc.cols[COL_VERSION], pdu->version);
+    _buf_put_varint(&_arc.cols[COL_COMMAND], pdu->command);
+    _buf_put_varint(&_arc.cols[COL_UPTIME], pdu->time);
+    _buf_put_varint(&_arc.cols[COL_COMMUNITY], community_idx);
+    if (pdu->command == SNMP_MSG_TRAP) {
+        b = &_arc.cols[COL_V1];
+        _buf_put(b, pdu->agent_addr, 4);
+        _buf_put_varint(b, pdu->trap_type);
+        _buf_put_varint(b, pdu->specific_type);
+        _buf_put_oid(b, pdu->enterprise, pdu->enterprise_length);
+    }
+
+    b = &_arc.cols[COL_VARBINDS];
+    for (nvars = 0, var = pdu->variables; var; var = var->next_variable)
+        nvars++;
+    _buf_put_varint(b, nvars);
+    for (var = pdu->variables; var; var = var->next_variable) {
+        if (var->name_length > MAX_OID_LEN) {
+            b->failed = 1;
+            break;
+        }
+        for (shared = 0; shared < var->name_length &&
+                 shared < _arc.prev_name_len &&
+                 var->name[shared] == _arc.prev_name[shared]; shared++)
+            ;
+        _buf_put_varint(b, shared);
+        _buf_put_oid(b, var->name + shared, var->name_length - shared);
+        _buf_put(b, &var->type, 1);
+        _archive_put_value(b, var);
+        memcpy(_arc.prev_name, var->name, var->name_length * sizeof(oid));
+        _arc.prev_name_len = var->name_length;
+    }
+
+    for (i = 0; i < COL_COUNT; i++)
+        if (_arc.cols[i].failed)
+            break;
+    if (i < COL_COUNT) {
+        /* drop what was added of this notification */
+        for (i = 0; i < COL_COUNT; i++) {
+            _arc.cols[i].len = saved[i];
+            _arc.cols[i].failed = 0;
+        }
+        /* the next name is then stored whole */
+        _arc.prev_name_len = 0;
+        return -1;
+    }
+
+    _arc.prev = now;
+    if (now < _arc.first)
+        _arc.first = now;
+    if (now > _arc.last)
+        _arc.last = now;
+    _arc.count++;
+    return 0;
+}
+
+/*
+ * segment files
+ */
+static int
+_archive_is_segment(const char *name)
+{
+    size_t          len = strlen(name);
+    const char     *base;
+
+    if (len < TRAPD_ARCHIVE_NAME_LEN)
+        return 0;
+    base = name + len - TRAPD_ARCHIVE_NAME_LEN;
+    if (base != name && base[-1] != '/')
+        return 0;
+    return !strncmp(base, "snmptrapd-", 10) && base[18] == '-' &&
+        !strcmp(base + 25, ".archive");
+}
+
+static int
+_archive_segment_filter(const void *text, void *ctx)
+{
+    return _archive_is_segment((const char *) text) ?
+        NETSNMP_DIR_INCLUDE : NETSNMP_DIR_EXCLUDE;
+}
+
+/*
+ * the segment files of a directory, sorted by name and so by time
+ */
+static netsnmp_container *
+_archive_segments(const char *dir)
+{
+    return netsnmp_directory_container_read_some(NULL, dir,
+                                                 _archive_segment_filter,
+                                                 NULL, NETSNMP_DIR_SORTED);
+}
+
+/*
+ * remove the segments last written more than archiveRetention days ago
+ */
+static void
+_archive_expire(time_t now)
+{
+    netsnmp_container *segments;
+    netsnmp_iterator *it;
+    struct stat     st;
+    const char     *path;
+
+    if (_arc.retention <= 0)
+        return;
+    segments = _archive_segments(_arc.dir);
+    if (segments == NULL)
+        return;
+    it = CONTAINER_ITERATOR(segments);
+    if (it) {
+        for (path = (const char *) ITERATOR_FIRST(it); path;
+             path = (const char *) ITERATOR_NEXT(it)) {
+            if (stat(path, &st) != 0 ||
+                st.st_mtime >= now - (time_t) _arc.retention * 86400)
+                continue;
+            if (unlink(path) == 0) {
+                DEBUGMSGTL(("snmptrapd:archive", "removed %s\n", path));
+                _arc.stats.expired++;
+            } else
+                snmp_log(LOG_ERR, "archive: could not remove %s: %s\n",
+                         path, strerror(errno));
+        }
+        ITERATOR_RELEASE(it);
+    }
+    netsnmp_directory_container_free(segments);
+}
+
+static int
+_archive_open(time_t start)
+{
+    char            path[SNMP_MAXPATH];
+    u_char          header[TRAPD_ARCHIVE_HEADER_LEN];
+    struct tm      *tm;
+    time_t          t;
+    int             fd = -1, tries;
+
+    _archive_expire(start);
+    mkdirhier(_arc.dir, NETSNMP_AGENT_DIRECTORY_MODE, 0);
+    /* a segment started in the same second takes the next free name */
+    for (t = start, tries = 0; fd < 0 && tries < 60; t++, tries++) {
+        tm = gmtime(&t);
+        if (tm == NULL)
+            break;
+        snprintf(path, sizeof(path),
+                 "%s/snmptrapd-%04d%02d%02d-%02d%02d%02d.archive", _arc.dir,
+                 tm->tm_year + 1900, tm->tm_mon + 1, tm->tm_mday,
+                 tm->tm_hour, tm->tm_min, tm->tm_sec);
+        fd = open(path, O_WRONLY | O_CREAT | O_EXCL | O_BINARY, 0666);
+        if (fd < 0 && errno != EEXIST)
+            break;
+    }
+    if (fd < 0) {
+        snmp_log(LOG_ERR, "archive: could not create a segment in %s: %s\n",
+                 _arc.dir, strerror(errno));
+        _arc.stats.write_errors++;
+        return -1;
+    }
+
+    memset(header, 0, sizeof(header));
+    memcpy(header, "NSTA", 4);
+    header[4] = TRAPD_ARCHIVE_VERSION;
+    _put_time(header + 8, start);
+    if (write(fd, header, sizeof(header)) != sizeof(header)) {
+        snmp_log(LOG_ERR, "archive: could not write %s: %s\n", path,
+                 strerror(errno));
+        _arc.stats.write_errors++;
+        close(fd);
+        unlink(path);
+        return -1;
+    }
+    DEBUGMSGTL(("snmptrapd:archive", "started %s\n", path));
+    _arc.fd = fd;
+    _arc.segment_start = start;
+    _arc.segment_bytes = sizeof(header);
+    _arc.stats.segments++;
+    return 0;
+}
+
+static void
+_archive_close(void)
+{
+    if (_arc.fd < 0)
+        return;
+    close(_arc.fd);
+    _arc.fd = -1;
+}
+
+/*
+ * encode the dictionaries and the columns of the block into _arc.out
+ */
+static int
+_archive_encode(void)
+{
+    trapd_archive_buf data;
+    trapd_archive_buf *out = &_arc.out;
+    size_t          index_len, raw_len, stored_len;
+    u_char         *hdr;
+    int             compression = TRAPD_ARCHIVE_NONE;
+    u_int           i;
+
+    out->len = 0;
+    out->failed = 0;
+    if (_buf_reserve(out, TRAPD_ARCHIVE_BLOCK_LEN) < 0)
+        return -1;
+    out->len = TRAPD_ARCHIVE_BLOCK_LEN;
+
+    _buf_put_varint(out, _arc.sources.count);
+    for (i = 0; i < _arc.sources.count; i++) {
+        _buf_put_varint(out, _arc.sources.lens[i]);
+        _buf_put(out, _arc.sources.keys[i], _arc.sources.lens[i]);
+    }
+    _buf_put_varint(out, _arc.trapoids.count);
+    for (i = 0; i < _arc.trapoids.count; i++)
+        _buf_put_oid(out, (const oid *) _arc.trapoids.keys[i],
+                     _arc.trapoids.lens[i] / sizeof(oid));
+    _buf_put_varint(out, _arc.communities.count);
+    for (i = 0; i < _arc.communities.count; i++) {
+        _buf_put_varint(out, _arc.communities.lens[i]);
+        _buf_put(out, _arc.communities.keys[i], _arc.communities.lens[i]);
+    }
+    index_len = out->len - TRAPD_ARCHIVE_BLOCK_LEN;
+
+    /* the data: the lengths of the columns, then the columns */
+    memset(&data, 0, sizeof(data));
+    for (i = 0; i < COL_COUNT; i++)
+        _buf_put_varint(&data, _arc.cols[i].len);
+    for (i = 0; i < COL_COUNT; i++)
+        _buf_put(&data, _arc.cols[i].data, _arc.cols[i].len);
+    if (data.failed || out->failed) {
+        _buf_free(&data);
+        return -1;
+    }
+    raw_len = stored_len = data.len;
+
+#ifdef NETSNMP_USE_ZLIB
+    {
+        uLongf          zlen = compressBound(raw_len);
+
+        if (_buf_reserve(out, zlen) == 0 &&
+            compress2(out->data + out->len, &zlen, data.data, raw_len,
+                      Z_DEFAULT_COMPRESSION) == Z_OK && zlen < raw_len) {
+            compression = TRAPD_ARCHIVE_ZLIB;
+            stored_len = zlen;
+            out->len += zlen;
+        }
+    }
+#endif
+    if (compression == TRAPD_ARCHIVE_NONE)
+        _buf_put(out, data.data, raw_len);
+    _buf_free(&data);
+    if (out->failed)
+        return -1;
+
+    hdr = out->data;
+    memset(hdr, 0, TRAPD_ARCHIVE_BLOCK_LEN);
+    memcpy(hdr, "NSTB", 4);
+    _put_le32(hdr + 4, _arc.count);
+    _put_le32(hdr + 8, index_len);
+    _put_le32(hdr + 12, stored_len);
+    _put_le32(hdr + 16, raw_len);
+    hdr[20] = (u_char) compression;
+    _put_time(hdr + 24, _arc.first);
+    _put_time(hdr + 32, _arc.last);
+
+    _arc.stats.raw_bytes += TRAPD_ARCHIVE_BLOCK_LEN + index_len + raw_len;
+    _arc.stats.stored_bytes += out->len;
+    return 0;
+}
+
+static void
+_archive_reset_block(void)
+{
+    int             i;
+
+    _arc.count = 0;
+    _dict_reset(&_arc.sources);
+    _dict_reset(&_arc.trapoids);
+    _dict_reset(&_arc.communities);
+    for (i = 0; i < COL_COUNT; i++) {
+        _arc.cols[i].len = 0;
+        _arc.cols[i].failed = 0;
+    }
+}
+
+/*
+ * write the block to the current segment, starting another one if needed
+ */
+static void
+_archive_flush(void)
+{
+    const u_char   *p;
+    size_t          left;
+    ssize_t         n;
+
+    if (_arc.alarm) {
+        snmp_alarm_unregister(_arc.alarm);
+        _arc.alarm = 0;
+    }
+    if (_arc.count == 0 || _arc.dir == NULL)
+        return;
+
+    if (_arc.fd >= 0 &&
+        (_arc.segment_bytes >= _arc.segment_size ||
+         _arc.first - _arc.segment_start >= _arc.segment_age)) {
+        DEBUGMSGTL(("snmptrapd:archive", "segment full, %lu bytes\n",
+                    _arc.segment_bytes));
+        _archive_close();
+    }
+    if (_arc.fd < 0 && _archive_open(_arc.first) < 0) {
+        _archive_reset_block();
+        return;
+    }
+
+    if (_archive_encode() < 0) {
+        snmp_log(LOG_ERR, "archive: could not encode a block of %u "
+                 "notifications\n", _arc.count);
+        _arc.stats.write_errors++;
+        _archive_reset_block();
+        return;
+    }
+
+    for (p = _arc.out.data, left = _arc.out.len; left > 0; ) {
+        n = write(_arc.fd, p, left);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            break;
+        p += n;
+        left -= n;
+    }
+    if (left) {
+        /* whatever made it is a torn block; carry on in a new segment */
+        snmp_log(LOG_ERR, "archive: could not write a block: %s\n",
+                 strerror(errno));
+        _arc.stats.write_errors++;
+        _archive_close();
+    } else {
+        DEBUGMSGTL(("snmptrapd:archive", "wrote %u notifications in %lu "
+                    "bytes\n", _arc.count, (u_long) _arc.out.len));
+        _arc.segment_bytes += _arc.out.len;
+        _arc.stats.archived += _arc.count;
+        _arc.stats.blocks++;
+    }
+    _archive_reset_block();
+}
+
+static void
+_archive_alarm(unsigned int clientreg, void *clientarg)
+{
+    _arc.alarm = 0;
+    _archive_flush();
+}
+
+/*
+ * the handler, run for every notification that may be logged
+ */
+static int
+archive_handler(netsnmp_pdu *pdu, netsnmp_transport *transport,
+                netsnmp_trapd_handler *handler)
+{
+    if (_arc.dir == NULL)
+        return NETSNMPTRAPD_HANDLER_OK;
+
+    if (_archive_add(pdu, transport, time(NULL)) < 0) {
+        snmp_log(LOG_ERR, "archive: could not add a notification\n");
+        _arc.stats.write_errors++;
+        return NETSNMPTRAPD_HANDLER_OK;
+    }
+    if (_arc.count >= (u_int) _arc.block_records)
+        _archive_flush();
+    else if (_arc.count == 1 && _arc.alarm == 0)
+        _arc.alarm = snmp_alarm_register(_arc.flush_interval, 0,
+                                         _archive_alarm, NULL);
+    return NETSNMPTRAPD_HANDLER_OK;
+}
+
+/*
+ * parse the archive configuration tokens
+ */
+static void
+_parse_archive_dir(const char *token, char *cptr)
+{
+    netsnmp_trapd_handler *traph;
+
+    if (*cptr == '\0') {
+        config_perror("archiveDir needs a directory");
+        return;
+    }
+    if (_arc.dir && strcmp(_arc.dir, cptr)) {
+        _archive_flush();
+        _archive_close();
+    }
+    free(_arc.dir);
+    _arc.dir = strdup(cptr);
+    if (!_arc.registered) {
+        traph = netsnmp_add_global_traphandler(NETSNMPTRAPD_PRE_HANDLER,
+                                               archive_handler);
+        if (traph == NULL) {
+            config_perror("could not add the archive handler");
+            return;
+        }
+        traph->authtypes = TRAP_AUTH_LOG;
+        _arc.registered = 1;
+    }
+    DEBUGMSGTL(("snmptrapd:archive", "archiving to %s\n", _arc.dir));
+}
+
+static void
+_free_archive_dir(void)
+{
+    _archive_flush();
+    _archive_close();
+    SNMP_FREE(_arc.dir);
+}
+
+static void
+_parse_archive_block_records(const char *token, char *cptr)
+{
+    int             records = atoi(cptr);
+
+    if (records < 1) {
+        config_perror("archiveBlockRecords must be at least 1");
+        return;
+    }
+    _arc.block_records = records;
+}
+
+static void
+_free_archive_block_records(void)
+{
+    _arc.block_records = TRAPD_ARCHIVE_BLOCK_RECORDS;
+}
+
+static void
+_parse_archive_flush_interval(const char *token, char *cptr)
+{
+    int             interval = atoi(cptr);
+
+    if (interval < 1) {
+        config_perror("archiveFlushInterval must be at least 1");
+        return;
+    }
+    _arc.flush_interval = interval;
+}
+
+static void
+_free_archive_flush_interval(void)
+{
+    _arc.flush_interval = TRAPD_ARCHIVE_FLUSH_INTERVAL;
+}
+
+static void
+_parse_archive_segment_size(const char *token, char *cptr)
+{
+    int             size = atoi(cptr);
+
+    if (size < 1) {
+        config_perror("archiveSegmentSize must be at least 1");
+        return;
+    }
+    _arc.segment_size = (u_long) size * 1024 * 1024;
+}
+
+static void
+_free_archive_segment_size(void)
+{
+    _arc.segment_size = TRAPD_ARCHIVE_SEGMENT_SIZE * 1024 * 1024;
+}
+
+static void
+_parse_archive_segment_age(const char *token, char *cptr)
+{
+    int             age = atoi(cptr);
+
+    if (age < 1) {
+        config_perror("archiveSegmentAge must be at least 1");
+        return;
+    }
+    _arc.segment_age = age;
+}
+
+static void
+_free_archive_segment_age(void)
+{
+    _arc.segment_age = TRAPD_ARCHIVE_SEGMENT_AGE;
+}
+
+static void
+_parse_archive_retention(const char *token, char *cptr)
+{
+    int             days = atoi(cptr);
+
+    if (days < 0) {
+        config_perror("archiveRetention must not be negative");
+        return;
+    }
+    _arc.retention = days;
+}
+
+static void
+_free_archive_retention(void)
+{
+    _arc.retention = 0;
+}
+
+/*
+ * register archive related configuration tokens
+ */
+void
+snmptrapd_register_archive_configs(void)
+{
+    register_config_handler("snmptrapd", "archiveDir",
+                            _parse_archive_dir, _free_archive_dir,
+                            "directory");
+    register_config_handler("snmptrapd", "archiveBlockRecords",
+                            _parse_archive_block_records,
+                            _free_archive_block_records, "integer");
+    register_config_handler("snmptrapd", "archiveFlushInterval",
+                            _parse_archive_flush_interval,
+                            _free_archive_flush_interval, "seconds");
+    register_config_handler("snmptrapd", "archiveSegmentSize",
+                            _parse_archive_segment_size,
+                            _free_archive_segment_size, "megabytes");
+    register_config_handler("snmptrapd", "archiveSegmentAge",
+                            _parse_archive_segment_age,
+                            _free_archive_segment_age, "seconds");
+    register_config_handler("snmptrapd", "archiveRetention",
+                            _parse_archive_retention,
+                            _free_archive_retention, "days");
+}
+
+int
+snmptrapd_archive_get_stats(netsnmp_trapd_archive_stats *stats)
+{
+    if (_arc.dir == NULL)
+        return -1;
+    *stats = _arc.stats;
+    return 0;
+}
+
+void
+snmptrapd_archive_log_stats(void)
+{
+    if (_arc.dir == NULL)
+        return;
+    snmp_log(LOG_INFO, "archive to %s: %lu archived, %lu blocks, "
+             "%lu bytes (%lu before compression), %lu segments, "
+             "%lu expired, %lu write errors\n",
+             _arc.dir, _arc.stats.archived, _arc.stats.blocks,
+             _arc.stats.stored_bytes, _arc.stats.raw_bytes,
+             _arc.stats.segments, _arc.stats.expired,
+             _arc.stats.write_errors);
+}
+
+/*
+ * write what is pending, log the counters and close the segment
+ */
+void
+snmptrapd_archive_shutdown(void)
+{
+    int             i;
+
+    _archive_flush();
+    snmptrapd_archive_log_stats();
+    _archive_close();
+    _dict_free(&_arc.sources);
+    _dict_free(&_arc.trapoids);
+    _dict_free(&_arc.communities);
+    for (i = 0; i < COL_COUNT; i++)
+        _buf_free(&_arc.cols[i]);
+    _buf_free(&_arc.out);
+}
+
+/*
+ * reading the archive
+ */
+typedef struct trapd_archive_cursor_s {
+    const u_char   *p;
+    const u_char   *end;
+} trapd_archive_cursor;
+
+static int
+_get_varint(trapd_archive_cursor *c, u_long *v)
+{
+    u_long          r = 0;
+    u_int           shift = 0;
+
+    while (c->p < c->end) {
+        if (shift >= sizeof(r) * 8)
+            return -1;
+        r |= (u_long) (*c->p & 0x7f) << shift;
+        if (!(*c->p++ & 0x80)) {
+            *v = r;
+            return 0;
+        }
+        shift += 7;
+    }
+    return -1;
+}
+
+static int
+_get_bytes(trapd_archive_cursor *c, const u_char **bytes, size_t *len)
+{
+    u_long          n;
+
+    if (_get_varint(c, &n) < 0 || n > (u_long) (c->end - c->p))
+        return -1;
+    *bytes = c->p;
+    *len = n;
+    c->p += n;
+    return 0;
+}
+
+static int
+_get_oid(trapd_archive_cursor *c, oid *name, size_t *len, size_t max)
+{
+    u_long          n, v, i;
+
+    if (_get_varint(c, &n) < 0 || n > max)
+        return -1;
+    for (i = 0; i < n; i++) {
+        if (_get_varint(c, &v) < 0)
+            return -1;
+        name[i] = v;
+    }
+    *len = n;
+    return 0;
+}
+
+/*
+ * the dictionaries of a block, pointing into its index
+ */
+typedef struct trapd_archive_index_s {
+    u_long          nsources;
+    const u_char  **sources;
+    size_t         *source_lens;
+    u_long          ntrapoids;
+    oid           **trapoids;
+    size_t         *trapoid_lens;
+    u_long          ncommunities;
+    const u_char  **communities;
+    size_t         *community_lens;
+} trapd_archive_index;
+
+static void
+_index_free(trapd_archive_index *idx)
+{
+    u_long          i;
+
+    for (i = 0; idx->trapoids && i < idx->ntrapoids; i++)
+        free(idx->trapoids[i]);
+    SNMP_FREE(idx->sources);
+    SNMP_FREE(idx->source_lens);
+    SNMP_FREE(idx->trapoids);
+    SNMP_FREE(idx->trapoid_lens);
+    SNMP_FREE(idx->communities);
+    SNMP_FREE(idx->community_lens);
+}
+
+static int
+_index_parse_strings(trapd_archive_cursor *c, u_long *count,
+                     const u_char ***strs, size_t **lens)
+{
+    u_long          i;
+
+    if (_get_varint(c, count) < 0 || *count > (u_long) (c->end - c->p))
+        return -1;
+    *strs = (const u_char **) calloc(*count + 1, sizeof(**strs));
+    *lens = (size_t *) calloc(*count + 1, sizeof(**lens));
+    if (*strs == NULL || *lens == NULL)
+        return -1;
+    for (i = 0; i < *count; i++)
+        if (_get_bytes(c, &(*strs)[i], &(*lens)[i]) < 0)
+            return -1;
+    return 0;
+}
+
+static int
+_index_parse(trapd_archive_cursor *c, trapd_archive_index *idx)
+{
+    oid             name[MAX_OID_LEN + 2];
+    u_long          i;
+
+    memset(idx, 0, sizeof(*idx));
+    if (_index_parse_strings(c, &idx->nsources, &idx->sources,
+                             &idx->source_lens) < 0)
+        return -1;
+    if (_get_varint(c, &idx->ntrapoids) < 0 ||
+        idx->ntrapoids > (u_long) (c->end - c->p))
+        return -1;
+    idx->trapoids = (oid **) calloc(idx->ntrapoids + 1, sizeof(oid *));
+    idx->trapoid_lens = (size_t *) calloc(idx->ntrapoids + 1,
+                                          sizeof(size_t));
+    if (idx->trapoids == NULL || idx->trapoid_lens == NULL)
+        return -1;
+    for (i = 0; i < idx->ntrapoids; i++) {
+        if (_get_oid(c, name, &idx->trapoid_lens[i], OID_LENGTH(name)) < 0)
+            return -1;
+        idx->trapoids[i] = snmp_duplicate_objid(name, idx->trapoid_lens[i]);
+        if (idx->trapoids[i] == NULL && idx->trapoid_lens[i])
+            return -1;
+    }
+    return _index_parse_strings(c, &idx->ncommunities, &idx->communities,
+                                &idx->community_lens);
+}
+
+/*
+ * decode the value of a varbind and add the varbind to pdu
+ */
+static int
+_archive_get_varbind(trapd_archive_cursor *c, oid *name, size_t *name_len,
+                     netsnmp_pdu *pdu)
+{
+    oid             rest[MAX_OID_LEN], value_oid[MAX_OID_LEN];
+    size_t          rest_len, len = 0;
+    u_long          shared, u;
+    long            l;
+    struct counter64 c64;
+    const u_char   *bytes = NULL;
+    const void     *value = NULL;
+    u_char          type;
+
+    if (_get_varint(c, &shared) < 0 || shared > *name_len ||
+        _get_oid(c, rest, &rest_len, MAX_OID_LEN - shared) < 0 ||
+        c->p >= c->end)
+        return -1;
+    memcpy(name + shared, rest, rest_len * sizeof(oid));
+    *name_len = shared + rest_len;
+    type = *c->p++;
+
+    switch (type) {
+    case ASN_INTEGER:
+        if (_get_varint(c, &u) < 0)
+            return -1;
+        l = _unzigzag(u);
+        value = &l;
+        len = sizeof(l);
+        break;
+    case ASN_COUNTER:
+    case ASN_GAUGE:
+    case ASN_TIMETICKS:
+    case ASN_UINTEGER:
+        if (_get_varint(c, &u) < 0)
+            return -1;
+        value = &u;
+        len = sizeof(u);
+        break;
+    case ASN_COUNTER64:
+        if (_get_varint(c, &c64.high) < 0 || _get_varint(c, &c64.low) < 0)
+            return -1;
+        value = &c64;
+        len = sizeof(c64);
+        break;
+    case ASN_OBJECT_ID:
+        if (_get_oid(c, value_oid, &len, MAX_OID_LEN) < 0)
+            return -1;
+        value = value_oid;
+        len *= sizeof(oid);
+        break;
+    case ASN_NULL:
+    case SNMP_NOSUCHOBJECT:
+    case SNMP_NOSUCHINSTANCE:
+    case SNMP_ENDOFMIBVIEW:
+        break;
+    default:
+        if (_get_bytes(c, &bytes, &len) < 0)
+            return -1;
+        value = bytes;
+        break;
+    }
+    if (pdu && !snmp_pdu_add_variable(pdu, name, *name_len, type, value, len))
+        return -1;
+    return 0;
+}
+
+/*
+ * decode the notifications of a block and pass those matching query on
+ */
+static int
+_archive_scan_block(const u_char *data, size_t data_len,
+                    u_long count, const trapd_archive_index *idx,
+                    const char *match_trapoid, long match_source,
+                    const netsnmp_trapd_archive_query *query,
+                    Netsnmp_Trap_Archive_Callback *callback, void *ctx,
+                    netsnmp_trapd_archive_scan_stats *stats)
+{
+    trapd_archive_cursor data_c, cols[COL_COUNT];
+    u_long          col_lens[COL_COUNT], n, source, trapoid, version;
+    u_long          command, uptime, community, nvars, v;
+    u_long          trap_type = 0, specific = 0;
+    time_t          when = 0;
+    oid             name[MAX_OID_LEN], enterprise[MAX_OID_LEN];
+    size_t          name_len = 0, enterprise_len = 0, len;
+    const u_char   *agent_addr = NULL;
+    char           *source_str;
+    netsnmp_pdu    *pdu;
+    int             i, matched, rc = 0;
+
+    data_c.p = data;
+    data_c.end = data + data_len;
+    for (i = 0; i < COL_COUNT; i++)
+        if (_get_varint(&data_c, &col_lens[i]) < 0)
+            return -1;
+    for (i = 0; i < COL_COUNT; i++) {
+        if (col_lens[i] > (u_long) (data_c.end - data_c.p))
+            return -1;
+        cols[i].p = data_c.p;
+        cols[i].end = data_c.p + col_lens[i];
+        data_c.p += col_lens[i];
+    }
+
+    for (n = 0; n < count; n++) {
+        if (_get_varint(&cols[COL_TIME], &v) < 0 ||
+            _get_varint(&cols[COL_SOURCE], &source) < 0 ||
+            _get_varint(&cols[COL_TRAPOID], &trapoid) < 0 ||
+            _get_varint(&cols[COL_VERSION], &version) < 0 ||
+            _get_varint(&cols[COL_COMMAND], &command) < 0 ||
+            _get_varint(&cols[COL_UPTIME], &uptime) < 0 ||
+            _get_varint(&cols[COL_COMMUNITY], &community) < 0 ||
+            source >= idx->nsources || trapoid >= idx->ntrapoids ||
+            community >= idx->ncommunities)
+            return -1;
+        when += _unzigzag(v);
+        if (command == SNMP_MSG_TRAP) {
+            if (cols[COL_V1].end - cols[COL_V1].p < 4)
+                return -1;
+            agent_addr = cols[COL_V1].p;
+            cols[COL_V1].p += 4;
+            if (_get_varint(&cols[COL_V1], &trap_type) < 0 ||
+                _get_varint(&cols[COL_V1], &specific) < 0 ||
+                _get_oid(&cols[COL_V1], enterprise, &enterprise_len,
+                         MAX_OID_LEN) < 0)
+                return -1;
+        }
+        stats->records++;
+
+        matched = (!query->begin || when >= query->begin) &&
+            (!query->end || when <= query->end) &&
+            (match_source < 0 || (long) source == match_source) &&
+            (!match_trapoid || match_trapoid[trapoid]);
+
+        pdu = NULL;
+        if (matched) {
+            pdu = snmp_pdu_create((int) command);
+            if (pdu == NULL)
+                return -1;
+            pdu->version = version;
+            pdu->time = uptime;
+            if (version == SNMP_VERSION_3) {
+                len = idx->community_lens[community];
+                pdu->securityName = (char *) malloc(len + 1);
+                if (pdu->securityName) {
+                    memcpy(pdu->securityName, idx->communities[community],
+                           len);
+                    pdu->securityName[len] = '\0';
+                    pdu->securityNameLen = len;
+                }
+            } else {
+                len = idx->community_lens[community];
+                pdu->community = (u_char *) malloc(len + 1);
+                if (pdu->community) {
+                    memcpy(pdu->community, idx->communities[community], len);
+                    pdu->community_len = len;
+                }
+            }
+            if (command == SNMP_MSG_TRAP) {
+                memcpy(pdu->agent_addr, agent_addr, 4);
+                pdu->trap_type = trap_type;
+                pdu->specific_type = specific;
+                pdu->enterprise = snmp_duplicate_objid(enterprise,
+                                                       enterprise_len);
+                pdu->enterprise_length = enterprise_len;
+            }
+        }
+
+        if (_get_varint(&cols[COL_VARBINDS], &nvars) < 0) {
+            snmp_free_pdu(pdu);
+            return -1;
+        }
+        for (v = 0; v < nvars; v++)
+            if (_archive_get_varbind(&cols[COL_VARBINDS], name, &name_len,
+                                     pdu) < 0) {
+                snmp_free_pdu(pdu);
+                return -1;
+            }
+
+        if (pdu) {
+            stats->matched++;
+            source_str = (char *) malloc(idx->source_lens[source] + 1);
+            if (source_str) {
+                memcpy(source_str, idx->sources[source],
+                       idx->source_lens[source]);
+                source_str[idx->source_lens[source]] = '\0';
+                rc = (*callback)(when, source_str, idx->trapoids[trapoid],
+                                 idx->trapoid_lens[trapoid], pdu, ctx);
+                free(source_str);
+            }
+            snmp_free_pdu(pdu);
+            if (rc)
+                return 1;
+        }
+    }
+    return 0;
+}
+
+/*
+ * scan a segment file; returns 1 if the callback stopped the scan
+ */
+static int
+_archive_scan_segment(const char *path,
+                      const netsnmp_trapd_archive_query *query,
+                      Netsnmp_Trap_Archive_Callback *callback, void *ctx,
+                      netsnmp_trapd_archive_scan_stats *stats)
+{
+    u_char          header[TRAPD_ARCHIVE_BLOCK_LEN];
+    u_char         *index_buf = NULL, *stored = NULL, *raw = NULL;
+    size_t          index_size = 0, stored_size = 0;
+#ifdef NETSNMP_USE_ZLIB
+    size_t          raw_size = 0;
+#endif
+    u_long          count, index_len, stored_len, raw_len, i;
+    time_t          first, last;
+    trapd_archive_cursor c;
+    trapd_archive_index idx;
+    char           *match_trapoid = NULL;
+    long            match_source;
+    int             compression, skip, rc = 0;
+    FILE           *f;
+
+    f = fopen(path, "rb");
+    if (f == NULL) {
+        snmp_log(LOG_ERR, "archive: could not open %s: %s\n", path,
+                 strerror(errno));
+        stats->errors++;
+        return 0;
+    }
+    if (fread(header, 1, TRAPD_ARCHIVE_HEADER_LEN, f) !=
+        TRAPD_ARCHIVE_HEADER_LEN || memcmp(header, "NSTA", 4) ||
+        header[4] != TRAPD_ARCHIVE_VERSION) {
+        snmp_log(LOG_ERR, "archive: %s is not an archive segment\n", path);
+        stats->errors++;
+        fclose(f);
+        return 0;
+    }
+
+    memset(&idx, 0, sizeof(idx));
+    while (rc == 0) {
+        i = fread(header, 1, sizeof(header), f);
+        if (i == 0)
+            break;
+        if (i != sizeof(header) || memcmp(header, "NSTB", 4)) {
+            DEBUGMSGTL(("snmptrapd:archive", "%s: torn block\n", path));
+            stats->errors++;
+            break;
+        }
+        count = _get_le32(header + 4);
+        index_len = _get_le32(header + 8);
+        stored_len = _get_le32(header + 12);
+        raw_len = _get_le32(header + 16);
+        compression = header[20];
+        first = _get_time(header + 24);
+        last = _get_time(header + 32);
+        stats->blocks++;
+
+        if ((query->begin && last < query->begin) ||
+            (query->end && first > query->end)) {
+            stats->blocks_skipped++;
+            if (fseek(f, index_len + stored_len, SEEK_CUR) != 0)
+                break;
+            continue;
+        }
+
+        if (index_len + 1 > index_size) {
+            u_char         *p = (u_char *) realloc(index_buf, index_len + 1);
+            if (p == NULL)
+                break;
+            index_buf = p;
+            index_size = index_len + 1;
+        }
+        if (fread(index_buf, 1, index_len, f) != index_len) {
+            stats->errors++;
+            break;
+        }
+        c.p = index_buf;
+        c.end = index_buf + index_len;
+        _index_free(&idx);
+        SNMP_FREE(match_trapoid);
+        if (_index_parse(&c, &idx) < 0) {
+            stats->errors++;
+            break;
+        }
+
+        /* look the source and trap OID of the query up in the index */
+        skip = 0;
+        match_source = -1;
+        if (query->source) {
+            for (i = 0; i < idx.nsources; i++)
+                if (idx.source_lens[i] == strlen(query->source) &&
+                    !memcmp(idx.sources[i], query->source,
+                            idx.source_lens[i]))
+                    break;
+            if (i == idx.nsources)
+                skip = 1;
+            match_source = i;
+        }
+        if (query->trapoid && !skip) {
+            match_trapoid = (char *) calloc(idx.ntrapoids + 1, 1);
+            if (match_trapoid == NULL)
+                break;
+            skip = 1;
+            for (i = 0; i < idx.ntrapoids; i++) {
+                if (query->subtree)
+                    match_trapoid[i] =
+                        !netsnmp_oid_is_subtree(query->trapoid,
+                                                query->trapoid_len,
+                                                idx.trapoids[i],
+                                                idx.trapoid_lens[i]);
+                else
+                    match_trapoid[i] =
+                        !snmp_oid_compare(query->trapoid, query->trapoid_len,
+                                          idx.trapoids[i],
+                                          idx.trapoid_lens[i]);
+                if (match_trapoid[i])
+                    skip = 0;
+            }
+        }
+        if (skip) {
+            stats->blocks_skipped++;
+            if (fseek(f, stored_len, SEEK_CUR) != 0)
+                break;
+            continue;
+        }
+
+        if (stored_len > stored_size) {
+            u_char         *p = (u_char *) realloc(stored, stored_len);
+            if (p == NULL)
+                break;
+            stored = p;
+            stored_size = stored_len;
+        }
+        if (fread(stored, 1, stored_len, f) != stored_len) {
+            stats->errors++;
+            break;
+        }
+        if (compression == TRAPD_ARCHIVE_ZLIB) {
+#ifdef NETSNMP_USE_ZLIB
+            uLongf          zlen = raw_len;
+
+            if (raw_len > raw_size) {
+                u_char         *p = (u_char *) realloc(raw, raw_len);
+                if (p == NULL)
+                    break;
+                raw = p;
+                raw_size = raw_len;
+            }
+            if (uncompress(raw, &zlen, stored, stored_len) != Z_OK ||
+                zlen != raw_len) {
+                stats->errors++;
+                continue;
+            }
+            rc = _archive_scan_block(raw, raw_len, count, &idx,
+                                     match_trapoid, match_source, query,
+                                     callback, ctx, stats);
+#else
+            snmp_log(LOG_ERR, "archive: %s holds compressed blocks, "
+                     "but zlib support was not compiled in\n", path);
+            stats->errors++;
+            break;
+#endif
+        } else if (compression == TRAPD_ARCHIVE_NONE && raw_len == stored_len)
+            rc = _archive_scan_block(stored, stored_len, count, &idx,
+                                     match_trapoid, match_source, query,
+                                     callback, ctx, stats);
+        else {
+            stats->errors++;
+            continue;
+        }
+        if (rc < 0) {
+            DEBUGMSGTL(("snmptrapd:archive", "%s: corrupt block\n", path));
+            stats->errors++;
+            rc = 0;
+        }
+    }
+
+    _index_free(&idx);
+    SNMP_FREE(match_trapoid);
+    SNMP_FREE(index_buf);
+    SNMP_FREE(stored);
+    SNMP_FREE(raw);
+    fclose(f);
+    return rc;
+}
+
+static int
+_archive_segment_start(const char *path, time_t *start)
+{
+    u_char          header[TRAPD_ARCHIVE_HEADER_LEN];
+    FILE           *f = fopen(path, "rb");
+    int             ok;
+
+    if (f == NULL)
+        return -1;
+    ok = fread(header, 1, sizeof(header), f) == sizeof(header) &&
+        !memcmp(header, "NSTA", 4);
+    fclose(f);
+    if (!ok)
+        return -1;
+    *start = _get_time(header + 8);
+    return 0;
+}
+
+/*
+ * scan an archive directory, or a single segment file, passing the
+ * notifications matching query to callback in the order received;
+ * returns -1 if path could not be read
+ */
+int
+netsnmp_trapd_archive_scan(const char *path,
+                           const netsnmp_trapd_archive_query *query,
+                           Netsnmp_Trap_Archive_Callback *callback,
+                           void *ctx, netsnmp_trapd_archive_scan_stats *stats)
+{
+    netsnmp_trapd_archive_scan_stats dummy;
+    netsnmp_container *segments;
+    netsnmp_iterator *it;
+    struct stat     st;
+    char           *cur, *next;
+    time_t          cur_start = 0, next_start = 0;
+    int             have_cur, have_next, rc = 0;
+
+    if (stats == NULL)
+        stats = &dummy;
+    memset(stats, 0, sizeof(*stats));
+    if (stat(path, &st) != 0)
+        return -1;
+    if (!S_ISDIR(st.st_mode)) {
+        stats->segments++;
+        rc = _archive_scan_segment(path, query, callback, ctx, stats);
+        return 0;
+    }
+
+    segments = _archive_segments(path);
+    if (segments == NULL)
+        return 0;               /* nothing archived yet */
+    it = CONTAINER_ITERATOR(segments);
+    if (it == NULL) {
+        netsnmp_directory_container_free(segments);
+        return -1;
+    }
+
+    /*
+     * the notifications of a segment came in after it started, and
+     * before the next one did
+     */
+    cur = (char *) ITERATOR_FIRST(it);
+    have_cur = cur && _archive_segment_start(cur, &cur_start) == 0;
+    while (cur && rc == 0) {
+        next = (char *) ITERATOR_NEXT(it);
+        have_next = next && _archive_segment_start(next, &next_start) == 0;
+        stats->segments++;
+        if ((query->end && have_cur && cur_start > query->end) ||
+            (query->begin && have_next && next_start < query->begin)) {
+            DEBUGMSGTL(("snmptrapd:archive", "skipping %s\n", cur));
+            stats->segments_skipped++;
+        } else
+            rc = _archive_scan_segment(cur, query, callback, ctx, stats);
+        cur = next;
+        cur_start = next_start;
+        have_cur = have_next;
+    }
+    ITERATOR_RELEASE(it);
+    netsnmp_directory_container_free(segments);
+    return 0;
+}
@@ -0,0 +1,60 @@
+#ifndef SNMPTRAPD_ARCHIVE_H
+#define SNMPTRAPD_ARCHIVE_H
+
+typedef struct netsnmp_trapd_archive_stats_s {
+    u_long          archived;       /* notifications appended */
+    u_long          blocks;         /* blocks written */
+    u_long          raw_bytes;      /* block contents before compression */
+    u_long          stored_bytes;   /* ... and as written */
+    u_long          segments;       /* segment files opened */
+    u_long          expired;        /* ... and removed by archiveRetention */
+    u_long          write_errors;
+} netsnmp_trapd_archive_stats;
+
+/*
+ * a query of the archive: notifications received in [begin, end] (either
+ * 0 for no limit), from the source address "source" and with a trap OID
+ * equal to trapoid, or within it if subtree is set (any of them NULL for
+ * no limit)
+ */
+typedef struct netsnmp_trapd_archive_query_s {
+    time_t          begin;
+    time_t          end;
+    const char     *source;
+    const oid      *trapoid;
+    size_t          trapoid_len;
+    int             subtree;
+} netsnmp_trapd_archive_query;
+
+typedef struct netsnmp_trapd_archive_scan_stats_s {
+    u_long          segments;       /* segment files looked at */
+    u_long          segments_skipped; /* ... and skipped by their time */
+    u_long          blocks;         /* blocks looked at */
+    u_long          blocks_skipped; /* ... and skipped by their index */
+    u_long          records;        /* notifications decoded */
+    u_long          matched;        /* ... and passed to the callback */
+    u_long          errors;         /* truncated or corrupt blocks */
+} netsnmp_trapd_archive_scan_stats;
+
+/*
+ * called for each notification matching a query; the pdu holds the
+ * version, command, community, uptime, v1 fields and varbinds as received.
+ * A non-zero return stops the scan.
+ */
+typedef int (Netsnmp_Trap_Archive_Callback)(time_t when, const char *source,
+                                            const oid *trapoid,
+                                            size_t trapoid_len,
+                                            netsnmp_pdu *pdu, void *ctx);
+
+void snmptrapd_register_archive_configs(void);
+int  snmptrapd_archive_get_stats(netsnmp_trapd_archive_stats *stats);
+void snmptrapd_archive_log_stats(void);
+void snmptrapd_archive_shutdown(void);
+
+int  netsnmp_trapd_archive_scan(const char *path,
+                                const netsnmp_trapd_archive_query *query,
+                                Netsnmp_Trap_Archive_Callback *callback,
+                                void *ctx,
+                                netsnmp_trapd_archive_scan_stats *stats);
+
+#endif /* SNMPTRAPD_ARCHIVE_H */
@@ -9,6 +9,14 @@
  */
 #include <net-snmp/net-snmp-config.h>
 
+#ifdef HAVE_STDLIB_H
+#include <stdlib.h>
+#endif
+#ifdef HAVE_STRING_H
+#include <string.h>
+#else
+#include <strings.h>
+#endif
 #ifdef HAVE_SYS_TYPES_H
 #include <sys/types.h>
 #endif
@@ -33,6 +41,204 @@
 
 #include <net-snmp/agent/agent_trap.h>
 
+/* default of authCacheSize */
+#define TRAPD_AUTH_CACHE_SIZE   1000
+#define TRAPD_AUTH_KEY_LEN      1024
+
+#ifdef USING_MIBII_VACM_CONF_MODULE
+/*
+ * The decisions of the VACM checks are cached: they depend only on the
+ * security model, level and name, the context and the trap OID of a
+ * notification, so the group, access and view lookups are done once per
+ * such key rather than for every notification.  The whole cache is
+ * dropped whenever the VACM configuration changes, and when it is full.
+ */
+typedef struct trapd_auth_entry_s {
+    u_char         *key;
+    size_t          key_len;
+    int             authtypes;      /* TRAP_AUTH_* bits authorized */
+} trapd_auth_entry;
+
+/*
+ * define a structure to hold all the file globals
+ */
+typedef struct netsnmp_trapd_auth_globals_t {
+    u_int           max_entries;    /* from authCacheSize, 0 for none */
+    netsnmp_container *cache;       /* trapd_auth_entry, by key */
+    unsigned int    generation;     /* of the VACM tables it is valid for */
+    u_long          checked;        /* notifications checked */
+    u_long          hits;           /* ... and found in the cache */
+    u_long          flushes;        /* times the cache was dropped */
+} netsnmp_trapd_auth_globals;
+
+static netsnmp_trapd_auth_globals _auth = {
+    TRAPD_AUTH_CACHE_SIZE               /* max_entries */
+};
+
+static int
+_auth_compare(const void *lhs, const void *rhs)
+{
+    const trapd_auth_entry *a = (const trapd_auth_entry *) lhs;
+    const trapd_auth_entry *b = (const trapd_auth_entry *) rhs;
+
+    if (a->key_len != b->key_len)
+        return a->key_len < b->key_len ? -1 : 1;
+    return memcmp(a->key, b->key, a->key_len);
+}
+
+static void
+_auth_entry_free(void *data, void *context)
+{
+    trapd_auth_entry *e = (trapd_auth_entry *) data;
+
+    free(e->key);
+    free(e);
+}
+
+static void
+_auth_flush(void)
+{
+    if (_auth.cache == NULL || CONTAINER_SIZE(_auth.cache) == 0)
+        return;
+    CONTAINER_CLEAR(_auth.cache, _auth_entry_free, NULL);
+    _auth.flushes++;
+}
+
+static int
+_auth_key_put(u_char *key, size_t *key_len, const void *p, size_t n)
+{
+    size_t          len = n;
+
+    if (*key_len + sizeof(len) + n > TRAPD_AUTH_KEY_LEN)
+        return -1;
+    memcpy(key + *key_len, &len, sizeof(len));
+    if (n)
+        memcpy(key + *key_len + sizeof(len), p, n);
+    *key_len += sizeof(len) + n;
+    return 0;
+}
+
+/*
+ * check the notification against each type of VACM access we may want
+ * to check up on later
+ */
+static int
+_auth_check(netsnmp_pdu *pdu, oid *trapoid, size_t trapoid_len)
+{
+    int             ret = 0;
+    int             i;
+
+    for(i = 0; i < VACM_MAX_VIEWS; i++) {
+        /* pass the PDU to the VACM routine for handling authorization */
+        DEBUGMSGTL(("snmptrapd:auth", "Calling VACM for checking phase %d:%s\n",
+                    i, se_find_label_in_slist(VACM_VIEW_ENUM_NAME, i)));
+        if (vacm_check_view_contents(pdu, trapoid, trapoid_len, 0, i,
+                                     VACM_CHECK_VIEW_CONTENTS_DNE_CONTEXT_OK)
+            == VACM_SUCCESS) {
+            DEBUGMSGTL(("snmptrapd:auth", "  result: authorized\n"));
+            ret |= 1 << i;
+        } else {
+            DEBUGMSGTL(("snmptrapd:auth", "  result: not authorized\n"));
+        }
+    }
+    return ret;
+}
+
+/*
+ * the TRAP_AUTH_* bits a notification is authorized for, from the cache
+ * if the decision is known
+ */
+static int
+_auth_lookup(netsnmp_pdu *pdu, oid *trapoid, size_t trapoid_len)
+{
+    u_char          key[TRAPD_AUTH_KEY_LEN];
+    trapd_auth_entry lookup, *e;
+    const char     *sn;
+    int             ret;
+
+    _auth.checked++;
+    if (_auth.max_entries == 0)
+        return _auth_check(pdu, trapoid, trapoid_len);
+    if (_auth.cache == NULL) {
+        _auth.cache =
+            netsnmp_container_find("snmptrapd_auth:btree:binary_array");
+        if (_auth.cache == NULL)
+            return _auth_check(pdu, trapoid, trapoid_len);
+        _auth.cache->container_name = strdup("snmptrapd_auth");
+        _auth.cache->compare = _auth_compare;
+        _auth.generation = vacm_get_generation();
+    }
+    if (_auth.generation != vacm_get_generation()) {
+        DEBUGMSGTL(("snmptrapd:auth", "VACM changed, dropping the cache\n"));
+        _auth_flush();
+        _auth.generation = vacm_get_generation();
+    }
+
+    /* for community based PDUs this also sets the context name */
+    sn = vacm_pdu_security_name(pdu);
+    if (sn == NULL)
+        return _auth_check(pdu, trapoid, trapoid_len);
+
+    lookup.key = key;
+    lookup.key_len = 0;
+    if (_auth_key_put(key, &lookup.key_len, &pdu->securityModel,
+                      sizeof(pdu->securityModel)) < 0 ||
+        _auth_key_put(key, &lookup.key_len, &pdu->securityLevel,
+                      sizeof(pdu->securityLevel)) < 0 ||
+        _auth_key_put(key, &lookup.key_len, sn, strlen(sn)) < 0 ||
+        _auth_key_put(key, &lookup.key_len, pdu->contextName,
+                      pdu->contextName ? pdu->contextNameLen : 0) < 0 ||
+        _auth_key_put(key, &lookup.key_len, trapoid,
+                      trapoid_len * sizeof(oid)) < 0)
+        return _auth_check(pdu, trapoid, trapoid_len);
+
+    e = (trapd_auth_entry *) CONTAINER_FIND(_auth.cache, &lookup);
+    if (e) {
+        _auth.hits++;
+        DEBUGMSGTL(("snmptrapd:auth", "cached bitmask auth for %s: %x\n",
+                    sn, e->authtypes));
+        return e->authtypes;
+    }
+
+    ret = _auth_check(pdu, trapoid, trapoid_len);
+
+    if (CONTAINER_SIZE(_auth.cache) >= _auth.max_entries)
+        _auth_flush();
+    e = SNMP_MALLOC_TYPEDEF(trapd_auth_entry);
+    if (e == NULL)
+        return ret;
+    e->key = netsnmp_memdup(key, lookup.key_len);
+    e->key_len = lookup.key_len;
+    e->authtypes = ret;
+    if (e->key == NULL || CONTAINER_INSERT(_auth.cache, e) != 0)
+        _auth_entry_free(e, NULL);
+    return ret;
+}
+#endif /* USING_MIBII_VACM_CONF_MODULE */
+
+static void
+_parse_auth_cache_size(const char *token, char *cptr)
+{
+    int             size = atoi(cptr);
+
+    if (size < 0) {
+        config_perror("authCacheSize must not be negative");
+        return;
+    }
+#ifdef USING_MIBII_VACM_CONF_MODULE
+    _auth.max_entries = size;
+#endif
+}
+
+static void
+_free_auth_cache_size(void)
+{
+#ifdef USING_MIBII_VACM_CONF_MODULE
+    _auth_flush();
+    _auth.max_entries = TRAPD_AUTH_CACHE_SIZE;
+#endif
+}
+
 /**
  * initializes the snmptrapd authorization code registering needed
  * handlers and config parsers.
@@ -45,6 +251,7 @@ init_netsnmp_trapd_auth(void)
     traph = netsnmp_add_global_traphandler(NETSNMPTRAPD_AUTH_HANDLER,
                                            netsnmp_trapd_auth);
     traph->authtypes = TRAP_AUTH_NONE;
+    traph->flags |= NETSNMP_TRAPHANDLER_FLAG_LAZY_VALUES;
 
 #ifdef USING_MIBII_VACM_CONF_MODULE
     /* register our configuration tokens for VACM configs */
@@ -55,11 +262,50 @@ init_netsnmp_trapd_auth(void)
     netsnmp_ds_register_config(ASN_BOOLEAN, "snmptrapd", "disableAuthorization",
                                NETSNMP_DS_APPLICATION_ID,
                                NETSNMP_DS_APP_NO_AUTHORIZATION);
+
+    register_config_handler("snmptrapd", "authCacheSize",
+                            _parse_auth_cache_size, _free_auth_cache_size,
+                            "integer");
 }
 
 /* XXX: store somewhere in the PDU instead */
 static int lastlookup;
 
+/*
+ * the trap OID of a notification: built from the enterprise and trap
+ * types of an SNMPv1 trap, as convert_v1pdu_to_v2() would, rather than
+ * by converting it
+ */
+static int
+_auth_trapoid(netsnmp_pdu *pdu, oid *trapoid, size_t *trapoid_len)
+{
+    oid snmptrapoid[] = { 1,3,6,1,6,3,1,1,4,1,0 };
+    size_t snmptrapoid_len = OID_LENGTH(snmptrapoid);
+    netsnmp_variable_list *var;
+
+#ifndef NETSNMP_DISABLE_SNMPV1
+    if (pdu->version == SNMP_VERSION_1)
+        return netsnmp_build_trap_oid(pdu, trapoid, trapoid_len) ==
+            SNMPERR_SUCCESS ? 0 : -1;
+#endif
+
+    /* loop through each variable and find the snmpTrapOID.0 var
+       indicating what the trap is we're staring at. */
+    for (var = pdu->variables; var != NULL; var = var->next_variable) {
+        if (netsnmp_oid_equals(var->name, var->name_length,
+                               snmptrapoid, snmptrapoid_len) == 0)
+            break;
+    }
+
+    /* make sure we can continue: we found the snmpTrapOID.0 and its an oid */
+    if (!var || var->type != ASN_OBJECT_ID || snmp_decode_var_value(var) ||
+        var->val_len > *trapoid_len * sizeof(oid))
+        return -1;
+    memcpy(trapoid, var->val.objid, var->val_len);
+    *trapoid_len = var->val_len / sizeof(oid);
+    return 0;
+}
+
 /**
  * Authorizes incoming notifications for further processing
  */
@@ -69,13 +315,8 @@ netsnmp_trapd_auth(netsnmp_pdu           *pdu,
                    netsnmp_trapd_handler *handler)
 {
     int ret = 0;
-    oid snmptrapoid[] = { 1,3,6,1,6,3,1,1,4,1,0 };
-    size_t snmptrapoid_len = OID_LENGTH(snmptrapoid);
-    netsnmp_pdu *newpdu = pdu;
-    netsnmp_variable_list *var;
-#ifdef USING_MIBII_VACM_CONF_MODULE
-    int i;
-#endif
+    oid trapoid[MAX_OID_LEN];
+    size_t trapoid_len = OID_LENGTH(trapoid);
 
     /* check to see if authorization was not disabled */
     if (netsnmp_ds_get_boolean(NETSNMP_DS_APPLICATION_ID,
@@ -88,82 +329,32 @@ netsnmp_trapd_auth(netsnmp_pdu           *pdu,
     /* bail early if called illegally */
     if (!pdu || !transport || !handler)
         return NETSNMPTRAPD_HANDLER_FINISH;
-    
-    /* convert to v2 so we can check it in a consistent manner */
-#ifndef NETSNMP_DISABLE_SNMPV1
-    if (pdu->version == SNMP_VERSION_1) {
-        newpdu = convert_v1pdu_to_v2(pdu);
-        if (!newpdu) {
-            snmp_log(LOG_ERR, "Failed to duplicate incoming PDU.  Refusing to authorize.\n");
-            return NETSNMPTRAPD_HANDLER_FINISH;
-        }
-    }
-#endif
 
     if (!vacm_is_configured()) {
-#ifndef NETSNMP_DISABLE_SNMPV1
-        if (newpdu != pdu)
-            snmp_free_pdu(newpdu);
-#endif
         snmp_log(LOG_WARNING, "No access configuration - dropping trap.\n");
         return NETSNMPTRAPD_HANDLER_FINISH;
     }
 
-    /* loop through each variable and find the snmpTrapOID.0 var
-       indicating what the trap is we're staring at. */
-    for (var = newpdu->variables; var != NULL; var = var->next_variable) {
-        if (netsnmp_oid_equals(var->name, var->name_length,
-                               snmptrapoid, snmptrapoid_len) == 0)
-            break;
-    }
-
-    /* make sure we can continue: we found the snmpTrapOID.0 and its an oid */
-    if (!var || var->type != ASN_OBJECT_ID) {
+    /* the VACM checks only need the trap OID, so SNMPv1 traps are
+       checked as they are, without converting them to v2 */
+    if (_auth_trapoid(pdu, trapoid, &trapoid_len) < 0) {
         snmp_log(LOG_ERR, "Can't determine trap identifier; refusing to authorize it\n");
-#ifndef NETSNMP_DISABLE_SNMPV1
-        if (newpdu != pdu)
-            snmp_free_pdu(newpdu);
-#endif
         return NETSNMPTRAPD_HANDLER_FINISH;
     }
 
 #ifdef USING_MIBII_VACM_CONF_MODULE
-    /* check the pdu against each typo of VACM access we may want to
-       check up on later.  We cache the results for future lookup on
-       each call to netsnmp_trapd_check_auth */
-    for(i = 0; i < VACM_MAX_VIEWS; i++) {
-        /* pass the PDU to the VACM routine for handling authorization */
-        DEBUGMSGTL(("snmptrapd:auth", "Calling VACM for checking phase %d:%s\n",
-                    i, se_find_label_in_slist(VACM_VIEW_ENUM_NAME, i)));
-        if (vacm_check_view_contents(newpdu, var->val.objid,
-                                     var->val_len/sizeof(oid), 0, i,
-                                     VACM_CHECK_VIEW_CONTENTS_DNE_CONTEXT_OK)
-            == VACM_SUCCESS) {
-            DEBUGMSGTL(("snmptrapd:auth", "  result: authorized\n"));
-            ret |= 1 << i;
-        } else {
-            DEBUGMSGTL(("snmptrapd:auth", "  result: not authorized\n"));
-        }
-    }
+    ret = _auth_lookup(pdu, trapoid, trapoid_len);
     DEBUGMSGTL(("snmptrapd:auth", "Final bitmask auth: %x\n", ret));
 #endif
 
     if (ret) {
         /* we have policy to at least do "something".  Remember and continue. */
         lastlookup = ret;
-#ifndef NETSNMP_DISABLE_SNMPV1
-        if (newpdu != pdu)
-            snmp_free_pdu(newpdu);
-#endif
         return NETSNMPTRAPD_HANDLER_OK;
     }
 
     /* No policy was met, so we drop the PDU from further processing */
     DEBUGMSGTL(("snmptrapd:auth", "Dropping unauthorized message\n"));
-#ifndef NETSNMP_DISABLE_SNMPV1
-    if (newpdu != pdu)
-        snmp_free_pdu(newpdu);
-#endif
     return NETSNMPTRAPD_HANDLER_FINISH;
 }
 
@@ -187,3 +378,32 @@ netsnmp_trapd_check_auth(int authtypes)
     return ((authtypes & lastlookup) == authtypes);
 }
 
+
+void
+snmptrapd_auth_log_stats(void)
+{
+#ifdef USING_MIBII_VACM_CONF_MODULE
+    if (_auth.cache == NULL)
+        return;
+    snmp_log(LOG_INFO, "auth: %lu checked, %lu cached decisions used, "
+             "%lu cache flushes, %lu cached (at most %u)\n",
+             _auth.checked, _auth.hits, _auth.flushes,
+             (u_long) CONTAINER_SIZE(_auth.cache), _auth.max_entries);
+#endif
+}
+
+/*
+ * log the counters and free the cache
+ */
+void
+snmptrapd_auth_shutdown(void)
+{
+#ifdef USING_MIBII_VACM_CONF_MODULE
+    snmptrapd_auth_log_stats();
+    if (_auth.cache) {
+        CONTAINER_CLEAR(_auth.cache, _auth_entry_free, NULL);
+        CONTAINER_FREE(_auth.cache);
+        _auth.cache = NULL;
+    }
+#endif
+}
@@ -0,0 +1,639 @@
+/*
+ * snmptrapd_dedup.c - suppress repeated notifications
+ *
+ * Each "dedup" rule covers a trap OID (or a subtree of them, or every
+ * notification with "default") and lets through at most COUNT
+ * notifications with the same key in any WINDOW seconds.  The key is the
+ * rule, the address the notification came from, its trap OID and, for
+ * each "-k" OID of the rule, the name and value of the first varbind
+ * within that OID; so "-k ifIndex" keeps the linkDown traps of different
+ * interfaces apart.  The first rule whose trap OID matches applies.
+ *
+ * The handler runs right after the authorization check, before any other
+ * handler, so a suppressed notification costs neither a log line nor a
+ * traphandle fork; informs are still answered.  For each key, the times
+ * the last COUNT notifications were let through are kept in a ring, which
+ * makes the window slide exactly.  Once a second, a sweep logs a summary
+ * for the keys that suppressed notifications at least a window ago (or
+ * since their last summary) and forgets the keys idle for a window.
+ *
+ * At most "dedupMaxKeys" keys are tracked; notifications with new keys
+ * are let through untracked once the table is full.
+ */
+#include <net-snmp/net-snmp-config.h>
+
+#ifdef HAVE_STDLIB_H
+#include <stdlib.h>
+#endif
+#ifdef HAVE_STRING_H
+#include <string.h>
+#else
+#include <strings.h>
+#endif
+#include <stdio.h>
+#include <sys/types.h>
+#ifdef TIME_WITH_SYS_TIME
+# include <sys/time.h>
+# include <time.h>
+#else
+# ifdef HAVE_SYS_TIME_H
+#  include <sys/time.h>
+# else
+#  include <time.h>
+# endif
+#endif
+
+#include <net-snmp/net-snmp-includes.h>
+#include "snmptrapd_handlers.h"
+#include "snmptrapd_auth.h"
+#include "snmptrapd_dedup.h"
+
+/* defaults and limits of the dedup configuration tokens */
+#define TRAPD_DEDUP_WINDOW      60
+#define TRAPD_DEDUP_COUNT       1
+#define TRAPD_DEDUP_MAX_COUNT   1000
+#define TRAPD_DEDUP_MAX_KEYS    10000
+#define TRAPD_DEDUP_KEY_VARS    8
+
+#define TRAPD_DEDUP_KEY_LEN     1024
+#define TRAPD_DEDUP_SOURCE_LEN  128
+
+typedef struct trapd_dedup_rule_s {
+    oid             trapoid[MAX_OID_LEN];
+    size_t          trapoid_len;    /* 0 for "default" */
+    int             subtree;        /* TRAPOID.* */
+    int             window;         /* seconds */
+    int             count;          /* let through per window */
+    oid            *keys[TRAPD_DEDUP_KEY_VARS];
+    size_t          key_lens[TRAPD_DEDUP_KEY_VARS];
+    int             nkeys;
+    int             index;          /* in the configuration */
+    struct trapd_dedup_rule_s *next;
+} trapd_dedup_rule;
+
+typedef struct trapd_dedup_entry_s {
+    u_char         *key;
+    size_t          key_len;
+    trapd_dedup_rule *rule;
+    char           *descr;          /* for the summaries */
+    struct timeval *passed;         /* ring of rule->count times */
+    int             npassed;
+    int             oldest;
+    struct timeval  last_seen;
+    struct timeval  last_summary;
+    u_long          passed_since;   /* since the last summary */
+    u_long          suppressed_since;
+    struct trapd_dedup_entry_s *next_idle;
+} trapd_dedup_entry;
+
+/*
+ * define a structure to hold all the file globals
+ */
+typedef struct netsnmp_trapd_dedup_globals_t {
+    trapd_dedup_rule *rules;        /* from dedup, in configuration order */
+    trapd_dedup_rule **rules_tail;
+    int             nrules;
+    u_int           max_keys;       /* from dedupMaxKeys */
+    netsnmp_container *table;       /* trapd_dedup_entry, by key */
+    u_int           alarm;          /* the sweep */
+    netsnmp_trapd_dedup_stats stats;
+} netsnmp_trapd_dedup_globals;
+
+static netsnmp_trapd_dedup_globals _dedup = {
+    NULL,                               /* rules */
+    &_dedup.rules,                      /* rules_tail */
+    0,                                  /* nrules */
+    TRAPD_DEDUP_MAX_KEYS                /* max_keys */
+};
+
+static long
+_ms_since(const struct timeval *then, const struct timeval *now)
+{
+    return (now->tv_sec - then->tv_sec) * 1000 +
+        (now->tv_usec - then->tv_usec) / 1000;
+}
+
+static int
+_dedup_compare(const void *lhs, const void *rhs)
+{
+    const trapd_dedup_entry *a = (const trapd_dedup_entry *) lhs;
+    const trapd_dedup_entry *b = (const trapd_dedup_entry *) rhs;
+
+    if (a->key_len != b->key_len)
+        return a->key_len < b->key_len ? -1 : 1;
+    return memcmp(a->key, b->key, a->key_len);
+}
+
+static void
+_dedup_entry_free(trapd_dedup_entry *e)
+{
+    if (e == NULL)
+        return;
+    free(e->key);
+    free(e->descr);
+    free(e->passed);
+    free(e);
+}
+
+static trapd_dedup_rule *
+_dedup_rule(const oid *trapoid, size_t trapoid_len)
+{
+    trapd_dedup_rule *rule;
+
+    for (rule = _dedup.rules; rule; rule = rule->next) {
+        if (rule->trapoid_len == 0)
+            return rule;
+        if (rule->subtree) {
+            if (trapoid_len > rule->trapoid_len &&
+                !snmp_oid_compare(rule->trapoid, rule->trapoid_len,
+                                  trapoid, rule->trapoid_len))
+                return rule;
+        } else if (!snmp_oid_compare(rule->trapoid, rule->trapoid_len,
+                                     trapoid, trapoid_len))
+            return rule;
+    }
+    return NULL;
+}
+
+/*
+ * the first varbind within a key OID of the rule, decoded
+ */
+static netsnmp_variable_list *
+_dedup_key_var(netsnmp_pdu *pdu, const trapd_dedup_rule *rule, int i)
+{
+    netsnmp_variable_list *var;
+
+    for (var = pdu->variables; var; var = var->next_variable)
+        if (var->name_length >= rule->key_lens[i] &&
+            !snmp_oid_compare(rule->keys[i], rule->key_lens[i],
+                              var->name, rule->key_lens[i]))
+            return snmp_decode_var_value(var) ? NULL : var;
+    return NULL;
+}
+
+static int
+_dedup_key_put(u_char *key, size_t *key_len, const void *p, size_t n)
+{
+    size_t          len = n;
+
+    if (*key_len + sizeof(len) + n > TRAPD_DEDUP_KEY_LEN)
+        return -1;
+    memcpy(key + *key_len, &len, sizeof(len));
+    if (n)
+        memcpy(key + *key_len + sizeof(len), p, n);
+    *key_len += sizeof(len) + n;
+    return 0;
+}
+
+/*
+ * build the key of a notification: the rule, the source, the trap OID and
+ * the name, type and value of the key varbinds, each with its length
+ */
+static int
+_dedup_key(netsnmp_pdu *pdu, const trapd_dedup_rule *rule,
+           const char *source, const oid *trapoid, size_t trapoid_len,
+           u_char *key, size_t *key_len)
+{
+    netsnmp_variable_list *var;
+    int             i;
+
+    *key_len = 0;
+    if (_dedup_key_put(key, key_len, &rule->index, sizeof(rule->index)) < 0 ||
+        _dedup_key_put(key, key_len, source, strlen(source)) < 0 ||
+        _dedup_key_put(key, key_len, trapoid, trapoid_len * sizeof(oid)) < 0)
+        return -1;
+    for (i = 0; i < rule->nkeys; i++) {
+        var = _dedup_key_var(pdu, rule, i);
+        if (var == NULL) {
+            if (_dedup_key_put(key, key_len, NULL, 0) < 0)
+                return -1;
+            continue;
+        }
+        if (_dedup_key_put(key, key_len, var->name,
+                           var->name_length * sizeof(oid)) < 0 ||
+            _dedup_key_put(key, key_len, &var->type, sizeof(var->type)) < 0 ||
+            _dedup_key_put(key, key_len, var->val.string, var->val_len) < 0)
+            return -1;
+    }
+    return 0;
+}
+
+/*
+ * describe a key for the summaries: "TRAPOID from SOURCE[, VARBIND]..."
+ */
+static char *
+_dedup_descr(netsnmp_pdu *pdu, const trapd_dedup_rule *rule,
+             const char *source, const oid *trapoid, size_t trapoid_len)
+{
+    netsnmp_variable_list *var;
+    char            buf[SPRINT_MAX_LEN];
+    size_t          len;
+    int             i;
+
+    snprint_objid(buf, sizeof(buf), trapoid, trapoid_len);
+    len = strlen(buf);
+    snprintf(buf + len, sizeof(buf) - len, " from %s", source);
+    for (i = 0; i < rule->nkeys; i++) {
+        var = _dedup_key_var(pdu, rule, i);
+        len = strlen(buf);
+        if (var == NULL || len + 3 >= sizeof(buf))
+            continue;
+        strcpy(buf + len, ", ");
+        snprint_variable(buf + len + 2, sizeof(buf) - len - 2,
+                         var->name, var->name_length, var);
+    }
+    return strdup(buf);
+}
+
+static trapd_dedup_entry *
+_dedup_entry_new(netsnmp_pdu *pdu, trapd_dedup_rule *rule,
+                 const char *source, const oid *trapoid, size_t trapoid_len,
+                 const u_char *key, size_t key_len,
+                 const struct timeval *now)
+{
+    trapd_dedup_entry *e;
+
+    e = SNMP_MALLOC_TYPEDEF(trapd_dedup_entry);
+    if (e == NULL)
+        return NULL;
+    e->key = netsnmp_memdup(key, key_len);
+    e->key_len = key_len;
+    e->rule = rule;
+    e->descr = _dedup_descr(pdu, rule, source, trapoid, trapoid_len);
+    e->passed = (struct timeval *) calloc(rule->count, sizeof(*e->passed));
+    e->last_summary = *now;
+    if (e->key == NULL || e->descr == NULL || e->passed == NULL ||
+        CONTAINER_INSERT(_dedup.table, e) != 0) {
+        _dedup_entry_free(e);
+        return NULL;
+    }
+    if (++_dedup.stats.keys > _dedup.stats.max_keys)
+        _dedup.stats.max_keys = _dedup.stats.keys;
+    return e;
+}
+
+/*
+ * the handler, run for every notification right after the authorization
+ * check
+ */
+static int
+dedup_handler(netsnmp_pdu *pdu, netsnmp_transport *transport,
+              netsnmp_trapd_handler *handler)
+{
+    oid             trapoid[MAX_OID_LEN];
+    size_t          trapoid_len;
+    char            source[TRAPD_DEDUP_SOURCE_LEN];
+    u_char          key[TRAPD_DEDUP_KEY_LEN];
+    trapd_dedup_rule *rule;
+    trapd_dedup_entry lookup, *e;
+    struct timeval  now;
+
+    if (_dedup.rules == NULL || _dedup.table == NULL)
+        return NETSNMPTRAPD_HANDLER_OK;
+    trapoid_len = OID_LENGTH(trapoid);
+    if (netsnmp_trapd_trapoid(pdu, trapoid, &trapoid_len) < 0)
+        return NETSNMPTRAPD_HANDLER_OK;
+    rule = _dedup_rule(trapoid, trapoid_len);
+    if (rule == NULL)
+        return NETSNMPTRAPD_HANDLER_OK;
+
+    netsnmp_trapd_source(pdu, transport, source, sizeof(source));
+    lookup.key = key;
+    if (_dedup_key(pdu, rule, source, trapoid, trapoid_len,
+                   key, &lookup.key_len) < 0) {
+        _dedup.stats.untracked++;
+        return NETSNMPTRAPD_HANDLER_OK;
+    }
+
+    netsnmp_get_monotonic_clock(&now);
+    e = (trapd_dedup_entry *) CONTAINER_FIND(_dedup.table, &lookup);
+    if (e == NULL) {
+        if (_dedup.stats.keys >= _dedup.max_keys ||
+            (e = _dedup_entry_new(pdu, rule, source, trapoid, trapoid_len,
+                                  key, lookup.key_len, &now)) == NULL) {
+            _dedup.stats.untracked++;
+            return NETSNMPTRAPD_HANDLER_OK;
+        }
+    }
+    e->last_seen = now;
+
+    if (e->npassed == rule->count &&
+        _ms_since(&e->passed[e->oldest], &now) < rule->window * 1000L) {
+        e->suppressed_since++;
+        _dedup.stats.suppressed++;
+        DEBUGMSGTL(("snmptrapd:dedup", "suppressed %s\n", e->descr));
+        return NETSNMPTRAPD_HANDLER_DONE;
+    }
+    if (e->npassed < rule->count)
+        e->passed[e->npassed++] = now;
+    else {
+        e->passed[e->oldest] = now;
+        e->oldest = (e->oldest + 1) % rule->count;
+    }
+    e->passed_since++;
+    _dedup.stats.passed++;
+    return NETSNMPTRAPD_HANDLER_OK;
+}
+
+static void
+_dedup_summary(trapd_dedup_entry *e, const struct timeval *now)
+{
+    snmp_log(LOG_WARNING, "dedup: suppressed %lu of %lu notifications in "
+             "%ld seconds: %s\n", e->suppressed_since,
+             e->suppressed_since + e->passed_since,
+             (_ms_since(&e->last_summary, now) + 500) / 1000, e->descr);
+    _dedup.stats.summaries++;
+    e->suppressed_since = e->passed_since = 0;
+    e->last_summary = *now;
+}
+
+typedef struct trapd_dedup_sweep_s {
+    struct timeval  now;
+    int             flush;          /* summarize everything now */
+    trapd_dedup_entry *idle;
+} trapd_dedup_sweep;
+
+static void
+_dedup_sweep_entry(void *data, void *context)
+{
+    trapd_dedup_entry *e = (trapd_dedup_entry *) data;
+    trapd_dedup_sweep *sweep = (trapd_dedup_sweep *) context;
+    long            window = e->rule->window * 1000L;
+
+    if (e->suppressed_since &&
+        (sweep->flush || _ms_since(&e->last_summary, &sweep->now) >= window))
+        _dedup_summary(e, &sweep->now);
+    if (!e->suppressed_since &&
+        _ms_since(&e->last_seen, &sweep->now) >= window) {
+        e->next_idle = sweep->idle;
+        sweep->idle = e;
+    }
+}
+
+static void
+_dedup_sweep(unsigned int clientreg, void *clientarg)
+{
+    trapd_dedup_sweep sweep;
+    trapd_dedup_entry *e;
+
+    if (_dedup.table == NULL)
+        return;
+    memset(&sweep, 0, sizeof(sweep));
+    netsnmp_get_monotonic_clock(&sweep.now);
+    CONTAINER_FOR_EACH(_dedup.table, _dedup_sweep_entry, &sweep);
+    while ((e = sweep.idle) != NULL) {
+        sweep.idle = e->next_idle;
+        CONTAINER_REMOVE(_dedup.table, e);
+        _dedup_entry_free(e);
+        _dedup.stats.keys--;
+    }
+}
+
+static void
+_dedup_flush_entry(void *data, void *context)
+{
+    trapd_dedup_entry *e = (trapd_dedup_entry *) data;
+
+    if (e->suppressed_since)
+        _dedup_summary(e, (const struct timeval *) context);
+    _dedup_entry_free(e);
+}
+
+/*
+ * log the summaries still due and forget every key
+ */
+static void
+_dedup_flush(void)
+{
+    struct timeval  now;
+
+    if (_dedup.table == NULL)
+        return;
+    netsnmp_get_monotonic_clock(&now);
+    CONTAINER_CLEAR(_dedup.table, _dedup_flush_entry, &now);
+    _dedup.stats.keys = 0;
+}
+
+/*
+ * parse "dedup [-w SECONDS] [-n COUNT] [-k OID]... TRAPOID|TRAPOID.*|default"
+ */
+static void
+_parse_dedup(const char *token, char *line)
+{
+    trapd_dedup_rule *rule;
+    char            buf[SPRINT_MAX_LEN];
+    oid             name[MAX_OID_LEN];
+    size_t          len;
+    char           *cptr = line;
+    int             i;
+
+    rule = SNMP_MALLOC_TYPEDEF(trapd_dedup_rule);
+    if (rule == NULL) {
+        config_perror("no memory for the dedup rule");
+        return;
+    }
+    rule->window = TRAPD_DEDUP_WINDOW;
+    rule->count = TRAPD_DEDUP_COUNT;
+
+    buf[0] = '\0';
+    while (cptr) {
+        cptr = copy_nword(cptr, buf, sizeof(buf));
+        if (buf[0] != '-')
+            break;
+        if (cptr == NULL || buf[2] != '\0') {
+            config_perror("dedup: bad option or missing argument");
+            goto fail;
+        }
+        switch (buf[1]) {
+        case 'w':
+            cptr = copy_nword(cptr, buf, sizeof(buf));
+            rule->window = atoi(buf);
+            if (rule->window < 1) {
+                config_perror("dedup: the window must be at least 1 second");
+                goto fail;
+            }
+            break;
+        case 'n':
+            cptr = copy_nword(cptr, buf, sizeof(buf));
+            rule->count = atoi(buf);
+            if (rule->count < 1 || rule->count > TRAPD_DEDUP_MAX_COUNT) {
+                config_perror("dedup: the count must be from 1 to 1000");
+                goto fail;
+            }
+            break;
+        case 'k':
+            cptr = copy_nword(cptr, buf, sizeof(buf));
+            if (rule->nkeys == TRAPD_DEDUP_KEY_VARS) {
+                config_perror("dedup: too many key OIDs");
+                goto fail;
+            }
+            len = MAX_OID_LEN;
+            if (!snmp_parse_oid(buf, name, &len)) {
+                config_perror("dedup: cannot parse the key OID");
+                goto fail;
+            }
+            rule->keys[rule->nkeys] = snmp_duplicate_objid(name, len);
+            if (rule->keys[rule->nkeys] == NULL) {
+                config_perror("no memory for the dedup rule");
+                goto fail;
+            }
+            rule->key_lens[rule->nkeys++] = len;
+            break;
+        default:
+            config_perror("dedup: unknown option");
+            goto fail;
+        }
+    }
+    if (buf[0] == '\0' || buf[0] == '-' || cptr != NULL) {
+        config_perror("dedup needs one trap OID, or \"default\"");
+        goto fail;
+    }
+
+    if (strcmp(buf, "default") != 0) {
+        len = strlen(buf);
+        if (len >= 2 && !strcmp(buf + len - 2, ".*")) {
+            buf[len - 2] = '\0';
+            rule->subtree = 1;
+        }
+        rule->trapoid_len = MAX_OID_LEN;
+        if (!snmp_parse_oid(buf, rule->trapoid, &rule->trapoid_len)) {
+            config_perror("dedup: cannot parse the trap OID");
+            goto fail;
+        }
+    }
+
+    if (_dedup.table == NULL) {
+        _dedup.table =
+            netsnmp_container_find("snmptrapd_dedup:btree:binary_array");
+        if (_dedup.table == NULL) {
+            config_perror("no memory for the dedup table");
+            goto fail;
+        }
+        _dedup.table->container_name = strdup("snmptrapd_dedup");
+        _dedup.table->compare = _dedup_compare;
+    }
+    if (_dedup.alarm == 0)
+        _dedup.alarm = snmp_alarm_register(1, SA_REPEAT, _dedup_sweep, NULL);
+
+    rule->index = _dedup.nrules++;
+    *_dedup.rules_tail = rule;
+    _dedup.rules_tail = &rule->next;
+    DEBUGMSGTL(("snmptrapd:dedup", "rule %d: %d per %d seconds\n",
+                rule->index, rule->count, rule->window));
+    return;
+
+fail:
+    for (i = 0; i < rule->nkeys; i++)
+        free(rule->keys[i]);
+    free(rule);
+}
+
+/*
+ * the entries point to the rules, so the rules go with the table
+ */
+static void
+_free_dedup(void)
+{
+    trapd_dedup_rule *rule;
+    int             i;
+
+    _dedup_flush();
+    if (_dedup.alarm) {
+        snmp_alarm_unregister(_dedup.alarm);
+        _dedup.alarm = 0;
+    }
+    while ((rule = _dedup.rules) != NULL) {
+        _dedup.rules = rule->next;
+        for (i = 0; i < rule->nkeys; i++)
+            free(rule->keys[i]);
+        free(rule);
+    }
+    _dedup.rules_tail = &_dedup.rules;
+    _dedup.nrules = 0;
+}
+
+static void
+_parse_dedup_max_keys(const char *token, char *cptr)
+{
+    int             keys = atoi(cptr);
+
+    if (keys < 1) {
+        config_perror("dedupMaxKeys must be at least 1");
+        return;
+    }
+    _dedup.max_keys = keys;
+}
+
+static void
+_free_dedup_max_keys(void)
+{
+    _dedup.max_keys = TRAPD_DEDUP_MAX_KEYS;
+}
+
+/*
+ * register dedup related configuration tokens
+ */
+void
+snmptrapd_register_dedup_configs(void)
+{
+    register_config_handler("snmptrapd", "dedup",
+                            _parse_dedup, _free_dedup,
+                            "[-w SECONDS] [-n COUNT] [-k OID]... "
+                            "TRAPOID|TRAPOID.*|default");
+    register_config_handler("snmptrapd", "dedupMaxKeys",
+                            _parse_dedup_max_keys, _free_dedup_max_keys,
+                            "integer");
+}
+
+/*
+ * add the handler; it must be added to the authorization list before the
+ * authorization handler, since the handlers are prepended to it
+ */
+void
+init_netsnmp_trapd_dedup(void)
+{
+    netsnmp_trapd_handler *traph;
+
+    traph = netsnmp_add_global_traphandler(NETSNMPTRAPD_AUTH_HANDLER,
+                                           dedup_handler);
+    if (traph == NULL)
+        return;
+    traph->authtypes = TRAP_AUTH_NONE;
+    traph->flags |= NETSNMP_TRAPHANDLER_FLAG_LAZY_VALUES;
+}
+
+int
+snmptrapd_dedup_get_stats(netsnmp_trapd_dedup_stats *stats)
+{
+    if (_dedup.rules == NULL)
+        return -1;
+    *stats = _dedup.stats;
+    return 0;
+}
+
+void
+snmptrapd_dedup_log_stats(void)
+{
+    if (_dedup.rules == NULL)
+        return;
+    snmp_log(LOG_INFO, "dedup: %lu passed, %lu suppressed, %lu untracked, "
+             "%lu summaries, %u keys (at most %u)\n",
+             _dedup.stats.passed, _dedup.stats.suppressed,
+             _dedup.stats.untracked, _dedup.stats.summaries,
+             _dedup.stats.keys, _dedup.stats.max_keys);
+}
+
+/*
+ * log the summaries still due and the counters, and free everything
+ */
+void
+snmptrapd_dedup_shutdown(void)
+{
+    _dedup_flush();
+    snmptrapd_dedup_log_stats();
+    _free_dedup();
+    if (_dedup.table) {
+        CONTAINER_FREE(_dedup.table);
+        _dedup.table = NULL;
+    }
+}
@@ -0,0 +1,20 @@
+#ifndef SNMPTRAPD_DEDUP_H
+#define SNMPTRAPD_DEDUP_H
+
+typedef struct netsnmp_trapd_dedup_stats_s {
+    u_long          passed;         /* notifications let through by a rule */
+    u_long          suppressed;     /* ... and suppressed */
+    u_long          untracked;      /* let through without a key, the
+                                     * table being full */
+    u_long          summaries;      /* summaries of suppressed ones logged */
+    u_int           keys;           /* keys tracked now */
+    u_int           max_keys;       /* ... and at most */
+} netsnmp_trapd_dedup_stats;
+
+void snmptrapd_register_dedup_configs(void);
+void init_netsnmp_trapd_dedup(void);
+int  snmptrapd_dedup_get_stats(netsnmp_trapd_dedup_stats *stats);
+void snmptrapd_dedup_log_stats(void);
+void snmptrapd_dedup_shutdown(void);
+
+#endif /* SNMPTRAPD_DEDUP_H */
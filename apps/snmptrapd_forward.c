@@ -0,0 +1,559 @@
+/*
+ * snmptrapd_forward.c - forward notifications to other receivers
+ *
+ * Each destination of a "forward" directive gets a session that is opened
+ * once and reused, and a queue of the notifications waiting to be sent to
+ * it.  The forward handler only queues a copy of the notification; the
+ * queues are flushed once per pass of the main loop, so everything that
+ * arrived in one pass goes out together.
+ *
+ * Informs are sent asynchronously and the library retries them with the
+ * timeout and retries of the session.  At most "forwardWindow" of them may
+ * await an acknowledgement per destination, and the rest wait in the queue
+ * until acknowledgements come in, at most "forwardQueue" notifications per
+ * destination.  With "forwardCoalesce yes", a batch sent over a stream
+ * transport is written with TCP_CORK set, so that the messages share
+ * segments.
+ *
+ * A destination no "forward" line names any more once the configuration
+ * has been read again is flushed one last time, then closed and freed.
+ * Informs are sent with the destination as their callback data, so one
+ * whose session was disconnected, and which the library closes later,
+ * is only freed once the callbacks of its informs have come.
+ */
+#include <net-snmp/net-snmp-config.h>
+
+#ifdef HAVE_STDLIB_H
+#include <stdlib.h>
+#endif
+#ifdef HAVE_STRING_H
+#include <string.h>
+#else
+#include <strings.h>
+#endif
+#include <sys/types.h>
+#ifdef HAVE_SYS_SOCKET_H
+#include <sys/socket.h>
+#endif
+#ifdef HAVE_NETINET_IN_H
+#include <netinet/in.h>
+#endif
+#ifdef HAVE_NETINET_TCP_H
+#include <netinet/tcp.h>
+#endif
+#ifdef TIME_WITH_SYS_TIME
+# include <sys/time.h>
+# include <time.h>
+#else
+# ifdef HAVE_SYS_TIME_H
+#  include <sys/time.h>
+# else
+#  include <time.h>
+# endif
+#endif
+
+#include <net-snmp/net-snmp-includes.h>
+#include "snmptrapd_forward.h"
+
+/* defaults of forwardWindow and forwardQueue */
+#define TRAPD_FORWARD_WINDOW  16
+#define TRAPD_FORWARD_QUEUE   1000
+/* seconds to wait before opening a session again after a failure */
+#define TRAPD_FORWARD_REOPEN  5
+
+typedef struct trapd_forward_entry_s {
+    netsnmp_pdu    *pdu;
+    struct trapd_forward_entry_s *next;
+} trapd_forward_entry;
+
+typedef struct trapd_forward_dest_s {
+    char           *peername;
+    long            version;
+    netsnmp_session *ss;            /* NULL until opened, or once closed */
+    time_t          reopen;         /* when to try to open it again */
+    trapd_forward_entry *head;      /* the queue */
+    trapd_forward_entry *tail;
+    u_long          completions;    /* inform callbacks seen */
+    int             configured;     /* named by a line of this reading */
+    int             released;       /* freed once no inform is outstanding */
+    netsnmp_trapd_forward_stats stats;
+    struct trapd_forward_dest_s *next;
+} trapd_forward_dest;
+
+/*
+ * define a structure to hold all the file globals
+ */
+typedef struct netsnmp_trapd_forward_globals_t {
+    int                 window;     /* from forwardWindow */
+    int                 queue_size; /* from forwardQueue */
+    int                 coalesce;   /* from forwardCoalesce */
+    trapd_forward_dest *dests;
+} netsnmp_trapd_forward_globals;
+
+static int _forward_prune(int majorID, int minorID, void *serverarg,
+                          void *clientarg);
+static void _forward_free_dest(trapd_forward_dest *d);
+
+static netsnmp_trapd_forward_globals _fwd = {
+    TRAPD_FORWARD_WINDOW,       /* window */
+    TRAPD_FORWARD_QUEUE,        /* queue_size */
+    0,                          /* coalesce */
+    NULL                        /* dests */
+};
+
+/*
+ * parse the forwarding configuration tokens
+ */
+static void
+_parse_forward_window(const char *token, char *cptr)
+{
+    int             window = atoi(cptr);
+
+    if (window < 1) {
+        config_perror("forwardWindow must be at least 1");
+        return;
+    }
+    _fwd.window = window;
+    DEBUGMSGTL(("snmptrapd:forward", "window now %d\n", window));
+}
+
+static void
+_free_forward_window(void)
+{
+    _fwd.window = TRAPD_FORWARD_WINDOW;
+}
+
+static void
+_parse_forward_queue(const char *token, char *cptr)
+{
+    int             size = atoi(cptr);
+
+    if (size < 1) {
+        config_perror("forwardQueue must be at least 1");
+        return;
+    }
+    _fwd.queue_size = size;
+    DEBUGMSGTL(("snmptrapd:forward", "queue size now %d\n", size));
+}
+
+static void
+_free_forward_queue(void)
+{
+    _fwd.queue_size = TRAPD_FORWARD_QUEUE;
+}
+
+static void
+_parse_forward_coalesce(const char *token, char *cptr)
+{
+    _fwd.coalesce = netsnmp_ds_parse_boolean(cptr) == 1;
+}
+
+static void
+_free_forward_coalesce(void)
+{
+    _fwd.coalesce = 0;
+}
+
+/*
+ * register forwarding related configuration tokens
+ */
+void
+snmptrapd_register_forward_configs(void)
+{
+    register_config_handler("snmptrapd", "forwardWindow",
+                            _parse_forward_window, _free_forward_window,
+                            "integer");
+    register_config_handler("snmptrapd", "forwardQueue",
+                            _parse_forward_queue, _free_forward_queue,
+                            "integer");
+    register_config_handler("snmptrapd", "forwardCoalesce",
+                            _parse_forward_coalesce, _free_forward_coalesce,
+                            "(1|yes|true|0|no|false)");
+    snmp_register_callback(SNMP_CALLBACK_LIBRARY,
+                           SNMP_CALLBACK_POST_READ_CONFIG,
+                           _forward_prune, NULL);
+}
+
+/*
+ * note that a "forward" line names peername, so that its destinations
+ * are kept
+ */
+void
+snmptrapd_forward_configure(const char *peername)
+{
+    trapd_forward_dest *d;
+
+    for (d = _fwd.dests; d; d = d->next)
+        if (!strcmp(d->peername, peername))
+            d->configured = 1;
+}
+
+static trapd_forward_dest *
+_forward_find_dest(const char *peername, long version)
+{
+    trapd_forward_dest *d;
+
+    for (d = _fwd.dests; d; d = d->next)
+        if (d->version == version && !strcmp(d->peername, peername))
+            return d;
+    return NULL;
+}
+
+/*
+ * called for the outcome of every inform sent
+ */
+static int
+_forward_inform_callback(int op, netsnmp_session *session, int reqid,
+                         netsnmp_pdu *pdu, void *magic)
+{
+    trapd_forward_dest *d = (trapd_forward_dest *) magic;
+
+    d->completions++;
+    if (d->stats.outstanding > 0)
+        d->stats.outstanding--;
+    if (op == NETSNMP_CALLBACK_OP_RECEIVED_MESSAGE)
+        d->stats.acked++;
+    else
+        d->stats.timed_out++;
+    DEBUGMSGTL(("snmptrapd:forward", "inform %d to %s: op %d\n",
+                reqid, d->peername, op));
+    if (d->released && !d->stats.outstanding)
+        _forward_free_dest(d);
+    return 1;
+}
+
+/*
+ * called for anything else happening to the session of a destination
+ */
+static int
+_forward_session_callback(int op, netsnmp_session *session, int reqid,
+                          netsnmp_pdu *pdu, void *magic)
+{
+    trapd_forward_dest *d = (trapd_forward_dest *) magic;
+
+    if (op == NETSNMP_CALLBACK_OP_DISCONNECT) {
+        /* the library closes the session; open a new one when needed */
+        DEBUGMSGTL(("snmptrapd:forward", "%s disconnected\n", d->peername));
+        d->ss = NULL;
+    }
+    return 1;
+}
+
+static int
+_forward_open(trapd_forward_dest *d)
+{
+    netsnmp_session session;
+    char            buf[BUFSIZ];
+    time_t          now = time(NULL);
+
+    if (d->reopen && now < d->reopen)
+        return -1;
+
+    snmp_sess_init(&session);
+    if (strchr(d->peername, ':') == NULL) {
+        snprintf(buf, BUFSIZ, "%s:%d", d->peername, SNMP_TRAP_PORT);
+        session.peername = buf;
+    } else {
+        session.peername = d->peername;
+    }
+    session.version = d->version;
+    session.callback = _forward_session_callback;
+    session.callback_magic = d;
+    d->ss = snmp_open(&session);
+    if (!d->ss) {
+        snmp_sess_perror("Forward failed", &session);
+        d->stats.open_errors++;
+        d->reopen = now + TRAPD_FORWARD_REOPEN;
+        return -1;
+    }
+    d->stats.opens++;
+    d->reopen = 0;
+    DEBUGMSGTL(("snmptrapd:forward", "opened a session to %s\n",
+                d->peername));
+    return 0;
+}
+
+static void
+_forward_close(trapd_forward_dest *d)
+{
+    netsnmp_session *ss = d->ss;
+
+    /* closing calls back for the informs awaiting acknowledgement */
+    d->ss = NULL;
+    if (ss)
+        snmp_close(ss);
+}
+
+/*
+ * the transport of the session of a destination if it is a stream
+ */
+static netsnmp_transport *
+_forward_stream(trapd_forward_dest *d)
+{
+    netsnmp_transport *t;
+
+    if (!d->ss)
+        return NULL;
+    t = snmp_sess_transport(snmp_sess_pointer(d->ss));
+    if (t && t->sock >= 0 && (t->flags & NETSNMP_TRANSPORT_FLAG_STREAM))
+        return t;
+    return NULL;
+}
+
+/*
+ * set or clear TCP_CORK on the socket of a stream session
+ */
+static void
+_forward_cork(trapd_forward_dest *d, int on)
+{
+#if defined(TCP_CORK) && defined(IPPROTO_TCP)
+    netsnmp_transport *t = _forward_stream(d);
+
+    if (t)
+        (void) setsockopt(t->sock, IPPROTO_TCP, TCP_CORK,
+                          (const void *) &on, sizeof(on));
+#endif
+}
+
+/*
+ * send what the window allows of the queue of a destination
+ */
+static void
+_forward_flush_dest(trapd_forward_dest *d)
+{
+    trapd_forward_entry *e;
+    netsnmp_pdu    *pdu;
+    u_long          completions;
+    int             inform, corked = 0;
+
+    if (!d->head)
+        return;
+    if (!d->ss && _forward_open(d) < 0)
+        return;
+
+    while ((e = d->head) != NULL) {
+        pdu = e->pdu;
+        inform = pdu->command == SNMP_MSG_INFORM;
+        if (inform && d->stats.outstanding >= (u_int) _fwd.window)
+            break;
+        if (!corked && _fwd.coalesce && e->next) {
+            _forward_cork(d, 1);
+            corked = 1;
+        }
+        d->head = e->next;
+        if (!d->head)
+            d->tail = NULL;
+        d->stats.depth--;
+        free(e);
+
+        completions = d->completions;
+        if (inform) {
+            d->stats.outstanding++;
+            if (d->stats.outstanding > d->stats.max_outstanding)
+                d->stats.max_outstanding = d->stats.outstanding;
+        }
+        /*
+         * the copy still has the ids of the received message, and
+         * those from different senders may be the same; the session
+         * needs its own to match acknowledgements to informs
+         */
+        pdu->reqid = snmp_get_next_reqid();
+        pdu->msgid = snmp_get_next_msgid();
+        d->ss->s_snmp_errno = SNMPERR_SUCCESS;
+        if (snmp_async_send(d->ss, pdu,
+                            inform ? _forward_inform_callback : NULL, d)) {
+            d->stats.sent++;
+            continue;
+        }
+
+        /* the callback may already have counted the failure */
+        if (inform && d->completions == completions) {
+            d->stats.outstanding--;
+            d->stats.timed_out++;
+        }
+        d->stats.send_errors++;
+        snmp_sess_perror("Forward failed", d->ss);
+        snmp_free_pdu(pdu);
+        if (_forward_stream(d)) {
+            /* the connection is gone; the rest waits for a new one */
+            corked = 0;
+            _forward_close(d);
+            break;
+        }
+    }
+    if (corked)
+        _forward_cork(d, 0);
+
+    /* resend informs that timed out even when the main loop is busy */
+    if (d->ss && d->stats.outstanding)
+        snmp_sess_timeout(snmp_sess_pointer(d->ss));
+}
+
+static void
+_forward_log_dest(trapd_forward_dest *d)
+{
+    snmp_log(LOG_INFO, "forward to %s: %lu queued, %lu dropped, "
+             "%lu sent, %lu send errors, %lu acked, %lu timed out, "
+             "depth %u (max %u), outstanding %u (max %u), "
+             "%lu opens, %lu open errors\n",
+             d->peername, d->stats.queued, d->stats.dropped,
+             d->stats.sent, d->stats.send_errors, d->stats.acked,
+             d->stats.timed_out, d->stats.depth, d->stats.max_depth,
+             d->stats.outstanding, d->stats.max_outstanding,
+             d->stats.opens, d->stats.open_errors);
+}
+
+static void
+_forward_free_dest(trapd_forward_dest *d)
+{
+    trapd_forward_entry *e;
+
+    _forward_close(d);
+    while ((e = d->head) != NULL) {
+        d->head = e->next;
+        snmp_free_pdu(e->pdu);
+        free(e);
+    }
+    free(d->peername);
+    free(d);
+}
+
+/*
+ * free a destination taken off the list, or, while a disconnected
+ * session still holds informs sent to it, once their callbacks have come
+ */
+static void
+_forward_release_dest(trapd_forward_dest *d)
+{
+    _forward_close(d);
+    if (d->stats.outstanding) {
+        DEBUGMSGTL(("snmptrapd:forward", "%s: %u informs outstanding\n",
+                    d->peername, d->stats.outstanding));
+        d->released = 1;
+        return;
+    }
+    _forward_free_dest(d);
+}
+
+/*
+ * once the configuration has been read, drop the destinations it no
+ * longer names
+ */
+static int
+_forward_prune(int majorID, int minorID, void *serverarg, void *clientarg)
+{
+    trapd_forward_dest *d, **prevp = &_fwd.dests;
+
+    while ((d = *prevp) != NULL) {
+        if (d->configured) {
+            /* a line of the next reading has to name it again */
+            d->configured = 0;
+            prevp = &d->next;
+            continue;
+        }
+        *prevp = d->next;
+        _forward_flush_dest(d);
+        DEBUGMSGTL(("snmptrapd:forward", "%s is no longer configured\n",
+                    d->peername));
+        _forward_log_dest(d);
+        _forward_release_dest(d);
+    }
+    return SNMPERR_SUCCESS;
+}
+
+/*
+ * queue a notification for peername, taking over pdu.  Returns 0 when it
+ * is queued, and -1 when it has been dropped.
+ */
+int
+snmptrapd_forward_pdu(const char *peername, netsnmp_pdu *pdu)
+{
+    trapd_forward_dest *d;
+    trapd_forward_entry *e;
+
+    d = _forward_find_dest(peername, pdu->version);
+    if (!d) {
+        d = SNMP_MALLOC_TYPEDEF(trapd_forward_dest);
+        if (!d || !(d->peername = strdup(peername))) {
+            free(d);
+            snmp_free_pdu(pdu);
+            return -1;
+        }
+        d->version = pdu->version;
+        d->next = _fwd.dests;
+        _fwd.dests = d;
+    }
+
+    if (d->stats.depth >= (u_int) _fwd.queue_size ||
+        !(e = SNMP_MALLOC_TYPEDEF(trapd_forward_entry))) {
+        if (d->stats.dropped++ == 0)
+            snmp_log(LOG_WARNING, "forward queue to %s is full, "
+                     "dropping notifications\n", peername);
+        snmp_free_pdu(pdu);
+        return -1;
+    }
+    e->pdu = pdu;
+    if (d->tail)
+        d->tail->next = e;
+    else
+        d->head = e;
+    d->tail = e;
+    d->stats.queued++;
+    if (++d->stats.depth > d->stats.max_depth)
+        d->stats.max_depth = d->stats.depth;
+    return 0;
+}
+
+/*
+ * send the queued notifications; called once per pass of the main loop
+ */
+void
+snmptrapd_forward_flush(void)
+{
+    trapd_forward_dest *d;
+
+    for (d = _fwd.dests; d; d = d->next)
+        _forward_flush_dest(d);
+}
+
+/*
+ * copy the counters of a destination.  Returns 0 if it exists.
+ */
+int
+snmptrapd_forward_get_stats(const char *peername, int version,
+                            netsnmp_trapd_forward_stats *stats)
+{
+    trapd_forward_dest *d = _forward_find_dest(peername, version);
+
+    if (!d) {
+        memset(stats, 0, sizeof(*stats));
+        return -1;
+    }
+    *stats = d->stats;
+    return 0;
+}
+
+void
+snmptrapd_forward_log_stats(void)
+{
+    trapd_forward_dest *d;
+
+    for (d = _fwd.dests; d; d = d->next)
+        _forward_log_dest(d);
+}
+
+/*
+ * send what can be sent, log the counters and close all sessions
+ */
+void
+snmptrapd_forward_shutdown(void)
+{
+    trapd_forward_dest *d;
+
+    snmptrapd_forward_flush();
+    snmptrapd_forward_log_stats();
+    while ((d = _fwd.dests) != NULL) {
+        _fwd.dests = d->next;
+        _forward_release_dest(d);
+    }
+}
@@ -0,0 +1,28 @@
+#ifndef SNMPTRAPD_FORWARD_H
+#define SNMPTRAPD_FORWARD_H
+
+typedef struct netsnmp_trapd_forward_stats_s {
+    u_long          queued;         /* notifications queued to be sent */
+    u_long          dropped;        /* ... and dropped, the queue being full */
+    u_long          sent;           /* ... and sent */
+    u_long          send_errors;    /* ... and failed to be sent */
+    u_long          acked;          /* informs acknowledged */
+    u_long          timed_out;      /* informs not acknowledged in time */
+    u_long          opens;          /* sessions opened */
+    u_long          open_errors;
+    u_int           depth;          /* notifications queued now */
+    u_int           max_depth;      /* ... and at most */
+    u_int           outstanding;    /* informs awaiting acknowledgement */
+    u_int           max_outstanding;
+} netsnmp_trapd_forward_stats;
+
+void snmptrapd_register_forward_configs(void);
+void snmptrapd_forward_configure(const char *peername);
+int  snmptrapd_forward_pdu(const char *peername, netsnmp_pdu *pdu);
+void snmptrapd_forward_flush(void);
+int  snmptrapd_forward_get_stats(const char *peername, int version,
+                                 netsnmp_trapd_forward_stats *stats);
+void snmptrapd_forward_log_stats(void);
+void snmptrapd_forward_shutdown(void);
+
+#endif /* SNMPTRAPD_FORWARD_H */
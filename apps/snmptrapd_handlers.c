@@ -39,6 +39,8 @@
 #include "snmptrapd_handlers.h"
 #include "snmptrapd_auth.h"
 #include "snmptrapd_log.h"
+#include "snmptrapd_forward.h"
+#include "snmptrapd_persist.h"
 #include "notification-log-mib/notification_log.h"
 
 netsnmp_feature_child_of(add_default_traphandler, snmptrapd);
@@ -50,6 +52,25 @@ char *print_format2  = NULL;
 char *exec_format1   = NULL;
 char *exec_format2   = NULL;
 
+/*
+ * The strings above compiled, as they are configured
+ */
+static netsnmp_trapd_format *syslog_compiled1 = NULL;
+static netsnmp_trapd_format *syslog_compiled2 = NULL;
+static netsnmp_trapd_format *print_compiled1  = NULL;
+static netsnmp_trapd_format *print_compiled2  = NULL;
+static netsnmp_trapd_format *exec_compiled1   = NULL;
+static netsnmp_trapd_format *exec_compiled2   = NULL;
+
+/*
+ * The built-in formats used when none is configured, compiled once
+ */
+static netsnmp_trapd_format *syslog_v1std_compiled = NULL;
+static netsnmp_trapd_format *syslog_v1ent_compiled = NULL;
+static netsnmp_trapd_format *syslog_v23_compiled   = NULL;
+static netsnmp_trapd_format *print_v23_compiled    = NULL;
+static netsnmp_trapd_format *exec_std_compiled     = NULL;
+
 int   SyslogTrap = 0;
 int   dropauth = 0;
 
@@ -93,14 +114,36 @@ snmptrapd_parse_traphandle(const char *token, char *line)
     netsnmp_trapd_handler *traph;
     int             flags = 0;
     char           *format = NULL;
+    int             workers = 0;
 
     memset( buf, 0, sizeof(buf));
     memset(obuf, 0, sizeof(obuf));
     cptr = copy_nword(line, buf, sizeof(buf));
 
-    if ( buf[0] == '-' && buf[1] == 'F' ) {
-        cptr = copy_nword(cptr, buf, sizeof(buf));
-        format = strdup( buf );
+    /*
+     * -F FORMAT, and -p [-n WORKERS] to keep the program running
+     */
+    while ( cptr && buf[0] == '-' ) {
+        if ( buf[1] == 'F' ) {
+            cptr = copy_nword(cptr, buf, sizeof(buf));
+            free(format);
+            format = strdup( buf );
+        } else if ( buf[1] == 'p' ) {
+            if (!workers)
+                workers = 1;
+        } else if ( buf[1] == 'n' ) {
+            cptr = copy_nword(cptr, buf, sizeof(buf));
+            workers = atoi(buf);
+            if (workers < 1) {
+                netsnmp_config_error("Bad traphandle worker count: %s", buf);
+                free(format);
+                return;
+            }
+        } else {
+            netsnmp_config_error("Unknown traphandle option: %s", buf);
+            free(format);
+            return;
+        }
         cptr = copy_nword(cptr, buf, sizeof(buf));
     }
     if ( !cptr ) {
@@ -145,8 +188,15 @@ snmptrapd_parse_traphandle(const char *token, char *line)
         traph->token = strdup(cptr);
         if (format) {
             traph->format = format;
+            traph->compiled_format = netsnmp_trapd_format_compile(format);
             format = NULL;
         }
+        if (workers) {
+            traph->handler_data = snmptrapd_persist_new(cptr, workers);
+            if (!traph->handler_data)
+                netsnmp_config_error("Cannot run traphandle %s persistently",
+                                     cptr);
+        }
     }
     free(format);
 }
@@ -215,12 +265,27 @@ parse_forward(const char *token, char *line)
         traph->token = strdup(cptr);
         if (format)
             traph->format = format;
+        if (traph->handler == forward_handler)
+            snmptrapd_forward_configure(cptr);
     } else {
         free(format);
     }
 }
 
 
+/*
+ * Replace a configured format string, and its compiled form
+ */
+static void
+format_set(char **format, netsnmp_trapd_format **compiled, const char *cp)
+{
+    SNMP_FREE(*format);
+    netsnmp_trapd_format_free(*compiled);
+    *format = strdup(cp);
+    *compiled = netsnmp_trapd_format_compile(cp);
+}
+
+
 void
 parse_format(const char *token, char *line)
 {
@@ -253,40 +318,27 @@ parse_format(const char *token, char *line)
      * So update the appropriate pointer(s).
      */
     if (!strcmp( line, "print1")) {
-        SNMP_FREE( print_format1 );
-        print_format1 = strdup(cp);
+        format_set(&print_format1, &print_compiled1, cp);
     } else if (!strcmp( line, "print2")) {
-        SNMP_FREE( print_format2 );
-        print_format2 = strdup(cp);
+        format_set(&print_format2, &print_compiled2, cp);
     } else if (!strcmp( line, "print")) {
-        SNMP_FREE( print_format1 );
-        SNMP_FREE( print_format2 );
-        print_format1 = strdup(cp);
-        print_format2 = strdup(cp);
+        format_set(&print_format1, &print_compiled1, cp);
+        format_set(&print_format2, &print_compiled2, cp);
     } else if (!strcmp( line, "syslog1")) {
-        SNMP_FREE( syslog_format1 );
-        syslog_format1 = strdup(cp);
+        format_set(&syslog_format1, &syslog_compiled1, cp);
     } else if (!strcmp( line, "syslog2")) {
-        SNMP_FREE( syslog_format2 );
-        syslog_format2 = strdup(cp);
+        format_set(&syslog_format2, &syslog_compiled2, cp);
     } else if (!strcmp( line, "syslog")) {
-        SNMP_FREE( syslog_format1 );
-        SNMP_FREE( syslog_format2 );
-        syslog_format1 = strdup(cp);
-        syslog_format2 = strdup(cp);
+        format_set(&syslog_format1, &syslog_compiled1, cp);
+        format_set(&syslog_format2, &syslog_compiled2, cp);
     } else if (!strcmp( line, "execute1")) {
-        SNMP_FREE( exec_format1 );
-        exec_format1 = strdup(cp);
+        format_set(&exec_format1, &exec_compiled1, cp);
     } else if (!strcmp( line, "execute2")) {
-        SNMP_FREE( exec_format2 );
-        exec_format2 = strdup(cp);
+        format_set(&exec_format2, &exec_compiled2, cp);
     } else if (!strcmp( line, "execute")) {
-        SNMP_FREE( exec_format1 );
-        SNMP_FREE( exec_format2 );
-        exec_format1 = strdup(cp);
-        exec_format2 = strdup(cp);
+        format_set(&exec_format1, &exec_compiled1, cp);
+        format_set(&exec_format2, &exec_compiled2, cp);
     }
-
     *sep = ' ';
 }
 
@@ -295,6 +347,8 @@ static void
 parse_trap1_fmt(const char *token, char *line)
 {
     print_format1 = strdup(line);
+    netsnmp_trapd_format_free(print_compiled1);
+    print_compiled1 = netsnmp_trapd_format_compile(line);
 }
 
 
@@ -304,6 +358,8 @@ free_trap1_fmt(void)
     if (print_format1 && print_format1 != trap1_std_str)
         free(print_format1);
     print_format1 = NULL;
+    netsnmp_trapd_format_free(print_compiled1);
+    print_compiled1 = NULL;
 }
 
 
@@ -311,6 +367,8 @@ static void
 parse_trap2_fmt(const char *token, char *line)
 {
     print_format2 = strdup(line);
+    netsnmp_trapd_format_free(print_compiled2);
+    print_compiled2 = netsnmp_trapd_format_compile(line);
 }
 
 
@@ -320,6 +378,8 @@ free_trap2_fmt(void)
     if (print_format2 && print_format2 != trap2_std_str)
         free(print_format2);
     print_format2 = NULL;
+    netsnmp_trapd_format_free(print_compiled2);
+    print_compiled2 = NULL;
 }
 
 
@@ -368,6 +428,124 @@ static netsnmp_handler_map handlers[] = {
     { NULL, NULL }
 };
 
+/*
+ * An index of the trap-specific handlers by OID: a tree with a node per
+ * sub-identifier, where the node of each registered OID holds the first
+ * handler of its list.  A lookup follows the trap OID down the tree, and
+ * the deepest handler that matches is the one the walk of the list,
+ * which is kept in descending OID order, would have found first.
+ */
+typedef struct trapd_oid_node_s trapd_oid_node;
+struct trapd_oid_node_s {
+    oid                    subid;
+    netsnmp_trapd_handler *traph;
+    trapd_oid_node       **children;    /* sorted by sub-identifier */
+    int                    nchildren;
+    int                    size;
+};
+
+static trapd_oid_node *trapd_oid_root = NULL;
+static int             trapd_oid_index_failed = 0;
+
+static trapd_oid_node *
+trapd_oid_child(trapd_oid_node *node, oid subid, int create)
+{
+    trapd_oid_node *child;
+    int             lo = 0, hi = node->nchildren, mid;
+
+    while (lo < hi) {
+        mid = (lo + hi) / 2;
+        if (node->children[mid]->subid == subid)
+            return node->children[mid];
+        if (node->children[mid]->subid < subid)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    if (!create)
+        return NULL;
+
+    if (node->nchildren == node->size) {
+        int             size = node->size ? node->size * 2 : 4;
+        trapd_oid_node **tmp = (trapd_oid_node **)
+            realloc(node->children, size * sizeof(*tmp));
+        if (!tmp)
+            return NULL;
+        node->children = tmp;
+        node->size = size;
+    }
+    child = SNMP_MALLOC_TYPEDEF(trapd_oid_node);
+    if (!child)
+        return NULL;
+    child->subid = subid;
+    memmove(&node->children[lo + 1], &node->children[lo],
+            (node->nchildren - lo) * sizeof(*node->children));
+    node->children[lo] = child;
+    node->nchildren++;
+    return child;
+}
+
+static void
+trapd_oid_index_add(netsnmp_trapd_handler *traph)
+{
+    trapd_oid_node *node;
+    int             i;
+
+    if (!trapd_oid_root)
+        trapd_oid_root = SNMP_MALLOC_TYPEDEF(trapd_oid_node);
+    node = trapd_oid_root;
+    for (i = 0; node && i < traph->trapoid_len; i++)
+        node = trapd_oid_child(node, traph->trapoid[i], 1);
+    if (!node) {
+        /*
+         * Out of memory: the index is incomplete, so walk the list instead
+         */
+        snmp_log(LOG_ERR, "snmptrapd: cannot index trap handlers\n");
+        trapd_oid_index_failed = 1;
+        return;
+    }
+    node->traph = traph;
+}
+
+static netsnmp_trapd_handler *
+trapd_oid_index_find(oid *trapOid, int trapOidLen)
+{
+    trapd_oid_node *node = trapd_oid_root;
+    netsnmp_trapd_handler *traph, *found = NULL;
+    int             i;
+
+    for (i = 0; node; i++) {
+        traph = node->traph;
+        if (traph) {
+            if (!(traph->flags & NETSNMP_TRAPHANDLER_FLAG_MATCH_TREE)) {
+                if (i == trapOidLen)
+                    found = traph;
+            } else if (i < trapOidLen ||
+                       !(traph->flags &
+                         NETSNMP_TRAPHANDLER_FLAG_STRICT_SUBTREE)) {
+                found = traph;
+            }
+        }
+        if (i == trapOidLen)
+            break;
+        node = trapd_oid_child(node, trapOid[i], 0);
+    }
+    return found;
+}
+
+static void
+trapd_oid_index_free(trapd_oid_node *node)
+{
+    int             i;
+
+    if (!node)
+        return;
+    for (i = 0; i < node->nchildren; i++)
+        trapd_oid_index_free(node->children[i]);
+    free(node->children);
+    free(node);
+}
+
 /*
  * Register a new "global" traphandler,
  * to be applied to *all* incoming traps
@@ -491,6 +669,7 @@ netsnmp_add_traphandler(Netsnmp_Trap_Handler* handler,
 	        netsnmp_specific_traphandlers = traph;
             traph2->prevt = traph;
             traph->nextt  = traph2;
+            trapd_oid_index_add(traph);
         }
     } else {
         /*
@@ -509,6 +688,7 @@ netsnmp_add_traphandler(Netsnmp_Trap_Handler* handler,
              */
             netsnmp_specific_traphandlers = traph;
         }
+        trapd_oid_index_add(traph);
     }
 
     return traph;
@@ -521,6 +701,18 @@ snmptrapd_free_traphandle(void)
 
     DEBUGMSGTL(("snmptrapd", "Freeing trap handler lists\n"));
 
+    /* the persistent programs of the traphandle lines */
+    snmptrapd_persist_free_all();
+
+    /* the built-in formats, compiled again when next used */
+    netsnmp_trapd_format_free(syslog_v1std_compiled);
+    netsnmp_trapd_format_free(syslog_v1ent_compiled);
+    netsnmp_trapd_format_free(syslog_v23_compiled);
+    netsnmp_trapd_format_free(print_v23_compiled);
+    netsnmp_trapd_format_free(exec_std_compiled);
+    syslog_v1std_compiled = syslog_v1ent_compiled = NULL;
+    syslog_v23_compiled = print_v23_compiled = exec_std_compiled = NULL;
+
     /*
      * Free default trap handlers
      */
@@ -530,6 +722,9 @@ snmptrapd_free_traphandle(void)
        DEBUGMSG(("snmptrapd", "Freeing default trap handler\n"));
 	nexth = traph->nexth;
 	SNMP_FREE(traph->token);
+	netsnmp_trapd_format_free(traph->compiled_format);
+	SNMP_FREE(traph->format_buf);
+	SNMP_FREE(traph->format_scratch);
 	SNMP_FREE(traph);
 	traph = nexth;
     }
@@ -547,6 +742,9 @@ snmptrapd_free_traphandle(void)
 	    DEBUGMSG(("snmptrapd", "Freeing specific trap handler\n"));
 	    nexth = traph->nexth;
 	    SNMP_FREE(traph->token);
+	    netsnmp_trapd_format_free(traph->compiled_format);
+	    SNMP_FREE(traph->format_buf);
+	    SNMP_FREE(traph->format_scratch);
 	    SNMP_FREE(traph->trapoid);
 	    SNMP_FREE(traph);
 	    traph = nexth;
@@ -554,6 +752,9 @@ snmptrapd_free_traphandle(void)
 	traph = nextt;
     }
     netsnmp_specific_traphandlers = NULL;
+    trapd_oid_index_free(trapd_oid_root);
+    trapd_oid_root = NULL;
+    trapd_oid_index_failed = 0;
 }
 
 /*
@@ -575,7 +776,21 @@ netsnmp_get_traphandler( oid *trapOid, int trapOidLen ) {
     /*
      * Look for a matching OID, and return that list...
      */
-    for (traph = netsnmp_specific_traphandlers;
+    if (!trapd_oid_index_failed) {
+        traph = trapd_oid_index_find(trapOid, trapOidLen);
+        if (traph) {
+            DEBUGMSGTL(( "snmptrapd:lookup",
+                         "get_traphandler %s match (%p)\n",
+                         !(traph->flags & NETSNMP_TRAPHANDLER_FLAG_MATCH_TREE) ?
+                         "exact" : "subtree", traph));
+            return traph;
+        }
+    }
+
+    /*
+     * ... walking the list only if the index could not be built
+     */
+    for (traph = trapd_oid_index_failed ? netsnmp_specific_traphandlers : NULL;
          traph; traph=traph->nextt ) {
 
         /*
@@ -629,6 +844,66 @@ netsnmp_get_traphandler( oid *trapOid, int trapOidLen ) {
  *
  *-----------------------------*/
 
+/*
+ * Get a handler's output buffer ready to format a notification in.  It
+ * is kept on the handler, and reused from one notification to the next.
+ */
+static u_char *
+format_start(netsnmp_trapd_handler *handler)
+{
+    if (handler->format_buf == NULL) {
+        handler->format_buf_len = 64;
+        if ((handler->format_buf = malloc(handler->format_buf_len)) == NULL) {
+            handler->format_buf_len = 0;
+            snmp_log(LOG_ERR, "couldn't display trap -- malloc failed\n");
+            return NULL;
+        }
+    }
+    handler->format_buf[0] = '\0';
+    return handler->format_buf;
+}
+
+/*
+ * Format a notification into the handler's buffer with a configured
+ * format string, from its compiled form if it has one
+ */
+static int
+format_configured(netsnmp_trapd_handler *handler, size_t * out_len,
+                  const char *format, const netsnmp_trapd_format *compiled,
+                  netsnmp_pdu *pdu, netsnmp_transport *transport)
+{
+    if (compiled)
+        return realloc_format_compiled_trap_scratch(&handler->format_buf,
+                                                    &handler->format_buf_len,
+                                                    out_len, 1, compiled,
+                                                    &handler->format_scratch,
+                                                    &handler->format_scratch_len,
+                                                    pdu, transport);
+    return realloc_format_trap(&handler->format_buf, &handler->format_buf_len,
+                               out_len, 1, format, pdu, transport);
+}
+
+/*
+ * Format a notification with one of the built-in formats, compiled the
+ * first time it is used
+ */
+static int
+format_default(netsnmp_trapd_handler *handler, size_t * out_len,
+               const char *format, netsnmp_trapd_format **compiled,
+               netsnmp_pdu *pdu, netsnmp_transport *transport)
+{
+    if (*compiled == NULL)
+        *compiled = netsnmp_trapd_format_compile(format);
+    return format_configured(handler, out_len, format, *compiled,
+                             pdu, transport);
+}
+
+/*
+ * For handlers called without a registration of their own
+ */
+static netsnmp_trapd_handler anonymous_handler;
+
+
 #define SYSLOG_V1_STANDARD_FORMAT      "%a: %W Trap (%q) Uptime: %#T%#v\n"
 #define SYSLOG_V1_ENTERPRISE_FORMAT    "%a: %W Trap (%q) Uptime: %#T%#v\n" /* XXX - (%q) become (.N) ??? */
 #define SYSLOG_V23_NOTIFICATION_FORMAT "%B [%b]: Trap %#v\n"	 	   /* XXX - introduces a leading " ," */
@@ -640,8 +915,7 @@ int   syslog_handler(  netsnmp_pdu           *pdu,
                        netsnmp_transport     *transport,
                        netsnmp_trapd_handler *handler)
 {
-    u_char         *rbuf = NULL;
-    size_t          r_len = 64, o_len = 0;
+    size_t          o_len = 0;
     int             trunc = 0;
 
     DEBUGMSGTL(( "snmptrapd", "syslog_handler\n"));
@@ -649,10 +923,10 @@ int   syslog_handler(  netsnmp_pdu           *pdu,
     if (SyslogTrap)
         return NETSNMPTRAPD_HANDLER_OK;
 
-    if ((rbuf = calloc(r_len, 1)) == NULL) {
-        snmp_log(LOG_ERR, "couldn't display trap -- malloc failed\n");
+    if (handler == NULL)
+        handler = &anonymous_handler;
+    if (format_start(handler) == NULL)
         return NETSNMPTRAPD_HANDLER_FAIL;	/* Failed but keep going */
-    }
 
     /*
      *  If there's a format string registered for this trap, then use it.
@@ -660,10 +934,10 @@ int   syslog_handler(  netsnmp_pdu           *pdu,
     if (handler && handler->format) {
         DEBUGMSGTL(( "snmptrapd", "format = '%s'\n", handler->format));
         if (*handler->format) {
-            trunc = !realloc_format_trap(&rbuf, &r_len, &o_len, 1,
-                                     handler->format, pdu, transport);
+            trunc = !format_configured(handler, &o_len, handler->format,
+                                       handler->compiled_format,
+                                       pdu, transport);
         } else {
-            free(rbuf);
             return NETSNMPTRAPD_HANDLER_OK;    /* A 0-length format string means don't log */
         }
 
@@ -680,35 +954,37 @@ int   syslog_handler(  netsnmp_pdu           *pdu,
 	if ( pdu->command == SNMP_MSG_TRAP ) {
             if (syslog_format1) {
                 DEBUGMSGTL(( "snmptrapd", "syslog_format v1 = '%s'\n", syslog_format1));
-                trunc = !realloc_format_trap(&rbuf, &r_len, &o_len, 1,
-                                             syslog_format1, pdu, transport);
+                trunc = !format_configured(handler, &o_len,
+                                           syslog_format1, syslog_compiled1,
+                                           pdu, transport);
 
 	    } else if (pdu->trap_type == SNMP_TRAP_ENTERPRISESPECIFIC) {
                 DEBUGMSGTL(( "snmptrapd", "v1 enterprise format\n"));
-                trunc = !realloc_format_trap(&rbuf, &r_len, &o_len, 1,
-                                             SYSLOG_V1_ENTERPRISE_FORMAT,
-                                             pdu, transport);
+                trunc = !format_default(handler, &o_len,
+                                        SYSLOG_V1_ENTERPRISE_FORMAT,
+                                        &syslog_v1ent_compiled, pdu, transport);
 	    } else {
                 DEBUGMSGTL(( "snmptrapd", "v1 standard trap format\n"));
-                trunc = !realloc_format_trap(&rbuf, &r_len, &o_len, 1,
-                                             SYSLOG_V1_STANDARD_FORMAT,
-                                             pdu, transport);
+                trunc = !format_default(handler, &o_len,
+                                        SYSLOG_V1_STANDARD_FORMAT,
+                                        &syslog_v1std_compiled, pdu, transport);
 	    }
 	} else {	/* SNMPv2/3 notifications */
             if (syslog_format2) {
                 DEBUGMSGTL(( "snmptrapd", "syslog_format v1 = '%s'\n", syslog_format2));
-                trunc = !realloc_format_trap(&rbuf, &r_len, &o_len, 1,
-                                             syslog_format2, pdu, transport);
+                trunc = !format_configured(handler, &o_len,
+                                           syslog_format2, syslog_compiled2,
+                                           pdu, transport);
 	    } else {
                 DEBUGMSGTL(( "snmptrapd", "v2/3 format\n"));
-                trunc = !realloc_format_trap(&rbuf, &r_len, &o_len, 1,
-                                             SYSLOG_V23_NOTIFICATION_FORMAT,
-                                             pdu, transport);
+                trunc = !format_default(handler, &o_len,
+                                        SYSLOG_V23_NOTIFICATION_FORMAT,
+                                        &syslog_v23_compiled, pdu, transport);
 	    }
         }
     }
-    snmp_log(LOG_WARNING, "%s%s", rbuf, (trunc?" [TRUNCATED]\n":""));
-    free(rbuf);
+    snmp_log(LOG_WARNING, "%s%s", handler->format_buf,
+             (trunc?" [TRUNCATED]\n":""));
     return NETSNMPTRAPD_HANDLER_OK;
 }
 
@@ -722,8 +998,7 @@ int   print_handler(   netsnmp_pdu           *pdu,
                        netsnmp_transport     *transport,
                        netsnmp_trapd_handler *handler)
 {
-    u_char         *rbuf = NULL;
-    size_t          r_len = 64, o_len = 0;
+    size_t          o_len = 0;
     int             trunc = 0;
 
     DEBUGMSGTL(( "snmptrapd", "print_handler\n"));
@@ -735,10 +1010,10 @@ int   print_handler(   netsnmp_pdu           *pdu,
     if (pdu->trap_type == SNMP_TRAP_AUTHFAIL && dropauth)
         return NETSNMPTRAPD_HANDLER_OK;
 
-    if ((rbuf = calloc(r_len, 1)) == NULL) {
-        snmp_log(LOG_ERR, "couldn't display trap -- malloc failed\n");
+    if (handler == NULL)
+        handler = &anonymous_handler;
+    if (format_start(handler) == NULL)
         return NETSNMPTRAPD_HANDLER_FAIL;	/* Failed but keep going */
-    }
 
     /*
      *  If there's a format string registered for this trap, then use it.
@@ -746,10 +1021,10 @@ int   print_handler(   netsnmp_pdu           *pdu,
     if (handler && handler->format) {
         DEBUGMSGTL(( "snmptrapd", "format = '%s'\n", handler->format));
         if (*handler->format) {
-            trunc = !realloc_format_trap(&rbuf, &r_len, &o_len, 1,
-                                     handler->format, pdu, transport);
+            trunc = !format_configured(handler, &o_len, handler->format,
+                                       handler->compiled_format,
+                                       pdu, transport);
         } else {
-            free(rbuf);
             return NETSNMPTRAPD_HANDLER_OK;    /* A 0-length format string means don't log */
         }
 
@@ -766,28 +1041,31 @@ int   print_handler(   netsnmp_pdu           *pdu,
 	if ( pdu->command == SNMP_MSG_TRAP ) {
             if (print_format1) {
                 DEBUGMSGTL(( "snmptrapd", "print_format v1 = '%s'\n", print_format1));
-                trunc = !realloc_format_trap(&rbuf, &r_len, &o_len, 1,
-                                             print_format1, pdu, transport);
+                trunc = !format_configured(handler, &o_len,
+                                           print_format1, print_compiled1,
+                                           pdu, transport);
 	    } else {
                 DEBUGMSGTL(( "snmptrapd", "v1 format\n"));
-                trunc = !realloc_format_plain_trap(&rbuf, &r_len, &o_len, 1,
-                                                   pdu, transport);
+                trunc = !realloc_format_plain_trap(&handler->format_buf,
+                                                   &handler->format_buf_len,
+                                                   &o_len, 1, pdu, transport);
 	    }
 	} else {
             if (print_format2) {
                 DEBUGMSGTL(( "snmptrapd", "print_format v2 = '%s'\n", print_format2));
-                trunc = !realloc_format_trap(&rbuf, &r_len, &o_len, 1,
-                                             print_format2, pdu, transport);
+                trunc = !format_configured(handler, &o_len,
+                                           print_format2, print_compiled2,
+                                           pdu, transport);
 	    } else {
                 DEBUGMSGTL(( "snmptrapd", "v2/3 format\n"));
-                trunc = !realloc_format_trap(&rbuf, &r_len, &o_len, 1,
-                                             PRINT_V23_NOTIFICATION_FORMAT,
-                                             pdu, transport);
+                trunc = !format_default(handler, &o_len,
+                                        PRINT_V23_NOTIFICATION_FORMAT,
+                                        &print_v23_compiled, pdu, transport);
 	    }
         }
     }
-    snmp_log(LOG_INFO, "%s%s", rbuf, (trunc?" [TRUNCATED]\n":""));
-    free(rbuf);
+    snmp_log(LOG_INFO, "%s%s", handler->format_buf,
+             (trunc?" [TRUNCATED]\n":""));
     return NETSNMPTRAPD_HANDLER_OK;
 }
 
@@ -806,8 +1084,7 @@ int   command_handler( netsnmp_pdu           *pdu,
                      "support for run_shell_command not available\n"));
     return NETSNMPTRAPD_HANDLER_FAIL;
 #else
-    u_char         *rbuf = NULL;
-    size_t          r_len = 64, o_len = 0;
+    size_t          o_len = 0;
     int             oldquick;
 
     netsnmp_assert(handler);
@@ -828,8 +1105,11 @@ int   command_handler( netsnmp_pdu           *pdu,
         /*
 	 * Format the trap and pass this string to the external command
 	 */
-        if ((rbuf = calloc(r_len, 1)) == NULL) {
-            snmp_log(LOG_ERR, "couldn't display trap -- malloc failed\n");
+        if (format_start(handler) == NULL) {
+            netsnmp_ds_set_boolean(NETSNMP_DS_LIBRARY_ID,
+                                   NETSNMP_DS_LIB_QUICK_PRINT, oldquick);
+            if (pdu->command == SNMP_MSG_TRAP)
+                snmp_free_pdu(v2_pdu);
             return NETSNMPTRAPD_HANDLER_FAIL;	/* Failed but keep going */
         }
 
@@ -839,34 +1119,40 @@ int   command_handler( netsnmp_pdu           *pdu,
          */
         if (handler->format && *handler->format) {
             DEBUGMSGTL(( "snmptrapd", "format = '%s'\n", handler->format));
-            realloc_format_trap(&rbuf, &r_len, &o_len, 1,
-                                             handler->format,
-                                             v2_pdu, transport);
+            format_configured(handler, &o_len, handler->format,
+                              handler->compiled_format, v2_pdu, transport);
         } else {
 	    if ( pdu->command == SNMP_MSG_TRAP && exec_format1 ) {
                 DEBUGMSGTL(( "snmptrapd", "exec v1 = '%s'\n", exec_format1));
-                realloc_format_trap(&rbuf, &r_len, &o_len, 1,
-                                             exec_format1, pdu, transport);
+                format_configured(handler, &o_len,
+                                  exec_format1, exec_compiled1,
+                                  pdu, transport);
 	    } else if ( pdu->command != SNMP_MSG_TRAP && exec_format2 ) {
                 DEBUGMSGTL(( "snmptrapd", "exec v2/3 = '%s'\n", exec_format2));
-                realloc_format_trap(&rbuf, &r_len, &o_len, 1,
-                                             exec_format2, pdu, transport);
+                format_configured(handler, &o_len,
+                                  exec_format2, exec_compiled2,
+                                  pdu, transport);
 	    } else {
                 DEBUGMSGTL(( "snmptrapd", "execute format\n"));
-                realloc_format_trap(&rbuf, &r_len, &o_len, 1, EXECUTE_FORMAT,
-                                             v2_pdu, transport);
+                format_default(handler, &o_len, EXECUTE_FORMAT,
+                               &exec_std_compiled, v2_pdu, transport);
             }
 	}
 
         /*
-         *  and pass this formatted string to the command specified
+         *  and pass this formatted string to the command specified,
+         *  or queue it for its persistent program
          */
-        run_shell_command(handler->token, (char*)rbuf, NULL, NULL);   /* Not interested in output */
+        if (handler->handler_data)
+            snmptrapd_persist_write(handler->handler_data,
+                                    (char *) handler->format_buf, o_len);
+        else
+            run_shell_command(handler->token, (char*)handler->format_buf,
+                              NULL, NULL);   /* Not interested in output */
         netsnmp_ds_set_boolean(NETSNMP_DS_LIBRARY_ID, 
                                NETSNMP_DS_LIB_QUICK_PRINT, oldquick);
         if (pdu->command == SNMP_MSG_TRAP)
             snmp_free_pdu(v2_pdu);
-        free(rbuf);
     }
     return NETSNMPTRAPD_HANDLER_OK;
 #endif /* !def USING_UTILITIES_EXECUTE_MODULE */
@@ -1008,35 +1294,22 @@ int   forward_handler( netsnmp_pdu           *pdu,
                        netsnmp_transport     *transport,
                        netsnmp_trapd_handler *handler)
 {
-    netsnmp_session session, *ss;
     netsnmp_pdu *pdu2;
-    char buf[BUFSIZ], *cp;
 
     DEBUGMSGTL(( "snmptrapd", "forward_handler (%s)\n", handler->token));
 
-    snmp_sess_init( &session );
-    if (strchr( handler->token, ':') == NULL) {
-        snprintf( buf, BUFSIZ, "%s:%d", handler->token, SNMP_TRAP_PORT);
-        cp = buf;
-    } else {
-        cp = handler->token;
-    }
-    session.peername = cp;
-    session.version  = pdu->version;
-    ss = snmp_open( &session );
-    if (!ss)
-        return NETSNMPTRAPD_HANDLER_FAIL;
-
-    /* XXX: wjh we should be caching sessions here and not always
-       reopening a session.  It's very inefficient, especially with v3
-       INFORMS which may require engineID probing */
-
+    /*
+     * The copy is queued, and sent on a session to this destination that
+     * is kept open (see snmptrapd_forward.c).
+     */
     pdu2 = snmp_clone_pdu(pdu);
+    if (!pdu2)
+        return NETSNMPTRAPD_HANDLER_FAIL;
 
     if (netsnmp_ds_get_boolean(NETSNMP_DS_LIBRARY_ID,
                                NETSNMP_DS_LIB_ADD_FORWARDER_INFO) &&
         !add_forwarder_info(pdu, pdu2)) {
-        snmp_close(ss);
+        snmp_free_pdu(pdu2);
         return NETSNMPTRAPD_HANDLER_FAIL;
     }
 
@@ -1046,13 +1319,8 @@ int   forward_handler( netsnmp_pdu           *pdu,
         pdu2->transport_data_length = 0;
     }
 
-    ss->s_snmp_errno = SNMPERR_SUCCESS;
-    if (!snmp_send( ss, pdu2 ) &&
-            ss->s_snmp_errno != SNMPERR_SUCCESS) {
-        snmp_sess_perror("Forward failed", ss);
-        snmp_free_pdu(pdu2);
-    }
-    snmp_close( ss );
+    if (snmptrapd_forward_pdu(handler->token, pdu2) < 0)
+        return NETSNMPTRAPD_HANDLER_FAIL;
     return NETSNMPTRAPD_HANDLER_OK;
 }
 
@@ -1077,17 +1345,124 @@ int   notification_handler(netsnmp_pdu           *pdu,
  *
  *-----------------------------*/
 
+/*
+ * Find the OID that identifies a notification.  On input *trapOidLen is
+ * the room in trapOid, on output the length of the OID.  Returns 0, or
+ * -1 if a TRAP2 or INFORM has no snmpTrapOID.0, or -2 if it cannot be
+ * used.  As values may be decoded lazily, snmpTrapOID.0 is decoded.
+ */
+int
+netsnmp_trapd_trapoid(netsnmp_pdu *pdu, oid *trapOid, size_t *trapOidLen)
+{
+    static const oid stdTrapOidRoot[] = { 1, 3, 6, 1, 6, 3, 1, 1, 5 };
+    static const oid snmpTrapOid[]    = { 1, 3, 6, 1, 6, 3, 1, 1, 4, 1, 0 };
+    netsnmp_variable_list *vars;
+    size_t len;
+
+    switch (pdu->command) {
+    case SNMP_MSG_TRAP:
+        /*
+         * Convert v1 traps into a v2-style trap OID
+         *    (following RFC 2576)
+         */
+        if (pdu->trap_type == SNMP_TRAP_ENTERPRISESPECIFIC) {
+            if (pdu->enterprise_length + 2 > *trapOidLen)
+                return -2;
+            len = pdu->enterprise_length;
+            memcpy(trapOid, pdu->enterprise, sizeof(oid) * len);
+            if (len == 0 || trapOid[len - 1] != 0) {
+                trapOid[len++] = 0;
+            }
+            trapOid[len++] = pdu->specific_type;
+        } else {
+            if (OID_LENGTH(stdTrapOidRoot) + 1 > *trapOidLen)
+                return -2;
+            memcpy(trapOid, stdTrapOidRoot, sizeof(stdTrapOidRoot));
+            len = OID_LENGTH(stdTrapOidRoot);  /* 9 */
+            trapOid[len++] = pdu->trap_type+1;
+        }
+        *trapOidLen = len;
+        return 0;
+
+    case SNMP_MSG_TRAP2:
+    case SNMP_MSG_INFORM:
+        /*
+         * v2c/v3 notifications *should* have snmpTrapOID as the
+         *    second varbind, so we can go straight there.
+         *    But check, just to make sure
+         */
+        vars = pdu->variables;
+        if (vars)
+            vars = vars->next_variable;
+        if (!vars || snmp_oid_compare(vars->name, vars->name_length,
+                                      snmpTrapOid, OID_LENGTH(snmpTrapOid))) {
+            /*
+             * Didn't find it!
+             * Let's look through the full list....
+             */
+            for ( vars = pdu->variables; vars; vars=vars->next_variable) {
+                if (!snmp_oid_compare(vars->name, vars->name_length,
+                                      snmpTrapOid, OID_LENGTH(snmpTrapOid)))
+                    break;
+            }
+            if (!vars)
+                return -1;
+        }
+        if (snmp_decode_var_value(vars) || vars->type != ASN_OBJECT_ID ||
+            vars->val_len > *trapOidLen * sizeof(oid))
+            return -2;
+        memcpy(trapOid, vars->val.objid, vars->val_len);
+        *trapOidLen = vars->val_len / sizeof(oid);
+        return 0;
+
+    default:
+        return -1;
+    }
+}
+
+/*
+ * The address a notification came from, without the port, or as the
+ * transport formats it if it is not an IP address
+ */
+void
+netsnmp_trapd_source(netsnmp_pdu *pdu, netsnmp_transport *transport,
+                     char *buf, size_t buf_len)
+{
+    netsnmp_indexed_addr_pair *addr_pair;
+    char *str;
+
+    buf[0] = '\0';
+    if (pdu->transport_data &&
+        pdu->transport_data_length == sizeof(*addr_pair)) {
+        addr_pair = (netsnmp_indexed_addr_pair *) pdu->transport_data;
+        if (addr_pair->remote_addr.sa.sa_family == AF_INET &&
+            inet_ntop(AF_INET, &addr_pair->remote_addr.sin.sin_addr,
+                      buf, buf_len))
+            return;
+#ifdef NETSNMP_ENABLE_IPV6
+        if (addr_pair->remote_addr.sa.sa_family == AF_INET6 &&
+            inet_ntop(AF_INET6, &addr_pair->remote_addr.sin6.sin6_addr,
+                      buf, buf_len))
+            return;
+#endif
+    }
+    if (transport && transport->f_fmtaddr) {
+        str = transport->f_fmtaddr(transport, pdu->transport_data,
+                                   pdu->transport_data_length);
+        if (str) {
+            strlcpy(buf, str, buf_len);
+            free(str);
+        }
+    }
+}
 
 
 int
 snmp_input(int op, netsnmp_session *session,
            int reqid, netsnmp_pdu *pdu, void *magic)
 {
-    oid stdTrapOidRoot[] = { 1, 3, 6, 1, 6, 3, 1, 1, 5 };
-    oid snmpTrapOid[]    = { 1, 3, 6, 1, 6, 3, 1, 1, 4, 1, 0 };
     oid trapOid[MAX_OID_LEN+2] = {0};
-    int trapOidLen;
-    netsnmp_variable_list *vars;
+    size_t trapOidLen;
     netsnmp_trapd_handler *traph;
     netsnmp_transport *transport = (netsnmp_transport *) magic;
     int ret, idx;
@@ -1106,62 +1481,20 @@ snmp_input(int op, netsnmp_session *session,
 	 * Determine the OID that identifies the trap being handled
 	 */
         DEBUGMSGTL(("snmptrapd", "input: %x\n", pdu->command));
-        switch (pdu->command) {
-        case SNMP_MSG_TRAP:
-            /*
-	     * Convert v1 traps into a v2-style trap OID
-	     *    (following RFC 2576)
-	     */
-            if (pdu->trap_type == SNMP_TRAP_ENTERPRISESPECIFIC) {
-                trapOidLen = pdu->enterprise_length;
-                memcpy(trapOid, pdu->enterprise, sizeof(oid) * trapOidLen);
-                if (trapOid[trapOidLen - 1] != 0) {
-                    trapOid[trapOidLen++] = 0;
-                }
-                trapOid[trapOidLen++] = pdu->specific_type;
-            } else {
-                memcpy(trapOid, stdTrapOidRoot, sizeof(stdTrapOidRoot));
-                trapOidLen = OID_LENGTH(stdTrapOidRoot);  /* 9 */
-                trapOid[trapOidLen++] = pdu->trap_type+1;
-            }
+        trapOidLen = OID_LENGTH(trapOid);
+        switch (netsnmp_trapd_trapoid(pdu, trapOid, &trapOidLen)) {
+        case 0:
             break;
-
-        case SNMP_MSG_TRAP2:
-        case SNMP_MSG_INFORM:
-            /*
-	     * v2c/v3 notifications *should* have snmpTrapOID as the
-	     *    second varbind, so we can go straight there.
-	     *    But check, just to make sure
-	     */
-            vars = pdu->variables;
-            if (vars)
-                vars = vars->next_variable;
-            if (!vars || snmp_oid_compare(vars->name, vars->name_length,
-                                          snmpTrapOid, OID_LENGTH(snmpTrapOid))) {
-	        /*
-		 * Didn't find it!
-		 * Let's look through the full list....
-		 */
-		for ( vars = pdu->variables; vars; vars=vars->next_variable) {
-                    if (!snmp_oid_compare(vars->name, vars->name_length,
-                                          snmpTrapOid, OID_LENGTH(snmpTrapOid)))
-                        break;
-                }
-                if (!vars) {
-	            /*
-		     * Still can't find it!  Give up.
-		     */
-		    snmp_log(LOG_ERR, "Cannot find TrapOID in TRAP2 PDU\n");
-		    return 1;		/* ??? */
-		}
-	    }
-            memcpy(trapOid, vars->val.objid, vars->val_len);
-            trapOidLen = vars->val_len /sizeof(oid);
-            break;
-
+        case -1:
+            if (pdu->command != SNMP_MSG_TRAP2 &&
+                pdu->command != SNMP_MSG_INFORM)
+                return 1;	/* SHOULDN'T HAPPEN! */
+            snmp_log(LOG_ERR, "Cannot find TrapOID in TRAP2 PDU\n");
+            return 1;		/* ??? */
         default:
-            /* SHOULDN'T HAPPEN! */
-            return 1;	/* ??? */
+            snmp_log(LOG_ERR, "Cannot decode TrapOID in %s PDU\n",
+                     pdu->command == SNMP_MSG_TRAP ? "TRAP" : "TRAP2");
+            return 1;
 	}
         DEBUGMSGTL(( "snmptrapd", "Trap OID: "));
         DEBUGMSGOID(("snmptrapd", trapOid, trapOidLen));
@@ -1187,6 +1520,7 @@ t        *     d) any other global handlers
          *  OK - Enough waffling, let's get to work.....
 	 */
 
+        ret = NETSNMPTRAPD_HANDLER_OK;
         for( idx = 0; handlers[idx].descr; ++idx ) {
             DEBUGMSGTL(("snmptrapd", "Running %s handlers\n",
                         handlers[idx].descr));
@@ -1199,12 +1533,20 @@ t        *     d) any other global handlers
                 if (!netsnmp_trapd_check_auth(traph->authtypes))
                     continue; /* we continue on and skip this one */
 
+                if (!(traph->flags & NETSNMP_TRAPHANDLER_FLAG_LAZY_VALUES) &&
+                    snmp_decode_varlist(pdu->variables)) {
+                    snmp_log(LOG_ERR, "Cannot decode the trap's varbinds\n");
+                    return 1;
+                }
                 ret = (*(traph->handler))(pdu, transport, traph);
                 if(NETSNMPTRAPD_HANDLER_FINISH == ret)
                     return 1;
-                if (ret == NETSNMPTRAPD_HANDLER_BREAK)
+                if (ret == NETSNMPTRAPD_HANDLER_BREAK ||
+                    ret == NETSNMPTRAPD_HANDLER_DONE)
                     break; /* move on to next type */
             } /* traph */
+            if (ret == NETSNMPTRAPD_HANDLER_DONE)
+                break; /* but still answer an inform */
         } /* handlers */
 
 
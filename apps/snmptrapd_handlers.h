@@ -10,12 +10,19 @@ typedef int (Netsnmp_Trap_Handler)(netsnmp_pdu           *pdu,
 
 #define NETSNMP_TRAPHANDLER_FLAG_MATCH_TREE     0x1
 #define NETSNMP_TRAPHANDLER_FLAG_STRICT_SUBTREE 0x2
+/* only looks at snmpTrapOID.0, so other values needn't be decoded */
+#define NETSNMP_TRAPHANDLER_FLAG_LAZY_VALUES    0x4
 
 struct netsnmp_trapd_handler_s {
      oid  *trapoid;
      int   trapoid_len;
      char *token;		/* Or an array of tokens? */
      char *format;		/* Formatting string */
+     struct netsnmp_trapd_format_s *compiled_format; /* ... and compiled */
+     u_char *format_buf;	/* Traps are formatted in, reused */
+     size_t  format_buf_len;
+     u_char *format_scratch;	/* ... and their fields built in */
+     size_t  format_scratch_len;
      int   version;		/* ??? */
      int   authtypes;
      int   flags;
@@ -53,6 +60,8 @@ extern int   dropauth;
 #define NETSNMPTRAPD_HANDLER_FAIL    2	/* Failed but keep going */
 #define NETSNMPTRAPD_HANDLER_BREAK   3	/* Move to the next list */
 #define NETSNMPTRAPD_HANDLER_FINISH  4	/* No further processing */
+#define NETSNMPTRAPD_HANDLER_DONE    5	/* No further processing, but
+					   answer informs */
 
 void snmptrapd_register_configs( void );
 netsnmp_trapd_handler *netsnmp_add_global_traphandler(int list, Netsnmp_Trap_Handler* handler);
@@ -62,6 +71,9 @@ netsnmp_trapd_handler *netsnmp_add_traphandler(Netsnmp_Trap_Handler* handler,
 netsnmp_trapd_handler *netsnmp_get_traphandler(oid *trapOid, int trapOidLen);
 
 const char *trap_description(int trap);
+int  netsnmp_trapd_trapoid(netsnmp_pdu *pdu, oid *trapOid, size_t *trapOidLen);
+void netsnmp_trapd_source(netsnmp_pdu *pdu, netsnmp_transport *transport,
+                          char *buf, size_t buf_len);
 int snmp_input(int op, netsnmp_session *session,
            int reqid, netsnmp_pdu *pdu, void *magic);
 
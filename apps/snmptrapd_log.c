@@ -111,7 +111,37 @@ typedef struct {
     int             leading_zeroes;     /* if true, display with leading zeroes */
 } options_type;
 
-char            separator[32];
+/*
+ * What rendering one trap needs to keep from one field to the next:
+ * the current time, looked up and broken down at most once however many
+ * time fields the format prints, and the buffer each field is built in.
+ */
+typedef struct {
+    time_t          now;
+    struct tm       local;
+    struct tm       utc;
+    int             have_now;
+    int             have_local;   /* 1 if set, -1 if localtime() failed */
+    int             have_utc;
+    u_char         *scratch;
+    size_t          scratch_len;
+} trapd_format_state;
+
+/*
+ * A format string compiled into a list of instructions, each either a
+ * run of literal text or a format command with its options parsed.
+ */
+typedef struct {
+    options_type    options;    /* options.cmd is UNDEF_CMD for text */
+    char           *text;       /* the literal text, or %v's separator */
+    size_t          text_len;
+} trapd_format_insn;
+
+struct netsnmp_trapd_format_s {
+    trapd_format_insn *insns;
+    int                insn_count;
+    int                insn_max;
+};
 
 /*
  * These symbols define the characters that the parser recognizes.
@@ -318,7 +348,7 @@ init_options(options_type * options)
     /*
      * initialize the structure's fields 
      */
-    options->cmd = '*';
+    options->cmd = UNDEF_CMD;
     options->width = 0;
     options->precision = UNDEF_PRECISION;
     options->left_justify = FALSE;
@@ -328,10 +358,33 @@ init_options(options_type * options)
 }
 
 
+static u_char *
+format_scratch(trapd_format_state *state)
+
+     /*
+      * Function:
+      *    Return the buffer a field is built in before being appended to
+      * the output with the right justification and padding, emptied.  It
+      * is allocated for the first field of a trap and reused for the rest,
+      * and always holds at least enough room for a number.
+      */
+{
+    if (state->scratch == NULL) {
+        state->scratch_len = 256;
+        if ((state->scratch = malloc(state->scratch_len)) == NULL) {
+            state->scratch_len = 0;
+            return NULL;
+        }
+    }
+    state->scratch[0] = '\0';
+    return state->scratch;
+}
+
+
 static int
 realloc_output_temp_bfr(u_char ** buf, size_t * buf_len, size_t * out_len,
                         int allow_realloc,
-                        u_char ** temp_buf, options_type * options)
+                        u_char * temp_buf, const options_type * options)
 
      /*
       * Function:
@@ -342,8 +395,8 @@ realloc_output_temp_bfr(u_char ** buf, size_t * buf_len, size_t * out_len,
       *
       *    buf, buf_len, out_len, allow_realloc - standard relocatable
       *                                           buffer parameters
-      *    temp_buf - pointer to string to append onto output buffer.  THIS
-      *               STRING IS free()d BY THIS FUNCTION.
+      *    temp_buf - string to append onto output buffer.  It may be
+      *               truncated in place to the field's precision.
       *    options  - what options to use when appending string
       */
 {
@@ -352,7 +405,7 @@ realloc_output_temp_bfr(u_char ** buf, size_t * buf_len, size_t * out_len,
     size_t          char_to_write;      /* # of other chars to write */
     size_t          zeroes_to_write;    /* fill to precision with zeroes for numbers */
 
-    if (temp_buf == NULL || *temp_buf == NULL) {
+    if (temp_buf == NULL) {
         return 1;
     }
 
@@ -360,7 +413,7 @@ realloc_output_temp_bfr(u_char ** buf, size_t * buf_len, size_t * out_len,
      * Figure out how many characters are in the temporary buffer now,
      * and how many of them we'll write.
      */
-    temp_len = strlen((char *) *temp_buf);
+    temp_len = strlen((char *) temp_buf);
     temp_to_write = temp_len;
 
     if (options->precision != UNDEF_PRECISION &&
@@ -382,7 +435,6 @@ realloc_output_temp_bfr(u_char ** buf, size_t * buf_len, size_t * out_len,
             if ((*out_len + 1) >= *buf_len) {
                 if (!(allow_realloc && snmp_realloc(buf, buf_len))) {
                     *(*buf + *out_len) = '\0';
-                    free(*temp_buf);
                     return 0;
                 }
             }
@@ -399,9 +451,8 @@ realloc_output_temp_bfr(u_char ** buf, size_t * buf_len, size_t * out_len,
     /*
      * Truncate the temporary buffer and append its contents.  
      */
-    *(*temp_buf + temp_to_write) = '\0';
-    if (!snmp_strcat(buf, buf_len, out_len, allow_realloc, *temp_buf)) {
-        free(*temp_buf);
+    *(temp_buf + temp_to_write) = '\0';
+    if (!snmp_strcat(buf, buf_len, out_len, allow_realloc, temp_buf)) {
         return 0;
     }
 
@@ -414,7 +465,6 @@ realloc_output_temp_bfr(u_char ** buf, size_t * buf_len, size_t * out_len,
             if ((*out_len + 1) >= *buf_len) {
                 if (!(allow_realloc && snmp_realloc(buf, buf_len))) {
                     *(*buf + *out_len) = '\0';
-                    free(*temp_buf);
                     return 0;
                 }
             }
@@ -428,8 +478,6 @@ realloc_output_temp_bfr(u_char ** buf, size_t * buf_len, size_t * out_len,
      */
 
     *(*buf + *out_len) = '\0';
-    free(*temp_buf);
-    *temp_buf = NULL;
     return 1;
 }
 
@@ -437,7 +485,8 @@ realloc_output_temp_bfr(u_char ** buf, size_t * buf_len, size_t * out_len,
 static int
 realloc_handle_time_fmt(u_char ** buf, size_t * buf_len, size_t * out_len,
                         int allow_realloc,
-                        options_type * options, netsnmp_pdu *pdu)
+                        const options_type * options, netsnmp_pdu *pdu,
+                        trapd_format_state *state)
 
      /*
       * Function:
@@ -450,6 +499,7 @@ realloc_handle_time_fmt(u_char ** buf, size_t * buf_len, size_t * out_len,
       *                                           buffer parameters
       *    options - options governing how to write the field
       *    pdu     - information about this trap
+      *    state   - the time and field buffer kept for this trap
       */
 {
     time_t          time_val;   /* the time value to output */
@@ -458,7 +508,7 @@ realloc_handle_time_fmt(u_char ** buf, size_t * buf_len, size_t * out_len,
     char           *safe_bfr = NULL;
     char            fmt_cmd = options->cmd;     /* the format command to use */
 
-    if ((safe_bfr = calloc(30, 1)) == NULL) {
+    if ((safe_bfr = (char *) format_scratch(state)) == NULL) {
         return 0;
     }
 
@@ -473,7 +523,11 @@ realloc_handle_time_fmt(u_char ** buf, size_t * buf_len, size_t * out_len,
         /*
          * Note: a time_t is a signed long.  
          */
-        time(&time_val);
+        if (!state->have_now) {
+            time(&state->now);
+            state->have_now = 1;
+        }
+        time_val = state->now;
         time_ul = (unsigned long) time_val;
     }
 
@@ -513,13 +567,32 @@ realloc_handle_time_fmt(u_char ** buf, size_t * buf_len, size_t * out_len,
         }
     } else {
         /*
-         * Handle other time fields.  
+         * Handle other time fields.  The current time is only broken
+         * down once per trap, however many of its fields are printed.
          */
 
-        if (options->alt_format) {
-            parsed_time = gmtime(&time_val);
+        if (is_up_time_cmd(fmt_cmd)) {
+            if (options->alt_format) {
+                parsed_time = gmtime(&time_val);
+            } else {
+                parsed_time = localtime(&time_val);
+            }
+        } else if (options->alt_format) {
+            if (!state->have_utc) {
+                parsed_time = gmtime(&time_val);
+                if (parsed_time)
+                    state->utc = *parsed_time;
+                state->have_utc = parsed_time ? 1 : -1;
+            }
+            parsed_time = (state->have_utc > 0) ? &state->utc : NULL;
         } else {
-            parsed_time = localtime(&time_val);
+            if (!state->have_local) {
+                parsed_time = localtime(&time_val);
+                if (parsed_time)
+                    state->local = *parsed_time;
+                state->have_local = parsed_time ? 1 : -1;
+            }
+            parsed_time = (state->have_local > 0) ? &state->local : NULL;
         }
 
         if (!parsed_time) {
@@ -590,7 +663,7 @@ realloc_handle_time_fmt(u_char ** buf, size_t * buf_len, size_t * out_len,
      * Output with correct justification, leading zeroes, etc.  
      */
     return realloc_output_temp_bfr(buf, buf_len, out_len, allow_realloc,
-                                   (u_char **) & safe_bfr, options);
+                                   (u_char *) safe_bfr, options);
 }
 
 static
@@ -611,8 +684,9 @@ void convert_agent_addr(struct in_addr agent_addr, char *name, size_t size)
 static int
 realloc_handle_ip_fmt(u_char ** buf, size_t * buf_len, size_t * out_len,
                       int allow_realloc,
-                      options_type * options, netsnmp_pdu *pdu,
-                      netsnmp_transport *transport)
+                      const options_type * options, netsnmp_pdu *pdu,
+                      netsnmp_transport *transport,
+                      trapd_format_state *state)
 
      /*
       * Function:
@@ -626,17 +700,17 @@ realloc_handle_ip_fmt(u_char ** buf, size_t * buf_len, size_t * out_len,
       *    options   - options governing how to write the field
       *    pdu       - information about this trap 
       *    transport - the transport descriptor
+      *    state     - the time and field buffer kept for this trap
       */
 {
     struct in_addr *agent_inaddr = (struct in_addr *) pdu->agent_addr;
     char            host[16];                   /* corresponding host name */
     char            fmt_cmd = options->cmd;     /* what we're formatting */
-    u_char         *temp_buf = NULL;
-    size_t          temp_buf_len = 64, temp_out_len = 0;
+    size_t          temp_out_len = 0;
     char           *tstr;
     unsigned int    oflags;
 
-    if ((temp_buf = calloc(temp_buf_len, 1)) == NULL) {
+    if (format_scratch(state) == NULL) {
         return 0;
     }
 
@@ -648,11 +722,8 @@ realloc_handle_ip_fmt(u_char ** buf, size_t * buf_len, size_t * out_len,
         /*
          * Write a numerical address.  
          */
-        if (!snmp_cstrcat(&temp_buf, &temp_buf_len, &temp_out_len, 1,
+        if (!snmp_cstrcat(&state->scratch, &state->scratch_len, &temp_out_len, 1,
                           inet_ntoa(*agent_inaddr))) {
-            if (temp_buf != NULL) {
-                free(temp_buf);
-            }
             return 0;
         }
         break;
@@ -664,10 +735,8 @@ realloc_handle_ip_fmt(u_char ** buf, size_t * buf_len, size_t * out_len,
          */
         convert_agent_addr(*(struct in_addr *)pdu->agent_addr,
                            host, sizeof(host));
-        if (!snmp_cstrcat(&temp_buf, &temp_buf_len, &temp_out_len, 1, host)) {
-            if (temp_buf != NULL) {
-                free(temp_buf);
-            }
+        if (!snmp_cstrcat(&state->scratch, &state->scratch_len, &temp_out_len, 1,
+                          host)) {
             return 0;
         }
         break;
@@ -684,18 +753,16 @@ realloc_handle_ip_fmt(u_char ** buf, size_t * buf_len, size_t * out_len,
             transport->flags = oflags;
           
             if (!tstr) goto noip;
-            if (!snmp_cstrcat(&temp_buf, &temp_buf_len, &temp_out_len, 1,
-                              tstr)) {
-                SNMP_FREE(temp_buf);
+            if (!snmp_cstrcat(&state->scratch, &state->scratch_len, &temp_out_len,
+                              1, tstr)) {
                 SNMP_FREE(tstr);
                 return 0;
             }
             SNMP_FREE(tstr);
         } else {
 noip:
-            if (!snmp_cstrcat(&temp_buf, &temp_buf_len, &temp_out_len, 1,
-                              "<UNKNOWN>")) {
-                SNMP_FREE(temp_buf);
+            if (!snmp_cstrcat(&state->scratch, &state->scratch_len, &temp_out_len,
+                              1, "<UNKNOWN>")) {
                 return 0;
             }
         }
@@ -718,18 +785,16 @@ noip:
             transport->flags = oflags;
           
             if (!tstr) goto nohost;
-            if (!snmp_cstrcat(&temp_buf, &temp_buf_len, &temp_out_len, 1,
-                              tstr)) {
-                SNMP_FREE(temp_buf);
+            if (!snmp_cstrcat(&state->scratch, &state->scratch_len, &temp_out_len,
+                              1, tstr)) {
                 SNMP_FREE(tstr);
                 return 0;
             }
             SNMP_FREE(tstr);
         } else {
 nohost:
-            if (!snmp_cstrcat(&temp_buf, &temp_buf_len, &temp_out_len, 1,
-                              "<UNKNOWN>")) {
-                SNMP_FREE(temp_buf);
+            if (!snmp_cstrcat(&state->scratch, &state->scratch_len, &temp_out_len,
+                              1, "<UNKNOWN>")) {
                 return 0;
             }
         }
@@ -739,21 +804,23 @@ nohost:
          * Don't know how to handle this command - write the character itself.  
          */
     default:
-        temp_buf[0] = fmt_cmd;
+        state->scratch[0] = fmt_cmd;
+        state->scratch[1] = '\0';
     }
 
     /*
      * Output with correct justification, leading zeroes, etc.  
      */
     return realloc_output_temp_bfr(buf, buf_len, out_len, allow_realloc,
-                                   &temp_buf, options);
+                                   state->scratch, options);
 }
 
 
 static int
 realloc_handle_ent_fmt(u_char ** buf, size_t * buf_len, size_t * out_len,
                        int allow_realloc,
-                       options_type * options, netsnmp_pdu *pdu)
+                       const options_type * options, netsnmp_pdu *pdu,
+                       trapd_format_state *state)
 
      /*
       * Function:
@@ -766,13 +833,13 @@ realloc_handle_ent_fmt(u_char ** buf, size_t * buf_len, size_t * out_len,
       *                                           buffer parameters
       *    options - options governing how to write the field
       *    pdu     - information about this trap 
+      *    state   - the time and field buffer kept for this trap
       */
 {
     char            fmt_cmd = options->cmd;     /* what we're formatting */
-    u_char         *temp_buf = NULL;
-    size_t          temp_buf_len = 64, temp_out_len = 0;
+    size_t          temp_out_len = 0;
 
-    if ((temp_buf = calloc(temp_buf_len, 1)) == NULL) {
+    if (format_scratch(state) == NULL) {
         return 0;
     }
 
@@ -785,9 +852,8 @@ realloc_handle_ent_fmt(u_char ** buf, size_t * buf_len, size_t * out_len,
          * Write the enterprise oid.  
          */
         if (!sprint_realloc_objid
-            (&temp_buf, &temp_buf_len, &temp_out_len, 1, pdu->enterprise,
-             pdu->enterprise_length)) {
-            free(temp_buf);
+            (&state->scratch, &state->scratch_len, &temp_out_len, 1,
+             pdu->enterprise, pdu->enterprise_length)) {
             return 0;
         }
         break;
@@ -797,9 +863,8 @@ realloc_handle_ent_fmt(u_char ** buf, size_t * buf_len, size_t * out_len,
          * Write the context oid.  
          */
         if (!sprint_realloc_hexstring
-            (&temp_buf, &temp_buf_len, &temp_out_len, 1, pdu->contextEngineID,
-             pdu->contextEngineIDLen)) {
-            free(temp_buf);
+            (&state->scratch, &state->scratch_len, &temp_out_len, 1,
+             pdu->contextEngineID, pdu->contextEngineIDLen)) {
             return 0;
         }
         break;
@@ -808,21 +873,23 @@ realloc_handle_ent_fmt(u_char ** buf, size_t * buf_len, size_t * out_len,
          * Don't know how to handle this command - write the character itself.  
          */
     default:
-        temp_buf[0] = fmt_cmd;
+        state->scratch[0] = fmt_cmd;
+        state->scratch[1] = '\0';
     }
 
     /*
      * Output with correct justification, leading zeroes, etc.  
      */
     return realloc_output_temp_bfr(buf, buf_len, out_len, allow_realloc,
-                                   &temp_buf, options);
+                                   state->scratch, options);
 }
 
 
 static int
 realloc_handle_trap_fmt(u_char ** buf, size_t * buf_len, size_t * out_len,
                         int allow_realloc,
-                        options_type * options, netsnmp_pdu *pdu)
+                        const options_type * options, const char *separator,
+                        netsnmp_pdu *pdu, trapd_format_state *state)
 
      /*
       * Function:
@@ -833,22 +900,36 @@ realloc_handle_trap_fmt(u_char ** buf, size_t * buf_len, size_t * out_len,
       * Input Parameters:
       *    buf, buf_len, out_len, allow_realloc - standard relocatable
       *                                           buffer parameters
-      *    options - options governing how to write the field
-      *    pdu     - information about this trap 
+      *    options   - options governing how to write the field
+      *    separator - the variable separator set by %V, or NULL
+      *    pdu       - information about this trap 
+      *    state     - the time and field buffer kept for this trap
       */
 {
     netsnmp_variable_list *vars;        /* variables assoc with trap */
     char            fmt_cmd = options->cmd;     /* what we're outputting */
-    u_char         *temp_buf = NULL;
-    size_t          tbuf_len = 64, tout_len = 0;
+    size_t          tout_len = 0;
     const char           *sep = separator;
     const char           *default_sep = "\t";
     const char           *default_alt_sep = ", ";
+    u_char        **tbuf = &state->scratch;
+    size_t         *tbuf_len = &state->scratch_len;
 
-    if ((temp_buf = calloc(tbuf_len, 1)) == NULL) {
+    if (format_scratch(state) == NULL) {
         return 0;
     }
 
+    /*
+     * Variables take up most of a trap's output, so print them straight
+     * into the output buffer when there's no padding or truncation to do.
+     */
+    if (fmt_cmd == CHR_TRAP_VARS && allow_realloc && options->width == 0 &&
+        options->precision == UNDEF_PRECISION) {
+        tbuf = buf;
+        tbuf_len = buf_len;
+        tout_len = *out_len;
+    }
+
     /*
      * Decide exactly what to output.  
      */
@@ -857,15 +938,17 @@ realloc_handle_trap_fmt(u_char ** buf, size_t * buf_len, size_t * out_len,
         /*
          * Write the trap's number.  
          */
-        tout_len = sprintf((char*)temp_buf, "%ld", pdu->trap_type);
+        tout_len = sprintf((char*)state->scratch, "%ld", pdu->trap_type);
         break;
 
     case CHR_TRAP_DESC:
         /*
          * Write the trap's description.  
          */
-        tout_len =
-            sprintf((char*)temp_buf, "%s", trap_description(pdu->trap_type));
+        if (!snmp_cstrcat(&state->scratch, &state->scratch_len, &tout_len, 1,
+                          trap_description(pdu->trap_type))) {
+            return 0;
+        }
         break;
 
     case CHR_TRAP_STYPE:
@@ -873,21 +956,15 @@ realloc_handle_trap_fmt(u_char ** buf, size_t * buf_len, size_t * out_len,
          * Write the trap's subtype.  
          */
         if (pdu->trap_type != SNMP_TRAP_ENTERPRISESPECIFIC) {
-            tout_len = sprintf((char*)temp_buf, "%ld", pdu->specific_type);
+            tout_len = sprintf((char*)state->scratch, "%ld", pdu->specific_type);
         } else {
             /*
              * Get object ID for the trap.  
              */
-            size_t          obuf_len = 64, oout_len = 0, trap_oid_len = 0;
+            size_t          trap_oid_len = 0;
             oid             trap_oid[MAX_OID_LEN + 2] = { 0 };
-            u_char         *obuf = NULL;
             char           *ptr = NULL;
 
-            if ((obuf = calloc(obuf_len, 1)) == NULL) {
-                free(temp_buf);
-                return 0;
-            }
-
             trap_oid_len = pdu->enterprise_length;
             memcpy(trap_oid, pdu->enterprise, trap_oid_len * sizeof(oid));
             if (trap_oid[trap_oid_len - 1] != 0) {
@@ -900,30 +977,14 @@ realloc_handle_trap_fmt(u_char ** buf, size_t * buf_len, size_t * out_len,
             /*
              * Find the element after the last dot.  
              */
-            if (!sprint_realloc_objid(&obuf, &obuf_len, &oout_len, 1,
-                                      trap_oid, trap_oid_len)) {
-                if (obuf != NULL) {
-                    free(obuf);
-                }
-                free(temp_buf);
+            if (!sprint_realloc_objid(&state->scratch, &state->scratch_len,
+                                      &tout_len, 1, trap_oid, trap_oid_len)) {
 		return 0;
             }
 
-            ptr = strrchr((char *) obuf, '.');
+            ptr = strrchr((char *) state->scratch, '.');
             if (ptr != NULL) {
-                if (!snmp_cstrcat(&temp_buf, &tbuf_len, &tout_len, 1, ptr)) {
-                    free(obuf);
-                    if (temp_buf != NULL) {
-                        free(temp_buf);
-                    }
-                    return 0;
-                }
-                free(obuf);
-            } else {
-                free(temp_buf);
-                temp_buf = obuf;
-                tbuf_len = obuf_len;
-                tout_len = oout_len;
+                memmove(state->scratch, ptr, strlen(ptr) + 1);
             }
         }
         break;
@@ -942,42 +1003,43 @@ realloc_handle_trap_fmt(u_char ** buf, size_t * buf_len, size_t * out_len,
              */
             if (options->alt_format ||
                 vars != pdu->variables ) {
-                if (!snmp_cstrcat(&temp_buf, &tbuf_len, &tout_len, 1, sep)) {
-                    if (temp_buf != NULL) {
-                        free(temp_buf);
-                    }
+                if (!snmp_cstrcat(tbuf, tbuf_len, &tout_len, 1, sep)) {
                     return 0;
                 }
             }
             if (!sprint_realloc_variable
-                (&temp_buf, &tbuf_len, &tout_len, 1, vars->name,
+                (tbuf, tbuf_len, &tout_len, 1, vars->name,
                  vars->name_length, vars)) {
-                if (temp_buf != NULL) {
-                    free(temp_buf);
-                }
                 return 0;
             }
         }
+        if (tbuf == buf) {
+            *out_len = tout_len;
+            *(*buf + *out_len) = '\0';
+            return 1;
+        }
         break;
 
     default:
         /*
          * Don't know how to handle this command - write the character itself.  
          */
-        temp_buf[0] = fmt_cmd;
+        state->scratch[0] = fmt_cmd;
+        state->scratch[1] = '\0';
     }
 
     /*
      * Output with correct justification, leading zeroes, etc.  
      */
     return realloc_output_temp_bfr(buf, buf_len, out_len, allow_realloc,
-                                   &temp_buf, options);
+                                   state->scratch, options);
 }
 
 static int
 realloc_handle_auth_fmt(u_char ** buf, size_t * buf_len, size_t * out_len,
                         int allow_realloc,
-                        options_type * options, netsnmp_pdu *pdu)
+                        const options_type * options, netsnmp_pdu *pdu,
+                        trapd_format_state *state)
      /*
       * Function:
       *     Handle a format command that deals with authentication
@@ -990,25 +1052,24 @@ realloc_handle_auth_fmt(u_char ** buf, size_t * buf_len, size_t * out_len,
       *                                           buffer parameters
       *    options - options governing how to write the field
       *    pdu     - information about this trap 
+      *    state   - the time and field buffer kept for this trap
       */
 {
     char            fmt_cmd = options->cmd;     /* what we're outputting */
-    u_char         *temp_buf = NULL;
-    size_t          tbuf_len = 64;
     unsigned int    i;
 
-    if ((temp_buf = calloc(tbuf_len, 1)) == NULL) {
+    if (format_scratch(state) == NULL) {
         return 0;
     }
 
     switch (fmt_cmd) {
 
     case CHR_SNMP_VERSION:
-        snprintf((char*)temp_buf, tbuf_len, "%ld", pdu->version);
+        snprintf((char*)state->scratch, 64, "%ld", pdu->version);
         break;
 
     case CHR_SNMP_SECMOD:
-        snprintf((char*)temp_buf, tbuf_len, "%d", pdu->securityModel);
+        snprintf((char*)state->scratch, 64, "%d", pdu->securityModel);
         break;
 
     case CHR_SNMP_USER:
@@ -1022,8 +1083,6 @@ realloc_handle_auth_fmt(u_char ** buf, size_t * buf_len, size_t * out_len,
 #if !defined(NETSNMP_DISABLE_SNMPV1) || !defined(NETSNMP_DISABLE_SNMPV2C)
             while ((*out_len + pdu->community_len + 1) >= *buf_len) {
                 if (!(allow_realloc && snmp_realloc(buf, buf_len))) {
-                    if (temp_buf)
-                        free(temp_buf);
                     return 0;
                 }
             }
@@ -1040,7 +1099,7 @@ realloc_handle_auth_fmt(u_char ** buf, size_t * buf_len, size_t * out_len,
             break;
 #endif
         default:
-            snprintf((char*)temp_buf, tbuf_len, "%s", pdu->securityName);
+            snprintf((char*)state->scratch, 64, "%s", pdu->securityName);
         }
         break;
 
@@ -1048,14 +1107,15 @@ realloc_handle_auth_fmt(u_char ** buf, size_t * buf_len, size_t * out_len,
         /*
          * Don't know how to handle this command - write the character itself.  
          */
-        temp_buf[0] = fmt_cmd;
+        state->scratch[0] = fmt_cmd;
+        state->scratch[1] = '\0';
     }
 
     /*
      * Output with correct justification, leading zeroes, etc.  
      */
     return realloc_output_temp_bfr(buf, buf_len, out_len, allow_realloc,
-                                   &temp_buf, options);
+                                   state->scratch, options);
 }
 
 static int
@@ -1182,7 +1242,8 @@ realloc_handle_wrap_fmt(u_char ** buf, size_t * buf_len, size_t * out_len,
 static int
 realloc_dispatch_format_cmd(u_char ** buf, size_t * buf_len,
                             size_t * out_len, int allow_realloc,
-                            options_type * options, netsnmp_pdu *pdu,
+                            const trapd_format_insn *insn,
+                            trapd_format_state *state, netsnmp_pdu *pdu,
                             netsnmp_transport *transport)
 
      /*
@@ -1192,11 +1253,13 @@ realloc_dispatch_format_cmd(u_char ** buf, size_t * buf_len,
       * Input Parameters:
       *    buf, buf_len, out_len, allow_realloc - standard relocatable
       *                                           buffer parameters
-      *    options   - options governing how to write the field
+      *    insn      - the command, and options governing how to write it
+      *    state     - the time and field buffer kept for this trap
       *    pdu       - information about this trap
       *    transport - the transport descriptor
       */
 {
+    const options_type *options = &insn->options;
     char            fmt_cmd = options->cmd;     /* for speed */
 
     /*
@@ -1205,19 +1268,20 @@ realloc_dispatch_format_cmd(u_char ** buf, size_t * buf_len,
 
     if (is_cur_time_cmd(fmt_cmd) || is_up_time_cmd(fmt_cmd)) {
         return realloc_handle_time_fmt(buf, buf_len, out_len,
-                                       allow_realloc, options, pdu);
+                                       allow_realloc, options, pdu, state);
     } else if (is_agent_cmd(fmt_cmd) || is_pdu_ip_cmd(fmt_cmd)) {
         return realloc_handle_ip_fmt(buf, buf_len, out_len, allow_realloc,
-                                     options, pdu, transport);
+                                     options, pdu, transport, state);
     } else if (is_trap_cmd(fmt_cmd)) {
         return realloc_handle_trap_fmt(buf, buf_len, out_len,
-                                       allow_realloc, options, pdu);
+                                       allow_realloc, options, insn->text,
+                                       pdu, state);
     } else if (is_auth_cmd(fmt_cmd)) {
         return realloc_handle_auth_fmt(buf, buf_len, out_len,
-                                       allow_realloc, options, pdu);
+                                       allow_realloc, options, pdu, state);
     } else if (fmt_cmd == CHR_PDU_ENT || fmt_cmd == CHR_TRAP_CONTEXTID) {
         return realloc_handle_ent_fmt(buf, buf_len, out_len, allow_realloc,
-                                      options, pdu);
+                                      options, pdu, state);
     } else if (fmt_cmd == CHR_PDU_WRAP) {
         return realloc_handle_wrap_fmt(buf, buf_len, out_len,
                                        allow_realloc, pdu);
@@ -1507,36 +1571,134 @@ realloc_format_plain_trap(u_char ** buf, size_t * buf_len,
 }
 
 
-int
-realloc_format_trap(u_char ** buf, size_t * buf_len, size_t * out_len,
-                    int allow_realloc, const char *format_str,
-                    netsnmp_pdu *pdu, netsnmp_transport *transport)
+static int
+format_add_insn(netsnmp_trapd_format *fmt, const options_type *options,
+                const u_char *text, size_t text_len)
 
      /*
       * Function:
-      *    Format the trap information for display in a log. Place the results
-      *    in the specified buffer (truncating to the length of the buffer).
-      *    Returns the number of characters it put in the buffer.
+      *    Append an instruction to a compiled format: a format command if
+      * options is given (text being its separator, if any), otherwise a
+      * run of literal text.
+      */
+{
+    trapd_format_insn *insn;
+    int             max;
+
+    if (fmt->insn_count == fmt->insn_max) {
+        max = fmt->insn_max ? 2 * fmt->insn_max : 8;
+        insn = (trapd_format_insn *) realloc(fmt->insns, max * sizeof(*insn));
+        if (insn == NULL) {
+            return 0;
+        }
+        fmt->insns = insn;
+        fmt->insn_max = max;
+    }
+
+    insn = &fmt->insns[fmt->insn_count];
+    if (options) {
+        insn->options = *options;
+    } else {
+        init_options(&insn->options);
+    }
+    insn->text = NULL;
+    insn->text_len = 0;
+    if (text) {
+        if ((insn->text = (char *) malloc(text_len + 1)) == NULL) {
+            return 0;
+        }
+        memcpy(insn->text, text, text_len);
+        insn->text[text_len] = '\0';
+        insn->text_len = text_len;
+    }
+    fmt->insn_count++;
+    return 1;
+}
+
+
+static int
+format_add_text(netsnmp_trapd_format *fmt, u_char *text, size_t *text_out)
+{
+    if (*text_out == 0) {
+        return 1;
+    }
+    if (!format_add_insn(fmt, NULL, text, *text_out)) {
+        return 0;
+    }
+    *text_out = 0;
+    return 1;
+}
+
+
+static int
+format_add_command(netsnmp_trapd_format *fmt, u_char *text,
+                   size_t *text_out, const options_type *options,
+                   const char *separator)
+{
+    if (!format_add_text(fmt, text, text_out)) {
+        return 0;
+    }
+    if (options->cmd == CHR_TRAP_VARS && *separator) {
+        return format_add_insn(fmt, options, (const u_char *) separator,
+                               strlen(separator));
+    }
+    return format_add_insn(fmt, options, NULL, 0);
+}
+
+
+static int
+format_add_char(u_char ** text, size_t * text_len, size_t * text_out,
+                char chr)
+{
+    if ((*text_out + 1) >= *text_len) {
+        if (!snmp_realloc(text, text_len)) {
+            return 0;
+        }
+    }
+    *(*text + *text_out) = chr;
+    (*text_out)++;
+    *(*text + *text_out) = '\0';
+    return 1;
+}
+
+
+netsnmp_trapd_format *
+netsnmp_trapd_format_compile(const char *format_str)
+
+     /*
+      * Function:
+      *    Parse a format string into a list of instructions that
+      * realloc_format_compiled_trap() can render without looking at the
+      * string again.  Returns NULL if memory runs out.
       *
       * Input Parameters:
-      *    buf, buf_len, out_len, allow_realloc - standard relocatable
-      *                                           buffer parameters
       *    format_str - specifies how to format the trap info
-      *    pdu        - the pdu information
-      *    transport  - the transport descriptor
       */
 {
+    netsnmp_trapd_format *fmt;
+    u_char         *text = NULL;        /* literal text not yet added */
+    size_t          text_len = 64, text_out = 0;
+    char            separator[32];      /* set by %V, used by %v */
     unsigned long   fmt_idx = 0;        /* index into the format string */
     options_type    options;    /* formatting options */
     parse_state_type state = PARSE_NORMAL;      /* state of the parser */
     char            next_chr;   /* for speed */
     int             reset_options = TRUE;       /* reset opts on next NORMAL state */
+    int             ok = 1;
 
-    if (buf == NULL) {
-        return 0;
+    if (format_str == NULL) {
+        return NULL;
+    }
+    fmt = SNMP_MALLOC_TYPEDEF(netsnmp_trapd_format);
+    if (fmt == NULL) {
+        return NULL;
+    }
+    if ((text = (u_char *) calloc(text_len, 1)) == NULL) {
+        goto fail;
     }
 
     memset(separator, 0, sizeof(separator));
+    init_options(&options);
     /*
      * Go until we reach the end of the format string:  
      */
@@ -1556,13 +1718,7 @@ realloc_format_trap(u_char ** buf, size_t * buf_len, size_t * out_len,
             } else if (next_chr == CHR_FMT_DELIM) {
                 state = PARSE_IN_FORMAT;
             } else {
-                if ((*out_len + 1) >= *buf_len) {
-                    if (!(allow_realloc && snmp_realloc(buf, buf_len))) {
-                        return 0;
-                    }
-                }
-                *(*buf + *out_len) = next_chr;
-                (*out_len)++;
+                ok = format_add_char(&text, &text_len, &text_out, next_chr);
             }
             break;
 
@@ -1570,13 +1726,14 @@ realloc_format_trap(u_char ** buf, size_t * buf_len, size_t * out_len,
             /*
              * Parse the separator character
              * XXX - Possibly need to handle quoted strings ??
+             * Anything past the end of the separator buffer is dropped.
              */
 	    {   char *sep = separator;
 		size_t i, j;
 		i = sizeof(separator);
 		j = 0;
 		memset(separator, 0, i);
-		while (j < i && next_chr && next_chr != CHR_FMT_DELIM) {
+		while (next_chr && next_chr != CHR_FMT_DELIM) {
 		    if (next_chr == '\\') {
 			/*
 			 * Handle backslash interpretation
@@ -1584,15 +1741,17 @@ realloc_format_trap(u_char ** buf, size_t * buf_len, size_t * out_len,
 			 *    (a bit of a hack, but it should work!)
 			 */
 			next_chr = format_str[++fmt_idx];
-			if (!realloc_handle_backslash
-			    ((u_char **)&sep, &i, &j, 0, next_chr)) {
-			    return 0;
-			}
-		    } else {
+			if (!next_chr)
+			    break;
+			realloc_handle_backslash((u_char **)&sep, &i, &j, 0,
+						 next_chr);
+		    } else if (j + 1 < i) {
 			separator[j++] = next_chr;
 		    }
 		    next_chr = format_str[++fmt_idx];
 		}
+		if (!next_chr)
+		    goto done;  /* the format ends within the separator */
 	    }
             state = PARSE_IN_FORMAT;
             break;
@@ -1601,10 +1760,8 @@ realloc_format_trap(u_char ** buf, size_t * buf_len, size_t * out_len,
             /*
              * Found a backslash.  
              */
-            if (!realloc_handle_backslash
-                (buf, buf_len, out_len, allow_realloc, next_chr)) {
-                return 0;
-            }
+            ok = realloc_handle_backslash(&text, &text_len, &text_out, 1,
+                                          next_chr);
             state = PARSE_NORMAL;
             break;
 
@@ -1629,20 +1786,11 @@ realloc_format_trap(u_char ** buf, size_t * buf_len, size_t * out_len,
                 state = PARSE_GET_WIDTH;
             } else if (is_fmt_cmd(next_chr)) {
                 options.cmd = next_chr;
-                if (!realloc_dispatch_format_cmd
-                    (buf, buf_len, out_len, allow_realloc, &options, pdu,
-                     transport)) {
-                    return 0;
-                }
+                ok = format_add_command(fmt, text, &text_out, &options,
+                                        separator);
                 state = PARSE_NORMAL;
             } else {
-                if ((*out_len + 1) >= *buf_len) {
-                    if (!(allow_realloc && snmp_realloc(buf, buf_len))) {
-                        return 0;
-                    }
-                }
-                *(*buf + *out_len) = next_chr;
-                (*out_len)++;
+                ok = format_add_char(&text, &text_len, &text_out, next_chr);
                 state = PARSE_NORMAL;
             }
             break;
@@ -1660,20 +1808,11 @@ realloc_format_trap(u_char ** buf, size_t * buf_len, size_t * out_len,
                 state = PARSE_GET_PRECISION;
             } else if (is_fmt_cmd(next_chr)) {
                 options.cmd = next_chr;
-                if (!realloc_dispatch_format_cmd
-                    (buf, buf_len, out_len, allow_realloc, &options, pdu,
-                     transport)) {
-                    return 0;
-                }
+                ok = format_add_command(fmt, text, &text_out, &options,
+                                        separator);
                 state = PARSE_NORMAL;
             } else {
-                if ((*out_len + 1) >= *buf_len) {
-                    if (!(allow_realloc && snmp_realloc(buf, buf_len))) {
-                        return 0;
-                    }
-                }
-                *(*buf + *out_len) = next_chr;
-                (*out_len)++;
+                ok = format_add_char(&text, &text_len, &text_out, next_chr);
                 state = PARSE_NORMAL;
             }
             break;
@@ -1698,20 +1837,11 @@ realloc_format_trap(u_char ** buf, size_t * buf_len, size_t * out_len,
                     (options.width < (size_t)options.precision)) {
                     options.width = (size_t)options.precision;
                 }
-                if (!realloc_dispatch_format_cmd
-                    (buf, buf_len, out_len, allow_realloc, &options, pdu,
-                     transport)) {
-                    return 0;
-                }
+                ok = format_add_command(fmt, text, &text_out, &options,
+                                        separator);
                 state = PARSE_NORMAL;
             } else {
-                if ((*out_len + 1) >= *buf_len) {
-                    if (!(allow_realloc && snmp_realloc(buf, buf_len))) {
-                        return 0;
-                    }
-                }
-                *(*buf + *out_len) = next_chr;
-                (*out_len)++;
+                ok = format_add_char(&text, &text_len, &text_out, next_chr);
                 state = PARSE_NORMAL;
             }
             break;
@@ -1721,17 +1851,178 @@ realloc_format_trap(u_char ** buf, size_t * buf_len, size_t * out_len,
              * Unknown state.  
              */
             reset_options = TRUE;
-            if ((*out_len + 1) >= *buf_len) {
-                if (!(allow_realloc && snmp_realloc(buf, buf_len))) {
-                    return 0;
+            ok = format_add_char(&text, &text_len, &text_out, next_chr);
+            state = PARSE_NORMAL;
+        }
+        if (!ok) {
+            goto fail;
+        }
+    }
+
+  done:
+    if (!format_add_text(fmt, text, &text_out)) {
+        goto fail;
+    }
+    free(text);
+    return fmt;
+
+  fail:
+    free(text);
+    netsnmp_trapd_format_free(fmt);
+    return NULL;
+}
+
+
+void
+netsnmp_trapd_format_free(netsnmp_trapd_format *fmt)
+{
+    int             i;
+
+    if (fmt == NULL) {
+        return;
+    }
+    for (i = 0; i < fmt->insn_count; i++) {
+        SNMP_FREE(fmt->insns[i].text);
+    }
+    SNMP_FREE(fmt->insns);
+    free(fmt);
+}
+
+
+int
+realloc_format_compiled_trap_scratch(u_char ** buf, size_t * buf_len,
+                                     size_t * out_len, int allow_realloc,
+                                     const netsnmp_trapd_format *fmt,
+                                     u_char ** scratch, size_t * scratch_len,
+                                     netsnmp_pdu *pdu,
+                                     netsnmp_transport *transport)
+
+     /*
+      * Function:
+      *    Format the trap information for display in a log, as
+      *    realloc_format_trap() does, from an already compiled format.
+      *
+      * Input Parameters:
+      *    buf, buf_len, out_len, allow_realloc - standard relocatable
+      *                                           buffer parameters
+      *    fmt        - the compiled format
+      *    scratch, scratch_len - the buffer fields are built in, kept by
+      *                 the caller to be reused for the next trap
+      *    pdu        - the pdu information
+      *    transport  - the transport descriptor
+      */
+{
+    const trapd_format_insn *insn;
+    trapd_format_state state;
+    size_t          len;
+    int             i;
+    int             rc = 1;
+
+    if (buf == NULL || fmt == NULL || scratch == NULL) {
+        return 0;
+    }
+
+    memset(&state, 0, sizeof(state));
+    state.scratch = *scratch;
+    state.scratch_len = *scratch_len;
+    for (i = 0; i < fmt->insn_count; i++) {
+        insn = &fmt->insns[i];
+        if (insn->options.cmd != UNDEF_CMD) {
+            if (!realloc_dispatch_format_cmd(buf, buf_len, out_len,
+                                             allow_realloc, insn, &state,
+                                             pdu, transport)) {
+                rc = 0;
+                break;
+            }
+            continue;
+        }
+
+        len = insn->text_len;
+        while ((*out_len + len + 1) >= *buf_len) {
+            if (!(allow_realloc && snmp_realloc(buf, buf_len))) {
+                /*
+                 * Fill what's left of the buffer, and give up.
+                 */
+                if (*out_len + 1 < *buf_len) {
+                    len = *buf_len - *out_len - 1;
+                    memcpy(*buf + *out_len, insn->text, len);
+                    *out_len += len;
                 }
+                *(*buf + *out_len) = '\0';
+                rc = 0;
+                goto done;
             }
-            *(*buf + *out_len) = next_chr;
-            (*out_len)++;
-            state = PARSE_NORMAL;
         }
+        memcpy(*buf + *out_len, insn->text, len);
+        *out_len += len;
     }
 
-    *(*buf + *out_len) = '\0';
-    return 1;
+    if (rc)
+        *(*buf + *out_len) = '\0';
+  done:
+    *scratch = state.scratch;
+    *scratch_len = state.scratch_len;
+    return rc;
+}
+
+
+int
+realloc_format_compiled_trap(u_char ** buf, size_t * buf_len,
+                             size_t * out_len, int allow_realloc,
+                             const netsnmp_trapd_format *fmt,
+                             netsnmp_pdu *pdu, netsnmp_transport *transport)
+
+     /*
+      * Function:
+      *    As realloc_format_compiled_trap_scratch(), with a scratch
+      *    buffer for this trap only.
+      */
+{
+    u_char         *scratch = NULL;
+    size_t          scratch_len = 0;
+    int             rc;
+
+    rc = realloc_format_compiled_trap_scratch(buf, buf_len, out_len,
+                                              allow_realloc, fmt,
+                                              &scratch, &scratch_len,
+                                              pdu, transport);
+    SNMP_FREE(scratch);
+    return rc;
+}
+
+
+int
+realloc_format_trap(u_char ** buf, size_t * buf_len, size_t * out_len,
+                    int allow_realloc, const char *format_str,
+                    netsnmp_pdu *pdu, netsnmp_transport *transport)
+
+     /*
+      * Function:
+      *    Format the trap information for display in a log. Place the results
+      *    in the specified buffer (truncating to the length of the buffer).
+      *    Returns the number of characters it put in the buffer.
+      *    Callers that format many traps with the same string should
+      *    compile it once and use realloc_format_compiled_trap().
+      *
+      * Input Parameters:
+      *    buf, buf_len, out_len, allow_realloc - standard relocatable
+      *                                           buffer parameters
+      *    format_str - specifies how to format the trap info
+      *    pdu        - the pdu information
+      *    transport  - the transport descriptor
+      */
+{
+    netsnmp_trapd_format *fmt;
+    int             rc;
+
+    if (buf == NULL) {
+        return 0;
+    }
+    if ((fmt = netsnmp_trapd_format_compile(format_str)) == NULL) {
+        return 0;
+    }
+    rc = realloc_format_compiled_trap(buf, buf_len, out_len, allow_realloc,
+                                      fmt, pdu, transport);
+    netsnmp_trapd_format_free(fmt);
+    return rc;
 }
@@ -3,6 +3,30 @@
 
 #include "snmptrapd_ds.h"
 
+typedef struct netsnmp_trapd_format_s netsnmp_trapd_format;
+
+netsnmp_trapd_format *netsnmp_trapd_format_compile(const char *format_str);
+void            netsnmp_trapd_format_free(netsnmp_trapd_format *fmt);
+int             realloc_format_compiled_trap(u_char ** buf, size_t * buf_len,
+                                             size_t * out_len,
+                                             int allow_realloc,
+                                             const netsnmp_trapd_format *fmt,
+                                             netsnmp_pdu *pdu,
+                                             struct netsnmp_transport_s
+                                             *transport);
+
+int             realloc_format_compiled_trap_scratch(u_char ** buf,
+                                                     size_t * buf_len,
+                                                     size_t * out_len,
+                                                     int allow_realloc,
+                                                     const netsnmp_trapd_format
+                                                     *fmt,
+                                                     u_char ** scratch,
+                                                     size_t * scratch_len,
+                                                     netsnmp_pdu *pdu,
+                                                     struct netsnmp_transport_s
+                                                     *transport);
+
 int             realloc_format_trap(u_char ** buf, size_t * buf_len,
                                     size_t * out_len, int allow_realloc,
                                     const char *format_str,
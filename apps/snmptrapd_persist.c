@@ -0,0 +1,554 @@
+/*
+ * snmptrapd_persist.c - persistent traphandle programs
+ *
+ * "traphandle -p" starts its program once, like pass_persist does on the
+ * agent side, instead of running it for every notification.  Each
+ * notification is formatted as for a plain traphandle and written to the
+ * standard input of the program as a record: its length in bytes, in
+ * decimal, on a line of its own, then the formatted text.
+ *
+ * With "-n WORKERS", that many copies of the program are started, and
+ * each notification goes to the one with the fewest queued.  Records are
+ * queued per program and written once per pass of the main loop, so that
+ * a burst goes out in a few writes; the pipe is non-blocking, and a
+ * program that does not keep up is written to whenever its pipe drains.
+ * At most "traphandleQueue" notifications are queued for a program; more
+ * are dropped.  A program that stops is started again once there is
+ * something for it, at most once a second; a record it was reading is
+ * lost.  When snmptrapd is reconfigured or stops, the programs are given
+ * a second to read what is queued and to exit after their standard input
+ * is closed, and are then killed.
+ */
+#include <net-snmp/net-snmp-config.h>
+
+#ifdef HAVE_STDLIB_H
+#include <stdlib.h>
+#endif
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+#ifdef HAVE_STRING_H
+#include <string.h>
+#else
+#include <strings.h>
+#endif
+#include <stdio.h>
+#include <errno.h>
+#include <signal.h>
+#include <sys/types.h>
+#ifdef HAVE_FCNTL_H
+#include <fcntl.h>
+#endif
+#ifdef HAVE_SYS_WAIT_H
+#include <sys/wait.h>
+#endif
+#ifdef HAVE_SYS_SELECT_H
+#include <sys/select.h>
+#endif
+#ifdef TIME_WITH_SYS_TIME
+# include <sys/time.h>
+# include <time.h>
+#else
+# ifdef HAVE_SYS_TIME_H
+#  include <sys/time.h>
+# else
+#  include <time.h>
+# endif
+#endif
+
+#include <net-snmp/net-snmp-includes.h>
+#include <net-snmp/library/fd_event_manager.h>
+#include <net-snmp/agent/netsnmp_close_fds.h>
+#include "snmptrapd_persist.h"
+
+#if defined(HAVE_FORK) && defined(HAVE_WAITPID) && defined(HAVE_FCNTL_H)
+#define TRAPD_PERSIST_SUPPORTED 1
+#endif
+
+/* default of traphandleQueue */
+#define TRAPD_PERSIST_QUEUE        1000
+#define TRAPD_PERSIST_MAX_WORKERS  64
+/* how long the programs get to finish when reconfiguring or stopping */
+#define TRAPD_PERSIST_STOP_WAIT    1000         /* milliseconds */
+
+typedef struct trapd_persist_worker_s {
+    netsnmp_trapd_persist *persist;
+    pid_t           pid;            /* the program, or -1 */
+    int             fd;             /* its standard input, or -1 */
+    int             waiting;        /* for fd to become writable */
+    long            next_start;     /* monotonic seconds */
+    u_char         *buf;            /* the records queued */
+    size_t          len;
+    size_t          size;
+    size_t          partial;        /* bytes left of a record partly
+                                     * written, at the start of buf */
+    u_int           depth;          /* records queued */
+} trapd_persist_worker;
+
+struct netsnmp_trapd_persist_s {
+    char           *command;
+    int             nworkers;
+    trapd_persist_worker *workers;
+    netsnmp_trapd_persist_stats stats;
+    netsnmp_trapd_persist *next;
+};
+
+/*
+ * define a structure to hold all the file globals
+ */
+typedef struct netsnmp_trapd_persist_globals_t {
+    netsnmp_trapd_persist *list;
+    u_int           queue;          /* from traphandleQueue */
+    u_int           alarm;          /* checks the programs */
+} netsnmp_trapd_persist_globals;
+
+static netsnmp_trapd_persist_globals _persist = {
+    NULL,                               /* list */
+    TRAPD_PERSIST_QUEUE,                /* queue */
+    0                                   /* alarm */
+};
+
+static void     _persist_send(trapd_persist_worker *w);
+
+static void
+_persist_writable(int fd, void *data)
+{
+    trapd_persist_worker *w = (trapd_persist_worker *) data;
+
+    unregister_writefd(fd);
+    w->waiting = 0;
+    _persist_send(w);
+}
+
+/*
+ * have the main loop call back once the pipe takes more; without the fd
+ * event manager, the next pass of the main loop tries again
+ */
+static void
+_persist_wait(trapd_persist_worker *w)
+{
+#ifndef NETSNMP_FEATURE_REMOVE_FD_EVENT_MANAGER
+    if (register_writefd(w->fd, _persist_writable, w) == FD_REGISTERED_OK)
+        w->waiting = 1;
+#endif /* NETSNMP_FEATURE_REMOVE_FD_EVENT_MANAGER */
+}
+
+static void
+_persist_unwait(trapd_persist_worker *w)
+{
+#ifndef NETSNMP_FEATURE_REMOVE_FD_EVENT_MANAGER
+    if (w->waiting)
+        unregister_writefd(w->fd);
+#endif /* NETSNMP_FEATURE_REMOVE_FD_EVENT_MANAGER */
+    w->waiting = 0;
+}
+
+static void
+_persist_nap(void)
+{
+    struct timeval  tv;
+
+    tv.tv_sec = 0;
+    tv.tv_usec = 10000;
+    select(0, NULL, NULL, NULL, &tv);
+}
+
+/*
+ * forget the rest of the record being written when the program stopped
+ */
+static void
+_persist_drop_partial(trapd_persist_worker *w)
+{
+    netsnmp_trapd_persist *p = w->persist;
+
+    if (w->partial == 0)
+        return;
+    memmove(w->buf, w->buf + w->partial, w->len - w->partial);
+    w->len -= w->partial;
+    w->partial = 0;
+    w->depth--;
+    p->stats.depth--;
+    p->stats.lost++;
+}
+
+/*
+ * account for n bytes written from the start of the queue
+ */
+static void
+_persist_advance(trapd_persist_worker *w, size_t n)
+{
+    netsnmp_trapd_persist *p = w->persist;
+    size_t          pos, rec;
+    char           *end;
+
+    if (n < w->partial) {
+        w->partial -= n;
+    } else {
+        pos = w->partial;
+        if (w->partial) {
+            w->partial = 0;
+            w->depth--;
+            p->stats.depth--;
+            p->stats.written++;
+        }
+        while (pos < n) {
+            rec = strtoul((char *) w->buf + pos, &end, 10);
+            rec += end + 1 - ((char *) w->buf + pos);
+            if (pos + rec > n) {
+                w->partial = pos + rec - n;
+                break;
+            }
+            pos += rec;
+            w->depth--;
+            p->stats.depth--;
+            p->stats.written++;
+        }
+    }
+    memmove(w->buf, w->buf + n, w->len - n);
+    w->len -= n;
+}
+
+/*
+ * stop a program, giving it up to wait milliseconds to exit by itself
+ * once its standard input is closed
+ */
+static void
+_persist_stop(trapd_persist_worker *w, int wait)
+{
+#ifdef TRAPD_PERSIST_SUPPORTED
+    _persist_unwait(w);
+    if (w->fd >= 0) {
+        close(w->fd);
+        w->fd = -1;
+    }
+    _persist_drop_partial(w);
+    if (w->pid > 0) {
+        for (; wait > 0; wait -= 10) {
+            if (waitpid(w->pid, NULL, WNOHANG) != 0)
+                break;
+            _persist_nap();
+        }
+        if (wait <= 0) {
+            kill(w->pid, SIGKILL);
+            waitpid(w->pid, NULL, 0);
+        }
+        w->pid = -1;
+    }
+#endif /* TRAPD_PERSIST_SUPPORTED */
+}
+
+static int
+_persist_start(trapd_persist_worker *w)
+{
+#ifdef TRAPD_PERSIST_SUPPORTED
+    netsnmp_trapd_persist *p = w->persist;
+    struct timeval  now;
+    int             fds[2];
+    pid_t           pid;
+
+    netsnmp_get_monotonic_clock(&now);
+    if (now.tv_sec < w->next_start)
+        return -1;
+    w->next_start = now.tv_sec + 1;
+
+    if (pipe(fds) < 0) {
+        snmp_log(LOG_ERR, "traphandle %s: pipe: %s\n", p->command,
+                 strerror(errno));
+        p->stats.start_errors++;
+        return -1;
+    }
+    pid = fork();
+    if (pid == 0) {
+        if (fds[0] != STDIN_FILENO)
+            dup2(fds[0], STDIN_FILENO);
+        netsnmp_close_fds(STDERR_FILENO);
+        execl("/bin/sh", "sh", "-c", p->command, (char *) NULL);
+        _exit(127);
+    }
+    close(fds[0]);
+    if (pid < 0) {
+        snmp_log(LOG_ERR, "traphandle %s: fork: %s\n", p->command,
+                 strerror(errno));
+        close(fds[1]);
+        p->stats.start_errors++;
+        return -1;
+    }
+    /* later programs must not hold this pipe open */
+    fcntl(fds[1], F_SETFD, FD_CLOEXEC);
+    fcntl(fds[1], F_SETFL, fcntl(fds[1], F_GETFL) | O_NONBLOCK);
+    w->pid = pid;
+    w->fd = fds[1];
+    p->stats.starts++;
+    DEBUGMSGTL(("snmptrapd:persist", "started %s, pid %ld\n", p->command,
+                (long) pid));
+    return 0;
+#else
+    return -1;
+#endif /* TRAPD_PERSIST_SUPPORTED */
+}
+
+/*
+ * write what is queued, as far as the pipe takes it
+ */
+static void
+_persist_send(trapd_persist_worker *w)
+{
+    ssize_t         n;
+
+    if (w->len == 0 || w->waiting)
+        return;
+    if (w->fd < 0 && _persist_start(w) < 0)
+        return;
+    while (w->len > 0) {
+        n = write(w->fd, w->buf, w->len);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0 && errno == EAGAIN) {
+            _persist_wait(w);
+            return;
+        }
+        if (n <= 0) {
+            snmp_log(LOG_ERR, "traphandle %s: write: %s\n",
+                     w->persist->command, strerror(errno));
+            _persist_stop(w, 0);
+            return;
+        }
+        _persist_advance(w, n);
+    }
+}
+
+static void
+_persist_check(unsigned int clientreg, void *clientarg)
+{
+#ifdef TRAPD_PERSIST_SUPPORTED
+    netsnmp_trapd_persist *p;
+    trapd_persist_worker *w;
+    int             i, status;
+
+    for (p = _persist.list; p; p = p->next)
+        for (i = 0; i < p->nworkers; i++) {
+            w = &p->workers[i];
+            if (w->pid <= 0 || waitpid(w->pid, &status, WNOHANG) <= 0)
+                continue;
+            if (WIFEXITED(status))
+                snmp_log(LOG_WARNING, "traphandle %s: program exited "
+                         "with status %d\n", p->command,
+                         WEXITSTATUS(status));
+            else
+                snmp_log(LOG_WARNING, "traphandle %s: program stopped\n",
+                         p->command);
+            p->stats.exits++;
+            w->pid = -1;
+            _persist_stop(w, 0);
+        }
+#endif /* TRAPD_PERSIST_SUPPORTED */
+    snmptrapd_persist_flush();
+}
+
+netsnmp_trapd_persist *
+snmptrapd_persist_new(const char *command, int workers)
+{
+    netsnmp_trapd_persist *p;
+    int             i;
+
+#ifndef TRAPD_PERSIST_SUPPORTED
+    snmp_log(LOG_ERR, "traphandle -p is not supported on this platform\n");
+    return NULL;
+#endif
+    if (workers < 1 || workers > TRAPD_PERSIST_MAX_WORKERS)
+        return NULL;
+    p = SNMP_MALLOC_TYPEDEF(netsnmp_trapd_persist);
+    if (p == NULL)
+        return NULL;
+    p->command = strdup(command);
+    p->workers = (trapd_persist_worker *) calloc(workers, sizeof(*p->workers));
+    if (p->command == NULL || p->workers == NULL) {
+        free(p->command);
+        free(p->workers);
+        free(p);
+        return NULL;
+    }
+    p->nworkers = workers;
+    for (i = 0; i < workers; i++) {
+        p->workers[i].persist = p;
+        p->workers[i].pid = -1;
+        p->workers[i].fd = -1;
+    }
+    p->next = _persist.list;
+    _persist.list = p;
+    if (_persist.alarm == 0)
+        _persist.alarm = snmp_alarm_register(1, SA_REPEAT, _persist_check,
+                                             NULL);
+    return p;
+}
+
+/*
+ * queue a notification for the least busy of the programs
+ */
+int
+snmptrapd_persist_write(netsnmp_trapd_persist *p, const char *data,
+                        size_t len)
+{
+    trapd_persist_worker *w;
+    char            hdr[24];
+    size_t          hdr_len, size;
+    u_char         *buf;
+    int             i;
+
+    w = &p->workers[0];
+    for (i = 1; i < p->nworkers; i++)
+        if (p->workers[i].depth < w->depth)
+            w = &p->workers[i];
+    if (w->depth >= _persist.queue) {
+        p->stats.dropped++;
+        return -1;
+    }
+
+    hdr_len = snprintf(hdr, sizeof(hdr), "%lu\n", (u_long) len);
+    if (w->len + hdr_len + len > w->size) {
+        size = w->size ? w->size : 4096;
+        while (size < w->len + hdr_len + len)
+            size *= 2;
+        buf = (u_char *) realloc(w->buf, size);
+        if (buf == NULL) {
+            p->stats.dropped++;
+            return -1;
+        }
+        w->buf = buf;
+        w->size = size;
+    }
+    memcpy(w->buf + w->len, hdr, hdr_len);
+    memcpy(w->buf + w->len + hdr_len, data, len);
+    w->len += hdr_len + len;
+    w->depth++;
+    p->stats.queued++;
+    if (++p->stats.depth > p->stats.max_depth)
+        p->stats.max_depth = p->stats.depth;
+    return 0;
+}
+
+/*
+ * write what was queued during this pass of the main loop
+ */
+void
+snmptrapd_persist_flush(void)
+{
+    netsnmp_trapd_persist *p;
+    int             i;
+
+    for (p = _persist.list; p; p = p->next)
+        for (i = 0; i < p->nworkers; i++)
+            _persist_send(&p->workers[i]);
+}
+
+void
+snmptrapd_persist_get_stats(netsnmp_trapd_persist *p,
+                            netsnmp_trapd_persist_stats *stats)
+{
+    *stats = p->stats;
+}
+
+/*
+ * let the programs read what is queued, stop them and log the counters;
+ * called when the traphandle lines are freed, and when snmptrapd stops
+ */
+void
+snmptrapd_persist_free_all(void)
+{
+    netsnmp_trapd_persist *p;
+    trapd_persist_worker *w;
+    int             i, wait, busy;
+
+    if (_persist.alarm) {
+        snmp_alarm_unregister(_persist.alarm);
+        _persist.alarm = 0;
+    }
+    for (wait = TRAPD_PERSIST_STOP_WAIT; wait > 0; wait -= 10) {
+        busy = 0;
+        for (p = _persist.list; p; p = p->next)
+            for (i = 0; i < p->nworkers; i++) {
+                w = &p->workers[i];
+                if (w->fd < 0)
+                    continue;
+                _persist_unwait(w);
+                _persist_send(w);
+                busy |= w->fd >= 0 && w->len > 0;
+            }
+        if (!busy)
+            break;
+        _persist_nap();
+    }
+
+#ifdef TRAPD_PERSIST_SUPPORTED
+    /* close every standard input first, so that they all exit together */
+    for (p = _persist.list; p; p = p->next)
+        for (i = 0; i < p->nworkers; i++) {
+            w = &p->workers[i];
+            _persist_unwait(w);
+            if (w->fd >= 0) {
+                close(w->fd);
+                w->fd = -1;
+            }
+        }
+    for (; wait > 0; wait -= 10) {
+        busy = 0;
+        for (p = _persist.list; p; p = p->next)
+            for (i = 0; i < p->nworkers; i++) {
+                w = &p->workers[i];
+                if (w->pid > 0 && waitpid(w->pid, NULL, WNOHANG) != 0)
+                    w->pid = -1;
+                busy |= w->pid > 0;
+            }
+        if (!busy)
+            break;
+        _persist_nap();
+    }
+#endif /* TRAPD_PERSIST_SUPPORTED */
+
+    while ((p = _persist.list) != NULL) {
+        _persist.list = p->next;
+        for (i = 0; i < p->nworkers; i++) {
+            w = &p->workers[i];
+            _persist_stop(w, 0);
+            free(w->buf);
+        }
+        snmp_log(LOG_INFO, "traphandle %s: %lu queued, %lu dropped, "
+                 "%lu written, %lu lost, %lu starts (%lu failed), "
+                 "%lu exits\n", p->command, p->stats.queued,
+                 p->stats.dropped, p->stats.written,
+                 p->stats.lost + p->stats.depth, p->stats.starts,
+                 p->stats.start_errors, p->stats.exits);
+        free(p->command);
+        free(p->workers);
+        free(p);
+    }
+}
+
+static void
+_parse_traphandle_queue(const char *token, char *cptr)
+{
+    int             queue = atoi(cptr);
+
+    if (queue < 1) {
+        config_perror("traphandleQueue must be at least 1");
+        return;
+    }
+    _persist.queue = queue;
+}
+
+static void
+_free_traphandle_queue(void)
+{
+    _persist.queue = TRAPD_PERSIST_QUEUE;
+}
+
+/*
+ * register persistent traphandle related configuration tokens
+ */
+void
+snmptrapd_register_persist_configs(void)
+{
+    register_config_handler("snmptrapd", "traphandleQueue",
+                            _parse_traphandle_queue,
+                            _free_traphandle_queue, "integer");
+}
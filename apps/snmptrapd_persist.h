@@ -0,0 +1,29 @@
+#ifndef SNMPTRAPD_PERSIST_H
+#define SNMPTRAPD_PERSIST_H
+
+typedef struct netsnmp_trapd_persist_s netsnmp_trapd_persist;
+
+typedef struct netsnmp_trapd_persist_stats_s {
+    u_long          queued;         /* notifications queued for the program */
+    u_long          dropped;        /* ... and dropped, the queues being full */
+    u_long          written;        /* ... and written to it */
+    u_long          lost;           /* ... and lost, the program having
+                                     * stopped while they were written */
+    u_long          starts;         /* programs started */
+    u_long          start_errors;
+    u_long          exits;          /* programs that stopped by themselves */
+    u_int           depth;          /* notifications queued now */
+    u_int           max_depth;      /* ... and at most */
+} netsnmp_trapd_persist_stats;
+
+void snmptrapd_register_persist_configs(void);
+netsnmp_trapd_persist *snmptrapd_persist_new(const char *command,
+                                             int workers);
+int  snmptrapd_persist_write(netsnmp_trapd_persist *persist,
+                             const char *data, size_t len);
+void snmptrapd_persist_flush(void);
+void snmptrapd_persist_get_stats(netsnmp_trapd_persist *persist,
+                                 netsnmp_trapd_persist_stats *stats);
+void snmptrapd_persist_free_all(void);
+
+#endif /* SNMPTRAPD_PERSIST_H */
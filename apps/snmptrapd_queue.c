@@ -0,0 +1,553 @@
+/*
+ * snmptrapd_queue.c - receive notifications ahead of their processing
+ *
+ * With "receiveQueue N" set, the UDP sockets snmptrapd listens on are read
+ * by a receiver thread, which only copies each datagram into a queue of at
+ * most N datagrams.  That keeps the socket buffers of the kernel empty while
+ * slow handlers run, and a datagram that does not fit in the queue is
+ * counted instead of being dropped silently by the kernel.
+ *
+ * The main loop takes the datagrams off the queue in the order they were
+ * received and processes them as snmp_read() would have.  Decoding, the
+ * handler chains and the responses to informs all stay on the main thread,
+ * as neither the library nor the handlers are thread-safe, and so
+ * notifications are still logged and handled in the order of arrival.
+ */
+#include <net-snmp/net-snmp-config.h>
+
+#ifdef HAVE_STDLIB_H
+#include <stdlib.h>
+#endif
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+#ifdef HAVE_STRING_H
+#include <string.h>
+#else
+#include <strings.h>
+#endif
+#ifdef HAVE_FCNTL_H
+#include <fcntl.h>
+#endif
+#include <errno.h>
+#include <signal.h>
+#include <sys/types.h>
+#ifdef HAVE_SYS_SELECT_H
+#include <sys/select.h>
+#endif
+#ifdef TIME_WITH_SYS_TIME
+# include <sys/time.h>
+# include <time.h>
+#else
+# ifdef HAVE_SYS_TIME_H
+#  include <sys/time.h>
+# else
+#  include <time.h>
+# endif
+#endif
+
+#include <net-snmp/net-snmp-includes.h>
+#include <net-snmp/library/fd_event_manager.h>
+#include <net-snmp/library/large_fd_set.h>
+#ifdef NETSNMP_TRANSPORT_UDPIPV6_DOMAIN
+#include <net-snmp/library/snmpUDPIPv6Domain.h>
+#endif
+#include "snmptrapd_queue.h"
+
+#if defined(HAVE_PTHREAD_H) && defined(HAVE_PTHREAD_CREATE) && \
+    !defined(WIN32) && !defined(NETSNMP_FEATURE_REMOVE_FD_EVENT_MANAGER)
+#define SNMPTRAPD_QUEUE_THREADS 1
+#include <pthread.h>
+#endif
+
+/* datagrams read from one socket before looking at the others */
+#define TRAPD_QUEUE_BURST 64
+
+typedef struct trapd_queued_packet_s {
+    struct session_list *slp;
+    u_char         *packet;
+    int             length;
+    void           *opaque;
+    int             olength;
+    struct timeval  received;
+} trapd_queued_packet;
+
+typedef struct trapd_queue_socket_s {
+    struct session_list *slp;
+    netsnmp_transport   *transport;
+} trapd_queue_socket;
+
+/*
+ * define a structure to hold all the file globals
+ */
+typedef struct netsnmp_trapd_queue_globals_t {
+    int                  size_config;   /* from receiveQueue */
+    int                  size_started;  /* ... when last started */
+    int                  running;
+    netsnmp_session     *sessions;      /* to start again with */
+    trapd_queued_packet *ring;          /* the queue */
+    int                  size;
+    int                  head;
+    int                  count;
+    trapd_queue_socket  *sockets;       /* sockets read by the receiver */
+    int                  nsockets;
+    int                  wake[2];       /* tells the main loop to dispatch */
+    int                  stop[2];       /* tells the receiver to stop */
+    netsnmp_trapd_queue_stats stats;
+#ifdef SNMPTRAPD_QUEUE_THREADS
+    pthread_mutex_t      lock;
+    pthread_t            thread;
+#endif
+} netsnmp_trapd_queue_globals;
+
+static netsnmp_trapd_queue_globals _queue = {
+    0,                          /* size_config */
+    0,                          /* size_started */
+    0,                          /* running */
+    NULL,                       /* sessions */
+    NULL, 0, 0, 0,              /* ring */
+    NULL, 0,                    /* sockets */
+    { -1, -1 }, { -1, -1 }      /* pipes */
+};
+
+/*
+ * parse the receiveQueue configuration token
+ */
+static void
+_parse_receive_queue(const char *token, char *cptr)
+{
+    int             size = atoi(cptr);
+
+    if (size < 0) {
+        config_perror("receiveQueue must not be negative");
+        return;
+    }
+    _queue.size_config = size;
+    DEBUGMSGTL(("snmptrapd:queue", "receive queue size now %d\n", size));
+}
+
+static void
+_free_receive_queue(void)
+{
+    _queue.size_config = 0;
+}
+
+/*
+ * register receive queue related configuration tokens
+ */
+void
+snmptrapd_register_queue_configs(void)
+{
+    register_config_handler("snmptrapd", "receiveQueue",
+                            _parse_receive_queue, _free_receive_queue,
+                            "integer");
+}
+
+#ifdef SNMPTRAPD_QUEUE_THREADS
+
+static u_long
+_usec_since(const struct timeval *from, const struct timeval *to)
+{
+    long            usec = (to->tv_sec - from->tv_sec) * 1000000L +
+                           (to->tv_usec - from->tv_usec);
+
+    return usec > 0 ? (u_long) usec : 0;
+}
+
+/*
+ * whether the receiver can read a transport: a plain UDP socket only, as
+ * the receiver calls its f_recv() while the main loop may send on it
+ */
+static int
+_queue_transport_ok(netsnmp_transport *t)
+{
+#ifdef NETSNMP_TRANSPORT_UDPIPV6_DOMAIN
+    static const oid udp6[] = { TRANSPORT_DOMAIN_UDP_IPV6 };
+#endif
+
+    if (!t || t->sock < 0 || t->base_transport || !t->f_recv ||
+        (t->flags & (NETSNMP_TRANSPORT_FLAG_STREAM |
+                     NETSNMP_TRANSPORT_FLAG_LISTEN |
+                     NETSNMP_TRANSPORT_FLAG_SHARED)))
+        return 0;
+    if (netsnmp_oid_equals(t->domain, t->domain_length,
+                           netsnmpUDPDomain, netsnmpUDPDomain_len) == 0)
+        return 1;
+#ifdef NETSNMP_TRANSPORT_UDPIPV6_DOMAIN
+    if (netsnmp_oid_equals(t->domain, t->domain_length,
+                           udp6, OID_LENGTH(udp6)) == 0)
+        return 1;
+#endif
+    return 0;
+}
+
+static void
+_queue_push(struct session_list *slp, const u_char *buf, int length,
+            void *opaque, int olength)
+{
+    trapd_queued_packet *qp;
+    u_char         *packet;
+    int             was_empty;
+
+    packet = (u_char *) malloc(length);
+    pthread_mutex_lock(&_queue.lock);
+    _queue.stats.received++;
+    if (!packet || _queue.count == _queue.size) {
+        _queue.stats.dropped++;
+        pthread_mutex_unlock(&_queue.lock);
+        free(packet);
+        free(opaque);
+        return;
+    }
+    memcpy(packet, buf, length);
+    qp = &_queue.ring[(_queue.head + _queue.count) % _queue.size];
+    qp->slp = slp;
+    qp->packet = packet;
+    qp->length = length;
+    qp->opaque = opaque;
+    qp->olength = olength;
+    gettimeofday(&qp->received, NULL);
+    was_empty = (_queue.count++ == 0);
+    if ((u_int) _queue.count > _queue.stats.max_depth)
+        _queue.stats.max_depth = _queue.count;
+    pthread_mutex_unlock(&_queue.lock);
+
+    /*
+     * the main loop takes everything queued when woken, so it only needs
+     * waking when the queue was empty
+     */
+    if (was_empty && write(_queue.wake[1], "", 1) < 0) {
+        /* the pipe is full, so the main loop is being woken already */
+    }
+}
+
+static void *
+_queue_receiver(void *arg)
+{
+    trapd_queue_socket *qs;
+    sigset_t        signals;
+    netsnmp_large_fd_set readfds;
+    u_char         *buf;
+    void           *opaque;
+    int             i, n, rc, olength, numfds;
+
+    /* signals are for the main loop */
+    sigfillset(&signals);
+    pthread_sigmask(SIG_BLOCK, &signals, NULL);
+
+    buf = (u_char *) malloc(SNMP_MAX_RCV_MSG_SIZE);
+    if (!buf)
+        return NULL;
+    netsnmp_large_fd_set_init(&readfds, FD_SETSIZE);
+
+    for (;;) {
+        NETSNMP_LARGE_FD_ZERO(&readfds);
+        NETSNMP_LARGE_FD_SET(_queue.stop[0], &readfds);
+        numfds = _queue.stop[0] + 1;
+        for (i = 0; i < _queue.nsockets; i++) {
+            NETSNMP_LARGE_FD_SET(_queue.sockets[i].transport->sock, &readfds);
+            if (_queue.sockets[i].transport->sock >= numfds)
+                numfds = _queue.sockets[i].transport->sock + 1;
+        }
+        rc = netsnmp_large_fd_set_select(numfds, &readfds, NULL, NULL, NULL);
+        if (rc < 0) {
+            if (errno == EINTR)
+                continue;
+            break;
+        }
+        if (NETSNMP_LARGE_FD_ISSET(_queue.stop[0], &readfds))
+            break;
+
+        for (i = 0; i < _queue.nsockets; i++) {
+            qs = &_queue.sockets[i];
+            if (!NETSNMP_LARGE_FD_ISSET(qs->transport->sock, &readfds))
+                continue;
+            /* the sockets don't block, so read what is there */
+            for (n = 0; n < TRAPD_QUEUE_BURST; n++) {
+                opaque = NULL;
+                olength = 0;
+                rc = qs->transport->f_recv(qs->transport, buf,
+                                           SNMP_MAX_RCV_MSG_SIZE,
+                                           &opaque, &olength);
+                if (rc <= 0) {
+                    free(opaque);
+                    break;
+                }
+                _queue_push(qs->slp, buf, rc, opaque, olength);
+            }
+        }
+    }
+    netsnmp_large_fd_set_cleanup(&readfds);
+    free(buf);
+    return NULL;
+}
+
+/*
+ * process the datagrams queued so far; any that are queued meanwhile wait
+ * for the next pass of the main loop, so that they cannot starve it
+ */
+static void
+_queue_dispatch(int fd, void *data)
+{
+    trapd_queued_packet qp;
+    struct timeval  start, done;
+    char            buf[64];
+    int             pending;
+    u_long          wait, handle;
+
+    while (read(fd, buf, sizeof(buf)) > 0)
+        ;
+
+    pthread_mutex_lock(&_queue.lock);
+    pending = _queue.count;
+    pthread_mutex_unlock(&_queue.lock);
+
+    for (; pending > 0; pending--) {
+        pthread_mutex_lock(&_queue.lock);
+        qp = _queue.ring[_queue.head];
+        _queue.head = (_queue.head + 1) % _queue.size;
+        _queue.count--;
+        pthread_mutex_unlock(&_queue.lock);
+
+        gettimeofday(&start, NULL);
+        snmp_sess_process_packet(qp.slp, qp.packet, qp.length,
+                                 qp.opaque, qp.olength);
+        gettimeofday(&done, NULL);
+        free(qp.packet);
+
+        wait = _usec_since(&qp.received, &start);
+        handle = _usec_since(&start, &done);
+        pthread_mutex_lock(&_queue.lock);
+        _queue.stats.handled++;
+        _queue.stats.wait_usec += wait;
+        if (wait > _queue.stats.max_wait_usec)
+            _queue.stats.max_wait_usec = wait;
+        _queue.stats.handle_usec += handle;
+        if (handle > _queue.stats.max_handle_usec)
+            _queue.stats.max_handle_usec = handle;
+        pthread_mutex_unlock(&_queue.lock);
+    }
+
+    pthread_mutex_lock(&_queue.lock);
+    pending = _queue.count;
+    pthread_mutex_unlock(&_queue.lock);
+    if (pending && write(_queue.wake[1], "", 1) < 0 && errno != EAGAIN)
+        DEBUGMSGTL(("snmptrapd:queue", "cannot wake the main loop\n"));
+}
+
+static int
+_queue_pipe(int fds[2])
+{
+    if (pipe(fds) < 0)
+        return -1;
+    fcntl(fds[0], F_SETFL, fcntl(fds[0], F_GETFL) | O_NONBLOCK);
+    fcntl(fds[1], F_SETFL, fcntl(fds[1], F_GETFL) | O_NONBLOCK);
+    return 0;
+}
+
+static void
+_queue_close_pipes(void)
+{
+    int             i;
+
+    for (i = 0; i < 2; i++) {
+        if (_queue.wake[i] >= 0)
+            close(_queue.wake[i]);
+        if (_queue.stop[i] >= 0)
+            close(_queue.stop[i]);
+        _queue.wake[i] = _queue.stop[i] = -1;
+    }
+}
+
+#endif /* SNMPTRAPD_QUEUE_THREADS */
+
+/*
+ * start receiving on the UDP sockets of the sessions in sess_list, if
+ * receiveQueue is set.  Returns 0 when the receiver runs or is not wanted.
+ */
+int
+snmptrapd_queue_start(netsnmp_session *sess_list)
+{
+#ifdef SNMPTRAPD_QUEUE_THREADS
+    netsnmp_session *s;
+    struct session_list *slp;
+    netsnmp_transport *t;
+    int             n;
+
+    _queue.sessions = sess_list;
+    _queue.size_started = _queue.size_config;
+    if (_queue.running || _queue.size_config <= 0)
+        return 0;
+
+    for (n = 0, s = sess_list; s; s = s->next)
+        n++;
+    _queue.sockets = (trapd_queue_socket *) calloc(n ? n : 1,
+                                                   sizeof(*_queue.sockets));
+    _queue.ring = (trapd_queued_packet *) calloc(_queue.size_config,
+                                                 sizeof(*_queue.ring));
+    if (!_queue.sockets || !_queue.ring)
+        goto fail;
+    _queue.size = _queue.size_config;
+    _queue.head = _queue.count = 0;
+    _queue.nsockets = 0;
+    for (s = sess_list; s; s = s->next) {
+        slp = snmp_sess_pointer(s);
+        t = slp ? snmp_sess_transport(slp) : NULL;
+        if (!_queue_transport_ok(t))
+            continue;
+        _queue.sockets[_queue.nsockets].slp = slp;
+        _queue.sockets[_queue.nsockets].transport = t;
+        _queue.nsockets++;
+    }
+    if (!_queue.nsockets) {
+        snmp_log(LOG_WARNING,
+                 "receiveQueue: no UDP sockets to receive on\n");
+        goto fail;
+    }
+
+    memset(&_queue.stats, 0, sizeof(_queue.stats));
+    if (_queue_pipe(_queue.wake) < 0 || _queue_pipe(_queue.stop) < 0) {
+        snmp_log_perror("receiveQueue: pipe");
+        goto fail;
+    }
+    pthread_mutex_init(&_queue.lock, NULL);
+    if (register_readfd(_queue.wake[0], _queue_dispatch, NULL) !=
+        FD_REGISTERED_OK) {
+        snmp_log(LOG_ERR, "receiveQueue: cannot register the queue\n");
+        pthread_mutex_destroy(&_queue.lock);
+        goto fail;
+    }
+    if (pthread_create(&_queue.thread, NULL, _queue_receiver, NULL) != 0) {
+        snmp_log(LOG_ERR, "receiveQueue: cannot start the receiver\n");
+        unregister_readfd(_queue.wake[0]);
+        pthread_mutex_destroy(&_queue.lock);
+        goto fail;
+    }
+    _queue.running = 1;
+    DEBUGMSGTL(("snmptrapd:queue", "receiving on %d sockets, queue of %d\n",
+                _queue.nsockets, _queue.size));
+    return 0;
+
+  fail:
+    _queue_close_pipes();
+    SNMP_FREE(_queue.sockets);
+    SNMP_FREE(_queue.ring);
+    _queue.nsockets = 0;
+    return -1;
+#else
+    _queue.sessions = sess_list;
+    _queue.size_started = _queue.size_config;
+    if (_queue.size_config > 0)
+        snmp_log(LOG_WARNING,
+                 "receiveQueue is not supported on this platform\n");
+    return _queue.size_config > 0 ? -1 : 0;
+#endif /* SNMPTRAPD_QUEUE_THREADS */
+}
+
+/*
+ * keep the main loop from reading the sockets the receiver reads
+ */
+void
+snmptrapd_queue_select_info(netsnmp_large_fd_set *readfds)
+{
+    int             i;
+
+    if (!_queue.running)
+        return;
+    for (i = 0; i < _queue.nsockets; i++)
+        NETSNMP_LARGE_FD_CLR(_queue.sockets[i].transport->sock, readfds);
+}
+
+/*
+ * stop the receiver, and process what it has queued
+ */
+void
+snmptrapd_queue_stop(void)
+{
+#ifdef SNMPTRAPD_QUEUE_THREADS
+    trapd_queued_packet *qp;
+
+    if (!_queue.running)
+        return;
+
+    if (write(_queue.stop[1], "", 1) < 0)
+        snmp_log_perror("receiveQueue: stop");
+    pthread_join(_queue.thread, NULL);
+    _queue_dispatch(_queue.wake[0], NULL);
+    /* anything the dispatch left for another pass */
+    while (_queue.count) {
+        qp = &_queue.ring[_queue.head];
+        free(qp->packet);
+        free(qp->opaque);
+        _queue.head = (_queue.head + 1) % _queue.size;
+        _queue.count--;
+    }
+    snmptrapd_queue_log_stats();
+    unregister_readfd(_queue.wake[0]);
+    _queue.running = 0;
+
+    pthread_mutex_destroy(&_queue.lock);
+    _queue_close_pipes();
+    SNMP_FREE(_queue.sockets);
+    SNMP_FREE(_queue.ring);
+    _queue.nsockets = 0;
+#endif /* SNMPTRAPD_QUEUE_THREADS */
+}
+
+/*
+ * log the counters on reconfiguration, and apply a changed receiveQueue:
+ * what is queued is processed, and the receiver is started again with
+ * the new size, or left stopped if it is now 0.
+ */
+void
+snmptrapd_queue_reconfig(void)
+{
+    if (_queue.size_config == _queue.size_started) {
+        snmptrapd_queue_log_stats();
+        return;
+    }
+
+    snmp_log(LOG_INFO, "receiveQueue changed from %d to %d\n",
+             _queue.size_started, _queue.size_config);
+    snmptrapd_queue_stop();
+    if (snmptrapd_queue_start(_queue.sessions) < 0)
+        snmp_log(LOG_WARNING, "receiving without a receive queue\n");
+}
+
+/*
+ * copy the counters of the receive queue.  Returns 0 if it is running.
+ */
+int
+snmptrapd_queue_get_stats(netsnmp_trapd_queue_stats *stats)
+{
+#ifdef SNMPTRAPD_QUEUE_THREADS
+    if (_queue.running) {
+        pthread_mutex_lock(&_queue.lock);
+        *stats = _queue.stats;
+        stats->depth = _queue.count;
+        pthread_mutex_unlock(&_queue.lock);
+        return 0;
+    }
+#endif /* SNMPTRAPD_QUEUE_THREADS */
+    memset(stats, 0, sizeof(*stats));
+    return -1;
+}
+
+void
+snmptrapd_queue_log_stats(void)
+{
+    netsnmp_trapd_queue_stats stats;
+
+    if (snmptrapd_queue_get_stats(&stats) < 0)
+        return;
+
+    snmp_log(LOG_INFO, "receive queue: %lu received, %lu dropped, "
+             "%lu handled, depth %u (max %u), wait %.0f us avg "
+             "(max %lu), handling %.0f us avg (max %lu)\n",
+             stats.received, stats.dropped, stats.handled,
+             stats.depth, stats.max_depth,
+             stats.handled ? stats.wait_usec / stats.handled : 0.0,
+             stats.max_wait_usec,
+             stats.handled ? stats.handle_usec / stats.handled : 0.0,
+             stats.max_handle_usec);
+}
@@ -0,0 +1,24 @@
+#ifndef SNMPTRAPD_QUEUE_H
+#define SNMPTRAPD_QUEUE_H
+
+typedef struct netsnmp_trapd_queue_stats_s {
+    u_long          received;       /* datagrams read by the receiver */
+    u_long          dropped;        /* ... and dropped, the queue being full */
+    u_long          handled;        /* ... and processed by the main loop */
+    u_int           depth;          /* datagrams queued now */
+    u_int           max_depth;      /* ... and at most */
+    double          wait_usec;      /* total time spent queued */
+    u_long          max_wait_usec;
+    double          handle_usec;    /* total time spent processing */
+    u_long          max_handle_usec;
+} netsnmp_trapd_queue_stats;
+
+void snmptrapd_register_queue_configs(void);
+int  snmptrapd_queue_start(netsnmp_session *sess_list);
+void snmptrapd_queue_select_info(netsnmp_large_fd_set *readfds);
+void snmptrapd_queue_stop(void);
+void snmptrapd_queue_reconfig(void);
+int  snmptrapd_queue_get_stats(netsnmp_trapd_queue_stats *stats);
+void snmptrapd_queue_log_stats(void);
+
+#endif /* SNMPTRAPD_QUEUE_H */
@@ -9,6 +9,17 @@
  * This file implements a handler for snmptrapd which will cache incoming
  * traps and then write them to a MySQL database.
  *
+ * The handler only formats a trap and queues it.  Where threads are
+ * available, a flush thread writes the queue whenever it reaches
+ * sqlMaxQueue traps or sqlSaveInterval seconds have passed, so that the
+ * main loop never waits for the database; the traps that arrive while it
+ * writes are written together on its next pass.  Each pass inserts the
+ * traps, and then their varbinds, sqlBatchSize rows per INSERT, and
+ * commits once.
+ *
+ * Traps that cannot be written because the database cannot be reached are
+ * appended to the sqlSpool file, if there is one, and inserted from it once
+ * the database is back; otherwise they are logged, as before.
  */
 #include <net-snmp/net-snmp-config.h>
 #include <net-snmp/net-snmp-features.h>
@@ -47,7 +58,19 @@
 #include <strings.h>
 #endif
 #include <ctype.h>
+#include <errno.h>
+#include <signal.h>
 #include <sys/types.h>
+#ifdef TIME_WITH_SYS_TIME
+# include <sys/time.h>
+# include <time.h>
+#else
+# ifdef HAVE_SYS_TIME_H
+#  include <sys/time.h>
+# else
+#  include <time.h>
+# endif
+#endif
 #ifdef HAVE_NETINET_IN_H
 #include <netinet/in.h>
 #endif
@@ -62,8 +85,50 @@
 #include "snmptrapd_log.h"
 #include "snmptrapd_sql.h"
 
+#if defined(HAVE_PTHREAD_H) && defined(HAVE_PTHREAD_CREATE) && !defined(WIN32)
+#define SNMPTRAPD_SQL_THREADS 1
+#include <pthread.h>
+#define SQL_LOCK()      pthread_mutex_lock(&_sql.lock)
+#define SQL_UNLOCK()    pthread_mutex_unlock(&_sql.lock)
+#else
+#define SQL_LOCK()
+#define SQL_UNLOCK()
+#endif
+
 netsnmp_feature_require(container_fifo);
 
+/* default and largest number of rows per INSERT (sqlBatchSize) */
+#define SQL_BATCH_ROWS      100
+#define SQL_BATCH_ROWS_MAX  1000
+/* traps waiting to be written beyond which new ones are only logged */
+#define SQL_MAX_PENDING     100000
+
+/* spool records: a magic, then integers and length-prefixed strings */
+#define SQL_SPOOL_MAGIC     0x4e535131  /* "NSQ1" */
+#define SQL_SPOOL_NULL      0xffffffff  /* length of a NULL string */
+#define SQL_SPOOL_MAX_FIELD (1024 * 1024)
+
+/** counters of the sql sink */
+typedef struct netsnmp_sql_stats_t {
+    u_long       queued;          /* traps queued by the handler */
+    u_long       written;         /* traps committed to the database */
+    u_long       statements;      /* INSERT statements executed */
+    u_long       commits;
+    u_long       spooled;         /* traps appended to the spool */
+    u_long       replayed;        /* traps read back from the spool */
+    u_long       logged;          /* traps logged instead */
+} netsnmp_sql_stats;
+
+#ifdef SNMPTRAPD_SQL_THREADS
+/** a message of the flush thread, for the main thread to log */
+typedef struct sql_msg_t {
+    struct sql_msg_t *next;
+    const char  *token;           /* debug token, or NULL for snmp_log */
+    int          priority;
+    char        *text;
+} sql_msg;
+#endif
+
 /*
  * define a structure to hold all the file globals
  */
@@ -83,6 +148,25 @@ typedef struct netsnmp_sql_globals_t {
     netsnmp_container *queue;     /* container; traps pending database write */
     u_int        queue_max;       /* auto save queue when it gets this big */
     int          queue_interval;  /* auto save every N seconds */
+    u_int        batch_config;    /* rows per INSERT, from sqlBatchSize */
+    char        *spool_config;    /* spool file, from sqlSpool */
+    int          batch_rows;      /* rows per INSERT, fixed at init */
+    char        *spool;           /* spool file, fixed at init */
+    int          spool_pending;   /* the spool may hold traps */
+    u_long       id_increment;    /* auto_increment_increment of server */
+    struct sql_buf_t **rows;      /* the traps of one INSERT */
+    netsnmp_container *writing;   /* container; traps being written */
+    netsnmp_sql_stats stats;
+#ifdef SNMPTRAPD_SQL_THREADS
+    int          running;         /* the flush thread is running */
+    int          stopping;        /* ... and should write all and exit */
+    pthread_mutex_t lock;         /* protects queue, stopping, msgs, and
+                                     the queued and logged counts */
+    pthread_cond_t  cond;         /* signals the flush thread */
+    pthread_t    thread;
+    sql_msg     *msgs;            /* messages of the flush thread */
+    sql_msg    **msgs_tail;
+#endif
 } netsnmp_sql_globals;
 
 static netsnmp_sql_globals _sql = {
@@ -101,7 +185,9 @@ static netsnmp_sql_globals _sql = {
     0,                     /* alarm_id */
     NULL,                  /* queue */
     1,                     /* queue_max */
-    -1                     /* queue_interval */
+    -1,                    /* queue_interval */
+    SQL_BATCH_ROWS,        /* batch_config */
+    NULL                   /* spool_config */
 };
 
 /*
@@ -194,16 +280,35 @@ typedef struct sql_buf_t {
 
     netsnmp_container *varbinds;
 
+    uint32_t   trap_id;           /* id of the inserted notification */
+
     char       logged;
 } sql_buf;
 
 /*
- * static bind structures, plus 2 static buffers to bind to.
+ * bind structures for batch_rows rows of each statement, plus the v3
+ * null flags of the trap rows.
  */
-static MYSQL_BIND _tbind[TBIND_MAX], _vbind[VBIND_MAX];
-static typeof(*((MYSQL_BIND*)NULL)->is_null) _no_v3;
+static MYSQL_BIND *_tbind, *_vbind;
+static typeof(*((MYSQL_BIND*)NULL)->is_null) *_no_v3;
+
+static const char _trap_insert[] = "INSERT INTO notifications "
+    "(date_time, host, auth, type, version, request_id, snmpTrapOID, transport, security_model, v3msgid, v3security_level, v3context_name, v3context_engine, v3security_name, v3security_engine) "
+    "VALUES ";
+static const char _vb_insert[] = "INSERT INTO varbinds "
+    "(trap_id, oid, type, value) VALUES ";
 
 static void _sql_process_queue(u_int dontcare, void *meeither);
+static void _sql_buf_free(void *p, void* dontcare);
+static void _sql_log(void *p, void *dontcare);
+static void _sql_msg(int priority, const char *format, ...)
+    NETSNMP_ATTRIBUTE_FORMAT(printf, 2, 3);
+static void _sql_debug(const char *token, const char *format, ...)
+    NETSNMP_ATTRIBUTE_FORMAT(printf, 2, 3);
+#ifdef SNMPTRAPD_SQL_THREADS
+static void *_sql_flusher(void *arg);
+static void _sql_msgs_log(void);
+#endif
 
 /*
  * parse the sqlMaxQueue configuration token
@@ -226,6 +331,33 @@ _parse_interval_fmt(const char *token, char *cptr)
                 _sql.queue_interval));
 }
 
+/*
+ * parse the sqlBatchSize configuration token
+ */
+static void
+_parse_batch_fmt(const char *token, char *cptr)
+{
+    int rows = atoi(cptr);
+
+    if (rows < 1 || rows > SQL_BATCH_ROWS_MAX) {
+        config_perror("sqlBatchSize must be between 1 and 1000");
+        return;
+    }
+    _sql.batch_config = rows;
+    DEBUGMSGTL(("sql:queue","batch size now %d rows\n", rows));
+}
+
+/*
+ * parse the sqlSpool configuration token
+ */
+static void
+_parse_spool_fmt(const char *token, char *cptr)
+{
+    SNMP_FREE(_sql.spool_config);
+    _sql.spool_config = strdup(cptr);
+    DEBUGMSGTL(("sql:spool","spool file now %s\n", cptr));
+}
+
 /*
  * register sql related configuration tokens
  */
@@ -236,12 +368,116 @@ snmptrapd_register_sql_configs( void )
                             _parse_queue_fmt, NULL, "integer");
     register_config_handler("snmptrapd", "sqlSaveInterval",
                             _parse_interval_fmt, NULL, "seconds");
+    register_config_handler("snmptrapd", "sqlBatchSize",
+                            _parse_batch_fmt, NULL, "rows");
+    register_config_handler("snmptrapd", "sqlSpool",
+                            _parse_spool_fmt, NULL, "FILE");
+}
+
+/*
+ * log a message, or a debug message if token is set.  The flush thread
+ * must not log, so its messages are queued for the main thread.
+ */
+static void
+_sql_vmsg(const char *token, int priority, const char *format, va_list ap)
+{
+    char       *text = NULL;
+#ifdef SNMPTRAPD_SQL_THREADS
+    sql_msg    *msg;
+#endif
+
+    if (token && !snmp_get_do_debugging())
+        return;
+    if (vasprintf(&text, format, ap) < 0)
+        return;
+
+#ifdef SNMPTRAPD_SQL_THREADS
+    if (_sql.running && pthread_equal(pthread_self(), _sql.thread)) {
+        msg = SNMP_MALLOC_TYPEDEF(sql_msg);
+        if (NULL == msg) {
+            free(text);
+            return;
+        }
+        msg->token = token;
+        msg->priority = priority;
+        msg->text = text;
+        SQL_LOCK();
+        if (NULL == _sql.msgs_tail)
+            _sql.msgs_tail = &_sql.msgs;
+        *_sql.msgs_tail = msg;
+        _sql.msgs_tail = &msg->next;
+        SQL_UNLOCK();
+        return;
+    }
+#endif
+
+    if (token)
+        DEBUGMSGTL((token, "%s", text));
+    else
+        snmp_log(priority, "%s", text);
+    free(text);
+}
+
+static void
+_sql_msg(int priority, const char *format, ...)
+{
+    va_list     ap;
+
+    va_start(ap, format);
+    _sql_vmsg(NULL, priority, format, ap);
+    va_end(ap);
+}
+
+static void
+_sql_debug(const char *token, const char *format, ...)
+{
+    va_list     ap;
+
+    va_start(ap, format);
+    _sql_vmsg(token, LOG_DEBUG, format, ap);
+    va_end(ap);
+}
+
+#ifdef SNMPTRAPD_SQL_THREADS
+/*
+ * log the messages queued by the flush thread, from the main thread
+ */
+static void
+_sql_msgs_log(void)
+{
+    sql_msg    *msg, *next;
+
+    SQL_LOCK();
+    msg = _sql.msgs;
+    _sql.msgs = NULL;
+    _sql.msgs_tail = &_sql.msgs;
+    SQL_UNLOCK();
+
+    for (; msg; msg = next) {
+        next = msg->next;
+        if (msg->token)
+            DEBUGMSGTL((msg->token, "%s", msg->text));
+        else
+            snmp_log(msg->priority, "%s", msg->text);
+        free(msg->text);
+        free(msg);
+    }
+}
+
+/*
+ * alarm callback: log what the flush thread has to report
+ */
+static void
+_sql_report(u_int dontcare, void *meeither)
+{
+    _sql_msgs_log();
 }
+#endif
 
 static void
 netsnmp_sql_disconnected(void)
 {
-    DEBUGMSGTL(("sql:connection","disconnected\n"));
+    _sql_debug("sql:connection","disconnected\n");
 
     _sql.connected = 0;
 
@@ -272,13 +508,13 @@ netsnmp_sql_error(const char *message)
     u_int err = mysql_errno(_sql.conn);
 
     if (0 == _sql.connected || !netsnmp_sql_server_disconnected(err)) {
-        snmp_log(LOG_ERR, "%s\n", message);
+        _sql_msg(LOG_ERR, "%s\n", message);
         if (_sql.conn != NULL) {
 #if MYSQL_VERSION_ID >= 40101
-            snmp_log(LOG_ERR, "Error %u (%s): %s\n",
+            _sql_msg(LOG_ERR, "Error %u (%s): %s\n",
                      err, mysql_sqlstate(_sql.conn), mysql_error(_sql.conn));
 #else
-            snmp(LOG_ERR, "Error %u: %s\n",
+            _sql_msg(LOG_ERR, "Error %u: %s\n",
                  mysql_errno(_sql.conn), mysql_error(_sql.conn));
 #endif
         }
@@ -296,9 +532,9 @@ netsnmp_sql_stmt_error (MYSQL_STMT *stmt, const char *message)
     u_int err = mysql_errno(_sql.conn);
 
     if (0 == _sql.connected || !netsnmp_sql_server_disconnected(err)) {
-        snmp_log(LOG_ERR, "%s\n", message);
+        _sql_msg(LOG_ERR, "%s\n", message);
         if (stmt) {
-            snmp_log(LOG_ERR, "SQL Error %u (%s): %s\n",
+            _sql_msg(LOG_ERR, "SQL Error %u (%s): %s\n",
                      mysql_stmt_errno(stmt), mysql_stmt_sqlstate(stmt),
                      mysql_stmt_error(stmt));
         }
@@ -315,6 +551,19 @@ netsnmp_mysql_cleanup(void)
 {
     DEBUGMSGTL(("sql:cleanup"," called\n"));
 
+#ifdef SNMPTRAPD_SQL_THREADS
+    /** the flush thread writes what is queued before it exits */
+    if (_sql.running) {
+        SQL_LOCK();
+        _sql.stopping = 1;
+        pthread_cond_signal(&_sql.cond);
+        SQL_UNLOCK();
+        pthread_join(_sql.thread, NULL);
+        _sql.running = 0;
+    }
+    _sql_msgs_log();
+#endif
+
     /** unregister alarm */
     if (_sql.alarm_id)
         snmp_alarm_unregister(_sql.alarm_id);
@@ -323,8 +572,16 @@ netsnmp_mysql_cleanup(void)
     if (CONTAINER_SIZE(_sql.queue))
         _sql_process_queue(0,NULL);
 
+    snmp_log(LOG_INFO, "sql: %lu traps queued, %lu written with %lu "
+             "statements and %lu commits, %lu spooled, %lu replayed, "
+             "%lu logged\n", _sql.stats.queued, _sql.stats.written,
+             _sql.stats.statements, _sql.stats.commits, _sql.stats.spooled,
+             _sql.stats.replayed, _sql.stats.logged);
+
     CONTAINER_FREE(_sql.queue);
     _sql.queue = NULL;
+    CONTAINER_FREE(_sql.writing);
+    _sql.writing = NULL;
 
     /** disconnect from server */
     netsnmp_sql_disconnected();
@@ -334,35 +591,97 @@ netsnmp_mysql_cleanup(void)
         _sql.conn = NULL;
     }
 
+    SNMP_FREE(_tbind);
+    SNMP_FREE(_vbind);
+    SNMP_FREE(_no_v3);
+    SNMP_FREE(_sql.rows);
+    SNMP_FREE(_sql.spool);
+
+#ifdef SNMPTRAPD_SQL_THREADS
+    pthread_cond_destroy(&_sql.cond);
+    pthread_mutex_destroy(&_sql.lock);
+#endif
+
     mysql_library_end();
 }
 
 /*
- * setup (initialize, prepare and bind) a prepared statement
+ * initialize and prepare an INSERT of rows rows of columns values each
  */
 static int
-netsnmp_mysql_bind(const char *text, size_t text_size, MYSQL_STMT **stmt,
-                   MYSQL_BIND *bind)
+netsnmp_mysql_bind(const char *insert, int columns, int rows,
+                   MYSQL_STMT **stmt)
 {
-    if ((NULL == text) || (NULL == stmt) || (NULL == bind)) {
-        snmp_log(LOG_ERR,"invalid parameters to netsnmp_mysql_bind()\n");
+    char   *text, *cp;
+    int     r, c, rc = -1;
+
+    if ((NULL == insert) || (NULL == stmt) || (rows < 1)) {
+        _sql_msg(LOG_ERR,"invalid parameters to netsnmp_mysql_bind()\n");
         return -1;
     }
 
+    /** "(?,...,?)" for each row, separated by commas */
+    text = (char *) malloc(strlen(insert) + rows * (2 * columns + 2) + 1);
+    if (NULL == text) {
+        _sql_msg(LOG_ERR,"could not allocate INSERT statement\n");
+        return -1;
+    }
+    strcpy(text, insert);
+    cp = text + strlen(text);
+    for (r = 0; r < rows; r++) {
+        if (r)
+            *cp++ = ',';
+        *cp++ = '(';
+        for (c = 0; c < columns; c++) {
+            if (c)
+                *cp++ = ',';
+            *cp++ = '?';
+        }
+        *cp++ = ')';
+    }
+    *cp = '\0';
+
     *stmt = mysql_stmt_init(_sql.conn);
     if (NULL == *stmt) {
         netsnmp_sql_error("could not initialize trap statement handler");
-        return -1;
+        goto out;
     }
 
-    if (mysql_stmt_prepare(*stmt, text, text_size) != 0) {
+    if (mysql_stmt_prepare(*stmt, text, cp - text) != 0) {
         netsnmp_sql_stmt_error(*stmt, "Could not prepare INSERT");
         mysql_stmt_close(*stmt);
         *stmt = NULL;
-        return -1;
+        goto out;
     }
+    rc = 0;
 
-    return 0;
+  out:
+    free(text);
+    return rc;
+}
+
+/*
+ * find the step between the ids of the rows of one INSERT
+ */
+static u_long
+netsnmp_mysql_id_increment(void)
+{
+    MYSQL_RES  *res;
+    MYSQL_ROW   row;
+    u_long      increment = 1;
+
+    if (mysql_query(_sql.conn, "SELECT @@session.auto_increment_increment")) {
+        netsnmp_sql_error("could not query auto_increment_increment");
+        return 1;
+    }
+    res = mysql_store_result(_sql.conn);
+    if (NULL == res)
+        return 1;
+    row = mysql_fetch_row(res);
+    if (row && row[0] && atol(row[0]) > 0)
+        increment = atol(row[0]);
+    mysql_free_result(res);
+    return increment;
 }
 
 /*
@@ -371,17 +690,11 @@ netsnmp_mysql_bind(const char *text, size_t text_size, MYSQL_STMT **stmt,
 static int
 netsnmp_mysql_connect(void)
 {
-    char trap_stmt[] = "INSERT INTO notifications "
-        "(date_time, host, auth, type, version, request_id, snmpTrapOID, transport, security_model, v3msgid, v3security_level, v3context_name, v3context_engine, v3security_name, v3security_engine) "
-        "VALUES(?,?,?,?,?,?,?,?,?,?,?,?,?,?,?)";
-    char vb_stmt[] = "INSERT INTO varbinds "
-        "(trap_id, oid, type, value) VALUES (?,?,?,?)";
-
     /** initialize connection handler */
     if (_sql.connected)
         return 0;
 
-    DEBUGMSGTL(("sql:connection","connecting\n"));
+    _sql_debug("sql:connection","connecting\n");
 
     if (_sql.conn) {
         mysql_close(_sql.conn);
@@ -415,13 +728,21 @@ netsnmp_mysql_connect(void)
 
     netsnmp_assert((_sql.trap_stmt == NULL) && (_sql.vb_stmt == NULL));
 
-    /** prepared statement for inserts */
-    if (0 != netsnmp_mysql_bind(trap_stmt,sizeof(trap_stmt), &_sql.trap_stmt,
-                                _tbind))
+    /*
+     * the rows of one INSERT get consecutive ids, this far apart, since
+     * their number is known in advance
+     */
+    _sql.id_increment = netsnmp_mysql_id_increment();
+    if (0 == _sql.connected)
+        goto err;
+
+    /** prepared statements for full batches of inserts */
+    if (0 != netsnmp_mysql_bind(_trap_insert, TBIND_MAX, _sql.batch_rows,
+                                &_sql.trap_stmt))
         goto err;
 
-    if (0 != netsnmp_mysql_bind(vb_stmt,sizeof(vb_stmt),&_sql.vb_stmt,
-                                _vbind)) {
+    if (0 != netsnmp_mysql_bind(_vb_insert, VBIND_MAX, _sql.batch_rows,
+                                &_sql.vb_stmt)) {
         mysql_stmt_close(_sql.trap_stmt);
         _sql.trap_stmt = NULL;
         goto err;
@@ -441,6 +762,7 @@ int
 netsnmp_mysql_init(void)
 {
     netsnmp_trapd_handler *traph;
+    int                    r;
 
     DEBUGMSGTL(("sql:init","called\n"));
 
@@ -451,11 +773,12 @@ netsnmp_mysql_init(void)
         return 0;
     }
 
-    /** create queue for storing traps til they are written to the db */
+    /** create queues for storing traps til they are written to the db */
     _sql.queue = netsnmp_container_find("fifo");
-    if (NULL == _sql.queue) {
+    _sql.writing = netsnmp_container_find("fifo");
+    if ((NULL == _sql.queue) || (NULL == _sql.writing)) {
         snmp_log(LOG_ERR, "Could not allocate sql buf container\n");
-        return -1;
+        goto err;
     }
 
 #if defined(HAVE_MYSQL_INIT)
@@ -502,98 +825,151 @@ netsnmp_mysql_init(void)
     }
 #endif /* !defined(HAVE_MYSQL_OPTIONS) */
 
-    /** init bind structures */
-    memset(_tbind, 0x0, sizeof(_tbind));
-    memset(_vbind, 0x0, sizeof(_vbind));
-
-    /** trap static bindings */
-    _tbind[TBIND_HOST].buffer_type = MYSQL_TYPE_STRING;
-    _tbind[TBIND_HOST].length = &_tbind[TBIND_HOST].buffer_length;
-
-    _tbind[TBIND_OID].buffer_type = MYSQL_TYPE_STRING;
-    _tbind[TBIND_OID].length = &_tbind[TBIND_OID].buffer_length;
-
-    _tbind[TBIND_REQID].buffer_type = MYSQL_TYPE_LONG;
-    _tbind[TBIND_REQID].is_unsigned = 1;
-
-    _tbind[TBIND_VER].buffer_type = MYSQL_TYPE_SHORT;
-    _tbind[TBIND_VER].is_unsigned = 1;
-
-    _tbind[TBIND_TYPE].buffer_type = MYSQL_TYPE_SHORT;
-    _tbind[TBIND_TYPE].is_unsigned = 1;
-
-    _tbind[TBIND_DATE].buffer_type = MYSQL_TYPE_DATETIME;
-
-    _tbind[TBIND_USER].buffer_type = MYSQL_TYPE_STRING;
-    _tbind[TBIND_USER].length = &_tbind[TBIND_USER].buffer_length;
-
-    _tbind[TBIND_TRANSPORT].buffer_type = MYSQL_TYPE_STRING;
-    _tbind[TBIND_TRANSPORT].length = &_tbind[TBIND_TRANSPORT].buffer_length;
-
-    _tbind[TBIND_SECURITY_MODEL].buffer_type = MYSQL_TYPE_SHORT;
-    _tbind[TBIND_SECURITY_MODEL].is_unsigned = 1;
-
-    _tbind[TBIND_v3_MSGID].buffer_type = MYSQL_TYPE_LONG;
-    _tbind[TBIND_v3_MSGID].is_unsigned = 1;
-    _tbind[TBIND_v3_SECURITY_LEVEL].buffer_type = MYSQL_TYPE_SHORT;
-    _tbind[TBIND_v3_SECURITY_LEVEL].is_unsigned = 1;
-    _tbind[TBIND_v3_CONTEXT_NAME].buffer_type = MYSQL_TYPE_STRING;
-    _tbind[TBIND_v3_CONTEXT_ENGINE].buffer_type = MYSQL_TYPE_STRING;
-    _tbind[TBIND_v3_SECURITY_NAME].buffer_type = MYSQL_TYPE_STRING;
-    _tbind[TBIND_v3_SECURITY_NAME].length =
-        &_tbind[TBIND_v3_SECURITY_NAME].buffer_length;
-    _tbind[TBIND_v3_CONTEXT_NAME].length =
-        &_tbind[TBIND_v3_CONTEXT_NAME].buffer_length;
-    _tbind[TBIND_v3_SECURITY_ENGINE].buffer_type = MYSQL_TYPE_STRING;
-    _tbind[TBIND_v3_SECURITY_ENGINE].length =
-        &_tbind[TBIND_v3_SECURITY_ENGINE].buffer_length;
-    _tbind[TBIND_v3_CONTEXT_ENGINE].length =
-        &_tbind[TBIND_v3_CONTEXT_ENGINE].buffer_length;
-
-    _tbind[TBIND_v3_MSGID].is_null =
-        _tbind[TBIND_v3_SECURITY_LEVEL].is_null =
-        _tbind[TBIND_v3_CONTEXT_NAME].is_null =
-        _tbind[TBIND_v3_CONTEXT_ENGINE].is_null =
-        _tbind[TBIND_v3_SECURITY_NAME].is_null =
-        _tbind[TBIND_v3_SECURITY_ENGINE].is_null = &_no_v3;
-    
-    /** variable static bindings */
-    _vbind[VBIND_ID].buffer_type = MYSQL_TYPE_LONG;
-    _vbind[VBIND_ID].is_unsigned = 1;
+    /** init bind structures, for batch_rows rows of each statement */
+    _sql.batch_rows = _sql.batch_config;
+    _tbind = (MYSQL_BIND *) calloc(_sql.batch_rows * TBIND_MAX,
+                                   sizeof(MYSQL_BIND));
+    _vbind = (MYSQL_BIND *) calloc(_sql.batch_rows * VBIND_MAX,
+                                   sizeof(MYSQL_BIND));
+    _no_v3 = calloc(_sql.batch_rows, sizeof(*_no_v3));
+    _sql.rows = (sql_buf **) calloc(_sql.batch_rows, sizeof(sql_buf *));
+    if (!_tbind || !_vbind || !_no_v3 || !_sql.rows) {
+        snmp_log(LOG_ERR, "Could not allocate sql bind structures\n");
+        goto err;
+    }
+
+    for (r = 0; r < _sql.batch_rows; r++) {
+        MYSQL_BIND *tb = &_tbind[r * TBIND_MAX];
+        MYSQL_BIND *vb = &_vbind[r * VBIND_MAX];
+
+        /** trap static bindings */
+        tb[TBIND_HOST].buffer_type = MYSQL_TYPE_STRING;
+        tb[TBIND_HOST].length = &tb[TBIND_HOST].buffer_length;
+
+        tb[TBIND_OID].buffer_type = MYSQL_TYPE_STRING;
+        tb[TBIND_OID].length = &tb[TBIND_OID].buffer_length;
+
+        tb[TBIND_REQID].buffer_type = MYSQL_TYPE_LONG;
+        tb[TBIND_REQID].is_unsigned = 1;
 
-    _vbind[VBIND_OID].buffer_type = MYSQL_TYPE_STRING;
-    _vbind[VBIND_OID].length = &_vbind[VBIND_OID].buffer_length;
+        tb[TBIND_VER].buffer_type = MYSQL_TYPE_SHORT;
+        tb[TBIND_VER].is_unsigned = 1;
 
-    _vbind[VBIND_TYPE].buffer_type = MYSQL_TYPE_SHORT;
-    _vbind[VBIND_TYPE].is_unsigned = 1;
+        tb[TBIND_TYPE].buffer_type = MYSQL_TYPE_SHORT;
+        tb[TBIND_TYPE].is_unsigned = 1;
+
+        tb[TBIND_DATE].buffer_type = MYSQL_TYPE_DATETIME;
+
+        tb[TBIND_USER].buffer_type = MYSQL_TYPE_STRING;
+        tb[TBIND_USER].length = &tb[TBIND_USER].buffer_length;
+
+        tb[TBIND_TRANSPORT].buffer_type = MYSQL_TYPE_STRING;
+        tb[TBIND_TRANSPORT].length = &tb[TBIND_TRANSPORT].buffer_length;
+
+        tb[TBIND_SECURITY_MODEL].buffer_type = MYSQL_TYPE_SHORT;
+        tb[TBIND_SECURITY_MODEL].is_unsigned = 1;
+
+        tb[TBIND_v3_MSGID].buffer_type = MYSQL_TYPE_LONG;
+        tb[TBIND_v3_MSGID].is_unsigned = 1;
+        tb[TBIND_v3_SECURITY_LEVEL].buffer_type = MYSQL_TYPE_SHORT;
+        tb[TBIND_v3_SECURITY_LEVEL].is_unsigned = 1;
+        tb[TBIND_v3_CONTEXT_NAME].buffer_type = MYSQL_TYPE_STRING;
+        tb[TBIND_v3_CONTEXT_ENGINE].buffer_type = MYSQL_TYPE_STRING;
+        tb[TBIND_v3_SECURITY_NAME].buffer_type = MYSQL_TYPE_STRING;
+        tb[TBIND_v3_SECURITY_NAME].length =
+            &tb[TBIND_v3_SECURITY_NAME].buffer_length;
+        tb[TBIND_v3_CONTEXT_NAME].length =
+            &tb[TBIND_v3_CONTEXT_NAME].buffer_length;
+        tb[TBIND_v3_SECURITY_ENGINE].buffer_type = MYSQL_TYPE_STRING;
+        tb[TBIND_v3_SECURITY_ENGINE].length =
+            &tb[TBIND_v3_SECURITY_ENGINE].buffer_length;
+        tb[TBIND_v3_CONTEXT_ENGINE].length =
+            &tb[TBIND_v3_CONTEXT_ENGINE].buffer_length;
+
+        tb[TBIND_v3_MSGID].is_null =
+            tb[TBIND_v3_SECURITY_LEVEL].is_null =
+            tb[TBIND_v3_CONTEXT_NAME].is_null =
+            tb[TBIND_v3_CONTEXT_ENGINE].is_null =
+            tb[TBIND_v3_SECURITY_NAME].is_null =
+            tb[TBIND_v3_SECURITY_ENGINE].is_null = &_no_v3[r];
+
+        /** variable static bindings */
+        vb[VBIND_ID].buffer_type = MYSQL_TYPE_LONG;
+        vb[VBIND_ID].is_unsigned = 1;
+
+        vb[VBIND_OID].buffer_type = MYSQL_TYPE_STRING;
+        vb[VBIND_OID].length = &vb[VBIND_OID].buffer_length;
+
+        vb[VBIND_TYPE].buffer_type = MYSQL_TYPE_SHORT;
+        vb[VBIND_TYPE].is_unsigned = 1;
 
 #ifdef NETSNMP_MYSQL_TRAP_VALUE_TEXT
-    _vbind[VBIND_VAL].buffer_type = MYSQL_TYPE_STRING;
+        vb[VBIND_VAL].buffer_type = MYSQL_TYPE_STRING;
 #else
-    _vbind[VBIND_VAL].buffer_type = MYSQL_TYPE_BLOB;
+        vb[VBIND_VAL].buffer_type = MYSQL_TYPE_BLOB;
 #endif
-    _vbind[VBIND_VAL].length = &_vbind[VBIND_VAL].buffer_length;
+        vb[VBIND_VAL].length = &vb[VBIND_VAL].buffer_length;
+    }
+
+    /** traps left in the spool by an earlier run are written first */
+    if (_sql.spool_config) {
+        char replay[SNMP_MAXPATH];
+
+        _sql.spool = strdup(_sql.spool_config);
+        snprintf(replay, sizeof(replay), "%s.replay", _sql.spool);
+        _sql.spool_pending = (access(_sql.spool, F_OK) == 0 ||
+                              access(replay, F_OK) == 0);
+    }
 
     /** try to connect; we'll try again later if we fail */
     (void) netsnmp_mysql_connect();
 
-    /** register periodic queue save */
-    _sql.alarm_id = snmp_alarm_register(_sql.queue_interval, /* seconds */
-                                        1,                   /* repeat */
-                                        _sql_process_queue,  /* function */
-                                        NULL);               /* client args */
-
     /** add handler */
     traph = netsnmp_add_global_traphandler(NETSNMPTRAPD_PRE_HANDLER,
                                            mysql_handler);
     if (NULL == traph) {
         snmp_log(LOG_ERR, "Could not allocate sql trap handler\n");
-        return -1;
+        goto err;
     }
     traph->authtypes = TRAP_AUTH_LOG;
 
+#ifdef SNMPTRAPD_SQL_THREADS
+    /** start the flush thread, or save the queue from the main loop */
+    pthread_mutex_init(&_sql.lock, NULL);
+    pthread_cond_init(&_sql.cond, NULL);
+    /** the thread waits for _sql.thread and running to be set */
+    SQL_LOCK();
+    if (pthread_create(&_sql.thread, NULL, _sql_flusher, NULL) == 0)
+        _sql.running = 1;
+    SQL_UNLOCK();
+    if (0 == _sql.running)
+        snmp_log(LOG_WARNING, "Could not start the sql flush thread\n");
+    else
+        /** log what the thread has to report as often as it writes */
+        _sql.alarm_id = snmp_alarm_register(_sql.queue_interval, 1,
+                                            _sql_report, NULL);
+    if (0 == _sql.running)
+#endif
+    /** register periodic queue save */
+    _sql.alarm_id = snmp_alarm_register(_sql.queue_interval, /* seconds */
+                                        1,                   /* repeat */
+                                        _sql_process_queue,  /* function */
+                                        NULL);               /* client args */
+
     atexit(netsnmp_mysql_cleanup);
     return 0;
+
+  err:
+    CONTAINER_FREE(_sql.queue);
+    _sql.queue = NULL;
+    CONTAINER_FREE(_sql.writing);
+    _sql.writing = NULL;
+    SNMP_FREE(_tbind);
+    SNMP_FREE(_vbind);
+    SNMP_FREE(_no_v3);
+    SNMP_FREE(_sql.rows);
+    SNMP_FREE(_sql.spool);
+    return -1;
 }
 
 /*
@@ -616,7 +992,7 @@ _sql_log(void *p, void *dontcare)
      * nothing done to protect against data insertion attacks with
      * respect to bad data (commas, newlines, etc)
      */
-    snmp_log(LOG_ERR,
+    _sql_msg(LOG_ERR,
              "trap:%d-%d-%d %d:%d:%d,%s,%d,%d,%d,%s,%s,%d,%d,%d,%s,%s,%s,%s\n",
              sqlb->time.year,sqlb->time.month,sqlb->time.day,
              sqlb->time.hour,sqlb->time.minute,sqlb->time.second,
@@ -628,10 +1004,13 @@ _sql_log(void *p, void *dontcare)
              sqlb->security_engine);
 
     sqlb->logged = 1; /* prevent multiple logging */
+    SQL_LOCK();
+    _sql.stats.logged++;
+    SQL_UNLOCK();
 
     it = CONTAINER_ITERATOR(sqlb->varbinds);
     if (NULL == it) {
-        snmp_log(LOG_ERR,
+        _sql_msg(LOG_ERR,
                  "error creating iterator; incomplete trap logged\n");
         return;
     }
@@ -639,17 +1018,17 @@ _sql_log(void *p, void *dontcare)
     /** log varbind info */
     for( sqlvb = ITERATOR_FIRST(it); sqlvb; sqlvb = ITERATOR_NEXT(it)) {
 #ifdef NETSNMP_MYSQL_TRAP_VALUE_TEXT
-        snmp_log(LOG_ERR,"varbind:%s,%s\n", sqlvb->oid, sqlvb->val);
+        _sql_msg(LOG_ERR,"varbind:%s,%s\n", sqlvb->oid, sqlvb->val);
 #else
         char *hex;
-        int len = binary_to_hex(sqlvb->val, sqlvb->val_len, &hex);
+        binary_to_hex(sqlvb->val, sqlvb->val_len, &hex);
         if (hex) {
-            snmp_log(LOG_ERR,"varbind:%d,%s,%s\n", sqlvb->oid, hex);
+            _sql_msg(LOG_ERR,"varbind:%s,%s\n", sqlvb->oid, hex);
             free(hex);
         }
         else {
-            snmp_log(LOG_ERR,"malloc failed for varbind hex value\n");
-            snmp_log(LOG_ERR,"varbind:%s,\n", sqlvb->oid);
+            _sql_msg(LOG_ERR,"malloc failed for varbind hex value\n");
+            _sql_msg(LOG_ERR,"varbind:%s,\n", sqlvb->oid);
         }
 #endif
     }
@@ -945,6 +1324,7 @@ mysql_handler(netsnmp_pdu           *pdu,
 {
     sql_buf     *sqlb;
     int          old_format, rc;
+    size_t       pending;
 
     DEBUGMSGTL(("sql:handler", "called\n"));
 
@@ -969,8 +1349,19 @@ mysql_handler(netsnmp_pdu           *pdu,
     netsnmp_ds_set_int(NETSNMP_DS_LIBRARY_ID, NETSNMP_DS_LIB_OID_OUTPUT_FORMAT,
                        old_format);
 
-    /** insert into queue */
-    rc = CONTAINER_INSERT(_sql.queue, sqlb);
+    /** insert into queue, unless too many traps are waiting already */
+    SQL_LOCK();
+    pending = CONTAINER_SIZE(_sql.queue);
+    if (pending >= SQL_MAX_PENDING)
+        rc = -1;
+    else {
+        rc = CONTAINER_INSERT(_sql.queue, sqlb);
+        if (0 == rc) {
+            ++pending;
+            _sql.stats.queued++;
+        }
+    }
+    SQL_UNLOCK();
     if(rc) {
         snmp_log(LOG_ERR, "Could not log queue sql trap buffer\n");
         _sql_log(sqlb, NULL);
@@ -979,180 +1370,647 @@ mysql_handler(netsnmp_pdu           *pdu,
     }
 
     /** save queue if size is > max */
-    if (CONTAINER_SIZE(_sql.queue) >= _sql.queue_max)
+    if (pending >= _sql.queue_max) {
+#ifdef SNMPTRAPD_SQL_THREADS
+        if (_sql.running)
+            pthread_cond_signal(&_sql.cond);
+        else
+#endif
         _sql_process_queue(0,NULL);
+    }
 
     return 0;
 }
 
 /*
- * save a buffered trap to sql database
+ * bind a buffered trap to one row of the trap INSERT
  */
 static void
-_sql_save(void *p, void *dontcare)
+_sql_bind_trap(MYSQL_BIND *tb, typeof(*_no_v3) *no_v3, sql_buf *sqlb)
 {
-    sql_buf              *sqlb = p;
-    netsnmp_iterator     *it;
-    sql_vb_buf           *sqlvb;
-    u_long                trap_id;
-
-    /*
-     * don't even try if we don't have a database connection
-     */
-    if (0 == _sql.connected) {
-        _sql_log(sqlb, NULL);
-        return;
-    }
-
     /*
      * the prepared statements are bound to the static buffer objects,
      * so copy the queued data to the static version.
      */
-    _tbind[TBIND_HOST].buffer = sqlb->host;
-    _tbind[TBIND_HOST].buffer_length = sqlb->host_len;
+    tb[TBIND_HOST].buffer = sqlb->host;
+    tb[TBIND_HOST].buffer_length = sqlb->host_len;
 
-    _tbind[TBIND_OID].buffer = sqlb->oid;
-    _tbind[TBIND_OID].buffer_length = sqlb->oid_len;
+    tb[TBIND_OID].buffer = sqlb->oid;
+    tb[TBIND_OID].buffer_length = sqlb->oid_len;
 
-    _tbind[TBIND_REQID].buffer = (void *)&sqlb->reqid;
-    _tbind[TBIND_VER].buffer = (void *)&sqlb->version;
-    _tbind[TBIND_TYPE].buffer = (void *)&sqlb->type;
-    _tbind[TBIND_SECURITY_MODEL].buffer = (void *)&sqlb->security_model;
+    tb[TBIND_REQID].buffer = (void *)&sqlb->reqid;
+    tb[TBIND_VER].buffer = (void *)&sqlb->version;
+    tb[TBIND_TYPE].buffer = (void *)&sqlb->type;
+    tb[TBIND_SECURITY_MODEL].buffer = (void *)&sqlb->security_model;
 
-    _tbind[TBIND_DATE].buffer = (void *)&sqlb->time;
+    tb[TBIND_DATE].buffer = (void *)&sqlb->time;
 
-    _tbind[TBIND_USER].buffer = sqlb->user;
-    _tbind[TBIND_USER].buffer_length = sqlb->user_len;
+    tb[TBIND_USER].buffer = sqlb->user;
+    tb[TBIND_USER].buffer_length = sqlb->user_len;
 
-    _tbind[TBIND_TRANSPORT].buffer = sqlb->transport;
+    tb[TBIND_TRANSPORT].buffer = sqlb->transport;
     if (sqlb->transport)
-        _tbind[TBIND_TRANSPORT].buffer_length = strlen(sqlb->transport);
+        tb[TBIND_TRANSPORT].buffer_length = strlen(sqlb->transport);
     else
-        _tbind[TBIND_TRANSPORT].buffer_length = 0;
+        tb[TBIND_TRANSPORT].buffer_length = 0;
 
 
     if ((SNMP_MP_MODEL_SNMPv3+1) == sqlb->version) {
-        _no_v3 = 0;
+        *no_v3 = 0;
 
-        _tbind[TBIND_v3_MSGID].buffer = &sqlb->msgid;
+        tb[TBIND_v3_MSGID].buffer = &sqlb->msgid;
         
-        _tbind[TBIND_v3_SECURITY_LEVEL].buffer = &sqlb->security_level;
+        tb[TBIND_v3_SECURITY_LEVEL].buffer = &sqlb->security_level;
         
-        _tbind[TBIND_v3_CONTEXT_NAME].buffer = sqlb->context;
-        _tbind[TBIND_v3_CONTEXT_NAME].buffer_length = sqlb->context_len;
+        tb[TBIND_v3_CONTEXT_NAME].buffer = sqlb->context;
+        tb[TBIND_v3_CONTEXT_NAME].buffer_length = sqlb->context_len;
 
-        _tbind[TBIND_v3_CONTEXT_ENGINE].buffer = sqlb->context_engine;
-        _tbind[TBIND_v3_CONTEXT_ENGINE].buffer_length =
+        tb[TBIND_v3_CONTEXT_ENGINE].buffer = sqlb->context_engine;
+        tb[TBIND_v3_CONTEXT_ENGINE].buffer_length =
             sqlb->context_engine_len;
 
-        _tbind[TBIND_v3_SECURITY_NAME].buffer = sqlb->security_name;
-        _tbind[TBIND_v3_SECURITY_NAME].buffer_length = sqlb->security_name_len;
+        tb[TBIND_v3_SECURITY_NAME].buffer = sqlb->security_name;
+        tb[TBIND_v3_SECURITY_NAME].buffer_length = sqlb->security_name_len;
 
-        _tbind[TBIND_v3_SECURITY_ENGINE].buffer = sqlb->security_engine;
-        _tbind[TBIND_v3_SECURITY_ENGINE].buffer_length =
+        tb[TBIND_v3_SECURITY_ENGINE].buffer = sqlb->security_engine;
+        tb[TBIND_v3_SECURITY_ENGINE].buffer_length =
             sqlb->security_engine_len;
     }
     else {
-        _no_v3 = 1;
+        *no_v3 = 1;
     }
+}
 
-    if (mysql_stmt_bind_param(_sql.trap_stmt, _tbind) != 0) {
-        netsnmp_sql_stmt_error(_sql.trap_stmt,
-                               "Could not bind parameters for INSERT");
-        _sql_log(sqlb, NULL);
-        return;
-    }
+/*
+ * bind a varbind of a buffered trap to one row of the varbind INSERT
+ */
+static void
+_sql_bind_varbind(MYSQL_BIND *vb, sql_buf *sqlb, sql_vb_buf *sqlvb)
+{
+    vb[VBIND_ID].buffer = (void *)&sqlb->trap_id;
+    vb[VBIND_TYPE].buffer = (void *)&sqlvb->type;
 
-    /** execute the prepared statement */
-    if (mysql_stmt_execute(_sql.trap_stmt) != 0) {
-        netsnmp_sql_stmt_error(_sql.trap_stmt,
-                               "Could not execute insert statement for trap");
-        _sql_log(sqlb, NULL);
-        return;
+    vb[VBIND_OID].buffer = sqlvb->oid;
+    vb[VBIND_OID].buffer_length = sqlvb->oid_len;
+
+    vb[VBIND_VAL].buffer = sqlvb->val;
+    vb[VBIND_VAL].buffer_length = sqlvb->val_len;
+}
+
+/*
+ * execute an INSERT of rows rows, with the prepared statement if they
+ * are a full batch, or else with one prepared for them.
+ *
+ * return 0 on success, anything else is an error
+ */
+static int
+_sql_execute(MYSQL_STMT *batch_stmt, const char *insert, int columns,
+             MYSQL_BIND *bind, int rows, const char *message)
+{
+    MYSQL_STMT *stmt = batch_stmt;
+    int         rc = -1;
+
+    /** the statements go with the connection */
+    if (0 == _sql.connected)
+        return -1;
+
+    if ((rows != _sql.batch_rows) &&
+        (0 != netsnmp_mysql_bind(insert, columns, rows, &stmt)))
+        return -1;
+    if (NULL == stmt)
+        return -1;
+
+    if (mysql_stmt_bind_param(stmt, bind) != 0)
+        netsnmp_sql_stmt_error(stmt, "Could not bind parameters for INSERT");
+    else if (mysql_stmt_execute(stmt) != 0)
+        netsnmp_sql_stmt_error(stmt, message);
+    else {
+        _sql.stats.statements++;
+        rc = 0;
     }
+
+    if (stmt != batch_stmt)
+        mysql_stmt_close(stmt);
+    return rc;
+}
+
+/*
+ * insert the first n traps of _sql.rows, and then their varbinds,
+ * batch_rows rows per INSERT.
+ *
+ * return 0 on success, anything else is an error
+ */
+static int
+_sql_insert_rows(int n)
+{
+    netsnmp_iterator     *it;
+    sql_vb_buf           *sqlvb;
+    u_long                trap_id;
+    int                   i, rows = 0, rc = 0;
+
+    for (i = 0; i < n; i++)
+        _sql_bind_trap(&_tbind[i * TBIND_MAX], &_no_v3[i], _sql.rows[i]);
+    if (0 != _sql_execute(_sql.trap_stmt, _trap_insert, TBIND_MAX, _tbind, n,
+                          "Could not execute insert statement for trap"))
+        return -1;
+
+    /** the id of the first row is returned, and the others follow it */
     trap_id = mysql_insert_id(_sql.conn);
 
+    for (i = 0; (i < n) && (0 == rc); i++) {
+        _sql.rows[i]->trap_id = trap_id;
+        trap_id += _sql.id_increment;
+
+        it = CONTAINER_ITERATOR(_sql.rows[i]->varbinds);
+        if (NULL == it) {
+            _sql_msg(LOG_ERR,"Could not allocate iterator\n");
+            return -1;
+        }
+        for (sqlvb = ITERATOR_FIRST(it); sqlvb && (0 == rc);
+             sqlvb = ITERATOR_NEXT(it)) {
+            _sql_bind_varbind(&_vbind[rows * VBIND_MAX], _sql.rows[i], sqlvb);
+            if (++rows < _sql.batch_rows)
+                continue;
+            rc = _sql_execute(_sql.vb_stmt, _vb_insert, VBIND_MAX, _vbind,
+                              rows,
+                              "Could not execute insert statement for varbind");
+            rows = 0;
+        }
+        ITERATOR_RELEASE(it);
+    }
+
+    if ((0 == rc) && rows)
+        rc = _sql_execute(_sql.vb_stmt, _vb_insert, VBIND_MAX, _vbind, rows,
+                          "Could not execute insert statement for varbind");
+    return rc;
+}
+
+/*
+ * insert the first n traps of _sql.rows, logging them if that fails for
+ * any reason but a lost connection.  returns the number inserted.
+ */
+static int
+_sql_insert_chunk(int n)
+{
+    int i;
+
+    if (0 == _sql_insert_rows(n))
+        return n;
+
+    if (_sql.connected)
+        for (i = 0; i < n; i++)
+            _sql_log(_sql.rows[i], NULL);
+    return 0;
+}
+
+/*
+ * put a string, or NULL, into the spool
+ */
+static int
+_sql_spool_put(FILE *f, const void *data, u_long len)
+{
+    uint32_t    n = data ? len : SQL_SPOOL_NULL;
+
+    if (fwrite(&n, sizeof(n), 1, f) != 1)
+        return -1;
+    if (data && len && fwrite(data, len, 1, f) != 1)
+        return -1;
+    return 0;
+}
+
+/*
+ * get a string, or NULL, from the spool
+ */
+static int
+_sql_spool_get(FILE *f, char **data, u_long *len)
+{
+    uint32_t    n;
+
+    *data = NULL;
+    if (len)
+        *len = 0;
+    if (fread(&n, sizeof(n), 1, f) != 1)
+        return -1;
+    if (SQL_SPOOL_NULL == n)
+        return 0;
+    if (n > SQL_SPOOL_MAX_FIELD)
+        return -1;
+
+    *data = (char *) malloc(n + 1);
+    if (NULL == *data)
+        return -1;
+    if (n && fread(*data, n, 1, f) != 1) {
+        SNMP_FREE(*data);
+        return -1;
+    }
+    (*data)[n] = '\0';
+    if (len)
+        *len = n;
+    return 0;
+}
+
+/*
+ * append a buffered trap to the spool
+ */
+static int
+_sql_spool_put_buf(FILE *f, sql_buf *sqlb)
+{
+    netsnmp_iterator     *it;
+    sql_vb_buf           *sqlvb;
+    uint32_t              hdr[14], type;
+    int                   rc = 0;
+
+    hdr[0] = SQL_SPOOL_MAGIC;
+    hdr[1] = sqlb->time.year;
+    hdr[2] = sqlb->time.month;
+    hdr[3] = sqlb->time.day;
+    hdr[4] = sqlb->time.hour;
+    hdr[5] = sqlb->time.minute;
+    hdr[6] = sqlb->time.second;
+    hdr[7] = sqlb->version;
+    hdr[8] = sqlb->type;
+    hdr[9] = sqlb->reqid;
+    hdr[10] = sqlb->security_model;
+    hdr[11] = sqlb->msgid;
+    hdr[12] = sqlb->security_level;
+    hdr[13] = CONTAINER_SIZE(sqlb->varbinds);
+
+    if ((fwrite(hdr, sizeof(hdr), 1, f) != 1) ||
+        _sql_spool_put(f, sqlb->host, sqlb->host_len) ||
+        _sql_spool_put(f, sqlb->oid, sqlb->oid_len) ||
+        _sql_spool_put(f, sqlb->user, sqlb->user_len) ||
+        _sql_spool_put(f, sqlb->transport,
+                       sqlb->transport ? strlen(sqlb->transport) : 0) ||
+        _sql_spool_put(f, sqlb->context, sqlb->context_len) ||
+        _sql_spool_put(f, sqlb->context_engine, sqlb->context_engine_len) ||
+        _sql_spool_put(f, sqlb->security_name, sqlb->security_name_len) ||
+        _sql_spool_put(f, sqlb->security_engine, sqlb->security_engine_len))
+        return -1;
+
+    it = CONTAINER_ITERATOR(sqlb->varbinds);
+    if (NULL == it)
+        return -1;
+    for (sqlvb = ITERATOR_FIRST(it); sqlvb && (0 == rc);
+         sqlvb = ITERATOR_NEXT(it)) {
+        type = sqlvb->type;
+        if ((fwrite(&type, sizeof(type), 1, f) != 1) ||
+            _sql_spool_put(f, sqlvb->oid, sqlvb->oid_len) ||
+            _sql_spool_put(f, sqlvb->val, sqlvb->val_len))
+            rc = -1;
+    }
+    ITERATOR_RELEASE(it);
+    return rc;
+}
+
+/*
+ * read a buffered trap back from the spool.  returns NULL at its end, and
+ * sets *bad if that is an incomplete or unreadable record.
+ */
+static sql_buf *
+_sql_spool_get_buf(FILE *f, int *bad)
+{
+    sql_buf              *sqlb;
+    sql_vb_buf           *sqlvb;
+    uint32_t              hdr[14], type, i;
+    char                 *val;
+    size_t                got;
+
+    *bad = 0;
+    got = fread(hdr, 1, sizeof(hdr), f);
+    if (0 == got)
+        return NULL;
+    *bad = 1;
+    if ((got != sizeof(hdr)) || (SQL_SPOOL_MAGIC != hdr[0]))
+        return NULL;
+
+    sqlb = _sql_buf_get();
+    if (NULL == sqlb)
+        return NULL;
+    sqlb->time.year = hdr[1];
+    sqlb->time.month = hdr[2];
+    sqlb->time.day = hdr[3];
+    sqlb->time.hour = hdr[4];
+    sqlb->time.minute = hdr[5];
+    sqlb->time.second = hdr[6];
+    sqlb->version = hdr[7];
+    sqlb->type = hdr[8];
+    sqlb->reqid = hdr[9];
+    sqlb->security_model = hdr[10];
+    sqlb->msgid = hdr[11];
+    sqlb->security_level = hdr[12];
+
+    if (_sql_spool_get(f, &sqlb->host, &sqlb->host_len) ||
+        _sql_spool_get(f, &sqlb->oid, &sqlb->oid_len) ||
+        _sql_spool_get(f, &sqlb->user, &sqlb->user_len) ||
+        _sql_spool_get(f, &sqlb->transport, NULL) ||
+        _sql_spool_get(f, &sqlb->context, &sqlb->context_len) ||
+        _sql_spool_get(f, &sqlb->context_engine, &sqlb->context_engine_len) ||
+        _sql_spool_get(f, &sqlb->security_name, &sqlb->security_name_len) ||
+        _sql_spool_get(f, &sqlb->security_engine, &sqlb->security_engine_len))
+        goto err;
+
+    for (i = 0; i < hdr[13]; i++) {
+        sqlvb = SNMP_MALLOC_TYPEDEF(sql_vb_buf);
+        if (NULL == sqlvb)
+            goto err;
+        if (CONTAINER_INSERT(sqlb->varbinds, sqlvb)) {
+            free(sqlvb);
+            goto err;
+        }
+        if ((fread(&type, sizeof(type), 1, f) != 1) ||
+            _sql_spool_get(f, &sqlvb->oid, &sqlvb->oid_len) ||
+            _sql_spool_get(f, &val, &sqlvb->val_len))
+            goto err;
+        sqlvb->type = type;
+        sqlvb->val = (u_char *) val;
+    }
+
+    *bad = 0;
+    return sqlb;
+
+  err:
+    _sql_buf_free(sqlb, NULL);
+    return NULL;
+}
+
+/*
+ * append the traps of a queue that have not been logged to the spool.
+ *
+ * return 0 on success, anything else is an error
+ */
+static int
+_sql_spool_write(netsnmp_container *q)
+{
+    netsnmp_iterator     *it;
+    sql_buf              *sqlb;
+    FILE                 *f;
+    long                  start;
+    u_long                n = 0;
+    int                   rc = 0;
+
+    f = fopen(_sql.spool, "ab");
+    if (NULL == f) {
+        _sql_msg(LOG_ERR, "Could not open sql spool %s: %s\n", _sql.spool,
+                 strerror(errno));
+        return -1;
+    }
+    fseek(f, 0, SEEK_END);
+    start = ftell(f);
+
+    it = CONTAINER_ITERATOR(q);
+    if (NULL == it)
+        rc = -1;
+    else {
+        for (sqlb = ITERATOR_FIRST(it); sqlb && (0 == rc);
+             sqlb = ITERATOR_NEXT(it)) {
+            if (sqlb->logged)
+                continue;
+            rc = _sql_spool_put_buf(f, sqlb);
+            n++;
+        }
+        ITERATOR_RELEASE(it);
+    }
+    if (0 != fflush(f))
+        rc = -1;
+#ifdef HAVE_FSYNC
+    if ((0 == rc) && (0 != fsync(fileno(f))))
+        rc = -1;
+#endif
+    /** leave no partial record for the next traps to follow */
+    if (rc && (start >= 0) && (0 != ftruncate(fileno(f), start)))
+        _sql_msg(LOG_ERR, "Could not truncate sql spool %s\n", _sql.spool);
+    if (0 != fclose(f))
+        rc = -1;
+
+    if (rc) {
+        _sql_msg(LOG_ERR, "Could not write sql spool %s\n", _sql.spool);
+        return -1;
+    }
+    _sql_debug("sql:spool", "spooled %lu traps\n", n);
+    _sql.stats.spooled += n;
+    _sql.spool_pending = 1;
+    return 0;
+}
+
+/*
+ * keep traps that could not be written: in the spool, if there is one,
+ * or else in the log
+ */
+static void
+_sql_fallback(netsnmp_container *q)
+{
+    if (_sql.spool && (0 == _sql_spool_write(q)))
+        return;
+    CONTAINER_FOR_EACH(q, _sql_log, NULL);
+}
+
+/*
+ * write the traps of a queue to the database, batch_rows per INSERT,
+ * and commit them together
+ */
+static void
+_sql_write_bufs(netsnmp_container *q)
+{
+    netsnmp_iterator     *it;
+    sql_buf              *sqlb;
+    u_long                inserted = 0;
+    int                   n = 0;
+
+    if (0 == CONTAINER_SIZE(q))
+        return;
+
     /*
-     * iterate over the varbinds, copy data and insert
+     * don't even try if we don't have a database connection
      */
-    it = CONTAINER_ITERATOR(sqlb->varbinds);
-    if (NULL == it) {
-        snmp_log(LOG_ERR,"Could not allocate iterator\n");
-        _sql_log(sqlb, NULL);
+    if (0 == _sql.connected) {
+        _sql_fallback(q);
         return;
     }
 
-    for( sqlvb = ITERATOR_FIRST(it); sqlvb; sqlvb = ITERATOR_NEXT(it)) {
+    it = CONTAINER_ITERATOR(q);
+    if (NULL == it) {
+        _sql_msg(LOG_ERR,"Could not allocate iterator\n");
+        CONTAINER_FOR_EACH(q, _sql_log, NULL);
+        return;
+    }
+    for (sqlb = ITERATOR_FIRST(it); sqlb && _sql.connected;
+         sqlb = ITERATOR_NEXT(it)) {
+        _sql.rows[n++] = sqlb;
+        if (n < _sql.batch_rows)
+            continue;
+        inserted += _sql_insert_chunk(n);
+        n = 0;
+    }
+    ITERATOR_RELEASE(it);
+    if (n && _sql.connected)
+        inserted += _sql_insert_chunk(n);
 
-        _vbind[VBIND_ID].buffer = (void *)&trap_id;
-        _vbind[VBIND_TYPE].buffer = (void *)&sqlvb->type;
+    if (_sql.connected) {
+        if (0 == mysql_commit(_sql.conn)) {
+            _sql.stats.commits++;
+            _sql.stats.written += inserted;
+            return;
+        }
+        netsnmp_sql_error("commit failed");
+        if (_sql.connected) { /* nuts... now what? */
+            CONTAINER_FOR_EACH(q, _sql_log, NULL);
+            return;
+        }
+    }
 
-        _vbind[VBIND_OID].buffer = sqlvb->oid;
-        _vbind[VBIND_OID].buffer_length = sqlvb->oid_len;
+    /** the transaction went with the connection */
+    _sql_fallback(q);
+}
 
-        _vbind[VBIND_VAL].buffer = sqlvb->val;
-        _vbind[VBIND_VAL].buffer_length = sqlvb->val_len;
+/*
+ * write the traps in the spool to the database.  The spool is renamed
+ * first, so that traps which cannot be written meanwhile go to a new one.
+ * A replay that was cut short is finished first.
+ */
+static void
+_sql_spool_replay(void)
+{
+    netsnmp_container    *q;
+    sql_buf              *sqlb;
+    char                  replay[SNMP_MAXPATH];
+    FILE                 *f;
+    int                   bad = 0;
+
+    snprintf(replay, sizeof(replay), "%s.replay", _sql.spool);
+    if ((0 != access(replay, F_OK)) && (0 != rename(_sql.spool, replay))) {
+        if (ENOENT == errno)
+            _sql.spool_pending = 0;
+        else
+            _sql_msg(LOG_ERR, "Could not rename sql spool %s: %s\n",
+                     _sql.spool, strerror(errno));
+        return;
+    }
 
-        if (mysql_stmt_bind_param(_sql.vb_stmt, _vbind) != 0) {
-            netsnmp_sql_stmt_error(_sql.vb_stmt,
-                                   "Could not bind parameters for INSERT");
-            _sql_log(sqlb, NULL);
-            break;
-        }
+    f = fopen(replay, "rb");
+    if (NULL == f) {
+        _sql_msg(LOG_ERR, "Could not open sql spool %s: %s\n", replay,
+                 strerror(errno));
+        return;
+    }
+    q = netsnmp_container_find("fifo");
+    if (NULL == q) {
+        _sql_msg(LOG_ERR, "Could not allocate sql buf container\n");
+        fclose(f);
+        return;
+    }
 
-        if (mysql_stmt_execute(_sql.vb_stmt) != 0) {
-            netsnmp_sql_stmt_error(_sql.vb_stmt,
-                                   "Could not execute insert statement for varbind");
+    _sql_debug("sql:spool", "replaying %s\n", replay);
+    while ((sqlb = _sql_spool_get_buf(f, &bad)) != NULL) {
+        if (CONTAINER_INSERT(q, sqlb)) {
             _sql_log(sqlb, NULL);
-            break;
+            _sql_buf_free(sqlb, NULL);
+            continue;
         }
+        _sql.stats.replayed++;
+        if (CONTAINER_SIZE(q) < SQL_BATCH_ROWS_MAX)
+            continue;
+        _sql_write_bufs(q);
+        CONTAINER_CLEAR(q, _sql_buf_free, NULL);
     }
-    ITERATOR_RELEASE(it);
+    _sql_write_bufs(q);
+    CONTAINER_CLEAR(q, _sql_buf_free, NULL);
+    CONTAINER_FREE(q);
+
+    if (bad)
+        _sql_msg(LOG_WARNING, "sql spool %s ends with an unreadable record\n",
+                 replay);
+    fclose(f);
+    unlink(replay);
+    _sql.spool_pending = (0 == access(_sql.spool, F_OK));
 }
 
 /*
- * process (save) queued items to sql database.
- *
- * dontcare & meeither are dummy params so this function can be used
- * as a netsnmp_alarm callback function.
+ * write a queue of buffered traps, after any spooled ones, and free them
  */
 static void
-_sql_process_queue(u_int dontcare, void *meeither)
+_sql_write_queue(netsnmp_container *q)
 {
-    int        sql_has_connected, rc;
-
-    /** bail if the queue is empty */
-    if( 0 == CONTAINER_SIZE(_sql.queue))
+    /** bail if there is nothing to write */
+    if ((0 == CONTAINER_SIZE(q)) && !_sql.spool_pending)
         return;
 
-    DEBUGMSGT(("sql:process", "processing %d queued traps\n",
-               (int)CONTAINER_SIZE(_sql.queue)));
+    _sql_debug("sql:process", "processing %d queued traps\n",
+               (int)CONTAINER_SIZE(q));
 
     /*
      * if we don't have a database connection, try to reconnect. We
-     * don't care if we fail - traps will be logged in that case.
+     * don't care if we fail - traps will be spooled or logged in that case.
      */
     if (0 == _sql.connected) {
-        DEBUGMSGT(("sql:process", "no sql connection; reconnecting\n"));
+        _sql_debug("sql:process", "no sql connection; reconnecting\n");
         (void) netsnmp_mysql_connect();
     }
 
-    sql_has_connected = _sql.connected;
+    if (_sql.connected && _sql.spool_pending)
+        _sql_spool_replay();
 
-    CONTAINER_FOR_EACH(_sql.queue, _sql_save, NULL);
+    _sql_write_bufs(q);
+    CONTAINER_CLEAR(q, _sql_buf_free, NULL);
+}
 
-    if (_sql.connected) {
-        rc = mysql_commit(_sql.conn);
-        if (rc) { /* nuts... now what? */
-            netsnmp_sql_error("commit failed");
-            CONTAINER_FOR_EACH(_sql.queue, _sql_log, NULL);
-        }
-    }
+/*
+ * process (save) queued items to sql database.
+ *
+ * dontcare & meeither are dummy params so this function can be used
+ * as a netsnmp_alarm callback function.
+ */
+static void
+_sql_process_queue(u_int dontcare, void *meeither)
+{
+    _sql_write_queue(_sql.queue);
+}
 
-    if (!sql_has_connected || _sql.connected) {
-        CONTAINER_CLEAR(_sql.queue, _sql_buf_free, NULL);
+#ifdef SNMPTRAPD_SQL_THREADS
+/*
+ * the flush thread: write the queue whenever it reaches sqlMaxQueue
+ * traps, or sqlSaveInterval seconds after the last time
+ */
+static void *
+_sql_flusher(void *arg)
+{
+    netsnmp_container    *q;
+    struct timeval        now;
+    struct timespec       deadline;
+    sigset_t              signals;
+    int                   stopping = 0;
+
+    /* signals are for the main loop */
+    sigfillset(&signals);
+    pthread_sigmask(SIG_BLOCK, &signals, NULL);
+    mysql_thread_init();
+
+    SQL_LOCK();
+    while (!stopping) {
+        gettimeofday(&now, NULL);
+        deadline.tv_sec = now.tv_sec + _sql.queue_interval;
+        deadline.tv_nsec = now.tv_usec * 1000;
+        while (!_sql.stopping && (CONTAINER_SIZE(_sql.queue) < _sql.queue_max)
+               && (pthread_cond_timedwait(&_sql.cond, &_sql.lock,
+                                          &deadline) != ETIMEDOUT))
+            ;
+
+        /** take the queue, and give the handler the empty one */
+        q = _sql.queue;
+        _sql.queue = _sql.writing;
+        _sql.writing = q;
+        stopping = _sql.stopping;
+        SQL_UNLOCK();
+
+        _sql_write_queue(q);
+
+        SQL_LOCK();
     }
+    SQL_UNLOCK();
+
+    mysql_thread_end();
+    return NULL;
 }
+#endif /* SNMPTRAPD_SQL_THREADS */
 
 #else
 int unused;	/* Suppress "empty translation unit" warning */
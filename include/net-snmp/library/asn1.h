@@ -500,6 +500,42 @@ SOFTWARE.
                                               int allow_realloc,
                                               u_char type, const double *data,
                                               size_t data_size);
+
+    /*
+     * Presized forward encoder functions.  asn_presize_* return content
+     * lengths (asn_presize_objid() returns 0 on error) and the
+     * asn_presized_build_* functions write header and content into a
+     * buffer known to be large enough, producing the same octets as the
+     * matching asn_realloc_rbuild_* function.
+     */
+    NETSNMP_IMPORT
+    size_t          asn_presize_header(size_t length);
+    NETSNMP_IMPORT
+    size_t          asn_presize_int(long integer);
+    NETSNMP_IMPORT
+    size_t          asn_presize_unsigned_int(u_long integer);
+    NETSNMP_IMPORT
+    size_t          asn_presize_objid(const oid * objid, size_t objidlength);
+    NETSNMP_IMPORT
+    u_char         *asn_presized_build_header(u_char * data, u_char type,
+                                              size_t length);
+    NETSNMP_IMPORT
+    u_char         *asn_presized_build_int(u_char * data, u_char type,
+                                           long integer, size_t length);
+    NETSNMP_IMPORT
+    u_char         *asn_presized_build_unsigned_int(u_char * data,
+                                                    u_char type,
+                                                    u_long integer,
+                                                    size_t length);
+    NETSNMP_IMPORT
+    u_char         *asn_presized_build_string(u_char * data, u_char type,
+                                              const u_char * str,
+                                              size_t strlength);
+    NETSNMP_IMPORT
+    u_char         *asn_presized_build_objid(u_char * data, u_char type,
+                                             const oid * objid,
+                                             size_t objidlength,
+                                             size_t length);
 #endif
 
 #ifdef __cplusplus
@@ -0,0 +1,38 @@
+/*
+ * container_btree.h
+ * $Id$
+ *
+ */
+#ifndef NETSNMP_CONTAINER_BTREE_H
+#define NETSNMP_CONTAINER_BTREE_H
+
+
+#include <net-snmp/library/container.h>
+
+#ifdef  __cplusplus
+extern "C" {
+#endif
+
+    /*
+     * get a container which uses a B+tree for storage
+     */
+    NETSNMP_IMPORT
+    netsnmp_container *netsnmp_container_get_btree(void);
+
+    /*
+     * get a factory for producing btree objects
+     */
+    struct netsnmp_factory_s *netsnmp_container_get_btree_factory(void);
+
+    /*
+     * initialize btree container. call at startup.
+     */
+    NETSNMP_IMPORT
+    void netsnmp_container_btree_init(void);
+
+
+#ifdef  __cplusplus
+}
+#endif
+
+#endif /** NETSNMP_CONTAINER_BTREE_H */
@@ -106,6 +106,10 @@ extern          "C" {
 #define NETSNMP_DS_LIB_FILTER_SOURCE       46 /* filter pkt by source IP */
 #define NETSNMP_DS_LIB_ADD_FORWARDER_INFO  47 /* add info about forwarder to SNMP packets */
 #define NETSNMP_DS_LIB_SSH_AGENT           48 /* enable ssh agent forwarding */
+#define NETSNMP_DS_LIB_PRESIZED_ENCODE     49 /* size v1/v2c packets first */
+#define NETSNMP_DS_LIB_MIB_CACHE           50 /* load/save a compiled MIB tree */
+#define NETSNMP_DS_LIB_MIB_LAZY_LOAD       51 /* read MIB modules when needed */
+#define NETSNMP_DS_LIB_PERSISTENT_JOURNAL  52 /* persistent state in a journal */
 #define NETSNMP_DS_LIB_MAX_BOOL_ID         64 /* match NETSNMP_DS_MAX_SUBIDS */
 
     /*
@@ -131,6 +135,8 @@ extern          "C" {
 #define NETSNMP_DS_LIB_RETRIES             15
 #define NETSNMP_DS_LIB_MSG_SEND_MAX        16 /* global max response size */
 #define NETSNMP_DS_LIB_FILTER_TYPE         17 /* 0=NONE, 1=whitelist, -1=blacklist */
+#define NETSNMP_DS_LIB_MIB_THREADS         18 /* threads reading MIB files */
+#define NETSNMP_DS_LIB_MIB_MEMO_SIZE       19 /* translations remembered */
 #define NETSNMP_DS_LIB_MAX_INT_ID          64 /* match NETSNMP_DS_MAX_SUBIDS */
     
     /*
@@ -186,6 +192,8 @@ extern          "C" {
 #define NETSNMP_DS_LIB_OUTPUT_PRECISION  35
 #define NETSNMP_DS_LIB_TLS_MIN_VERSION   36
 #define NETSNMP_DS_LIB_TLS_MAX_VERSION   37
+#define NETSNMP_DS_LIB_MIB_CACHE_FILE    38
+#define NETSNMP_DS_LIB_MIB_INDEX_FILE    39
 #define NETSNMP_DS_LIB_MAX_STR_ID        64 /* match NETSNMP_DS_MAX_SUBIDS */
 
     /*
@@ -289,6 +297,8 @@ extern          "C" {
     int             netsnmp_ds_parse_boolean(char *line);
     NETSNMP_IMPORT
     void            netsnmp_ds_shutdown(void);
+    NETSNMP_IMPORT
+    u_int           netsnmp_ds_generation(void);
 
 #ifdef __cplusplus
 }
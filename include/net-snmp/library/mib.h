@@ -176,6 +176,18 @@ SOFTWARE.
                                                       const oid * objid,
                                                       size_t objidlen);
 
+    /*
+     * counts of translations answered from the memo of recent ones
+     */
+    typedef struct netsnmp_mib_memo_stats_s {
+        u_long          oid_hits, oid_misses;   /* OIDs printed */
+        u_long          name_hits, name_misses; /* names read */
+        u_long          flushes;        /* emptied as the MIB tree changed */
+    } netsnmp_mib_memo_stats;
+
+    NETSNMP_IMPORT
+    void            netsnmp_mib_memo_get_stats(netsnmp_mib_memo_stats *stats);
+
     NETSNMP_IMPORT
     void
                     netsnmp_sprint_realloc_objid(u_char ** buf,
@@ -186,6 +198,31 @@ SOFTWARE.
                                                  const oid * objid,
                                                  size_t objidlen);
 
+    /*
+     * Output options of the sprint_realloc_* value functions, as set by
+     * the -O flags.  See netsnmp_print_options_use().
+     */
+    typedef struct netsnmp_print_options_s {
+        u_char          quick_print;    /* NETSNMP_DS_LIB_QUICK_PRINT */
+        u_char          quicke_print;   /* NETSNMP_DS_LIB_QUICKE_PRINT */
+        u_char          bare_value;     /* NETSNMP_DS_LIB_PRINT_BARE_VALUE */
+        u_char          numeric_enum;   /* NETSNMP_DS_LIB_PRINT_NUMERIC_ENUM */
+        u_char          numeric_timeticks;      /* ..._NUMERIC_TIMETICKS */
+        u_char          hex_text;       /* NETSNMP_DS_LIB_PRINT_HEX_TEXT */
+        u_char          hex_2digit;     /* ..._2DIGIT_HEX_OUTPUT */
+        u_char          no_units;       /* NETSNMP_DS_LIB_DONT_PRINT_UNITS */
+        u_char          no_display_hint;        /* ..._NO_DISPLAY_HINT */
+        int             string_format;  /* ..._STRING_OUTPUT_FORMAT */
+        int             hex_line_len;   /* ..._HEX_OUTPUT_LENGTH */
+    } netsnmp_print_options;
+
+    NETSNMP_IMPORT
+    void            netsnmp_print_options_init(netsnmp_print_options *opts);
+    NETSNMP_IMPORT
+    const netsnmp_print_options *
+                    netsnmp_print_options_use(const netsnmp_print_options
+                                              *opts);
+
     NETSNMP_IMPORT
     int             sprint_realloc_value(u_char ** buf, size_t * buf_len,
                                  size_t * out_len, int allow_realloc,
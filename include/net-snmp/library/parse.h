@@ -116,6 +116,9 @@ SOFTWARE.
         int             reported;       /* 1=report started in print_subtree... */
         char           *defaultValue;
        char	       *parseErrorString; /* Contains the error string if there are errors in parsing MIBs */
+        struct tree   **child_index;    /* children by subid, see find_tree_subid() */
+        u_int           child_count;
+        u_int           child_gen;
     };
 
     /*
@@ -203,6 +206,28 @@ SOFTWARE.
     void            netsnmp_init_mib_internals(void);
     void            unload_all_mibs(void);
     int             add_mibfile(const char*, const char*);
+    NETSNMP_IMPORT
+    int             netsnmp_mib_cache_save(const char *file, const char *key,
+                                           const char *paths);
+    NETSNMP_IMPORT
+    int             netsnmp_mib_cache_load(const char *file, const char *key);
+    NETSNMP_IMPORT
+    void            netsnmp_mib_prefetch(const char *const *names, int count,
+                                         int nthreads);
+    NETSNMP_IMPORT
+    void            netsnmp_mib_prefetch_done(void);
+    NETSNMP_IMPORT
+    int             netsnmp_mib_index_save(const char *file, const char *key,
+                                           const char *paths);
+    NETSNMP_IMPORT
+    int             netsnmp_mib_index_load(const char *file, const char *key);
+    NETSNMP_IMPORT
+    void            netsnmp_mib_index_clear(void);
+    NETSNMP_IMPORT
+    void            netsnmp_mib_index_need_label(const char *label);
+    NETSNMP_IMPORT
+    void            netsnmp_mib_index_need_oid(const oid *name, size_t len);
+    u_int           netsnmp_mib_generation(void);
     int             which_module(const char *);
     NETSNMP_IMPORT
     char           *module_name(int, char *);
@@ -213,6 +238,8 @@ SOFTWARE.
     NETSNMP_IMPORT
     struct tree    *find_tree_node(const char *, int);
     NETSNMP_IMPORT
+    struct tree    *find_tree_subid(struct tree *, u_long);
+    NETSNMP_IMPORT
     const char     *get_tc_descriptor(int);
     NETSNMP_IMPORT
     const char     *get_tc_description(int);
@@ -130,6 +130,9 @@ extern          "C" {
     NETSNMP_IMPORT
     void            snmp_clean_persistent(const char *type);
     struct config_line *read_config_get_handlers(const char *type);
+    struct config_line *read_config_find_handler(struct config_line
+                                                 *line_handlers,
+                                                 const char *token);
 
     /*
      * external memory list handlers 
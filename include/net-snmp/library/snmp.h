@@ -319,6 +319,10 @@ SOFTWARE.
 #define UCD_MSG_FLAG_FORWARD_ENCODE         0x8000
 #endif
 #define UCD_MSG_FLAG_BULK_TOOBIG          0x010000
+/** parse large values in place, see NETSNMP_VARBIND_BORROWED */
+#define UCD_MSG_FLAG_BORROW_VARBINDS      0x020000
+/** don't decode values until asked to, see NETSNMP_VARBIND_LAZY */
+#define UCD_MSG_FLAG_LAZY_VARBINDS        0x040000
 
     /*
      * view status 
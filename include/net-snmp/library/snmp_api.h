@@ -180,6 +180,8 @@ typedef struct request_list {
 
 #define SNMP_DETAIL_SIZE        512
 
+#define SNMP_FLAGS_LAZY_VARBINDS   0x8000 /* see UCD_MSG_FLAG_LAZY_VARBINDS */
+#define SNMP_FLAGS_BORROW_VARBINDS 0x4000 /* see UCD_MSG_FLAG_BORROW_VARBINDS */
 #define SNMP_FLAGS_TIME_CREATED    0x2000
 #define SNMP_FLAGS_SESSION_USER    0x1000
 #define SNMP_FLAGS_UDP_BROADCAST   0x800
@@ -235,6 +235,8 @@ extern          "C" {
     struct vacm_securityEntry *vacm_scanSecurityEntry(void);
     NETSNMP_IMPORT
     int             vacm_is_configured(void);
+    NETSNMP_IMPORT
+    unsigned int    vacm_get_generation(void);
 
     void            vacm_save(const char *token, const char *type);
     void            vacm_save_view(struct vacm_viewEntry *view,
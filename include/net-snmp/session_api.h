@@ -267,6 +267,14 @@ extern          "C" {
     NETSNMP_IMPORT
     int             snmp_sess_read2(struct session_list *,
                                     netsnmp_large_fd_set *);
+    /*
+     * Processes a datagram read from the session's transport by other
+     * means, as snmp_sess_read() would.  Returns 0 if success, -1 if fail.
+     */
+    NETSNMP_IMPORT
+    int             snmp_sess_process_packet(struct session_list *,
+                                             u_char *packet, int length,
+                                             void *opaque, int olength);
     NETSNMP_IMPORT
     void            snmp_sess_timeout(struct session_list *);
     NETSNMP_IMPORT
@@ -133,8 +133,23 @@ typedef struct variable_list {
    /** callback to free above */
    void            (*dataFreeHook)(void *);    
    int             index;
+   /** NETSNMP_VARBIND_* flags */
+   u_char          flags;
 } netsnmp_variable_list;
 
+/*
+ * val points into the packet the varbind was parsed from and is only
+ * valid while that packet is being processed.  Cloning the varbind or
+ * calling snmp_varlist_materialize() gives it its own copy.
+ */
+#define NETSNMP_VARBIND_BORROWED 0x01
+/*
+ * val.string and val_len hold the still encoded value, which
+ * snmp_decode_var_value() decodes.  Always set with
+ * NETSNMP_VARBIND_BORROWED.
+ */
+#define NETSNMP_VARBIND_LAZY     0x02
+
 
 /** @typedef struct snmp_pdu to netsnmp_pdu
  * Typedefs the snmp_pdu struct into netsnmp_pdu */
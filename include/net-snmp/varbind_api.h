@@ -31,6 +31,12 @@ extern          "C" {
     NETSNMP_IMPORT
     netsnmp_variable_list *
        snmp_clone_varbind(netsnmp_variable_list * varlist);
+    NETSNMP_IMPORT
+    int             snmp_varlist_materialize(netsnmp_variable_list * varlist);
+    NETSNMP_IMPORT
+    int             snmp_decode_var_value(netsnmp_variable_list * var);
+    NETSNMP_IMPORT
+    int             snmp_decode_varlist(netsnmp_variable_list * varlist);
 
     /* Setting Values */
     NETSNMP_IMPORT
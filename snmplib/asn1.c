@@ -3939,6 +3939,289 @@ asn_realloc_rbuild_double(u_char ** pkt, size_t * pkt_len,
 }
 
 #endif                          /* NETSNMP_WITH_OPAQUE_SPECIAL_TYPES */
+
+/*
+ * Presized forward encoding.  The asn_presize_* functions return the
+ * number of content octets the matching asn_realloc_rbuild_* function
+ * would produce, so that a caller can work out every length in a message
+ * before writing any of it.  The asn_presized_build_* functions then
+ * write the header and content forwards into a buffer the caller has
+ * already made large enough, and return a pointer just past the data.
+ * The output is identical to that of the reverse encoders.
+ */
+
+/**
+ * @internal
+ * Returns the size of the header asn_realloc_rbuild_header() builds for
+ * an object with the given content length.
+ *
+ * @param length IN - length of object content
+ *
+ * @return number of octets in the type and length fields
+ */
+size_t
+asn_presize_header(size_t length)
+{
+    size_t          n = 2;
+
+    if (length > 0x7f) {
+        for (; length; length >>= 8)
+            n++;
+    }
+    return n;
+}
+
+/**
+ * @internal
+ * Returns the content length of an encoded integer.
+ *
+ * @param integer IN - value to encode
+ *
+ * @return number of content octets
+ */
+size_t
+asn_presize_int(long integer)
+{
+    long            testvalue;
+    size_t          n = 1;
+    u_char          top;
+
+    CHECK_OVERFLOW_S(integer, 15);
+    testvalue = (integer < 0) ? -1 : 0;
+    top = (u_char) integer;
+    integer >>= 8;
+    while (integer != testvalue) {
+        top = (u_char) integer;
+        integer >>= 8;
+        n++;
+    }
+    if ((top & 0x80) != (testvalue & 0x80))
+        n++;
+    return n;
+}
+
+/**
+ * @internal
+ * Returns the content length of an encoded unsigned integer.
+ *
+ * @param integer IN - value to encode
+ *
+ * @return number of content octets
+ */
+size_t
+asn_presize_unsigned_int(u_long integer)
+{
+    size_t          n = 1;
+    u_char          top;
+
+    CHECK_OVERFLOW_U(integer, 16);
+    top = (u_char) integer;
+    integer >>= 8;
+    while (integer != 0) {
+        top = (u_char) integer;
+        integer >>= 8;
+        n++;
+    }
+    if (top & 0x80)
+        n++;
+    return n;
+}
+
+static size_t
+_asn_presize_subid(uint32_t subid)
+{
+    size_t          n = 1;
+
+    while (subid >>= 7)
+        n++;
+    return n;
+}
+
+/**
+ * @internal
+ * Returns the content length of an encoded object identifier.
+ *
+ * @param objid       IN - pointer to the object id
+ * @param objidlength IN - number of sub-identifiers
+ *
+ * @return number of content octets, or 0 if objid can't be encoded
+ */
+size_t
+asn_presize_objid(const oid * objid, size_t objidlength)
+{
+    size_t          i, n;
+    oid             tmpint;
+
+    if (objidlength == 0)
+        return 1;
+    if (objid[0] > 2) {
+        ERROR_MSG("build objid: bad first subidentifier");
+        return 0;
+    }
+    if (objidlength == 1)
+        return 1;
+    if (objid[1] > 40 && objid[0] < 2) {
+        ERROR_MSG("build objid: bad second subidentifier");
+        return 0;
+    }
+    n = _asn_presize_subid(objid[0] * 40 + objid[1]);
+    for (i = 2; i < objidlength; i++) {
+        tmpint = objid[i];
+        CHECK_OVERFLOW_U(tmpint, 17);
+        n += _asn_presize_subid(tmpint);
+    }
+    return n;
+}
+
+/**
+ * @internal
+ * Writes an ASN header forwards.
+ *
+ * @param data   IN - where to write, with asn_presize_header(length)
+ *                    octets available
+ * @param type   IN - type of object
+ * @param length IN - length of object content
+ *
+ * @return pointer to the first octet after the header
+ */
+u_char         *
+asn_presized_build_header(u_char * data, u_char type, size_t length)
+{
+    size_t          n = asn_presize_header(length) - 2, i;
+
+    *data++ = type;
+    if (n == 0) {
+        *data++ = (u_char) length;
+        return data;
+    }
+    *data++ = (u_char) (0x80 | n);
+    for (i = n; i > 0; i--) {
+        data[i - 1] = (u_char) length;
+        length >>= 8;
+    }
+    return data + n;
+}
+
+/**
+ * @internal
+ * Writes an ASN integer forwards.
+ *
+ * @param data    IN - where to write
+ * @param type    IN - type of object
+ * @param integer IN - value to encode
+ * @param length  IN - content length from asn_presize_int()
+ *
+ * @return pointer to the first octet after the object
+ */
+u_char         *
+asn_presized_build_int(u_char * data, u_char type, long integer,
+                       size_t length)
+{
+    size_t          i;
+
+    CHECK_OVERFLOW_S(integer, 15);
+    data = asn_presized_build_header(data, type, length);
+    for (i = length; i > 0; i--) {
+        data[i - 1] = (u_char) integer;
+        integer >>= 8;
+    }
+    return data + length;
+}
+
+/**
+ * @internal
+ * Writes an ASN unsigned integer forwards.
+ *
+ * @param data    IN - where to write
+ * @param type    IN - type of object
+ * @param integer IN - value to encode
+ * @param length  IN - content length from asn_presize_unsigned_int()
+ *
+ * @return pointer to the first octet after the object
+ */
+u_char         *
+asn_presized_build_unsigned_int(u_char * data, u_char type, u_long integer,
+                                size_t length)
+{
+    size_t          i;
+
+    CHECK_OVERFLOW_U(integer, 16);
+    data = asn_presized_build_header(data, type, length);
+    for (i = length; i > 0; i--) {
+        data[i - 1] = (u_char) integer;
+        integer >>= 8;
+    }
+    return data + length;
+}
+
+/**
+ * @internal
+ * Writes an ASN string, bit string or other opaque octets forwards.
+ *
+ * @param data      IN - where to write
+ * @param type      IN - type of object
+ * @param str       IN - pointer to the string
+ * @param strlength IN - length of the string
+ *
+ * @return pointer to the first octet after the object
+ */
+u_char         *
+asn_presized_build_string(u_char * data, u_char type,
+                          const u_char * str, size_t strlength)
+{
+    data = asn_presized_build_header(data, type, strlength);
+    if (str)
+        memcpy(data, str, strlength);
+    return data + strlength;
+}
+
+static u_char  *
+_asn_presized_build_subid(u_char * data, uint32_t subid)
+{
+    size_t          n = _asn_presize_subid(subid), i;
+
+    data[n - 1] = subid & 0x7f;
+    for (i = n - 1; i > 0; i--) {
+        subid >>= 7;
+        data[i - 1] = (subid & 0x7f) | 0x80;
+    }
+    return data + n;
+}
+
+/**
+ * @internal
+ * Writes an ASN object identifier forwards.
+ *
+ * @param data        IN - where to write
+ * @param type        IN - type of object
+ * @param objid       IN - pointer to the object id
+ * @param objidlength IN - number of sub-identifiers
+ * @param length      IN - content length from asn_presize_objid()
+ *
+ * @return pointer to the first octet after the object
+ */
+u_char         *
+asn_presized_build_objid(u_char * data, u_char type, const oid * objid,
+                         size_t objidlength, size_t length)
+{
+    size_t          i;
+    oid             tmpint;
+
+    data = asn_presized_build_header(data, type, length);
+    if (objidlength == 0) {
+        *data++ = 0;
+    } else if (objidlength == 1) {
+        *data++ = (u_char) (40 * objid[0]);
+    } else {
+        data = _asn_presized_build_subid(data, objid[0] * 40 + objid[1]);
+        for (i = 2; i < objidlength; i++) {
+            tmpint = objid[i];
+            CHECK_OVERFLOW_U(tmpint, 17);
+            data = _asn_presized_build_subid(data, tmpint);
+        }
+    }
+    return data;
+}
 #endif                          /*  NETSNMP_USE_REVERSE_ASNENCODING  */
 /**
  * @}
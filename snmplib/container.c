@@ -18,6 +18,7 @@
 #include <net-snmp/net-snmp-includes.h>
 #include <net-snmp/library/container.h>
 #include <net-snmp/library/container_binary_array.h>
+#include <net-snmp/library/container_btree.h>
 #include <net-snmp/library/container_list_ssll.h>
 #include <net-snmp/library/container_null.h>
 #include "factory.h"
@@ -95,6 +96,9 @@ netsnmp_container_init_list(void)
      * register containers
      */
     netsnmp_container_binary_array_init();
+#ifndef NETSNMP_FEATURE_REMOVE_CONTAINER_BTREE
+    netsnmp_container_btree_init();
+#endif /* NETSNMP_FEATURE_REMOVE_CONTAINER_BTREE */
 #ifndef NETSNMP_FEATURE_REMOVE_CONTAINER_LINKED_LIST
     netsnmp_container_ssll_init();
 #endif /* NETSNMP_FEATURE_REMOVE_CONTAINER_LINKED_LIST */
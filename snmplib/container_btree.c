@@ -0,0 +1,1052 @@
+/*
+ * container_btree.c
+ * $Id$
+ *
+ * A sorted container backed by a B+tree. Items live in fixed size leaf
+ * nodes which are chained together for in-order traversal; inner nodes
+ * only hold separator keys, child pointers and the number of items below
+ * each child, so that positional access (get_at/remove_at) is O(log n)
+ * too. Unlike the binary_array container, inserts and removes never move
+ * more than one node's worth of pointers, which keeps building or
+ * updating large tables from going quadratic.
+ */
+
+#include <net-snmp/net-snmp-config.h>
+#include <net-snmp/net-snmp-features.h>
+
+#include <stdio.h>
+#ifdef HAVE_STDLIB_H
+#include <stdlib.h>
+#endif
+#ifdef HAVE_MALLOC_H
+#include <malloc.h>
+#endif
+#include <sys/types.h>
+#ifdef HAVE_STRING_H
+#include <string.h>
+#else
+#include <strings.h>
+#endif
+
+#include <net-snmp/net-snmp-includes.h>
+#include <net-snmp/types.h>
+#include <net-snmp/library/snmp_api.h>
+#include <net-snmp/library/container.h>
+#include <net-snmp/library/container_btree.h>
+#include <net-snmp/library/tools.h>
+#include <net-snmp/library/snmp_assert.h>
+#include "factory.h"
+
+netsnmp_feature_child_of(container_btree, container_types);
+
+#ifndef NETSNMP_FEATURE_REMOVE_CONTAINER_BTREE
+
+/*
+ * Node sizes. A leaf holds up to BT_LEAF_MAX item pointers (512 bytes on
+ * a 64 bit host), an inner node up to BT_INNER_MAX children. Non-root
+ * nodes are kept at least half full.
+ */
+#define BT_LEAF_MAX     64
+#define BT_INNER_MAX    32
+#define BT_LEAF_MIN     (BT_LEAF_MAX / 2)
+#define BT_INNER_MIN    (BT_INNER_MAX / 2)
+
+typedef struct btree_node_s {
+    u_short                    leaf;       /* 1 for leaves, 0 for inner */
+    u_short                    n;          /* items or children in use */
+} btree_node;
+
+typedef struct btree_leaf_s {
+    btree_node                 hdr;
+    struct btree_leaf_s       *prev, *next;
+    void                      *item[BT_LEAF_MAX];
+} btree_leaf;
+
+typedef struct btree_inner_s {
+    btree_node                 hdr;
+    /*
+     * key[i] (i > 0) separates child[i-1] from child[i]: it is the first
+     * item below child[i], so every item in child[i-1] compares <= key[i]
+     * and every item in child[i] >= key[i]. Being an item, it must be
+     * replaced before that item leaves the tree. key[0] is unused.
+     */
+    void                      *key[BT_INNER_MAX];
+    btree_node                *child[BT_INNER_MAX];
+    size_t                     count[BT_INNER_MAX];
+} btree_inner;
+
+typedef struct btree_container_s {
+    netsnmp_container          c;
+
+    size_t                     count;      /* number of items stored */
+    btree_node                *root;
+    btree_leaf                *head;       /* leftmost leaf */
+    btree_leaf                *tail;       /* rightmost leaf */
+} btree_container;
+
+typedef struct btree_iterator_s {
+    netsnmp_iterator           base;
+
+    size_t                     pos;        /* global index */
+    btree_leaf                *leaf;       /* cached position of pos, */
+    int                        lpos;       /*  NULL leaf if unknown */
+} btree_iterator;
+
+static netsnmp_iterator *_bt_iterator_get(netsnmp_container *c);
+
+/**********************************************************************
+ *
+ * node helpers
+ *
+ */
+static btree_leaf *
+_bt_leaf_new(void)
+{
+    btree_leaf *l = SNMP_MALLOC_TYPEDEF(btree_leaf);
+    if (NULL != l)
+        l->hdr.leaf = 1;
+    return l;
+}
+
+static btree_inner *
+_bt_inner_new(void)
+{
+    return SNMP_MALLOC_TYPEDEF(btree_inner);
+}
+
+static size_t
+_bt_node_count(btree_node *n)
+{
+    btree_inner *in;
+    size_t       total = 0;
+    int          i;
+
+    if (n->leaf)
+        return n->n;
+
+    in = (btree_inner *)n;
+    for (i = 0; i < n->n; ++i)
+        total += in->count[i];
+    return total;
+}
+
+/*
+ * The first item below a node.
+ */
+static void *
+_bt_first_item(btree_node *n)
+{
+    while (!n->leaf)
+        n = ((btree_inner *)n)->child[0];
+    return ((btree_leaf *)n)->item[0];
+}
+
+static void
+_bt_node_free(btree_node *n)
+{
+    if (!n->leaf) {
+        btree_inner *in = (btree_inner *)n;
+        int          i;
+
+        for (i = 0; i < n->n; ++i)
+            _bt_node_free(in->child[i]);
+    }
+    free(n);
+}
+
+/*
+ * Number of entries e in v[from..to) for which cmp(e, key) < 0 (or <= 0
+ * if strict is set). The entries are sorted, so this is a binary search.
+ */
+static int
+_bt_rank(void **v, int from, int to, const void *key,
+         netsnmp_container_compare *cmp, int strict)
+{
+    int lo = from, hi = to, mid, rc;
+
+    while (lo < hi) {
+        mid = lo + ((hi - lo) >> 1);
+        rc = cmp(v[mid], key);
+        if (rc < 0 || (strict && rc == 0))
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo - from;
+}
+
+/*
+ * Find the first item e for which cmp(e, key) >= 0 (or > 0 if strict is
+ * set). Returns the leaf and position in the leaf, and optionally the
+ * global index of the item. Returns 0 if there is no such item.
+ */
+static int
+_bt_seek(btree_container *t, const void *key, netsnmp_container_compare *cmp,
+         int strict, btree_leaf **leaf, int *lpos, size_t *index)
+{
+    btree_node *n = t->root;
+    size_t      skipped = 0;
+    int         i, c;
+
+    while (!n->leaf) {
+        btree_inner *in = (btree_inner *)n;
+
+        c = _bt_rank(in->key, 1, n->n, key, cmp, strict);
+        for (i = 0; i < c; ++i)
+            skipped += in->count[i];
+        n = in->child[c];
+    }
+
+    *leaf = (btree_leaf *)n;
+    *lpos = _bt_rank((*leaf)->item, 0, n->n, key, cmp, strict);
+    if (*lpos >= (*leaf)->hdr.n) {
+        /*
+         * the separator only bounds this leaf, so the answer may be the
+         * first item of the next one.
+         */
+        skipped += (*leaf)->hdr.n;
+        *leaf = (*leaf)->next;
+        *lpos = 0;
+        if (NULL == *leaf)
+            return 0;
+    }
+    if (index)
+        *index = skipped + *lpos;
+    return 1;
+}
+
+/*
+ * Locate the item at a global index.
+ */
+static int
+_bt_locate(btree_container *t, size_t index, btree_leaf **leaf, int *lpos)
+{
+    btree_node *n = t->root;
+    int         i;
+
+    if (index >= t->count)
+        return 0;
+
+    while (!n->leaf) {
+        btree_inner *in = (btree_inner *)n;
+
+        for (i = 0; i < n->n - 1 && index >= in->count[i]; ++i)
+            index -= in->count[i];
+        n = in->child[i];
+    }
+    netsnmp_assert(index < n->n);
+    *leaf = (btree_leaf *)n;
+    *lpos = (int)index;
+    return 1;
+}
+
+/**********************************************************************
+ *
+ * insert
+ *
+ */
+static int
+_bt_leaf_insert(btree_container *t, btree_leaf *l, int pos, void *item,
+                btree_node **split, void **split_key)
+{
+    btree_leaf *r;
+    int         mid = BT_LEAF_MAX / 2;
+
+    if (l->hdr.n < BT_LEAF_MAX) {
+        memmove(&l->item[pos + 1], &l->item[pos],
+                (l->hdr.n - pos) * sizeof(void *));
+        l->item[pos] = item;
+        ++l->hdr.n;
+        return 0;
+    }
+
+    r = _bt_leaf_new();
+    if (NULL == r)
+        return -1;
+    memcpy(r->item, &l->item[mid], (BT_LEAF_MAX - mid) * sizeof(void *));
+    r->hdr.n = BT_LEAF_MAX - mid;
+    l->hdr.n = mid;
+
+    r->prev = l;
+    r->next = l->next;
+    if (l->next)
+        l->next->prev = r;
+    else
+        t->tail = r;
+    l->next = r;
+
+    if (pos <= mid)
+        _bt_leaf_insert(t, l, pos, item, NULL, NULL);
+    else
+        _bt_leaf_insert(t, r, pos - mid, item, NULL, NULL);
+
+    *split = &r->hdr;
+    *split_key = r->item[0];
+    return 0;
+}
+
+static void
+_bt_inner_add(btree_inner *in, int pos, btree_node *child, void *key,
+              size_t count)
+{
+    int tail = in->hdr.n - pos;
+
+    memmove(&in->child[pos + 1], &in->child[pos], tail * sizeof(void *));
+    memmove(&in->key[pos + 1], &in->key[pos], tail * sizeof(void *));
+    memmove(&in->count[pos + 1], &in->count[pos], tail * sizeof(size_t));
+    in->child[pos] = child;
+    in->key[pos] = key;
+    in->count[pos] = count;
+    ++in->hdr.n;
+}
+
+static int
+_bt_insert_rec(btree_container *t, btree_node *n, void *item,
+               btree_node **split, void **split_key)
+{
+    btree_inner *in, *r = NULL;
+    btree_node  *csplit = NULL;
+    void        *ckey = NULL;
+    size_t       rcount;
+    int          i, mid = BT_INNER_MAX / 2;
+
+    if (n->leaf) {
+        btree_leaf *l = (btree_leaf *)n;
+        /* insert after any duplicates, like binary_array does */
+        i = _bt_rank(l->item, 0, n->n, item, t->c.compare, 1);
+        return _bt_leaf_insert(t, l, i, item, split, split_key);
+    }
+
+    /*
+     * if this node is full, a split below would have to split it as
+     * well. Allocate the sibling up front so that running out of memory
+     * leaves the tree untouched.
+     */
+    if (n->n == BT_INNER_MAX && NULL == (r = _bt_inner_new()))
+        return -1;
+
+    in = (btree_inner *)n;
+    i = _bt_rank(in->key, 1, n->n, item, t->c.compare, 1);
+    if (_bt_insert_rec(t, in->child[i], item, &csplit, &ckey) != 0) {
+        free(r);
+        return -1;
+    }
+    ++in->count[i];
+    if (NULL == csplit) {
+        free(r);
+        return 0;
+    }
+
+    rcount = _bt_node_count(csplit);
+    in->count[i] -= rcount;
+
+    if (NULL == r) {
+        _bt_inner_add(in, i + 1, csplit, ckey, rcount);
+        return 0;
+    }
+
+    /*
+     * no room for the new child; split this node, then add it to
+     * whichever half it belongs in.
+     */
+    memcpy(r->child, &in->child[mid], (BT_INNER_MAX - mid) * sizeof(void *));
+    memcpy(r->key, &in->key[mid], (BT_INNER_MAX - mid) * sizeof(void *));
+    memcpy(r->count, &in->count[mid], (BT_INNER_MAX - mid) * sizeof(size_t));
+    r->hdr.n = BT_INNER_MAX - mid;
+    n->n = mid;
+
+    if (i + 1 <= mid)
+        _bt_inner_add(in, i + 1, csplit, ckey, rcount);
+    else
+        _bt_inner_add(r, i + 1 - mid, csplit, ckey, rcount);
+
+    *split = &r->hdr;
+    *split_key = r->key[0];
+    r->key[0] = NULL;
+    return 0;
+}
+
+static int
+_bt_insert(btree_container *t, const void *data)
+{
+    btree_node  *split = NULL;
+    void        *split_key = NULL;
+    void        *item = NETSNMP_REMOVE_CONST(void *, data);
+    btree_leaf  *leaf;
+    btree_inner *root = NULL;
+    int          lpos;
+
+    if (NULL == item)
+        return -1;
+
+    if (!(t->c.flags & CONTAINER_KEY_ALLOW_DUPLICATES) &&
+        _bt_seek(t, item, t->c.compare, 0, &leaf, &lpos, NULL) &&
+        t->c.compare(leaf->item[lpos], item) == 0) {
+        DEBUGMSGTL(("container","not inserting duplicate key\n"));
+        return -1;
+    }
+
+    /* a full root may need a new root above it */
+    if ((t->root->n == (t->root->leaf ? BT_LEAF_MAX : BT_INNER_MAX) &&
+         NULL == (root = _bt_inner_new())) ||
+        _bt_insert_rec(t, t->root, item, &split, &split_key) != 0) {
+        free(root);
+        snmp_log(LOG_ERR, "malloc failed in btree insert\n");
+        return -1;
+    }
+
+    if (NULL != split) {
+        root->child[0] = t->root;
+        root->count[0] = _bt_node_count(t->root);
+        root->child[1] = split;
+        root->key[1] = split_key;
+        root->count[1] = _bt_node_count(split);
+        root->hdr.n = 2;
+        t->root = &root->hdr;
+    } else
+        free(root);
+
+    ++t->count;
+    ++t->c.sync;
+    return 0;
+}
+
+/**********************************************************************
+ *
+ * remove
+ *
+ */
+
+/*
+ * child[i] of p has dropped below its minimum fill; merge it with, or
+ * borrow one entry from, an adjacent sibling.
+ */
+static void
+_bt_rebalance(btree_container *t, btree_inner *p, int i)
+{
+    int         a = i > 0 ? i - 1 : 0, b = a + 1;
+    btree_node *na = p->child[a], *nb = p->child[b];
+    int         maxn = na->leaf ? BT_LEAF_MAX : BT_INNER_MAX;
+    int         j;
+
+    if (na->n + nb->n <= maxn) {
+        /*
+         * merge b into a
+         */
+        if (na->leaf) {
+            btree_leaf *la = (btree_leaf *)na, *lb = (btree_leaf *)nb;
+
+            memcpy(&la->item[na->n], lb->item, nb->n * sizeof(void *));
+            la->next = lb->next;
+            if (lb->next)
+                lb->next->prev = la;
+            else
+                t->tail = la;
+        } else {
+            btree_inner *ia = (btree_inner *)na, *ib = (btree_inner *)nb;
+
+            for (j = 0; j < nb->n; ++j) {
+                ia->child[na->n + j] = ib->child[j];
+                ia->count[na->n + j] = ib->count[j];
+                ia->key[na->n + j] = j ? ib->key[j] : p->key[b];
+            }
+        }
+        na->n += nb->n;
+        p->count[a] += p->count[b];
+        free(nb);
+
+        memmove(&p->child[b], &p->child[b + 1],
+                (p->hdr.n - b - 1) * sizeof(void *));
+        memmove(&p->key[b], &p->key[b + 1],
+                (p->hdr.n - b - 1) * sizeof(void *));
+        memmove(&p->count[b], &p->count[b + 1],
+                (p->hdr.n - b - 1) * sizeof(size_t));
+        --p->hdr.n;
+        return;
+    }
+
+    if (na->leaf) {
+        btree_leaf *la = (btree_leaf *)na, *lb = (btree_leaf *)nb;
+
+        if (a == i) {
+            /* a is short; take the first item of b */
+            la->item[na->n++] = lb->item[0];
+            memmove(&lb->item[0], &lb->item[1], --nb->n * sizeof(void *));
+            ++p->count[a];
+            --p->count[b];
+        } else {
+            /* b is short; take the last item of a */
+            memmove(&lb->item[1], &lb->item[0], nb->n++ * sizeof(void *));
+            lb->item[0] = la->item[--na->n];
+            --p->count[a];
+            ++p->count[b];
+        }
+        p->key[b] = lb->item[0];
+    } else {
+        btree_inner *ia = (btree_inner *)na, *ib = (btree_inner *)nb;
+        size_t       moved;
+
+        if (a == i) {
+            /* a is short; rotate the first child of b through p */
+            ia->child[na->n] = ib->child[0];
+            ia->count[na->n] = moved = ib->count[0];
+            ia->key[na->n] = p->key[b];
+            ++na->n;
+            p->key[b] = ib->key[1];
+            --nb->n;
+            memmove(&ib->child[0], &ib->child[1], nb->n * sizeof(void *));
+            memmove(&ib->count[0], &ib->count[1], nb->n * sizeof(size_t));
+            memmove(&ib->key[1], &ib->key[2], (nb->n - 1) * sizeof(void *));
+            p->count[a] += moved;
+            p->count[b] -= moved;
+        } else {
+            /* b is short; rotate the last child of a through p */
+            memmove(&ib->child[1], &ib->child[0], nb->n * sizeof(void *));
+            memmove(&ib->count[1], &ib->count[0], nb->n * sizeof(size_t));
+            memmove(&ib->key[2], &ib->key[1], (nb->n - 1) * sizeof(void *));
+            ++nb->n;
+            --na->n;
+            ib->key[1] = p->key[b];
+            ib->child[0] = ia->child[na->n];
+            ib->count[0] = moved = ia->count[na->n];
+            p->key[b] = ia->key[na->n];
+            p->count[a] -= moved;
+            p->count[b] += moved;
+        }
+    }
+}
+
+static void *
+_bt_remove_rec(btree_container *t, btree_node *n, size_t index)
+{
+    btree_inner *in;
+    void        *item;
+    int          i;
+
+    if (n->leaf) {
+        btree_leaf *l = (btree_leaf *)n;
+
+        item = l->item[index];
+        --n->n;
+        memmove(&l->item[index], &l->item[index + 1],
+                (n->n - index) * sizeof(void *));
+        return item;
+    }
+
+    in = (btree_inner *)n;
+    for (i = 0; i < n->n - 1 && index >= in->count[i]; ++i)
+        index -= in->count[i];
+
+    item = _bt_remove_rec(t, in->child[i], index);
+    --in->count[i];
+
+    /*
+     * the caller may free the item as soon as it is removed, so a
+     * separator must not go on pointing at it. Non-root nodes are never
+     * emptied here, so there is a new first item to take its place.
+     */
+    if (i > 0 && in->key[i] == item)
+        in->key[i] = _bt_first_item(in->child[i]);
+
+    if (in->child[i]->n <
+        (in->child[i]->leaf ? BT_LEAF_MIN : BT_INNER_MIN))
+        _bt_rebalance(t, in, i);
+
+    return item;
+}
+
+static int
+_bt_remove_index(btree_container *t, size_t index, void **save)
+{
+    btree_node *old;
+    void       *item;
+
+    if (index >= t->count)
+        return -1;
+
+    item = _bt_remove_rec(t, t->root, index);
+    if (save)
+        *save = item;
+
+    /*
+     * drop a level when the root is down to a single child
+     */
+    if (!t->root->leaf && t->root->n == 1) {
+        old = t->root;
+        t->root = ((btree_inner *)old)->child[0];
+        free(old);
+    }
+
+    --t->count;
+    ++t->c.sync;
+    return 0;
+}
+
+/**********************************************************************
+ *
+ * container
+ *
+ */
+static void *
+_bt_find(netsnmp_container *c, const void *key)
+{
+    btree_container *t = (btree_container *)c;
+    btree_leaf      *leaf;
+    int              lpos;
+
+    if (NULL == key || !t->count)
+        return NULL;
+
+    if (!_bt_seek(t, key, c->compare, 0, &leaf, &lpos, NULL) ||
+        c->compare(leaf->item[lpos], key) != 0)
+        return NULL;
+
+    return leaf->item[lpos];
+}
+
+static void *
+_bt_find_next(netsnmp_container *c, const void *key)
+{
+    btree_container *t = (btree_container *)c;
+    btree_leaf      *leaf;
+    int              lpos;
+
+    if (!t->count)
+        return NULL;
+
+    if (NULL == key)
+        return t->head->item[0];
+
+    /* strict seek skips over any duplicates of key */
+    if (!_bt_seek(t, key, c->compare, 1, &leaf, &lpos, NULL))
+        return NULL;
+
+    return leaf->item[lpos];
+}
+
+static int
+_bt_container_insert(netsnmp_container *c, const void *data)
+{
+    return _bt_insert((btree_container *)c, data);
+}
+
+static int
+_bt_insert_before(netsnmp_container *c, size_t index, void *data)
+{
+    btree_container *t = (btree_container *)c;
+    btree_leaf      *leaf;
+    int              lpos;
+
+    if (NULL == data || index > t->count)
+        return -1;
+
+    /*
+     * a B+tree can't hold items out of order, so only accept the
+     * insert if it agrees with where the item sorts anyway.
+     */
+    if (index > 0 && _bt_locate(t, index - 1, &leaf, &lpos) &&
+        c->compare(leaf->item[lpos], data) > 0)
+        goto out_of_order;
+    if (index < t->count && _bt_locate(t, index, &leaf, &lpos) &&
+        c->compare(leaf->item[lpos], data) < 0)
+        goto out_of_order;
+
+    return _bt_insert(t, data);
+
+  out_of_order:
+    DEBUGMSGTL(("container:btree", "insert_before would break sort order\n"));
+    return -1;
+}
+
+static int
+_bt_remove(netsnmp_container *c, const void *key)
+{
+    btree_container *t = (btree_container *)c;
+    btree_leaf      *leaf;
+    size_t           index;
+    int              lpos;
+
+    if (NULL == key || !t->count)
+        return -1;
+
+    if (!_bt_seek(t, key, c->compare, 0, &leaf, &lpos, &index) ||
+        c->compare(leaf->item[lpos], key) != 0)
+        return -1;
+
+    return _bt_remove_index(t, index, NULL);
+}
+
+static int
+_bt_remove_at(netsnmp_container *c, size_t index, void **save)
+{
+    if (save)
+        *save = NULL;
+
+    return _bt_remove_index((btree_container *)c, index, save);
+}
+
+static int
+_bt_get_at(netsnmp_container *c, size_t index, void **entry)
+{
+    btree_leaf *leaf;
+    int         lpos;
+
+    if (NULL == entry ||
+        !_bt_locate((btree_container *)c, index, &leaf, &lpos))
+        return -1;
+
+    *entry = leaf->item[lpos];
+    return 0;
+}
+
+static size_t
+_bt_size(netsnmp_container *c)
+{
+    return ((btree_container *)c)->count;
+}
+
+static void
+_bt_for_each(netsnmp_container *c, netsnmp_container_obj_func *f,
+             void *context)
+{
+    btree_container *t = (btree_container *)c;
+    btree_leaf      *leaf;
+    int              i;
+
+    for (leaf = t->head; leaf; leaf = leaf->next)
+        for (i = 0; i < leaf->hdr.n; ++i)
+            (*f) (leaf->item[i], context);
+}
+
+static int
+_bt_reset(btree_container *t)
+{
+    btree_leaf *leaf = _bt_leaf_new();
+
+    if (NULL == leaf)
+        return -1;
+
+    t->root = &leaf->hdr;
+    t->head = t->tail = leaf;
+    t->count = 0;
+    return 0;
+}
+
+static void
+_bt_clear(netsnmp_container *c, netsnmp_container_obj_func *f,
+          void *context)
+{
+    btree_container *t = (btree_container *)c;
+    btree_node      *old = t->root;
+
+    if (NULL != f)
+        _bt_for_each(c, f, context);
+
+    if (_bt_reset(t) != 0) {
+        /* keep the (emptied) old leaves rather than lose the container */
+        snmp_log(LOG_ERR, "malloc failed in btree clear\n");
+        return;
+    }
+    _bt_node_free(old);
+    ++c->sync;
+}
+
+static netsnmp_void_array *
+_bt_get_subset(netsnmp_container *c, void *key)
+{
+    btree_container    *t = (btree_container *)c;
+    netsnmp_void_array *va;
+    btree_leaf         *leaf, *l;
+    size_t              len = 0;
+    int                 lpos, i;
+
+    if (NULL == key || !t->count)
+        return NULL;
+
+    netsnmp_assert(c->ncompare);
+    if (NULL == c->ncompare ||
+        !_bt_seek(t, key, c->ncompare, 0, &leaf, &lpos, NULL))
+        return NULL;
+
+    /*
+     * count the matches, then copy them out
+     */
+    for (l = leaf, i = lpos; l; l = l->next, i = 0) {
+        for (; i < l->hdr.n; ++i)
+            if (c->ncompare(l->item[i], key) != 0)
+                break;
+            else
+                ++len;
+        if (i < l->hdr.n)
+            break;
+    }
+    if (0 == len || len > INT_MAX / sizeof(void *))
+        return NULL;
+
+    va = SNMP_MALLOC_TYPEDEF(netsnmp_void_array);
+    if (NULL == va)
+        return NULL;
+    va->array = malloc(len * sizeof(void *));
+    if (NULL == va->array) {
+        free(va);
+        return NULL;
+    }
+    va->size = len;
+
+    for (len = 0, l = leaf, i = lpos; len < va->size; l = l->next, i = 0)
+        for (; i < l->hdr.n && len < va->size; ++i)
+            va->array[len++] = l->item[i];
+
+    return va;
+}
+
+static int
+_bt_options(netsnmp_container *c, int set, u_int flags)
+{
+    if (set) {
+        /* items must stay sorted, so only duplicates are supported */
+        if ((flags & CONTAINER_KEY_ALLOW_DUPLICATES) != flags)
+            return -1;
+        c->flags = flags;
+        return flags;
+    }
+
+    return ((c->flags & flags) == flags);
+}
+
+static int
+_bt_free(netsnmp_container *c)
+{
+    btree_container *t = (btree_container *)c;
+
+    _bt_node_free(t->root);
+    SNMP_FREE(c->container_name);
+    free(t);
+    return 0;
+}
+
+static netsnmp_container *
+_bt_duplicate(netsnmp_container *c, void *ctx, u_int flags)
+{
+    btree_container *t = (btree_container *)c;
+    netsnmp_container *dup;
+    btree_leaf      *leaf;
+    int              i;
+
+    if (flags) {
+        snmp_log(LOG_ERR, "btree duplicate does not support flags yet\n");
+        return NULL;
+    }
+
+    dup = netsnmp_container_get_btree();
+    if (NULL == dup) {
+        snmp_log(LOG_ERR, "no memory for btree duplicate\n");
+        return NULL;
+    }
+    if (netsnmp_container_data_dup(dup, c) != 0) {
+        _bt_free(dup);
+        return NULL;
+    }
+
+    /*
+     * shallow copy; items arrive in order, so each insert lands in the
+     * rightmost leaf.
+     */
+    for (leaf = t->head; leaf; leaf = leaf->next)
+        for (i = 0; i < leaf->hdr.n; ++i)
+            if (_bt_insert((btree_container *)dup, leaf->item[i]) != 0) {
+                snmp_log(LOG_ERR, "no memory for btree duplicate\n");
+                _bt_free(dup);
+                return NULL;
+            }
+
+    return dup;
+}
+
+netsnmp_container *
+netsnmp_container_get_btree(void)
+{
+    btree_container *t = SNMP_MALLOC_TYPEDEF(btree_container);
+    if (NULL == t) {
+        snmp_log(LOG_ERR, "couldn't allocate memory\n");
+        return NULL;
+    }
+
+    if (_bt_reset(t) != 0) {
+        free(t);
+        snmp_log(LOG_ERR, "couldn't allocate memory for container_data\n");
+        return NULL;
+    }
+
+    /*
+     * NOTE: CHANGES HERE MUST BE DUPLICATED IN duplicate AS WELL!!
+     */
+    netsnmp_init_container(&t->c, NULL, _bt_free, _bt_size, NULL,
+                           _bt_container_insert, _bt_remove, _bt_find);
+    t->c.find_next = _bt_find_next;
+    t->c.get_subset = _bt_get_subset;
+    t->c.get_iterator = _bt_iterator_get;
+    t->c.for_each = _bt_for_each;
+    t->c.clear = _bt_clear;
+    t->c.options = _bt_options;
+    t->c.duplicate = _bt_duplicate;
+    t->c.get_at = _bt_get_at;
+    t->c.remove_at = _bt_remove_at;
+    t->c.insert_before = _bt_insert_before;
+
+    return &t->c;
+}
+
+netsnmp_factory *
+netsnmp_container_get_btree_factory(void)
+{
+    static netsnmp_factory f = { "btree",
+                                 netsnmp_container_get_btree };
+
+    return &f;
+}
+
+void
+netsnmp_container_btree_init(void)
+{
+    netsnmp_container_register("btree",
+                               netsnmp_container_get_btree_factory());
+}
+
+/**********************************************************************
+ *
+ * iterator
+ *
+ */
+static void *
+_bt_iterator_position(btree_iterator *it, size_t pos, int cache)
+{
+    btree_container *t = (btree_container *)it->base.container;
+    btree_leaf      *leaf;
+    int              lpos;
+
+    if (it->base.container->sync != it->base.sync) {
+        DEBUGMSGTL(("container:iterator", "out of sync\n"));
+        return NULL;
+    }
+
+    if (cache && NULL != it->leaf)
+        return it->leaf->item[it->lpos];
+
+    if (!_bt_locate(t, pos, &leaf, &lpos)) {
+        DEBUGMSGTL(("container:iterator", "end of container\n"));
+        return NULL;
+    }
+    if (cache) {
+        it->leaf = leaf;
+        it->lpos = lpos;
+    }
+
+    return leaf->item[lpos];
+}
+
+static void *
+_bt_iterator_curr(netsnmp_iterator *nit)
+{
+    btree_iterator *it = (btree_iterator *)nit;
+
+    return _bt_iterator_position(it, it->pos, 1);
+}
+
+static void *
+_bt_iterator_first(netsnmp_iterator *nit)
+{
+    return _bt_iterator_position((btree_iterator *)nit, 0, 0);
+}
+
+static void *
+_bt_iterator_next(netsnmp_iterator *nit)
+{
+    btree_iterator *it = (btree_iterator *)nit;
+
+    ++it->pos;
+    if (NULL != it->leaf && ++it->lpos >= it->leaf->hdr.n) {
+        it->leaf = it->leaf->next;
+        it->lpos = 0;
+    }
+    return _bt_iterator_position(it, it->pos, 1);
+}
+
+static void *
+_bt_iterator_last(netsnmp_iterator *nit)
+{
+    btree_iterator  *it = (btree_iterator *)nit;
+    btree_container *t = (btree_container *)it->base.container;
+
+    return _bt_iterator_position(it, t->count - 1, 0);
+}
+
+static int
+_bt_iterator_remove(netsnmp_iterator *nit)
+{
+    btree_iterator *it = (btree_iterator *)nit;
+
+    /*
+     * since this iterator was used for the remove, keep it in sync with
+     * the container. Also, back up one so that next will be the position
+     * that was just removed. The tree may have been reshaped, so forget
+     * the cached leaf.
+     */
+    ++it->base.sync;
+    it->leaf = NULL;
+    return _bt_remove_at(it->base.container, it->pos--, NULL);
+}
+
+static int
+_bt_iterator_reset(netsnmp_iterator *nit)
+{
+    btree_iterator *it = (btree_iterator *)nit;
+
+    /*
+     * save sync count, to make sure container doesn't change while
+     * iterator is in use.
+     */
+    it->base.sync = it->base.container->sync;
+    it->pos = 0;
+    it->leaf = NULL;
+
+    return 0;
+}
+
+static int
+_bt_iterator_release(netsnmp_iterator *it)
+{
+    free(it);
+
+    return 0;
+}
+
+static netsnmp_iterator *
+_bt_iterator_get(netsnmp_container *c)
+{
+    btree_iterator *it;
+
+    if (NULL == c)
+        return NULL;
+
+    it = SNMP_MALLOC_TYPEDEF(btree_iterator);
+    if (NULL == it)
+        return NULL;
+
+    it->base.container = c;
+
+    it->base.first = _bt_iterator_first;
+    it->base.next = _bt_iterator_next;
+    it->base.curr = _bt_iterator_curr;
+    it->base.last = _bt_iterator_last;
+    it->base.remove = _bt_iterator_remove;
+    it->base.reset = _bt_iterator_reset;
+    it->base.release = _bt_iterator_release;
+
+    (void)_bt_iterator_reset(&it->base);
+
+    return &it->base;
+}
+#else  /* NETSNMP_FEATURE_REMOVE_CONTAINER_BTREE */
+netsnmp_feature_unused(container_btree);
+#endif /* NETSNMP_FEATURE_REMOVE_CONTAINER_BTREE */
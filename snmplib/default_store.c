@@ -182,6 +182,7 @@ static char *netsnmp_ds_strings[NETSNMP_DS_MAX_IDS][NETSNMP_DS_MAX_SUBIDS];
 #ifndef NETSNMP_FEATURE_REMOVE_DEFAULT_STORE_VOID
 static void *netsnmp_ds_voids[NETSNMP_DS_MAX_IDS][NETSNMP_DS_MAX_SUBIDS];
 #endif /* NETSNMP_FEATURE_REMOVE_DEFAULT_STORE_VOID */
+static u_int netsnmp_ds_changes = 1;
 
 /**
  * Stores "true" or "false" given an int value for value into
@@ -199,6 +200,8 @@ static void *netsnmp_ds_voids[NETSNMP_DS_MAX_IDS][NETSNMP_DS_MAX_SUBIDS];
 int
 netsnmp_ds_set_boolean(int storeid, int which, int value)
 {
+    char old;
+
     if (storeid < 0 || storeid >= NETSNMP_DS_MAX_IDS || 
 	which   < 0 || which   >= NETSNMP_DS_MAX_SUBIDS) {
         return SNMPERR_GENERR;
@@ -207,11 +210,14 @@ netsnmp_ds_set_boolean(int storeid, int which, int value)
     DEBUGMSGTL(("netsnmp_ds_set_boolean", "Setting %s:%d = %d/%s\n",
                 stores[storeid], which, value, ((value) ? "True" : "False")));
 
+    old = netsnmp_ds_booleans[storeid][which/8];
     if (value > 0) {
         netsnmp_ds_booleans[storeid][which/8] |= (1 << (which % 8));
     } else {
         netsnmp_ds_booleans[storeid][which/8] &= (0xff7f >> (7 - (which % 8)));
     }
+    if (netsnmp_ds_booleans[storeid][which/8] != old)
+        netsnmp_ds_changes++;
 
     return SNMPERR_SUCCESS;
 }
@@ -229,6 +235,7 @@ netsnmp_ds_toggle_boolean(int storeid, int which)
     } else {
         netsnmp_ds_booleans[storeid][which/8] &= (0xff7f >> (7 - (which % 8)));
     }
+    netsnmp_ds_changes++;
 
     DEBUGMSGTL(("netsnmp_ds_toggle_boolean", "Setting %s:%d = %d/%s\n",
                 stores[storeid], which, netsnmp_ds_booleans[storeid][which/8],
@@ -259,7 +266,10 @@ netsnmp_ds_set_int(int storeid, int which, int value)
     DEBUGMSGTL(("netsnmp_ds_set_int", "Setting %s:%d = %d\n",
                 stores[storeid], which, value));
 
-    netsnmp_ds_integers[storeid][which] = value;
+    if (netsnmp_ds_integers[storeid][which] != value) {
+        netsnmp_ds_integers[storeid][which] = value;
+        netsnmp_ds_changes++;
+    }
     return SNMPERR_SUCCESS;
 }
 
@@ -290,6 +300,12 @@ netsnmp_ds_set_string(int storeid, int which, const char *value)
      */
     if (netsnmp_ds_strings[storeid][which] == value)
         return SNMPERR_SUCCESS;
+    /*
+     * or with the value it already has?
+     */
+    if (value && netsnmp_ds_strings[storeid][which] &&
+        strcmp(netsnmp_ds_strings[storeid][which], value) == 0)
+        return SNMPERR_SUCCESS;
 
     snmp_res_lock(MT_LIBRARY_ID, MT_LIB_SESSION);
     if (netsnmp_ds_strings[storeid][which] != NULL) {
@@ -303,6 +319,7 @@ netsnmp_ds_set_string(int storeid, int which, const char *value)
     } else {
         netsnmp_ds_strings[storeid][which] = NULL;
     }
+    netsnmp_ds_changes++;
 
     return SNMPERR_SUCCESS;
 }
@@ -330,7 +347,10 @@ netsnmp_ds_set_void(int storeid, int which, void *value)
     DEBUGMSGTL(("netsnmp_ds_set_void", "Setting %s:%d = %p\n",
                 stores[storeid], which, value));
 
-    netsnmp_ds_voids[storeid][which] = value;
+    if (netsnmp_ds_voids[storeid][which] != value) {
+        netsnmp_ds_voids[storeid][which] = value;
+        netsnmp_ds_changes++;
+    }
 
     return SNMPERR_SUCCESS;
 }
@@ -571,6 +591,18 @@ netsnmp_ds_shutdown(void)
             }
         }
     }
+    netsnmp_ds_changes++;
     snmp_res_unlock(MT_LIBRARY_ID, MT_LIB_SESSION);
 }
+
+/**
+ * Returns a number which changes whenever a value in the store is set
+ * to something other than what it was, so that callers can keep values
+ * derived from the store until then.
+ */
+u_int
+netsnmp_ds_generation(void)
+{
+    return netsnmp_ds_changes;
+}
 /**  @} */
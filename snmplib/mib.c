@@ -134,7 +134,13 @@ static int      print_tree_node(u_char ** buf, size_t * buf_len,
 static void     handle_mibdirs_conf(const char *token, char *line);
 static void     handle_mibs_conf(const char *token, char *line);
 static void     handle_mibfile_conf(const char *token, char *line);
+static void     mib_index_need_labels(const char *name);
+static void     mib_memo_free(void);
+static int      _get_node(const char *name, oid * objid,
+                          size_t * objidlen);
 #endif /*NETSNMP_DISABLE_MIB_LOADING */
+static int      _read_objid(const char *input, oid * output,
+                            size_t * out_len);
 
 static void     _oid_finish_printing(const oid * objid, size_t objidlen,
                                      u_char ** buf, size_t * buf_len,
@@ -199,6 +205,156 @@ enum inet_address_type {
 };
 
 
+/*
+ * The options the value printing functions follow.  Unless a caller has
+ * chosen others with netsnmp_print_options_use(), they are those in the
+ * default store, read again only once something in the store changed.
+ */
+static netsnmp_print_options print_options_ds;
+static u_int    print_options_ds_generation;
+static const netsnmp_print_options *print_options_chosen;
+
+/**
+ * Fills opts in with the current output options (the -O flags).
+ *
+ * @param opts  The options to fill in.
+ */
+void
+netsnmp_print_options_init(netsnmp_print_options *opts)
+{
+    memset(opts, 0, sizeof(*opts));
+    opts->quick_print = netsnmp_ds_get_boolean(NETSNMP_DS_LIBRARY_ID,
+                                               NETSNMP_DS_LIB_QUICK_PRINT);
+    opts->quicke_print = netsnmp_ds_get_boolean(NETSNMP_DS_LIBRARY_ID,
+                                                NETSNMP_DS_LIB_QUICKE_PRINT);
+    opts->bare_value = netsnmp_ds_get_boolean(NETSNMP_DS_LIBRARY_ID,
+                                              NETSNMP_DS_LIB_PRINT_BARE_VALUE);
+    opts->numeric_enum =
+        netsnmp_ds_get_boolean(NETSNMP_DS_LIBRARY_ID,
+                               NETSNMP_DS_LIB_PRINT_NUMERIC_ENUM);
+    opts->numeric_timeticks =
+        netsnmp_ds_get_boolean(NETSNMP_DS_LIBRARY_ID,
+                               NETSNMP_DS_LIB_NUMERIC_TIMETICKS);
+    opts->hex_text = netsnmp_ds_get_boolean(NETSNMP_DS_LIBRARY_ID,
+                                            NETSNMP_DS_LIB_PRINT_HEX_TEXT);
+    opts->hex_2digit = netsnmp_ds_get_boolean(NETSNMP_DS_LIBRARY_ID,
+                                              NETSNMP_DS_LIB_2DIGIT_HEX_OUTPUT);
+    opts->no_units = netsnmp_ds_get_boolean(NETSNMP_DS_LIBRARY_ID,
+                                            NETSNMP_DS_LIB_DONT_PRINT_UNITS);
+    opts->no_display_hint =
+        netsnmp_ds_get_boolean(NETSNMP_DS_LIBRARY_ID,
+                               NETSNMP_DS_LIB_NO_DISPLAY_HINT);
+    opts->string_format = netsnmp_ds_get_int(NETSNMP_DS_LIBRARY_ID,
+                                        NETSNMP_DS_LIB_STRING_OUTPUT_FORMAT);
+    opts->hex_line_len = netsnmp_ds_get_int(NETSNMP_DS_LIBRARY_ID,
+                                            NETSNMP_DS_LIB_HEX_OUTPUT_LENGTH);
+}
+
+/**
+ * Makes the sprint_realloc_* value functions, and those printing whole
+ * variables, follow opts instead of the options in the default store,
+ * e.g. to print with other options than the application's without
+ * changing those.  opts must stay valid while it is used.
+ *
+ * @param opts  The options to follow, or NULL to follow the default
+ *              store again.
+ *
+ * @return The options followed before.
+ */
+const netsnmp_print_options *
+netsnmp_print_options_use(const netsnmp_print_options *opts)
+{
+    const netsnmp_print_options *old = print_options_chosen;
+
+    print_options_chosen = opts;
+    return old;
+}
+
+static const netsnmp_print_options *
+print_options(void)
+{
+    u_int           generation;
+
+    if (print_options_chosen)
+        return print_options_chosen;
+    generation = netsnmp_ds_generation();
+    if (generation != print_options_ds_generation) {
+        netsnmp_print_options_init(&print_options_ds);
+        print_options_ds_generation = generation;
+    }
+    return &print_options_ds;
+}
+
+/*
+ * Formats v in decimal so that it ends at end, and returns its start.
+ */
+static char    *
+print_ulong(char *end, u_long v)
+{
+    do {
+        *--end = '0' + v % 10;
+        v /= 10;
+    } while (v);
+    return end;
+}
+
+static char    *
+print_long(char *end, long v)
+{
+    if (v >= 0)
+        return print_ulong(end, v);
+    end = print_ulong(end, 0UL - (u_long) v);
+    *--end = '-';
+    return end;
+}
+
+/*
+ * Appends len characters at str, and a terminating NUL, to the buffer.
+ */
+static int
+print_append(u_char ** buf, size_t * buf_len, size_t * out_len,
+             int allow_realloc, const char *str, size_t len)
+{
+    while (*out_len + len + 1 > *buf_len) {
+        if (!(allow_realloc && snmp_realloc(buf, buf_len)))
+            return 0;
+    }
+    memcpy(*buf + *out_len, str, len);
+    *out_len += len;
+    *(*buf + *out_len) = '\0';
+    return 1;
+}
+
+/*
+ * Appends prefix, the number v and suffix, any of the strings may be
+ * NULL.
+ */
+static int
+print_number(u_char ** buf, size_t * buf_len, size_t * out_len,
+             int allow_realloc, const char *prefix, long v, int is_signed,
+             const char *suffix)
+{
+    char            tmp[64], *end = tmp + sizeof(tmp), *cp;
+    size_t          len;
+
+    if (suffix) {
+        len = strlen(suffix);
+        if (len > 32)
+            return (print_number(buf, buf_len, out_len, allow_realloc,
+                                 prefix, v, is_signed, NULL) &&
+                    snmp_cstrcat(buf, buf_len, out_len, allow_realloc,
+                                 suffix));
+        end -= len;
+        memcpy(end, suffix, len);
+    }
+    cp = is_signed ? print_long(end, v) : print_ulong(end, (u_long) v);
+    if (prefix && !snmp_cstrcat(buf, buf_len, out_len, allow_realloc,
+                                prefix))
+        return 0;
+    return print_append(buf, buf_len, out_len, allow_realloc, cp,
+                        tmp + sizeof(tmp) - cp);
+}
+
 /**
  * @internal
  * Converts timeticks to hours, minutes, seconds string.
@@ -214,7 +370,7 @@ uptimeString(u_long timeticks, char *buf, size_t buflen)
 {
     int             centisecs, seconds, minutes, hours, days;
 
-    if (netsnmp_ds_get_boolean(NETSNMP_DS_LIBRARY_ID, NETSNMP_DS_LIB_NUMERIC_TIMETICKS)) {
+    if (print_options()->numeric_timeticks) {
         snprintf(buf, buflen, "%lu", timeticks);
         return buf;
     }
@@ -231,7 +387,7 @@ uptimeString(u_long timeticks, char *buf, size_t buflen)
     minutes = timeticks / 60;
     seconds = timeticks % 60;
 
-    if (netsnmp_ds_get_boolean(NETSNMP_DS_LIBRARY_ID, NETSNMP_DS_LIB_QUICK_PRINT))
+    if (print_options()->quick_print)
         snprintf(buf, buflen, "%d:%d:%02d:%02d.%02d",
                 days, hours, minutes, seconds, centisecs);
     else {
@@ -294,9 +450,10 @@ int
 _sprint_hexstring_line(u_char ** buf, size_t * buf_len, size_t * out_len,
                        int allow_realloc, const u_char * cp, size_t line_len)
 {
+    static const char hexdigits[] = "0123456789ABCDEF";
     const u_char   *tp;
     const u_char   *cp2 = cp;
-    size_t          lenleft = line_len;
+    u_char         *op;
 
     /*
      * Make sure there's enough room for the hex output....
@@ -310,22 +467,18 @@ _sprint_hexstring_line(u_char ** buf, size_t * buf_len, size_t * out_len,
     /*
      * .... and display the hex values themselves....
      */
-    for (; lenleft >= 8; lenleft-=8) {
-        sprintf((char *) (*buf + *out_len),
-                "%02X %02X %02X %02X %02X %02X %02X %02X ", cp[0], cp[1],
-                cp[2], cp[3], cp[4], cp[5], cp[6], cp[7]);
-        *out_len += strlen((char *) (*buf + *out_len));
-        cp       += 8;
-    }
-    for (; lenleft > 0; lenleft--) {
-        sprintf((char *) (*buf + *out_len), "%02X ", *cp++);
-        *out_len += strlen((char *) (*buf + *out_len));
+    for (op = *buf + *out_len; cp < cp2 + line_len; cp++) {
+        *op++ = hexdigits[*cp >> 4];
+        *op++ = hexdigits[*cp & 0xf];
+        *op++ = ' ';
     }
+    *op = '\0';
+    *out_len = op - *buf;
 
     /*
      * .... plus (optionally) do the same for the ASCII equivalent.
      */
-    if (netsnmp_ds_get_boolean(NETSNMP_DS_LIBRARY_ID, NETSNMP_DS_LIB_PRINT_HEX_TEXT)) {
+    if (print_options()->hex_text) {
         while ((*out_len + line_len+5) >= *buf_len) {
             if (!(allow_realloc && snmp_realloc(buf, buf_len))) {
                 return 0;
@@ -347,8 +500,7 @@ int
 sprint_realloc_hexstring(u_char ** buf, size_t * buf_len, size_t * out_len,
                          int allow_realloc, const u_char * cp, size_t len)
 {
-    int line_len = netsnmp_ds_get_int(NETSNMP_DS_LIBRARY_ID,
-                                      NETSNMP_DS_LIB_HEX_OUTPUT_LENGTH);
+    int line_len = print_options()->hex_line_len;
     if (line_len <= 0)
         line_len = len;
 
@@ -424,6 +576,178 @@ sprint_realloc_asciistring(u_char ** buf, size_t * buf_len,
     return 1;
 }
 
+/*
+ * One part of an OCTET STRING DISPLAY-HINT (RFC 2579, section 3.1), e.g.
+ * "1x:" or "*1d.".
+ */
+struct hint_spec {
+    int             width;
+    char            star, code, separ, term;
+};
+
+/*
+ * Splits hint into its parts, spec must have room for strlen(hint) of
+ * them.  Returns the number of parts.
+ */
+static int
+split_octet_hint(const char *hint, struct hint_spec *spec)
+{
+    int             count = 0;
+    char            ch;
+
+    while (*hint) {
+        spec->star = 0;
+        if (*hint == '*') {
+            spec->star = 1;
+            hint++;
+        }
+        spec->width = 0;
+        while ('0' <= *hint && *hint <= '9')
+            spec->width = (spec->width * 10) + (*hint++ - '0');
+        spec->code = *hint;
+        if (*hint)
+            hint++;
+        if ((ch = *hint) && ch != '*' && (ch < '0' || ch > '9')
+            && (spec->width != 0 || (ch != 'x' && ch != 'd' && ch != 'o')))
+            spec->separ = *hint++;
+        else
+            spec->separ = 0;
+        if ((ch = *hint) && ch != '*' && (ch < '0' || ch > '9')
+            && (spec->width != 0 || (ch != 'x' && ch != 'd' && ch != 'o')))
+            spec->term = *hint++;
+        else
+            spec->term = 0;
+        if (spec->width == 0)  /* Handle malformed hint strings */
+            spec->width = 1;
+        spec++;
+        count++;
+    }
+    return count;
+}
+
+/*
+ * Prints the octets of var as the hint parts spec[0 .. count - 1] say.
+ * Returns 1 on success, 0 on failure, or -1 if the hint is bad.
+ */
+static int
+sprint_realloc_hinted_octets(u_char ** buf, size_t * buf_len,
+                             size_t * out_len, int allow_realloc,
+                             const netsnmp_variable_list * var,
+                             const struct hint_spec *next, int count)
+{
+    static const struct hint_spec no_hint = { 1, 0, 'd', 0, 0 };
+    const struct hint_spec *spec = &no_hint, *end = next + count;
+    int             repeat, x, cnt;
+    unsigned long   value;
+    char            intbuf[32], *ip;
+    const u_char   *cp = var->val.string, *ecp = cp + var->val_len;
+
+    while (cp < ecp) {
+        repeat = 1;
+        if (next < end) {
+            spec = next++;
+            if (spec->star)
+                repeat = *cp++;
+        }
+
+        while (repeat && cp < ecp) {
+            value = 0;
+            if (spec->code != 'a' && spec->code != 't') {
+                for (x = 0; x < spec->width; x++) {
+                    value = value * 256 + *cp++;
+                }
+            }
+            switch (spec->code) {
+            case 'x':
+                /*
+                 * if value is < 16, it will be a single hex digit. If the
+                 * width is 1 (we are outputting a byte at a time), pat it
+                 * to 2 digits if NETSNMP_DS_LIB_2DIGIT_HEX_OUTPUT is set
+                 * or all of the following are true:
+                 *  - we do not have a separation character
+                 *  - there is no hint left (or there never was a hint)
+                 *
+                 * e.g. for the data 0xAA01BB, would anyone really ever
+                 * want the string "AA1BB"??
+                 */
+                ip = intbuf + sizeof(intbuf);
+                do {
+                    *--ip = "0123456789abcdef"[value & 0xf];
+                    value >>= 4;
+                } while (value);
+                if (ip == intbuf + sizeof(intbuf) - 1 && 1 == spec->width &&
+                    (print_options()->hex_2digit ||
+                     ((0 == spec->separ) && (next == end))))
+                    *--ip = '0';
+                if (!print_append(buf, buf_len, out_len, allow_realloc, ip,
+                                  intbuf + sizeof(intbuf) - ip)) {
+                    return 0;
+                }
+                break;
+            case 'd':
+                ip = print_long(intbuf + sizeof(intbuf), (long) value);
+                if (!print_append(buf, buf_len, out_len, allow_realloc, ip,
+                                  intbuf + sizeof(intbuf) - ip)) {
+                    return 0;
+                }
+                break;
+            case 'o':
+                sprintf(intbuf, "%lo", value);
+                if (!snmp_cstrcat
+                    (buf, buf_len, out_len, allow_realloc, intbuf)) {
+                    return 0;
+                }
+                break;
+            case 't': /* new in rfc 3411 */
+            case 'a':
+                /* A string hint gives the max size - we may not need this much */
+                cnt = SNMP_MIN(spec->width, ecp - cp);
+                while ((*out_len + cnt + 1) > *buf_len) {
+                    if (!allow_realloc || !snmp_realloc(buf, buf_len))
+                        return 0;
+                }
+                if (memchr(cp, '\0', cnt) == NULL) {
+                    /* No embedded '\0' - use memcpy() to preserve UTF-8 */
+                    memcpy(*buf + *out_len, cp, cnt);
+                    *out_len += cnt;
+                    *(*buf + *out_len) = '\0';
+                } else if (!sprint_realloc_asciistring(buf, buf_len,
+                                 out_len, allow_realloc, cp, cnt)) {
+                    return 0;
+                }
+                cp += cnt;
+                break;
+            default:
+                return -1;
+            }
+
+            if (cp < ecp && spec->separ) {
+                while ((*out_len + 1) >= *buf_len) {
+                    if (!(allow_realloc && snmp_realloc(buf, buf_len))) {
+                        return 0;
+                    }
+                }
+                *(*buf + *out_len) = spec->separ;
+                (*out_len)++;
+                *(*buf + *out_len) = '\0';
+            }
+            repeat--;
+        }
+
+        if (spec->term && cp < ecp) {
+            while ((*out_len + 1) >= *buf_len) {
+                if (!(allow_realloc && snmp_realloc(buf, buf_len))) {
+                    return 0;
+                }
+            }
+            *(*buf + *out_len) = spec->term;
+            (*out_len)++;
+            *(*buf + *out_len) = '\0';
+        }
+    }
+    return 1;
+}
+
 /**
  * Prints an octet string into a buffer.
  *
@@ -454,14 +778,12 @@ sprint_realloc_octet_string(u_char ** buf, size_t * buf_len,
                             const char *units)
 {
     size_t          saved_out_len = *out_len;
-    const char     *saved_hint = hint;
     int             hex = 0, x = 0;
     u_char         *cp;
-    int             output_format, cnt;
+    int             output_format;
 
     if (var->type != ASN_OCTET_STR) {
-        if (!netsnmp_ds_get_boolean(
-                    NETSNMP_DS_LIBRARY_ID, NETSNMP_DS_LIB_QUICKE_PRINT)) {
+        if (!print_options()->quicke_print) {
             const char      str[] = "Wrong Type (should be OCTET STRING): ";
             if (!snmp_cstrcat(buf, buf_len, out_len, allow_realloc, str))
                 return 0;
@@ -473,158 +795,45 @@ sprint_realloc_octet_string(u_char ** buf, size_t * buf_len,
 
 
     if (hint) {
-        int             repeat, width = 1;
-        long            value;
-        char            code = 'd', separ = 0, term = 0, ch, intbuf[32];
-#define HEX2DIGIT_NEED_INIT 3
-        char            hex2digit = HEX2DIGIT_NEED_INIT;
-        u_char         *ecp;
-
-        if (!netsnmp_ds_get_boolean(NETSNMP_DS_LIBRARY_ID, NETSNMP_DS_LIB_QUICK_PRINT)) {
+        struct hint_spec local[16], *spec = local, *allocated = NULL;
+        int             rc;
+
+        if (!print_options()->quick_print) {
             if (!snmp_cstrcat(buf, buf_len, out_len, allow_realloc,
                               "STRING: ")) {
                 return 0;
             }
         }
-        cp = var->val.string;
-        ecp = cp + var->val_len;
-
-        while (cp < ecp) {
-            repeat = 1;
-            if (*hint) {
-                if (*hint == '*') {
-                    repeat = *cp++;
-                    hint++;
-                }
-                width = 0;
-                while ('0' <= *hint && *hint <= '9')
-                    width = (width * 10) + (*hint++ - '0');
-                code = *hint++;
-                if ((ch = *hint) && ch != '*' && (ch < '0' || ch > '9')
-                    && (width != 0
-                        || (ch != 'x' && ch != 'd' && ch != 'o')))
-                    separ = *hint++;
-                else
-                    separ = 0;
-                if ((ch = *hint) && ch != '*' && (ch < '0' || ch > '9')
-                    && (width != 0
-                        || (ch != 'x' && ch != 'd' && ch != 'o')))
-                    term = *hint++;
-                else
-                    term = 0;
-                if (width == 0)  /* Handle malformed hint strings */
-                    width = 1;
-            }
 
-            while (repeat && cp < ecp) {
-                value = 0;
-                if (code != 'a' && code != 't') {
-                    for (x = 0; x < width; x++) {
-                        value = value * 256 + *cp++;
-                    }
-                }
-                switch (code) {
-                case 'x':
-                    if (HEX2DIGIT_NEED_INIT == hex2digit)
-                        hex2digit = netsnmp_ds_get_boolean(NETSNMP_DS_LIBRARY_ID,
-                                                           NETSNMP_DS_LIB_2DIGIT_HEX_OUTPUT);
-                    /*
-                     * if value is < 16, it will be a single hex digit. If the
-                     * width is 1 (we are outputting a byte at a time), pat it
-                     * to 2 digits if NETSNMP_DS_LIB_2DIGIT_HEX_OUTPUT is set
-                     * or all of the following are true:
-                     *  - we do not have a separation character
-                     *  - there is no hint left (or there never was a hint)
-                     *
-                     * e.g. for the data 0xAA01BB, would anyone really ever
-                     * want the string "AA1BB"??
-                     */
-                    if (((value < 16) && (1 == width)) &&
-                        (hex2digit || ((0 == separ) && (0 == *hint)))) {
-                        sprintf(intbuf, "0%lx", value);
-                    } else {
-                        sprintf(intbuf, "%lx", value);
-                    }
-                    if (!snmp_cstrcat
-                        (buf, buf_len, out_len, allow_realloc, intbuf)) {
-                        return 0;
-                    }
-                    break;
-                case 'd':
-                    sprintf(intbuf, "%ld", value);
-                    if (!snmp_cstrcat
-                        (buf, buf_len, out_len, allow_realloc, intbuf)) {
-                        return 0;
-                    }
-                    break;
-                case 'o':
-                    sprintf(intbuf, "%lo", value);
-                    if (!snmp_cstrcat
-                        (buf, buf_len, out_len, allow_realloc, intbuf)) {
-                        return 0;
-                    }
-                    break;
-                case 't': /* new in rfc 3411 */
-                case 'a':
-                    /* A string hint gives the max size - we may not need this much */
-                    cnt = SNMP_MIN(width, ecp - cp);
-                    while ((*out_len + cnt + 1) > *buf_len) {
-                        if (!allow_realloc || !snmp_realloc(buf, buf_len))
-                            return 0;
-                    }
-                    if (memchr(cp, '\0', cnt) == NULL) {
-                        /* No embedded '\0' - use memcpy() to preserve UTF-8 */
-                        memcpy(*buf + *out_len, cp, cnt);
-                        *out_len += cnt;
-                        *(*buf + *out_len) = '\0';
-                    } else if (!sprint_realloc_asciistring(buf, buf_len,
-                                     out_len, allow_realloc, cp, cnt)) {
-                        return 0;
-                    }
-                    cp += cnt;
-                    break;
-                default:
-                    *out_len = saved_out_len;
-                    if (snmp_cstrcat(buf, buf_len, out_len, allow_realloc,
-                                     "(Bad hint ignored: ")
-                        && snmp_cstrcat(buf, buf_len, out_len,
-                                       allow_realloc, saved_hint)
-                        && snmp_cstrcat(buf, buf_len, out_len,
-                                       allow_realloc, ") ")) {
-                        return sprint_realloc_octet_string(buf, buf_len,
-                                                           out_len,
-                                                           allow_realloc,
-                                                           var, enums,
-                                                           NULL, NULL);
-                    } else {
-                        return 0;
-                    }
-                }
-
-                if (cp < ecp && separ) {
-                    while ((*out_len + 1) >= *buf_len) {
-                        if (!(allow_realloc && snmp_realloc(buf, buf_len))) {
-                            return 0;
-                        }
-                    }
-                    *(*buf + *out_len) = separ;
-                    (*out_len)++;
-                    *(*buf + *out_len) = '\0';
-                }
-                repeat--;
-            }
-
-            if (term && cp < ecp) {
-                while ((*out_len + 1) >= *buf_len) {
-                    if (!(allow_realloc && snmp_realloc(buf, buf_len))) {
-                        return 0;
-                    }
-                }
-                *(*buf + *out_len) = term;
-                (*out_len)++;
-                *(*buf + *out_len) = '\0';
+        if (strlen(hint) > sizeof(local) / sizeof(local[0])) {
+            spec = allocated = (struct hint_spec *)
+                malloc(strlen(hint) * sizeof(*spec));
+            if (!spec)
+                return 0;
+        }
+        rc = sprint_realloc_hinted_octets(buf, buf_len, out_len,
+                                          allow_realloc, var, spec,
+                                          split_octet_hint(hint, spec));
+        free(allocated);
+        if (rc < 0) {
+            *out_len = saved_out_len;
+            if (snmp_cstrcat(buf, buf_len, out_len, allow_realloc,
+                             "(Bad hint ignored: ")
+                && snmp_cstrcat(buf, buf_len, out_len,
+                               allow_realloc, hint)
+                && snmp_cstrcat(buf, buf_len, out_len,
+                               allow_realloc, ") ")) {
+                return sprint_realloc_octet_string(buf, buf_len,
+                                                   out_len,
+                                                   allow_realloc,
+                                                   var, enums,
+                                                   NULL, NULL);
+            } else {
+                return 0;
             }
         }
+        if (!rc)
+            return 0;
 
         if (units) {
             return (snmp_cstrcat(buf, buf_len, out_len, allow_realloc, " ") &&
@@ -639,7 +848,7 @@ sprint_realloc_octet_string(u_char ** buf, size_t * buf_len,
         return 1;
     }
 
-    output_format = netsnmp_ds_get_int(NETSNMP_DS_LIBRARY_ID, NETSNMP_DS_LIB_STRING_OUTPUT_FORMAT);
+    output_format = print_options()->string_format;
     if (0 == output_format) {
         output_format = NETSNMP_STRING_OUTPUT_GUESS;
     }
@@ -667,7 +876,7 @@ sprint_realloc_octet_string(u_char ** buf, size_t * buf_len,
     }
 
     if (hex) {
-        if (netsnmp_ds_get_boolean(NETSNMP_DS_LIBRARY_ID, NETSNMP_DS_LIB_QUICK_PRINT)) {
+        if (print_options()->quick_print) {
             if (!snmp_cstrcat(buf, buf_len, out_len, allow_realloc, "\"")) {
                 return 0;
             }
@@ -683,13 +892,13 @@ sprint_realloc_octet_string(u_char ** buf, size_t * buf_len,
             return 0;
         }
 
-        if (netsnmp_ds_get_boolean(NETSNMP_DS_LIBRARY_ID, NETSNMP_DS_LIB_QUICK_PRINT)) {
+        if (print_options()->quick_print) {
             if (!snmp_cstrcat(buf, buf_len, out_len, allow_realloc, "\"")) {
                 return 0;
             }
         }
     } else {
-        if (!netsnmp_ds_get_boolean(NETSNMP_DS_LIBRARY_ID, NETSNMP_DS_LIB_QUICK_PRINT)) {
+        if (!print_options()->quick_print) {
             if (!snmp_cstrcat(buf, buf_len, out_len, allow_realloc,
                              "STRING: ")) {
                 return 0;
@@ -750,8 +959,7 @@ sprint_realloc_float(u_char ** buf, size_t * buf_len,
     char *printf_format_string = NULL;
 
     if (var->type != ASN_OPAQUE_FLOAT) {
-        if (!netsnmp_ds_get_boolean(
-                NETSNMP_DS_LIBRARY_ID, NETSNMP_DS_LIB_QUICKE_PRINT)) {
+        if (!print_options()->quicke_print) {
             static const char str[] = "Wrong Type (should be Float): ";
             if (!snmp_cstrcat(buf, buf_len, out_len, allow_realloc, str))
                 return 0;
@@ -761,7 +969,7 @@ sprint_realloc_float(u_char ** buf, size_t * buf_len,
                                           NULL);
     }
 
-    if (!netsnmp_ds_get_boolean(NETSNMP_DS_LIBRARY_ID, NETSNMP_DS_LIB_QUICK_PRINT)) {
+    if (!print_options()->quick_print) {
         if (!snmp_cstrcat
             (buf, buf_len, out_len, allow_realloc, "Opaque: Float: ")) {
             return 0;
@@ -827,8 +1035,7 @@ sprint_realloc_double(u_char ** buf, size_t * buf_len,
     char *printf_format_string = NULL;
 
     if (var->type != ASN_OPAQUE_DOUBLE) {
-        if (!netsnmp_ds_get_boolean(
-                NETSNMP_DS_LIBRARY_ID, NETSNMP_DS_LIB_QUICKE_PRINT)) {
+        if (!print_options()->quicke_print) {
             static const char str[] = "Wrong Type (should be Double): ";
             if (!snmp_cstrcat(buf, buf_len, out_len, allow_realloc, str))
                 return 0;
@@ -838,7 +1045,7 @@ sprint_realloc_double(u_char ** buf, size_t * buf_len,
                                           NULL);
     }
 
-    if (!netsnmp_ds_get_boolean(NETSNMP_DS_LIBRARY_ID, NETSNMP_DS_LIB_QUICK_PRINT)) {
+    if (!print_options()->quick_print) {
         if (!snmp_cstrcat
             (buf, buf_len, out_len, allow_realloc, "Opaque: Float: ")) {
             return 0;
@@ -910,8 +1117,7 @@ sprint_realloc_counter64(u_char ** buf, size_t * buf_len, size_t * out_len,
         && var->type != ASN_OPAQUE_I64 && var->type != ASN_OPAQUE_U64
 #endif
         ) {
-        if (!netsnmp_ds_get_boolean(
-                NETSNMP_DS_LIBRARY_ID, NETSNMP_DS_LIB_QUICKE_PRINT)) {
+        if (!print_options()->quicke_print) {
             static const char str[] = "Wrong Type (should be Counter64): ";
             if (!snmp_cstrcat(buf, buf_len, out_len, allow_realloc, str))
                 return 0;
@@ -921,7 +1127,7 @@ sprint_realloc_counter64(u_char ** buf, size_t * buf_len, size_t * out_len,
                                           NULL);
     }
 
-    if (!netsnmp_ds_get_boolean(NETSNMP_DS_LIBRARY_ID, NETSNMP_DS_LIB_QUICK_PRINT)) {
+    if (!print_options()->quick_print) {
 #ifdef NETSNMP_WITH_OPAQUE_SPECIAL_TYPES
         if (var->type != ASN_COUNTER64) {
             if (!snmp_cstrcat
@@ -1014,8 +1220,7 @@ sprint_realloc_opaque(u_char ** buf, size_t * buf_len,
         && var->type != ASN_OPAQUE_FLOAT && var->type != ASN_OPAQUE_DOUBLE
 #endif                          /* NETSNMP_WITH_OPAQUE_SPECIAL_TYPES */
         ) {
-        if (!netsnmp_ds_get_boolean(
-                NETSNMP_DS_LIBRARY_ID, NETSNMP_DS_LIB_QUICKE_PRINT)) {
+        if (!print_options()->quicke_print) {
             static const char str[] = "Wrong Type (should be Opaque): ";
             if (!snmp_cstrcat(buf, buf_len, out_len, allow_realloc, str))
                 return 0;
@@ -1047,7 +1252,7 @@ sprint_realloc_opaque(u_char ** buf, size_t * buf_len,
 
     case ASN_OPAQUE:
 #endif
-        if (!netsnmp_ds_get_boolean(NETSNMP_DS_LIBRARY_ID, NETSNMP_DS_LIB_QUICK_PRINT)) {
+        if (!print_options()->quick_print) {
             static const char str[] = "OPAQUE: ";
             if (!snmp_cstrcat(buf, buf_len, out_len, allow_realloc, str)) {
                 return 0;
@@ -1098,8 +1303,7 @@ sprint_realloc_object_identifier(u_char ** buf, size_t * buf_len,
     int             buf_overflow = 0;
 
     if (var->type != ASN_OBJECT_ID) {
-        if (!netsnmp_ds_get_boolean(
-                NETSNMP_DS_LIBRARY_ID, NETSNMP_DS_LIB_QUICKE_PRINT)) {
+        if (!print_options()->quicke_print) {
             static const char str[] = "Wrong Type (should be OBJECT IDENTIFIER): ";
             if (!snmp_cstrcat(buf, buf_len, out_len, allow_realloc, str))
                 return 0;
@@ -1109,7 +1313,7 @@ sprint_realloc_object_identifier(u_char ** buf, size_t * buf_len,
                                           NULL);
     }
 
-    if (!netsnmp_ds_get_boolean(NETSNMP_DS_LIBRARY_ID, NETSNMP_DS_LIB_QUICK_PRINT)) {
+    if (!print_options()->quick_print) {
         static const char str[] = "OID: ";
         if (!snmp_cstrcat(buf, buf_len, out_len, allow_realloc, str)) {
             return 0;
@@ -1164,8 +1368,7 @@ sprint_realloc_timeticks(u_char ** buf, size_t * buf_len, size_t * out_len,
     char            timebuf[40];
 
     if (var->type != ASN_TIMETICKS) {
-        if (!netsnmp_ds_get_boolean(
-                NETSNMP_DS_LIBRARY_ID, NETSNMP_DS_LIB_QUICKE_PRINT)) {
+        if (!print_options()->quicke_print) {
             static const char str[] = "Wrong Type (should be Timeticks): ";
             if (!snmp_cstrcat(buf, buf_len, out_len, allow_realloc, str))
                 return 0;
@@ -1175,19 +1378,12 @@ sprint_realloc_timeticks(u_char ** buf, size_t * buf_len, size_t * out_len,
                                           NULL);
     }
 
-    if (netsnmp_ds_get_boolean(NETSNMP_DS_LIBRARY_ID, NETSNMP_DS_LIB_NUMERIC_TIMETICKS)) {
-        char            str[32];
-        snprintf(str, sizeof(str), "%lu", *(u_long *) var->val.integer);
-        if (!snmp_cstrcat(buf, buf_len, out_len, allow_realloc, str)) {
-            return 0;
-        }
-        return 1;
-    }
-    if (!netsnmp_ds_get_boolean(NETSNMP_DS_LIBRARY_ID, NETSNMP_DS_LIB_QUICK_PRINT)) {
-        char            str[32];
-        snprintf(str, sizeof(str), "Timeticks: (%lu) ",
-                 *(u_long *) var->val.integer);
-        if (!snmp_cstrcat(buf, buf_len, out_len, allow_realloc, str)) {
+    if (print_options()->numeric_timeticks)
+        return print_number(buf, buf_len, out_len, allow_realloc, NULL,
+                            *var->val.integer, 0, NULL);
+    if (!print_options()->quick_print) {
+        if (!print_number(buf, buf_len, out_len, allow_realloc,
+                          "Timeticks: (", *var->val.integer, 0, ") ")) {
             return 0;
         }
     }
@@ -1337,8 +1533,7 @@ sprint_realloc_integer(u_char ** buf, size_t * buf_len, size_t * out_len,
     char           *enum_string = NULL;
 
     if (var->type != ASN_INTEGER) {
-        if (!netsnmp_ds_get_boolean(
-                NETSNMP_DS_LIBRARY_ID, NETSNMP_DS_LIB_QUICKE_PRINT)) {
+        if (!print_options()->quicke_print) {
             static const char str[] = "Wrong Type (should be INTEGER): ";
             if (!snmp_cstrcat(buf, buf_len, out_len, allow_realloc, str))
                 return 0;
@@ -1355,14 +1550,14 @@ sprint_realloc_integer(u_char ** buf, size_t * buf_len, size_t * out_len,
         }
     }
 
-    if (!netsnmp_ds_get_boolean(NETSNMP_DS_LIBRARY_ID, NETSNMP_DS_LIB_QUICK_PRINT)) {
+    if (!print_options()->quick_print) {
         if (!snmp_cstrcat(buf, buf_len, out_len, allow_realloc, "INTEGER: ")) {
             return 0;
         }
     }
 
     if (enum_string == NULL ||
-        netsnmp_ds_get_boolean(NETSNMP_DS_LIBRARY_ID, NETSNMP_DS_LIB_PRINT_NUMERIC_ENUM)) {
+        print_options()->numeric_enum) {
         if (hint) {
             if (!(sprint_realloc_hinted_integer(buf, buf_len, out_len,
                                                 allow_realloc,
@@ -1370,24 +1565,20 @@ sprint_realloc_integer(u_char ** buf, size_t * buf_len, size_t * out_len,
                                                 hint, units))) {
                 return 0;
             }
-        } else {
-            char            str[32];
-            snprintf(str, sizeof(str), "%ld", *var->val.integer);
-            if (!snmp_cstrcat(buf, buf_len, out_len, allow_realloc, str)) {
-                return 0;
-            }
+        } else if (!print_number(buf, buf_len, out_len, allow_realloc,
+                                 NULL, *var->val.integer, 1, NULL)) {
+            return 0;
         }
-    } else if (netsnmp_ds_get_boolean(NETSNMP_DS_LIBRARY_ID, NETSNMP_DS_LIB_QUICK_PRINT)) {
+    } else if (print_options()->quick_print) {
         if (!snmp_cstrcat(buf, buf_len, out_len, allow_realloc, enum_string)) {
             return 0;
         }
     } else {
-        char            str[32];
-        snprintf(str, sizeof(str), "(%ld)", *var->val.integer);
         if (!snmp_cstrcat(buf, buf_len, out_len, allow_realloc, enum_string)) {
             return 0;
         }
-        if (!snmp_cstrcat(buf, buf_len, out_len, allow_realloc, str)) {
+        if (!print_number(buf, buf_len, out_len, allow_realloc, "(",
+                          *var->val.integer, 1, ")")) {
             return 0;
         }
     }
@@ -1430,8 +1621,7 @@ sprint_realloc_uinteger(u_char ** buf, size_t * buf_len, size_t * out_len,
     char           *enum_string = NULL;
 
     if (var->type != ASN_UINTEGER) {
-        if (!netsnmp_ds_get_boolean(
-                NETSNMP_DS_LIBRARY_ID, NETSNMP_DS_LIB_QUICKE_PRINT)) {
+        if (!print_options()->quicke_print) {
             static const char str[] = "Wrong Type (should be UInteger32): ";
             if (!snmp_cstrcat(buf, buf_len, out_len, allow_realloc, str))
                 return 0;
@@ -1449,7 +1639,7 @@ sprint_realloc_uinteger(u_char ** buf, size_t * buf_len, size_t * out_len,
     }
 
     if (enum_string == NULL ||
-        netsnmp_ds_get_boolean(NETSNMP_DS_LIBRARY_ID, NETSNMP_DS_LIB_PRINT_NUMERIC_ENUM)) {
+        print_options()->numeric_enum) {
         if (hint) {
             if (!(sprint_realloc_hinted_integer(buf, buf_len, out_len,
                                                 allow_realloc,
@@ -1457,24 +1647,20 @@ sprint_realloc_uinteger(u_char ** buf, size_t * buf_len, size_t * out_len,
                                                 hint, units))) {
                 return 0;
             }
-        } else {
-            char            str[32];
-            snprintf(str, sizeof(str), "%lu", *var->val.integer);
-            if (!snmp_cstrcat(buf, buf_len, out_len, allow_realloc, str)) {
-                return 0;
-            }
+        } else if (!print_number(buf, buf_len, out_len, allow_realloc,
+                                 NULL, *var->val.integer, 0, NULL)) {
+            return 0;
         }
-    } else if (netsnmp_ds_get_boolean(NETSNMP_DS_LIBRARY_ID, NETSNMP_DS_LIB_QUICK_PRINT)) {
+    } else if (print_options()->quick_print) {
         if (!snmp_cstrcat(buf, buf_len, out_len, allow_realloc, enum_string)) {
             return 0;
         }
     } else {
-        char            str[32];
-        snprintf(str, sizeof(str), "(%lu)", *var->val.integer);
         if (!snmp_cstrcat(buf, buf_len, out_len, allow_realloc, enum_string)) {
             return 0;
         }
-        if (!snmp_cstrcat(buf, buf_len, out_len, allow_realloc, str)) {
+        if (!print_number(buf, buf_len, out_len, allow_realloc, "(",
+                          *var->val.integer, 0, ")")) {
             return 0;
         }
     }
@@ -1514,11 +1700,8 @@ sprint_realloc_gauge(u_char ** buf, size_t * buf_len, size_t * out_len,
                      const struct enum_list *enums,
                      const char *hint, const char *units)
 {
-    char            tmp[32];
-
     if (var->type != ASN_GAUGE) {
-        if (!netsnmp_ds_get_boolean(
-                NETSNMP_DS_LIBRARY_ID, NETSNMP_DS_LIB_QUICKE_PRINT)) {
+        if (!print_options()->quicke_print) {
             static const char str[] = "Wrong Type (should be Gauge32 or Unsigned32): ";
             if (!snmp_cstrcat(buf, buf_len, out_len, allow_realloc, str))
                 return 0;
@@ -1528,7 +1711,7 @@ sprint_realloc_gauge(u_char ** buf, size_t * buf_len, size_t * out_len,
                                           NULL);
     }
 
-    if (!netsnmp_ds_get_boolean(NETSNMP_DS_LIBRARY_ID, NETSNMP_DS_LIB_QUICK_PRINT)) {
+    if (!print_options()->quick_print) {
         static const char str[] = "Gauge32: ";
         if (!snmp_cstrcat(buf, buf_len, out_len, allow_realloc, str)) {
             return 0;
@@ -1541,11 +1724,9 @@ sprint_realloc_gauge(u_char ** buf, size_t * buf_len, size_t * out_len,
                                            units)) {
             return 0;
         }
-    } else {
-        sprintf(tmp, "%u", (unsigned int)(*var->val.integer & 0xffffffff));
-        if (!snmp_cstrcat(buf, buf_len, out_len, allow_realloc, tmp)) {
-            return 0;
-        }
+    } else if (!print_number(buf, buf_len, out_len, allow_realloc, NULL,
+                             *var->val.integer & 0xffffffff, 0, NULL)) {
+        return 0;
     }
     if (units) {
         return (snmp_cstrcat(buf, buf_len, out_len, allow_realloc, " ") &&
@@ -1582,11 +1763,8 @@ sprint_realloc_counter(u_char ** buf, size_t * buf_len, size_t * out_len,
                        const struct enum_list *enums,
                        const char *hint, const char *units)
 {
-    char            tmp[32];
-
     if (var->type != ASN_COUNTER) {
-        if (!netsnmp_ds_get_boolean(
-                NETSNMP_DS_LIBRARY_ID, NETSNMP_DS_LIB_QUICKE_PRINT)) {
+        if (!print_options()->quicke_print) {
             static const char str[] = "Wrong Type (should be Counter32): ";
             if (!snmp_cstrcat(buf, buf_len, out_len, allow_realloc, str))
                 return 0;
@@ -1596,14 +1774,14 @@ sprint_realloc_counter(u_char ** buf, size_t * buf_len, size_t * out_len,
                                           NULL);
     }
 
-    if (!netsnmp_ds_get_boolean(NETSNMP_DS_LIBRARY_ID, NETSNMP_DS_LIB_QUICK_PRINT)) {
+    if (!print_options()->quick_print) {
         static const char str[] = "Counter32: ";
         if (!snmp_cstrcat(buf, buf_len, out_len, allow_realloc, str)) {
             return 0;
         }
     }
-    sprintf(tmp, "%u", (unsigned int)(*var->val.integer & 0xffffffff));
-    if (!snmp_cstrcat(buf, buf_len, out_len, allow_realloc, tmp)) {
+    if (!print_number(buf, buf_len, out_len, allow_realloc, NULL,
+                      *var->val.integer & 0xffffffff, 0, NULL)) {
         return 0;
     }
     if (units) {
@@ -1644,8 +1822,7 @@ sprint_realloc_networkaddress(u_char ** buf, size_t * buf_len,
     size_t          i;
 
     if (var->type != ASN_IPADDRESS) {
-        if (!netsnmp_ds_get_boolean(
-                NETSNMP_DS_LIBRARY_ID, NETSNMP_DS_LIB_QUICKE_PRINT)) {
+        if (!print_options()->quicke_print) {
             static const char str[] = "Wrong Type (should be NetworkAddress): ";
             if (!snmp_cstrcat(buf, buf_len, out_len, allow_realloc, str))
                 return 0;
@@ -1655,7 +1832,7 @@ sprint_realloc_networkaddress(u_char ** buf, size_t * buf_len,
                                           NULL);
     }
 
-    if (!netsnmp_ds_get_boolean(NETSNMP_DS_LIBRARY_ID, NETSNMP_DS_LIB_QUICK_PRINT)) {
+    if (!print_options()->quick_print) {
         static const char str[] = "Network Address: ";
         if (!snmp_cstrcat(buf, buf_len, out_len, allow_realloc, str)) {
             return 0;
@@ -1708,10 +1885,11 @@ sprint_realloc_ipaddress(u_char ** buf, size_t * buf_len, size_t * out_len,
                          const char *hint, const char *units)
 {
     u_char         *ip = var->val.string;
+    char            tmp[4], *cp;
+    int             i;
 
     if (var->type != ASN_IPADDRESS) {
-        if (!netsnmp_ds_get_boolean(
-                NETSNMP_DS_LIBRARY_ID, NETSNMP_DS_LIB_QUICKE_PRINT)) {
+        if (!print_options()->quicke_print) {
             static const char str[] = "Wrong Type (should be IpAddress): ";
             if (!snmp_cstrcat(buf, buf_len, out_len, allow_realloc, str))
                 return 0;
@@ -1721,7 +1899,7 @@ sprint_realloc_ipaddress(u_char ** buf, size_t * buf_len, size_t * out_len,
                                           NULL);
     }
 
-    if (!netsnmp_ds_get_boolean(NETSNMP_DS_LIBRARY_ID, NETSNMP_DS_LIB_QUICK_PRINT)) {
+    if (!print_options()->quick_print) {
         static const char str[] = "IpAddress: ";
         if (!snmp_cstrcat(buf, buf_len, out_len, allow_realloc, str)) {
             return 0;
@@ -1732,10 +1910,16 @@ sprint_realloc_ipaddress(u_char ** buf, size_t * buf_len, size_t * out_len,
             return 0;
         }
     }
-    if (ip)
-        sprintf((char *) (*buf + *out_len), "%d.%d.%d.%d",
-                                            ip[0], ip[1], ip[2], ip[3]);
-    *out_len += strlen((char *) (*buf + *out_len));
+    if (ip) {
+        for (i = 0; i < 4; i++) {
+            for (cp = print_ulong(tmp + sizeof(tmp), ip[i]);
+                 cp < tmp + sizeof(tmp); cp++)
+                *(*buf + (*out_len)++) = *cp;
+            if (i < 3)
+                *(*buf + (*out_len)++) = '.';
+        }
+    }
+    *(*buf + *out_len) = '\0';
     return 1;
 }
 
@@ -1770,8 +1954,7 @@ sprint_realloc_null(u_char ** buf, size_t * buf_len, size_t * out_len,
     static const char str[] = "NULL";
 
     if (var->type != ASN_NULL) {
-        if (!netsnmp_ds_get_boolean(
-                NETSNMP_DS_LIBRARY_ID, NETSNMP_DS_LIB_QUICKE_PRINT)) {
+        if (!print_options()->quicke_print) {
             static const char str[] = "Wrong Type (should be NULL): ";
             if (!snmp_cstrcat(buf, buf_len, out_len, allow_realloc, str))
                 return 0;
@@ -1817,8 +2000,7 @@ sprint_realloc_bitstring(u_char ** buf, size_t * buf_len, size_t * out_len,
     char           *enum_string;
 
     if (var->type != ASN_BIT_STR && var->type != ASN_OCTET_STR) {
-        if (!netsnmp_ds_get_boolean(
-                NETSNMP_DS_LIBRARY_ID, NETSNMP_DS_LIB_QUICKE_PRINT)) {
+        if (!print_options()->quicke_print) {
             static const char str[] = "Wrong Type (should be BITS): ";
             if (!snmp_cstrcat(buf, buf_len, out_len, allow_realloc, str))
                 return 0;
@@ -1828,7 +2010,7 @@ sprint_realloc_bitstring(u_char ** buf, size_t * buf_len, size_t * out_len,
                                           NULL);
     }
 
-    if (netsnmp_ds_get_boolean(NETSNMP_DS_LIBRARY_ID, NETSNMP_DS_LIB_QUICK_PRINT)) {
+    if (print_options()->quick_print) {
         static const char str[] = "\"";
         if (!snmp_cstrcat(buf, buf_len, out_len, allow_realloc, str)) {
             return 0;
@@ -1844,7 +2026,7 @@ sprint_realloc_bitstring(u_char ** buf, size_t * buf_len, size_t * out_len,
         return 0;
     }
 
-    if (netsnmp_ds_get_boolean(NETSNMP_DS_LIBRARY_ID, NETSNMP_DS_LIB_QUICK_PRINT)) {
+    if (print_options()->quick_print) {
         static const char str[] = "\"";
         if (!snmp_cstrcat(buf, buf_len, out_len, allow_realloc, str)) {
             return 0;
@@ -1862,8 +2044,7 @@ sprint_realloc_bitstring(u_char ** buf, size_t * buf_len, size_t * out_len,
                         }
                     }
                     if (enum_string == NULL ||
-                        netsnmp_ds_get_boolean(NETSNMP_DS_LIBRARY_ID,
-                                       NETSNMP_DS_LIB_PRINT_NUMERIC_ENUM)) {
+                        print_options()->numeric_enum) {
                         char            str[32];
                         snprintf(str, sizeof(str), "%d ", (len * 8) + bit);
                         if (!snmp_cstrcat(buf, buf_len, out_len, allow_realloc,
@@ -1898,8 +2079,7 @@ sprint_realloc_nsapaddress(u_char ** buf, size_t * buf_len,
                            const char *units)
 {
     if (var->type != ASN_NSAP) {
-        if (!netsnmp_ds_get_boolean(
-                NETSNMP_DS_LIBRARY_ID, NETSNMP_DS_LIB_QUICKE_PRINT)) {
+        if (!print_options()->quicke_print) {
             static const char str[] = "Wrong Type (should be NsapAddress): ";
             if (!snmp_cstrcat(buf, buf_len, out_len, allow_realloc, str))
                 return 0;
@@ -1909,7 +2089,7 @@ sprint_realloc_nsapaddress(u_char ** buf, size_t * buf_len,
                                           NULL);
     }
 
-    if (!netsnmp_ds_get_boolean(NETSNMP_DS_LIBRARY_ID, NETSNMP_DS_LIB_QUICK_PRINT)) {
+    if (!print_options()->quick_print) {
         static const char str[] = "NsapAddress: ";
         if (!snmp_cstrcat(buf, buf_len, out_len, allow_realloc, str)) {
             return 0;
@@ -2476,6 +2656,18 @@ register_mib_handlers(void)
                        NETSNMP_DS_LIBRARY_ID, NETSNMP_DS_LIB_MIB_WARNINGS);
     netsnmp_ds_register_premib(ASN_BOOLEAN, "snmp", "mibReplaceWithLatest",
                        NETSNMP_DS_LIBRARY_ID, NETSNMP_DS_LIB_MIB_REPLACE);
+    netsnmp_ds_register_premib(ASN_BOOLEAN, "snmp", "mibCache",
+                       NETSNMP_DS_LIBRARY_ID, NETSNMP_DS_LIB_MIB_CACHE);
+    netsnmp_ds_register_premib(ASN_OCTET_STR, "snmp", "mibCacheFile",
+                       NETSNMP_DS_LIBRARY_ID, NETSNMP_DS_LIB_MIB_CACHE_FILE);
+    netsnmp_ds_register_premib(ASN_INTEGER, "snmp", "mibLoadThreads",
+                       NETSNMP_DS_LIBRARY_ID, NETSNMP_DS_LIB_MIB_THREADS);
+    netsnmp_ds_register_premib(ASN_BOOLEAN, "snmp", "mibLazyLoad",
+                       NETSNMP_DS_LIBRARY_ID, NETSNMP_DS_LIB_MIB_LAZY_LOAD);
+    netsnmp_ds_register_premib(ASN_OCTET_STR, "snmp", "mibIndexFile",
+                       NETSNMP_DS_LIBRARY_ID, NETSNMP_DS_LIB_MIB_INDEX_FILE);
+    netsnmp_ds_register_premib(ASN_INTEGER, "snmp", "mibMemoSize",
+                       NETSNMP_DS_LIBRARY_ID, NETSNMP_DS_LIB_MIB_MEMO_SIZE);
 #endif
 
     netsnmp_ds_register_premib(ASN_BOOLEAN, "snmp", "printNumericEnums",
@@ -2661,27 +2853,49 @@ netsnmp_fixup_mib_directory(void)
 
 }
 
-/**
- * Initialises the mib reader.
- *
- * Reads in all settings from the environment.
+/*
+ * Starts reading the modules named in mibs on mibLoadThreads threads,
+ * ahead of read_configured_mibs() parsing them.
  */
-void
-netsnmp_init_mib(void)
+static void
+prefetch_configured_mibs(const char *mibs)
 {
-    const char     *prefix;
-    char           *env_var, *entry;
-    PrefixListPtr   pp = &mib_prefixes[0];
-    char           *st = NULL;
+    const char    **names;
+    char           *copy, *entry, *st = NULL;
+    int             nthreads, count = 0, all = 0;
 
-    if (Mib)
+    nthreads = netsnmp_ds_get_int(NETSNMP_DS_LIBRARY_ID,
+                                  NETSNMP_DS_LIB_MIB_THREADS);
+    if (nthreads <= 0 || !mibs)
         return;
-    netsnmp_init_mib_internals();
+    copy = strdup(mibs);
+    names = calloc(strlen(mibs) / 2 + 1, sizeof(*names));
+    if (copy && names) {
+        for (entry = strtok_r(copy, ENV_SEPARATOR, &st); entry;
+             entry = strtok_r(NULL, ENV_SEPARATOR, &st)) {
+            if (strcasecmp(entry, DEBUG_ALWAYS_TOKEN) == 0)
+                all = 1;
+            else if (strstr(entry, "/") == NULL)
+                names[count++] = entry;
+        }
+        netsnmp_mib_prefetch(all ? NULL : names, count, nthreads);
+    }
+    free(names);
+    free(copy);
+}
+
+/*
+ * Adds the MIB directories and files named by MIBDIRS and MIBFILES.
+ */
+static void
+add_configured_mibdirs(void)
+{
+    char           *env_var, *entry;
+    char           *st = NULL;
 
     /*
      * Initialise the MIB directory/ies 
      */
-    netsnmp_fixup_mib_directory();
     env_var = strdup(netsnmp_get_mib_directory());
     if (!env_var)
         return;
@@ -2710,41 +2924,27 @@ netsnmp_init_mib(void)
     }
 
     netsnmp_init_mib_internals();
+}
+
+/*
+ * Reads the MIB modules and files named by mibs, which is consumed, and
+ * by MIBFILES.
+ */
+static void
+read_configured_mibs(char *mibs)
+{
+    char           *env_var, *entry;
+    char           *st = NULL;
 
     /*
      * Read in any modules or mibs requested 
      */
 
-    env_var = netsnmp_getenv("MIBS");
-    if (env_var == NULL) {
-        if (confmibs != NULL)
-            env_var = strdup(confmibs);
-        else
-            env_var = strdup(NETSNMP_DEFAULT_MIBS);
-    } else {
-        env_var = strdup(env_var);
-    }
-    if (env_var && ((*env_var == '+') || (*env_var == '-'))) {
-        int res;
-
-        if (*env_var == '+')
-            res = asprintf(&entry, "%s%c%s", NETSNMP_DEFAULT_MIBS,
-                           ENV_SEPARATOR_CHAR, env_var + 1);
-        else
-            res = asprintf(&entry, "%s%c%s", env_var + 1, ENV_SEPARATOR_CHAR,
-                           NETSNMP_DEFAULT_MIBS);
-        SNMP_FREE(env_var);
-        if (res < 0) {
-            DEBUGMSGTL(("init_mib", "env mibs malloc failed"));
-            return;
-        }
-        env_var = entry;
-    }
-
     DEBUGMSGTL(("init_mib",
                 "Seen MIBS: Looking in '%s' for mib files ...\n",
-                env_var));
-    entry = strtok_r(env_var, ENV_SEPARATOR, &st);
+                mibs));
+    prefetch_configured_mibs(mibs);
+    entry = mibs ? strtok_r(mibs, ENV_SEPARATOR, &st) : NULL;
     while (entry) {
         if (strcasecmp(entry, DEBUG_ALWAYS_TOKEN) == 0) {
             read_all_mibs();
@@ -2756,7 +2956,7 @@ netsnmp_init_mib(void)
         entry = strtok_r(NULL, ENV_SEPARATOR, &st);
     }
     adopt_orphans();
-    SNMP_FREE(env_var);
+    netsnmp_mib_prefetch_done();
 
     env_var = netsnmp_getenv("MIBFILES");
     if (env_var != NULL) {
@@ -2783,23 +2983,150 @@ netsnmp_init_mib(void)
         } else {
             env_var = strdup(env_var);
         }
-    } else {
-#ifdef NETSNMP_DEFAULT_MIBFILES
-        env_var = strdup(NETSNMP_DEFAULT_MIBFILES);
-#endif
+    } else {
+#ifdef NETSNMP_DEFAULT_MIBFILES
+        env_var = strdup(NETSNMP_DEFAULT_MIBFILES);
+#endif
+    }
+
+    if (env_var != NULL) {
+        DEBUGMSGTL(("init_mib",
+                    "Seen MIBFILES: Looking in '%s' for mib files ...\n",
+                    env_var));
+        entry = strtok_r(env_var, ENV_SEPARATOR, &st);
+        while (entry) {
+            read_mib(entry);
+            entry = strtok_r(NULL, ENV_SEPARATOR, &st);
+        }
+        SNMP_FREE(env_var);
+    }
+}
+
+/*
+ * Returns the key a compiled MIB cache or MIB index must have been written
+ * with to be usable for mibs and the current configuration.  Whether
+ * descriptions are kept only matters to the cache.
+ */
+static char *
+mib_cache_key(const char *mibs, int descrs)
+{
+    const char     *mibfiles = netsnmp_getenv("MIBFILES");
+    char           *key;
+
+    if (asprintf(&key, "MIBDIRS=%s\nMIBS=%s\nMIBFILES=%s\nflags=%d%d%d%d",
+                 netsnmp_get_mib_directory(), mibs,
+                 mibfiles ? mibfiles : "", descrs,
+                 netsnmp_ds_get_boolean(NETSNMP_DS_LIBRARY_ID,
+                                        NETSNMP_DS_LIB_MIB_COMMENT_TERM),
+                 netsnmp_ds_get_boolean(NETSNMP_DS_LIBRARY_ID,
+                                        NETSNMP_DS_LIB_MIB_PARSE_LABEL),
+                 netsnmp_ds_get_boolean(NETSNMP_DS_LIBRARY_ID,
+                                        NETSNMP_DS_LIB_MIB_REPLACE)) < 0)
+        return NULL;
+    return key;
+}
+
+/**
+ * Initialises the mib reader.
+ *
+ * Reads in all settings from the environment.
+ */
+void
+netsnmp_init_mib(void)
+{
+    const char     *prefix;
+    char           *env_var, *entry;
+    char           *cache_file = NULL, *cache_key = NULL;
+    char           *index_file = NULL, *index_key = NULL;
+    PrefixListPtr   pp = &mib_prefixes[0];
+
+    if (Mib)
+        return;
+    netsnmp_init_mib_internals();
+
+    netsnmp_fixup_mib_directory();
+
+    env_var = netsnmp_getenv("MIBS");
+    if (env_var == NULL) {
+        if (confmibs != NULL)
+            env_var = strdup(confmibs);
+        else
+            env_var = strdup(NETSNMP_DEFAULT_MIBS);
+    } else {
+        env_var = strdup(env_var);
+    }
+    if (env_var && ((*env_var == '+') || (*env_var == '-'))) {
+        int res;
+
+        if (*env_var == '+')
+            res = asprintf(&entry, "%s%c%s", NETSNMP_DEFAULT_MIBS,
+                           ENV_SEPARATOR_CHAR, env_var + 1);
+        else
+            res = asprintf(&entry, "%s%c%s", env_var + 1, ENV_SEPARATOR_CHAR,
+                           NETSNMP_DEFAULT_MIBS);
+        SNMP_FREE(env_var);
+        if (res < 0) {
+            DEBUGMSGTL(("init_mib", "env mibs malloc failed"));
+            return;
+        }
+        env_var = entry;
     }
 
-    if (env_var != NULL) {
-        DEBUGMSGTL(("init_mib",
-                    "Seen MIBFILES: Looking in '%s' for mib files ...\n",
-                    env_var));
-        entry = strtok_r(env_var, ENV_SEPARATOR, &st);
-        while (entry) {
-            read_mib(entry);
-            entry = strtok_r(NULL, ENV_SEPARATOR, &st);
+    /*
+     * Use the compiled MIB cache or the MIB index if they match, or
+     * create them
+     */
+    if (env_var && netsnmp_ds_get_boolean(NETSNMP_DS_LIBRARY_ID,
+                                          NETSNMP_DS_LIB_MIB_CACHE)) {
+        entry = netsnmp_ds_get_string(NETSNMP_DS_LIBRARY_ID,
+                                      NETSNMP_DS_LIB_MIB_CACHE_FILE);
+        if (entry)
+            cache_file = strdup(entry);
+        else if (asprintf(&cache_file, "%s/mib_cache",
+                          get_persistent_directory()) < 0)
+            cache_file = NULL;
+    }
+    if (env_var && netsnmp_ds_get_boolean(NETSNMP_DS_LIBRARY_ID,
+                                          NETSNMP_DS_LIB_MIB_LAZY_LOAD)) {
+        entry = netsnmp_ds_get_string(NETSNMP_DS_LIBRARY_ID,
+                                      NETSNMP_DS_LIB_MIB_INDEX_FILE);
+        if (entry)
+            index_file = strdup(entry);
+        else if (asprintf(&index_file, "%s/mib_index",
+                          get_persistent_directory()) < 0)
+            index_file = NULL;
+    }
+    if (cache_file)
+        cache_key = mib_cache_key(env_var,
+                                  netsnmp_ds_get_boolean(NETSNMP_DS_LIBRARY_ID,
+                                             NETSNMP_DS_LIB_SAVE_MIB_DESCRS));
+    if (index_file)
+        index_key = mib_cache_key(env_var, 0);
+
+    if (!index_key && cache_key &&
+        netsnmp_mib_cache_load(cache_file, cache_key) == 0) {
+        DEBUGMSGTL(("init_mib", "Loaded MIBs from %s\n", cache_file));
+    } else {
+        add_configured_mibdirs();
+        if (index_key && netsnmp_mib_index_load(index_file, index_key) == 0) {
+            DEBUGMSGTL(("init_mib", "Reading MIBs indexed in %s when needed\n",
+                        index_file));
+            read_configured_mibs(NULL);
+        } else {
+            read_configured_mibs(env_var);
+            if (cache_key)
+                netsnmp_mib_cache_save(cache_file, cache_key,
+                                       netsnmp_get_mib_directory());
+            if (index_key)
+                netsnmp_mib_index_save(index_file, index_key,
+                                       netsnmp_get_mib_directory());
         }
-        SNMP_FREE(env_var);
     }
+    SNMP_FREE(env_var);
+    SNMP_FREE(cache_key);
+    SNMP_FREE(cache_file);
+    SNMP_FREE(index_key);
+    SNMP_FREE(index_file);
 
     prefix = netsnmp_getenv("PREFIX");
 
@@ -2860,6 +3187,7 @@ void
 shutdown_mib(void)
 {
     unload_all_mibs();
+    mib_memo_free();
     if (tree_top) {
         if (tree_top->label)
             SNMP_FREE(tree_top->label);
@@ -2965,6 +3293,392 @@ set_function(struct tree *subtree)
 
 #endif /* NETSNMP_DISABLE_MIB_LOADING */
 
+#ifndef NETSNMP_DISABLE_MIB_LOADING
+/*
+ * Memo of recent translations between OIDs and names, so that printing
+ * and reading the same objects over and over doesn't walk the tree and
+ * decode labels each time.  The entries are hashed, and when mibMemoSize
+ * of them are kept the least recently used one is dropped.
+ *
+ * An OID whose deepest known node is a leaf, and whose remaining
+ * subidentifiers print as plain numbers (a scalar's .0, integer table
+ * indexes), is remembered by that leaf's OID, so all instances of an
+ * object share one entry.  The memo is emptied whenever the tree changes.
+ */
+#define MIB_MEMO_SIZE   1000
+
+#define MEMO_OID        1       /* OID printed, the whole OID */
+#define MEMO_OID_PREFIX 2       /* OID printed, up to a leaf */
+#define MEMO_READ_OBJID 3       /* name read by read_objid() */
+#define MEMO_GET_NODE   4       /* name read by get_node() */
+#define MEMO_BY_NAME(kind) ((kind) >= MEMO_READ_OBJID)
+
+#define MEMO_EXTENDED_INDEX 0x100       /* flags besides the output format */
+#define MEMO_DONT_BREAKDOWN 0x200
+#define MEMO_ESCAPE_QUOTES  0x400
+
+struct mib_memo {
+    struct mib_memo *hnext;     /* next in hash bucket */
+    struct mib_memo *prev, *next;       /* most recently used first */
+    u_int           hash;
+    int             kind;
+    int             flags;      /* options the translation depends on */
+    struct tree    *tp;
+    oid            *name;
+    size_t          name_len;
+    char           *str;
+    size_t          str_len;
+};
+
+static struct {
+    struct mib_memo **buckets;
+    u_int           nbuckets;   /* a power of two */
+    u_int           count, max;
+    struct mib_memo *head, *tail;
+    u_int           generation;
+    netsnmp_mib_memo_stats stats;
+} mib_memo;
+
+static void
+mib_memo_flush(void)
+{
+    struct mib_memo *mp, *next;
+
+    for (mp = mib_memo.head; mp; mp = next) {
+        next = mp->next;
+        free(mp);
+    }
+    mib_memo.head = mib_memo.tail = NULL;
+    mib_memo.count = 0;
+    if (mib_memo.buckets)
+        memset(mib_memo.buckets, 0,
+               mib_memo.nbuckets * sizeof(*mib_memo.buckets));
+}
+
+static void
+mib_memo_free(void)
+{
+    mib_memo_flush();
+    SNMP_FREE(mib_memo.buckets);
+    mib_memo.nbuckets = mib_memo.max = 0;
+}
+
+/*
+ * Gets the memo ready for use, returning 0 if it is turned off.
+ */
+static int
+mib_memo_ready(void)
+{
+    int             size = netsnmp_ds_get_int(NETSNMP_DS_LIBRARY_ID,
+                                              NETSNMP_DS_LIB_MIB_MEMO_SIZE);
+    u_int           generation = netsnmp_mib_generation();
+
+    if (size < 0) {
+        if (mib_memo.buckets)
+            mib_memo_free();
+        return 0;
+    }
+    if (size == 0)
+        size = MIB_MEMO_SIZE;
+    if (generation != mib_memo.generation) {
+        if (mib_memo.count) {
+            DEBUGMSGTL(("mib_memo", "tree changed, dropping %u entries\n",
+                        mib_memo.count));
+            mib_memo_flush();
+            mib_memo.stats.flushes++;
+        }
+        mib_memo.generation = generation;
+    }
+    if ((u_int) size != mib_memo.max) {
+        mib_memo_free();
+        for (mib_memo.nbuckets = 16; mib_memo.nbuckets < (u_int) size;
+             mib_memo.nbuckets <<= 1)
+            ;
+        mib_memo.buckets = calloc(mib_memo.nbuckets,
+                                  sizeof(*mib_memo.buckets));
+        if (!mib_memo.buckets) {
+            mib_memo.nbuckets = 0;
+            return 0;
+        }
+        mib_memo.max = size;
+    }
+    return 1;
+}
+
+/*
+ * FNV-1a, with the options a translation depends on as the seed, so
+ * that the hashes of an OID's prefixes come out along the way.
+ */
+static u_int
+mib_memo_seed(int flags)
+{
+    return (2166136261U ^ (u_int) flags) * 16777619U;
+}
+
+static u_int
+mib_memo_hash_oid(u_int hash, oid subid)
+{
+    return (hash ^ (u_int) subid) * 16777619U;
+}
+
+static u_int
+mib_memo_hash_str(u_int hash, const char *str, size_t len)
+{
+    while (len-- > 0)
+        hash = (hash ^ (u_char) *str++) * 16777619U;
+    return hash;
+}
+
+static struct mib_memo *
+mib_memo_find(u_int hash, int kind, int flags, const oid * name,
+              size_t name_len, const char *str, size_t str_len)
+{
+    struct mib_memo *mp;
+
+    for (mp = mib_memo.buckets[hash & (mib_memo.nbuckets - 1)]; mp;
+         mp = mp->hnext) {
+        if (mp->hash != hash || mp->kind != kind || mp->flags != flags)
+            continue;
+        if (MEMO_BY_NAME(kind) ?
+            mp->str_len == str_len && !memcmp(mp->str, str, str_len) :
+            mp->name_len == name_len &&
+            !memcmp(mp->name, name, name_len * sizeof(oid)))
+            break;
+    }
+    if (mp && mp != mib_memo.head) {
+        mp->prev->next = mp->next;
+        if (mp->next)
+            mp->next->prev = mp->prev;
+        else
+            mib_memo.tail = mp->prev;
+        mp->prev = NULL;
+        mp->next = mib_memo.head;
+        mib_memo.head->prev = mp;
+        mib_memo.head = mp;
+    }
+    return mp;
+}
+
+static void
+mib_memo_add(u_int hash, int kind, int flags, struct tree *tp,
+             const oid * name, size_t name_len, const char *str,
+             size_t str_len)
+{
+    struct mib_memo *mp, **mpp;
+
+    if (mib_memo.count >= mib_memo.max && (mp = mib_memo.tail)) {
+        for (mpp = &mib_memo.buckets[mp->hash & (mib_memo.nbuckets - 1)];
+             *mpp != mp; mpp = &(*mpp)->hnext)
+            ;
+        *mpp = mp->hnext;
+        mib_memo.tail = mp->prev;
+        if (mib_memo.tail)
+            mib_memo.tail->next = NULL;
+        else
+            mib_memo.head = NULL;
+        mib_memo.count--;
+        free(mp);
+    }
+
+    mp = malloc(sizeof(*mp) + name_len * sizeof(oid) + str_len + 1);
+    if (!mp)
+        return;
+    mp->hash = hash;
+    mp->kind = kind;
+    mp->flags = flags;
+    mp->tp = tp;
+    mp->name = (oid *) (mp + 1);
+    mp->name_len = name_len;
+    memcpy(mp->name, name, name_len * sizeof(oid));
+    mp->str = (char *) (mp->name + name_len);
+    mp->str_len = str_len;
+    memcpy(mp->str, str, str_len);
+    mp->str[str_len] = '\0';
+
+    mpp = &mib_memo.buckets[hash & (mib_memo.nbuckets - 1)];
+    mp->hnext = *mpp;
+    *mpp = mp;
+    mp->prev = NULL;
+    mp->next = mib_memo.head;
+    if (mib_memo.head)
+        mib_memo.head->prev = mp;
+    else
+        mib_memo.tail = mp;
+    mib_memo.head = mp;
+    mib_memo.count++;
+}
+
+static int
+mib_memo_oid_flags(void)
+{
+    int             flags = netsnmp_ds_get_int(NETSNMP_DS_LIBRARY_ID,
+                                       NETSNMP_DS_LIB_OID_OUTPUT_FORMAT);
+
+    if (netsnmp_ds_get_boolean(NETSNMP_DS_LIBRARY_ID,
+                               NETSNMP_DS_LIB_EXTENDED_INDEX))
+        flags |= MEMO_EXTENDED_INDEX;
+    if (netsnmp_ds_get_boolean(NETSNMP_DS_LIBRARY_ID,
+                               NETSNMP_DS_LIB_DONT_BREAKDOWN_OIDS))
+        flags |= MEMO_DONT_BREAKDOWN;
+    if (netsnmp_ds_get_boolean(NETSNMP_DS_LIBRARY_ID,
+                               NETSNMP_DS_LIB_ESCAPE_QUOTES))
+        flags |= MEMO_ESCAPE_QUOTES;
+    return flags;
+}
+
+/*
+ * Returns whether subidentifiers past the leaf tp are always printed as
+ * plain numbers, i.e. the indexes _get_realloc_symbol() would decode
+ * (if any) are all integers without enumerations.
+ */
+static int
+mib_memo_plain_suffix(struct tree *tp, int flags)
+{
+    struct index_list *in_dices = NULL;
+    struct tree    *tp2;
+
+    if ((flags & 0xff) == NETSNMP_OID_OUTPUT_UCD)
+        return 0;
+    if ((flags & 0xff) == NETSNMP_OID_OUTPUT_NUMERIC ||
+        (flags & MEMO_DONT_BREAKDOWN))
+        return 1;
+    for (; tp; tp = tp->parent) {
+        if (tp->indexes) {
+            in_dices = tp->indexes;
+            break;
+        }
+        if (tp->augments && (tp2 = find_tree_node(tp->augments, -1))) {
+            in_dices = tp2->indexes;
+            break;
+        }
+    }
+    if (in_dices && (flags & MEMO_EXTENDED_INDEX))
+        return 0;
+    for (; in_dices; in_dices = in_dices->next) {
+        tp2 = find_tree_node(in_dices->ilabel, -1);
+        if (!tp2)
+            break;
+        switch (tp2->type) {
+        case TYPE_INTEGER32:
+        case TYPE_UINTEGER:
+        case TYPE_UNSIGNED32:
+        case TYPE_GAUGE:
+        case TYPE_INTEGER:
+            if (tp2->enums)
+                return 0;
+            break;
+        case TYPE_TIMETICKS:
+        case TYPE_IPADDR:
+            break;
+        default:
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/*
+ * Returns the length of the ".n.n" tail which str has for the
+ * subidentifiers in objid, or 0 if it doesn't end so.
+ */
+static size_t
+mib_memo_tail(const char *str, size_t str_len, const oid * objid,
+              size_t objidlen)
+{
+    char            intbuf[32];
+    size_t          tail = 0, len;
+
+    while (objidlen-- > 0) {
+        len = sprintf(intbuf, ".%" NETSNMP_PRIo "u", objid[objidlen]);
+        if (tail + len >= str_len ||
+            memcmp(str + str_len - tail - len, intbuf, len))
+            return 0;
+        tail += len;
+    }
+    return tail;
+}
+
+/*
+ * Remembers how an OID printed, see above.
+ */
+static void
+mib_memo_add_oid(struct tree *tp, int flags, const u_int * hash,
+                 const oid * objid, size_t objidlen, const char *str,
+                 size_t str_len)
+{
+    struct tree    *tp2;
+    size_t          depth = 0, tail;
+
+    for (tp2 = tp; tp2; tp2 = tp2->parent)
+        depth++;
+    if (depth < objidlen && !tp->child_list &&
+        mib_memo_plain_suffix(tp, flags) &&
+        (tail = mib_memo_tail(str, str_len, objid + depth,
+                              objidlen - depth)) != 0) {
+        mib_memo_add(hash[depth], MEMO_OID_PREFIX, flags, tp, objid, depth,
+                     str, str_len - tail);
+    } else if (depth <= objidlen &&
+               (depth == objidlen || !(flags & MEMO_EXTENDED_INDEX))) {
+        mib_memo_add(hash[objidlen], MEMO_OID, flags, tp, objid, objidlen,
+                     str, str_len);
+    }
+}
+
+/*
+ * Reads a name with lookup(), read_objid() or get_node(), through the
+ * memo.
+ */
+static int
+mib_memo_read(int kind, int (*lookup) (const char *, oid *, size_t *),
+              const char *input, oid * output, size_t * out_len)
+{
+    struct mib_memo *mp;
+    size_t          len;
+    u_int           hash;
+    int             flags = 0, res;
+
+    if (!input || !mib_memo_ready())
+        return lookup(input, output, out_len);
+    if (netsnmp_ds_get_boolean(NETSNMP_DS_LIBRARY_ID,
+                               NETSNMP_DS_LIB_READ_UCD_STYLE_OID))
+        flags |= 1;
+    if (netsnmp_ds_get_boolean(NETSNMP_DS_LIBRARY_ID,
+                               NETSNMP_DS_LIB_DONT_CHECK_RANGE))
+        flags |= 2;
+    if (netsnmp_ds_get_boolean(NETSNMP_DS_LIBRARY_ID,
+                               NETSNMP_DS_LIB_NO_DISPLAY_HINT))
+        flags |= 4;
+    len = strlen(input);
+    hash = mib_memo_hash_str(mib_memo_seed(flags), input, len);
+    mp = mib_memo_find(hash, kind, flags, NULL, 0, input, len);
+    if (mp && mp->name_len <= *out_len) {
+        mib_memo.stats.name_hits++;
+        memcpy(output, mp->name, mp->name_len * sizeof(oid));
+        *out_len = mp->name_len;
+        return 1;
+    }
+    mib_memo.stats.name_misses++;
+    res = lookup(input, output, out_len);
+    if (res == 1 && !mp)
+        mib_memo_add(hash, kind, flags, NULL, output, *out_len, input, len);
+    return res;
+}
+#endif /* NETSNMP_DISABLE_MIB_LOADING */
+
+/**
+ * Copies the counts of translations answered by the memo of recent
+ * ones, and of those which weren't, into stats.
+ */
+void
+netsnmp_mib_memo_get_stats(netsnmp_mib_memo_stats *stats)
+{
+#ifndef NETSNMP_DISABLE_MIB_LOADING
+    *stats = mib_memo.stats;
+#else
+    memset(stats, 0, sizeof(*stats));
+#endif /* NETSNMP_DISABLE_MIB_LOADING */
+}
+
 /**
  * Reads an object identifier from an input string into internal OID form.
  * 
@@ -2983,6 +3697,17 @@ set_function(struct tree *subtree)
 int
 read_objid(const char *input, oid * output, size_t * out_len)
 {
+#ifndef NETSNMP_DISABLE_MIB_LOADING
+    return mib_memo_read(MEMO_READ_OBJID, _read_objid, input, output,
+                         out_len);
+#else
+    return _read_objid(input, output, out_len);
+#endif /* NETSNMP_DISABLE_MIB_LOADING */
+}
+
+static int
+_read_objid(const char *input, oid * output, size_t * out_len)
+{
 #ifndef NETSNMP_DISABLE_MIB_LOADING
     struct tree    *root = tree_top;
     char            buf[SPRINT_MAX_LEN];
@@ -2991,6 +3716,9 @@ read_objid(const char *input, oid * output, size_t * out_len)
     char           *name, ch;
     const char     *cp;
 
+#ifndef NETSNMP_DISABLE_MIB_LOADING
+    mib_index_need_labels(input);
+#endif /* NETSNMP_DISABLE_MIB_LOADING */
     cp = input;
     while ((ch = *cp)) {
         if (('0' <= ch && ch <= '9')
@@ -3130,11 +3858,11 @@ netsnmp_sprint_realloc_objid_tree(u_char ** buf, size_t * buf_len,
                                  buf_overflow, objid, objidlen);
 }
 #else
-struct tree    *
-netsnmp_sprint_realloc_objid_tree(u_char ** buf, size_t * buf_len,
-                                  size_t * out_len, int allow_realloc,
-                                  int *buf_overflow,
-                                  const oid * objid, size_t objidlen)
+static struct tree *
+_sprint_realloc_objid_tree(u_char ** buf, size_t * buf_len,
+                           size_t * out_len, int allow_realloc,
+                           int *buf_overflow,
+                           const oid * objid, size_t objidlen)
 {
     u_char         *tbuf = NULL, *cp = NULL;
     size_t          tbuf_len = 512, tout_len = 0;
@@ -3252,6 +3980,60 @@ netsnmp_sprint_realloc_objid_tree(u_char ** buf, size_t * buf_len,
     SNMP_FREE(tbuf);
     return subtree;
 }
+
+struct tree    *
+netsnmp_sprint_realloc_objid_tree(u_char ** buf, size_t * buf_len,
+                                  size_t * out_len, int allow_realloc,
+                                  int *buf_overflow,
+                                  const oid * objid, size_t objidlen)
+{
+    struct mib_memo *mp;
+    struct tree    *tp;
+    u_int           hash[MAX_OID_LEN + 1];
+    size_t          start = *out_len, k;
+    char            intbuf[32];
+    int             flags;
+
+    if (*buf_overflow || !objid || objidlen == 0 ||
+        objidlen > MAX_OID_LEN || !mib_memo_ready())
+        return _sprint_realloc_objid_tree(buf, buf_len, out_len,
+                                          allow_realloc, buf_overflow,
+                                          objid, objidlen);
+
+    /*
+     * the longest remembered prefix which is the whole OID, or a leaf
+     */
+    netsnmp_mib_index_need_oid(objid, objidlen);
+    flags = mib_memo_oid_flags();
+    hash[0] = mib_memo_seed(flags);
+    for (k = 0; k < objidlen; k++)
+        hash[k + 1] = mib_memo_hash_oid(hash[k], objid[k]);
+    k = objidlen;
+    mp = mib_memo_find(hash[k], MEMO_OID, flags, objid, k, NULL, 0);
+    while (!mp && --k > 0)
+        mp = mib_memo_find(hash[k], MEMO_OID_PREFIX, flags, objid, k,
+                           NULL, 0);
+
+    if (mp) {
+        mib_memo.stats.oid_hits++;
+        if (!snmp_cstrcat(buf, buf_len, out_len, allow_realloc, mp->str))
+            *buf_overflow = 1;
+        for (; k < objidlen && !*buf_overflow; k++) {
+            sprintf(intbuf, ".%" NETSNMP_PRIo "u", objid[k]);
+            if (!snmp_cstrcat(buf, buf_len, out_len, allow_realloc, intbuf))
+                *buf_overflow = 1;
+        }
+        return mp->tp;
+    }
+
+    mib_memo.stats.oid_misses++;
+    tp = _sprint_realloc_objid_tree(buf, buf_len, out_len, allow_realloc,
+                                    buf_overflow, objid, objidlen);
+    if (tp && !*buf_overflow && *buf)
+        mib_memo_add_oid(tp, flags, hash, objid, objidlen,
+                         (char *) *buf + start, *out_len - start);
+    return tp;
+}
 #endif /* NETSNMP_DISABLE_MIB_LOADING */
 
 int
@@ -3345,13 +4127,13 @@ sprint_realloc_variable(u_char ** buf, size_t * buf_len,
     if (buf_overflow) {
         return 0;
     }
-    if (!netsnmp_ds_get_boolean(NETSNMP_DS_LIBRARY_ID, NETSNMP_DS_LIB_PRINT_BARE_VALUE)) {
-        if (netsnmp_ds_get_boolean(NETSNMP_DS_LIBRARY_ID, NETSNMP_DS_LIB_QUICKE_PRINT)) {
+    if (!print_options()->bare_value) {
+        if (print_options()->quicke_print) {
             if (!snmp_cstrcat(buf, buf_len, out_len, allow_realloc, " = ")) {
                 return 0;
             }
         } else {
-            if (netsnmp_ds_get_boolean(NETSNMP_DS_LIBRARY_ID, NETSNMP_DS_LIB_QUICK_PRINT)) {
+            if (print_options()->quick_print) {
                 if (!snmp_cstrcat(buf, buf_len, out_len, allow_realloc, " ")) {
                     return 0;
                 }
@@ -3379,13 +4161,11 @@ sprint_realloc_variable(u_char ** buf, size_t * buf_len,
     } else if (subtree) {
         const char *units = NULL;
         const char *hint = NULL;
-        if (!netsnmp_ds_get_boolean(NETSNMP_DS_LIBRARY_ID,
-                                    NETSNMP_DS_LIB_DONT_PRINT_UNITS)) {
+        if (!print_options()->no_units) {
             units = subtree->units;
         }
 
-		if (!netsnmp_ds_get_boolean(NETSNMP_DS_LIBRARY_ID,
-                                    NETSNMP_DS_LIB_NO_DISPLAY_HINT)) {
+		if (!print_options()->no_display_hint) {
 			hint = subtree->hint;
         }
 
@@ -3493,8 +4273,7 @@ sprint_realloc_value(u_char ** buf, size_t * buf_len,
         const char *units = NULL;
         struct tree *subtree = tree_head;
 	subtree = get_tree(objid, objidlen, subtree);
-        if (subtree && !netsnmp_ds_get_boolean(NETSNMP_DS_LIBRARY_ID,
-                                            NETSNMP_DS_LIB_DONT_PRINT_UNITS)) {
+        if (subtree && !print_options()->no_units) {
             units = subtree->units;
         }
         if (subtree) {
@@ -4198,63 +4977,62 @@ _get_realloc_symbol(const oid * objid, size_t objidlen,
     if (!objid || !buf) {
         return NULL;
     }
-
-    for (; subtree; subtree = subtree->next_peer) {
-        if (*objid == subtree->subid) {
-	    while (subtree->next_peer && subtree->next_peer->subid == *objid)
-		subtree = subtree->next_peer;
-            if (subtree->indexes) {
-                in_dices = subtree->indexes;
-            } else if (subtree->augments) {
-                struct tree    *tp2 =
-                    find_tree_node(subtree->augments, -1);
-                if (tp2) {
-                    in_dices = tp2->indexes;
-                }
+    if (subtree && !subtree->parent)
+        netsnmp_mib_index_need_oid(objid, objidlen);
+
+    subtree = find_tree_subid(subtree, *objid);
+    if (subtree) {
+        if (subtree->indexes) {
+            in_dices = subtree->indexes;
+        } else if (subtree->augments) {
+            struct tree    *tp2 =
+                find_tree_node(subtree->augments, -1);
+            if (tp2) {
+                in_dices = tp2->indexes;
             }
+        }
 
-            if (!strncmp(subtree->label, ANON, ANON_LEN) ||
-                (NETSNMP_OID_OUTPUT_NUMERIC == output_format)) {
-                sprintf(intbuf, "%lu", subtree->subid);
-                if (!*buf_overflow && !snmp_cstrcat(buf, buf_len, out_len,
-                                                    allow_realloc, intbuf)) {
-                    *buf_overflow = 1;
-                }
-            } else {
+        if (!strncmp(subtree->label, ANON, ANON_LEN) ||
+            (NETSNMP_OID_OUTPUT_NUMERIC == output_format)) {
+            sprintf(intbuf, "%lu", subtree->subid);
+            if (!*buf_overflow && !snmp_cstrcat(buf, buf_len, out_len,
+                                                allow_realloc, intbuf)) {
+                *buf_overflow = 1;
+            }
+        } else {
+            if (!*buf_overflow &&
+                !snmp_cstrcat(buf, buf_len, out_len, allow_realloc,
+                              subtree->label)) {
+                *buf_overflow = 1;
+            }
+            if (output_format == NETSNMP_OID_OUTPUT_FULL_AND_NUMERIC) {
+                snprintf(intbuf, sizeof intbuf, "(%lu)", subtree->subid);
                 if (!*buf_overflow &&
                     !snmp_cstrcat(buf, buf_len, out_len, allow_realloc,
-                                  subtree->label)) {
+                                  intbuf)) {
                     *buf_overflow = 1;
                 }
-                if (output_format == NETSNMP_OID_OUTPUT_FULL_AND_NUMERIC) {
-                    snprintf(intbuf, sizeof intbuf, "(%lu)", subtree->subid);
-                    if (!*buf_overflow &&
-                        !snmp_cstrcat(buf, buf_len, out_len, allow_realloc,
-                                      intbuf)) {
-                        *buf_overflow = 1;
-                    }
-                }
             }
+        }
 
-            if (objidlen > 1) {
-                if (!*buf_overflow &&
-                    !snmp_cstrcat(buf, buf_len, out_len, allow_realloc, ".")) {
-                    *buf_overflow = 1;
-                }
-
-                return_tree = _get_realloc_symbol(objid + 1, objidlen - 1,
-                                                  subtree->child_list,
-                                                  buf, buf_len, out_len,
-                                                  allow_realloc,
-                                                  buf_overflow, in_dices,
-                                                  end_of_known);
+        if (objidlen > 1) {
+            if (!*buf_overflow &&
+                !snmp_cstrcat(buf, buf_len, out_len, allow_realloc, ".")) {
+                *buf_overflow = 1;
             }
 
-            if (return_tree != NULL) {
-                return return_tree;
-            } else {
-                return subtree;
-            }
+            return_tree = _get_realloc_symbol(objid + 1, objidlen - 1,
+                                              subtree->child_list,
+                                              buf, buf_len, out_len,
+                                              allow_realloc,
+                                              buf_overflow, in_dices,
+                                              end_of_known);
+        }
+
+        if (return_tree != NULL) {
+            return return_tree;
+        } else {
+            return subtree;
         }
     }
 
@@ -4594,16 +5372,11 @@ get_tree(const oid * objid, size_t objidlen, struct tree *subtree)
 {
     struct tree    *return_tree = NULL;
 
-    for (; subtree; subtree = subtree->next_peer) {
-        if (*objid == subtree->subid)
-            goto found;
-    }
-
-    return NULL;
-
-  found:
-    while (subtree->next_peer && subtree->next_peer->subid == *objid)
-	subtree = subtree->next_peer;
+    if (subtree && !subtree->parent)
+        netsnmp_mib_index_need_oid(objid, objidlen);
+    subtree = find_tree_subid(subtree, *objid);
+    if (subtree == NULL)
+        return NULL;
     if (objidlen > 1)
         return_tree =
             get_tree(objid + 1, objidlen - 1, subtree->child_list);
@@ -5323,8 +6096,7 @@ _add_strings_to_oid(void *tp, char *cp,
             subid = strtoul(cp, &ecp, 0);
             if (*ecp)
                 goto bad_id;
-            while (tp2 && tp2->subid != subid)
-                tp2 = tp2->next_peer;
+            tp2 = find_tree_subid(tp2, subid);
         } else {
             while (tp2 && strcmp(tp2->label, fcp))
                 tp2 = tp2->next_peer;
@@ -5688,13 +6460,48 @@ _add_strings_to_oid(void *tp, char *cp,
 
 
 #ifndef NETSNMP_DISABLE_MIB_LOADING
+/*
+ * Reads the modules which define the labels in the textual OID name,
+ * when the MIBs are loaded lazily.
+ */
+static void
+mib_index_need_labels(const char *name)
+{
+    char            label[MAXTOKEN];
+    const char     *cp = name;
+    char            quote;
+    size_t          len;
+
+    while (*cp) {
+        if (*cp == '"' || *cp == '\'') {
+            for (quote = *cp++; *cp && *cp != quote; cp++)
+                if (*cp == '\\' && cp[1])
+                    cp++;
+            if (*cp)
+                cp++;
+        } else if (isalpha((unsigned char) *cp)) {
+            for (len = 0; isalnum((unsigned char) *cp) || *cp == '-' ||
+                 *cp == '_'; cp++)
+                if (len < sizeof(label) - 1)
+                    label[len++] = *cp;
+            label[len] = '\0';
+            netsnmp_mib_index_need_label(label);
+        } else {
+            cp++;
+        }
+    }
+}
+
 /**
  * @see comments on find_best_tree_node for usage after first time.
  */
 int
 get_wild_node(const char *name, oid * objid, size_t * objidlen)
 {
-    struct tree    *tp = find_best_tree_node(name, tree_head, NULL);
+    struct tree    *tp;
+
+    mib_index_need_labels(name);
+    tp = find_best_tree_node(name, tree_head, NULL);
     if (!tp)
         return 0;
     return get_node(tp->label, objid, objidlen);
@@ -5702,11 +6509,18 @@ get_wild_node(const char *name, oid * objid, size_t * objidlen)
 
 int
 get_node(const char *name, oid * objid, size_t * objidlen)
+{
+    return mib_memo_read(MEMO_GET_NODE, _get_node, name, objid, objidlen);
+}
+
+static int
+_get_node(const char *name, oid * objid, size_t * objidlen)
 {
     const char     *cp;
     char            ch;
     int             res;
 
+    mib_index_need_labels(name);
     cp = name;
     while ((ch = *cp))
         if (('0' <= ch && ch <= '9')
@@ -77,6 +77,13 @@ SOFTWARE.
 #ifdef HAVE_UNISTD_H
 #include <unistd.h>
 #endif
+#ifdef HAVE_SYS_MMAN_H
+#include <sys/mman.h>
+#endif
+#if defined(HAVE_PTHREAD_H) && defined(HAVE_PTHREAD_CREATE)
+#include <pthread.h>
+#define MIB_PREFETCH 1
+#endif
 
 #include <errno.h>
 
@@ -141,9 +148,28 @@ struct tc {                     /* textual conventions */
     struct range_list *ranges;
     char           *description;
     int             lineno;
+    int             next;       /* next index in the same tc_hash chain */
 } *tclist;
 int tc_alloc;
 
+/*
+ * Where get_token() reads from: a stdio stream, or when fp is NULL, a
+ * file already read into memory.  Lines are counted in *line.  When quiet
+ * is set warnings aren't printed, only noted in trouble.
+ */
+struct mib_lexer {
+    FILE           *fp;
+    const u_char   *cur;
+    const u_char   *end;
+    const u_char   *start;      /* first character of the last token */
+    int            *line;
+    int             quiet;
+    int             trouble;
+};
+
+#define LEX_GETC(lx) ((lx)->fp ? netsnmp_getc((lx)->fp) :             \
+                      (lx)->cur < (lx)->end ? *(lx)->cur++ : EOF)
+
 static int      mibLine;
 static const char *File = "(none)";
 static int      anonymous;
@@ -526,13 +552,29 @@ char gMibNames[STRINGMAX];
 #define HASHSIZE        32
 #define BUCKET(x)       (x & (HASHSIZE-1))
 
+/*
+ * The node, tree and textual convention tables are hashed on label_hash()
+ * and grow in powers of two, starting from NHASHSIZE buckets.
+ */
 #define NHASHSIZE    128
-#define NBUCKET(x)   (x & (NHASHSIZE-1))
+#define NBUCKET(x)   ((x) & (nbuckets_size-1))
+#define TBUCKET(x)   ((x) & (tbuckets_size-1))
+#define TCBUCKET(x)  ((x) & (tc_hash_size-1))
 
 static struct tok *buckets[HASHSIZE];
 
-static struct node *nbuckets[NHASHSIZE];
-static struct tree *tbuckets[NHASHSIZE];
+static struct node *nbuckets_fixed[NHASHSIZE];
+static struct node **nbuckets = nbuckets_fixed;
+static u_int    nbuckets_size = NHASHSIZE;  /* buckets in use */
+static u_int    nbuckets_alloc = NHASHSIZE; /* buckets allocated */
+static struct tree *tbuckets_fixed[NHASHSIZE];
+static struct tree **tbuckets = tbuckets_fixed;
+static u_int    tbuckets_size = NHASHSIZE;
+static u_int    tbuckets_count = 0;         /* trees in tbuckets */
+static int      tc_hash_fixed[NHASHSIZE];
+static int     *tc_hash = tc_hash_fixed;    /* first tclist index, or -1 */
+static u_int    tc_hash_size = NHASHSIZE;
+static int      tc_count = 0;               /* tclist slots in use */
 static struct module *module_head = NULL;
 
 static struct node *orphan_nodes = NULL;
@@ -549,13 +591,28 @@ static char    *last_err_module = NULL; /* no repeats on "Cannot find module..."
 
 static void     tree_from_node(struct tree *tp, struct node *np);
 static void     do_subtree(struct tree *, struct node **);
+static void     tree_changed(void);
 static void     do_linkup(struct module *, struct node *);
 static void     dump_module_list(void);
 static int      get_token(FILE *, char *, int);
-static int      parseQuoteString(FILE *, char *, int);
+static int      parseQuoteString(struct mib_lexer *, char *, int);
+static int      netsnmp_getc(FILE *);
+static void     lex_ungetc(struct mib_lexer *, int);
+#ifdef MIB_PREFETCH
+struct mib_stream;
+static struct mib_stream *replay_stream;
+static int      replay_token(struct mib_stream *, char *, int);
+static void     replay_unget(struct mib_stream *);
+static struct mib_stream *prefetch_take(struct module *);
+static void     mib_stream_free(struct mib_stream *);
+#endif
 static int      tossObjectIdentifier(FILE *);
 static int      name_hash(const char *);
+static u_int    label_hash(const char *);
 static void     init_node_hash(struct node *);
+static void     link_tbucket(struct tree *);
+static void     reset_tbuckets(void);
+static void     rebuild_tc_hash(void);
 static void     print_error(const char *, const char *, int);
 static void     free_tree(struct tree *);
 static void     free_partial_tree(struct tree *, int);
@@ -695,6 +752,26 @@ name_hash(const char *name)
     return (hash);
 }
 
+/*
+ * FNV-1a over the lower cased label, so that labels which label_compare
+ * considers equal always hash alike.  name_hash() is kept for the token
+ * table, whose hash get_token() computes as it reads.
+ */
+static u_int
+label_hash(const char *label)
+{
+    u_int           hash = 2166136261U;
+    const char     *cp;
+
+    if (!label)
+        return 0;
+    for (cp = label; *cp; cp++) {
+        hash ^= (u_char) tolower((unsigned char)(*cp));
+        hash *= 16777619U;
+    }
+    return (hash);
+}
+
 void
 netsnmp_init_mib_internals(void)
 {
@@ -727,10 +804,11 @@ netsnmp_init_mib_internals(void)
     module_map[max_modc].next = NULL;
     module_map_head = module_map;
 
-    memset(nbuckets, 0, sizeof(nbuckets));
-    memset(tbuckets, 0, sizeof(tbuckets));
+    memset(nbuckets, 0, nbuckets_size * sizeof(*nbuckets));
+    reset_tbuckets();
     tc_alloc = TC_INCR;
     tclist = calloc(tc_alloc, sizeof(struct tc));
+    rebuild_tc_hash();
     build_translation_table();
     init_tree_roots();          /* Set up initial roots */
     /*
@@ -746,16 +824,38 @@ init_mib_internals(void)
 }
 #endif
 
+/*
+ * Hashes the nodes on their parent's label, with about one node per
+ * bucket.  Only the buckets in use are cleared, so a large module doesn't
+ * make the many small ones after it slower.
+ */
 static void
 init_node_hash(struct node *nodes)
 {
-    struct node    *np, *nextp;
+    struct node    *np, *nextp, **nb;
+    u_int           count, size;
     int             hash;
 
-    memset(nbuckets, 0, sizeof(nbuckets));
+    for (count = 0, np = nodes; np; np = np->next)
+        count++;
+    for (size = NHASHSIZE; size < count && size < 0x40000000U; size <<= 1)
+        ;
+    if (size > nbuckets_alloc) {
+        nb = malloc(size * sizeof(*nb));
+        if (nb) {
+            if (nbuckets != nbuckets_fixed)
+                free(nbuckets);
+            nbuckets = nb;
+            nbuckets_alloc = size;
+        } else {
+            size = nbuckets_alloc;
+        }
+    }
+    nbuckets_size = size;
+    memset(nbuckets, 0, nbuckets_size * sizeof(*nbuckets));
     for (np = nodes; np;) {
         nextp = np->next;
-        hash = NBUCKET(name_hash(np->parent));
+        hash = NBUCKET(label_hash(np->parent));
         np->next = nbuckets[hash];
         nbuckets[hash] = np;
         np = nextp;
@@ -824,10 +924,69 @@ alloc_node(int modid)
     return np;
 }
 
+/*
+ * Doubles tbuckets.  Each chain is moved in order, so trees with the same
+ * label are still found in the order they were hashed in.
+ */
+static void
+grow_tbuckets(void)
+{
+    struct tree   **tb, **tails, *tp, *next;
+    u_int           size = tbuckets_size * 2, i, hash;
+
+    tb = calloc(size, sizeof(*tb));
+    tails = calloc(size, sizeof(*tails));
+    if (!tb || !tails) {
+        free(tb);
+        free(tails);
+        return;                 /* keep the longer chains */
+    }
+    for (i = 0; i < tbuckets_size; i++)
+        for (tp = tbuckets[i]; tp; tp = next) {
+            next = tp->next;
+            tp->next = NULL;
+            hash = label_hash(tp->label) & (size - 1);
+            if (tails[hash])
+                tails[hash]->next = tp;
+            else
+                tb[hash] = tp;
+            tails[hash] = tp;
+        }
+    free(tails);
+    if (tbuckets != tbuckets_fixed)
+        free(tbuckets);
+    tbuckets = tb;
+    tbuckets_size = size;
+}
+
+static void
+link_tbucket(struct tree *tp)
+{
+    u_int           hash;
+
+    if (tbuckets_count >= tbuckets_size && tbuckets_size < 0x40000000U)
+        grow_tbuckets();
+    hash = TBUCKET(label_hash(tp->label));
+    tp->next = tbuckets[hash];
+    tbuckets[hash] = tp;
+    tbuckets_count++;
+}
+
+static void
+reset_tbuckets(void)
+{
+    if (tbuckets != tbuckets_fixed)
+        free(tbuckets);
+    tbuckets = tbuckets_fixed;
+    tbuckets_size = NHASHSIZE;
+    tbuckets_count = 0;
+    memset(tbuckets_fixed, 0, sizeof(tbuckets_fixed));
+}
+
 static void
 unlink_tbucket(struct tree *tp)
 {
-    int             hash = NBUCKET(name_hash(tp->label));
+    u_int           hash = TBUCKET(label_hash(tp->label));
     struct tree    *otp = NULL, *ntp = tbuckets[hash];
 
     while (ntp && ntp != tp) {
@@ -836,10 +995,13 @@ unlink_tbucket(struct tree *tp)
     }
     if (!ntp)
         snmp_log(LOG_EMERG, "Can't find %s in tbuckets\n", tp->label);
-    else if (otp)
-        otp->next = ntp->next;
-    else
-        tbuckets[hash] = tp->next;
+    else {
+        if (otp)
+            otp->next = ntp->next;
+        else
+            tbuckets[hash] = tp->next;
+        tbuckets_count--;
+    }
 }
 
 static void
@@ -847,6 +1009,7 @@ unlink_tree(struct tree *tp)
 {
     struct tree    *otp = NULL, *ntp = tp->parent;
 
+    tree_changed();
     if (!ntp) {                 /* this tree has no parent */
         DEBUGMSGTL(("unlink_tree", "Tree node %s has no parent\n",
                     tp->label));
@@ -891,6 +1054,8 @@ free_partial_tree(struct tree *tp, int keep_label)
     SNMP_FREE(tp->reference);
     SNMP_FREE(tp->augments);
     SNMP_FREE(tp->defaultValue);
+    SNMP_FREE(tp->child_index);
+    tp->child_count = 0;
 }
 
 /*
@@ -1156,7 +1321,6 @@ init_tree_roots(void)
 {
     struct tree    *tp, *lasttp;
     int             base_modid;
-    int             hash;
 
     base_modid = which_module("SNMPv2-SMI");
     if (base_modid == -1)
@@ -1177,9 +1341,7 @@ init_tree_roots(void)
     tp->subid = 2;
     tp->tc_index = -1;
     set_function(tp);           /* from mib.c */
-    hash = NBUCKET(name_hash(tp->label));
-    tp->next = tbuckets[hash];
-    tbuckets[hash] = tp;
+    link_tbucket(tp);
     lasttp = tp;
     root_imports[0].label = strdup(tp->label);
     root_imports[0].modid = base_modid;
@@ -1198,9 +1360,7 @@ init_tree_roots(void)
     tp->subid = 0;
     tp->tc_index = -1;
     set_function(tp);           /* from mib.c */
-    hash = NBUCKET(name_hash(tp->label));
-    tp->next = tbuckets[hash];
-    tbuckets[hash] = tp;
+    link_tbucket(tp);
     lasttp = tp;
     root_imports[1].label = strdup(tp->label);
     root_imports[1].modid = base_modid;
@@ -1219,9 +1379,7 @@ init_tree_roots(void)
     tp->subid = 1;
     tp->tc_index = -1;
     set_function(tp);           /* from mib.c */
-    hash = NBUCKET(name_hash(tp->label));
-    tp->next = tbuckets[hash];
-    tbuckets[hash] = tp;
+    link_tbucket(tp);
     lasttp = tp;
     root_imports[2].label = strdup(tp->label);
     root_imports[2].modid = base_modid;
@@ -1245,7 +1403,7 @@ find_tree_node(const char *name, int modid)
     if (!name || !*name)
         return (NULL);
 
-    headtp = tbuckets[NBUCKET(name_hash(name))];
+    headtp = tbuckets[TBUCKET(label_hash(name))];
     for (tp = headtp; tp; tp = tp->next) {
         if (tp->label && !label_compare(tp->label, name)) {
 
@@ -1262,6 +1420,124 @@ find_tree_node(const char *name, int modid)
     return (NULL);
 }
 
+/*
+ * Nodes with many children also keep them in an array sorted by subid.
+ * The array is built by the first lookup after the tree has changed,
+ * which every change to the tree's structure records by bumping
+ * tree_generation.
+ */
+#define CHILD_INDEX_MIN 16
+
+static u_int    tree_generation = 1;
+
+static void
+tree_changed(void)
+{
+    if (++tree_generation == 0)
+        tree_generation = 1;
+}
+
+/*
+ * Returns a number which changes whenever the tree does, for callers
+ * which remember what they looked up in it.
+ */
+u_int
+netsnmp_mib_generation(void)
+{
+    return tree_generation;
+}
+
+struct child_pos {
+    struct tree    *tp;
+    u_int           pos;
+};
+
+static int
+child_pos_cmp(const void *a, const void *b)
+{
+    const struct child_pos *ca = a, *cb = b;
+
+    if (ca->tp->subid != cb->tp->subid)
+        return ca->tp->subid < cb->tp->subid ? -1 : 1;
+    return ca->pos < cb->pos ? -1 : ca->pos > cb->pos;
+}
+
+static void
+index_children(struct tree *parent)
+{
+    struct tree    *tp, **children = NULL;
+    struct child_pos *sorted = NULL;
+    u_int           n = 0, i;
+
+    parent->child_gen = tree_generation;
+    for (tp = parent->child_list; tp; tp = tp->next_peer)
+        n++;
+    if (n >= CHILD_INDEX_MIN &&
+        (sorted = malloc(n * sizeof(*sorted))) != NULL)
+        children = realloc(parent->child_index, n * sizeof(*children));
+    if (children == NULL) {
+        free(sorted);
+        SNMP_FREE(parent->child_index);
+        parent->child_count = 0;
+        return;
+    }
+    /*
+     * peers with the same subid stay in list order
+     */
+    for (i = 0, tp = parent->child_list; tp; tp = tp->next_peer, i++) {
+        sorted[i].tp = tp;
+        sorted[i].pos = i;
+    }
+    qsort(sorted, n, sizeof(*sorted), child_pos_cmp);
+    for (i = 0; i < n; i++)
+        children[i] = sorted[i].tp;
+    free(sorted);
+    parent->child_index = children;
+    parent->child_count = n;
+}
+
+/**
+ * Finds a node by sub-identifier among the peers starting at list.
+ *
+ * @param list  the first of the peers, usually a parent's child_list
+ * @param subid the sub-identifier to look for
+ *
+ * @return the last of the peers with that sub-identifier, or NULL
+ */
+struct tree    *
+find_tree_subid(struct tree *list, u_long subid)
+{
+    struct tree    *parent = list ? list->parent : NULL;
+    u_int           lo, hi, mid;
+
+    if (parent && parent->child_list == list) {
+        if (parent->child_gen != tree_generation)
+            index_children(parent);
+        if (parent->child_index) {
+            lo = 0;
+            hi = parent->child_count;
+            while (lo < hi) {
+                mid = lo + (hi - lo) / 2;
+                if (parent->child_index[mid]->subid <= subid)
+                    lo = mid + 1;
+                else
+                    hi = mid;
+            }
+            if (lo > 0 && parent->child_index[lo - 1]->subid == subid)
+                return parent->child_index[lo - 1];
+            return NULL;
+        }
+    }
+    for (; list; list = list->next_peer) {
+        if (list->subid == subid) {
+            while (list->next_peer && list->next_peer->subid == subid)
+                list = list->next_peer;
+            return list;
+        }
+    }
+    return NULL;
+}
+
 /*
  * computes a value which represents how close name1 is to name2.
  * * high scores mean a worse match.
@@ -1384,6 +1660,7 @@ merge_anon_children(struct tree *tp1, struct tree *tp2)
 {
     struct tree    *child1, *child2, *previous;
 
+    tree_changed();
     for (child1 = tp1->child_list; child1;) {
 
         for (child2 = tp2->child_list, previous = NULL;
@@ -1479,9 +1756,9 @@ do_subtree(struct tree *root, struct node **nodes)
     struct tree    *xroot = root;
     struct node    *np, **headp;
     struct node    *oldnp = NULL, *child_list = NULL, *childp = NULL;
-    int             hash;
     int            *int_p;
 
+    tree_changed();
     while (xroot->next_peer && xroot->next_peer->subid == root->subid) {
 #if 0
         printf("xroot: %s.%s => %s\n", xroot->parent->label, xroot->label,
@@ -1491,7 +1768,7 @@ do_subtree(struct tree *root, struct node **nodes)
     }
 
     tp = root;
-    headp = &nbuckets[NBUCKET(name_hash(tp->label))];
+    headp = &nbuckets[NBUCKET(label_hash(tp->label))];
     /*
      * Search each of the nodes for one whose parent is root, and
      * move each into a separate list.
@@ -1602,9 +1879,7 @@ do_subtree(struct tree *root, struct node **nodes)
             otp->next_peer = tp;
         else
             xxroot->child_list = tp;
-        hash = NBUCKET(name_hash(tp->label));
-        tp->next = tbuckets[hash];
-        tbuckets[hash] = tp;
+        link_tbucket(tp);
         do_subtree(tp, nodes);
 
         if (anon_tp) {
@@ -1673,15 +1948,14 @@ do_subtree(struct tree *root, struct node **nodes)
                 /*
                  * hash in anon_tp in its new place 
                  */
-                hash = NBUCKET(name_hash(anon_tp->label));
-                anon_tp->next = tbuckets[hash];
-                tbuckets[hash] = anon_tp;
+                link_tbucket(anon_tp);
 
                 /*
                  * unlink and destroy tp 
                  */
                 unlink_tbucket(tp);
                 unlink_tree(tp);
+                SNMP_FREE(tp->child_index);
                 free(tp);
             } else {
                 /*
@@ -1770,10 +2044,10 @@ do_linkup(struct module *mp, struct node *np)
      */
     oldp = orphan_nodes;
     do {
-        for (i = 0; i < NHASHSIZE; i++)
+        for (i = 0; i < nbuckets_size; i++)
             for (onp = nbuckets[i]; onp; onp = onp->next) {
                 struct node    *op = NULL;
-                int             hash = NBUCKET(name_hash(onp->label));
+                int             hash = NBUCKET(label_hash(onp->label));
                 np = nbuckets[hash];
                 while (np) {
                     if (label_compare(onp->label, np->parent)) {
@@ -1796,7 +2070,7 @@ do_linkup(struct module *mp, struct node *np)
         more = 0;
         for (onp = orphan_nodes; onp != oldp; onp = onp->next) {
             struct node    *op = NULL;
-            int             hash = NBUCKET(name_hash(onp->label));
+            int             hash = NBUCKET(label_hash(onp->label));
             np = nbuckets[hash];
             while (np) {
                 if (label_compare(onp->label, np->parent)) {
@@ -1822,7 +2096,7 @@ do_linkup(struct module *mp, struct node *np)
      * complain about left over nodes 
      */
     for (np = orphan_nodes; np && np->next; np = np->next);     /* find the end of the orphan list */
-    for (i = 0; i < NHASHSIZE; i++)
+    for (i = 0; i < nbuckets_size; i++)
         if (nbuckets[i]) {
             if (orphan_nodes)
                 onp = np->next = nbuckets[i];
@@ -2117,9 +2391,9 @@ get_tc_index(const char *descriptor, int modid)
         }
 
 
-    for (i = 0, tcp = tclist; i < tc_alloc; i++, tcp++) {
-        if (tcp->type == 0)
-            break;
+    for (i = tc_hash[TCBUCKET(label_hash(descriptor))]; i != -1;
+         i = tcp->next) {
+        tcp = &tclist[i];
         if (!label_compare(descriptor, tcp->descriptor) &&
             ((modid == tcp->modid) || (modid == -1))) {
             return i;
@@ -2128,6 +2402,55 @@ get_tc_index(const char *descriptor, int modid)
     return -1;
 }
 
+/*
+ * Adds tclist[tc_index] to the end of its tc_hash chain, so that the
+ * chains stay in index order and get_tc_index() finds the first
+ * definition, as a scan of tclist would.
+ */
+static void
+link_tc_hash(int tc_index)
+{
+    int            *ip;
+
+    tclist[tc_index].next = -1;
+    for (ip = &tc_hash[TCBUCKET(label_hash(tclist[tc_index].descriptor))];
+         *ip != -1; ip = &tclist[*ip].next)
+        ;
+    *ip = tc_index;
+}
+
+/*
+ * Rehashes every textual convention in tclist, with room for tc_alloc
+ * of them.
+ */
+static void
+rebuild_tc_hash(void)
+{
+    u_int           size, i;
+    int            *th;
+
+    for (size = NHASHSIZE; size < (u_int) tc_alloc && size < 0x40000000U;
+         size <<= 1)
+        ;
+    if (size != tc_hash_size) {
+        th = size > NHASHSIZE ? malloc(size * sizeof(*th)) : tc_hash_fixed;
+        if (th) {
+            if (tc_hash != tc_hash_fixed)
+                free(tc_hash);
+            tc_hash = th;
+            tc_hash_size = size;
+        }
+    }
+    for (i = 0; i < tc_hash_size; i++)
+        tc_hash[i] = -1;
+    tc_count = 0;
+    for (i = 0; i < (u_int) tc_alloc; i++)
+        if (tclist[i].type) {
+            link_tc_hash(i);
+            tc_count = i + 1;
+        }
+}
+
 /*
  * translate integer tc_index to string identifier from tclist
  * *
@@ -2327,7 +2650,12 @@ parse_asntype(FILE * fp, char *name, int *ntype, char *ntoken)
     } else if (type == LEFTBRACKET) {
         struct node    *np;
         int             ch_next = '{';
-        ungetc(ch_next, fp);
+        if (fp)
+            ungetc(ch_next, fp);
+#ifdef MIB_PREFETCH
+        else if (replay_stream)
+            replay_unget(replay_stream);
+#endif
         np = parse_objectid(fp, name);
         if (np != NULL) {
             *ntype = get_token(fp, ntoken, MAXTOKEN);
@@ -2444,13 +2772,10 @@ parse_asntype(FILE * fp, char *name, int *ntype, char *ntoken)
         /*
          * textual convention 
          */
-        tcp = NULL;
-        for (i = 0; i < tc_alloc; i++) {
-            if (tclist[i].type == 0) {
-                if (tcp == NULL)
-                    tcp = &tclist[i];
-            } else if (strcmp(name, tclist[i].descriptor) == 0 &&
-                       tclist[i].modid == current_module) {
+        for (i = tc_hash[TCBUCKET(label_hash(name))]; i != -1;
+             i = tclist[i].next) {
+            if (strcmp(name, tclist[i].descriptor) == 0 &&
+                tclist[i].modid == current_module) {
                 snmp_log(LOG_ERR,
                          "Duplicate TEXTUAL-CONVENTION '%s' at line %d in %s. First at line %d\n",
                          name, mibLine, File, tclist[i].lineno);
@@ -2458,12 +2783,17 @@ parse_asntype(FILE * fp, char *name, int *ntype, char *ntoken)
             }
         }
 
-        if (tcp == NULL) {
-            tclist = realloc(tclist, (tc_alloc + TC_INCR)*sizeof(struct tc));
+        if (tc_count >= tc_alloc) {
+            tcp = realloc(tclist, (tc_alloc + TC_INCR)*sizeof(struct tc));
+            if (tcp == NULL)
+                goto err;
+            tclist = tcp;
             memset(tclist+tc_alloc, 0, TC_INCR*sizeof(struct tc));
-            tcp = tclist + tc_alloc;
             tc_alloc += TC_INCR;
+            if ((u_int) tc_alloc > tc_hash_size)
+                rebuild_tc_hash();
         }
+        tcp = &tclist[tc_count];
         if (!(type & SYNTAX_MASK)) {
             print_error("Textual convention doesn't map to real type",
                         token, type);
@@ -2475,6 +2805,7 @@ parse_asntype(FILE * fp, char *name, int *ntype, char *ntoken)
         tcp->description = descr;
         tcp->lineno = mibLine;
         tcp->type = type;
+        link_tc_hash(tc_count++);
         *ntype = get_token(fp, ntoken, MAXTOKEN);
         if (*ntype == LEFTPAREN) {
             tcp->ranges = parse_ranges(fp, &tcp->ranges);
@@ -3928,15 +4259,28 @@ read_from_file(struct module *mp, const char *name)
     const char     *oldFile = File;
     int             oldLine = mibLine;
     int             oldModule = current_module;
-    FILE           *fp;
+    FILE           *fp = NULL;
     struct node    *np;
     int             res;
+#ifdef MIB_PREFETCH
+    struct mib_stream *oldStream = replay_stream;
+    struct mib_stream *stream;
+#endif
 
     if (mp->no_imports != -1) {
         DEBUGMSGTL(("parse-mibs", "Module %s already loaded\n",
                     name));
         return MODULE_ALREADY_LOADED;
     }
+#ifdef MIB_PREFETCH
+    /*
+     * with no fp, get_token() replays the prefetched tokens
+     */
+    stream = prefetch_take(mp);
+    if (stream)
+        DEBUGMSGTL(("parse-mibs", "Using prefetched %s\n", mp->file));
+    else
+#endif
     if ((fp = fopen(mp->file, "r")) == NULL) {
         int rval;
         if (errno == ENOTDIR || errno == ENOENT)
@@ -3947,20 +4291,30 @@ read_from_file(struct module *mp, const char *name)
         return rval;
     }
 #ifdef HAVE_FLOCKFILE
-    flockfile(fp);
+    if (fp)
+        flockfile(fp);
 #endif
     mp->no_imports = 0; /* Note that we've read the file */
     File = mp->file;
     mibLine = 1;
     current_module = mp->modid;
+#ifdef MIB_PREFETCH
+    replay_stream = stream;
+#endif
     /*
      * Parse the file
      */
     np = parse(fp);
+    if (fp) {
 #ifdef HAVE_FUNLOCKFILE
-    funlockfile(fp);
+        funlockfile(fp);
+#endif
+        fclose(fp);
+    }
+#ifdef MIB_PREFETCH
+    replay_stream = oldStream;
+    mib_stream_free(stream);
 #endif
-    fclose(fp);
     File = oldFile;
     mibLine = oldLine;
     current_module = oldModule;
@@ -4007,7 +4361,7 @@ adopt_orphans(void)
 
     while (adopted) {
         adopted = 0;
-        for (i = 0; i < NHASHSIZE; i++)
+        for (i = 0; i < nbuckets_size; i++)
             if (nbuckets[i]) {
                 for (np = nbuckets[i]; np != NULL; np = np->next) {
                     tp = find_tree_node(np->parent, -1);
@@ -4042,7 +4396,7 @@ adopt_orphans(void)
      * Report on outstanding orphans
      *    and link them back into the orphan list
      */
-    for (i = 0; i < NHASHSIZE; i++)
+    for (i = 0; i < nbuckets_size; i++)
         if (nbuckets[i]) {
             if (orphan_nodes)
                 onp = np->next = nbuckets[i];
@@ -4102,6 +4456,7 @@ unload_module_by_ID(int modID, struct tree *tree_top)
     struct tree    *tp, *next;
     int             i;
 
+    tree_changed();
     for (tp = tree_top; tp; tp = next) {
         /*
          * Essentially, this is equivalent to the code fragment:
@@ -4202,6 +4557,13 @@ netsnmp_unload_module(const char *name)
         return MODULE_NOT_FOUND;
     }
     unload_module_by_ID(modID, tree_head);
+    if (mp->imports && mp->imports != root_imports) {
+        int             i;
+
+        for (i = 0; i < mp->no_imports; i++)
+            SNMP_FREE(mp->imports[i].label);
+        SNMP_FREE(mp->imports);
+    }
     mp->no_imports = -1;        /* mark as unloaded */
     return MODULE_LOADED_OK;    /* Well, you know what I mean! */
 }
@@ -4217,6 +4579,9 @@ unload_all_mibs(void)
     struct tc      *ptc;
     unsigned int    i;
 
+    netsnmp_mib_prefetch_done();
+    netsnmp_mib_index_clear();
+
     for (mcp = module_map_head; mcp; mcp = module_map_head) {
         if (mcp == module_map)
             break;
@@ -4230,7 +4595,8 @@ unload_all_mibs(void)
     for (mp = module_head; mp; mp = module_head) {
         struct module_import *mi = mp->imports;
         if (mi) {
-            for (i = 0; i < (unsigned int)mp->no_imports; ++i) {
+            for (i = 0; mp->no_imports > 0 &&
+                        i < (unsigned int)mp->no_imports; ++i) {
                 SNMP_FREE((mi + i)->label);
             }
             mp->no_imports = 0;
@@ -4264,10 +4630,15 @@ unload_all_mibs(void)
     }
     SNMP_FREE(tclist);
     tc_alloc = 0;
+    rebuild_tc_hash();
 
     memset(buckets, 0, sizeof(buckets));
-    memset(nbuckets, 0, sizeof(nbuckets));
-    memset(tbuckets, 0, sizeof(tbuckets));
+    if (nbuckets != nbuckets_fixed)
+        free(nbuckets);
+    nbuckets = nbuckets_fixed;
+    nbuckets_size = nbuckets_alloc = NHASHSIZE;
+    memset(nbuckets_fixed, 0, sizeof(nbuckets_fixed));
+    reset_tbuckets();
 
     for (i = 0; i < sizeof(root_imports) / sizeof(root_imports[0]); i++) {
         SNMP_FREE(root_imports[i].label);
@@ -4718,13 +5089,22 @@ static int netsnmp_getc(FILE *stream)
 #endif
 }
 
+static void
+lex_ungetc(struct mib_lexer *lx, int ch)
+{
+    if (lx->fp)
+        ungetc(ch, lx->fp);
+    else if (ch != EOF)
+        lx->cur--;
+}
+
 /*
  * Parses a token from the file.  The type of the token parsed is returned,
  * and the text is placed in the string pointed to by token.
  * Warning: this method may recurse.
  */
 static int
-get_token(FILE *const fp, char *const token, const int maxtlen)
+lex_token(struct mib_lexer *const lx, char *const token, const int maxtlen)
 {
     int             ch, ch_next;
     char           *cp;
@@ -4741,21 +5121,23 @@ fetch_next_token:
      * skip all white space 
      */
     do {
-        ch = netsnmp_getc(fp);
+        ch = LEX_GETC(lx);
         if (ch == '\n')
-            mibLine++;
+            (*lx->line)++;
     }
     while (isspace(ch) && ch != EOF);
+    if (!lx->fp)
+        lx->start = ch == EOF ? lx->cur : lx->cur - 1;
     *cp++ = ch;
     *cp = '\0';
     switch (ch) {
     case EOF:
         return ENDOFFILE;
     case '"':
-        return parseQuoteString(fp, token, maxtlen);
+        return parseQuoteString(lx, token, maxtlen);
     case '\'':                 /* binary or hex constant */
         seenSymbols = bdigits;
-        while ((ch = netsnmp_getc(fp)) != EOF && ch != '\'') {
+        while ((ch = LEX_GETC(lx)) != EOF && ch != '\'') {
             switch (seenSymbols) {
             case bdigits:
                 if (ch == '0' || ch == '1')
@@ -4776,7 +5158,7 @@ fetch_next_token:
         if (ch == '\'') {
             unsigned long   val = 0;
             char           *run = token + 1;
-            ch = netsnmp_getc(fp);
+            ch = LEX_GETC(lx);
             switch (ch) {
             case EOF:
                 return ENDOFFILE;
@@ -4835,25 +5217,25 @@ fetch_next_token:
     case '|':
         return BAR;
     case '.':
-        ch_next = netsnmp_getc(fp);
+        ch_next = LEX_GETC(lx);
         if (ch_next == '.')
             return RANGE;
-        ungetc(ch_next, fp);
+        lex_ungetc(lx, ch_next);
         return LABEL;
     case ':':
-        ch_next = netsnmp_getc(fp);
+        ch_next = LEX_GETC(lx);
         if (ch_next != ':') {
-            ungetc(ch_next, fp);
+            lex_ungetc(lx, ch_next);
             return LABEL;
         }
-        ch_next = netsnmp_getc(fp);
+        ch_next = LEX_GETC(lx);
         if (ch_next != '=') {
-            ungetc(ch_next, fp);
+            lex_ungetc(lx, ch_next);
             return LABEL;
         }
         return EQUALS;
     case '-':
-        ch_next = netsnmp_getc(fp);
+        ch_next = LEX_GETC(lx);
         if (ch_next == '-') {
             if (netsnmp_ds_get_boolean(NETSNMP_DS_LIBRARY_ID, 
 				       NETSNMP_DS_LIB_MIB_COMMENT_TERM)) {
@@ -4861,7 +5243,7 @@ fetch_next_token:
                  * Treat the rest of this line as a comment. 
                  */
                 while ((ch_next != EOF) && (ch_next != '\n'))
-                    ch_next = netsnmp_getc(fp);
+                    ch_next = LEX_GETC(lx);
             } else {
                 /*
                  * Treat the rest of the line or until another '--' as a comment 
@@ -4870,20 +5252,20 @@ fetch_next_token:
                  * (this is the "technically" correct way to parse comments) 
                  */
                 ch = ' ';
-                ch_next = netsnmp_getc(fp);
+                ch_next = LEX_GETC(lx);
                 while (ch_next != EOF && ch_next != '\n' &&
                        (ch != '-' || ch_next != '-')) {
                     ch = ch_next;
-                    ch_next = netsnmp_getc(fp);
+                    ch_next = LEX_GETC(lx);
                 }
             }
             if (ch_next == EOF)
                 return ENDOFFILE;
             if (ch_next == '\n')
-                mibLine++;
+                (*lx->line)++;
             goto fetch_next_token;
         }
-        ungetc(ch_next, fp);
+        lex_ungetc(lx, ch_next);
 	NETSNMP_FALLTHROUGH;
     default:
         /*
@@ -4895,17 +5277,19 @@ fetch_next_token:
             return LABEL;
         hash += tolower(ch);
       more:
-        while (is_labelchar(ch_next = netsnmp_getc(fp))) {
+        while (is_labelchar(ch_next = LEX_GETC(lx))) {
             hash += tolower(ch_next);
             if (cp - token < maxtlen - 1)
                 *cp++ = ch_next;
             else
                 too_long = 1;
         }
-        ungetc(ch_next, fp);
+        lex_ungetc(lx, ch_next);
         *cp = '\0';
 
-        if (too_long)
+        if (too_long && lx->quiet)
+            lx->trouble = 1;
+        else if (too_long)
             print_error("Warning: token too long", token, CONTINUE);
         for (tp = buckets[BUCKET(hash)]; tp; tp = tp->next) {
             if ((tp->hash == hash) && (!label_compare(tp->name, token)))
@@ -4914,9 +5298,9 @@ fetch_next_token:
         if (tp) {
             if (tp->token != CONTINUE)
                 return (tp->token);
-            while (isspace((ch_next = netsnmp_getc(fp))))
+            while (isspace((ch_next = LEX_GETC(lx))))
                 if (ch_next == '\n')
-                    mibLine++;
+                    (*lx->line)++;
             if (ch_next == EOF)
                 return ENDOFFILE;
             if (isalnum(ch_next)) {
@@ -4935,6 +5319,25 @@ fetch_next_token:
     }
 }
 
+/*
+ * Reads the next token from fp, or when fp is NULL, from the module
+ * being replayed.
+ */
+static int
+get_token(FILE *const fp, char *const token, const int maxtlen)
+{
+    struct mib_lexer lx;
+
+#ifdef MIB_PREFETCH
+    if (fp == NULL && replay_stream)
+        return replay_token(replay_stream, token, maxtlen);
+#endif
+    lx.fp = fp;
+    lx.line = &mibLine;
+    lx.quiet = 0;
+    return lex_token(&lx, token, maxtlen);
+}
+
 netsnmp_feature_child_of(parse_get_token, netsnmp_unused);
 #ifndef NETSNMP_FEATURE_REMOVE_PARSE_GET_TOKEN
 int
@@ -5147,6 +5550,1749 @@ read_all_mibs(void)
 }
 
 
+#ifdef MIB_PREFETCH
+/*
+ * Prefetching MIB modules.
+ *
+ * Reading a MIB is mostly tokenizing, and tokenizing a file doesn't
+ * depend on any other module.  netsnmp_mib_prefetch() starts threads
+ * which read and tokenize module files, and the modules those import,
+ * ahead of the parser.  Modules are still parsed and linked one at a
+ * time, in the usual order: read_from_file() takes the tokens of a
+ * module (waiting for them, or tokenizing the file itself if no thread
+ * has started on it yet) and get_token() replays them.
+ *
+ * Each token is recorded as tokenized into a MAXQUOTESTR buffer.  When a
+ * caller's buffer is small enough that the token might have been
+ * truncated, or tokenizing it produced a warning, get_token() tokenizes
+ * it again from the file's text with the caller's buffer, so the parser
+ * sees exactly what it would have read from the file.
+ */
+struct mib_lexeme {
+    int             type;
+    int             line;       /* mibLine after the token */
+    int             trouble;    /* tokenizing it produced a warning */
+    size_t          from;       /* offset tokenizing started at */
+    size_t          start;      /* offset of its first character */
+    size_t          end;        /* offset after it */
+    size_t          text;       /* offset of its text in texts */
+};
+
+struct mib_stream {
+    u_char         *buf;        /* the file */
+    size_t          len;
+    struct mib_lexeme *tokens;
+    int             count;
+    char           *texts;
+    int             next;       /* next token to replay */
+    size_t          pos;        /* replay offset in buf */
+};
+
+#define PREFETCH_IDLE   0       /* not wanted (yet) */
+#define PREFETCH_QUEUED 1
+#define PREFETCH_BUSY   2       /* being tokenized */
+#define PREFETCH_DONE   3       /* stream is set, or NULL on failure */
+#define PREFETCH_TAKEN  4
+
+struct mib_prefetch {
+    char           *name;
+    char           *file;
+    int             state;
+    struct mib_stream *stream;
+    struct mib_prefetch *next;  /* in prefetch_queue */
+};
+
+static pthread_mutex_t prefetch_lock;
+static pthread_cond_t prefetch_cond;
+static pthread_t *prefetch_threads;
+static int      prefetch_nthreads;
+static struct mib_prefetch *prefetch_jobs;      /* sorted by name */
+static int      prefetch_njobs;
+static struct mib_prefetch *prefetch_queue;
+static int      prefetch_busy;
+static int      prefetch_stop;
+
+static void
+mib_stream_free(struct mib_stream *s)
+{
+    if (!s)
+        return;
+    free(s->buf);
+    free(s->tokens);
+    free(s->texts);
+    free(s);
+}
+
+/*
+ * Reads file into memory and tokenizes all of it.  Runs on the prefetch
+ * threads, so it must only use the read-only parts of the parser's state.
+ */
+static struct mib_stream *
+mib_stream_read(const char *file)
+{
+    struct mib_stream *s;
+    struct mib_lexer lx;
+    struct mib_lexeme *t;
+    FILE           *fp;
+    char            token[MAXQUOTESTR];
+    size_t          size = 0, n, text_len = 0, text_size = 0, tlen;
+    int             alloc = 0, line = 1;
+    void           *p;
+
+    s = calloc(1, sizeof(*s));
+    if (!s)
+        return NULL;
+    fp = fopen(file, "r");
+    if (!fp) {
+        free(s);
+        return NULL;
+    }
+    do {
+        if (s->len == size) {
+            size = size ? size * 2 : 16384;
+            p = realloc(s->buf, size);
+            if (!p)
+                break;
+            s->buf = p;
+        }
+        n = fread(s->buf + s->len, 1, size - s->len, fp);
+        s->len += n;
+    } while (n > 0);
+    if (ferror(fp) || !feof(fp)) {
+        fclose(fp);
+        mib_stream_free(s);
+        return NULL;
+    }
+    fclose(fp);
+
+    memset(&lx, 0, sizeof(lx));
+    lx.cur = s->buf;
+    lx.end = s->buf + s->len;
+    lx.line = &line;
+    lx.quiet = 1;
+    do {
+        if (s->count == alloc) {
+            alloc = alloc ? alloc * 2 : 1024;
+            p = realloc(s->tokens, alloc * sizeof(*t));
+            if (!p)
+                goto fail;
+            s->tokens = p;
+        }
+        t = &s->tokens[s->count++];
+        t->from = lx.cur - s->buf;
+        lx.trouble = 0;
+        token[MAXQUOTESTR - 1] = '\0';  /* EOF in a string leaves it open */
+        t->type = lex_token(&lx, token, MAXQUOTESTR);
+        t->line = line;
+        t->trouble = lx.trouble;
+        t->start = lx.start - s->buf;
+        t->end = lx.cur - s->buf;
+        tlen = strlen(token) + 1;
+        if (text_len + tlen > text_size) {
+            text_size = text_size ? text_size * 2 : 65536;
+            if (text_size < text_len + tlen)
+                text_size = text_len + tlen;
+            p = realloc(s->texts, text_size);
+            if (!p)
+                goto fail;
+            s->texts = p;
+        }
+        memcpy(s->texts + text_len, token, tlen);
+        t->text = text_len;
+        text_len += tlen;
+    } while (t->type != ENDOFFILE);
+    return s;
+
+  fail:
+    mib_stream_free(s);
+    return NULL;
+}
+
+static int
+replay_token(struct mib_stream *s, char *token, int maxtlen)
+{
+    struct mib_lexeme *t;
+    struct mib_lexer lx;
+    int             type;
+
+    t = s->next < s->count ? &s->tokens[s->next] : NULL;
+    if (t && t->from == s->pos && !t->trouble &&
+        t->end - t->start + 2 < (size_t) maxtlen) {
+        strcpy(token, s->texts + t->text);
+        mibLine = t->line;
+        s->pos = t->end;
+        s->next++;
+        return t->type;
+    }
+
+    memset(&lx, 0, sizeof(lx));
+    lx.cur = s->buf + s->pos;
+    lx.end = s->buf + s->len;
+    lx.line = &mibLine;
+    type = lex_token(&lx, token, maxtlen);
+    s->pos = lx.cur - s->buf;
+    while (s->next < s->count && s->tokens[s->next].from < s->pos)
+        s->next++;
+    return type;
+}
+
+/*
+ * The equivalent of ungetc() of the '{' just read.
+ */
+static void
+replay_unget(struct mib_stream *s)
+{
+    if (s->pos > 0)
+        s->pos--;
+}
+
+static int
+prefetch_compare(const void *a, const void *b)
+{
+    return label_compare(((const struct mib_prefetch *) a)->name,
+                         ((const struct mib_prefetch *) b)->name);
+}
+
+static struct mib_prefetch *
+prefetch_find(const char *name)
+{
+    struct mib_prefetch key;
+
+    if (!prefetch_jobs || !name)
+        return NULL;
+    key.name = NETSNMP_REMOVE_CONST(char *, name);
+    return bsearch(&key, prefetch_jobs, prefetch_njobs,
+                   sizeof(*prefetch_jobs), prefetch_compare);
+}
+
+/*
+ * Queues the modules named in the IMPORTS of a tokenized module ahead of
+ * the others, as the parser needs them first.  Called with
+ * prefetch_lock held.
+ */
+static void
+prefetch_queue_imports(struct mib_stream *s)
+{
+    struct mib_prefetch *job;
+    int             i;
+
+    for (i = 0; i < s->count && s->tokens[i].type != IMPORTS; i++)
+        if (s->tokens[i].type == ENDOFFILE || i > 16)
+            return;
+    for (i++; i + 1 < s->count; i++) {
+        if (s->tokens[i].type == SEMI || s->tokens[i].type == ENDOFFILE)
+            break;
+        if (s->tokens[i].type != FROM)
+            continue;
+        job = prefetch_find(s->texts + s->tokens[++i].text);
+        if (job && job->state == PREFETCH_IDLE) {
+            job->state = PREFETCH_QUEUED;
+            job->next = prefetch_queue;
+            prefetch_queue = job;
+        }
+    }
+}
+
+/*
+ * Tokenizes a queued job.  Called with prefetch_lock held, which is
+ * released while the file is read.
+ */
+static void
+prefetch_run(struct mib_prefetch *job)
+{
+    struct mib_stream *s;
+
+    job->state = PREFETCH_BUSY;
+    prefetch_busy++;
+    pthread_mutex_unlock(&prefetch_lock);
+    s = mib_stream_read(job->file);
+    pthread_mutex_lock(&prefetch_lock);
+    prefetch_busy--;
+    job->stream = s;
+    job->state = PREFETCH_DONE;
+    if (s)
+        prefetch_queue_imports(s);
+    pthread_cond_broadcast(&prefetch_cond);
+}
+
+static void *
+prefetch_thread(void *arg)
+{
+    struct mib_prefetch *job;
+
+    pthread_mutex_lock(&prefetch_lock);
+    for (;;) {
+        /*
+         * a module being tokenized may still queue its imports
+         */
+        while (!prefetch_queue && !prefetch_stop && prefetch_busy > 0)
+            pthread_cond_wait(&prefetch_cond, &prefetch_lock);
+        if (!prefetch_queue || prefetch_stop)
+            break;
+        job = prefetch_queue;
+        prefetch_queue = job->next;
+        prefetch_run(job);
+    }
+    pthread_mutex_unlock(&prefetch_lock);
+    return arg;
+}
+
+/*
+ * Returns the tokens of mp if it has been prefetched, or NULL if it
+ * must be read from its file.
+ */
+static struct mib_stream *
+prefetch_take(struct module *mp)
+{
+    struct mib_prefetch *job, **jp;
+    struct mib_stream *s = NULL;
+
+    job = prefetch_find(mp->name);
+    if (!job || strcmp(job->file, mp->file) != 0)
+        return NULL;
+    pthread_mutex_lock(&prefetch_lock);
+    if (job->state == PREFETCH_QUEUED) {
+        for (jp = &prefetch_queue; *jp != job; jp = &(*jp)->next)
+            ;
+        *jp = job->next;
+        prefetch_run(job);
+    }
+    while (job->state == PREFETCH_BUSY)
+        pthread_cond_wait(&prefetch_cond, &prefetch_lock);
+    if (job->state == PREFETCH_DONE) {
+        s = job->stream;
+        job->stream = NULL;
+        job->state = PREFETCH_TAKEN;
+    }
+    pthread_mutex_unlock(&prefetch_lock);
+    return s;
+}
+
+/**
+ * Starts reading and tokenizing MIB modules on threads, ahead of
+ * netsnmp_read_module() and read_all_mibs() needing them.
+ *
+ * @param names    the modules which will be read, or NULL for all of
+ *                 the modules not read yet.  The modules they import are
+ *                 prefetched as well.
+ * @param count    the number of names.
+ * @param nthreads the number of threads to use.
+ *
+ * netsnmp_mib_prefetch_done() must be called once the modules have been
+ * read.  Does nothing if a prefetch is already running.
+ */
+void
+netsnmp_mib_prefetch(const char *const *names, int count, int nthreads)
+{
+    struct mib_prefetch *job, **tail;
+    struct module  *mp;
+    int             i, n;
+
+    if (prefetch_jobs || nthreads <= 0)
+        return;
+    netsnmp_init_mib_internals();       /* the keyword table */
+    for (n = 0, mp = module_head; mp; mp = mp->next)
+        if (mp->no_imports == -1)
+            n++;
+    if (n == 0)
+        return;
+    prefetch_jobs = calloc(n, sizeof(*prefetch_jobs));
+    prefetch_threads = calloc(nthreads, sizeof(*prefetch_threads));
+    if (!prefetch_jobs || !prefetch_threads)
+        goto fail;
+    for (prefetch_njobs = 0, mp = module_head; mp; mp = mp->next) {
+        if (mp->no_imports != -1)
+            continue;
+        job = &prefetch_jobs[prefetch_njobs++];
+        job->name = strdup(mp->name);
+        job->file = strdup(mp->file);
+        if (!job->name || !job->file)
+            goto fail;
+    }
+    qsort(prefetch_jobs, prefetch_njobs, sizeof(*prefetch_jobs),
+          prefetch_compare);
+
+    /*
+     * queue in the order the modules will be read
+     */
+    tail = &prefetch_queue;
+    for (i = 0, mp = module_head; names ? i < count : mp != NULL;
+         i++, mp = mp ? mp->next : NULL) {
+        job = prefetch_find(names ? names[i] : mp->name);
+        if (job && job->state == PREFETCH_IDLE) {
+            job->state = PREFETCH_QUEUED;
+            *tail = job;
+            tail = &job->next;
+        }
+    }
+    *tail = NULL;
+
+    pthread_mutex_init(&prefetch_lock, NULL);
+    pthread_cond_init(&prefetch_cond, NULL);
+    prefetch_stop = 0;
+    prefetch_busy = 0;
+    for (prefetch_nthreads = 0; prefetch_nthreads < nthreads;
+         prefetch_nthreads++)
+        if (pthread_create(&prefetch_threads[prefetch_nthreads], NULL,
+                           prefetch_thread, NULL) != 0)
+            break;
+    DEBUGMSGTL(("parse-mibs", "Prefetching %d modules on %d threads\n",
+                prefetch_njobs, prefetch_nthreads));
+    return;
+
+  fail:
+    snmp_log(LOG_ERR, "Cannot prefetch MIB modules: out of memory\n");
+    for (i = 0; prefetch_jobs && i < prefetch_njobs; i++) {
+        free(prefetch_jobs[i].name);
+        free(prefetch_jobs[i].file);
+    }
+    SNMP_FREE(prefetch_jobs);
+    SNMP_FREE(prefetch_threads);
+    prefetch_njobs = 0;
+    prefetch_queue = NULL;
+}
+
+/**
+ * Stops the threads started by netsnmp_mib_prefetch() and frees
+ * whatever they tokenized that wasn't read.
+ */
+void
+netsnmp_mib_prefetch_done(void)
+{
+    int             i;
+
+    if (!prefetch_jobs)
+        return;
+    pthread_mutex_lock(&prefetch_lock);
+    prefetch_stop = 1;
+    pthread_cond_broadcast(&prefetch_cond);
+    pthread_mutex_unlock(&prefetch_lock);
+    for (i = 0; i < prefetch_nthreads; i++)
+        pthread_join(prefetch_threads[i], NULL);
+    pthread_cond_destroy(&prefetch_cond);
+    pthread_mutex_destroy(&prefetch_lock);
+    for (i = 0; i < prefetch_njobs; i++) {
+        free(prefetch_jobs[i].name);
+        free(prefetch_jobs[i].file);
+        mib_stream_free(prefetch_jobs[i].stream);
+    }
+    SNMP_FREE(prefetch_jobs);
+    SNMP_FREE(prefetch_threads);
+    prefetch_njobs = 0;
+    prefetch_nthreads = 0;
+    prefetch_queue = NULL;
+}
+#else                           /* MIB_PREFETCH */
+void
+netsnmp_mib_prefetch(const char *const *names, int count, int nthreads)
+{
+}
+
+void
+netsnmp_mib_prefetch_done(void)
+{
+}
+#endif                          /* MIB_PREFETCH */
+
+
+/*
+ * Compiled MIB cache.
+ *
+ * The cache is an image of the parser's state once all MIBs have been
+ * read: the module list, the textual conventions and the tree, including
+ * the order of the label hash chains.  It is a header, a stream of 32 bit
+ * words describing the records and a pool of NUL terminated strings which
+ * the records refer to by offset.  As it contains no pointers it can be
+ * mapped anywhere; loading relocates it into ordinary tree nodes, which
+ * the rest of the library modifies and frees as usual.
+ *
+ * An image is only valid on the host that wrote it (the header records
+ * the byte order and word sizes), for the key it was written with, and
+ * while none of the module files or other listed paths have changed.
+ */
+#define MIB_CACHE_MAGIC         0x4e534d43      /* "NSMC" */
+#define MIB_CACHE_VERSION       2
+#define MIB_CACHE_BYTE_ORDER    0x01020304
+#define MIB_CACHE_HEADER_WORDS  7
+#define MIB_CACHE_NONE          0xffffffffU
+
+struct mib_cache_buf {
+    u_char         *data;
+    size_t          len;
+    size_t          size;
+};
+
+struct mib_cache_writer {
+    struct mib_cache_buf words;
+    struct mib_cache_buf strings;
+    int             error;
+};
+
+struct mib_cache_reader {
+    const u_char   *words;
+    size_t          nwords;
+    size_t          pos;
+    const char     *strings;
+    size_t          strings_len;
+    int             error;
+};
+
+struct mib_cache_index {
+    const struct tree *tp;
+    u_int           idx;
+};
+
+static void
+mib_cache_append(struct mib_cache_writer *w, struct mib_cache_buf *b,
+                 const void *data, size_t len)
+{
+    u_char         *p;
+    size_t          size;
+
+    if (w->error)
+        return;
+    if (b->len + len > b->size) {
+        size = b->size ? b->size : 4096;
+        while (size < b->len + len)
+            size *= 2;
+        p = realloc(b->data, size);
+        if (p == NULL) {
+            w->error = 1;
+            return;
+        }
+        b->data = p;
+        b->size = size;
+    }
+    memcpy(b->data + b->len, data, len);
+    b->len += len;
+}
+
+static void
+mib_cache_put(struct mib_cache_writer *w, u_int v)
+{
+    mib_cache_append(w, &w->words, &v, sizeof(v));
+}
+
+static void
+mib_cache_put_long(struct mib_cache_writer *w, u_long v)
+{
+    mib_cache_put(w, (u_int) (v & 0xffffffffU));
+    mib_cache_put(w, (u_int) ((v >> 16) >> 16));
+}
+
+static void
+mib_cache_put_str(struct mib_cache_writer *w, const char *s)
+{
+    if (s == NULL) {
+        mib_cache_put(w, MIB_CACHE_NONE);
+        return;
+    }
+    mib_cache_put(w, (u_int) w->strings.len);
+    mib_cache_append(w, &w->strings, s, strlen(s) + 1);
+}
+
+static void
+mib_cache_put_stat(struct mib_cache_writer *w, const char *path)
+{
+    struct stat     st;
+
+    mib_cache_put_str(w, path);
+    if (stat(path, &st) == 0) {
+        mib_cache_put_long(w, (u_long) st.st_mtime);
+        mib_cache_put_long(w, (u_long) st.st_size);
+    } else {
+        mib_cache_put_long(w, 0);
+        mib_cache_put_long(w, (u_long) -1);
+    }
+}
+
+/*
+ * Writes the key and the state of all module files and of the paths in
+ * the ENV_SEPARATOR separated list paths, which an image depends on.
+ */
+static void
+mib_cache_put_depends(struct mib_cache_writer *w, const char *key,
+                      const char *paths)
+{
+    struct module  *mp;
+    char           *copy, *entry, *st = NULL;
+    size_t          npos;
+    u_int           n = 0;
+
+    mib_cache_put_str(w, key);
+    npos = w->words.len;
+    mib_cache_put(w, 0);
+    for (mp = module_head; mp; mp = mp->next, n++)
+        mib_cache_put_stat(w, mp->file);
+    if (paths && (copy = strdup(paths)) != NULL) {
+        for (entry = strtok_r(copy, ENV_SEPARATOR, &st); entry;
+             entry = strtok_r(NULL, ENV_SEPARATOR, &st), n++)
+            mib_cache_put_stat(w, entry);
+        free(copy);
+    }
+    if (!w->error)
+        memcpy(w->words.data + npos, &n, sizeof(n));
+}
+
+static void
+mib_cache_put_lists(struct mib_cache_writer *w, struct enum_list *ep,
+                    struct range_list *rp)
+{
+    struct enum_list *e;
+    struct range_list *r;
+    u_int           n;
+
+    for (n = 0, e = ep; e; e = e->next)
+        n++;
+    mib_cache_put(w, n);
+    for (e = ep; e; e = e->next) {
+        mib_cache_put(w, (u_int) e->value);
+        mib_cache_put_str(w, e->label);
+        mib_cache_put(w, (u_int) e->lineno);
+    }
+    for (n = 0, r = rp; r; r = r->next)
+        n++;
+    mib_cache_put(w, n);
+    for (r = rp; r; r = r->next) {
+        mib_cache_put(w, (u_int) r->low);
+        mib_cache_put(w, (u_int) r->high);
+    }
+}
+
+static int
+mib_cache_index_cmp(const void *a, const void *b)
+{
+    const struct mib_cache_index *ia = a, *ib = b;
+
+    if ((const char *) ia->tp < (const char *) ib->tp)
+        return -1;
+    return (const char *) ia->tp > (const char *) ib->tp;
+}
+
+/*
+ * Returns the index of tp in the image, MIB_CACHE_NONE for NULL, or
+ * sets the writer's error if tp isn't part of the tree.
+ */
+static u_int
+mib_cache_find(struct mib_cache_writer *w, struct mib_cache_index *index,
+               size_t count, const struct tree *tp)
+{
+    struct mib_cache_index key, *found;
+
+    if (tp == NULL)
+        return MIB_CACHE_NONE;
+    key.tp = tp;
+    found = bsearch(&key, index, count, sizeof(*index), mib_cache_index_cmp);
+    if (found == NULL) {
+        w->error = 1;
+        return MIB_CACHE_NONE;
+    }
+    return found->idx;
+}
+
+/*
+ * Appends tp, its peers and all their descendants to *trees, parents
+ * before children.
+ */
+static int
+mib_cache_collect(struct tree *tp, struct tree ***trees, size_t *count,
+                  size_t *size)
+{
+    struct tree   **p;
+
+    for (; tp; tp = tp->next_peer) {
+        if (*count == *size) {
+            *size = *size ? *size * 2 : 1024;
+            p = realloc(*trees, *size * sizeof(*p));
+            if (p == NULL)
+                return -1;
+            *trees = p;
+        }
+        (*trees)[(*count)++] = tp;
+        if (mib_cache_collect(tp->child_list, trees, count, size) < 0)
+            return -1;
+    }
+    return 0;
+}
+
+/*
+ * Replaces file by the header and the image in w, and frees the image.
+ */
+static int
+mib_cache_write(const char *file, const u_int *header, size_t header_len,
+                struct mib_cache_writer *w)
+{
+    char           *tmpfile = NULL;
+    FILE           *fp = NULL;
+
+    if (!w->error && asprintf(&tmpfile, "%s.%ld", file, (long) getpid()) >= 0 &&
+        mkdirhier(file, NETSNMP_AGENT_DIRECTORY_MODE, 1) == 0 &&
+        (fp = fopen(tmpfile, "wb")) != NULL) {
+        if (fwrite(header, header_len, 1, fp) != 1 ||
+            fwrite(w->words.data, 1, w->words.len, fp) != w->words.len ||
+            fwrite(w->strings.data, 1, w->strings.len, fp) != w->strings.len)
+            w->error = 1;
+        if (fclose(fp) != 0)
+            w->error = 1;
+        if (w->error || rename(tmpfile, file) != 0) {
+            unlink(tmpfile);
+            fp = NULL;
+        }
+    }
+    free(tmpfile);
+    free(w->words.data);
+    free(w->strings.data);
+    return fp == NULL;
+}
+
+/**
+ * Writes the MIBs loaded so far to a compiled MIB cache.
+ *
+ * @param file  the cache file, which is replaced atomically
+ * @param key   describes the configuration the MIBs were loaded with
+ * @param paths ENV_SEPARATOR separated list of further paths (e.g. MIB
+ *              directories) whose modification invalidates the cache
+ *
+ * @return 0 on success, 1 if the cache could not be written
+ */
+int
+netsnmp_mib_cache_save(const char *file, const char *key, const char *paths)
+{
+    struct mib_cache_writer w;
+    struct mib_cache_index *index = NULL;
+    struct tree   **trees = NULL, *tp;
+    struct module  *mp;
+    struct index_list *ip;
+    struct varbind_list *vp;
+    struct tc      *tcp;
+    size_t          count = 0, size = 0, i;
+    u_int           n, header[MIB_CACHE_HEADER_WORDS];
+    int             j;
+
+    if (orphan_nodes) {
+        DEBUGMSGTL(("mib_cache", "not saving %s: unresolved nodes\n", file));
+        return 1;
+    }
+    memset(&w, 0, sizeof(w));
+
+    if (mib_cache_collect(tree_head, &trees, &count, &size) < 0 ||
+        count >= MIB_CACHE_NONE ||
+        (index = malloc(count * sizeof(*index) + 1)) == NULL) {
+        free(trees);
+        return 1;
+    }
+    for (i = 0; i < count; i++) {
+        index[i].tp = trees[i];
+        index[i].idx = (u_int) i;
+    }
+    qsort(index, count, sizeof(*index), mib_cache_index_cmp);
+
+    mib_cache_put_depends(&w, key, paths);
+    mib_cache_put(&w, (u_int) max_module);
+    mib_cache_put(&w, (u_int) anonymous);
+    for (j = 0; j < NUMBER_OF_ROOT_NODES; j++)
+        mib_cache_put(&w, (u_int) root_imports[j].modid);
+
+    /*
+     * modules, in list order
+     */
+    for (n = 0, mp = module_head; mp; mp = mp->next)
+        n++;
+    mib_cache_put(&w, n);
+    for (mp = module_head; mp; mp = mp->next) {
+        mib_cache_put_str(&w, mp->name);
+        mib_cache_put_str(&w, mp->file);
+        mib_cache_put(&w, (u_int) mp->modid);
+        mib_cache_put(&w, (u_int) mp->no_imports);
+        if (mp->imports == root_imports) {
+            mib_cache_put(&w, 1);
+        } else if (mp->imports && mp->no_imports > 0) {
+            mib_cache_put(&w, 2);
+            for (j = 0; j < mp->no_imports; j++) {
+                mib_cache_put_str(&w, mp->imports[j].label);
+                mib_cache_put(&w, (u_int) mp->imports[j].modid);
+            }
+        } else {
+            mib_cache_put(&w, 0);
+        }
+    }
+
+    /*
+     * textual conventions, by index
+     */
+    mib_cache_put(&w, (u_int) tc_alloc);
+    for (n = 0, j = 0; j < tc_alloc; j++)
+        if (tclist[j].type)
+            n++;
+    mib_cache_put(&w, n);
+    for (j = 0, tcp = tclist; j < tc_alloc; j++, tcp++) {
+        if (!tcp->type)
+            continue;
+        mib_cache_put(&w, (u_int) j);
+        mib_cache_put(&w, (u_int) tcp->type);
+        mib_cache_put(&w, (u_int) tcp->modid);
+        mib_cache_put_str(&w, tcp->descriptor);
+        mib_cache_put_str(&w, tcp->hint);
+        mib_cache_put_lists(&w, tcp->enums, tcp->ranges);
+        mib_cache_put_str(&w, tcp->description);
+        mib_cache_put(&w, (u_int) tcp->lineno);
+    }
+
+    /*
+     * the tree, parents first, and the label hash chains
+     */
+    mib_cache_put(&w, (u_int) count);
+    for (i = 0; i < count; i++) {
+        tp = trees[i];
+        mib_cache_put(&w, mib_cache_find(&w, index, count, tp->parent));
+        mib_cache_put_str(&w, tp->label);
+        mib_cache_put_long(&w, tp->subid);
+        mib_cache_put(&w, (u_int) tp->modid);
+        if (tp->module_list == &tp->modid || tp->number_modules <= 0) {
+            mib_cache_put(&w, 0);
+        } else {
+            mib_cache_put(&w, (u_int) tp->number_modules);
+            for (j = 0; j < tp->number_modules; j++)
+                mib_cache_put(&w, (u_int) tp->module_list[j]);
+        }
+        mib_cache_put(&w, (u_int) tp->number_modules);
+        mib_cache_put(&w, (u_int) tp->tc_index);
+        mib_cache_put(&w, (u_int) tp->type);
+        mib_cache_put(&w, (u_int) tp->access);
+        mib_cache_put(&w, (u_int) tp->status);
+        mib_cache_put_lists(&w, tp->enums, tp->ranges);
+        for (n = 0, ip = tp->indexes; ip; ip = ip->next)
+            n++;
+        mib_cache_put(&w, n);
+        for (ip = tp->indexes; ip; ip = ip->next) {
+            mib_cache_put_str(&w, ip->ilabel);
+            mib_cache_put(&w, (u_int) ip->isimplied);
+        }
+        mib_cache_put_str(&w, tp->augments);
+        for (n = 0, vp = tp->varbinds; vp; vp = vp->next)
+            n++;
+        mib_cache_put(&w, n);
+        for (vp = tp->varbinds; vp; vp = vp->next)
+            mib_cache_put_str(&w, vp->vblabel);
+        mib_cache_put_str(&w, tp->hint);
+        mib_cache_put_str(&w, tp->units);
+        mib_cache_put_str(&w, tp->description);
+        mib_cache_put_str(&w, tp->reference);
+        mib_cache_put_str(&w, tp->defaultValue);
+        mib_cache_put(&w, mib_cache_find(&w, index, count, tp->next));
+    }
+    mib_cache_put(&w, tbuckets_size);
+    for (j = 0; (u_int) j < tbuckets_size; j++)
+        mib_cache_put(&w, mib_cache_find(&w, index, count, tbuckets[j]));
+    free(index);
+    free(trees);
+
+    header[0] = MIB_CACHE_MAGIC;
+    header[1] = MIB_CACHE_VERSION;
+    header[2] = MIB_CACHE_BYTE_ORDER;
+    header[3] = sizeof(long);
+    header[4] = sizeof(oid);
+    header[5] = (u_int) (w.words.len / sizeof(u_int));
+    header[6] = (u_int) w.strings.len;
+
+    if (mib_cache_write(file, header, sizeof(header), &w) != 0) {
+        DEBUGMSGTL(("mib_cache", "could not write %s\n", file));
+        return 1;
+    }
+    DEBUGMSGTL(("mib_cache", "wrote %" NETSNMP_PRIz "u nodes to %s\n",
+                count, file));
+    return 0;
+}
+
+static u_int
+mib_cache_get(struct mib_cache_reader *r)
+{
+    u_int           v;
+
+    if (r->pos >= r->nwords) {
+        r->error = 1;
+        return 0;
+    }
+    memcpy(&v, r->words + r->pos++ * sizeof(v), sizeof(v));
+    return v;
+}
+
+static u_long
+mib_cache_get_long(struct mib_cache_reader *r)
+{
+    u_long          low = mib_cache_get(r);
+    u_long          high = mib_cache_get(r);
+
+    return low | ((high << 16) << 16);
+}
+
+/*
+ * Returns a count of items that take at least one word each.
+ */
+static u_int
+mib_cache_get_count(struct mib_cache_reader *r)
+{
+    u_int           n = mib_cache_get(r);
+
+    if (n > r->nwords - r->pos) {
+        r->error = 1;
+        return 0;
+    }
+    return n;
+}
+
+static const char *
+mib_cache_get_cstr(struct mib_cache_reader *r)
+{
+    u_int           off = mib_cache_get(r);
+
+    if (off == MIB_CACHE_NONE || r->error)
+        return NULL;
+    if (off >= r->strings_len ||
+        memchr(r->strings + off, '\0', r->strings_len - off) == NULL) {
+        r->error = 1;
+        return NULL;
+    }
+    return r->strings + off;
+}
+
+static char *
+mib_cache_get_str(struct mib_cache_reader *r)
+{
+    const char     *s = mib_cache_get_cstr(r);
+    char           *copy;
+
+    if (s == NULL)
+        return NULL;
+    copy = strdup(s);
+    if (copy == NULL)
+        r->error = 1;
+    return copy;
+}
+
+/*
+ * Checks what mib_cache_put_depends() wrote: returns 0 if the key matches
+ * and none of the files and paths have changed since.
+ */
+static int
+mib_cache_check_depends(struct mib_cache_reader *r, const char *key)
+{
+    struct stat     sb;
+    const char     *s;
+    u_long          mtime, size;
+    u_int           n;
+
+    s = mib_cache_get_cstr(r);
+    if (r->error || s == NULL || strcmp(s, key) != 0) {
+        DEBUGMSGTL(("mib_cache", "cache key differs\n"));
+        return 1;
+    }
+    for (n = mib_cache_get_count(r); n > 0 && !r->error; n--) {
+        s = mib_cache_get_cstr(r);
+        mtime = mib_cache_get_long(r);
+        size = mib_cache_get_long(r);
+        if (s == NULL || r->error)
+            return 1;
+        if (stat(s, &sb) == 0 ? ((u_long) sb.st_mtime != mtime ||
+                                 (u_long) sb.st_size != size)
+                              : size != (u_long) -1) {
+            DEBUGMSGTL(("mib_cache", "%s has changed\n", s));
+            return 1;
+        }
+    }
+    return r->error;
+}
+
+static void
+mib_cache_get_lists(struct mib_cache_reader *r, struct enum_list **enums,
+                    struct range_list **ranges)
+{
+    struct enum_list **ep = enums;
+    struct range_list **rp = ranges;
+    u_int           n;
+
+    for (n = mib_cache_get_count(r); n > 0 && !r->error; n--) {
+        *ep = calloc(1, sizeof(**ep));
+        if (*ep == NULL) {
+            r->error = 1;
+            return;
+        }
+        (*ep)->value = (int) mib_cache_get(r);
+        (*ep)->label = mib_cache_get_str(r);
+        (*ep)->lineno = (int) mib_cache_get(r);
+        ep = &(*ep)->next;
+    }
+    for (n = mib_cache_get_count(r); n > 0 && !r->error; n--) {
+        *rp = calloc(1, sizeof(**rp));
+        if (*rp == NULL) {
+            r->error = 1;
+            return;
+        }
+        (*rp)->low = (int) mib_cache_get(r);
+        (*rp)->high = (int) mib_cache_get(r);
+        rp = &(*rp)->next;
+    }
+}
+
+static void
+mib_cache_free_trees(struct tree **trees, size_t count)
+{
+    size_t          i;
+
+    for (i = 0; i < count; i++) {
+        if (!trees[i])
+            continue;
+        free_partial_tree(trees[i], FALSE);
+        if (trees[i]->module_list != &trees[i]->modid)
+            free(trees[i]->module_list);
+        free(trees[i]);
+    }
+    free(trees);
+}
+
+static void
+mib_cache_free_modules(struct module *mp)
+{
+    struct module  *next;
+    int             i;
+
+    for (; mp; mp = next) {
+        next = mp->next;
+        if (mp->imports && mp->imports != root_imports) {
+            for (i = 0; i < mp->no_imports; i++)
+                free(mp->imports[i].label);
+            free(mp->imports);
+        }
+        free(mp->name);
+        free(mp->file);
+        free(mp);
+    }
+}
+
+static void
+mib_cache_free_tclist(struct tc *list, int count)
+{
+    int             i;
+
+    if (!list)
+        return;
+    for (i = 0; i < count; i++) {
+        free_enums(&list[i].enums);
+        free_ranges(&list[i].ranges);
+        free(list[i].descriptor);
+        free(list[i].hint);
+        free(list[i].description);
+    }
+    free(list);
+}
+
+/*
+ * Returns the contents of file, mapped if possible, or NULL if it can't
+ * be read or is shorter than min_len.
+ */
+static u_char *
+mib_cache_map(const char *file, size_t min_len, size_t *len, int *mapped)
+{
+    struct stat     sb;
+    u_char         *image = NULL;
+    FILE           *fp;
+
+    *mapped = 0;
+    fp = fopen(file, "rb");
+    if (fp == NULL)
+        return NULL;
+    if (fstat(fileno(fp), &sb) != 0 || sb.st_size < (off_t) min_len) {
+        fclose(fp);
+        return NULL;
+    }
+    *len = (size_t) sb.st_size;
+#if defined(HAVE_MMAP) && defined(HAVE_SYS_MMAN_H)
+    image = mmap(NULL, *len, PROT_READ, MAP_PRIVATE, fileno(fp), 0);
+    if (image == MAP_FAILED)
+        image = NULL;
+    else
+        *mapped = 1;
+#endif
+    if (image == NULL) {
+        image = malloc(*len);
+        if (image && fread(image, 1, *len, fp) != *len) {
+            free(image);
+            image = NULL;
+        }
+    }
+    fclose(fp);
+    return image;
+}
+
+static void
+mib_cache_unmap(u_char *image, size_t len, int mapped)
+{
+#if defined(HAVE_MMAP) && defined(HAVE_SYS_MMAN_H)
+    if (mapped)
+        munmap(image, len);
+    else
+#endif
+        free(image);
+}
+
+/*
+ * Rebuilds the parser state from the image in r.  Nothing is changed
+ * unless the whole image is valid.
+ */
+static int
+mib_cache_relocate(struct mib_cache_reader *r, const char *key)
+{
+    struct module  *modules = NULL, **mpp = &modules, *mp;
+    struct tc      *tcs = NULL;
+    struct tree   **trees = NULL, **tails = NULL, *tp, *roots = NULL;
+    struct tree    *root_tail = NULL, **heads = NULL;
+    struct index_list **ipp;
+    struct varbind_list **vpp;
+    u_int          *nexts = NULL, parent, n, k, tcs_alloc = 0, count = 0;
+    u_int           nheads = 0;
+    int             new_max_module, new_anonymous, root_modid[NUMBER_OF_ROOT_NODES];
+    int             i;
+
+    if (mib_cache_check_depends(r, key) != 0)
+        return 1;
+
+    new_max_module = (int) mib_cache_get(r);
+    new_anonymous = (int) mib_cache_get(r);
+    for (i = 0; i < NUMBER_OF_ROOT_NODES; i++)
+        root_modid[i] = (int) mib_cache_get(r);
+
+    for (n = mib_cache_get_count(r); n > 0 && !r->error; n--) {
+        mp = *mpp = calloc(1, sizeof(*mp));
+        if (mp == NULL) {
+            r->error = 1;
+            break;
+        }
+        mpp = &mp->next;
+        mp->name = mib_cache_get_str(r);
+        mp->file = mib_cache_get_str(r);
+        mp->modid = (int) mib_cache_get(r);
+        mp->no_imports = (int) mib_cache_get(r);
+        if (mp->name == NULL || mp->file == NULL)
+            r->error = 1;
+        switch (mib_cache_get(r)) {
+        case 0:
+            break;
+        case 1:
+            mp->imports = root_imports;
+            if (mp->no_imports != NUMBER_OF_ROOT_NODES)
+                r->error = 1;
+            break;
+        case 2:
+            if (mp->no_imports <= 0 ||
+                (u_int) mp->no_imports > r->nwords - r->pos ||
+                (mp->imports = calloc(mp->no_imports,
+                                      sizeof(*mp->imports))) == NULL) {
+                mp->no_imports = 0;
+                r->error = 1;
+                break;
+            }
+            for (i = 0; i < mp->no_imports; i++) {
+                mp->imports[i].label = mib_cache_get_str(r);
+                mp->imports[i].modid = (int) mib_cache_get(r);
+            }
+            break;
+        default:
+            r->error = 1;
+        }
+    }
+
+    tcs_alloc = mib_cache_get(r);
+    if (!r->error && (tcs_alloc < TC_INCR || tcs_alloc > INT_MAX ||
+                      (tcs = calloc(tcs_alloc, sizeof(*tcs))) == NULL))
+        r->error = 1;
+    for (n = mib_cache_get_count(r); n > 0 && !r->error; n--) {
+        k = mib_cache_get(r);
+        if (k >= tcs_alloc || tcs[k].type) {
+            r->error = 1;
+            break;
+        }
+        tcs[k].type = (int) mib_cache_get(r);
+        tcs[k].modid = (int) mib_cache_get(r);
+        tcs[k].descriptor = mib_cache_get_str(r);
+        tcs[k].hint = mib_cache_get_str(r);
+        mib_cache_get_lists(r, &tcs[k].enums, &tcs[k].ranges);
+        tcs[k].description = mib_cache_get_str(r);
+        tcs[k].lineno = (int) mib_cache_get(r);
+        if (tcs[k].type == 0 || tcs[k].descriptor == NULL)
+            r->error = 1;
+    }
+
+    if (!r->error) {
+        count = mib_cache_get_count(r);
+        trees = calloc(count + 1, sizeof(*trees));
+        tails = calloc(count + 1, sizeof(*tails));
+        nexts = calloc(count + 1, sizeof(*nexts));
+        if (trees == NULL || tails == NULL || nexts == NULL)
+            r->error = 1;
+    }
+    for (k = 0; k < count && !r->error; k++) {
+        tp = trees[k] = calloc(1, sizeof(*tp));
+        if (tp == NULL) {
+            r->error = 1;
+            break;
+        }
+        tp->module_list = &tp->modid;
+        parent = mib_cache_get(r);
+        tp->label = mib_cache_get_str(r);
+        tp->subid = mib_cache_get_long(r);
+        tp->modid = (int) mib_cache_get(r);
+        n = mib_cache_get_count(r);
+        if (n > 0 && !r->error) {
+            tp->module_list = malloc(n * sizeof(int));
+            if (tp->module_list == NULL) {
+                tp->module_list = &tp->modid;
+                r->error = 1;
+                break;
+            }
+            for (i = 0; i < (int) n; i++)
+                tp->module_list[i] = (int) mib_cache_get(r);
+        }
+        tp->number_modules = (int) mib_cache_get(r);
+        if (n > 0 && tp->number_modules != (int) n)
+            r->error = 1;
+        tp->tc_index = (int) mib_cache_get(r);
+        tp->type = (int) mib_cache_get(r);
+        tp->access = (int) mib_cache_get(r);
+        tp->status = (int) mib_cache_get(r);
+        mib_cache_get_lists(r, &tp->enums, &tp->ranges);
+        ipp = &tp->indexes;
+        for (n = mib_cache_get_count(r); n > 0 && !r->error; n--) {
+            *ipp = calloc(1, sizeof(**ipp));
+            if (*ipp == NULL) {
+                r->error = 1;
+                break;
+            }
+            (*ipp)->ilabel = mib_cache_get_str(r);
+            (*ipp)->isimplied = (char) mib_cache_get(r);
+            ipp = &(*ipp)->next;
+        }
+        tp->augments = mib_cache_get_str(r);
+        vpp = &tp->varbinds;
+        for (n = mib_cache_get_count(r); n > 0 && !r->error; n--) {
+            *vpp = calloc(1, sizeof(**vpp));
+            if (*vpp == NULL) {
+                r->error = 1;
+                break;
+            }
+            (*vpp)->vblabel = mib_cache_get_str(r);
+            vpp = &(*vpp)->next;
+        }
+        tp->hint = mib_cache_get_str(r);
+        tp->units = mib_cache_get_str(r);
+        tp->description = mib_cache_get_str(r);
+        tp->reference = mib_cache_get_str(r);
+        tp->defaultValue = mib_cache_get_str(r);
+        nexts[k] = mib_cache_get(r);
+        if (tp->label == NULL ||
+            (nexts[k] != MIB_CACHE_NONE && nexts[k] >= count))
+            r->error = 1;
+
+        /*
+         * parents come first, so append to the parent's children
+         */
+        if (parent == MIB_CACHE_NONE) {
+            if (root_tail)
+                root_tail->next_peer = tp;
+            else
+                roots = tp;
+            root_tail = tp;
+        } else if (parent < k) {
+            tp->parent = trees[parent];
+            if (tails[parent])
+                tails[parent]->next_peer = tp;
+            else
+                trees[parent]->child_list = tp;
+            tails[parent] = tp;
+        } else {
+            r->error = 1;
+        }
+    }
+    nheads = mib_cache_get(r);
+    if (r->error || nheads < NHASHSIZE || (nheads & (nheads - 1)) ||
+        nheads > r->nwords - r->pos ||
+        (heads = calloc(nheads, sizeof(*heads))) == NULL)
+        r->error = 1;
+    for (k = 0; k < nheads && !r->error; k++) {
+        n = mib_cache_get(r);
+        if (n != MIB_CACHE_NONE && n >= count)
+            r->error = 1;
+        heads[k] = r->error || n == MIB_CACHE_NONE ? NULL : trees[n];
+    }
+    if (r->pos != r->nwords || roots == NULL)
+        r->error = 1;
+
+    free(tails);
+    if (r->error) {
+        DEBUGMSGTL(("mib_cache", "cache is corrupt\n"));
+        free(nexts);
+        free(heads);
+        if (trees)
+            mib_cache_free_trees(trees, count);
+        mib_cache_free_modules(modules);
+        mib_cache_free_tclist(tcs, tcs_alloc);
+        return 1;
+    }
+
+    /*
+     * replace the initial roots with the image
+     */
+    while (tree_head) {
+        tp = tree_head;
+        tree_head = tp->next_peer;
+        free_tree(tp);
+    }
+    for (k = 0; k < count; k++) {
+        trees[k]->next = nexts[k] == MIB_CACHE_NONE ? NULL : trees[nexts[k]];
+        set_function(trees[k]);
+    }
+    reset_tbuckets();
+    if (nheads == NHASHSIZE) {
+        memcpy(tbuckets_fixed, heads, sizeof(tbuckets_fixed));
+        free(heads);
+    } else {
+        tbuckets = heads;
+        tbuckets_size = nheads;
+    }
+    tbuckets_count = count;
+    tree_head = roots;
+    module_head = modules;
+    mib_cache_free_tclist(tclist, tc_alloc);
+    tclist = tcs;
+    tc_alloc = (int) tcs_alloc;
+    rebuild_tc_hash();
+    max_module = new_max_module;
+    anonymous = new_anonymous;
+    for (i = 0; i < NUMBER_OF_ROOT_NODES; i++)
+        root_imports[i].modid = root_modid[i];
+    free(nexts);
+    free(trees);
+    DEBUGMSGTL(("mib_cache", "loaded %u nodes\n", count));
+    return 0;
+}
+
+/**
+ * Replaces the initial MIB tree with the contents of a compiled MIB cache
+ * written by netsnmp_mib_cache_save().  Only done before any MIB has
+ * been read.
+ *
+ * @param file the cache file
+ * @param key  must match the key the cache was written with
+ *
+ * @return 0 if the cache was loaded, 1 if it is missing, stale or invalid
+ */
+int
+netsnmp_mib_cache_load(const char *file, const char *key)
+{
+    struct mib_cache_reader r;
+    struct tree    *tp;
+    u_int           header[MIB_CACHE_HEADER_WORDS];
+    u_char         *image;
+    size_t          image_len = 0;
+    int             mapped = 0, rc = 1;
+
+    if (module_head || orphan_nodes || !tree_head)
+        return 1;
+    for (tp = tree_head; tp; tp = tp->next_peer)
+        if (tp->child_list)
+            return 1;
+
+    image = mib_cache_map(file, sizeof(header), &image_len, &mapped);
+    if (image == NULL)
+        return 1;
+
+    memcpy(header, image, sizeof(header));
+    if (header[0] == MIB_CACHE_MAGIC && header[1] == MIB_CACHE_VERSION &&
+        header[2] == MIB_CACHE_BYTE_ORDER && header[3] == sizeof(long) &&
+        header[4] == sizeof(oid) &&
+        header[5] <= (image_len - sizeof(header)) / sizeof(u_int) &&
+        image_len == sizeof(header) + header[5] * sizeof(u_int) +
+                     header[6]) {
+        memset(&r, 0, sizeof(r));
+        r.words = image + sizeof(header);
+        r.nwords = header[5];
+        r.strings = (const char *) r.words + r.nwords * sizeof(u_int);
+        r.strings_len = header[6];
+        rc = mib_cache_relocate(&r, key);
+    } else {
+        DEBUGMSGTL(("mib_cache", "%s is not a MIB cache for this host\n",
+                    file));
+    }
+    mib_cache_unmap(image, image_len, mapped);
+    return rc;
+}
+
+/*
+ * Lazy MIB loading.
+ *
+ * The MIB index lists, for each module of a fully loaded tree, the labels
+ * the module defines and the OIDs where its definitions hang off nodes
+ * defined elsewhere.  Once an index is loaded the modules are read only
+ * when a lookup first needs them: netsnmp_mib_index_need_label() reads
+ * the modules defining a label, and netsnmp_mib_index_need_oid() those
+ * with definitions along an OID.  The index uses the layout of the
+ * compiled MIB cache, and the same rules for when it is valid.
+ */
+#define MIB_INDEX_MAGIC         0x4e534d49      /* "NSMI" */
+#define MIB_INDEX_VERSION       1
+#define MIB_INDEX_HEADER_WORDS  5
+
+struct mib_index_label {
+    const char     *label;
+    u_int           module;
+};
+
+struct mib_index_root {
+    const u_int    *subids;     /* in the image */
+    u_int           len;
+    u_int           module;
+};
+
+struct mib_index_module {
+    const char     *name;
+    int             loaded;
+};
+
+static struct {
+    u_char         *image;
+    size_t          image_len;
+    int             mapped;
+    struct mib_index_module *modules;
+    struct mib_index_label *labels;
+    struct mib_index_root *roots;
+    u_int           nmodules, nlabels, nroots;
+    u_int           pending;    /* modules not read yet */
+    int             busy;
+} mib_index;
+
+static int
+tree_has_module(const struct tree *tp, int modid)
+{
+    int             i;
+
+    for (i = 0; i < tp->number_modules; i++)
+        if (tp->module_list[i] == modid)
+            return 1;
+    return 0;
+}
+
+/*
+ * Writes a record for each module defining tp, its peers and their
+ * descendants: the module, the label and, where the parent is defined
+ * by other modules only, the OID.  name holds the OID of the parent.
+ */
+static void
+mib_index_put_tree(struct mib_cache_writer *w, const struct tree *tp,
+                   const int *slot, u_int *name, size_t len, u_int *count)
+{
+    int             i, m;
+    size_t          k;
+
+    for (; tp; tp = tp->next_peer) {
+        if (len < MAX_OID_LEN)
+            name[len] = (u_int) tp->subid;
+        for (i = 0; i < tp->number_modules; i++) {
+            m = tp->module_list[i];
+            if (m < 0 || m > max_module || slot[m] < 0)
+                continue;
+            mib_cache_put(w, (u_int) slot[m]);
+            mib_cache_put_str(w, tp->label);
+            if (len < MAX_OID_LEN &&
+                (!tp->parent || !tree_has_module(tp->parent, m))) {
+                mib_cache_put(w, (u_int) len + 1);
+                for (k = 0; k <= len; k++)
+                    mib_cache_put(w, name[k]);
+            } else {
+                mib_cache_put(w, 0);
+            }
+            (*count)++;
+        }
+        if (tp->child_list)
+            mib_index_put_tree(w, tp->child_list, slot, name, len + 1, count);
+    }
+}
+
+/**
+ * Writes an index of the MIBs loaded so far, for loading them lazily.
+ *
+ * @param file  the index file, which is replaced atomically
+ * @param key   describes the configuration the MIBs were loaded with
+ * @param paths ENV_SEPARATOR separated list of further paths (e.g. MIB
+ *              directories) whose modification invalidates the index
+ *
+ * @return 0 on success, 1 if the index could not be written
+ */
+int
+netsnmp_mib_index_save(const char *file, const char *key, const char *paths)
+{
+    struct mib_cache_writer w;
+    struct module  *mp;
+    u_int           header[MIB_INDEX_HEADER_WORDS], n, count = 0;
+    u_int           name[MAX_OID_LEN];
+    size_t          npos;
+    int            *slot;
+
+    slot = malloc((max_module + 1) * sizeof(*slot));
+    if (slot == NULL)
+        return 1;
+    memset(&w, 0, sizeof(w));
+    mib_cache_put_depends(&w, key, paths);
+
+    /*
+     * the modules which have been read
+     */
+    npos = w.words.len;
+    mib_cache_put(&w, 0);
+    memset(slot, 0xff, (max_module + 1) * sizeof(*slot));
+    for (n = 0, mp = module_head; mp; mp = mp->next) {
+        if (mp->no_imports == -1 || mp->modid < 0 || mp->modid > max_module)
+            continue;
+        slot[mp->modid] = (int) n++;
+        mib_cache_put_str(&w, mp->name);
+    }
+    if (!w.error)
+        memcpy(w.words.data + npos, &n, sizeof(n));
+
+    npos = w.words.len;
+    mib_cache_put(&w, 0);
+    mib_index_put_tree(&w, tree_head, slot, name, 0, &count);
+    if (!w.error)
+        memcpy(w.words.data + npos, &count, sizeof(count));
+    free(slot);
+
+    header[0] = MIB_INDEX_MAGIC;
+    header[1] = MIB_INDEX_VERSION;
+    header[2] = MIB_CACHE_BYTE_ORDER;
+    header[3] = (u_int) (w.words.len / sizeof(u_int));
+    header[4] = (u_int) w.strings.len;
+    if (mib_cache_write(file, header, sizeof(header), &w) != 0) {
+        DEBUGMSGTL(("mib_index", "could not write %s\n", file));
+        return 1;
+    }
+    DEBUGMSGTL(("mib_index", "wrote %u definitions of %u modules to %s\n",
+                count, n, file));
+    return 0;
+}
+
+static int
+mib_index_label_cmp(const void *a, const void *b)
+{
+    return label_compare(((const struct mib_index_label *) a)->label,
+                         ((const struct mib_index_label *) b)->label);
+}
+
+/*
+ * Compares the OID of a root with the OID name of length len.
+ */
+static int
+mib_index_root_oid_cmp(const struct mib_index_root *rp, const oid *name,
+                       size_t len)
+{
+    size_t          k;
+
+    for (k = 0; k < rp->len && k < len; k++)
+        if (rp->subids[k] != name[k])
+            return rp->subids[k] < name[k] ? -1 : 1;
+    if (rp->len == len)
+        return 0;
+    return rp->len < len ? -1 : 1;
+}
+
+static int
+mib_index_root_cmp(const void *a, const void *b)
+{
+    const struct mib_index_root *ra = a, *rb = b;
+    size_t          k;
+
+    for (k = 0; k < ra->len && k < rb->len; k++)
+        if (ra->subids[k] != rb->subids[k])
+            return ra->subids[k] < rb->subids[k] ? -1 : 1;
+    if (ra->len == rb->len)
+        return 0;
+    return ra->len < rb->len ? -1 : 1;
+}
+
+/**
+ * Forgets the MIB index, after which no more modules are read lazily.
+ */
+void
+netsnmp_mib_index_clear(void)
+{
+    free(mib_index.modules);
+    free(mib_index.labels);
+    free(mib_index.roots);
+    if (mib_index.image)
+        mib_cache_unmap(mib_index.image, mib_index.image_len,
+                        mib_index.mapped);
+    memset(&mib_index, 0, sizeof(mib_index));
+}
+
+/**
+ * Loads an index written by netsnmp_mib_index_save(), so that the modules
+ * it lists are read when they are first needed instead of up front.
+ *
+ * @param file the index file
+ * @param key  must match the key the index was written with
+ *
+ * @return 0 if the index was loaded, 1 if it is missing, stale or invalid
+ */
+int
+netsnmp_mib_index_load(const char *file, const char *key)
+{
+    struct mib_cache_reader r;
+    u_int           header[MIB_INDEX_HEADER_WORDS], i, n, len;
+
+    netsnmp_mib_index_clear();
+    mib_index.image = mib_cache_map(file, sizeof(header),
+                                    &mib_index.image_len, &mib_index.mapped);
+    if (mib_index.image == NULL)
+        return 1;
+    memcpy(header, mib_index.image, sizeof(header));
+    if (header[0] != MIB_INDEX_MAGIC || header[1] != MIB_INDEX_VERSION ||
+        header[2] != MIB_CACHE_BYTE_ORDER ||
+        header[3] > (mib_index.image_len - sizeof(header)) / sizeof(u_int) ||
+        mib_index.image_len != sizeof(header) + header[3] * sizeof(u_int) +
+                               header[4]) {
+        DEBUGMSGTL(("mib_index", "%s is not a MIB index for this host\n",
+                    file));
+        netsnmp_mib_index_clear();
+        return 1;
+    }
+    memset(&r, 0, sizeof(r));
+    r.words = mib_index.image + sizeof(header);
+    r.nwords = header[3];
+    r.strings = (const char *) r.words + r.nwords * sizeof(u_int);
+    r.strings_len = header[4];
+    if (mib_cache_check_depends(&r, key) != 0) {
+        netsnmp_mib_index_clear();
+        return 1;
+    }
+
+    n = mib_cache_get_count(&r);
+    if (!r.error &&
+        (mib_index.modules = calloc(n + 1, sizeof(*mib_index.modules))) == NULL)
+        r.error = 1;
+    for (i = 0; i < n && !r.error; i++) {
+        mib_index.modules[i].name = mib_cache_get_cstr(&r);
+        if (mib_index.modules[i].name == NULL)
+            r.error = 1;
+    }
+    mib_index.nmodules = n;
+
+    n = mib_cache_get_count(&r);
+    if (!r.error &&
+        ((mib_index.labels = calloc(n + 1, sizeof(*mib_index.labels))) == NULL ||
+         (mib_index.roots = calloc(n + 1, sizeof(*mib_index.roots))) == NULL))
+        r.error = 1;
+    for (i = 0; i < n && !r.error; i++) {
+        mib_index.labels[i].module = mib_cache_get(&r);
+        mib_index.labels[i].label = mib_cache_get_cstr(&r);
+        len = mib_cache_get(&r);
+        if (mib_index.labels[i].module >= mib_index.nmodules ||
+            mib_index.labels[i].label == NULL || len > MAX_OID_LEN ||
+            len > r.nwords - r.pos) {
+            r.error = 1;
+            break;
+        }
+        if (len) {
+            mib_index.roots[mib_index.nroots].subids =
+                (const u_int *) (r.words + r.pos * sizeof(u_int));
+            mib_index.roots[mib_index.nroots].len = len;
+            mib_index.roots[mib_index.nroots].module =
+                mib_index.labels[i].module;
+            mib_index.nroots++;
+            r.pos += len;
+        }
+    }
+    mib_index.nlabels = n;
+    if (r.error || r.pos != r.nwords) {
+        DEBUGMSGTL(("mib_index", "index is corrupt\n"));
+        netsnmp_mib_index_clear();
+        return 1;
+    }
+    qsort(mib_index.labels, mib_index.nlabels, sizeof(*mib_index.labels),
+          mib_index_label_cmp);
+    qsort(mib_index.roots, mib_index.nroots, sizeof(*mib_index.roots),
+          mib_index_root_cmp);
+    mib_index.pending = mib_index.nmodules;
+    DEBUGMSGTL(("mib_index", "loaded %u labels and %u subtrees of %u modules\n",
+                mib_index.nlabels, mib_index.nroots, mib_index.nmodules));
+    return 0;
+}
+
+static void
+mib_index_read_module(u_int module)
+{
+    struct mib_index_module *mip = &mib_index.modules[module];
+
+    if (mip->loaded)
+        return;
+    mip->loaded = 1;
+    mib_index.pending--;
+    DEBUGMSGTL(("mib_index", "reading %s\n", mip->name));
+    mib_index.busy = 1;
+    netsnmp_read_module(mip->name);
+    adopt_orphans();
+    mib_index.busy = 0;
+}
+
+/**
+ * Reads the modules of the MIB index which define label, unless they
+ * have been read already.
+ */
+void
+netsnmp_mib_index_need_label(const char *label)
+{
+    u_int           lo, hi, mid;
+
+    if (!mib_index.pending || mib_index.busy)
+        return;
+    lo = 0;
+    hi = mib_index.nlabels;
+    while (lo < hi) {
+        mid = lo + (hi - lo) / 2;
+        if (label_compare(mib_index.labels[mid].label, label) < 0)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    for (; lo < mib_index.nlabels &&
+         !label_compare(mib_index.labels[lo].label, label); lo++)
+        mib_index_read_module(mib_index.labels[lo].module);
+}
+
+/**
+ * Reads the modules of the MIB index which define any of the nodes
+ * along name, unless they have been read already.
+ */
+void
+netsnmp_mib_index_need_oid(const oid *name, size_t len)
+{
+    u_int           lo, hi, mid;
+    size_t          k;
+
+    if (!mib_index.pending || mib_index.busy)
+        return;
+    for (k = 1; k <= len && k <= MAX_OID_LEN; k++) {
+        lo = 0;
+        hi = mib_index.nroots;
+        while (lo < hi) {
+            mid = lo + (hi - lo) / 2;
+            if (mib_index_root_oid_cmp(&mib_index.roots[mid], name, k) < 0)
+                lo = mid + 1;
+            else
+                hi = mid;
+        }
+        for (; lo < mib_index.nroots &&
+             !mib_index_root_oid_cmp(&mib_index.roots[lo], name, k); lo++)
+            mib_index_read_module(mib_index.roots[lo].module);
+    }
+}
+
 #ifdef TEST
 int main(int argc, char *argv[])
 {
@@ -5171,23 +7317,26 @@ int main(int argc, char *argv[])
 #endif                          /* TEST */
 
 static int
-parseQuoteString(FILE * fp, char *token, int maxtlen)
+parseQuoteString(struct mib_lexer *lx, char *token, int maxtlen)
 {
     register int    ch;
     int             count = 0;
     int             too_long = 0;
     char           *token_start = token;
 
-    for (ch = netsnmp_getc(fp); ch != EOF; ch = netsnmp_getc(fp)) {
+    for (ch = LEX_GETC(lx); ch != EOF; ch = LEX_GETC(lx)) {
         if (ch == '\r')
             continue;
         if (ch == '\n') {
-            mibLine++;
+            (*lx->line)++;
         } else if (ch == '"') {
             netsnmp_assert(token - token_start < maxtlen);
             *token = '\0';
-            if (too_long && netsnmp_ds_get_int(NETSNMP_DS_LIBRARY_ID, 
-					   NETSNMP_DS_LIB_MIB_WARNINGS) > 1) {
+            if (too_long && lx->quiet) {
+                lx->trouble = 1;
+            } else if (too_long &&
+                       netsnmp_ds_get_int(NETSNMP_DS_LIBRARY_ID,
+                                          NETSNMP_DS_LIB_MIB_WARNINGS) > 1) {
                 /*
                  * show short form for brevity sake 
                  */
@@ -139,8 +139,160 @@ netsnmp_feature_child_of(read_config_register_app_prenetsnmp_mib_handler, netsnm
 
 static int      config_errors;
 
+static void     journal_free_all(void);
+
 struct config_files *config_files = NULL;
 
+/*
+ * An index of the registered tokens, so that the handler for a line is
+ * found without walking the handler list of its type.  Tokens match
+ * without regard to case, and of the handlers in one list that match a
+ * token only the first is indexed, so a lookup finds the same handler as
+ * a walk of the list would.
+ */
+struct config_index_entry {
+    struct config_files       *type;
+    struct config_line        *line;
+    unsigned int               hash;
+    struct config_index_entry *next;
+};
+
+static struct config_index_entry **config_index;
+static unsigned int config_index_size;  /* number of buckets, a power of 2 */
+static unsigned int config_index_count;
+static int          config_index_failed;
+
+static unsigned int
+config_index_hash(const char *token)
+{
+    unsigned int    hash = 2166136261U;
+
+    for (; *token; token++)
+        hash = (hash ^ tolower((unsigned char) *token)) * 16777619U;
+    return hash;
+}
+
+static struct config_index_entry *
+config_index_find(struct config_files *type, const char *token)
+{
+    struct config_index_entry *ep;
+    unsigned int    hash;
+
+    if (!config_index)
+        return NULL;
+    hash = config_index_hash(token);
+    for (ep = config_index[hash & (config_index_size - 1)]; ep;
+         ep = ep->next)
+        if (ep->hash == hash && ep->type == type &&
+            !strcasecmp(ep->line->config_token, token))
+            return ep;
+    return NULL;
+}
+
+static void
+config_index_grow(void)
+{
+    struct config_index_entry **table, *ep, *next;
+    unsigned int    size, i;
+
+    size = config_index_size ? config_index_size * 2 : 64;
+    table = (struct config_index_entry **) calloc(size, sizeof(*table));
+    if (!table)
+        return;                 /* still correct, only slower */
+    for (i = 0; i < config_index_size; i++) {
+        for (ep = config_index[i]; ep; ep = next) {
+            next = ep->next;
+            ep->next = table[ep->hash & (size - 1)];
+            table[ep->hash & (size - 1)] = ep;
+        }
+    }
+    free(config_index);
+    config_index = table;
+    config_index_size = size;
+}
+
+/*
+ * Indexes a handler that was added to the end of the list of its type,
+ * unless an earlier one already matches its token.
+ */
+static void
+config_index_add(struct config_files *type, struct config_line *line)
+{
+    struct config_index_entry *ep, **bucket;
+
+    if (config_index_find(type, line->config_token))
+        return;
+    if (config_index_count >= config_index_size)
+        config_index_grow();
+    ep = (struct config_index_entry *) malloc(sizeof(*ep));
+    if (!ep || !config_index) {
+        /*
+         * a handler missing from the index would not be found, so stop
+         * using it
+         */
+        free(ep);
+        config_index_failed = 1;
+        return;
+    }
+    ep->type = type;
+    ep->line = line;
+    ep->hash = config_index_hash(line->config_token);
+    bucket = &config_index[ep->hash & (config_index_size - 1)];
+    ep->next = *bucket;
+    *bucket = ep;
+    config_index_count++;
+}
+
+/*
+ * Drops a handler that has been taken off the list of its type from the
+ * index, and indexes the next handler in the list with a matching token
+ * in its place.
+ */
+static void
+config_index_remove(struct config_files *type, struct config_line *line)
+{
+    struct config_index_entry **epp, *ep;
+    struct config_line *lptr;
+
+    if (!config_index)
+        return;
+    epp = &config_index[config_index_hash(line->config_token) &
+                        (config_index_size - 1)];
+    for (; *epp; epp = &(*epp)->next) {
+        if ((*epp)->line == line) {
+            ep = *epp;
+            *epp = ep->next;
+            free(ep);
+            config_index_count--;
+            break;
+        }
+    }
+    for (lptr = type->start; lptr; lptr = lptr->next) {
+        if (!strcasecmp(lptr->config_token, line->config_token)) {
+            config_index_add(type, lptr);
+            break;
+        }
+    }
+}
+
+static void
+config_index_free(void)
+{
+    struct config_index_entry *ep, *next;
+    unsigned int    i;
+
+    for (i = 0; i < config_index_size; i++) {
+        for (ep = config_index[i]; ep; ep = next) {
+            next = ep->next;
+            free(ep);
+        }
+    }
+    SNMP_FREE(config_index);
+    config_index_size = 0;
+    config_index_count = 0;
+    config_index_failed = 0;
+}
+
 
 static struct config_line *
 internal_register_config_handler(const char *type_param,
@@ -233,6 +385,7 @@ internal_register_config_handler(const char *type_param,
 
         if (help != NULL)
             (*ltmp)->help = strdup(help);
+        config_index_add(*ctmp, *ltmp);
     }
 
     /*
@@ -408,12 +561,14 @@ unregister_config_handler(const char *type_param, const char *token)
          * found it at the top of the list 
          */
         struct config_line *ltmp2 = (*ltmp)->next;
-        if ((*ltmp)->free_func)
-            (*ltmp)->free_func();
-        SNMP_FREE((*ltmp)->config_token);
-        SNMP_FREE((*ltmp)->help);
-        SNMP_FREE(*ltmp);
+        struct config_line *found = *ltmp;
         (*ctmp)->start = ltmp2;
+        config_index_remove(*ctmp, found);
+        if (found->free_func)
+            found->free_func();
+        SNMP_FREE(found->config_token);
+        SNMP_FREE(found->help);
+        SNMP_FREE(found);
         return;
     }
     while ((*ltmp)->next != NULL
@@ -421,13 +576,14 @@ unregister_config_handler(const char *type_param, const char *token)
         ltmp = &((*ltmp)->next);
     }
     if ((*ltmp)->next != NULL) {
-        struct config_line *ltmp2 = (*ltmp)->next->next;
-        if ((*ltmp)->next->free_func)
-            (*ltmp)->next->free_func();
-        SNMP_FREE((*ltmp)->next->config_token);
-        SNMP_FREE((*ltmp)->next->help);
-        SNMP_FREE((*ltmp)->next);
-        (*ltmp)->next = ltmp2;
+        struct config_line *found = (*ltmp)->next;
+        (*ltmp)->next = found->next;
+        config_index_remove(*ctmp, found);
+        if (found->free_func)
+            found->free_func();
+        SNMP_FREE(found->config_token);
+        SNMP_FREE(found->help);
+        SNMP_FREE(found);
     }
 }
 
@@ -459,6 +615,8 @@ unregister_all_config_handlers(void)
         ctmp = save;
         config_files = save;
     }
+    config_index_free();
+    journal_free_all();
 }
 
 #ifdef TESTING
@@ -516,9 +674,24 @@ read_config_find_handler(struct config_line *line_handlers,
                          const char *token)
 {
     struct config_line *lptr;
+    struct config_files *ctmp;
+    struct config_index_entry *ep;
 
     netsnmp_assert(token);
 
+    /*
+     * The lists of the registered types are indexed; any other list, such
+     * as one put together by the caller, is walked.
+     */
+    if (line_handlers && !config_index_failed) {
+        for (ctmp = config_files; ctmp != NULL; ctmp = ctmp->next) {
+            if (ctmp->start == line_handlers) {
+                ep = config_index_find(ctmp, token);
+                return ep ? ep->line : NULL;
+            }
+        }
+    }
+
     for (lptr = line_handlers; lptr != NULL; lptr = lptr->next) {
         if (!strcasecmp(token, lptr->config_token)) {
             return lptr;
@@ -742,6 +915,82 @@ netsnmp_config_process_memories_when(int when, int clear)
     netsnmp_config_process_memory_list(&memorylist, when, clear);
 }
 
+/*
+ * Reads the lines of a config file a block at a time, into one buffer
+ * that is reused for every line and only grows for a line longer than
+ * any before it.
+ */
+#define CONFIG_READ_BLOCK 8192
+
+struct config_reader {
+    FILE           *fp;
+    char           *buf;
+    size_t          size;       /* allocated size of buf */
+    size_t          start;      /* first unread byte */
+    size_t          end;        /* end of the data read */
+    int             eof;
+    int             failed;
+};
+
+/*
+ * Returns the next line, without its newline, or NULL at the end of the
+ * file or when no memory was left for the line (failed is set then).
+ */
+static char *
+config_reader_line(struct config_reader *rd)
+{
+    char           *nl, *line;
+    size_t          n;
+
+    for (;;) {
+        if (rd->end > rd->start) {
+            nl = (char *) memchr(rd->buf + rd->start, '\n',
+                                 rd->end - rd->start);
+            if (nl) {
+                *nl = '\0';
+                line = rd->buf + rd->start;
+                rd->start = nl + 1 - rd->buf;
+                return line;
+            }
+        }
+        if (rd->eof) {
+            if (rd->start == rd->end)
+                return NULL;
+            /* a last line without a newline */
+            rd->buf[rd->end] = '\0';
+            line = rd->buf + rd->start;
+            rd->start = rd->end;
+            return line;
+        }
+
+        /*
+         * Move the start of a line to the front and read more after it,
+         * with room for at least half a block and a terminating NUL.
+         */
+        if (rd->start) {
+            memmove(rd->buf, rd->buf + rd->start, rd->end - rd->start);
+            rd->end -= rd->start;
+            rd->start = 0;
+        }
+        if (rd->size - rd->end <= CONFIG_READ_BLOCK / 2) {
+            size_t          size = rd->size ? rd->size * 2 :
+                                              CONFIG_READ_BLOCK;
+            char           *tmp = (char *) realloc(rd->buf, size);
+
+            if (!tmp) {
+                rd->failed = 1;
+                return NULL;
+            }
+            rd->buf = tmp;
+            rd->size = size;
+        }
+        n = fread(rd->buf + rd->end, 1, rd->size - rd->end - 1, rd->fp);
+        if (n == 0)
+            rd->eof = 1;
+        rd->end += n;
+    }
+}
+
 /*******************************************************************-o-******
  * read_config
  *
@@ -777,8 +1026,8 @@ read_config(const char *filename,
     const unsigned int prev_linecount = linecount;
 
     FILE           *ifile;
-    char           *line = NULL;  /* current line buffer */
-    size_t          linesize = 0; /* allocated size of line */
+    struct config_reader rd;
+    char           *line;         /* current line, in the reader's buffer */
 
     netsnmp_assert(line_handler);
     netsnmp_assert(line_handler->config_token);
@@ -830,39 +1079,13 @@ read_config(const char *filename,
     DEBUGMSGTL(("read_config:file", "Reading configuration %s (%d)\n",
                 filename, when));
 
-    while (ifile) {
-        size_t              linelen = 0; /* strlen of the current line */
+    memset(&rd, 0, sizeof(rd));
+    rd.fp = ifile;
+
+    while ((line = config_reader_line(&rd)) != NULL) {
         char               *cptr;
         struct config_line *lptr = line_handler;
 
-        for (;;) {
-            if (linesize <= linelen + 1) {
-                char *tmp = realloc(line, linesize + 256);
-                if (tmp) {
-                    line = tmp;
-                    linesize += 256;
-                } else {
-                    netsnmp_config_error("Failed to allocate memory\n");
-                    free(line);
-                    fclose(ifile);
-                    return SNMPERR_GENERR;
-                }
-            }
-            if (fgets(line + linelen, linesize - linelen, ifile) == NULL) {
-                line[linelen] = '\0';
-                fclose (ifile);
-                ifile = NULL;
-                break;
-            }
-
-            linelen += strlen(line + linelen);
-
-            if (linelen && line[linelen - 1] == '\n') {
-              line[linelen - 1] = '\0';
-              break;
-            }
-        }
-
         ++linecount;
         DEBUGMSGTL(("9:read_config:line", "%s:%d examining: %s\n",
                     filename, linecount, line));
@@ -1003,11 +1226,14 @@ read_config(const char *filename,
             }
         }
     }
-    free(line);
+    if (rd.failed)
+        netsnmp_config_error("Failed to allocate memory\n");
+    free(rd.buf);
+    fclose(ifile);
     linecount = prev_linecount;
     curfilename = prev_filename;
     --depth;
-    return SNMPERR_SUCCESS;
+    return rd.failed ? SNMPERR_GENERR : SNMPERR_SUCCESS;
 
 }                               /* end read_config() */
 
@@ -1253,6 +1479,553 @@ get_temp_file_pattern(void)
 				  NETSNMP_DS_LIB_TEMP_FILE_PATTERN));
 }
 
+/*
+ * The persistent journal.
+ *
+ * With "persistentJournal yes", the lines stored with read_config_store()
+ * go to <persistentDir>/<type>.journal instead of <type>.conf.  After a
+ * header, the journal holds records which each replace a range of the
+ * lines saved so far by new ones:
+ *
+ *   length, CRC-32 of the payload, payload:
+ *   start, number of lines removed, number of lines added,
+ *   and for each line added: its length, its bytes
+ *
+ * all numbers being 32 bit little endian.  A save, from
+ * snmp_save_persistent() to snmp_clean_persistent(), appends one record
+ * for what changed since the previous save and is synced once, where the
+ * text file is rewritten and synced line by line.  The journal ends at the
+ * first record cut short or failing its CRC, so an interrupted save leaves
+ * the state of the previous one.  When the journal has grown to several
+ * times the size of its state it is rewritten as a single record.
+ *
+ * A journal is read back whether or not persistentJournal is set, and is
+ * removed by a save to the text file, so the setting can be turned on and
+ * off to convert between the formats.
+ */
+#define JOURNAL_MAGIC       "NET-SNMP journal 1\n"
+#define JOURNAL_MAGIC_LEN   (sizeof(JOURNAL_MAGIC) - 1)
+#define JOURNAL_MAX_RECORD  (256 * 1024 * 1024)
+
+struct persist_journal {
+    char           *type;
+    char          **lines;          /* the state, as last saved */
+    int             count, size;
+    char          **pending;        /* stored since snmp_save_persistent() */
+    int             pending_count, pending_size;
+    int             saving;
+    int             loaded;
+    long            file_len;       /* bytes of the journal file read */
+    long            state_len;      /* bytes of a record of all lines */
+    struct persist_journal *next;
+};
+
+static struct persist_journal *journals;
+
+static void
+read_config_sync(FILE *fout)
+{
+    fflush(fout);
+#if defined(HAVE_FSYNC)
+    fsync(fileno(fout));
+#elif defined(HAVE__GET_OSFHANDLE)
+    {
+        int fd;
+        HANDLE h;
+
+        fd = fileno(fout);
+        netsnmp_assert(fd != -1);
+        /*
+         * Use size_t instead of uintptr_t because not all supported
+         * Windows compilers support uintptr_t.
+         */
+        h = (HANDLE)(size_t)_get_osfhandle(fd);
+        netsnmp_assert(h != INVALID_HANDLE_VALUE);
+        FlushFileBuffers(h);
+    }
+#endif
+}
+
+static u_int
+journal_crc(const u_char *data, size_t len)
+{
+    static u_int    table[256];
+    u_int           crc;
+    int             i, j;
+
+    if (!table[1]) {
+        for (i = 0; i < 256; i++) {
+            crc = i;
+            for (j = 0; j < 8; j++)
+                crc = (crc & 1) ? 0xedb88320U ^ (crc >> 1) : crc >> 1;
+            table[i] = crc;
+        }
+    }
+    crc = 0xffffffffU;
+    while (len--)
+        crc = table[(crc ^ *data++) & 0xff] ^ (crc >> 8);
+    return crc ^ 0xffffffffU;
+}
+
+static void
+journal_put32(u_char *cp, u_int value)
+{
+    cp[0] = value & 0xff;
+    cp[1] = (value >> 8) & 0xff;
+    cp[2] = (value >> 16) & 0xff;
+    cp[3] = (value >> 24) & 0xff;
+}
+
+static u_int
+journal_get32(const u_char *cp)
+{
+    return cp[0] | (cp[1] << 8) | (cp[2] << 16) | ((u_int) cp[3] << 24);
+}
+
+/*
+ * Returns whether lines stored for type go to its journal, and if so
+ * its file name in file.
+ */
+static int
+journal_in_use(const char *type, char *file, size_t file_len)
+{
+    if (!netsnmp_ds_get_boolean(NETSNMP_DS_LIBRARY_ID,
+                                NETSNMP_DS_LIB_PERSISTENT_JOURNAL) ||
+        netsnmp_getenv("SNMP_PERSISTENT_FILE"))
+        return 0;
+    snprintf(file, file_len, "%s/%s.journal", get_persistent_directory(),
+             type);
+    file[file_len - 1] = 0;
+    return 1;
+}
+
+static struct persist_journal *
+journal_find(const char *type, int create)
+{
+    struct persist_journal *j;
+
+    for (j = journals; j; j = j->next)
+        if (!strcmp(j->type, type))
+            return j;
+    if (!create)
+        return NULL;
+    j = SNMP_MALLOC_TYPEDEF(struct persist_journal);
+    if (!j)
+        return NULL;
+    j->type = strdup(type);
+    if (!j->type) {
+        free(j);
+        return NULL;
+    }
+    j->next = journals;
+    journals = j;
+    return j;
+}
+
+static void
+journal_free_lines(char **lines, int count)
+{
+    while (count > 0)
+        free(lines[--count]);
+}
+
+/*
+ * Replaces removed lines of j's state from start on by the count lines
+ * in new_lines, which are taken over.  Returns 0 if j cannot be grown.
+ */
+static int
+journal_replace(struct persist_journal *j, int start, int removed,
+                char **new_lines, int count)
+{
+    char          **grown;
+    int             len, i;
+
+    if (j->count - removed + count > j->size) {
+        len = j->count - removed + count + j->size / 2 + 16;
+        grown = (char **) realloc(j->lines, len * sizeof(char *));
+        if (!grown)
+            return 0;
+        j->lines = grown;
+        j->size = len;
+    }
+    for (i = start; i < start + removed; i++) {
+        j->state_len -= 4 + strlen(j->lines[i]);
+        free(j->lines[i]);
+    }
+    memmove(j->lines + start + count, j->lines + start + removed,
+            (j->count - start - removed) * sizeof(char *));
+    for (i = 0; i < count; i++) {
+        j->lines[start + i] = new_lines[i];
+        j->state_len += 4 + strlen(new_lines[i]);
+    }
+    j->count += count - removed;
+    return 1;
+}
+
+/*
+ * Applies the record in payload to j's state.  Returns 0 if it does not
+ * fit the state, or is inconsistent.
+ */
+static int
+journal_apply_record(struct persist_journal *j, const u_char *payload,
+                     u_int len)
+{
+    const u_char   *cp = payload + 12, *end = payload + len;
+    u_int           start, removed, count, i, n;
+    char          **new_lines;
+
+    if (len < 12)
+        return 0;
+    start = journal_get32(payload);
+    removed = journal_get32(payload + 4);
+    count = journal_get32(payload + 8);
+    if (start > (u_int) j->count || removed > (u_int) j->count - start ||
+        count > len / 4)
+        return 0;
+    new_lines = (char **) calloc(count ? count : 1, sizeof(char *));
+    if (!new_lines)
+        return 0;
+    for (i = 0; i < count; i++) {
+        if (end - cp < 4 || (n = journal_get32(cp)) > (u_int) (end - cp) - 4
+            || !(new_lines[i] = (char *) malloc(n + 1)))
+            break;
+        memcpy(new_lines[i], cp + 4, n);
+        new_lines[i][n] = '\0';
+        cp += 4 + n;
+    }
+    if (i < count || cp != end ||
+        !journal_replace(j, start, removed, new_lines, count)) {
+        journal_free_lines(new_lines, i);
+        free(new_lines);
+        return 0;
+    }
+    free(new_lines);
+    return 1;
+}
+
+/*
+ * Reads j's state from file, up to the first record which is damaged.
+ */
+static void
+journal_read(struct persist_journal *j, const char *file)
+{
+    FILE           *fin;
+    u_char          head[JOURNAL_MAGIC_LEN > 8 ? JOURNAL_MAGIC_LEN : 8];
+    u_char         *payload;
+    u_int           len;
+    int             records = 0;
+
+    journal_free_lines(j->lines, j->count);
+    j->count = 0;
+    j->state_len = 20;
+    j->file_len = 0;
+    j->loaded = 1;
+    if ((fin = fopen(file, "rb")) == NULL)
+        return;
+    if (fread(head, 1, JOURNAL_MAGIC_LEN, fin) != JOURNAL_MAGIC_LEN ||
+        memcmp(head, JOURNAL_MAGIC, JOURNAL_MAGIC_LEN)) {
+        snmp_log(LOG_ERR, "%s is not a persistent journal\n", file);
+        fclose(fin);
+        return;
+    }
+    j->file_len = JOURNAL_MAGIC_LEN;
+    while (fread(head, 1, 8, fin) == 8) {
+        len = journal_get32(head);
+        if (len > JOURNAL_MAX_RECORD || !(payload = (u_char *) malloc(len)))
+            break;
+        if (fread(payload, 1, len, fin) != len ||
+            journal_crc(payload, len) != journal_get32(head + 4) ||
+            !journal_apply_record(j, payload, len)) {
+            free(payload);
+            break;
+        }
+        free(payload);
+        j->file_len += 8 + len;
+        records++;
+    }
+    if (!feof(fin) || fgetc(fin) != EOF)
+        snmp_log(LOG_WARNING, "%s: ignoring the damaged end of the journal, "
+                 "after %d records\n", file, records);
+    DEBUGMSGTL(("read_config:journal", "read %d lines in %d records from %s\n",
+                j->count, records, file));
+    fclose(fin);
+}
+
+/*
+ * Writes a record replacing removed lines from start on by the count
+ * lines in lines.  Returns the number of bytes written, or -1.
+ */
+static long
+journal_write_record(FILE *fout, int start, int removed, char **lines,
+                     int count)
+{
+    size_t          len = 20, n;
+    u_char         *record, *cp;
+    int             i;
+
+    for (i = 0; i < count; i++)
+        len += 4 + strlen(lines[i]);
+    if (len - 8 > JOURNAL_MAX_RECORD ||
+        (record = (u_char *) malloc(len)) == NULL)
+        return -1;
+    journal_put32(record, len - 8);
+    journal_put32(record + 8, start);
+    journal_put32(record + 12, removed);
+    journal_put32(record + 16, count);
+    for (cp = record + 20, i = 0; i < count; i++) {
+        n = strlen(lines[i]);
+        journal_put32(cp, n);
+        memcpy(cp + 4, lines[i], n);
+        cp += 4 + n;
+    }
+    journal_put32(record + 4, journal_crc(record + 8, len - 8));
+    n = fwrite(record, 1, len, fout);
+    free(record);
+    return n == len ? (long) len : -1;
+}
+
+/*
+ * Rewrites the journal file as a single record of j's state.
+ */
+static int
+journal_compact(struct persist_journal *j, const char *file)
+{
+    char            tmpfile[SNMP_MAXPATH];
+    FILE           *fout;
+    long            len;
+
+    snprintf(tmpfile, sizeof(tmpfile), "%s.tmp", file);
+    tmpfile[sizeof(tmpfile) - 1] = 0;
+    if ((fout = fopen(tmpfile, "wb")) == NULL) {
+        snmp_log(LOG_ERR, "read_config_store open failure on %s\n", tmpfile);
+        return 0;
+    }
+    len = fwrite(JOURNAL_MAGIC, 1, JOURNAL_MAGIC_LEN, fout) ==
+        JOURNAL_MAGIC_LEN ?
+        journal_write_record(fout, 0, 0, j->lines, j->count) : -1;
+    read_config_sync(fout);
+    if (fclose(fout) != 0 || len < 0 || rename(tmpfile, file) != 0) {
+        snmp_log(LOG_ERR, "Cannot write the persistent journal %s\n", file);
+        unlink(tmpfile);
+        return 0;
+    }
+    DEBUGMSGTL(("read_config:journal", "compacted %s to %d lines\n", file,
+                j->count));
+    j->file_len = JOURNAL_MAGIC_LEN + len;
+    return 1;
+}
+
+/*
+ * Stores that the count lines in lines (which are taken over) replace
+ * removed lines of j's state from start on.  Returns 0 if they could not
+ * be written.
+ */
+static int
+journal_commit(struct persist_journal *j, const char *file, int start,
+               int removed, char **lines, int count)
+{
+    struct stat     statbuf;
+    FILE           *fout = NULL;
+    long            len = -1;
+#ifdef NETSNMP_PERSISTENT_MASK
+    mode_t          oldmask;
+#endif
+
+    if (!journal_replace(j, start, removed, lines, count)) {
+        journal_free_lines(lines, count);
+        snmp_log(LOG_ERR, "Cannot store in the persistent journal %s\n",
+                 file);
+        return 0;
+    }
+#ifdef NETSNMP_PERSISTENT_MASK
+    oldmask = umask(NETSNMP_PERSISTENT_MASK);
+#endif
+    if (mkdirhier(file, NETSNMP_AGENT_DIRECTORY_MODE, 1))
+        snmp_log(LOG_ERR,
+                 "Failed to create the persistent directory for %s\n", file);
+    /*
+     * Append, unless the file holds more than was read of it (the end of
+     * an interrupted write), or has grown large enough to be compacted.
+     */
+    if (j->file_len >= (long) JOURNAL_MAGIC_LEN &&
+        j->file_len < 4 * j->state_len + 65536 &&
+        stat(file, &statbuf) == 0 && statbuf.st_size == j->file_len &&
+        (fout = fopen(file, "ab")) != NULL) {
+        len = journal_write_record(fout, start, removed,
+                                   j->lines + start, count);
+        read_config_sync(fout);
+        if (fclose(fout) != 0)
+            len = -1;
+    }
+    if (len >= 0)
+        j->file_len += len;
+    else if (!journal_compact(j, file))
+        j->file_len = 0;
+#ifdef NETSNMP_PERSISTENT_MASK
+    umask(oldmask);
+#endif
+    return j->file_len != 0;
+}
+
+/*
+ * Returns j with its state read, if it has not been yet.
+ */
+static struct persist_journal *
+journal_get(const char *type, const char *file)
+{
+    struct persist_journal *j = journal_find(type, 1);
+
+    if (j && !j->loaded)
+        journal_read(j, file);
+    return j;
+}
+
+/*
+ * Adds line, split at newlines as it would be in the text file, to the
+ * count lines in *lines.
+ */
+static void
+journal_add_line(char ***lines, int *count, int *size, const char *line)
+{
+    const char     *end;
+    char          **grown;
+    int             len;
+
+    for (; *line; line = *end ? end + 1 : end) {
+        end = strchr(line, '\n');
+        if (!end)
+            end = line + strlen(line);
+        if (*count >= *size) {
+            len = *size * 2 + 16;
+            grown = (char **) realloc(*lines, len * sizeof(char *));
+            if (!grown)
+                return;
+            *lines = grown;
+            *size = len;
+        }
+        if (((*lines)[*count] = (char *) malloc(end - line + 1)) == NULL)
+            return;
+        memcpy((*lines)[*count], line, end - line);
+        (*lines)[(*count)++][end - line] = '\0';
+    }
+}
+
+static void
+journal_store(const char *type, const char *file, const char *line)
+{
+    struct persist_journal *j = journal_get(type, file);
+    char          **lines = NULL;
+    int             count = 0, size = 0;
+
+    if (!j)
+        return;
+    DEBUGMSGTL(("read_config:store", "storing: %s\n", line));
+    if (j->saving) {
+        journal_add_line(&j->pending, &j->pending_count, &j->pending_size,
+                         line);
+        return;
+    }
+    journal_add_line(&lines, &count, &size, line);
+    if (count)
+        journal_commit(j, file, j->count, 0, lines, count);
+    free(lines);
+}
+
+/*
+ * Stores the lines stored for j since snmp_save_persistent(), as the
+ * change from the state saved before.  Returns 0 if they could not be
+ * written.
+ */
+static int
+journal_save(struct persist_journal *j, const char *file)
+{
+    int             head = 0, tail = 0, count, rc = 1;
+
+    while (head < j->count && head < j->pending_count &&
+           !strcmp(j->lines[head], j->pending[head]))
+        head++;
+    while (tail < j->count - head && tail < j->pending_count - head &&
+           !strcmp(j->lines[j->count - 1 - tail],
+                   j->pending[j->pending_count - 1 - tail]))
+        tail++;
+    count = j->pending_count - head - tail;
+    DEBUGMSGTL(("read_config:journal", "saving %s: %d of %d lines changed\n",
+                j->type, count, j->pending_count));
+    if (count || j->count - head - tail || j->file_len == 0)
+        rc = journal_commit(j, file, head, j->count - head - tail,
+                            j->pending + head, count);
+    journal_free_lines(j->pending, head);
+    journal_free_lines(j->pending + head + count, tail);
+    SNMP_FREE(j->pending);
+    j->pending_count = j->pending_size = 0;
+    j->saving = 0;
+    return rc;
+}
+
+/*
+ * Reads <dir>/<type>.journal, if there is one, and hands its lines to the
+ * handlers of ctmp.
+ */
+static int
+journal_load(const char *dir, struct config_files *ctmp, int when)
+{
+    const char * const prev_filename = curfilename;
+    const unsigned int prev_linecount = linecount;
+    char            file[SNMP_MAXPATH], token[STRINGMAX], *line, *cptr;
+    struct config_line *lptr;
+    struct persist_journal *j;
+    struct stat     statbuf;
+    int             i;
+
+    snprintf(file, sizeof(file), "%s/%s.journal", dir, ctmp->fileHeader);
+    file[sizeof(file) - 1] = 0;
+    if (stat(file, &statbuf) != 0)
+        return SNMPERR_GENERR;
+    j = journal_find(ctmp->fileHeader, 1);
+    if (!j)
+        return SNMPERR_GENERR;
+    if (!j->loaded || statbuf.st_size != j->file_len)
+        journal_read(j, file);
+
+    curfilename = file;
+    for (i = 0; i < j->count; i++) {
+        linecount = i + 1;
+        if ((line = strdup(j->lines[i])) == NULL)
+            break;
+        if ((cptr = skip_white(line)) != NULL) {
+            lptr = ctmp->start;
+            cptr = copy_nword(cptr, token, sizeof(token));
+            if (token[0] == '[' && token[strlen(token) - 1] == ']') {
+                token[strlen(token) - 1] = '\0';
+                lptr = read_config_get_handlers(&token[1]);
+                cptr = copy_nword(cptr, token, sizeof(token));
+            }
+            if (lptr && cptr)
+                run_config_handler(lptr, token, cptr, when);
+        }
+        free(line);
+    }
+    curfilename = prev_filename;
+    linecount = prev_linecount;
+    return SNMPERR_SUCCESS;
+}
+
+static void
+journal_free_all(void)
+{
+    struct persist_journal *j;
+
+    while ((j = journals) != NULL) {
+        journals = j->next;
+        journal_free_lines(j->lines, j->count);
+        journal_free_lines(j->pending, j->pending_count);
+        free(j->lines);
+        free(j->pending);
+        free(j->type);
+        free(j);
+    }
+}
+
 /**
  * utility routine for read_config_files
  *
@@ -1345,6 +2118,8 @@ read_config_files_in_path(const char *path, struct config_files *ctmp,
                         ret = SNMPERR_SUCCESS;
                 }
             }
+            if (journal_load(cptr2, ctmp, when) == SNMPERR_SUCCESS)
+                ret = SNMPERR_SUCCESS;
         }
         snprintf(configfile, sizeof(configfile),
                  "%s/%s.conf", cptr2, ctmp->fileHeader);
@@ -1541,6 +2316,7 @@ read_config_store(const char *type, const char *line)
 #ifdef NETSNMP_PERSISTENT_DIRECTORY
     char            file[512], *filep;
     FILE           *fout;
+    int             journal;
 #ifdef NETSNMP_PERSISTENT_MASK
     mode_t          oldmask;
 #endif
@@ -1553,9 +2329,14 @@ read_config_store(const char *type, const char *line)
     /*
      * store configuration directives in the following order of preference:
      * 1. ENV variable SNMP_PERSISTENT_FILE
-     * 2. configured <NETSNMP_PERSISTENT_DIRECTORY>/<type>.conf
+     * 2. configured <NETSNMP_PERSISTENT_DIRECTORY>/<type>.journal, with
+     *    persistentJournal set
+     * 3. configured <NETSNMP_PERSISTENT_DIRECTORY>/<type>.conf
      */
-    if ((filep = netsnmp_getenv("SNMP_PERSISTENT_FILE")) == NULL) {
+    journal = journal_in_use(type, file, sizeof(file));
+    if (journal) {
+        filep = file;
+    } else if ((filep = netsnmp_getenv("SNMP_PERSISTENT_FILE")) == NULL) {
         snprintf(file, sizeof(file),
                  "%s/%s.conf", get_persistent_directory(), type);
         file[ sizeof(file)-1 ] = 0;
@@ -1569,30 +2350,14 @@ read_config_store(const char *type, const char *line)
                  "Failed to create the persistent directory for %s\n",
                  file);
     }
-    if ((fout = fopen(filep, "a")) != NULL) {
+    if (journal) {
+        journal_store(type, filep, line);
+    } else if ((fout = fopen(filep, "a")) != NULL) {
         fprintf(fout, "%s", line);
         if (line[strlen(line)] != '\n')
             fprintf(fout, "\n");
         DEBUGMSGTL(("read_config:store", "storing: %s\n", line));
-        fflush(fout);
-#if defined(HAVE_FSYNC)
-        fsync(fileno(fout));
-#elif defined(HAVE__GET_OSFHANDLE)
-        {
-            int fd;
-            HANDLE h;
-
-            fd = fileno(fout);
-            netsnmp_assert(fd != -1);
-            /*
-             * Use size_t instead of uintptr_t because not all supported
-             * Windows compilers support uintptr_t.
-             */
-            h = (HANDLE)(size_t)_get_osfhandle(fd);
-            netsnmp_assert(h != INVALID_HANDLE_VALUE);
-            FlushFileBuffers(h);
-        }
-#endif
+        read_config_sync(fout);
         fclose(fout);
     } else {
         if (strcmp(NETSNMP_APPLICATION_CONFIG_TYPE, type) != 0) {
@@ -1645,6 +2410,7 @@ snmp_save_persistent(const char *type)
 {
     char            file[512], fileold[SPRINT_MAX_LEN];
     struct stat     statbuf;
+    struct persist_journal *journal;
     int             j;
 
     if (netsnmp_ds_get_boolean(NETSNMP_DS_LIBRARY_ID,
@@ -1676,6 +2442,17 @@ snmp_save_persistent(const char *type)
             }
         }
     }
+    /*
+     * with a journal, collect what is stored until snmp_clean_persistent()
+     */
+    if (journal_in_use(type, file, sizeof(file))) {
+        if ((journal = journal_get(type, file)) != NULL) {
+            journal_free_lines(journal->pending, journal->pending_count);
+            journal->pending_count = 0;
+            journal->saving = 1;
+        }
+        return;
+    }
     /*
      * save a warning header to the top of the new file 
      */
@@ -1698,6 +2475,9 @@ snmp_save_persistent(const char *type)
  *      
  *
  * Unlink all backup files called "<NETSNMP_PERSISTENT_DIRECTORY>/<type>.%d.conf".
+ * With persistentJournal set, first write what was stored since
+ * snmp_save_persistent() to the journal.  Otherwise remove any journal,
+ * since its contents have been saved to the text file.
  *
  * Should be called just after we successfull dumped the last of the
  * persistent data, to remove the backup copies of previous storage dumps.
@@ -1712,7 +2492,8 @@ snmp_clean_persistent(const char *type)
 {
     char            file[512];
     struct stat     statbuf;
-    int             j;
+    struct persist_journal *journal;
+    int             j, saved;
 
     if (netsnmp_ds_get_boolean(NETSNMP_DS_LIBRARY_ID,
                                NETSNMP_DS_LIB_DONT_PERSIST_STATE)
@@ -1720,10 +2501,28 @@ snmp_clean_persistent(const char *type)
                                NETSNMP_DS_LIB_DISABLE_PERSISTENT_SAVE)) return;
 
     DEBUGMSGTL(("snmp_clean_persistent", "cleaning %s files...\n", type));
-    snprintf(file, sizeof(file),
-             "%s/%s.conf", get_persistent_directory(), type);
-    file[ sizeof(file)-1 ] = 0;
-    if (stat(file, &statbuf) == 0) {
+    if (journal_in_use(type, file, sizeof(file))) {
+        journal = journal_find(type, 0);
+        saved = journal && journal->saving &&
+            journal_save(journal, file);
+    } else {
+        snprintf(file, sizeof(file),
+                 "%s/%s.conf", get_persistent_directory(), type);
+        file[ sizeof(file)-1 ] = 0;
+        saved = stat(file, &statbuf) == 0;
+        snprintf(file, sizeof(file),
+                 "%s/%s.journal", get_persistent_directory(), type);
+        file[ sizeof(file)-1 ] = 0;
+        if (saved && stat(file, &statbuf) == 0) {
+            DEBUGMSGTL(("snmp_clean_persistent",
+                        " removing journal: %s\n", file));
+            if (unlink(file) == -1)
+                snmp_log(LOG_ERR, "Cannot unlink %s\n", file);
+            if ((journal = journal_find(type, 0)) != NULL)
+                journal_read(journal, file);
+        }
+    }
+    if (saved) {
         for (j = 0; j <= NETSNMP_MAX_PERSISTENT_BACKUPS; j++) {
             snprintf(file, sizeof(file),
                      "%s/%s.%d.conf", get_persistent_directory(), type, j);
@@ -141,6 +141,19 @@ SOFTWARE.
 #include <openssl/ssl.h>
 #include <net-snmp/library/cert_util.h>
 #endif
+/*
+ * SSE2 is part of the x86-64 baseline; AVX2 is compiled in separately and
+ * only used when the CPU reports it (see _oid_diff_resolve()).
+ */
+#if defined(__GNUC__) && defined(__SSE2__) && \
+    (defined(__x86_64__) || defined(__i386__))
+#include <emmintrin.h>
+#define NETSNMP_OID_DIFF_SSE2 1
+#if __GNUC__ >= 5 || defined(__clang__)
+#include <immintrin.h>
+#define NETSNMP_OID_DIFF_AVX2 1
+#endif
+#endif
 
 netsnmp_feature_child_of(statistics, libnetsnmp);
 netsnmp_feature_child_of(snmp_api, libnetsnmp);
@@ -797,6 +810,8 @@ register_default_handlers(void)
 		      NETSNMP_DS_LIBRARY_ID, NETSNMP_DS_LIB_DUMP_PACKET);
     netsnmp_ds_register_config(ASN_BOOLEAN, "snmp", "reverseEncodeBER",
 		      NETSNMP_DS_LIBRARY_ID, NETSNMP_DS_LIB_REVERSE_ENCODE);
+    netsnmp_ds_register_config(ASN_BOOLEAN, "snmp", "presizedEncodeBER",
+		      NETSNMP_DS_LIBRARY_ID, NETSNMP_DS_LIB_PRESIZED_ENCODE);
     netsnmp_ds_register_config(ASN_INTEGER, "snmp", "defaultPort",
 		      NETSNMP_DS_LIBRARY_ID, NETSNMP_DS_LIB_DEFAULT_PORT);
 #ifndef NETSNMP_FEATURE_REMOVE_RUNTIME_DISABLE_VERSION
@@ -848,6 +863,8 @@ register_default_handlers(void)
 		      NETSNMP_DS_LIBRARY_ID, NETSNMP_DS_LIB_DISABLE_PERSISTENT_LOAD);
     netsnmp_ds_register_config(ASN_BOOLEAN, "snmp", "noPersistentSave",
 		      NETSNMP_DS_LIBRARY_ID, NETSNMP_DS_LIB_DISABLE_PERSISTENT_SAVE);
+    netsnmp_ds_register_config(ASN_BOOLEAN, "snmp", "persistentJournal",
+		      NETSNMP_DS_LIBRARY_ID, NETSNMP_DS_LIB_PERSISTENT_JOURNAL);
     netsnmp_ds_register_config(ASN_BOOLEAN, "snmp",
                                "noContextEngineIDDiscovery",
                                NETSNMP_DS_LIBRARY_ID,
@@ -2922,6 +2939,356 @@ snmpv3_packet_build(netsnmp_session * session, netsnmp_pdu *pdu,
 }                               /* end snmpv3_packet_build() */
 
 
+#if defined(NETSNMP_USE_REVERSE_ASNENCODING) && \
+    (!defined(NETSNMP_DISABLE_SNMPV1) || !defined(NETSNMP_DISABLE_SNMPV2C))
+/*
+ * Presized encoding of community based messages.  A first pass works out
+ * the length of every TLV in the message, remembering the per-varbind
+ * ones, and a second pass writes the message front to back into space
+ * reserved at the top of the buffer, so the result is laid out exactly
+ * as if snmp_pdu_realloc_rbuild() had built it.
+ */
+#ifndef PRESIZE_VB_CACHE
+#define PRESIZE_VB_CACHE 32
+#endif
+/*
+ * largest value (an opaque wrapped 64 bit integer or double) that is
+ * encoded through the reverse encoder
+ */
+#define PRESIZE_SCRATCH_LEN 32
+
+struct presized_varbind {
+    size_t          name_len;       /* OID content length */
+    size_t          val_len;        /* value content, or TLV if scratch */
+};
+
+/*
+ * Encode a value of a type without a presized encoder into scratch.
+ * Returns the TLV length, which ends at scratch + PRESIZE_SCRATCH_LEN,
+ * or 0 on failure.
+ */
+static size_t
+_snmp_presize_scratch(u_char * scratch, const netsnmp_variable_list * vp)
+{
+    size_t          len = PRESIZE_SCRATCH_LEN, offset = 0;
+    int             rc = 0;
+
+    switch (vp->type) {
+#ifdef NETSNMP_WITH_OPAQUE_SPECIAL_TYPES
+    case ASN_OPAQUE_COUNTER64:
+    case ASN_OPAQUE_U64:
+#endif
+    case ASN_COUNTER64:
+        rc = asn_realloc_rbuild_unsigned_int64(&scratch, &len, &offset, 0,
+                                               vp->type,
+                                               vp->val.counter64,
+                                               vp->val_len);
+        break;
+#ifdef NETSNMP_WITH_OPAQUE_SPECIAL_TYPES
+    case ASN_OPAQUE_FLOAT:
+        rc = asn_realloc_rbuild_float(&scratch, &len, &offset, 0, vp->type,
+                                      vp->val.floatVal, vp->val_len);
+        break;
+    case ASN_OPAQUE_DOUBLE:
+        rc = asn_realloc_rbuild_double(&scratch, &len, &offset, 0,
+                                       vp->type, vp->val.doubleVal,
+                                       vp->val_len);
+        break;
+    case ASN_OPAQUE_I64:
+        rc = asn_realloc_rbuild_signed_int64(&scratch, &len, &offset, 0,
+                                             vp->type, vp->val.counter64,
+                                             vp->val_len);
+        break;
+#endif                          /* NETSNMP_WITH_OPAQUE_SPECIAL_TYPES */
+    default:
+        break;
+    }
+    return rc ? offset : 0;
+}
+
+/*
+ * First pass for one varbind: fills in *pv and returns the length of the
+ * varbind sequence content, or 0 if the varbind can't be encoded.
+ */
+static size_t
+_snmp_presize_varbind(const netsnmp_variable_list * vp,
+                      struct presized_varbind *pv)
+{
+    u_char          scratch[PRESIZE_SCRATCH_LEN];
+    size_t          val_tlv;
+
+    switch (vp->type) {
+    case ASN_INTEGER:
+        if (vp->val_len != sizeof(long))
+            goto bad_size;
+        pv->val_len = asn_presize_int(*vp->val.integer);
+        val_tlv = asn_presize_header(pv->val_len) + pv->val_len;
+        break;
+
+    case ASN_GAUGE:
+    case ASN_COUNTER:
+    case ASN_TIMETICKS:
+    case ASN_UINTEGER:
+        if (vp->val_len != sizeof(u_long))
+            goto bad_size;
+        pv->val_len = asn_presize_unsigned_int(*(u_long *) vp->val.integer);
+        val_tlv = asn_presize_header(pv->val_len) + pv->val_len;
+        break;
+
+    case ASN_OCTET_STR:
+    case ASN_IPADDRESS:
+    case ASN_OPAQUE:
+    case ASN_NSAP:
+    case ASN_BIT_STR:
+        pv->val_len = vp->val_len;
+        val_tlv = asn_presize_header(pv->val_len) + pv->val_len;
+        break;
+
+    case ASN_OBJECT_ID:
+        pv->val_len = asn_presize_objid(vp->val.objid,
+                                        vp->val_len / sizeof(oid));
+        if (pv->val_len == 0)
+            return 0;
+        val_tlv = asn_presize_header(pv->val_len) + pv->val_len;
+        break;
+
+    case ASN_NULL:
+    case SNMP_NOSUCHOBJECT:
+    case SNMP_NOSUCHINSTANCE:
+    case SNMP_ENDOFMIBVIEW:
+        pv->val_len = 0;
+        val_tlv = 2;
+        break;
+
+    default:
+        pv->val_len = val_tlv = _snmp_presize_scratch(scratch, vp);
+        if (val_tlv == 0) {
+            DEBUGMSGTL(("snmp_presized_build", "can't encode type %d\n",
+                        vp->type));
+            return 0;
+        }
+        break;
+    }
+
+    pv->name_len = asn_presize_objid(vp->name, vp->name_length);
+    if (pv->name_len == 0)
+        return 0;
+    return asn_presize_header(pv->name_len) + pv->name_len + val_tlv;
+
+  bad_size:
+    snmp_log(LOG_ERR, "presized build: bad size %" NETSNMP_PRIz
+             "u for type %d\n", vp->val_len, vp->type);
+    return 0;
+}
+
+/*
+ * Second pass for one varbind: writes it at cp and returns the end.
+ */
+static u_char  *
+_snmp_presized_build_varbind(u_char * cp, const netsnmp_variable_list * vp,
+                             const struct presized_varbind *pv,
+                             size_t vb_len)
+{
+    u_char          scratch[PRESIZE_SCRATCH_LEN];
+
+    cp = asn_presized_build_header(cp, (u_char) (ASN_SEQUENCE |
+                                                 ASN_CONSTRUCTOR), vb_len);
+    cp = asn_presized_build_objid(cp, (u_char) (ASN_UNIVERSAL |
+                                                ASN_PRIMITIVE |
+                                                ASN_OBJECT_ID),
+                                  vp->name, vp->name_length, pv->name_len);
+
+    switch (vp->type) {
+    case ASN_INTEGER:
+        return asn_presized_build_int(cp, vp->type, *vp->val.integer,
+                                      pv->val_len);
+
+    case ASN_GAUGE:
+    case ASN_COUNTER:
+    case ASN_TIMETICKS:
+    case ASN_UINTEGER:
+        return asn_presized_build_unsigned_int(cp, vp->type,
+                                               *(u_long *) vp->val.integer,
+                                               pv->val_len);
+
+    case ASN_OCTET_STR:
+    case ASN_IPADDRESS:
+    case ASN_OPAQUE:
+    case ASN_NSAP:
+    case ASN_BIT_STR:
+        return asn_presized_build_string(cp, vp->type, vp->val.string,
+                                         vp->val_len);
+
+    case ASN_OBJECT_ID:
+        return asn_presized_build_objid(cp, vp->type, vp->val.objid,
+                                        vp->val_len / sizeof(oid),
+                                        pv->val_len);
+
+    case ASN_NULL:
+    case SNMP_NOSUCHOBJECT:
+    case SNMP_NOSUCHINSTANCE:
+    case SNMP_ENDOFMIBVIEW:
+        return asn_presized_build_header(cp, vp->type, 0);
+
+    default:
+        _snmp_presize_scratch(scratch, vp);
+        memcpy(cp, scratch + PRESIZE_SCRATCH_LEN - pv->val_len, pv->val_len);
+        return cp + pv->val_len;
+    }
+}
+
+/*
+ * Builds a complete SNMPv1 or SNMPv2c message ending at
+ * *pkt + *pkt_len - *offset, growing the buffer at most once, and adds
+ * its length to *offset.  Returns 1 on success and 0 on failure.
+ */
+static int
+_snmp_presized_build(u_char ** pkt, size_t * pkt_len, size_t * offset,
+                     const netsnmp_pdu *pdu)
+{
+    struct presized_varbind vbcache[PRESIZE_VB_CACHE], *vbs = vbcache;
+    netsnmp_variable_list *vp;
+    size_t          count = 0, i, vbl_len = 0, pdu_len, msg_len, total;
+    size_t         *vb_len = NULL, vb_len_cache[PRESIZE_VB_CACHE];
+    size_t          reqid_len = 0, errstat_len = 0, errindex_len = 0;
+    size_t          ent_len = 0, gen_len = 0, spec_len = 0, time_len = 0;
+    size_t          version_len;
+    long            version = pdu->version;
+    u_char         *cp, *end;
+    int             rc = 0;
+
+    for (vp = pdu->variables; vp && vp->type != ASN_PRIV_STOP;
+         vp = vp->next_variable)
+        count++;
+    vb_len = vb_len_cache;
+    if (count > PRESIZE_VB_CACHE) {
+        vbs = (struct presized_varbind *) malloc(count * sizeof(*vbs));
+        vb_len = (size_t *) malloc(count * sizeof(*vb_len));
+        if (vbs == NULL || vb_len == NULL)
+            goto out;
+    }
+
+    /*
+     * Pass 1: lengths, innermost first.
+     */
+    for (vp = pdu->variables, i = 0; i < count; vp = vp->next_variable, i++) {
+        vb_len[i] = _snmp_presize_varbind(vp, &vbs[i]);
+        if (vb_len[i] == 0)
+            goto out;
+        vbl_len += asn_presize_header(vb_len[i]) + vb_len[i];
+    }
+    pdu_len = asn_presize_header(vbl_len) + vbl_len;
+    if (pdu->command != SNMP_MSG_TRAP) {
+        reqid_len = asn_presize_int(pdu->reqid);
+        errstat_len = asn_presize_int(pdu->errstat);
+        errindex_len = asn_presize_int(pdu->errindex);
+        pdu_len += asn_presize_header(reqid_len) + reqid_len +
+            asn_presize_header(errstat_len) + errstat_len +
+            asn_presize_header(errindex_len) + errindex_len;
+    } else {
+        ent_len = asn_presize_objid(pdu->enterprise, pdu->enterprise_length);
+        if (ent_len == 0)
+            goto out;
+        gen_len = asn_presize_int(pdu->trap_type);
+        spec_len = asn_presize_int(pdu->specific_type);
+        time_len = asn_presize_unsigned_int(pdu->time);
+        pdu_len += asn_presize_header(ent_len) + ent_len + 2 + 4 +
+            asn_presize_header(gen_len) + gen_len +
+            asn_presize_header(spec_len) + spec_len +
+            asn_presize_header(time_len) + time_len;
+    }
+    version_len = asn_presize_int(version);
+    msg_len = asn_presize_header(version_len) + version_len +
+        asn_presize_header(pdu->community_len) + pdu->community_len +
+        asn_presize_header(pdu_len) + pdu_len;
+    total = asn_presize_header(msg_len) + msg_len;
+
+    DEBUGMSGTL(("snmp_presized_build", "%" NETSNMP_PRIz "u varbinds, %"
+                NETSNMP_PRIz "u bytes\n", count, total));
+
+    /*
+     * Make room below anything already built, keeping it at the top.
+     */
+    if (*pkt_len - *offset < total) {
+        size_t          new_len = *offset + total;
+        u_char         *new_pkt = (u_char *) realloc(*pkt, new_len);
+
+        if (new_pkt == NULL)
+            goto out;
+        memmove(new_pkt + new_len - *offset, new_pkt + *pkt_len - *offset,
+                *offset);
+        *pkt = new_pkt;
+        *pkt_len = new_len;
+    }
+    end = *pkt + *pkt_len - *offset;
+    cp = end - total;
+
+    /*
+     * Pass 2: write everything front to back.
+     */
+    cp = asn_presized_build_header(cp, (u_char) (ASN_SEQUENCE |
+                                                 ASN_CONSTRUCTOR), msg_len);
+    cp = asn_presized_build_int(cp, (u_char) (ASN_UNIVERSAL | ASN_PRIMITIVE |
+                                              ASN_INTEGER), version,
+                                version_len);
+    cp = asn_presized_build_string(cp, (u_char) (ASN_UNIVERSAL |
+                                                 ASN_PRIMITIVE |
+                                                 ASN_OCTET_STR),
+                                   pdu->community, pdu->community_len);
+    cp = asn_presized_build_header(cp, (u_char) pdu->command, pdu_len);
+    if (pdu->command != SNMP_MSG_TRAP) {
+        cp = asn_presized_build_int(cp, (u_char) (ASN_UNIVERSAL |
+                                                  ASN_PRIMITIVE |
+                                                  ASN_INTEGER),
+                                    pdu->reqid, reqid_len);
+        cp = asn_presized_build_int(cp, (u_char) (ASN_UNIVERSAL |
+                                                  ASN_PRIMITIVE |
+                                                  ASN_INTEGER),
+                                    pdu->errstat, errstat_len);
+        cp = asn_presized_build_int(cp, (u_char) (ASN_UNIVERSAL |
+                                                  ASN_PRIMITIVE |
+                                                  ASN_INTEGER),
+                                    pdu->errindex, errindex_len);
+    } else {
+        cp = asn_presized_build_objid(cp, (u_char) (ASN_UNIVERSAL |
+                                                    ASN_PRIMITIVE |
+                                                    ASN_OBJECT_ID),
+                                      pdu->enterprise,
+                                      pdu->enterprise_length, ent_len);
+        cp = asn_presized_build_string(cp, (u_char) (ASN_IPADDRESS |
+                                                     ASN_PRIMITIVE),
+                                       pdu->agent_addr, 4);
+        cp = asn_presized_build_int(cp, (u_char) (ASN_UNIVERSAL |
+                                                  ASN_PRIMITIVE |
+                                                  ASN_INTEGER),
+                                    pdu->trap_type, gen_len);
+        cp = asn_presized_build_int(cp, (u_char) (ASN_UNIVERSAL |
+                                                  ASN_PRIMITIVE |
+                                                  ASN_INTEGER),
+                                    pdu->specific_type, spec_len);
+        cp = asn_presized_build_unsigned_int(cp, (u_char) (ASN_TIMETICKS |
+                                                           ASN_PRIMITIVE),
+                                             pdu->time, time_len);
+    }
+    cp = asn_presized_build_header(cp, (u_char) (ASN_SEQUENCE |
+                                                 ASN_CONSTRUCTOR), vbl_len);
+    for (vp = pdu->variables, i = 0; i < count; vp = vp->next_variable, i++)
+        cp = _snmp_presized_build_varbind(cp, vp, &vbs[i], vb_len[i]);
+
+    netsnmp_assert(cp == end);
+    *offset += total;
+    rc = 1;
+
+  out:
+    if (vbs != vbcache)
+        free(vbs);
+    if (vb_len != vb_len_cache)
+        free(vb_len);
+    return rc;
+}
+#endif /* NETSNMP_USE_REVERSE_ASNENCODING && (v1 || v2c) */
+
+
 /*
  * Takes a session and a pdu and serializes the ASN PDU into the area
  * pointed to by *pkt.  *pkt_len is the size of the data area available.
@@ -3132,6 +3499,12 @@ _snmp_build(u_char ** pkt, size_t * pkt_len, size_t * offset,
         DEBUGMSGTL(("snmp_send", "Building SNMPv%ld message...\n",
                     (1 + pdu->version)));
 #ifdef NETSNMP_USE_REVERSE_ASNENCODING
+        if (!(pdu->flags & UCD_MSG_FLAG_FORWARD_ENCODE) &&
+            netsnmp_ds_get_boolean(NETSNMP_DS_LIBRARY_ID,
+                                   NETSNMP_DS_LIB_PRESIZED_ENCODE)) {
+            DEBUGPRINTPDUTYPE("send", pdu->command);
+            return _snmp_presized_build(pkt, pkt_len, offset, pdu) ? 0 : -1;
+        }
         if (!(pdu->flags & UCD_MSG_FLAG_FORWARD_ENCODE)) {
             DEBUGPRINTPDUTYPE("send", pdu->command);
             rc = snmp_pdu_realloc_rbuild(pkt, pkt_len, offset, pdu);
@@ -4062,6 +4435,14 @@ snmpv3_parse(netsnmp_pdu *pdu,
         return (-1);
     }
 
+    /*
+     * A decrypted scopedPDU lives in a buffer that is freed on return, so
+     * values may only be borrowed if it is still part of the message.
+     */
+    if (cp == NULL || cp < msg_data || cp >= msg_data + msg_len)
+        pdu->flags &= ~(UCD_MSG_FLAG_BORROW_VARBINDS |
+                        UCD_MSG_FLAG_LAZY_VARBINDS);
+
     if (ret_val != SNMPERR_SUCCESS) {
         DEBUGDUMPSECTION("recv", "ScopedPDU");
         /*
@@ -4664,17 +5045,177 @@ snmp_parse(struct session_list *slp, netsnmp_session *pss,
     return rc;
 }
 
+/*
+ * Decodes the value TLV starting at var_val and ending at end into vp.
+ * vp->type and vp->val_len must hold the type and content length from the
+ * TLV header.  If borrow is set, large strings are left in place.
+ *
+ * Returns 0 on success, -1 on error.
+ */
+static int
+_snmp_parse_var_value(netsnmp_variable_list *vp, u_char *var_val,
+                      u_char *end, int borrow)
+{
+    oid             objid[MAX_OID_LEN];
+    size_t          len = end - var_val;
+    u_char         *p;
+
+    switch ((short) vp->type) {
+    case ASN_INTEGER:
+        vp->val.integer = (long *) vp->buf;
+        vp->val_len = sizeof(long);
+        p = asn_parse_int(var_val, &len, &vp->type,
+                      (long *) vp->val.integer,
+                      sizeof(*vp->val.integer));
+        if (!p)
+            return -1;
+        break;
+    case ASN_COUNTER:
+    case ASN_GAUGE:
+    case ASN_TIMETICKS:
+    case ASN_UINTEGER:
+        vp->val.integer = (long *) vp->buf;
+        vp->val_len = sizeof(u_long);
+        p = asn_parse_unsigned_int(var_val, &len, &vp->type,
+                               (u_long *) vp->val.integer,
+                               vp->val_len);
+        if (!p)
+            return -1;
+        break;
+#ifdef NETSNMP_WITH_OPAQUE_SPECIAL_TYPES
+    case ASN_OPAQUE_COUNTER64:
+    case ASN_OPAQUE_U64:
+#endif                          /* NETSNMP_WITH_OPAQUE_SPECIAL_TYPES */
+    case ASN_COUNTER64:
+        vp->val.counter64 = (struct counter64 *) vp->buf;
+        vp->val_len = sizeof(struct counter64);
+        p = asn_parse_unsigned_int64(var_val, &len, &vp->type,
+                                 (struct counter64 *) vp->val.
+                                 counter64, vp->val_len);
+        if (!p)
+            return -1;
+        break;
+#ifdef NETSNMP_WITH_OPAQUE_SPECIAL_TYPES
+    case ASN_OPAQUE_FLOAT:
+        vp->val.floatVal = (float *) vp->buf;
+        vp->val_len = sizeof(float);
+        p = asn_parse_float(var_val, &len, &vp->type,
+                        vp->val.floatVal, vp->val_len);
+        if (!p)
+            return -1;
+        break;
+    case ASN_OPAQUE_DOUBLE:
+        vp->val.doubleVal = (double *) vp->buf;
+        vp->val_len = sizeof(double);
+        p = asn_parse_double(var_val, &len, &vp->type,
+                         vp->val.doubleVal, vp->val_len);
+        if (!p)
+            return -1;
+        break;
+    case ASN_OPAQUE_I64:
+        vp->val.counter64 = (struct counter64 *) vp->buf;
+        vp->val_len = sizeof(struct counter64);
+        p = asn_parse_signed_int64(var_val, &len, &vp->type,
+                               (struct counter64 *) vp->val.counter64,
+                               sizeof(*vp->val.counter64));
+
+        if (!p)
+            return -1;
+        break;
+#endif                          /* NETSNMP_WITH_OPAQUE_SPECIAL_TYPES */
+    case ASN_IPADDRESS:
+        if (vp->val_len != 4)
+            return -1;
+        NETSNMP_FALLTHROUGH;
+    case ASN_OCTET_STR:
+    case ASN_OPAQUE:
+    case ASN_NSAP:
+        if (vp->val_len < sizeof(vp->buf)) {
+            vp->val.string = (u_char *) vp->buf;
+        } else if (borrow) {
+            /*
+             * the value is the last val_len bytes of the varbind
+             */
+            vp->val.string = end - vp->val_len;
+            vp->flags |= NETSNMP_VARBIND_BORROWED;
+            break;
+        } else {
+            vp->val.string = (u_char *) malloc(vp->val_len);
+        }
+        if (vp->val.string == NULL) {
+            return -1;
+        }
+        p = asn_parse_string(var_val, &len, &vp->type, vp->val.string,
+                         &vp->val_len);
+        if (!p)
+            return -1;
+        break;
+    case ASN_OBJECT_ID:
+        vp->val_len = MAX_OID_LEN;
+        p = asn_parse_objid(var_val, &len, &vp->type, objid, &vp->val_len);
+        if (!p)
+            return -1;
+        vp->val_len *= sizeof(oid);
+        vp->val.objid = netsnmp_memdup(objid, vp->val_len);
+        if (vp->val.objid == NULL)
+            return -1;
+        break;
+    case SNMP_NOSUCHOBJECT:
+    case SNMP_NOSUCHINSTANCE:
+    case SNMP_ENDOFMIBVIEW:
+    case ASN_NULL:
+        break;
+    case ASN_BIT_STR:
+        if (borrow && vp->val_len >= 1) {
+            /*
+             * parse the bit string onto itself: it is checked as when
+             * copied, and stays where it is in the packet
+             */
+            vp->val.bitstring = end - vp->val_len;
+            vp->flags |= NETSNMP_VARBIND_BORROWED;
+            p = asn_parse_bitstring(var_val, &len, &vp->type,
+                                    vp->val.bitstring, &vp->val_len);
+            if (!p)
+                return -1;
+            break;
+        }
+        vp->val.bitstring = (u_char *) malloc(vp->val_len);
+        if (vp->val.bitstring == NULL) {
+            return -1;
+        }
+        p = asn_parse_bitstring(var_val, &len, &vp->type,
+                            vp->val.bitstring, &vp->val_len);
+        if (!p)
+            return -1;
+        break;
+    default:
+        snmp_log(LOG_ERR, "bad type returned (%x)\n", vp->type);
+        return -1;
+    }
+    return 0;
+}
+
+/*
+ * Parses the PDU at data into pdu.  If pdu->flags has
+ * UCD_MSG_FLAG_BORROW_VARBINDS set, values that don't fit in a varbind's
+ * own buffer are not copied but left pointing into data, and the varbind
+ * is marked NETSNMP_VARBIND_BORROWED.  With UCD_MSG_FLAG_LAZY_VARBINDS,
+ * values are not decoded at all: the varbind is marked
+ * NETSNMP_VARBIND_LAZY, val.string and val_len describe the value's
+ * encoding within data, and snmp_decode_var_value() must be called before
+ * the value is used.  Errors in a lazy value are only reported then.
+ */
 int
 snmp_pdu_parse(netsnmp_pdu *pdu, u_char * data, size_t * length)
 {
     u_char          type;
     u_char          msg_type;
     u_char         *var_val;
-    size_t          len;
     size_t          four;
     netsnmp_variable_list *vp = NULL, *vplast = NULL;
     oid             objid[MAX_OID_LEN];
-    u_char         *p;
+    int             borrow = pdu->flags & UCD_MSG_FLAG_BORROW_VARBINDS;
+    int             lazy = pdu->flags & UCD_MSG_FLAG_LAZY_VARBINDS;
 
     /*
      * Get the PDU type 
@@ -4818,130 +5359,24 @@ snmp_pdu_parse(netsnmp_pdu *pdu, u_char * data, size_t * length)
         if (NULL == vp)
             goto fail;
 
+        vp->name = vp->name_loc;
         vp->name_length = MAX_OID_LEN;
         DEBUGDUMPSECTION("recv", "VarBind");
-        data = snmp_parse_var_op(data, objid, &vp->name_length, &vp->type,
-                                 &vp->val_len, &var_val, length);
+        data = snmp_parse_var_op(data, vp->name_loc, &vp->name_length,
+                                 &vp->type, &vp->val_len, &var_val, length);
         if (data == NULL)
             goto fail;
-        if (snmp_set_var_objid(vp, objid, vp->name_length))
-            goto fail;
 
-        len = SNMP_MAX_PACKET_LEN;
         DEBUGDUMPHEADER("recv", "Value");
-        switch ((short) vp->type) {
-        case ASN_INTEGER:
-            vp->val.integer = (long *) vp->buf;
-            vp->val_len = sizeof(long);
-            p = asn_parse_int(var_val, &len, &vp->type,
-                          (long *) vp->val.integer,
-                          sizeof(*vp->val.integer));
-            if (!p)
-                goto fail;
-            break;
-        case ASN_COUNTER:
-        case ASN_GAUGE:
-        case ASN_TIMETICKS:
-        case ASN_UINTEGER:
-            vp->val.integer = (long *) vp->buf;
-            vp->val_len = sizeof(u_long);
-            p = asn_parse_unsigned_int(var_val, &len, &vp->type,
-                                   (u_long *) vp->val.integer,
-                                   vp->val_len);
-            if (!p)
-                goto fail;
-            break;
-#ifdef NETSNMP_WITH_OPAQUE_SPECIAL_TYPES
-        case ASN_OPAQUE_COUNTER64:
-        case ASN_OPAQUE_U64:
-#endif                          /* NETSNMP_WITH_OPAQUE_SPECIAL_TYPES */
-        case ASN_COUNTER64:
-            vp->val.counter64 = (struct counter64 *) vp->buf;
-            vp->val_len = sizeof(struct counter64);
-            p = asn_parse_unsigned_int64(var_val, &len, &vp->type,
-                                     (struct counter64 *) vp->val.
-                                     counter64, vp->val_len);
-            if (!p)
-                goto fail;
-            break;
-#ifdef NETSNMP_WITH_OPAQUE_SPECIAL_TYPES
-        case ASN_OPAQUE_FLOAT:
-            vp->val.floatVal = (float *) vp->buf;
-            vp->val_len = sizeof(float);
-            p = asn_parse_float(var_val, &len, &vp->type,
-                            vp->val.floatVal, vp->val_len);
-            if (!p)
-                goto fail;
-            break;
-        case ASN_OPAQUE_DOUBLE:
-            vp->val.doubleVal = (double *) vp->buf;
-            vp->val_len = sizeof(double);
-            p = asn_parse_double(var_val, &len, &vp->type,
-                             vp->val.doubleVal, vp->val_len);
-            if (!p)
-                goto fail;
-            break;
-        case ASN_OPAQUE_I64:
-            vp->val.counter64 = (struct counter64 *) vp->buf;
-            vp->val_len = sizeof(struct counter64);
-            p = asn_parse_signed_int64(var_val, &len, &vp->type,
-                                   (struct counter64 *) vp->val.counter64,
-                                   sizeof(*vp->val.counter64));
-
-            if (!p)
-                goto fail;
-            break;
-#endif                          /* NETSNMP_WITH_OPAQUE_SPECIAL_TYPES */
-        case ASN_IPADDRESS:
-            if (vp->val_len != 4)
-                goto fail;
-            NETSNMP_FALLTHROUGH;
-        case ASN_OCTET_STR:
-        case ASN_OPAQUE:
-        case ASN_NSAP:
-            if (vp->val_len < sizeof(vp->buf)) {
-                vp->val.string = (u_char *) vp->buf;
-            } else {
-                vp->val.string = (u_char *) malloc(vp->val_len);
-            }
-            if (vp->val.string == NULL) {
-                goto fail;
-            }
-            p = asn_parse_string(var_val, &len, &vp->type, vp->val.string,
-                             &vp->val_len);
-            if (!p)
-                goto fail;
-            break;
-        case ASN_OBJECT_ID:
-            vp->val_len = MAX_OID_LEN;
-            p = asn_parse_objid(var_val, &len, &vp->type, objid, &vp->val_len);
-            if (!p)
-                goto fail;
-            vp->val_len *= sizeof(oid);
-            vp->val.objid = netsnmp_memdup(objid, vp->val_len);
-            if (vp->val.objid == NULL)
-                goto fail;
-            break;
-        case SNMP_NOSUCHOBJECT:
-        case SNMP_NOSUCHINSTANCE:
-        case SNMP_ENDOFMIBVIEW:
-        case ASN_NULL:
-            break;
-        case ASN_BIT_STR:
-            vp->val.bitstring = (u_char *) malloc(vp->val_len);
-            if (vp->val.bitstring == NULL) {
-                goto fail;
-            }
-            p = asn_parse_bitstring(var_val, &len, &vp->type,
-                                vp->val.bitstring, &vp->val_len);
-            if (!p)
-                goto fail;
-            break;
-        default:
-            snmp_log(LOG_ERR, "bad type returned (%x)\n", vp->type);
+        if (lazy && vp->val_len > 0) {
+            /*
+             * remember where the value TLV is and decode it on demand
+             */
+            vp->val.string = var_val;
+            vp->val_len = data - var_val;
+            vp->flags |= NETSNMP_VARBIND_LAZY | NETSNMP_VARBIND_BORROWED;
+        } else if (_snmp_parse_var_value(vp, var_val, data, borrow) < 0)
             goto fail;
-            break;
-        }
         DEBUGINDENTADD(-4);
 
         if (NULL == vplast) {
@@ -4966,6 +5401,69 @@ snmp_pdu_parse(netsnmp_pdu *pdu, u_char * data, size_t * length)
     return -1;
 }
 
+/**
+ * Decodes the value of a varbind parsed with UCD_MSG_FLAG_LAZY_VARBINDS.
+ * Large strings are left in the packet, as for
+ * UCD_MSG_FLAG_BORROW_VARBINDS.  Does nothing for other varbinds.
+ *
+ * @param var the varbind to decode
+ *
+ * @return 0 on success, 1 if the value could not be decoded
+ */
+int
+snmp_decode_var_value(netsnmp_variable_list *var)
+{
+    u_char         *tlv, *data;
+    size_t          len;
+    u_char          type;
+
+    if (var == NULL || !(var->flags & NETSNMP_VARBIND_LAZY))
+        return 0;
+
+    tlv = var->val.string;
+    len = var->val_len;
+    var->val.string = NULL;
+    var->val_len = 0;
+    var->flags &= ~(NETSNMP_VARBIND_LAZY | NETSNMP_VARBIND_BORROWED);
+
+    data = asn_parse_header(tlv, &len, &type);
+    if (data != NULL) {
+        var->val_len = len;
+        if (_snmp_parse_var_value(var, tlv, data + len, 1) == 0)
+            return 0;
+    }
+    DEBUGMSGTL(("recv", "error while decoding a lazy varbind value\n"));
+
+    /*
+     * leave no partly decoded value behind for callers that go by the
+     * type and val_len
+     */
+    if (var->val.string && var->val.string != var->buf &&
+        !(var->flags & NETSNMP_VARBIND_BORROWED))
+        free(var->val.string);
+    var->flags &= ~NETSNMP_VARBIND_BORROWED;
+    var->val.string = NULL;
+    var->val_len = 0;
+    var->type = ASN_NULL;
+    return 1;
+}
+
+/**
+ * Decodes the values of all lazily parsed varbinds in a list.
+ *
+ * @param var the first varbind in the list
+ *
+ * @return 0 on success, 1 if any value could not be decoded
+ */
+int
+snmp_decode_varlist(netsnmp_variable_list *var)
+{
+    for (; var; var = var->next_variable)
+        if (snmp_decode_var_value(var))
+            return 1;
+    return 0;
+}
+
 /*
  * snmp v3 utility function to parse into the scopedPdu. stores contextName
  * and contextEngineID in pdu struct. Also stores pdu->command (handy for 
@@ -5566,7 +6064,8 @@ snmp_free_var_internals(netsnmp_variable_list * var)
 
     if (var->name != var->name_loc)
         SNMP_FREE(var->name);
-    if (var->val.string != var->buf)
+    if (var->val.string != var->buf &&
+        !(var->flags & NETSNMP_VARBIND_BORROWED))
         SNMP_FREE(var->val.string);
     if (var->data) {
         if (var->dataFreeHook) {
@@ -5748,6 +6247,12 @@ _sess_process_packet_parse_pdu(struct session_list *slp, netsnmp_session * sp,
       pdu->flags |= UCD_MSG_FLAG_TUNNELED;
   }
 
+  /* the packet outlives the pdu, so values can be parsed in place */
+  if (sp->flags & SNMP_FLAGS_BORROW_VARBINDS)
+      pdu->flags |= UCD_MSG_FLAG_BORROW_VARBINDS;
+  if (sp->flags & SNMP_FLAGS_LAZY_VARBINDS)
+      pdu->flags |= UCD_MSG_FLAG_LAZY_VARBINDS;
+
   if (isp->hook_parse) {
     ret = isp->hook_parse(sp, pdu, packetptr, length);
   } else {
@@ -6519,6 +7024,37 @@ snmp_sess_read2(struct session_list *slp, netsnmp_large_fd_set * fdset)
     return rc;
 }
 
+/*
+ * Processes a datagram that was read from the transport of a session by
+ * other means than snmp_read(), e.g. on another thread, as if snmp_read()
+ * had read it.  opaque is freed.
+ * returns 0 if success, -1 if fail
+ */
+int
+snmp_sess_process_packet(struct session_list *slp, u_char *packet,
+                         int length, void *opaque, int olength)
+{
+    netsnmp_session *sp = slp ? slp->session : NULL;
+    struct snmp_internal_session *isp = slp ? slp->internal : NULL;
+    netsnmp_transport *transport = slp ? slp->transport : NULL;
+    int             rc;
+
+    if (NULL == sp || NULL == isp || NULL == transport || NULL == packet) {
+        snmp_log(LOG_ERR, "bad parameters to snmp_sess_process_packet\n");
+        SNMP_FREE(opaque);
+        return -1;
+    }
+
+    sp->s_snmp_errno = 0;
+    sp->s_errno = 0;
+    rc = _sess_process_packet(slp, sp, isp, transport, opaque, olength,
+                              packet, length);
+    if (rc && sp->s_snmp_errno) {
+        SET_SNMP_ERROR(sp->s_snmp_errno);
+    }
+    return rc < 0 ? -1 : 0;
+}
+
 
 /**
  * Returns info about what snmp requires from a select statement.
@@ -6951,6 +7487,92 @@ snmp_sess_timeout(struct session_list *slp)
     }
 }
 
+/*
+ * Find the first sub-identifier at which two OIDs of (at least) len
+ * sub-identifiers differ; returns len if they are equal. This is the
+ * inner loop of every OID comparison below, and therefore of every
+ * container lookup, registry lookup and VACM check, so it compares a
+ * whole vector of sub-identifiers at a time where the CPU allows it.
+ * Equality is tested bytewise, which works for any sizeof(oid).
+ */
+static size_t
+_oid_diff_scalar(const oid * name1, const oid * name2, size_t len)
+{
+    size_t          i;
+
+    for (i = 0; i < len; i++)
+        if (name1[i] != name2[i])
+            break;
+    return i;
+}
+
+#ifdef NETSNMP_OID_DIFF_SSE2
+static size_t
+_oid_diff_sse2(const oid * name1, const oid * name2, size_t len)
+{
+    const size_t    per_vec = 16 / sizeof(oid);
+    size_t          i;
+    unsigned int    mask;
+
+    for (i = 0; i + per_vec <= len; i += per_vec) {
+        __m128i         a = _mm_loadu_si128((const __m128i *) (name1 + i));
+        __m128i         b = _mm_loadu_si128((const __m128i *) (name2 + i));
+
+        mask = _mm_movemask_epi8(_mm_cmpeq_epi8(a, b)) ^ 0xffffU;
+        if (mask)
+            return i + __builtin_ctz(mask) / sizeof(oid);
+    }
+    return i + _oid_diff_scalar(name1 + i, name2 + i, len - i);
+}
+#endif /* NETSNMP_OID_DIFF_SSE2 */
+
+#ifdef NETSNMP_OID_DIFF_AVX2
+__attribute__((target("avx2")))
+static size_t
+_oid_diff_avx2(const oid * name1, const oid * name2, size_t len)
+{
+    const size_t    per_vec = 32 / sizeof(oid);
+    size_t          i;
+    unsigned int    mask;
+
+    for (i = 0; i + per_vec <= len; i += per_vec) {
+        __m256i         a = _mm256_loadu_si256((const __m256i *) (name1 + i));
+        __m256i         b = _mm256_loadu_si256((const __m256i *) (name2 + i));
+
+        mask = ~(unsigned int)_mm256_movemask_epi8(_mm256_cmpeq_epi8(a, b));
+        if (mask)
+            return i + __builtin_ctz(mask) / sizeof(oid);
+    }
+    return i + _oid_diff_sse2(name1 + i, name2 + i, len - i);
+}
+#endif /* NETSNMP_OID_DIFF_AVX2 */
+
+static size_t   _oid_diff_resolve(const oid *, const oid *, size_t);
+
+static size_t   (*_oid_diff)(const oid *, const oid *, size_t) =
+    _oid_diff_resolve;
+
+/*
+ * Pick the best implementation on first use. Racing threads all store
+ * the same pointer, so no locking is needed.
+ */
+static size_t
+_oid_diff_resolve(const oid * name1, const oid * name2, size_t len)
+{
+#if defined(NETSNMP_OID_DIFF_AVX2)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+        _oid_diff = _oid_diff_avx2;
+    else
+        _oid_diff = _oid_diff_sse2;
+#elif defined(NETSNMP_OID_DIFF_SSE2)
+    _oid_diff = _oid_diff_sse2;
+#else
+    _oid_diff = _oid_diff_scalar;
+#endif
+    return _oid_diff(name1, name2, len);
+}
+
 /*
  * lexicographical compare two object identifiers.
  * * Returns -1 if name1 < name2,
@@ -6965,10 +7587,7 @@ snmp_oid_ncompare(const oid * in_name1,
                   size_t len1,
                   const oid * in_name2, size_t len2, size_t max_len)
 {
-    register int    len;
-    register const oid *name1 = in_name1;
-    register const oid *name2 = in_name2;
-    size_t          min_len;
+    size_t          min_len, i;
 
     /*
      * len = minimum of len1 and len2 
@@ -6981,24 +7600,19 @@ snmp_oid_ncompare(const oid * in_name1,
     if (min_len > max_len)
         min_len = max_len;
 
-    len = min_len;
-
     /*
      * find first non-matching OID 
      */
-    while (len-- > 0) {
+    i = _oid_diff(in_name1, in_name2, min_len);
+    if (i < min_len) {
         /*
          * these must be done in separate comparisons, since
          * subtracting them and using that result has problems with
          * subids > 2^31. 
          */
-        if (*(name1) != *(name2)) {
-            if (*(name1) < *(name2))
-                return -1;
-            return 1;
-        }
-        name1++;
-        name2++;
+        if (in_name1[i] < in_name2[i])
+            return -1;
+        return 1;
     }
 
     if (min_len != max_len) {
@@ -7031,9 +7645,7 @@ int
 snmp_oid_compare(const oid * in_name1,
                  size_t len1, const oid * in_name2, size_t len2)
 {
-    register int    len;
-    register const oid *name1 = in_name1;
-    register const oid *name2 = in_name2;
+    size_t          len, i;
 
     /*
      * len = minimum of len1 and len2 
@@ -7045,19 +7657,16 @@ snmp_oid_compare(const oid * in_name1,
     /*
      * find first non-matching OID 
      */
-    while (len-- > 0) {
+    i = _oid_diff(in_name1, in_name2, len);
+    if (i < len) {
         /*
          * these must be done in separate comparisons, since
          * subtracting them and using that result has problems with
          * subids > 2^31. 
          */
-        if (*(name1) != *(name2)) {
-            if (*(name1) < *(name2))
-                return -1;
-            return 1;
-        }
-        name1++;
-        name2++;
+        if (in_name1[i] < in_name2[i])
+            return -1;
+        return 1;
     }
     /*
      * both OIDs equal up to length of shorter OID 
@@ -7088,40 +7697,34 @@ int
 netsnmp_oid_compare_ll(const oid * in_name1, size_t len1, const oid * in_name2,
                        size_t len2, size_t *offpt)
 {
-    register int    len;
-    register const oid *name1 = in_name1;
-    register const oid *name2 = in_name2;
-    int initlen;
+    size_t          len, i;
 
     /*
      * len = minimum of len1 and len2 
      */
     if (len1 < len2)
-        initlen = len = len1;
+        len = len1;
     else
-        initlen = len = len2;
+        len = len2;
     /*
-     * find first non-matching OID 
+     * find first non-matching OID; offpt is one past it (or one past
+     * the end of the shorter OID when they are equal that far).
      */
-    while (len-- > 0) {
+    i = _oid_diff(in_name1, in_name2, len);
+    *offpt = i + 1;
+    if (i < len) {
         /*
          * these must be done in separate comparisons, since
          * subtracting them and using that result has problems with
          * subids > 2^31. 
          */
-        if (*(name1) != *(name2)) {
-            *offpt = initlen - len;
-            if (*(name1) < *(name2))
-                return -1;
-            return 1;
-        }
-        name1++;
-        name2++;
+        if (in_name1[i] < in_name2[i])
+            return -1;
+        return 1;
     }
     /*
      * both OIDs equal up to length of shorter OID 
      */
-    *offpt = initlen - len;
     if (len1 < len2)
         return -1;
     if (len2 < len1)
@@ -7168,10 +7771,6 @@ int
 netsnmp_oid_equals(const oid * in_name1,
                    size_t len1, const oid * in_name2, size_t len2)
 {
-    register const oid *name1 = in_name1;
-    register const oid *name2 = in_name2;
-    register int    len = len1;
-
     /*
      * len = minimum of len1 and len2 
      */
@@ -7182,21 +7781,12 @@ netsnmp_oid_equals(const oid * in_name1,
      */
     if (len1 == 0)
         return 0;   /* Two null OIDs are (trivially) the same */
-    if (!name1 || !name2)
+    if (!in_name1 || !in_name2)
         return 1;   /* Otherwise something's wrong, so report a non-match */
     /*
      * find first non-matching OID 
      */
-    while (len-- > 0) {
-        /*
-         * these must be done in separate comparisons, since
-         * subtracting them and using that result has problems with
-         * subids > 2^31. 
-         */
-        if (*(name1++) != *(name2++))
-            return 1;
-    }
-    return 0;
+    return _oid_diff(in_name1, in_name2, len1) != len1;
 }
 
 #ifndef NETSNMP_FEATURE_REMOVE_OID_IS_SUBTREE
@@ -7234,7 +7824,6 @@ int
 netsnmp_oid_find_prefix(const oid * in_name1, size_t len1,
                         const oid * in_name2, size_t len2)
 {
-    int i;
     size_t min_size;
 
     if (!in_name1 || !in_name2 || !len1 || !len2)
@@ -7243,14 +7832,12 @@ netsnmp_oid_find_prefix(const oid * in_name1, size_t len1,
     if (in_name1[0] != in_name2[0])
         return 0;   /* No match */
     min_size = SNMP_MIN(len1, len2);
-    for(i = 0; i < (int)min_size; i++) {
-        if (in_name1[i] != in_name2[i])
-            return i;    /* 'i' is the first differing subidentifier
-                            So the common prefix is 0..(i-1), of length i */
-    }
-    return min_size;	/* The shorter OID is a prefix of the longer, and
-                           hence is precisely the common prefix of the two.
-                           Return its length. */
+    /*
+     * The first differing subidentifier ends the common prefix; if there
+     * is none, the shorter OID is a prefix of the longer, and hence is
+     * precisely the common prefix of the two.
+     */
+    return _oid_diff(in_name1, in_name2, min_size);
 }
 
 #ifndef NETSNMP_DISABLE_MIB_LOADING
@@ -252,6 +252,8 @@ snmp_clone_var(netsnmp_variable_list * var, netsnmp_variable_list * newvar)
 {
     if (!newvar || !var)
         return 1;
+    if (snmp_decode_var_value(var))
+        return 1;
 
     memmove(newvar, var, sizeof(netsnmp_variable_list));
     newvar->next_variable = NULL;
@@ -260,6 +262,7 @@ snmp_clone_var(netsnmp_variable_list * var, netsnmp_variable_list * newvar)
     newvar->data = NULL;
     newvar->dataFreeHook = NULL;
     newvar->index = 0;
+    newvar->flags &= ~NETSNMP_VARBIND_BORROWED;
 
     /*
      * Clone the object identifier and the value.
@@ -337,15 +340,47 @@ snmp_reset_var_buffers(netsnmp_variable_list * var)
             var->name_length = 0;
         }
         if (var->val.string != var->buf) {
-            if (NULL != var->val.string)
+            if (NULL != var->val.string &&
+                !(var->flags & NETSNMP_VARBIND_BORROWED))
                 free(var->val.string);
             var->val.string = var->buf;
             var->val_len = 0;
+            var->flags &= ~(NETSNMP_VARBIND_BORROWED | NETSNMP_VARBIND_LAZY);
         }
         var = var->next_variable;
     }
 }
 
+/*
+ * Gives every varbind in the list that borrows its value from a received
+ * packet (NETSNMP_VARBIND_BORROWED) its own copy, so that the list can be
+ * kept after the packet has been processed.  Lazily parsed values are
+ * decoded first.
+ *
+ * Returns 0 if successful, 1 if memory could not be allocated or a value
+ * could not be decoded.
+ */
+int
+snmp_varlist_materialize(netsnmp_variable_list * var)
+{
+    u_char         *copy;
+
+    for (; var; var = var->next_variable) {
+        if (snmp_decode_var_value(var))
+            return 1;
+        if (!(var->flags & NETSNMP_VARBIND_BORROWED))
+            continue;
+        if (var->val_len <= sizeof(var->buf))
+            copy = var->buf;
+        else if ((copy = (u_char *) malloc(var->val_len)) == NULL)
+            return 1;
+        memmove(copy, var->val.string, var->val_len);
+        var->val.string = copy;
+        var->flags &= ~NETSNMP_VARBIND_BORROWED;
+    }
+    return 0;
+}
+
 /*
  * Creates and allocates a clone of the input PDU,
  * but does NOT copy the variables.
@@ -808,11 +843,13 @@ snmp_set_var_value(netsnmp_variable_list * vars,
      * xxx-rks: why the unconditional free? why not use existing
      * memory, if len < vars->val_len ?
      */
-    if (vars->val.string && vars->val.string != vars->buf) {
+    if (vars->val.string && vars->val.string != vars->buf &&
+        !(vars->flags & NETSNMP_VARBIND_BORROWED)) {
         free(vars->val.string);
     }
     vars->val.string = NULL;
     vars->val_len = 0;
+    vars->flags &= ~(NETSNMP_VARBIND_BORROWED | NETSNMP_VARBIND_LAZY);
 
     if (value == NULL && len > 0) {
         snmp_log(LOG_ERR, "bad size for NULL value\n");
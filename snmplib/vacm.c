@@ -66,6 +66,7 @@
 static struct vacm_viewEntry *viewList = NULL, *viewScanPtr = NULL;
 static struct vacm_accessEntry *accessList = NULL, *accessScanPtr = NULL;
 static struct vacm_groupEntry *groupList = NULL, *groupScanPtr = NULL;
+static unsigned int vacmGeneration = 0;
 
 /*
  * Macro to extend view masks with 1 bits when shorter than subtree lengths
@@ -872,6 +873,7 @@ vacm_createGroupEntry(int securityModel, const char *securityName)
         groupList = gp;
     else
         og->next = gp;
+    vacmGeneration++;
     return gp;
 }
 
@@ -898,6 +900,7 @@ vacm_destroyGroupEntry(int securityModel, const char *securityName)
     if (vp->reserved)
         free(vp->reserved);
     free(vp);
+    vacmGeneration++;
     return;
 }
 
@@ -906,6 +909,7 @@ void
 vacm_destroyAllGroupEntries(void)
 {
     struct vacm_groupEntry *gp;
+    vacmGeneration++;
     while ((gp = groupList)) {
         groupList = gp->next;
         if (gp->reserved)
@@ -1065,6 +1069,7 @@ vacm_createAccessEntry(const char *groupName,
         accessList = vp;
     else
         op->next = vp;
+    vacmGeneration++;
     return vp;
 }
 
@@ -1097,6 +1102,7 @@ vacm_destroyAccessEntry(const char *groupName,
     if (vp->reserved)
         free(vp->reserved);
     free(vp);
+    vacmGeneration++;
     return;
 }
 
@@ -1104,6 +1110,7 @@ void
 vacm_destroyAllAccessEntries(void)
 {
     struct vacm_accessEntry *ap;
+    vacmGeneration++;
     while ((ap = accessList)) {
         accessList = ap->next;
         if (ap->reserved)
@@ -1145,6 +1152,18 @@ vacm_is_configured(void)
     return 1;
 }
 
+/*
+ * returns a number that changes whenever a view, group or access entry
+ * is created or destroyed, so that callers can tell when decisions
+ * they have remembered may no longer hold.  Entries modified in place,
+ * e.g. through the VACM MIB, are not counted.
+ */
+unsigned int
+vacm_get_generation(void)
+{
+    return vacmGeneration;
+}
+
 /*
  * backwards compatability
  */
@@ -1168,6 +1187,7 @@ struct vacm_viewEntry *
 vacm_createViewEntry(const char *viewName,
                      oid * viewSubtree, size_t viewSubtreeLen)
 {
+    vacmGeneration++;
     return netsnmp_view_create( &viewList, viewName, viewSubtree,
                                 viewSubtreeLen);
 }
@@ -1176,12 +1196,14 @@ void
 vacm_destroyViewEntry(const char *viewName,
                       oid * viewSubtree, size_t viewSubtreeLen)
 {
+    vacmGeneration++;
     netsnmp_view_destroy( &viewList, viewName, viewSubtree, viewSubtreeLen);
 }
 
 void
 vacm_destroyAllViewEntries(void)
 {
+    vacmGeneration++;
     netsnmp_view_clear( &viewList );
 }
 
@@ -0,0 +1,183 @@
+/* HEADER Testing B+tree container against binary array */
+
+/*
+ * Insert the same OIDs, in a scrambled order, into a btree and a binary
+ * array container and check that both agree on ordering, lookups,
+ * subsets and positional access while growing and shrinking. Items are
+ * freed as soon as they are removed from both (after overwriting them,
+ * so that anything still pointing at them compares wrongly), and later
+ * lookups use keys of their own.
+ */
+static const char test_name[] = "btree-container-test";
+#define N_ITEMS 5000
+#define ITEM_KILL(ip) do {                      \
+        (ip)->oids[0] = (ip)->oids[1] = 0;      \
+        (ip)->len = 0;                          \
+        free(ip);                               \
+    } while (0)
+netsnmp_index     **idx, key, key2, *ip, *ip2;
+oid                 key_oids[2], dup_oids[2];
+netsnmp_container  *bt, *ba, *dup;
+netsnmp_void_array *va1, *va2;
+netsnmp_iterator   *it;
+void               *p1, *p2;
+oid                 prefix;
+int                 i, k, ok;
+
+init_snmp(test_name);
+
+bt = netsnmp_container_find("btree");
+ba = netsnmp_container_find("binary_array");
+OK(bt != NULL && ba != NULL, "btree and binary_array containers exist");
+
+/* item i holds the OID k / 10 . k % 10 */
+#define ITEM_K(i) ((int)(((long)(i) * 7919) % N_ITEMS))
+idx = calloc(N_ITEMS, sizeof(netsnmp_index *));
+
+for (i = 0; i < N_ITEMS; ++i) {
+    k = ITEM_K(i);
+    idx[i] = malloc(sizeof(netsnmp_index) + 2 * sizeof(oid));
+    idx[i]->oids = (oid *)(idx[i] + 1);
+    idx[i]->oids[0] = k / 10;
+    idx[i]->oids[1] = k % 10;
+    idx[i]->len = 2;
+    CONTAINER_INSERT(bt, idx[i]);
+    CONTAINER_INSERT(ba, idx[i]);
+}
+OKF(CONTAINER_SIZE(bt) == N_ITEMS,
+    ("btree holds %d items", (int)CONTAINER_SIZE(bt)));
+OK(CONTAINER_INSERT(bt, idx[17]) != 0, "duplicate insert is refused");
+
+ok = 1;
+for (ip = CONTAINER_FIRST(bt), ip2 = CONTAINER_FIRST(ba), i = 0; ip || ip2;
+     ip = CONTAINER_NEXT(bt, ip), ip2 = CONTAINER_NEXT(ba, ip2), ++i) {
+    CONTAINER_GET_AT(bt, i, &p1);
+    if (ip != ip2 || p1 != ip)
+        ok = 0;
+}
+OK(ok && i == N_ITEMS, "getnext and get_at order matches binary_array");
+
+it = CONTAINER_ITERATOR(bt);
+for (ip = ITERATOR_FIRST(it), i = 0; ip; ip = ITERATOR_NEXT(it), ++i)
+    if (CONTAINER_GET_AT(ba, i, &p2) != 0 || p2 != ip)
+        break;
+OKF(i == N_ITEMS, ("iterator visited %d items in order", i));
+ITERATOR_RELEASE(it);
+
+prefix = 123;
+key.oids = &prefix;
+key.len = 1;
+va1 = CONTAINER_GET_SUBSET(bt, &key);
+va2 = CONTAINER_GET_SUBSET(ba, &key);
+OK(va1 && va2 && va1->size == 10 && va2->size == 10 &&
+   memcmp(va1->array, va2->array, 10 * sizeof(void *)) == 0,
+   "get_subset matches binary_array");
+if (va1) {
+    free(va1->array);
+    free(va1);
+}
+if (va2) {
+    free(va2->array);
+    free(va2);
+}
+
+dup = CONTAINER_DUP(bt, NULL, 0);
+OK(dup && CONTAINER_SIZE(dup) == N_ITEMS, "duplicate has all items");
+if (dup) {
+    CONTAINER_CLEAR(dup, NULL, NULL);
+    CONTAINER_FREE(dup);
+}
+
+/*
+ * remove every seventh item by key, and every fifth by position, and
+ * free what was removed
+ */
+for (i = 0; i < N_ITEMS; i += 7) {
+    CONTAINER_REMOVE(bt, idx[i]);
+    CONTAINER_REMOVE(ba, idx[i]);
+    ITEM_KILL(idx[i]);
+    idx[i] = NULL;
+}
+for (i = CONTAINER_SIZE(bt) - 1; i >= 0; i -= 5) {
+    CONTAINER_REMOVE_AT(bt, i, &p1);
+    CONTAINER_REMOVE_AT(ba, i, &p2);
+    if (p1 != p2)
+        break;
+    for (k = 0; k < N_ITEMS; ++k)
+        if (idx[k] == p1)
+            idx[k] = NULL;
+    ITEM_KILL((netsnmp_index *)p1);
+}
+OK(i < 0, "remove_at returns the same items");
+OK(CONTAINER_SIZE(bt) == CONTAINER_SIZE(ba), "sizes match after removes");
+
+ok = 1;
+key.oids = key_oids;
+key.len = 2;
+for (i = 0; i < N_ITEMS; ++i) {
+    key_oids[0] = ITEM_K(i) / 10;
+    key_oids[1] = ITEM_K(i) % 10;
+    if (CONTAINER_FIND(bt, &key) != CONTAINER_FIND(ba, &key) ||
+        CONTAINER_FIND(bt, &key) != idx[i] ||
+        CONTAINER_NEXT(bt, &key) != CONTAINER_NEXT(ba, &key))
+        ok = 0;
+}
+OK(ok, "find and find_next agree after removes");
+
+/* drain through an iterator */
+it = CONTAINER_ITERATOR(bt);
+for (ip = ITERATOR_FIRST(it); ip; ip = ITERATOR_NEXT(it))
+    ITERATOR_REMOVE(it);
+ITERATOR_RELEASE(it);
+OKF(CONTAINER_SIZE(bt) == 0,
+    ("iterator removed all items, %d left", (int)CONTAINER_SIZE(bt)));
+OK(CONTAINER_FIRST(bt) == NULL, "empty btree has no first item");
+
+/* duplicates, inserted after existing equal keys like binary_array */
+CONTAINER_SET_OPTIONS(bt, CONTAINER_KEY_ALLOW_DUPLICATES, k);
+OK(k != -1, "btree supports duplicate keys");
+key_oids[0] = 1;
+key_oids[1] = 2;
+key2.oids = dup_oids;
+key2.len = 2;
+dup_oids[0] = 3;
+dup_oids[1] = 4;
+for (i = 0; i < 200; ++i)
+    CONTAINER_INSERT(bt, i % 2 ? &key2 : &key);
+OK(CONTAINER_SIZE(bt) == 200, "duplicate inserts accepted");
+ip = CONTAINER_FIRST(bt);
+ip2 = CONTAINER_NEXT(bt, ip);
+OK(ip2 == NULL || bt->compare(ip, ip2) < 0, "getnext skips duplicates");
+
+/*
+ * the inetCidrRouteTable container, set up as the table does: routes
+ * with the same index are all kept, and removed one at a time
+ */
+dup = netsnmp_container_find("inetCidrRouteTable:btree:table_container");
+k = -1;
+if (dup)
+    CONTAINER_SET_OPTIONS(dup, CONTAINER_KEY_ALLOW_DUPLICATES, k);
+OK(dup && k != -1, "route table container allows duplicate keys");
+if (dup) {
+    for (i = 0; i < 3; ++i)
+        CONTAINER_INSERT(dup, &key);
+    OK(CONTAINER_INSERT(dup, &key2) == 0 && CONTAINER_SIZE(dup) == 4,
+       "routes with the same index are all inserted");
+    for (i = 0; i < 3; ++i)
+        CONTAINER_REMOVE(dup, &key);
+    OK(CONTAINER_SIZE(dup) == 1 && CONTAINER_FIND(dup, &key) == NULL &&
+       CONTAINER_FIND(dup, &key2) == &key2,
+       "duplicate routes are removed one at a time");
+    CONTAINER_CLEAR(dup, NULL, NULL);
+    CONTAINER_FREE(dup);
+}
+
+CONTAINER_CLEAR(bt, NULL, NULL);
+CONTAINER_CLEAR(ba, NULL, NULL);
+CONTAINER_FREE(bt);
+CONTAINER_FREE(ba);
+for (i = 0; i < N_ITEMS; ++i)
+    free(idx[i]);
+free(idx);
+
+snmp_shutdown(test_name);
@@ -0,0 +1,60 @@
+/* HEADER Testing OID comparison functions */
+
+/*
+ * Compare two OIDs that share a prefix and then differ (or not) at every
+ * position, for lengths that straddle the vector widths, against the
+ * obvious one sub-identifier at a time loop.
+ */
+oid             a[40], b[40];
+size_t          len1, len2, diff, i, off, min_len;
+int             expect, bad_cmp = 0, bad_ncmp = 0, bad_tree = 0;
+int             bad_eq = 0, bad_prefix = 0, bad_ll = 0;
+
+for (len1 = 0; len1 < 40; len1++) {
+    for (len2 = len1 > 3 ? len1 - 3 : 0; len2 < 40 && len2 <= len1 + 3;
+         len2++) {
+        min_len = len1 < len2 ? len1 : len2;
+        for (diff = 0; diff <= min_len; diff++) {
+            for (i = 0; i < 40; i++)
+                a[i] = b[i] = 1000 + i;
+            if (diff < min_len) {
+                /* differ in the top bit, where subtraction would fail */
+                a[diff] = (oid)1 << (sizeof(oid) * 8 - 1);
+                b[diff] = 7;
+                /* and make sure later sub-identifiers don't matter */
+                if (diff + 1 < min_len)
+                    b[diff + 1] = (oid)-1;
+            }
+
+            if (diff < min_len)
+                expect = 1;
+            else
+                expect = len1 < len2 ? -1 : len1 > len2 ? 1 : 0;
+
+            if (snmp_oid_compare(a, len1, b, len2) != expect ||
+                snmp_oid_compare(b, len2, a, len1) != -expect)
+                bad_cmp++;
+            if (snmp_oid_ncompare(a, len1, b, len2, diff) != 0 ||
+                snmp_oid_ncompare(a, len1, b, len2, diff + 1) != expect)
+                bad_ncmp++;
+            if (snmp_oidtree_compare(a, len1, b, len2) !=
+                (diff < min_len ? 1 : 0))
+                bad_tree++;
+            if (netsnmp_oid_equals(a, len1, b, len2) != (expect != 0))
+                bad_eq++;
+            if (min_len &&
+                netsnmp_oid_find_prefix(a, len1, b, len2) != (int)diff)
+                bad_prefix++;
+            if (netsnmp_oid_compare_ll(a, len1, b, len2, &off) != expect ||
+                off != diff + 1)
+                bad_ll++;
+        }
+    }
+}
+
+OKF(bad_cmp == 0, ("snmp_oid_compare: %d mismatches", bad_cmp));
+OKF(bad_ncmp == 0, ("snmp_oid_ncompare: %d mismatches", bad_ncmp));
+OKF(bad_tree == 0, ("snmp_oidtree_compare: %d mismatches", bad_tree));
+OKF(bad_eq == 0, ("netsnmp_oid_equals: %d mismatches", bad_eq));
+OKF(bad_prefix == 0, ("netsnmp_oid_find_prefix: %d mismatches", bad_prefix));
+OKF(bad_ll == 0, ("netsnmp_oid_compare_ll: %d mismatches", bad_ll));
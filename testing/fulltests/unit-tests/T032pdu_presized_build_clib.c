@@ -0,0 +1,154 @@
+/* HEADER Presized PDU building */
+
+/*
+ * Build the same PDUs with the reverse encoder and with the presized
+ * encoder and check that the packets are byte for byte identical.  The
+ * presized encoder starts with a tiny buffer, and both start with a few
+ * bytes already at the top of it which must be left alone.
+ */
+#if !defined(NETSNMP_DISABLE_SNMPV2C) && !defined(NETSNMP_DISABLE_SNMPV1) && \
+    defined(NETSNMP_USE_REVERSE_ASNENCODING)
+netsnmp_pdu        *pdu;
+netsnmp_session     session, *ss;
+u_char             *rbuf, *pbuf, *str;
+size_t              rbuf_len, pbuf_len, roff, poff;
+oid                 name[] = { 1, 3, 6, 1, 4, 1, 8072, 9999, 1, 0 };
+oid                 ent[] = { 1, 3, 6, 1, 4, 1, 8072, 4 };
+oid                 big[] = { 2, 999, 0x7f, 0x80, 0x3fff, 0x4000, 0xffffffff };
+long                ival[] = { 0, 127, 128, -128, -129, 0x7fffffff, -1 };
+u_long              uval[] = { 0, 0x7f, 0x80, 0xff, 0x8000, 0xffffffff };
+struct counter64    c64;
+int                 kind, i, rc1, rc2;
+
+init_snmp("testing");
+snmp_sess_init(&session);
+session.version = SNMP_VERSION_2c;
+session.peername = strdup("udp:127.0.0.1"); /* we won't actually connect */
+session.community = (u_char *) strdup("public");
+session.community_len = strlen((char *) session.community);
+ss = snmp_open(&session);
+OKF((ss != NULL), ("Creating a session failed"));
+
+str = malloc(70000);
+for (i = 0; i < 70000; i++)
+    str[i] = (u_char) i;
+
+for (kind = 0; ss && kind < 5; kind++) {
+    switch (kind) {
+    case 0:                    /* one of each type */
+        pdu = snmp_pdu_create(SNMP_MSG_GET);
+        for (i = 0; i < sizeof(ival) / sizeof(ival[0]); i++)
+            snmp_pdu_add_variable(pdu, name, OID_LENGTH(name), ASN_INTEGER,
+                                  &ival[i], sizeof(ival[i]));
+        for (i = 0; i < sizeof(uval) / sizeof(uval[0]); i++)
+            snmp_pdu_add_variable(pdu, name, OID_LENGTH(name),
+                                  i % 2 ? ASN_COUNTER : ASN_TIMETICKS,
+                                  &uval[i], sizeof(uval[i]));
+        for (i = 0; i < 3; i++) {
+            c64.high = i ? 0x80000000U >> (i - 1) * 31 : 0;
+            c64.low = 0xffffffffU >> i;
+            snmp_pdu_add_variable(pdu, name, OID_LENGTH(name), ASN_COUNTER64,
+                                  &c64, sizeof(c64));
+        }
+        snmp_pdu_add_variable(pdu, big, OID_LENGTH(big), ASN_OBJECT_ID,
+                              big, sizeof(big));
+        snmp_pdu_add_variable(pdu, name, OID_LENGTH(name), ASN_OBJECT_ID,
+                              big, sizeof(oid));
+        snmp_pdu_add_variable(pdu, name, OID_LENGTH(name), ASN_IPADDRESS,
+                              str, 4);
+        snmp_pdu_add_variable(pdu, name, OID_LENGTH(name), ASN_OCTET_STR,
+                              str, 0);
+        snmp_pdu_add_variable(pdu, name, OID_LENGTH(name), ASN_NULL, NULL, 0);
+        snmp_pdu_add_variable(pdu, name, OID_LENGTH(name),
+                              SNMP_NOSUCHINSTANCE, NULL, 0);
+        snmp_pdu_add_variable(pdu, name, OID_LENGTH(name), ASN_BIT_STR,
+                              str, 3);
+        pdu->version = SNMP_VERSION_2c;
+        break;
+    case 1:                    /* SNMPv1 trap */
+        pdu = snmp_pdu_create(SNMP_MSG_TRAP);
+        pdu->enterprise = netsnmp_memdup(ent, sizeof(ent));
+        pdu->enterprise_length = OID_LENGTH(ent);
+        memcpy(pdu->agent_addr, "\x7f\x00\x00\x01", 4);
+        pdu->trap_type = SNMP_TRAP_ENTERPRISESPECIFIC;
+        pdu->specific_type = -5;
+        pdu->time = 0x80000000U;
+        snmp_pdu_add_variable(pdu, name, OID_LENGTH(name), ASN_OCTET_STR,
+                              str, 200);
+        pdu->version = SNMP_VERSION_1;
+        break;
+    case 2:                    /* more varbinds than the size cache */
+        pdu = snmp_pdu_create(SNMP_MSG_TRAP2);
+        for (i = 0; i < 100; i++) {
+            name[OID_LENGTH(name) - 1] = i * 1000;
+            snmp_pdu_add_variable(pdu, name, OID_LENGTH(name),
+                                  ASN_OCTET_STR, str, i);
+        }
+        pdu->version = SNMP_VERSION_2c;
+        break;
+    case 3:                    /* three byte lengths */
+        pdu = snmp_pdu_create(SNMP_MSG_SET);
+        snmp_pdu_add_variable(pdu, name, OID_LENGTH(name), ASN_OCTET_STR,
+                              str, 70000);
+        pdu->reqid = -2;
+        pdu->version = SNMP_VERSION_2c;
+        break;
+    default:
+        pdu = snmp_pdu_create(SNMP_MSG_RESPONSE);
+        pdu->errstat = SNMP_ERR_GENERR;
+        pdu->errindex = 200;
+        pdu->version = SNMP_VERSION_2c;
+        break;
+    }
+
+    rbuf_len = 4096;
+    rbuf = malloc(rbuf_len);
+    memcpy(rbuf + rbuf_len - 3, "top", 3);
+    roff = 3;
+    netsnmp_ds_set_boolean(NETSNMP_DS_LIBRARY_ID,
+                           NETSNMP_DS_LIB_PRESIZED_ENCODE, 0);
+    rc1 = snmp_build(&rbuf, &rbuf_len, &roff, ss, pdu);
+
+    pbuf_len = 8;
+    pbuf = malloc(pbuf_len);
+    memcpy(pbuf + pbuf_len - 3, "top", 3);
+    poff = 3;
+    netsnmp_ds_set_boolean(NETSNMP_DS_LIBRARY_ID,
+                           NETSNMP_DS_LIB_PRESIZED_ENCODE, 1);
+    rc2 = snmp_build(&pbuf, &pbuf_len, &poff, ss, pdu);
+
+    OKF(rc1 == 0 && rc2 == 0,
+        ("kind %d: both encoders succeed (%d, %d)", kind, rc1, rc2));
+    OKF(roff == poff && pbuf_len == poff &&
+        memcmp(rbuf + rbuf_len - roff, pbuf + pbuf_len - poff, roff) == 0,
+        ("kind %d: presized packet of %" NETSNMP_PRIz "u bytes matches",
+         kind, poff));
+
+    free(rbuf);
+    free(pbuf);
+    snmp_free_pdu(pdu);
+}
+
+/* a value that can't be encoded must fail rather than write anything */
+pdu = snmp_pdu_create(SNMP_MSG_GET);
+pdu->version = SNMP_VERSION_2c;
+big[0] = 3;
+snmp_pdu_add_variable(pdu, big, OID_LENGTH(big), ASN_NULL, NULL, 0);
+pbuf_len = 8;
+pbuf = malloc(pbuf_len);
+poff = 0;
+OK(ss && snmp_build(&pbuf, &pbuf_len, &poff, ss, pdu) != 0 && poff == 0,
+   "bad OID is refused");
+free(pbuf);
+snmp_free_pdu(pdu);
+
+netsnmp_ds_set_boolean(NETSNMP_DS_LIBRARY_ID,
+                       NETSNMP_DS_LIB_PRESIZED_ENCODE, 0);
+free(str);
+if (ss)
+    snmp_close(ss);
+netsnmp_cleanup_session(&session);
+snmp_shutdown("testing");
+#else
+OK(1, "reverse encoding or community based SNMP not available");
+#endif
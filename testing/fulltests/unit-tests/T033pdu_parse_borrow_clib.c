@@ -0,0 +1,105 @@
+/* HEADER Parsing of PDUs with borrowed values */
+
+/*
+ * Large values parsed with UCD_MSG_FLAG_BORROW_VARBINDS must point into
+ * the packet, and cloning, setting, materializing and freeing such
+ * varbinds must never touch the packet memory.
+ */
+#ifdef NETSNMP_USE_REVERSE_ASNENCODING
+netsnmp_pdu           *pdu, *parsed, *clone;
+netsnmp_variable_list *vp;
+oid                    name[] = { 1, 3, 6, 1, 2, 1, 1, 1, 0 };
+u_char                 str[200], packet[1024], *end, *buf;
+size_t                 len, buf_len, offset;
+long                   ival = 42;
+int                    i, rc, nborrowed;
+
+for (i = 0; i < sizeof(str); i++)
+    str[i] = (u_char) (i + 1);
+
+pdu = snmp_pdu_create(SNMP_MSG_GET);
+snmp_pdu_add_variable(pdu, name, OID_LENGTH(name), ASN_OCTET_STR, str, 100);
+snmp_pdu_add_variable(pdu, name, OID_LENGTH(name), ASN_OCTET_STR, str, 10);
+snmp_pdu_add_variable(pdu, name, OID_LENGTH(name), ASN_BIT_STR, str, 60);
+snmp_pdu_add_variable(pdu, name, OID_LENGTH(name), ASN_INTEGER, &ival,
+                      sizeof(ival));
+buf_len = 64;
+buf = malloc(buf_len);
+offset = 0;
+rc = snmp_pdu_realloc_rbuild(&buf, &buf_len, &offset, pdu);
+OK(rc && offset <= sizeof(packet), "built the test PDU");
+memcpy(packet, buf + buf_len - offset, offset);
+end = packet + offset;
+free(buf);
+
+len = end - packet;
+parsed = SNMP_MALLOC_TYPEDEF(netsnmp_pdu);
+parsed->flags |= UCD_MSG_FLAG_BORROW_VARBINDS;
+rc = snmp_pdu_parse(parsed, packet, &len);
+OKF(rc == 0, ("parsed the test PDU: %d", rc));
+
+nborrowed = 0;
+for (vp = parsed->variables; vp; vp = vp->next_variable) {
+    if (vp->flags & NETSNMP_VARBIND_BORROWED) {
+        nborrowed++;
+        if (vp->val.string < packet || vp->val.string >= end)
+            nborrowed = -100;
+    }
+}
+OKF(nborrowed == 2, ("large string and bitstring are borrowed (%d)",
+                     nborrowed));
+vp = parsed->variables;
+OK(vp && vp->val_len == 100 && memcmp(vp->val.string, str, 100) == 0,
+   "borrowed string has the right value");
+OK(vp && vp->name == vp->name_loc &&
+   snmp_oid_compare(vp->name, vp->name_length, name, OID_LENGTH(name)) == 0,
+   "name is parsed into the varbind");
+vp = vp ? vp->next_variable : NULL;
+OK(vp && !(vp->flags & NETSNMP_VARBIND_BORROWED) &&
+   vp->val.string == vp->buf, "small string is copied into the varbind");
+
+clone = snmp_clone_pdu(parsed);
+OK(clone != NULL, "cloned the parsed PDU");
+nborrowed = 0;
+for (vp = clone ? clone->variables : NULL; vp; vp = vp->next_variable)
+    if ((vp->flags & NETSNMP_VARBIND_BORROWED) ||
+        (vp->val.string >= packet && vp->val.string < end))
+        nborrowed++;
+OKF(nborrowed == 0, ("clone owns all of its values (%d)", nborrowed));
+OK(clone && memcmp(clone->variables->val.string, str, 100) == 0,
+   "clone has the right value");
+
+/* replacing a borrowed value must not free the packet */
+vp = parsed->variables->next_variable->next_variable;
+rc = snmp_set_var_typed_value(vp, ASN_OCTET_STR, str, 150);
+OK(rc == 0 && !(vp->flags & NETSNMP_VARBIND_BORROWED) &&
+   memcmp(vp->val.string, str, 150) == 0, "borrowed value replaced");
+
+rc = snmp_varlist_materialize(parsed->variables);
+OK(rc == 0 && !(parsed->variables->flags & NETSNMP_VARBIND_BORROWED) &&
+   (parsed->variables->val.string < packet ||
+    parsed->variables->val.string >= end) &&
+   memcmp(parsed->variables->val.string, str, 100) == 0,
+   "materialized value is a copy");
+
+/* the eager path is unchanged */
+len = end - packet;
+snmp_free_pdu(clone);
+clone = SNMP_MALLOC_TYPEDEF(netsnmp_pdu);
+rc = snmp_pdu_parse(clone, packet, &len);
+OK(rc == 0 && !(clone->variables->flags & NETSNMP_VARBIND_BORROWED) &&
+   (clone->variables->val.string < packet ||
+    clone->variables->val.string >= end), "values are copied by default");
+
+/* scribbling over the packet must not affect the owned copies */
+memset(packet, 0, sizeof(packet));
+OK(memcmp(parsed->variables->val.string, str, 100) == 0 &&
+   memcmp(clone->variables->val.string, str, 100) == 0,
+   "copies survive the packet");
+
+snmp_free_pdu(clone);
+snmp_free_pdu(parsed);
+snmp_free_pdu(pdu);
+#else
+OK(1, "reverse encoding is needed to build the test packet");
+#endif
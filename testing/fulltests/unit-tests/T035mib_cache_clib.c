@@ -0,0 +1,144 @@
+/* HEADER Compiled MIB cache */
+
+/*
+ * Load all MIBs, write them to a compiled cache and check that loading
+ * the cache gives back the same tree, label hash chains and textual
+ * conventions, and that the cache is refused when the key differs, a
+ * listed path changes or the file is damaged.
+ */
+#define HASH_INT(v) (h = h * 31 + (u_long) (v))
+#define HASH_STR(str) do {                                      \
+        const char *cp_ = (str);                                \
+        HASH_INT(cp_ != NULL);                                  \
+        for (; cp_ && *cp_; cp_++)                              \
+            HASH_INT(*cp_);                                     \
+    } while (0)
+char               mibdir[PATH_MAX], *cache, *damaged, *tmpdir, *paths;
+char               buf[4096];
+struct tree       *tp, *found;
+struct enum_list  *ep;
+struct range_list *rp;
+struct index_list *ip;
+u_long             h, sum[2], nodes[2];
+FILE              *in, *out;
+size_t             n;
+int                pass, i, rc;
+
+snprintf(mibdir, sizeof(mibdir), "%s/%s", ABS_SRCDIR, "mibs");
+netsnmp_ds_set_string(NETSNMP_DS_LIBRARY_ID, NETSNMP_DS_LIB_MIBDIRS, mibdir);
+netsnmp_ds_set_boolean(NETSNMP_DS_LIBRARY_ID, NETSNMP_DS_LIB_SAVE_MIB_DESCRS,
+                       1);
+setenv("MIBS", "ALL", 1);
+if (asprintf(&cache, "/tmp/mib-cache-%d", getpid()) < 0 ||
+    asprintf(&damaged, "%s.damaged", cache) < 0 ||
+    asprintf(&tmpdir, "%s.dir", cache) < 0 ||
+    asprintf(&paths, "%s%s%s", mibdir, ENV_SEPARATOR, tmpdir) < 0)
+    return 1;
+mkdirhier(tmpdir, 0700, 0);
+
+init_snmp("T035");
+
+for (pass = 0; pass < 2; pass++) {
+    if (pass == 1) {
+        shutdown_mib();
+        netsnmp_init_mib_internals();
+        rc = netsnmp_mib_cache_load(cache, "test");
+        OKF(rc == 0, ("loaded the cache: %d", rc));
+    }
+
+    /* hash every node in preorder, and what a lookup by label finds */
+    h = 0;
+    nodes[pass] = 0;
+    for (tp = get_tree_head(); tp; ) {
+        nodes[pass]++;
+        HASH_STR(tp->label);
+        HASH_INT(tp->subid);
+        HASH_INT(tp->modid);
+        HASH_INT(tp->number_modules);
+        for (i = 0; i < tp->number_modules; i++)
+            HASH_INT(tp->module_list[i]);
+        HASH_INT(tp->type);
+        HASH_INT(tp->access);
+        HASH_INT(tp->status);
+        HASH_INT(tp->tc_index);
+        if (tp->tc_index >= 0)
+            HASH_STR(get_tc_descriptor(tp->tc_index));
+        for (ep = tp->enums; ep; ep = ep->next) {
+            HASH_INT(ep->value);
+            HASH_STR(ep->label);
+        }
+        for (rp = tp->ranges; rp; rp = rp->next) {
+            HASH_INT(rp->low);
+            HASH_INT(rp->high);
+        }
+        for (ip = tp->indexes; ip; ip = ip->next) {
+            HASH_STR(ip->ilabel);
+            HASH_INT(ip->isimplied);
+        }
+        HASH_STR(tp->augments);
+        HASH_STR(tp->hint);
+        HASH_STR(tp->units);
+        HASH_STR(tp->description);
+        HASH_STR(tp->reference);
+        HASH_STR(tp->defaultValue);
+        HASH_INT(tp->printomat != NULL);
+        found = find_tree_node(tp->label, -1);
+        HASH_INT(found ? found->subid : 0);
+        HASH_INT(found ? found->modid : 0);
+
+        if (tp->child_list) {
+            tp = tp->child_list;
+        } else {
+            while (tp && !tp->next_peer)
+                tp = tp->parent;
+            if (tp)
+                tp = tp->next_peer;
+        }
+    }
+    sum[pass] = h;
+
+    if (pass == 0) {
+        rc = netsnmp_mib_cache_save(cache, "test", paths);
+        OKF(rc == 0, ("saved %lu nodes to the cache: %d", nodes[0], rc));
+    }
+}
+OKF(nodes[0] > 1000 && nodes[0] == nodes[1],
+    ("cache has all %lu nodes (%lu)", nodes[0], nodes[1]));
+OK(sum[0] == sum[1], "cached tree is identical");
+OK(netsnmp_mib_cache_load(cache, "test") != 0,
+   "cache isn't loaded over loaded MIBs");
+
+shutdown_mib();
+netsnmp_init_mib_internals();
+OK(netsnmp_mib_cache_load(cache, "other") != 0 &&
+   get_tree_head() && get_tree_head()->child_list == NULL,
+   "cache is refused for another key");
+
+/* a damaged cache must be refused without touching the tree */
+in = fopen(cache, "rb");
+out = fopen(damaged, "wb");
+if (in && out) {
+    for (i = 0; (n = fread(buf, 1, sizeof(buf), in)) > 0 && i < 40; i++)
+        fwrite(buf, 1, n, out);
+}
+if (in)
+    fclose(in);
+if (out)
+    fclose(out);
+OK(netsnmp_mib_cache_load(damaged, "test") != 0 &&
+   get_tree_head() && get_tree_head()->child_list == NULL,
+   "truncated cache is refused");
+
+rmdir(tmpdir);
+OK(netsnmp_mib_cache_load(cache, "test") != 0,
+   "cache is refused when a listed path changes");
+
+unlink(cache);
+unlink(damaged);
+free(paths);
+free(tmpdir);
+free(damaged);
+free(cache);
+snmp_shutdown("T035");
+#undef HASH_STR
+#undef HASH_INT
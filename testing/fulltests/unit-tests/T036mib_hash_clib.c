@@ -0,0 +1,87 @@
+/* HEADER MIB parser symbol tables */
+
+/*
+ * Read a generated MIB with thousands of nodes, whose labels are pairwise
+ * anagrams, and a few hundred textual conventions, and check that every
+ * node and every TC reference is found again.
+ */
+#define NTC   300
+#define NNODE 3000
+char           mibdir[PATH_MAX], *file, label[64], parent[64];
+struct tree   *tp;
+FILE          *fp;
+const char    *descr;
+int            i, j, found, tcs;
+
+snprintf(mibdir, sizeof(mibdir), "%s/%s", ABS_SRCDIR, "mibs");
+netsnmp_ds_set_string(NETSNMP_DS_LIBRARY_ID, NETSNMP_DS_LIB_MIBDIRS, mibdir);
+if (asprintf(&file, "/tmp/SYNTH-HASH-MIB-%d.txt", getpid()) < 0)
+    return 1;
+init_snmp("T036");
+
+fp = fopen(file, "w");
+OK(fp != NULL, "created the test MIB");
+if (!fp)
+    return 1;
+fprintf(fp, "SYNTH-HASH-MIB DEFINITIONS ::= BEGIN\n"
+        "IMPORTS enterprises, OBJECT-TYPE, Integer32 FROM SNMPv2-SMI\n"
+        "        TEXTUAL-CONVENTION FROM SNMPv2-TC;\n"
+        "synthHash OBJECT IDENTIFIER ::= { enterprises 99991 }\n");
+for (i = 0; i < NTC; i++)
+    fprintf(fp, "SynthTc%dAb ::= TEXTUAL-CONVENTION\n"
+            "    DISPLAY-HINT \"d\"\n    STATUS current\n"
+            "    DESCRIPTION \"tc\"\n    SYNTAX Integer32\n", i);
+/* children are written before their parents */
+for (i = NNODE - 1; i >= 0; i--) {
+    if (i < 10)
+        strcpy(parent, "synthHash");
+    else
+        snprintf(parent, sizeof(parent), "ab%d", i / 10 - 1);
+    fprintf(fp, "ab%d OBJECT IDENTIFIER ::= { %s %d }\n", i, parent,
+            i % 10 * 2 + 1);
+    fprintf(fp, "ba%d OBJECT-TYPE\n    SYNTAX SynthTc%dAb\n"
+            "    MAX-ACCESS read-only\n    STATUS current\n"
+            "    DESCRIPTION \"node\"\n    ::= { %s %d }\n",
+            i, i % NTC, parent, i % 10 * 2 + 2);
+}
+fprintf(fp, "END\n");
+fclose(fp);
+
+OK(read_mib(file) != NULL, "read the test MIB");
+
+found = tcs = 0;
+for (i = 0; i < NNODE; i++) {
+    if (i < 10)
+        strcpy(parent, "synthHash");
+    else
+        snprintf(parent, sizeof(parent), "ab%d", i / 10 - 1);
+    for (j = 0; j < 2; j++) {
+        snprintf(label, sizeof(label), j ? "ba%d" : "ab%d", i);
+        tp = find_tree_node(label, -1);
+        if (tp && strcmp(tp->label, label) == 0 &&
+            tp->subid == (u_long) (i % 10 * 2 + 1 + j) && tp->parent &&
+            strcmp(tp->parent->label, parent) == 0)
+            found++;
+        if (j && tp) {
+            descr = get_tc_descriptor(tp->tc_index);
+            snprintf(label, sizeof(label), "SynthTc%dAb", i % NTC);
+            if (descr && strcmp(descr, label) == 0 &&
+                tp->type == TYPE_INTEGER32)
+                tcs++;
+        }
+    }
+}
+OKF(found == 2 * NNODE, ("found %d of %d nodes", found, 2 * NNODE));
+OKF(tcs == NNODE, ("found the TC of %d of %d objects", tcs, NNODE));
+OK(find_tree_node("ab0", which_module("SYNTH-HASH-MIB")) != NULL &&
+   find_tree_node("ab0", which_module("SNMPv2-SMI")) == NULL,
+   "lookups honour the module");
+OK(find_tree_node("ab", -1) == NULL && find_tree_node("a0b", -1) == NULL,
+   "near misses aren't found");
+OK(find_tree_node("sysDescr", -1) != NULL, "standard MIB nodes are found");
+
+unlink(file);
+free(file);
+snmp_shutdown("T036");
+#undef NNODE
+#undef NTC
@@ -0,0 +1,147 @@
+/* HEADER Parallel MIB loading */
+
+/*
+ * Load all MIBs as usual, then again with the modules prefetched on
+ * threads, and check that both give the same tree and the same textual
+ * conventions.  Also check a module which the parser needs to tokenize
+ * into small buffers, and prefetching a list of modules.
+ */
+#define HASH_INT(v) (h = h * 31 + (u_long) (v))
+#define HASH_STR(str) do {                                      \
+        const char *cp_ = (str);                                \
+        HASH_INT(cp_ != NULL);                                  \
+        for (; cp_ && *cp_; cp_++)                              \
+            HASH_INT(*cp_);                                     \
+    } while (0)
+char               mibdir[PATH_MAX], *file;
+struct tree       *tp;
+struct enum_list  *ep;
+struct range_list *rp;
+struct index_list *ip;
+FILE              *fp;
+const char        *names[] = { "IF-MIB", "SYNTH-PREFETCH-MIB" };
+u_long             h, sum[4], nodes[4];
+int                pass, i, errors[4];
+
+snprintf(mibdir, sizeof(mibdir), "%s/%s", ABS_SRCDIR, "mibs");
+netsnmp_ds_set_string(NETSNMP_DS_LIBRARY_ID, NETSNMP_DS_LIB_MIBDIRS, mibdir);
+netsnmp_ds_set_boolean(NETSNMP_DS_LIBRARY_ID, NETSNMP_DS_LIB_SAVE_MIB_DESCRS,
+                       1);
+if (asprintf(&file, "/tmp/SYNTH-PREFETCH-MIB-%d.txt", getpid()) < 0)
+    return 1;
+
+/*
+ * long labels and strings, hex and binary constants, comments and a
+ * string left open at the end of the file
+ */
+fp = fopen(file, "w");
+OK(fp != NULL, "created the test MIB");
+if (!fp)
+    return 1;
+fprintf(fp, "SYNTH-PREFETCH-MIB DEFINITIONS ::= BEGIN\n"
+        "IMPORTS enterprises, OBJECT-TYPE, Integer32 FROM SNMPv2-SMI\n"
+        "        TEXTUAL-CONVENTION FROM SNMPv2-TC;\n"
+        "-- a comment -- -- and another\n"
+        "synthPrefetch OBJECT IDENTIFIER ::= { enterprises 99992 }\n"
+        "SynthHex ::= TEXTUAL-CONVENTION\n    STATUS current\n"
+        "    DESCRIPTION \"hex\"\n"
+        "    SYNTAX Integer32 { one('01'h), two('10'B), three('0F0F'H) }\n");
+fprintf(fp, "synthLong");
+for (i = 0; i < 300; i++)
+    fputc('x', fp);
+fprintf(fp, " OBJECT-TYPE\n    SYNTAX SynthHex\n"
+        "    MAX-ACCESS read-only\n    STATUS current\n"
+        "    DESCRIPTION \"");
+for (i = 0; i < 5000; i++)
+    fputc('a' + i % 26, fp);
+fprintf(fp, "\"\n    REFERENCE \"");
+for (i = 0; i < 200; i++)
+    fputc('r', fp);
+fprintf(fp, "\"\n    ::= { synthPrefetch 1 }\nEND\n\"open");
+fclose(fp);
+
+init_snmp("T037");
+netsnmp_ds_set_boolean(NETSNMP_DS_LIBRARY_ID, NETSNMP_DS_LIB_MIB_ERRORS, 0);
+for (pass = 0; pass < 4; pass++) {
+    shutdown_mib();
+    netsnmp_init_mib_internals();
+    add_mibdir(mibdir);
+    add_mibfile(file, NULL);
+    errors[pass] = get_mib_parse_error_count();
+    if (pass == 1 || pass == 3)
+        netsnmp_mib_prefetch(NULL, 0, 4);
+    if (pass < 2) {
+        read_all_mibs();
+    } else {
+        if (pass == 3)
+            netsnmp_mib_prefetch(names, 2, 2);
+        for (i = 0; i < 2; i++)
+            netsnmp_read_module(names[i]);
+        adopt_orphans();
+    }
+    netsnmp_mib_prefetch_done();
+    errors[pass] = get_mib_parse_error_count() - errors[pass];
+
+    h = 0;
+    nodes[pass] = 0;
+    for (tp = get_tree_head(); tp; ) {
+        nodes[pass]++;
+        HASH_STR(tp->label);
+        HASH_INT(tp->subid);
+        HASH_INT(tp->modid);
+        HASH_INT(tp->type);
+        HASH_INT(tp->access);
+        HASH_INT(tp->status);
+        HASH_INT(tp->tc_index);
+        if (tp->tc_index >= 0)
+            HASH_STR(get_tc_descriptor(tp->tc_index));
+        for (ep = tp->enums; ep; ep = ep->next) {
+            HASH_INT(ep->value);
+            HASH_STR(ep->label);
+        }
+        for (rp = tp->ranges; rp; rp = rp->next) {
+            HASH_INT(rp->low);
+            HASH_INT(rp->high);
+        }
+        for (ip = tp->indexes; ip; ip = ip->next)
+            HASH_STR(ip->ilabel);
+        HASH_STR(tp->augments);
+        HASH_STR(tp->hint);
+        HASH_STR(tp->units);
+        HASH_STR(tp->description);
+        HASH_STR(tp->reference);
+        HASH_STR(tp->defaultValue);
+
+        if (tp->child_list) {
+            tp = tp->child_list;
+        } else {
+            while (tp && !tp->next_peer)
+                tp = tp->parent;
+            if (tp)
+                tp = tp->next_peer;
+        }
+    }
+    sum[pass] = h;
+}
+OKF(nodes[0] > 1000 && nodes[0] == nodes[1],
+    ("all %lu nodes are loaded with threads (%lu)", nodes[0], nodes[1]));
+OK(sum[0] == sum[1], "prefetched tree is identical");
+OKF(nodes[2] > 100 && nodes[2] < nodes[0] && nodes[2] == nodes[3],
+    ("listed modules give %lu nodes with threads (%lu)", nodes[2], nodes[3]));
+OK(sum[2] == sum[3], "prefetched listed modules are identical");
+OKF(errors[0] > 0 && errors[0] == errors[1] && errors[2] == errors[3],
+    ("parser reports the same problems (%d %d %d %d)", errors[0], errors[1],
+     errors[2], errors[3]));
+
+tp = find_tree_node("synthPrefetch", -1);
+OK(tp && tp->child_list && tp->child_list->subid == 1 &&
+   strlen(tp->child_list->label) == MAXTOKEN - 1 &&
+   tp->child_list->description &&
+   strlen(tp->child_list->description) == MAXQUOTESTR - 1,
+   "long tokens are truncated as when read from the file");
+
+unlink(file);
+free(file);
+snmp_shutdown("T037");
+#undef HASH_STR
+#undef HASH_INT
@@ -0,0 +1,108 @@
+/* HEADER Lazy MIB loading */
+
+/*
+ * Load some MIBs, which writes a MIB index, then load them again lazily
+ * and check that only the modules which lookups need are read, and that
+ * OIDs translate as with all modules loaded.
+ */
+#define NOIDS 5
+char               mibdir[PATH_MAX], *idxfile, buf[NOIDS][256], out[256];
+const char        *labels[] = { "ifDescr.1", "SNMPv2-MIB::sysDescr.0",
+                                "hrStorageSize.7" };
+oid                oids[NOIDS][MAX_OID_LEN], name[MAX_OID_LEN];
+oid                numeric[NOIDS][9] = {
+    { 1, 3, 6, 1, 2, 1, 1, 3, 0 },
+    { 1, 3, 6, 1, 2, 1, 31, 1, 1 },
+    { 1, 3, 6, 1, 4, 1, 2021, 4, 5 },
+    { 1, 3, 6, 1, 2, 1, 25, 4, 2 },
+    { 1, 3, 6, 1, 2, 1, 2, 2, 1 },
+};
+size_t             lens[NOIDS], len;
+struct tree       *tp;
+FILE              *fp;
+u_long             nodes[4];
+int                pass, i, same;
+
+snprintf(mibdir, sizeof(mibdir), "%s/%s", ABS_SRCDIR, "mibs");
+netsnmp_ds_set_string(NETSNMP_DS_LIBRARY_ID, NETSNMP_DS_LIB_MIBDIRS, mibdir);
+setenv("MIBS", "SNMPv2-MIB:IF-MIB:HOST-RESOURCES-MIB:UCD-SNMP-MIB", 1);
+if (asprintf(&idxfile, "/tmp/mib-index-%d", getpid()) < 0)
+    return 1;
+netsnmp_ds_set_boolean(NETSNMP_DS_LIBRARY_ID, NETSNMP_DS_LIB_MIB_LAZY_LOAD, 1);
+netsnmp_ds_set_string(NETSNMP_DS_LIBRARY_ID, NETSNMP_DS_LIB_MIB_INDEX_FILE,
+                      idxfile);
+
+init_snmp("T038");
+fp = fopen(idxfile, "rb");
+OK(fp != NULL, "wrote the MIB index");
+if (fp)
+    fclose(fp);
+
+for (pass = 0; pass < 4; pass++) {
+    if (pass == 1 || pass == 2) {
+        shutdown_mib();
+        netsnmp_init_mib();
+        OKF(find_tree_node("ifDescr", -1) == NULL &&
+            find_tree_node("sysDescr", -1) == NULL,
+            ("no modules are read up front (pass %d)", pass));
+    } else if (pass == 3) {
+        /* another MIB list doesn't match the index */
+        setenv("MIBS", "SNMPv2-MIB:IF-MIB:HOST-RESOURCES-MIB", 1);
+        shutdown_mib();
+        netsnmp_init_mib();
+    }
+    if (pass < 2) {
+        same = 0;
+        for (i = 0; i < 3; i++) {
+            len = MAX_OID_LEN;
+            if (!(i == 1 ? read_objid(labels[i], name, &len) :
+                  get_node(labels[i], name, &len)))
+                continue;
+            if (pass == 0) {
+                memcpy(oids[i], name, len * sizeof(oid));
+                lens[i] = len;
+                same++;
+            } else if (!snmp_oid_compare(oids[i], lens[i], name, len)) {
+                same++;
+            }
+        }
+        OKF(same == 3, ("labels are found (%d of 3)", same));
+        same = 0;
+        for (i = 0; i < NOIDS; i++) {
+            snprint_objid(pass ? out : buf[i], sizeof(out), numeric[i], 9);
+            if (pass == 0 ? strstr(buf[i], "::") != NULL :
+                strcmp(out, buf[i]) == 0)
+                same++;
+        }
+        OKF(same == NOIDS, ("OIDs translate the same (%d of %d)", same,
+                            NOIDS));
+    }
+    if (pass == 2) {
+        tp = get_tree(numeric[2], 9, get_tree_head());
+        OK(tp && !strcmp(tp->label, "memTotalReal") &&
+           find_tree_node("ifDescr", -1) == NULL,
+           "get_tree() reads only the module it needs");
+    }
+
+    nodes[pass] = 0;
+    for (tp = get_tree_head(); tp; ) {
+        nodes[pass]++;
+        if (tp->child_list) {
+            tp = tp->child_list;
+        } else {
+            while (tp && !tp->next_peer)
+                tp = tp->parent;
+            if (tp)
+                tp = tp->next_peer;
+        }
+    }
+}
+OKF(nodes[2] < nodes[0] && nodes[1] <= nodes[0],
+    ("one lookup reads %lu of the %lu nodes", nodes[2], nodes[0]));
+OKF(nodes[3] > nodes[2] && find_tree_node("ifDescr", -1) != NULL,
+    ("index isn't used for other MIBs (%lu nodes)", nodes[3]));
+
+unlink(idxfile);
+free(idxfile);
+snmp_shutdown("T038");
+#undef NOIDS
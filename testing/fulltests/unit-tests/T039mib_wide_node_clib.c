@@ -0,0 +1,85 @@
+/* HEADER Lookups below MIB nodes with many children */
+
+/*
+ * Read a MIB with a node that has thousands of children, defined out of
+ * order, and check that every child is found by OID, also after another
+ * module has added a child and has been unloaded again.
+ */
+#define NCHILD 3000
+char           mibdir[PATH_MAX], *file, *file2, buf[256], label[64];
+oid            name[] = { 1, 3, 6, 1, 4, 1, 99993, 0 };
+int            label_of[NCHILD + 2];
+struct tree   *tp;
+FILE          *fp;
+int            i, found, printed;
+
+snprintf(mibdir, sizeof(mibdir), "%s/%s", ABS_SRCDIR, "mibs");
+netsnmp_ds_set_string(NETSNMP_DS_LIBRARY_ID, NETSNMP_DS_LIB_MIBDIRS, mibdir);
+if (asprintf(&file, "/tmp/SYNTH-WIDE-MIB-%d.txt", getpid()) < 0 ||
+    asprintf(&file2, "/tmp/SYNTH-WIDE2-MIB-%d.txt", getpid()) < 0)
+    return 1;
+init_snmp("T039");
+
+fp = fopen(file, "w");
+OK(fp != NULL, "created the test MIB");
+if (!fp)
+    return 1;
+fprintf(fp, "SYNTH-WIDE-MIB DEFINITIONS ::= BEGIN\n"
+        "IMPORTS enterprises FROM SNMPv2-SMI;\n"
+        "synthWide OBJECT IDENTIFIER ::= { enterprises 99993 }\n");
+for (i = 0; i < NCHILD; i++) {
+    name[7] = (i * 7919) % NCHILD + 1;
+    label_of[name[7]] = i;
+    fprintf(fp, "w%d OBJECT IDENTIFIER ::= { synthWide %d }\n", i,
+            (int) name[7]);
+}
+fprintf(fp, "END\n");
+fclose(fp);
+
+fp = fopen(file2, "w");
+if (fp) {
+    fprintf(fp, "SYNTH-WIDE2-MIB DEFINITIONS ::= BEGIN\n"
+            "IMPORTS synthWide FROM SYNTH-WIDE-MIB;\n"
+            "wExtra OBJECT IDENTIFIER ::= { synthWide %d }\n"
+            "END\n", NCHILD + 1);
+    fclose(fp);
+}
+
+OK(read_mib(file) != NULL, "read the test MIB");
+
+found = printed = 0;
+for (i = 1; i <= NCHILD; i++) {
+    name[7] = i;
+    snprintf(label, sizeof(label), "w%d", label_of[i]);
+    tp = get_tree(name, OID_LENGTH(name), get_tree_head());
+    if (tp && tp->subid == (u_long) i && !strcmp(tp->label, label))
+        found++;
+    snprint_objid(buf, sizeof(buf), name, OID_LENGTH(name));
+    if (!strcmp(buf, label) || (strstr(buf, "::") &&
+                                !strcmp(strstr(buf, "::") + 2, label)))
+        printed++;
+}
+OKF(found == NCHILD, ("get_tree() finds %d of %d children", found, NCHILD));
+OKF(printed == NCHILD, ("%d of %d children are printed by name", printed,
+                        NCHILD));
+
+name[7] = NCHILD + 1;
+tp = get_tree(name, OID_LENGTH(name), get_tree_head());
+OK(tp && !strcmp(tp->label, "synthWide"), "unknown child gives the parent");
+read_mib(file2);
+tp = get_tree(name, OID_LENGTH(name), get_tree_head());
+OK(tp && !strcmp(tp->label, "wExtra"), "child added later is found");
+netsnmp_unload_module("SYNTH-WIDE2-MIB");
+tp = get_tree(name, OID_LENGTH(name), get_tree_head());
+OK(tp && !strcmp(tp->label, "synthWide"), "unloaded child is gone");
+name[7] = 1;
+tp = get_tree(name, OID_LENGTH(name), get_tree_head());
+OK(tp && tp->subid == 1 && tp->parent && tp->parent->child_list &&
+   !strcmp(tp->parent->label, "synthWide"), "other children are kept");
+
+unlink(file);
+unlink(file2);
+free(file);
+free(file2);
+snmp_shutdown("T039");
+#undef NCHILD
@@ -0,0 +1,127 @@
+/* HEADER Memo of OID and name translations */
+
+/*
+ * Print and read OIDs with the memo of recent translations turned off
+ * and on, and check that they come out the same, that repeated ones are
+ * answered by the memo, and that loading a MIB or changing the output
+ * options is taken into account.
+ */
+#define NOIDS 6
+char               mibdir[PATH_MAX], *file, out[2][NOIDS][256], buf[256];
+const char        *names[] = { "SNMPv2-MIB::sysUpTime.0", "ifDescr.7",
+                               "IF-MIB::ifInOctets.12",
+                               "TCP-MIB::tcpConnState.10.0.0.1.161.10.0.0.2.3333" };
+oid                oids[NOIDS][MAX_OID_LEN], name[MAX_OID_LEN];
+size_t             lens[NOIDS], len;
+oid                synth[] = { 1, 3, 6, 1, 4, 1, 99994, 1, 0 };
+netsnmp_mib_memo_stats before, after;
+FILE              *fp;
+int                pass, i, round, same;
+
+snprintf(mibdir, sizeof(mibdir), "%s/%s", ABS_SRCDIR, "mibs");
+netsnmp_ds_set_string(NETSNMP_DS_LIBRARY_ID, NETSNMP_DS_LIB_MIBDIRS, mibdir);
+setenv("MIBS", "SNMPv2-MIB:IF-MIB:TCP-MIB:SNMP-VIEW-BASED-ACM-MIB", 1);
+if (asprintf(&file, "/tmp/SYNTH-MEMO-MIB-%d.txt", getpid()) < 0)
+    return 1;
+init_snmp("T040");
+
+/* scalars, integer and address indexes, a string index, unknown OIDs */
+for (i = 0; i < 4; i++) {
+    lens[i] = MAX_OID_LEN;
+    if (!get_node(names[i], oids[i], &lens[i]))
+        lens[i] = 0;
+}
+lens[4] = MAX_OID_LEN;
+read_objid(".1.3.6.1.6.3.16.1.4.1.4.3.97.98.99.2.3", oids[4], &lens[4]);
+lens[5] = MAX_OID_LEN;
+read_objid(".1.3.6.1.4.1.99994.1.0", oids[5], &lens[5]);
+OKF(lens[0] == 9 && lens[1] == 11 && lens[2] == 11 && lens[3] == 20 &&
+    lens[4] == 17 && lens[5] == 9, ("OIDs are read (%d %d %d %d %d %d)",
+                                    (int) lens[0], (int) lens[1],
+                                    (int) lens[2], (int) lens[3],
+                                    (int) lens[4], (int) lens[5]));
+
+for (pass = 0; pass < 2; pass++) {
+    netsnmp_ds_set_int(NETSNMP_DS_LIBRARY_ID, NETSNMP_DS_LIB_MIB_MEMO_SIZE,
+                       pass ? 0 : -1);
+    for (round = 0; round < 3; round++)
+        for (i = 0; i < NOIDS; i++)
+            snprint_objid(out[pass][i], sizeof(out[pass][i]), oids[i],
+                          lens[i]);
+}
+same = 0;
+for (i = 0; i < NOIDS; i++)
+    if (!strcmp(out[0][i], out[1][i]))
+        same++;
+OKF(same == NOIDS, ("OIDs print the same with the memo (%d of %d)", same,
+                    NOIDS));
+OKF(!strcmp(out[1][0], "SNMPv2-MIB::sysUpTime.0") &&
+    !strcmp(out[1][4], "SNMP-VIEW-BASED-ACM-MIB::vacmAccessContextMatch.\"abc\".2.3"),
+    ("scalars and indexes are printed (%s, %s)", out[1][0], out[1][4]));
+
+/* other instances of a remembered object */
+netsnmp_mib_memo_get_stats(&before);
+oids[1][10] = 8;
+snprint_objid(buf, sizeof(buf), oids[1], lens[1]);
+netsnmp_mib_memo_get_stats(&after);
+OKF(!strcmp(buf, "IF-MIB::ifDescr.8") &&
+    after.oid_hits == before.oid_hits + 1,
+    ("another instance comes from the memo (%s)", buf));
+
+netsnmp_ds_set_int(NETSNMP_DS_LIBRARY_ID, NETSNMP_DS_LIB_OID_OUTPUT_FORMAT,
+                   NETSNMP_OID_OUTPUT_NUMERIC);
+snprint_objid(buf, sizeof(buf), oids[1], lens[1]);
+OKF(!strcmp(buf, ".1.3.6.1.2.1.2.2.1.2.8"),
+    ("output options are taken into account (%s)", buf));
+netsnmp_ds_set_int(NETSNMP_DS_LIBRARY_ID, NETSNMP_DS_LIB_OID_OUTPUT_FORMAT,
+                   0);
+oids[1][10] = 7;
+
+/* names read the same, and again from the memo */
+same = 0;
+netsnmp_mib_memo_get_stats(&before);
+for (round = 0; round < 2; round++)
+    for (i = 0; i < 4; i++) {
+        len = MAX_OID_LEN;
+        if (get_node(names[i], name, &len) &&
+            !snmp_oid_compare(name, len, oids[i], lens[i]))
+            same++;
+    }
+netsnmp_mib_memo_get_stats(&after);
+OKF(same == 8 && after.name_hits >= before.name_hits + 4,
+    ("names are read the same (%d of 8, %lu hits)", same,
+     after.name_hits - before.name_hits));
+len = 2;
+OK(!get_node(names[0], name, &len), "a short buffer is still refused");
+
+/* a MIB which adds to the tree drops what was remembered */
+fp = fopen(file, "w");
+if (fp) {
+    fprintf(fp, "SYNTH-MEMO-MIB DEFINITIONS ::= BEGIN\n"
+            "IMPORTS enterprises FROM SNMPv2-SMI;\n"
+            "synthMemo OBJECT IDENTIFIER ::= { enterprises 99994 }\n"
+            "synthMemoLeaf OBJECT IDENTIFIER ::= { synthMemo 1 }\n"
+            "END\n");
+    fclose(fp);
+}
+len = MAX_OID_LEN;
+OK(!get_node("synthMemoLeaf", name, &len),
+   "unknown name isn't found");
+netsnmp_mib_memo_get_stats(&before);
+OK(read_mib(file) != NULL, "read the test MIB");
+snprint_objid(buf, sizeof(buf), synth, OID_LENGTH(synth));
+netsnmp_mib_memo_get_stats(&after);
+OKF(!strcmp(buf, "SYNTH-MEMO-MIB::synthMemoLeaf.0") &&
+    after.flushes == before.flushes + 1,
+    ("new MIB objects are printed (%s)", buf));
+len = MAX_OID_LEN;
+OK(get_node("synthMemoLeaf", name, &len) && len == 8,
+   "new MIB objects are read");
+netsnmp_unload_module("SYNTH-MEMO-MIB");
+snprint_objid(buf, sizeof(buf), synth, OID_LENGTH(synth));
+OKF(!strcmp(buf, out[1][5]), ("unloaded objects are gone (%s)", buf));
+
+unlink(file);
+free(file);
+snmp_shutdown("T040");
+#undef NOIDS
@@ -0,0 +1,120 @@
+/* HEADER Printing values with chosen output options */
+
+/*
+ * Print values of several types, with and without DISPLAY-HINTs, and check
+ * the text, also when printed a second time, and that options chosen with
+ * netsnmp_print_options_use() apply without changing those in the default
+ * store.
+ */
+char               mibdir[PATH_MAX], buf[256];
+const char        *names[] = { "IF-MIB::ifPhysAddress.1",
+                               "HOST-RESOURCES-MIB::hrSystemDate.0",
+                               "IF-MIB::ifInOctets.1",
+                               "SNMPv2-MIB::sysUpTime.0",
+                               "IF-MIB::ifAdminStatus.1",
+                               "IP-MIB::ipAdEntAddr.10.0.0.255" };
+const char        *expect[] = { "STRING: 0:1b:21:a:4f:5e",
+                                "STRING: 2026-10-19,13:5:7.0",
+                                "Counter32: 4294967295",
+                                "Timeticks: (987654321) 114 days, 7:29:03.21",
+                                "INTEGER: up(1)",
+                                "IpAddress: 10.0.0.255" };
+u_char             mac[] = { 0, 0x1b, 0x21, 0x0a, 0x4f, 0x5e };
+u_char             date[] = { 7, 0xea, 10, 19, 13, 5, 7, 0 };
+u_char             ip[] = { 10, 0, 0, 255 };
+long               ivals[] = { 0, 0, 0xffffffffL, 987654321, 1, 0 };
+oid                names_oid[6][MAX_OID_LEN];
+size_t             lens[6], out_len, buf_len;
+netsnmp_variable_list vars[6];
+netsnmp_print_options opts;
+u_char            *rbuf;
+int                i, pass, same;
+u_int              generation;
+
+snprintf(mibdir, sizeof(mibdir), "%s/%s", ABS_SRCDIR, "mibs");
+netsnmp_ds_set_string(NETSNMP_DS_LIBRARY_ID, NETSNMP_DS_LIB_MIBDIRS, mibdir);
+setenv("MIBS", "SNMPv2-MIB:IF-MIB:IP-MIB:HOST-RESOURCES-MIB", 1);
+init_snmp("T041");
+
+memset(vars, 0, sizeof(vars));
+for (i = 0; i < 6; i++) {
+    lens[i] = MAX_OID_LEN;
+    if (!read_objid(names[i], names_oid[i], &lens[i]))
+        lens[i] = 0;
+    vars[i].val.integer = &ivals[i];
+    vars[i].val_len = sizeof(ivals[i]);
+}
+vars[0].type = ASN_OCTET_STR;
+vars[0].val.string = mac;
+vars[0].val_len = sizeof(mac);
+vars[1].type = ASN_OCTET_STR;
+vars[1].val.string = date;
+vars[1].val_len = sizeof(date);
+vars[2].type = ASN_COUNTER;
+vars[3].type = ASN_TIMETICKS;
+vars[4].type = ASN_INTEGER;
+vars[5].type = ASN_IPADDRESS;
+vars[5].val.string = ip;
+vars[5].val_len = sizeof(ip);
+
+/* printing again gives the same text */
+for (pass = 0; pass < 2; pass++) {
+    for (i = 0, same = 0; i < 6; i++) {
+        snprint_value(buf, sizeof(buf), names_oid[i], lens[i], &vars[i]);
+        if (lens[i] && !strcmp(buf, expect[i]))
+            same++;
+        else
+            fprintf(stdout, "# %s: got \"%s\"\n", names[i], buf);
+    }
+    OKF(same == 6, ("pass %d: %d of 6 values are printed as expected",
+                    pass, same));
+}
+
+/* hints given directly, longer than is parsed on the stack, and bad */
+buf_len = 256;
+rbuf = (u_char *) malloc(buf_len);
+out_len = 0;
+sprint_realloc_octet_string(&rbuf, &buf_len, &out_len, 1, &vars[1], NULL,
+                            "1d.1d.1d.1d.1d.1d.1d.1d", NULL);
+OKF(!strcmp((char *) rbuf, "STRING: 7.234.10.19.13.5.7.0"),
+    ("long hint: %s", rbuf));
+out_len = 0;
+sprint_realloc_octet_string(&rbuf, &buf_len, &out_len, 1, &vars[0], NULL,
+                            "1q", NULL);
+OKF(!strncmp((char *) rbuf, "(Bad hint ignored: 1q) ", 23),
+    ("bad hint: %s", rbuf));
+free(rbuf);
+
+/* chosen options apply, and leave the default store alone */
+netsnmp_print_options_init(&opts);
+opts.quick_print = 1;
+opts.hex_2digit = 1;
+OK(netsnmp_print_options_use(&opts) == NULL, "no options chosen before");
+snprint_value(buf, sizeof(buf), names_oid[0], lens[0], &vars[0]);
+OKF(!strcmp(buf, "00:1b:21:0a:4f:5e"), ("quick print: %s", buf));
+OK(!netsnmp_ds_get_boolean(NETSNMP_DS_LIBRARY_ID,
+                           NETSNMP_DS_LIB_QUICK_PRINT),
+   "default store is unchanged");
+OK(netsnmp_print_options_use(NULL) == &opts, "chosen options are returned");
+snprint_value(buf, sizeof(buf), names_oid[2], lens[2], &vars[2]);
+OKF(!strcmp(buf, expect[2]), ("default options again: %s", buf));
+
+/* changes to the default store are followed */
+netsnmp_ds_set_boolean(NETSNMP_DS_LIBRARY_ID, NETSNMP_DS_LIB_QUICK_PRINT, 1);
+snprint_value(buf, sizeof(buf), names_oid[3], lens[3], &vars[3]);
+OKF(!strcmp(buf, "114:7:29:03.21"), ("store changed: %s", buf));
+netsnmp_ds_set_boolean(NETSNMP_DS_LIBRARY_ID, NETSNMP_DS_LIB_QUICK_PRINT, 0);
+
+/* setting a value the store already has is not a change */
+generation = netsnmp_ds_generation();
+netsnmp_ds_set_boolean(NETSNMP_DS_LIBRARY_ID, NETSNMP_DS_LIB_QUICK_PRINT, 0);
+netsnmp_ds_set_int(NETSNMP_DS_LIBRARY_ID, NETSNMP_DS_LIB_OID_OUTPUT_FORMAT,
+                   netsnmp_ds_get_int(NETSNMP_DS_LIBRARY_ID,
+                                      NETSNMP_DS_LIB_OID_OUTPUT_FORMAT));
+netsnmp_ds_set_string(NETSNMP_DS_LIBRARY_ID, NETSNMP_DS_LIB_MIBDIRS, mibdir);
+OK(netsnmp_ds_generation() == generation, "same values leave the options");
+netsnmp_ds_set_boolean(NETSNMP_DS_LIBRARY_ID, NETSNMP_DS_LIB_QUICK_PRINT, 1);
+OK(netsnmp_ds_generation() != generation, "a new value changes them");
+netsnmp_ds_set_boolean(NETSNMP_DS_LIBRARY_ID, NETSNMP_DS_LIB_QUICK_PRINT, 0);
+
+snmp_shutdown("T041");
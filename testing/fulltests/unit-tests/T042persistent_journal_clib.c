@@ -0,0 +1,133 @@
+/* HEADER Persistent state in a journal */
+
+/*
+ * Save rows of a persistent "T042" type with persistentJournal set, save
+ * again with one row changed, and check that only the change is appended,
+ * that the rows are read back, also after the end of the journal has been
+ * damaged, and that turning the journal off and on converts to and from
+ * the text file.
+ */
+#define NROWS 10
+char            dir[PATH_MAX], journal[PATH_MAX], text[PATH_MAX];
+char            tokens[NROWS][16], line[64];
+const char     *value;
+long            size1 = 0, size2, size3;
+FILE           *fp;
+int             i, pass, same;
+
+snprintf(dir, sizeof(dir), "/tmp/T042-%d", getpid());
+snprintf(journal, sizeof(journal), "%s/T042.journal", dir);
+snprintf(text, sizeof(text), "%s/T042.conf", dir);
+snprintf(line, sizeof(line), "%s/x", dir);
+mkdirhier(line, 0700, 1);
+set_persistent_directory(dir);
+setenv("SNMPCONFPATH", dir, 1);
+netsnmp_ds_set_boolean(NETSNMP_DS_LIBRARY_ID,
+                       NETSNMP_DS_LIB_PERSISTENT_JOURNAL, 1);
+for (i = 0; i < NROWS; i++) {
+    snprintf(tokens[i], sizeof(tokens[i]), "t042row%d", i);
+    netsnmp_ds_register_config(ASN_OCTET_STR, "T042", tokens[i],
+                               NETSNMP_DS_APPLICATION_ID, i);
+}
+
+/* a first save, and a second one with row 5 changed */
+for (pass = 0; pass < 2; pass++) {
+    snmp_save_persistent("T042");
+    for (i = 0; i < NROWS; i++) {
+        snprintf(line, sizeof(line), "%s value%d%s", tokens[i], i,
+                 pass && i == 5 ? "-changed" : "");
+        read_config_store("T042", line);
+    }
+    snmp_clean_persistent("T042");
+    fp = fopen(journal, "rb");
+    size2 = -1;
+    if (fp) {
+        fseek(fp, 0, SEEK_END);
+        size2 = ftell(fp);
+        fclose(fp);
+    }
+    if (pass == 0)
+        size1 = size2;
+}
+fp = fopen(text, "r");
+OK(size1 > 0 && fp == NULL, "the rows are saved to the journal only");
+if (fp)
+    fclose(fp);
+OKF(size2 > size1 && size2 - size1 < size1 / 2,
+    ("the second save appends the change only (%ld, then %ld bytes)",
+     size1, size2));
+
+/* a line stored outside of a save, then read everything back */
+read_config_store("T042", "t042row9 appended");
+for (i = 0; i < NROWS; i++)
+    netsnmp_ds_set_string(NETSNMP_DS_APPLICATION_ID, i, NULL);
+read_config_files(NORMAL_CONFIG);
+for (i = 0, same = 0; i < NROWS; i++) {
+    value = netsnmp_ds_get_string(NETSNMP_DS_APPLICATION_ID, i);
+    snprintf(line, sizeof(line), "value%d%s", i, i == 5 ? "-changed" : "");
+    if (value && !strcmp(value, i == 9 ? "appended" : line))
+        same++;
+}
+OKF(same == NROWS, ("%d of %d rows are read back", same, NROWS));
+
+/* the damaged end of a journal is ignored, and then compacted away */
+fp = fopen(journal, "ab");
+if (fp) {
+    fwrite("\x20\0\0\0garbage", 1, 11, fp);
+    fclose(fp);
+}
+netsnmp_ds_set_string(NETSNMP_DS_APPLICATION_ID, 5, NULL);
+read_config_files(NORMAL_CONFIG);
+value = netsnmp_ds_get_string(NETSNMP_DS_APPLICATION_ID, 5);
+OK(value && !strcmp(value, "value5-changed"),
+   "rows are read from a journal with a damaged end");
+snmp_save_persistent("T042");
+read_config_store("T042", "t042row0 compacted");
+snmp_clean_persistent("T042");
+fp = fopen(journal, "rb");
+size3 = -1;
+if (fp) {
+    fseek(fp, 0, SEEK_END);
+    size3 = ftell(fp);
+    fclose(fp);
+}
+OKF(size3 > 0 && size3 < size1, ("the journal is rewritten (%ld bytes)",
+                                 size3));
+netsnmp_ds_set_string(NETSNMP_DS_APPLICATION_ID, 0, NULL);
+read_config_files(NORMAL_CONFIG);
+value = netsnmp_ds_get_string(NETSNMP_DS_APPLICATION_ID, 0);
+OK(value && !strcmp(value, "compacted"), "the rewritten journal is read");
+
+/* export to the text file, and import again */
+netsnmp_ds_set_boolean(NETSNMP_DS_LIBRARY_ID,
+                       NETSNMP_DS_LIB_PERSISTENT_JOURNAL, 0);
+snmp_save_persistent("T042");
+read_config_store("T042", "t042row1 exported");
+snmp_clean_persistent("T042");
+fp = fopen(journal, "rb");
+OK(fp == NULL, "saving to the text file removes the journal");
+if (fp)
+    fclose(fp);
+netsnmp_ds_set_boolean(NETSNMP_DS_LIBRARY_ID,
+                       NETSNMP_DS_LIB_PERSISTENT_JOURNAL, 1);
+netsnmp_ds_set_string(NETSNMP_DS_APPLICATION_ID, 1, NULL);
+read_config_files(NORMAL_CONFIG);
+value = netsnmp_ds_get_string(NETSNMP_DS_APPLICATION_ID, 1);
+OK(value && !strcmp(value, "exported"), "the text file is read");
+snmp_save_persistent("T042");
+read_config_store("T042", "t042row1 imported");
+snmp_clean_persistent("T042");
+fp = fopen(text, "r");
+OK(fp == NULL, "saving to the journal moves the text file away");
+if (fp)
+    fclose(fp);
+netsnmp_ds_set_string(NETSNMP_DS_APPLICATION_ID, 1, NULL);
+read_config_files(NORMAL_CONFIG);
+value = netsnmp_ds_get_string(NETSNMP_DS_APPLICATION_ID, 1);
+OK(value && !strcmp(value, "imported"), "the new journal is read");
+
+unlink(journal);
+unlink(text);
+rmdir(dir);
+unregister_all_config_handlers();
+#undef NROWS
@@ -0,0 +1,81 @@
+/* HEADER Config handler lookups and line reading */
+
+/*
+ * Register many tokens for a "T043" type, check that lookups ignore case
+ * and find the first of two tokens that differ only in case, also after
+ * it is unregistered, and read a generated file with long lines, lines
+ * that repeat a token and a last line without a newline.
+ */
+#define NTOKENS 40
+#define LONGLEN 20000
+char            file[PATH_MAX], tokens[NTOKENS][16], expect[NTOKENS][16];
+char           *longval;
+struct config_line *lptr;
+const char     *value;
+FILE           *fp;
+int             i, j, same;
+
+for (i = 0; i < NTOKENS; i++) {
+    snprintf(tokens[i], sizeof(tokens[i]), "t043Token%d", i);
+    netsnmp_ds_register_config(ASN_OCTET_STR, "T043", tokens[i],
+                               NETSNMP_DS_APPLICATION_ID, i);
+}
+register_config_handler("T043", "t043Dup", NULL, NULL, "first");
+register_config_handler("T043", "T043DUP", NULL, NULL, "second");
+
+lptr = read_config_find_handler(read_config_get_handlers("T043"),
+                                "T043TOKEN17");
+OK(lptr && !strcmp(lptr->config_token, "t043Token17"),
+   "lookups ignore case");
+lptr = read_config_find_handler(read_config_get_handlers("T043"),
+                                "t043token40");
+OK(lptr == NULL, "unknown tokens are not found");
+lptr = read_config_find_handler(read_config_get_handlers("T043"),
+                                "t043dup");
+OK(lptr && !strcmp(lptr->help, "first"),
+   "the first of two matching tokens is found");
+unregister_config_handler("T043", "t043Dup");
+lptr = read_config_find_handler(read_config_get_handlers("T043"),
+                                "t043dup");
+OK(lptr && !strcmp(lptr->help, "second"),
+   "the second token is found once the first is unregistered");
+unregister_config_handler("T043", "T043DUP");
+lptr = read_config_find_handler(read_config_get_handlers("T043"),
+                                "t043dup");
+OK(lptr == NULL, "neither is found once both are unregistered");
+
+/* every token three times, the last value wins, and two long lines */
+longval = (char *) malloc(LONGLEN + 1);
+memset(longval, 'x', LONGLEN);
+longval[LONGLEN] = '\0';
+snprintf(file, sizeof(file), "/tmp/T043-%d.conf", getpid());
+fp = fopen(file, "w");
+if (fp) {
+    fprintf(fp, "# %s\n", longval);
+    for (j = 0; j < 3; j++)
+        for (i = 0; i < NTOKENS; i++)
+            fprintf(fp, "%s value%d-%d\n", tokens[(i * 7) % NTOKENS], j, i);
+    fprintf(fp, "t043token1 %s   \n", longval);
+    fprintf(fp, "T043TOKEN2 last");
+    fclose(fp);
+}
+OK(read_config_with_type(file, "T043") == SNMPERR_SUCCESS, "file is read");
+for (i = 0; i < NTOKENS; i++)
+    snprintf(expect[(i * 7) % NTOKENS], sizeof(expect[0]), "value2-%d", i);
+for (i = 0, same = 0; i < NTOKENS; i++) {
+    value = netsnmp_ds_get_string(NETSNMP_DS_APPLICATION_ID, i);
+    if (i == 1)
+        same += value && !strcmp(value, longval);
+    else if (i == 2)
+        same += value && !strcmp(value, "last");
+    else
+        same += value && !strcmp(value, expect[i]);
+}
+OKF(same == NTOKENS, ("%d of %d tokens have their last value", same,
+                      NTOKENS));
+
+unlink(file);
+free(longval);
+unregister_all_config_handlers();
+#undef NTOKENS
+#undef LONGLEN
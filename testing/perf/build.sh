@@ -0,0 +1,43 @@
+#!/bin/sh -eu
+#
+# Build the benchmark drivers in this directory against a built tree.
+# The drivers link the static libraries, so configure with
+# --enable-static.  Run from the top of the build directory, or set
+# builddir; the drivers are written to $builddir/testing/perf.
+
+scriptdir=$(cd "$(dirname "$0")" && pwd)
+srcdir=$(cd "${scriptdir}/../.." && pwd)
+builddir=${builddir:-$(pwd)}
+
+if [ ! -f "${builddir}/snmplib/.libs/libnetsnmp.a" ]; then
+    echo "No static libnetsnmp in ${builddir} - not building the benchmarks"
+    exit 0
+fi
+
+CC=${CC:-$("${builddir}/net-snmp-config" --build-command)}
+# snmptrapd's formatting code needs the agent libraries too
+trapd=
+if [ -f "${builddir}/apps/.libs/libnetsnmptrapd.a" ] &&
+   [ -f "${builddir}/agent/.libs/libnetsnmpmibs.a" ]; then
+    trapd="${builddir}/apps/.libs/libnetsnmptrapd.a
+           ${builddir}/agent/.libs/libnetsnmpagent.a
+           ${builddir}/agent/.libs/libnetsnmpmibs.a
+           ${builddir}/agent/helpers/.libs/libnetsnmphelpers.a
+           ${builddir}/agent/.libs/libnetsnmpagent.a"
+fi
+libs=$(sed -n 's/^NSC_LNETSNMPLIBS="\(.*\)"$/\1/p' "${builddir}/net-snmp-config";
+       sed -n "s/^PERLLDOPTS_FOR_LIBS='\(.*\)'/\1/p" "${builddir}/config.log")
+mkdir -p "${builddir}/testing/perf"
+
+for bench in "${scriptdir}"/*_bench.c; do
+    name=$(basename "${bench}" .c)
+    if [ "${name}" = trapformat_bench ] && [ -z "${trapd}" ]; then
+        echo "No static snmptrapd libraries - not building ${name}"
+        continue
+    fi
+    echo "Compiling testing/perf/${name}.c"
+    # shellcheck disable=SC2086
+    $CC -I"${builddir}/include" -I"${srcdir}/include" -I"${srcdir}/apps" \
+        "${bench}" -o "${builddir}/testing/perf/${name}" \
+        ${trapd} "${builddir}/snmplib/.libs/libnetsnmp.a" ${libs}
+done
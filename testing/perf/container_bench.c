@@ -0,0 +1,116 @@
+/*
+ * container_bench.c: time the operations of a table container
+ *
+ * usage: container_bench TYPE N
+ *
+ * Fills a container of the given type (e.g. btree or binary_array)
+ * with N 10-subid, tcpConnectionTable-like indexes in random order, and
+ * times N finds, N find_nexts and N removes.  The churn phase removes
+ * an item, looks up another and puts the first back, N times, in a full
+ * container.  Times are in ms.
+ */
+#include <net-snmp/net-snmp-config.h>
+#include <net-snmp/net-snmp-includes.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/time.h>
+
+static double
+now_ms(void)
+{
+    struct timeval  tv;
+
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec * 1e3 + tv.tv_usec / 1e3;
+}
+
+int
+main(int argc, char **argv)
+{
+    netsnmp_container *c;
+    netsnmp_index  *items, *ip, key;
+    oid            *oids, *o;
+    int            *perm;
+    int             n, i, j, t, found;
+    double          t0, ins, fnd, nxt, rem, churn;
+
+    if (argc != 3 || (n = atoi(argv[2])) <= 0) {
+        fprintf(stderr, "usage: %s TYPE N\n", argv[0]);
+        return 1;
+    }
+
+    netsnmp_container_init_list();
+    c = netsnmp_container_find(argv[1]);
+    if (c == NULL) {
+        fprintf(stderr, "no container type %s\n", argv[1]);
+        return 1;
+    }
+    c->compare = netsnmp_compare_netsnmp_index;
+
+    items = calloc(n, sizeof(*items));
+    oids = calloc(n * 10, sizeof(oid));
+    perm = calloc(n, sizeof(int));
+    if (items == NULL || oids == NULL || perm == NULL)
+        return 1;
+    for (i = 0; i < n; i++) {
+        /* local address and port, remote address and port */
+        o = &oids[i * 10];
+        o[0] = 1; o[1] = 4; o[2] = 10; o[3] = 0;
+        o[4] = (i >> 8) & 255; o[5] = i & 255;
+        o[6] = 1024 + (i % 50000);
+        o[7] = 1; o[8] = 4; o[9] = i * 7919u % 65536;
+        items[i].oids = o;
+        items[i].len = 10;
+        perm[i] = i;
+    }
+    srandom(1);
+    for (i = n - 1; i > 0; i--) {
+        j = random() % (i + 1);
+        t = perm[i]; perm[i] = perm[j]; perm[j] = t;
+    }
+
+    t0 = now_ms();
+    for (i = 0; i < n; i++)
+        CONTAINER_INSERT(c, &items[perm[i]]);
+    ins = now_ms() - t0;
+
+    t0 = now_ms();
+    for (i = 0; i < n; i++) {
+        key = items[perm[(i * 31) % n]];
+        if (CONTAINER_FIND(c, &key) == NULL)
+            abort();
+    }
+    fnd = now_ms() - t0;
+
+    found = 0;
+    t0 = now_ms();
+    for (i = 0; i < n; i++)
+        found += CONTAINER_NEXT(c, &items[perm[i]]) != NULL;
+    nxt = now_ms() - t0;
+
+    t0 = now_ms();
+    for (i = 0; i < n; i++) {
+        ip = &items[perm[(i * 13) % n]];
+        CONTAINER_REMOVE(c, ip);
+        key = items[perm[(i * 31) % n]];
+        CONTAINER_FIND(c, &key);
+        CONTAINER_INSERT(c, ip);
+    }
+    churn = now_ms() - t0;
+
+    t0 = now_ms();
+    for (i = 0; i < n; i++)
+        CONTAINER_REMOVE(c, &items[perm[(i * 17) % n]]);
+    rem = now_ms() - t0;
+
+    printf("%s n=%d insert %.2f find %.2f next %.2f remove %.2f "
+           "churn %.2f ms (%d next, %d left)\n", argv[1], n, ins, fnd, nxt,
+           rem, churn, found, (int) CONTAINER_SIZE(c));
+
+    CONTAINER_FREE(c);
+    free(perm);
+    free(oids);
+    free(items);
+    return 0;
+}
@@ -0,0 +1,92 @@
+/*
+ * journal_bench.c: time saving and reading persistent state
+ *
+ * usage: journal_bench JOURNAL ROWS [read]
+ *
+ * With persistentJournal off (JOURNAL 0) or on (1), registers a
+ * STORE_DATA callback that writes ROWS lines about the size of a
+ * usmUser line, and times three snmp_store() calls; one line changes
+ * before the third.  The time init_snmp() takes to read the state back
+ * is printed first; with "read", nothing is saved.  Set
+ * SNMP_PERSISTENT_DIR to an empty directory on the file system to be
+ * measured, and run once to save and again with "read".
+ */
+#include <net-snmp/net-snmp-config.h>
+#include <net-snmp/net-snmp-includes.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+
+static int      nrows, changed, nread;
+
+static double
+now_ms(void)
+{
+    struct timeval  tv;
+
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec * 1e3 + tv.tv_usec / 1e3;
+}
+
+static int
+store_rows(int majorID, int minorID, void *serverarg, void *clientarg)
+{
+    char            line[SNMP_MAXBUF];
+    int             i;
+
+    for (i = 0; i < nrows; i++) {
+        snprintf(line, sizeof(line),
+                 "jrow 0x80001f8880c71fc1f0ab0c2e6900000000 0x%08x%s "
+                 ".1.3.6.1.6.3.10.1.1.3 .1.3.6.1.6.3.10.1.2.4 "
+                 "0x5a7c3b1e9d8f02461a3c5e7f9b0d2f4%d "
+                 "0x2b4d6f8193a5c7e9f0b2d4f6a8c0e2f4 \"\" 1 3",
+                 i, i == 7 && changed ? "ff" : "", i % 10);
+        read_config_store("journal_bench", line);
+    }
+    return SNMPERR_SUCCESS;
+}
+
+static void
+parse_row(const char *token, char *line)
+{
+    nread++;
+}
+
+int
+main(int argc, char **argv)
+{
+    const char     *mode;
+    double          t0;
+    int             journal, k;
+
+    if (argc < 3 || (nrows = atoi(argv[2])) <= 0) {
+        fprintf(stderr, "usage: %s JOURNAL ROWS [read]\n", argv[0]);
+        return 1;
+    }
+    journal = atoi(argv[1]);
+    mode = journal ? "journal" : "text";
+
+    register_config_handler("journal_bench", "jrow", parse_row, NULL, NULL);
+    netsnmp_ds_set_boolean(NETSNMP_DS_LIBRARY_ID,
+                           NETSNMP_DS_LIB_PERSISTENT_JOURNAL, journal);
+    t0 = now_ms();
+    init_snmp("journal_bench");
+    printf("%s: init_snmp() read %d rows in %.1f ms\n", mode, nread,
+           now_ms() - t0);
+    if (argc > 3)
+        return 0;
+
+    snmp_register_callback(SNMP_CALLBACK_LIBRARY, SNMP_CALLBACK_STORE_DATA,
+                           store_rows, NULL);
+    for (k = 0; k < 3; k++) {
+        changed = k == 2;
+        t0 = now_ms();
+        snmp_store("journal_bench");
+        printf("%s: save %d (%s) %.1f ms\n", mode, k + 1,
+               k == 0 ? "full state" : changed ? "one row changed" :
+               "unchanged", now_ms() - t0);
+    }
+    return 0;
+}
@@ -0,0 +1,135 @@
+/*
+ * mib_bench.c: time loading the MIBs and looking up their labels
+ *
+ * usage: mib_bench [-s] [RUNS]
+ *
+ * Loads every MIB in MIBDIRS (MIBS=ALL) RUNS times, 5 by default, and
+ * prints the best time and the peak RSS.  With -s, the MIB that the
+ * T036 unit test generates (3000 pairs of nodes with anagram labels
+ * and 300 textual conventions) is written to a temporary directory
+ * and loaded as well, and 60000 find_tree_node() lookups of its labels
+ * are timed.
+ */
+#include <net-snmp/net-snmp-config.h>
+#include <net-snmp/net-snmp-includes.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+
+#define NTC   300
+#define NNODE 3000
+
+static double
+now_ms(void)
+{
+    struct timeval  tv;
+
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec * 1e3 + tv.tv_usec / 1e3;
+}
+
+static int
+write_synth_mib(const char *dir)
+{
+    char            file[PATH_MAX], parent[64];
+    FILE           *fp;
+    int             i;
+
+    snprintf(file, sizeof(file), "%s/SYNTH-HASH-MIB.txt", dir);
+    if ((fp = fopen(file, "w")) == NULL)
+        return -1;
+    fprintf(fp, "SYNTH-HASH-MIB DEFINITIONS ::= BEGIN\n"
+            "IMPORTS enterprises, OBJECT-TYPE, Integer32 FROM SNMPv2-SMI\n"
+            "        TEXTUAL-CONVENTION FROM SNMPv2-TC;\n"
+            "synthHash OBJECT IDENTIFIER ::= { enterprises 99991 }\n");
+    for (i = 0; i < NTC; i++)
+        fprintf(fp, "SynthTc%dAb ::= TEXTUAL-CONVENTION\n"
+                "    DISPLAY-HINT \"d\"\n    STATUS current\n"
+                "    DESCRIPTION \"tc\"\n    SYNTAX Integer32\n", i);
+    /* children are written before their parents */
+    for (i = NNODE - 1; i >= 0; i--) {
+        if (i < 10)
+            strcpy(parent, "synthHash");
+        else
+            snprintf(parent, sizeof(parent), "ab%d", i / 10 - 1);
+        fprintf(fp, "ab%d OBJECT IDENTIFIER ::= { %s %d }\n", i, parent,
+                i % 10 * 2 + 1);
+        fprintf(fp, "ba%d OBJECT-TYPE\n    SYNTAX SynthTc%dAb\n"
+                "    MAX-ACCESS read-only\n    STATUS current\n"
+                "    DESCRIPTION \"node\"\n    ::= { %s %d }\n",
+                i, i % NTC, parent, i % 10 * 2 + 2);
+    }
+    fprintf(fp, "END\n");
+    return fclose(fp);
+}
+
+int
+main(int argc, char **argv)
+{
+    char            tmpdir[] = "/tmp/mib_bench.XXXXXX";
+    char            dirs[PATH_MAX * 2], file[PATH_MAX], label[32];
+    const char     *mibdirs;
+    struct rusage   ru;
+    int             synth = 0, runs = 5, i, k, hits;
+    double          t0, t, best = 1e9;
+
+    if (argc > 1 && strcmp(argv[1], "-s") == 0) {
+        synth = 1;
+        argc--;
+        argv++;
+    }
+    if (argc > 1)
+        runs = atoi(argv[1]);
+    if (runs <= 0) {
+        fprintf(stderr, "usage: mib_bench [-s] [RUNS]\n");
+        return 1;
+    }
+
+    if (synth) {
+        if (mkdtemp(tmpdir) == NULL || write_synth_mib(tmpdir) != 0) {
+            perror(tmpdir);
+            return 1;
+        }
+        mibdirs = getenv("MIBDIRS");
+        snprintf(dirs, sizeof(dirs), "%s:%s",
+                 mibdirs ? mibdirs : netsnmp_get_mib_directory(), tmpdir);
+        setenv("MIBDIRS", dirs, 1);
+    }
+    setenv("MIBS", "ALL", 1);
+
+    for (i = 0; i < runs; i++) {
+        t0 = now_ms();
+        netsnmp_init_mib();
+        t = now_ms() - t0;
+        if (t < best)
+            best = t;
+        if (i + 1 < runs)
+            shutdown_mib();
+    }
+    getrusage(RUSAGE_SELF, &ru);
+    printf("read_all_mibs best of %d: %.1f ms, peak RSS %ld KB\n", runs,
+           best, ru.ru_maxrss);
+
+    if (synth) {
+        hits = 0;
+        t0 = now_ms();
+        for (i = 0; i < 10; i++)
+            for (k = 0; k < NNODE; k++) {
+                snprintf(label, sizeof(label), "ab%d", k);
+                hits += find_tree_node(label, -1) != NULL;
+                snprintf(label, sizeof(label), "ba%d", k);
+                hits += find_tree_node(label, -1) != NULL;
+            }
+        printf("%d find_tree_node: %.1f ms, %d found\n", 20 * NNODE,
+               now_ms() - t0, hits);
+        snprintf(file, sizeof(file), "%s/SYNTH-HASH-MIB.txt", tmpdir);
+        unlink(file);
+        rmdir(tmpdir);
+    }
+    shutdown_mib();
+    return 0;
+}
@@ -0,0 +1,62 @@
+/*
+ * oidcmp_bench.c: time snmp_oid_compare()
+ *
+ * usage: oidcmp_bench [COUNT]
+ *
+ * Compares two OIDs of the same length that differ only in their last
+ * sub-identifier, as in a walk of long table indexes, COUNT times
+ * (2000000 by default) for each of several lengths.  The best of 5
+ * runs is printed, in ns per compare.
+ */
+#include <net-snmp/net-snmp-config.h>
+#include <net-snmp/net-snmp-includes.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/time.h>
+
+static double
+now_ms(void)
+{
+    struct timeval  tv;
+
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec * 1e3 + tv.tv_usec / 1e3;
+}
+
+int
+main(int argc, char **argv)
+{
+    static const int lens[] = { 8, 12, 24, 64, 128 };
+    oid             a[MAX_OID_LEN], b[MAX_OID_LEN];
+    int             count = argc > 1 ? atoi(argv[1]) : 2000000;
+    int             li, i, len, r;
+    long            sum;
+    double          t0, t, best;
+
+    if (count <= 0) {
+        fprintf(stderr, "usage: %s [COUNT]\n", argv[0]);
+        return 1;
+    }
+    for (i = 0; i < MAX_OID_LEN; i++)
+        a[i] = b[i] = i % 7 + 1;
+
+    for (li = 0; li < (int) (sizeof(lens) / sizeof(lens[0])); li++) {
+        len = lens[li];
+        b[len - 1] = a[len - 1] + 1;
+        best = 1e9;
+        sum = 0;
+        for (r = 0; r < 5; r++) {
+            t0 = now_ms();
+            for (i = 0; i < count; i++)
+                sum += snmp_oid_compare(a, len, b, len);
+            t = now_ms() - t0;
+            if (t < best)
+                best = t;
+        }
+        b[len - 1] = a[len - 1];
+        printf("length %3d: %6.1f ns/compare (%ld)\n", len,
+               best * 1e6 / count, sum);
+    }
+    return 0;
+}
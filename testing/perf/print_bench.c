@@ -0,0 +1,105 @@
+/*
+ * print_bench.c: time snprint_value()
+ *
+ * usage: print_bench [COUNT]
+ *
+ * Loads IF-MIB, HOST-RESOURCES-MIB, IP-MIB and SNMPv2-MIB from MIBDIRS
+ * and prints eight values of common types COUNT times each (200000 by
+ * default) with the default output options.  The best of 5 runs is
+ * printed, in ns per call.
+ */
+#include <net-snmp/net-snmp-config.h>
+#include <net-snmp/net-snmp-includes.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/time.h>
+
+#define NVALS 8
+
+static double
+now_ms(void)
+{
+    struct timeval  tv;
+
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec * 1e3 + tv.tv_usec / 1e3;
+}
+
+int
+main(int argc, char **argv)
+{
+    static const u_char mac[] = { 0x00, 0x1b, 0x21, 0x3c, 0x4d, 0x5e };
+    static const u_char date[] = { 0x07, 0xea, 10, 19, 6, 34, 41, 0,
+                                   '+', 0, 0 };
+    static const u_char ip[] = { 192, 168, 1, 254 };
+    static const char *names[NVALS] = {
+        "IF-MIB::ifPhysAddress.2",
+        "HOST-RESOURCES-MIB::hrSystemDate.0",
+        "IF-MIB::ifInOctets.2",
+        "SNMPv2-MIB::sysUpTime.0",
+        "IP-MIB::ipAdEntAddr.192.168.1.254",
+        "IF-MIB::ifOperStatus.2",
+        "IF-MIB::ifSpeed.2",
+        "IF-MIB::ifMtu.2"
+    };
+    static const u_char types[NVALS] = {
+        ASN_OCTET_STR, ASN_OCTET_STR, ASN_COUNTER, ASN_TIMETICKS,
+        ASN_IPADDRESS, ASN_INTEGER, ASN_GAUGE, ASN_INTEGER
+    };
+    u_long          counter = 3123456789UL, ticks = 123456789;
+    u_long          gauge = 1000000000;
+    long            oper = 1, mtu = 1500;
+    const void     *vals[NVALS];
+    size_t          lens[NVALS];
+    netsnmp_variable_list *vars[NVALS];
+    oid             name[MAX_OID_LEN];
+    size_t          name_len;
+    char            buf[512];
+    int             count = argc > 1 ? atoi(argv[1]) : 200000;
+    int             i, k, r;
+    double          t0, t, best;
+
+    if (count <= 0) {
+        fprintf(stderr, "usage: %s [COUNT]\n", argv[0]);
+        return 1;
+    }
+    vals[0] = mac;      lens[0] = sizeof(mac);
+    vals[1] = date;     lens[1] = sizeof(date);
+    vals[2] = &counter; lens[2] = sizeof(counter);
+    vals[3] = &ticks;   lens[3] = sizeof(ticks);
+    vals[4] = ip;       lens[4] = sizeof(ip);
+    vals[5] = &oper;    lens[5] = sizeof(oper);
+    vals[6] = &gauge;   lens[6] = sizeof(gauge);
+    vals[7] = &mtu;     lens[7] = sizeof(mtu);
+
+    setenv("MIBS", "IF-MIB:HOST-RESOURCES-MIB:IP-MIB:SNMPv2-MIB", 1);
+    init_snmp("print_bench");
+    for (k = 0; k < NVALS; k++) {
+        name_len = MAX_OID_LEN;
+        if (!read_objid(names[k], name, &name_len)) {
+            fprintf(stderr, "%s: not found in MIBDIRS\n", names[k]);
+            return 1;
+        }
+        vars[k] = NULL;
+        snmp_varlist_add_variable(&vars[k], name, name_len, types[k],
+                                  vals[k], lens[k]);
+    }
+
+    for (k = 0; k < NVALS; k++) {
+        best = 1e9;
+        for (r = 0; r < 5; r++) {
+            t0 = now_ms();
+            for (i = 0; i < count; i++)
+                snprint_value(buf, sizeof(buf), vars[k]->name,
+                              vars[k]->name_length, vars[k]);
+            t = now_ms() - t0;
+            if (t < best)
+                best = t;
+        }
+        printf("%-36s %6.0f ns  %s\n", names[k], best * 1e6 / count, buf);
+        snmp_free_varbind(vars[k]);
+    }
+    snmp_shutdown("print_bench");
+    return 0;
+}
@@ -0,0 +1,155 @@
+/*
+ * trapformat_bench.c: time formatting notifications as snmptrapd does
+ *
+ * usage: trapformat_bench MODE [COUNT]
+ *
+ * Formats an SNMPv2c notification with four varbinds from 192.0.2.1,
+ * COUNT times (100000 by default), with each of snmptrapd's built-in
+ * SNMPv2 formats.  MODE "string" formats from the string into a new
+ * buffer each time, as realloc_format_trap() callers do; "compiled"
+ * compiles the format once and keeps the output and scratch buffers,
+ * as the syslog, print and execute handlers do.  Addresses are printed
+ * numerically.  The best of 5 runs is printed, in notifications per
+ * second.
+ */
+#include <net-snmp/net-snmp-config.h>
+#include <net-snmp/net-snmp-includes.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+
+#include "snmptrapd_log.h"
+
+static const char *formats[][2] = {
+    { "print",   "%.4y-%.2m-%.2l %.2h:%.2j:%.2k %B [%b]:\n%v\n" },
+    { "syslog",  "%B [%b]: Trap %#v\n" },
+    { "execute", "%B\n%b\n%V\n%v\n" },
+    { "header",  "%.4y-%.2m-%.2l %.2h:%.2j:%.2k %B [%b]:\n" }
+};
+
+static double
+now_ms(void)
+{
+    struct timeval  tv;
+
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec * 1e3 + tv.tv_usec / 1e3;
+}
+
+static netsnmp_pdu *
+make_notification(void)
+{
+    static oid      trapoid_oid[] = { 1, 3, 6, 1, 6, 3, 1, 1, 4, 1, 0 };
+    static oid      uptime_oid[] = { 1, 3, 6, 1, 2, 1, 1, 3, 0 };
+    static oid      link_oid[] = { 1, 3, 6, 1, 6, 3, 1, 1, 5, 3 };
+    static oid      ifindex_oid[] = { 1, 3, 6, 1, 2, 1, 2, 2, 1, 1, 2 };
+    static oid      ifdescr_oid[] = { 1, 3, 6, 1, 2, 1, 2, 2, 1, 2, 2 };
+    static const char descr[] = "GigabitEthernet0/1/2";
+    netsnmp_indexed_addr_pair *addr;
+    netsnmp_pdu    *pdu;
+    u_long          ticks = 123456789;
+    long            ifindex = 2;
+
+    pdu = snmp_pdu_create(SNMP_MSG_TRAP2);
+    pdu->version = SNMP_VERSION_2c;
+    snmp_pdu_add_variable(pdu, uptime_oid, OID_LENGTH(uptime_oid),
+                          ASN_TIMETICKS, &ticks, sizeof(ticks));
+    snmp_pdu_add_variable(pdu, trapoid_oid, OID_LENGTH(trapoid_oid),
+                          ASN_OBJECT_ID, link_oid, sizeof(link_oid));
+    snmp_pdu_add_variable(pdu, ifindex_oid, OID_LENGTH(ifindex_oid),
+                          ASN_INTEGER, &ifindex, sizeof(ifindex));
+    snmp_pdu_add_variable(pdu, ifdescr_oid, OID_LENGTH(ifdescr_oid),
+                          ASN_OCTET_STR, descr, strlen(descr));
+
+    addr = SNMP_MALLOC_TYPEDEF(netsnmp_indexed_addr_pair);
+    if (addr == NULL)
+        return NULL;
+    addr->remote_addr.sin.sin_family = AF_INET;
+    addr->remote_addr.sin.sin_port = htons(1162);
+    addr->remote_addr.sin.sin_addr.s_addr = htonl(0xc0000201);
+    pdu->transport_data = addr;
+    pdu->transport_data_length = sizeof(*addr);
+    return pdu;
+}
+
+int
+main(int argc, char **argv)
+{
+    netsnmp_transport *transport;
+    netsnmp_trapd_format *fmt;
+    netsnmp_pdu    *pdu;
+    u_char         *buf = NULL, *scratch = NULL;
+    size_t          buf_len = 0, scratch_len = 0, out_len = 0;
+    int             compiled, count, f, i, r;
+    double          t0, t, best;
+
+    if (argc < 2 || (strcmp(argv[1], "string") != 0 &&
+                     strcmp(argv[1], "compiled") != 0) ||
+        (count = argc > 2 ? atoi(argv[2]) : 100000) <= 0) {
+        fprintf(stderr, "usage: %s string|compiled [COUNT]\n", argv[0]);
+        return 1;
+    }
+    compiled = strcmp(argv[1], "compiled") == 0;
+
+    netsnmp_ds_set_boolean(NETSNMP_DS_APPLICATION_ID,
+                           NETSNMP_DS_APP_NUMERIC_IP, 1);
+    init_snmp("trapformat_bench");
+    transport = netsnmp_transport_open_client("trapformat_bench",
+                                              "udp:127.0.0.1:162");
+    if (transport == NULL || (pdu = make_notification()) == NULL) {
+        fprintf(stderr, "could not set up the notification\n");
+        return 1;
+    }
+
+    for (f = 0; f < (int) (sizeof(formats) / sizeof(formats[0])); f++) {
+        fmt = compiled ? netsnmp_trapd_format_compile(formats[f][1]) : NULL;
+        best = 1e9;
+        for (r = 0; r < 5; r++) {
+            t0 = now_ms();
+            for (i = 0; i < count; i++) {
+                out_len = 0;
+                if (compiled) {
+                    if (buf == NULL) {
+                        buf_len = 64;
+                        if ((buf = malloc(buf_len)) == NULL)
+                            return 1;
+                    }
+                    realloc_format_compiled_trap_scratch(&buf, &buf_len,
+                                                         &out_len, 1, fmt,
+                                                         &scratch,
+                                                         &scratch_len,
+                                                         pdu, transport);
+                } else {
+                    buf_len = 64;
+                    if ((buf = calloc(buf_len, 1)) == NULL)
+                        return 1;
+                    realloc_format_trap(&buf, &buf_len, &out_len, 1,
+                                        formats[f][1], pdu, transport);
+                    if (i + 1 < count)
+                        SNMP_FREE(buf);
+                }
+            }
+            t = now_ms() - t0;
+            if (t < best)
+                best = t;
+            if (!compiled && r < 4)
+                SNMP_FREE(buf);
+        }
+        printf("%-8s %-8s %8.0f /s  %lu bytes\n", formats[f][0], argv[1],
+               count * 1e3 / best, (unsigned long) out_len);
+        if (f == 0 && argc > 3)
+            fwrite(buf, 1, out_len, stdout);
+        if (!compiled)
+            SNMP_FREE(buf);
+        netsnmp_trapd_format_free(fmt);
+    }
+
+    SNMP_FREE(buf);
+    SNMP_FREE(scratch);
+    snmp_free_pdu(pdu);
+    netsnmp_transport_free(transport);
+    snmp_shutdown("trapformat_bench");
+    return 0;
+}